@@ -0,0 +1,335 @@
+/*--
+    BatchFit.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//Fits every stroke in the given .pts, .cnc and .cstk files (or directories of them, or wildcard patterns) on several
+//threads and writes the results in input order as they are ready, to stdout or, with -o, to a file per stroke.
+//A throughput summary goes to stderr.  With -pack, the strokes are instead written to a stroke corpus file
+//(see StrokeCorpus.h), which is much faster to load for repeated bulk runs.
+//Strokes from .cnc files are fit with the parameters stored with them, unless -preset or -params is given.
+//A .pgm image of line art is vectorized: each outline of its ink is a stroke, so "-format svg scan.pgm" writes the
+//whole drawing as one SVG document.
+//Usage: BatchFit [-preset name | -params file] [-j threads] [-format primitives|bezier|svg] [-tolerance pixels]
+//                [-o directory] [-pack corpus.cstk] inputs...
+
+#include "StrokeFiles.h"
+#include "Cornucopia.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace Eigen;
+using namespace Cornu;
+
+enum Format
+{
+    PRIMITIVES,
+    BEZIER,
+    SVG
+};
+
+static const char *presetNames[Parameters::NUM_PRESETS] = { "default", "loose", "accurate", "polyline", "lines_and_arcs", "clothoid_only" };
+
+struct Result
+{
+    Result() : done(false), numPrimitives(0) {}
+
+    bool done;
+    int numPrimitives; //0 if the fit failed
+    string text;
+};
+
+static string fitStroke(const InputStroke &stroke, const Parameters &params, Format format, double tolerance, int &numPrimitives)
+{
+    Fitter fitter;
+    fitter.setParams(params);
+    fitter.setOriginalSketch(stroke.polyline());
+    fitter.run();
+    PrimitiveSequenceConstPtr curve = fitter.finalOutput();
+    numPrimitives = curve ? curve->primitives().size() : 0;
+
+    ostringstream out;
+    out.precision(10);
+    if(!curve)
+    {
+        out << (format == SVG ? "<!-- " : "# ") << stroke.name << ": fit failed" << (format == SVG ? " -->\n" : "\n");
+        return out.str();
+    }
+
+    const char *closedText = curve->isClosed() ? "closed" : "open";
+    if(format == PRIMITIVES)
+    {
+        const char *typeNames[3] = { "line", "arc", "clothoid" };
+        out << "# " << stroke.name << ": " << numPrimitives << " primitives, " << closedText << "\n";
+        for(int i = 0; i < curve->primitives().size(); ++i)
+        {
+            CurvePrimitiveConstPtr primitive = curve->primitives()[i];
+            out << typeNames[primitive->getType()];
+            for(int j = 0; j < primitive->numParams(); ++j)
+                out << " " << primitive->params()[j];
+            out << "\n";
+        }
+        return out.str();
+    }
+
+    BezierSplineConstPtr spline = curve->toAdaptiveBezierSpline(tolerance);
+    const BezierSpline::PrimitiveVector &beziers = spline->primitives();
+    if(format == BEZIER)
+    {
+        out << "# " << stroke.name << ": " << beziers.size() << " cubic Beziers, " << closedText << "\n";
+        for(int i = 0; i < beziers.size(); ++i)
+        {
+            for(int j = 0; j < 4; ++j)
+                out << (j ? " " : "") << beziers[i].controlPoint(j)[0] << " " << beziers[i].controlPoint(j)[1];
+            out << "\n";
+        }
+        return out.str();
+    }
+
+    out << "<path id=\"" << stroke.name << "\" fill=\"none\" stroke=\"black\" d=\"";
+    for(int i = 0; i < beziers.size(); ++i)
+    {
+        if(i == 0)
+            out << "M " << beziers[i].controlPoint(0)[0] << " " << beziers[i].controlPoint(0)[1];
+        out << " C";
+        for(int j = 1; j < 4; ++j)
+            out << " " << beziers[i].controlPoint(j)[0] << " " << beziers[i].controlPoint(j)[1];
+    }
+    out << (curve->isClosed() ? " Z" : "") << "\"/>\n";
+    return out.str();
+}
+
+static const char *svgHeader = "<svg xmlns=\"http://www.w3.org/2000/svg\">\n";
+static const char *svgFooter = "</svg>\n";
+
+//the stroke name with the characters that can't be in file names replaced
+static string outputFileName(const string &dir, const string &strokeName, Format format)
+{
+    string name = strokeName;
+    size_t slash = name.find_last_of("/\\");
+    if(slash != string::npos)
+        name = name.substr(slash + 1);
+    for(int i = 0; i < (int)name.size(); ++i)
+        if(name[i] == ':' || name[i] == '.')
+            name[i] = '_';
+    return dir + "/" + name + (format == SVG ? ".svg" : ".txt");
+}
+
+static void usage()
+{
+    fprintf(stderr, "Usage: BatchFit [-preset name | -params file] [-j threads] [-format primitives|bezier|svg] "
+                    "[-tolerance pixels] [-o directory] [-pack corpus.cstk] inputs...\nPresets:");
+    for(int i = 0; i < Parameters::NUM_PRESETS; ++i)
+        fprintf(stderr, " %s", presetNames[i]);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+    typedef chrono::steady_clock Clock;
+
+    Parameters params;
+    bool overrideParams = false;
+    int numThreads = max(1, (int)thread::hardware_concurrency());
+    Format format = PRIMITIVES;
+    double tolerance = 1.;
+    string outputDir, packFile;
+    vector<string> args;
+    for(int i = 1; i < argc; ++i)
+    {
+        string error;
+        if(!strcmp(argv[i], "-preset") && i + 1 < argc)
+        {
+            ++i;
+            int preset = 0;
+            while(preset < Parameters::NUM_PRESETS && strcmp(argv[i], presetNames[preset]))
+                ++preset;
+            if(preset == Parameters::NUM_PRESETS)
+            {
+                fprintf(stderr, "Unknown preset %s\n", argv[i]);
+                usage();
+                return 1;
+            }
+            params = Parameters((Parameters::Preset)preset);
+            overrideParams = true;
+        }
+        else if(!strcmp(argv[i], "-params") && i + 1 < argc)
+        {
+            if(!readParameterFile(argv[++i], params, error))
+            {
+                fprintf(stderr, "%s: %s\n", argv[i], error.c_str());
+                return 1;
+            }
+            overrideParams = true;
+        }
+        else if(!strcmp(argv[i], "-j") && i + 1 < argc)
+            numThreads = max(1, atoi(argv[++i]));
+        else if(!strcmp(argv[i], "-format") && i + 1 < argc)
+        {
+            ++i;
+            if(!strcmp(argv[i], "primitives"))
+                format = PRIMITIVES;
+            else if(!strcmp(argv[i], "bezier"))
+                format = BEZIER;
+            else if(!strcmp(argv[i], "svg"))
+                format = SVG;
+            else
+            {
+                fprintf(stderr, "Unknown format %s\n", argv[i]);
+                usage();
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "-tolerance") && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-o") && i + 1 < argc)
+            outputDir = argv[++i];
+        else if(!strcmp(argv[i], "-pack") && i + 1 < argc)
+            packFile = argv[++i];
+        else if(argv[i][0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+            args.push_back(argv[i]);
+    }
+
+    Clock::time_point start = Clock::now();
+
+    vector<string> files = expandInputs(args);
+    vector<InputStroke> strokes;
+    int numBadFiles = 0;
+    for(int i = 0; i < (int)files.size(); ++i)
+    {
+        string error;
+        if(!readStrokeFile(files[i], strokes, error))
+        {
+            fprintf(stderr, "%s: %s\n", files[i].c_str(), error.c_str());
+            ++numBadFiles;
+        }
+    }
+    if(strokes.empty())
+    {
+        fprintf(stderr, "No strokes to fit\n");
+        usage();
+        return 1;
+    }
+
+    if(!packFile.empty())
+    {
+        StrokeCorpusWriter writer;
+        writer.open(packFile);
+        for(int i = 0; i < (int)strokes.size(); ++i)
+            writer.add(strokes[i].polyline()->pts());
+        if(!writer.close())
+        {
+            fprintf(stderr, "Could not write %s\n", packFile.c_str());
+            return 1;
+        }
+        fprintf(stderr, "Packed %d strokes into %s\n", (int)strokes.size(), packFile.c_str());
+        return numBadFiles ? 1 : 0;
+    }
+
+    //the strokes are fit in parallel, so each fit runs on one thread
+    for(int i = 0; i < (int)strokes.size(); ++i)
+    {
+        if(overrideParams || !strokes[i].hasParams)
+            strokes[i].params = params;
+        if(numThreads > 1)
+            strokes[i].params.set(Parameters::MULTITHREADED, 0.);
+    }
+
+    //Workers fill in the results in any order while this thread writes them out in input order
+    vector<Result> results(strokes.size());
+    mutex resultMutex;
+    condition_variable resultReady;
+    ThreadPool pool(numThreads);
+    thread fitting([&]() {
+        pool.parallelFor((int)strokes.size(), [&](int i) {
+            Result result;
+            result.text = fitStroke(strokes[i], strokes[i].params, format, tolerance, result.numPrimitives);
+            result.done = true;
+            lock_guard<mutex> lock(resultMutex);
+            results[i] = std::move(result);
+            resultReady.notify_all();
+        });
+    });
+
+    long long numPts = 0, numPrimitives = 0;
+    int numFailed = 0, numWriteErrors = 0;
+    if(format == SVG && outputDir.empty())
+        fputs(svgHeader, stdout);
+    for(int i = 0; i < (int)strokes.size(); ++i)
+    {
+        Result result;
+        {
+            unique_lock<mutex> lock(resultMutex);
+            resultReady.wait(lock, [&]() { return results[i].done; });
+            result = std::move(results[i]);
+        }
+
+        numPts += strokes[i].numPts();
+        numPrimitives += result.numPrimitives;
+        numFailed += (result.numPrimitives == 0);
+        strokes[i].pts = PolylineConstPtr(); //done with the points
+        strokes[i].corpus.reset();
+
+        if(outputDir.empty())
+        {
+            fputs(result.text.c_str(), stdout);
+            fflush(stdout);
+            continue;
+        }
+
+        string fileName = outputFileName(outputDir, strokes[i].name, format);
+        FILE *file = fopen(fileName.c_str(), "w");
+        if(!file)
+        {
+            fprintf(stderr, "Could not write %s\n", fileName.c_str());
+            ++numWriteErrors;
+            continue;
+        }
+        if(format == SVG)
+            fputs(svgHeader, file);
+        fputs(result.text.c_str(), file);
+        if(format == SVG)
+            fputs(svgFooter, file);
+        fclose(file);
+    }
+    if(format == SVG && outputDir.empty())
+        fputs(svgFooter, stdout);
+    fitting.join();
+
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    fprintf(stderr, "Fit %d strokes (%lld points, %lld primitives) from %d files in %.3f s on %d threads: "
+                    "%.1f strokes/s, %.0f points/s, %d failed\n",
+            (int)strokes.size(), numPts, numPrimitives, (int)files.size() - numBadFiles, seconds, numThreads,
+            strokes.size() / seconds, numPts / seconds, numFailed);
+
+    return (numBadFiles || numFailed || numWriteErrors) ? 1 : 0;
+}
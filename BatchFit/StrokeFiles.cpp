@@ -0,0 +1,401 @@
+/*--
+    StrokeFiles.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StrokeFiles.h"
+#include "Algorithm.h"
+#include "JsonReader.h"
+#include "ContourTracer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace Eigen;
+using namespace Cornu;
+
+static string lowerCase(string s)
+{
+    for(int i = 0; i < (int)s.size(); ++i)
+        s[i] = (char)tolower(s[i]);
+    return s;
+}
+
+static bool isStrokeFile(const string &fileName)
+{
+    string lower = lowerCase(fileName);
+    return (lower.size() > 4 && (lower.compare(lower.size() - 4, 4, ".pts") == 0 || lower.compare(lower.size() - 4, 4, ".cnc") == 0 ||
+                                 lower.compare(lower.size() - 4, 4, ".pgm") == 0)) ||
+           (lower.size() > 5 && lower.compare(lower.size() - 5, 5, ".cstk") == 0);
+}
+
+#ifdef _WIN32
+static void findFiles(const string &pattern, const string &dir, bool strokeFilesOnly, vector<string> &out)
+{
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileA(pattern.c_str(), &data);
+    if(handle == INVALID_HANDLE_VALUE)
+        return;
+    do
+    {
+        if(!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && (!strokeFilesOnly || isStrokeFile(data.cFileName)))
+            out.push_back(dir + data.cFileName);
+    } while(FindNextFileA(handle, &data));
+    FindClose(handle);
+}
+#endif
+
+vector<string> expandInputs(const vector<string> &args)
+{
+    vector<string> out;
+    for(int i = 0; i < (int)args.size(); ++i)
+    {
+        const string &arg = args[i];
+#ifdef _WIN32
+        DWORD attributes = GetFileAttributesA(arg.c_str());
+        if(attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+            findFiles(arg + "\\*", arg + "\\", true, out);
+        else if(arg.find_first_of("*?") != string::npos)
+        {
+            size_t slash = arg.find_last_of("\\/");
+            findFiles(arg, slash == string::npos ? string() : arg.substr(0, slash + 1), false, out);
+        }
+        else
+            out.push_back(arg);
+#else
+        struct stat info;
+        if(stat(arg.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+        {
+            vector<string> files; //sorted, so that the order doesn't depend on the file system
+            if(DIR *dir = opendir(arg.c_str()))
+            {
+                while(dirent *entry = readdir(dir))
+                    if(isStrokeFile(entry->d_name))
+                        files.push_back(arg + "/" + entry->d_name);
+                closedir(dir);
+            }
+            sort(files.begin(), files.end());
+            out.insert(out.end(), files.begin(), files.end());
+        }
+        else if(arg.find_first_of("*?[") != string::npos)
+        {
+            glob_t matches;
+            if(glob(arg.c_str(), 0, NULL, &matches) == 0)
+                for(size_t j = 0; j < matches.gl_pathc; ++j)
+                    out.push_back(matches.gl_pathv[j]);
+            globfree(&matches);
+        }
+        else
+            out.push_back(arg);
+#endif
+    }
+    return out;
+}
+
+//Applies a setting from a .cnc sketch or a parameter file.  Returns false if the name isn't a parameter or a stage.
+static bool applySetting(const string &name, bool isNumber, double number, const string &text, Parameters &params)
+{
+    const vector<Parameters::Parameter> &parameters = Parameters::parameters();
+    for(int i = 0; isNumber && i < (int)parameters.size(); ++i)
+    {
+        if(lowerCase(parameters[i].typeName) == lowerCase(name))
+        {
+            params.set(parameters[i].type, number);
+            return true;
+        }
+    }
+
+    for(int stage = 0; stage < NUM_ALGORITHM_STAGES; ++stage)
+    {
+        if(lowerCase(AlgorithmBase::get((AlgorithmStage)stage, 0)->stageName()) != lowerCase(name))
+            continue;
+        for(int i = 0; i < AlgorithmBase::numAlgorithmsForStage((AlgorithmStage)stage); ++i)
+        {
+            if(isNumber ? i == (int)number : lowerCase(AlgorithmBase::get((AlgorithmStage)stage, i)->name()) == lowerCase(text))
+            {
+                params.setAlgorithm(stage, i);
+                return true;
+            }
+        }
+        return false;
+    }
+    return false;
+}
+
+//The big-endian QDataStream format: a 32-bit point count followed by double x, y pairs
+static PolylineConstPtr readPts(istream &in)
+{
+    unsigned char buffer[8];
+    if(!in.read((char *)buffer, 4))
+        return PolylineConstPtr();
+    unsigned int sz = (buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+    if(sz < 2 || sz > 10000000)
+        return PolylineConstPtr();
+
+    VectorC<Vector2d> pts(sz, NOT_CIRCULAR);
+    for(int i = 0; i < (int)sz; ++i)
+    {
+        for(int j = 0; j < 2; ++j)
+        {
+            if(!in.read((char *)buffer, 8))
+                return PolylineConstPtr();
+            unsigned long long bits = 0;
+            for(int k = 0; k < 8; ++k)
+                bits = (bits << 8) | buffer[k];
+            memcpy(&pts[i][j], &bits, 8);
+        }
+    }
+    return new Polyline(std::move(pts));
+}
+
+static bool readCnc(const string &fileName, const string &text, vector<InputStroke> &out, string &error)
+{
+    JsonReader reader(text.data(), text.data() + text.size());
+    if(reader.next() != JsonReader::BEGIN_ARRAY)
+    {
+        error = "not a JSON array of sketches";
+        return false;
+    }
+
+    for(int i = 0; reader.next() != JsonReader::END_ARRAY; ++i)
+    {
+        InputStroke stroke;
+        ostringstream name;
+        name << fileName << ":" << i;
+        stroke.name = name.str();
+        stroke.hasParams = true;
+
+        if(reader.token() != JsonReader::BEGIN_OBJECT)
+        {
+            if(!reader.skipRest())
+            {
+                error = "malformed JSON after sketch " + name.str();
+                return false;
+            }
+            continue;
+        }
+
+        while(reader.next() == JsonReader::STRING)
+        {
+            string key = reader.text();
+            JsonReader::Token value = reader.next();
+            if(key == "pts")
+            {
+                VectorC<Vector2d> pts;
+                if(value != JsonReader::BEGIN_ARRAY || !reader.readPoints(pts))
+                {
+                    error = "sketch " + name.str() + " has bad points";
+                    return false;
+                }
+                if(pts.size() >= 2)
+                    stroke.pts = new Polyline(std::move(pts));
+            }
+            else if(value == JsonReader::NUMBER || value == JsonReader::STRING)
+                applySetting(key, value == JsonReader::NUMBER, reader.number(), reader.text(), stroke.params);
+            else if(!reader.skipRest())
+                break;
+        }
+        if(reader.token() != JsonReader::END_OBJECT)
+        {
+            error = "malformed JSON in sketch " + name.str();
+            return false;
+        }
+
+        if(stroke.pts)
+            out.push_back(stroke);
+    }
+    return true;
+}
+
+static bool readCorpus(const string &fileName, vector<InputStroke> &out, string &error)
+{
+    shared_ptr<StrokeCorpus> corpus(new StrokeCorpus());
+    if(!corpus->open(fileName))
+    {
+        error = corpus->error();
+        return false;
+    }
+
+    for(int i = 0; i < corpus->size(); ++i)
+    {
+        InputStroke stroke;
+        ostringstream name;
+        name << fileName << ":" << i;
+        stroke.name = name.str();
+        stroke.corpus = corpus;
+        stroke.span = corpus->stroke(i);
+        if(stroke.span.size >= 2)
+            out.push_back(stroke);
+    }
+    return true;
+}
+
+//The next number in a PGM header, skipping whitespace and # comments
+static bool readPgmNumber(istream &in, int &out)
+{
+    while(in && (isspace(in.peek()) || in.peek() == '#'))
+    {
+        if(in.get() == '#')
+            in.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+    return (bool)(in >> out);
+}
+
+//Binary (P5) or text (P2) grayscale images with at most 8 bits per pixel.  The outlines of the dark regions are
+//traced (see ContourTracer.h), and each one is a stroke.
+static bool readPgm(const string &fileName, istream &in, vector<InputStroke> &out, string &error)
+{
+    char magic[2];
+    int width, height, maxValue;
+    if(!in.read(magic, 2) || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '2') ||
+       !readPgmNumber(in, width) || !readPgmNumber(in, height) || !readPgmNumber(in, maxValue) ||
+       width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 255)
+    {
+        error = "not an 8-bit PGM image";
+        return false;
+    }
+
+    vector<unsigned char> pixels((size_t)width * height);
+    if(magic[1] == '5')
+    {
+        in.get(); //the single whitespace character before the pixels
+        in.read((char *)&pixels[0], pixels.size());
+    }
+    for(size_t i = 0; in && i < pixels.size(); ++i)
+    {
+        int value = pixels[i];
+        if(magic[1] == '2' && !readPgmNumber(in, value))
+            break;
+        pixels[i] = (unsigned char)min(255, value * 255 / maxValue);
+    }
+    if(!in)
+    {
+        error = "the image is truncated";
+        return false;
+    }
+
+    ImageContours contours;
+    traceContours(&pixels[0], width, height, width, 128., contours, ThreadPool::global());
+    for(int i = 0; i < contours.numContours(); ++i)
+    {
+        InputStroke stroke;
+        ostringstream name;
+        name << fileName << ":" << i;
+        stroke.name = name.str();
+        VectorC<Vector2d> pts((int)(contours.offsets[i + 1] - contours.offsets[i]), NOT_CIRCULAR);
+        for(int j = 0; j < pts.size(); ++j)
+            pts[j] = Vector2d(contours.xy[2 * (contours.offsets[i] + j)], contours.xy[2 * (contours.offsets[i] + j) + 1]);
+        stroke.pts = new Polyline(std::move(pts));
+        out.push_back(stroke);
+    }
+    return true;
+}
+
+bool readStrokeFile(const string &fileName, vector<InputStroke> &out, string &error)
+{
+    string lower = lowerCase(fileName);
+    if(lower.size() > 5 && lower.compare(lower.size() - 5, 5, ".cstk") == 0)
+        return readCorpus(fileName, out, error);
+
+    ifstream in(fileName.c_str(), ios::binary);
+    if(!in)
+    {
+        error = "could not open the file";
+        return false;
+    }
+
+    if(lower.size() > 4 && lower.compare(lower.size() - 4, 4, ".cnc") == 0)
+    {
+        ostringstream text;
+        text << in.rdbuf();
+        return readCnc(fileName, text.str(), out, error);
+    }
+
+    if(lower.size() > 4 && lower.compare(lower.size() - 4, 4, ".pgm") == 0)
+        return readPgm(fileName, in, out, error);
+
+    InputStroke stroke;
+    stroke.name = fileName;
+    stroke.pts = readPts(in);
+    if(!stroke.pts)
+    {
+        error = "not a .pts file";
+        return false;
+    }
+    out.push_back(stroke);
+    return true;
+}
+
+static string trimmed(const string &s)
+{
+    size_t start = s.find_first_not_of(" \t\r\n"), end = s.find_last_not_of(" \t\r\n");
+    return start == string::npos ? string() : s.substr(start, end - start + 1);
+}
+
+bool readParameterFile(const string &fileName, Parameters &params, string &error)
+{
+    ifstream in(fileName.c_str());
+    if(!in)
+    {
+        error = "could not open the file";
+        return false;
+    }
+
+    string line;
+    for(int lineNum = 1; getline(in, line); ++lineNum)
+    {
+        line = trimmed(line);
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        ostringstream where;
+        where << "line " << lineNum;
+        size_t equals = line.find('=');
+        if(equals == string::npos)
+        {
+            error = where.str() + " has no =";
+            return false;
+        }
+        string name = trimmed(line.substr(0, equals)), value = trimmed(line.substr(equals + 1));
+
+        double number = 0.;
+        bool isNumber = JsonReader::parseNumber(value.data(), value.data() + value.size(), number);
+        if(!applySetting(name, isNumber, number, value, params))
+        {
+            error = where.str() + ": unknown setting " + name + " = " + value;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+/*--
+    StrokeFiles.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_STROKEFILES_H_INCLUDED
+#define CORNUCOPIA_STROKEFILES_H_INCLUDED
+
+#include "Parameters.h"
+#include "Polyline.h"
+#include "StrokeCorpus.h"
+
+#include <memory>
+
+#include <string>
+#include <vector>
+
+//Reading the stroke and parameter files BatchFit takes, without Qt
+
+struct InputStroke
+{
+    InputStroke() : hasParams(false) {}
+
+    int numPts() const { return pts ? pts->pts().size() : span.size; }
+    Cornu::PolylineConstPtr polyline() const { return pts ? pts : Cornu::PolylineConstPtr(span.toPolyline()); }
+
+    std::string name; //the file name, followed by the index of the sketch for .cnc and stroke corpus files
+    Cornu::PolylineConstPtr pts;
+    //Strokes in a stroke corpus are left in the mapped file until they are fit
+    std::shared_ptr<Cornu::StrokeCorpus> corpus;
+    Cornu::StrokeSpan span;
+    bool hasParams; //.cnc files store parameters with each sketch
+    Cornu::Parameters params;
+};
+
+//Expands directories into the .pts, .cnc, .cstk and .pgm files in them and wildcard patterns into the files they match.
+//Other arguments are taken to be file names.
+std::vector<std::string> expandInputs(const std::vector<std::string> &args);
+
+//Reads DemoUI's .pts files (one stroke in big-endian binary), .cnc files (JSON with an array of sketches,
+//each with a "pts" array of alternating coordinates and its parameters), stroke corpus .cstk files (see
+//StrokeCorpus.h) and grayscale .pgm images, e.g., scanned line art, whose ink outlines are traced (see
+//ContourTracer.h) into a stroke each.  Oversketching relations between the sketches are ignored.  Returns false
+//and sets error if the file can't be read.
+bool readStrokeFile(const std::string &fileName, std::vector<InputStroke> &out, std::string &error);
+
+//Reads a text file with a "name = value" line per setting.  The name is a parameter name, as in .cnc files
+//(e.g., Error cost), or a stage name (e.g., Path Finding), and the value is a number or, for a stage, the name
+//or index of an algorithm.  Lines starting with # are comments.  The settings are applied to params.
+bool readParameterFile(const std::string &fileName, Cornu::Parameters &params, std::string &error);
+
+#endif //CORNUCOPIA_STROKEFILES_H_INCLUDED
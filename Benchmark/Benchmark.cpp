@@ -0,0 +1,406 @@
+/*--
+    Benchmark.cpp
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//Fits every stroke of the corpus with every parameter preset several times and prints the per-stage median and
+//95th percentile wall times, the throughput, the number of allocations, the peak bytes held through the fit's
+//Allocator and the work counts (see FitMetrics) per fit as JSON on stdout.
+//With -kernels, times the primitive kernels instead (see KernelBenchmark.h), taking medians over runs batches.
+//With -trace, also writes a Chrome trace of the fits to the given file (the most recent events, if there are many).
+//With -capture, writes a snapshot (see Fitter::writeSnapshot) of every fit, taken before the given stage, to the
+//given directory instead, along with a snapshots.txt listing them.  With -replay, reruns the snapshots listed in
+//the given directory and prints the times of the stage they were taken before, so that stage can be timed alone,
+//and of the whole reruns.  Slow fit captures (see Fitter::setSlowFitCapture) are replayed the same way, and the
+//total time of the run a snapshot was written after is printed with them.
+//Stages are given by index or by name without spaces, e.g., pathfinding.
+//Usage: Benchmark [-n runs] [-kernels] [-trace file] [-capture stage directory] [-replay directory] [corpus directory]
+
+#include "KernelBenchmark.h"
+#include "Cornucopia.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+using namespace std;
+using namespace Eigen;
+using namespace Cornu;
+
+#ifndef CORNUCOPIA_BENCHMARK_CORPUS
+#define CORNUCOPIA_BENCHMARK_CORPUS "Corpus"
+#endif
+
+//Allocation counting.  With glibc, malloc itself is intercepted, so Eigen's allocations are counted along with
+//operator new's.  Elsewhere only operator new is.
+static atomic<long long> numAllocations(0);
+static atomic<long long> allocatedBytes(0);
+
+static void countAllocation(size_t size)
+{
+    numAllocations.fetch_add(1, memory_order_relaxed);
+    allocatedBytes.fetch_add((long long)size, memory_order_relaxed);
+}
+
+#if defined(__GLIBC__)
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) { countAllocation(size); return __libc_malloc(size); }
+void *calloc(size_t num, size_t size) { countAllocation(num * size); return __libc_calloc(num, size); }
+void *realloc(void *ptr, size_t size) { countAllocation(size); return __libc_realloc(ptr, size); }
+}
+#else
+void *operator new(size_t size)
+{
+    countAllocation(size);
+    if(void *out = std::malloc(size ? size : 1))
+        return out;
+    throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+#endif
+
+struct Stroke
+{
+    string name;
+    PolylineConstPtr pts;
+};
+
+//Reads DemoUI's .pts format: a big-endian 32-bit point count followed by big-endian double x, y pairs.
+static bool readPts(const string &fileName, VectorC<Vector2d> &out)
+{
+    ifstream in(fileName.c_str(), ios::binary);
+    unsigned char buffer[8];
+    if(!in.read((char *)buffer, 4))
+        return false;
+    unsigned int sz = (buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+    if(sz > 10000)
+        return false;
+
+    out = VectorC<Vector2d>(sz, NOT_CIRCULAR);
+    for(int i = 0; i < (int)sz; ++i)
+    {
+        for(int j = 0; j < 2; ++j)
+        {
+            if(!in.read((char *)buffer, 8))
+                return false;
+            unsigned long long bits = 0;
+            for(int k = 0; k < 8; ++k)
+                bits = (bits << 8) | buffer[k];
+            memcpy(&out[i][j], &bits, 8);
+        }
+    }
+    return true;
+}
+
+static vector<Stroke> readCorpus(const string &dir)
+{
+    vector<Stroke> out;
+    ifstream manifest((dir + "/corpus.txt").c_str());
+    string line;
+    while(getline(manifest, line))
+    {
+        if(line.empty() || line[0] == '#')
+            continue;
+        VectorC<Vector2d> pts;
+        if(!readPts(dir + "/" + line + ".pts", pts))
+        {
+            fprintf(stderr, "Could not read %s/%s.pts\n", dir.c_str(), line.c_str());
+            continue;
+        }
+        Stroke stroke;
+        stroke.name = line;
+        stroke.pts = new Polyline(std::move(pts));
+        out.push_back(stroke);
+    }
+    return out;
+}
+
+//returns the sample at the given fraction (nearest rank) of the sorted samples
+static double percentile(vector<double> samples, double fraction)
+{
+    sort(samples.begin(), samples.end());
+    int idx = (int)ceil(fraction * samples.size()) - 1;
+    return samples[max(0, min((int)samples.size() - 1, idx))];
+}
+
+static void printTimes(const vector<double> &times)
+{
+    printf("{ \"median_ms\": %.4f, \"p95_ms\": %.4f }", 1000. * percentile(times, 0.5), 1000. * percentile(times, 0.95));
+}
+
+static void printCounters(const vector<vector<double> > &counters)
+{
+    printf("{");
+    for(int i = 0; i < FitMetrics::NUM_COUNTERS; ++i)
+        printf("%s \"%s\": %.0f", i ? "," : "", FitMetrics::counterName((FitMetrics::Counter)i), percentile(counters[i], 0.5));
+    printf(" }");
+}
+
+static string stageName(int stage)
+{
+    return AlgorithmBase::get((AlgorithmStage)stage, 0)->stageName();
+}
+
+//accepts the stage index or its name, ignoring case and spaces; returns -1 if there is no such stage
+static int parseStage(const string &arg)
+{
+    if(!arg.empty() && isdigit(arg[0]))
+        return atoi(arg.c_str()) < NUM_ALGORITHM_STAGES ? atoi(arg.c_str()) : -1;
+    for(int stage = 0; stage < NUM_ALGORITHM_STAGES; ++stage)
+    {
+        string name;
+        for(int i = 0; i < (int)stageName(stage).size(); ++i)
+            if(stageName(stage)[i] != ' ')
+                name += (char)tolower(stageName(stage)[i]);
+        string lowerArg;
+        for(int i = 0; i < (int)arg.size(); ++i)
+            lowerArg += (char)tolower(arg[i]);
+        if(name == lowerArg)
+            return stage;
+    }
+    return -1;
+}
+
+static string fileNamePart(const string &name)
+{
+    string out = name;
+    for(int i = 0; i < (int)out.size(); ++i)
+        if(!isalnum(out[i]))
+            out[i] = '_';
+    return out;
+}
+
+static int capture(const vector<Stroke> &strokes, AlgorithmStage stage, const string &dir)
+{
+    ofstream manifest((dir + "/snapshots.txt").c_str());
+    if(!manifest)
+    {
+        fprintf(stderr, "Could not write %s/snapshots.txt\n", dir.c_str());
+        return 1;
+    }
+    for(int preset = 0; preset < Parameters::NUM_PRESETS; ++preset)
+    {
+        Parameters params((Parameters::Preset)preset);
+        for(int s = 0; s < (int)strokes.size(); ++s)
+        {
+            Fitter fitter;
+            fitter.setParams(params);
+            fitter.setOriginalSketch(strokes[s].pts);
+            fitter.run();
+
+            string name = fileNamePart(params.name()) + "_" + strokes[s].name;
+            ofstream out((dir + "/" + name + ".snp").c_str(), ios::binary);
+            if(!fitter.writeSnapshot(out, stage))
+            {
+                fprintf(stderr, "Could not write %s/%s.snp\n", dir.c_str(), name.c_str());
+                return 1;
+            }
+            manifest << name << "\n";
+        }
+    }
+    return 0;
+}
+
+static int replay(const string &dir, int runs)
+{
+    ifstream manifest((dir + "/snapshots.txt").c_str());
+    string name;
+    int numReplayed = 0;
+    printf("{\n  \"runs\": %d,\n  \"results\": [", runs);
+    while(getline(manifest, name))
+    {
+        if(name.empty() || name[0] == '#')
+            continue;
+        ifstream in((dir + "/" + name + ".snp").c_str(), ios::binary);
+        ostringstream data;
+        data << in.rdbuf();
+
+        int stage = -1;
+        double capturedTime = 0.;
+        vector<double> times, totalTimes;
+        vector<vector<double> > counters(FitMetrics::NUM_COUNTERS);
+        for(int run = -1; run < runs; ++run)
+        {
+            istringstream snapshot(data.str());
+            Fitter fitter;
+            if(!fitter.loadSnapshot(snapshot))
+            {
+                fprintf(stderr, "Could not read %s/%s.snp\n", dir.c_str(), name.c_str());
+                return 1;
+            }
+            capturedTime = fitter.metrics().totalTime();
+            fitter.run();
+
+            //the first stage that ran is the one the snapshot was taken before
+            for(stage = 0; stage < NUM_ALGORITHM_STAGES - 1; ++stage)
+                if(fitter.metrics().stageTime((AlgorithmStage)stage) > 0.)
+                    break;
+            if(run < 0)
+                continue;
+            times.push_back(fitter.metrics().stageTime((AlgorithmStage)stage));
+            totalTimes.push_back(fitter.metrics().totalTime());
+            for(int i = 0; i < FitMetrics::NUM_COUNTERS; ++i)
+                counters[i].push_back(double(fitter.metrics().counter((FitMetrics::Counter)i)));
+        }
+
+        printf("%s\n    { \"snapshot\": \"%s\", \"stage\": \"%s\", \"time\": ", numReplayed++ ? "," : "",
+               name.c_str(), stageName(stage).c_str());
+        printTimes(times);
+        printf(", \"total\": ");
+        printTimes(totalTimes);
+        printf(", \"captured_total_ms\": %.4f, \"counters\": ", 1000. * capturedTime);
+        printCounters(counters);
+        printf(" }");
+    }
+    printf("\n  ]\n}\n");
+
+    if(!numReplayed)
+    {
+        fprintf(stderr, "No snapshots in %s/snapshots.txt\n", dir.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 20;
+    bool kernels = false;
+    int captureStage = -1;
+    string traceFile, captureDir, replayDir;
+    string corpusDir = CORNUCOPIA_BENCHMARK_CORPUS;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-n") && i + 1 < argc)
+            runs = max(1, atoi(argv[++i]));
+        else if(!strcmp(argv[i], "-kernels"))
+            kernels = true;
+        else if(!strcmp(argv[i], "-trace") && i + 1 < argc)
+            traceFile = argv[++i];
+        else if(!strcmp(argv[i], "-capture") && i + 2 < argc)
+        {
+            captureStage = parseStage(argv[++i]);
+            captureDir = argv[++i];
+            if(captureStage < 0)
+            {
+                fprintf(stderr, "Unknown stage %s\n", argv[i - 1]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "-replay") && i + 1 < argc)
+            replayDir = argv[++i];
+        else
+            corpusDir = argv[i];
+    }
+
+    if(kernels)
+    {
+        runKernelBenchmarks(runs);
+        return 0;
+    }
+    if(!replayDir.empty())
+        return replay(replayDir, runs);
+
+    vector<Stroke> strokes = readCorpus(corpusDir);
+    if(strokes.empty())
+    {
+        fprintf(stderr, "No strokes in the corpus at %s\n", corpusDir.c_str());
+        return 1;
+    }
+
+    if(!captureDir.empty())
+        return capture(strokes, (AlgorithmStage)captureStage, captureDir);
+
+    Trace::setEnabled(!traceFile.empty());
+
+    printf("{\n  \"runs\": %d,\n  \"results\": [", runs);
+    for(int preset = 0; preset < Parameters::NUM_PRESETS; ++preset)
+    {
+        Parameters params((Parameters::Preset)preset);
+
+        for(int s = 0; s < (int)strokes.size(); ++s)
+        {
+            vector<vector<double> > stageTimes(NUM_ALGORITHM_STAGES);
+            vector<vector<double> > counters(FitMetrics::NUM_COUNTERS);
+            vector<double> totalTimes, allocations, bytes, peakBytes;
+
+            for(int run = -1; run < runs; ++run) //the first run warms up caches and lazily built tables
+            {
+                FitMetrics metrics;
+                long long allocationsBefore = numAllocations, bytesBefore = allocatedBytes;
+                {
+                    Fitter fitter;
+                    fitter.setParams(params);
+                    fitter.setOriginalSketch(strokes[s].pts);
+                    fitter.run();
+                    metrics = fitter.metrics();
+                }
+                if(run < 0)
+                    continue;
+
+                allocations.push_back(double(numAllocations - allocationsBefore));
+                bytes.push_back(double(allocatedBytes - bytesBefore));
+                peakBytes.push_back(double(metrics.peakBytes()));
+                totalTimes.push_back(metrics.totalTime());
+                for(int stage = 0; stage < NUM_ALGORITHM_STAGES; ++stage)
+                    stageTimes[stage].push_back(metrics.stageTime((AlgorithmStage)stage));
+                for(int i = 0; i < FitMetrics::NUM_COUNTERS; ++i)
+                    counters[i].push_back(double(metrics.counter((FitMetrics::Counter)i)));
+            }
+
+            int numPts = strokes[s].pts->pts().size();
+            printf("%s\n    {\n", (preset || s) ? "," : "");
+            printf("      \"preset\": \"%s\",\n      \"stroke\": \"%s\",\n      \"points\": %d,\n",
+                   params.name().c_str(), strokes[s].name.c_str(), numPts);
+            printf("      \"total\": ");
+            printTimes(totalTimes);
+            printf(",\n      \"points_per_second\": %.1f,\n", numPts / max(1e-9, percentile(totalTimes, 0.5)));
+            printf("      \"allocations\": %.0f,\n      \"allocated_bytes\": %.0f,\n      \"peak_bytes\": %.0f,\n",
+                   percentile(allocations, 0.5), percentile(bytes, 0.5), percentile(peakBytes, 0.5));
+            printf("      \"counters\": ");
+            printCounters(counters);
+            printf(",\n      \"stages\": {");
+            for(int stage = 0; stage < NUM_ALGORITHM_STAGES; ++stage)
+            {
+                printf("%s\n        \"%s\": ", stage ? "," : "", stageName(stage).c_str());
+                printTimes(stageTimes[stage]);
+            }
+            printf("\n      }\n    }");
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    if(!traceFile.empty() && !Trace::writeChromeJson(traceFile))
+    {
+        fprintf(stderr, "Could not write %s\n", traceFile.c_str());
+        return 1;
+    }
+
+    return 0;
+}
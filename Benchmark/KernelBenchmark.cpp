@@ -0,0 +1,208 @@
+/*--
+    KernelBenchmark.cpp
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "KernelBenchmark.h"
+#include "Cornucopia.h"
+#include "Fresnel.h"
+#include "ErrorComputer.h"
+#include "PrimitiveFitter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+using namespace Eigen;
+using namespace Cornu;
+
+static volatile double sink; //results go here so that the timed loops aren't optimized away
+
+//Calls op, which does opsPerCall operations, in batches of about 10ms and returns the median time per operation
+template<typename Op>
+static double nsPerOp(const Op &op, int opsPerCall, int batches)
+{
+    typedef chrono::steady_clock Clock;
+
+    int calls = 1;
+    while(true)
+    {
+        Clock::time_point start = Clock::now();
+        for(int i = 0; i < calls; ++i)
+            op();
+        if(chrono::duration<double>(Clock::now() - start).count() > 0.01)
+            break;
+        calls *= 2;
+    }
+
+    vector<double> times;
+    for(int b = 0; b < batches; ++b)
+    {
+        Clock::time_point start = Clock::now();
+        for(int i = 0; i < calls; ++i)
+            op();
+        times.push_back(chrono::duration<double>(Clock::now() - start).count() * 1e9 / (double(calls) * opsPerCall));
+    }
+    sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+static bool firstKernel = true;
+
+static void printKernel(const char *name, const char *variant, const char *range, double ns)
+{
+    printf("%s\n    { \"kernel\": \"%s\", \"variant\": \"%s\", \"range\": \"%s\", \"ns_per_op\": %.3f }",
+           firstKernel ? "" : ",", name, variant, range, ns);
+    firstKernel = false;
+}
+
+typedef void (*ScalarFresnel)(double, double *, double *);
+typedef void (*VectorFresnel)(const VectorXd &, VectorXd *, VectorXd *);
+
+static void benchmarkFresnel(const char *name, ScalarFresnel scalar, VectorFresnel vector, int batches)
+{
+    const int num = 1024;
+    const char *rangeNames[3] = { "|t| < 1", "|t| < 5", "|t| < 30" };
+    const double ranges[3] = { 1., 5., 30. };
+
+    for(int r = 0; r < 3; ++r)
+    {
+        VectorXd t = VectorXd::LinSpaced(num, -ranges[r], ranges[r]), s, c;
+
+        printKernel(name, "scalar", rangeNames[r], nsPerOp([&]() {
+            double sum = 0., si, ci;
+            for(int i = 0; i < num; ++i)
+            {
+                scalar(t[i], &si, &ci);
+                sum += si + ci;
+            }
+            sink = sum;
+        }, num, batches));
+
+        printKernel(name, "vector", rangeNames[r], nsPerOp([&]() { vector(t, &s, &c); sink = s[0] + c[num - 1]; }, num, batches));
+    }
+}
+
+static void benchmarkCurve(const char *name, CurvePrimitiveConstPtr curve, int batches)
+{
+    const int num = 1024;
+    VectorXd s = VectorXd::LinSpaced(num, 0., curve->length());
+
+    //points scattered up to 20 units off the curve for projection
+    vector<Vector2d, aligned_allocator<Vector2d> > pts(num);
+    for(int i = 0; i < num; ++i)
+    {
+        Vector2d pos, der;
+        curve->eval(s[i], &pos, &der);
+        pts[i] = pos + 20. * sin(i * 0.37) * Vector2d(-der[1], der[0]);
+    }
+
+    printKernel(name, "eval", "whole curve", nsPerOp([&]() {
+        Vector2d pos, der, sum(0., 0.);
+        for(int i = 0; i < num; ++i)
+        {
+            curve->eval(s[i], &pos, &der);
+            sum += pos + der;
+        }
+        sink = sum[0];
+    }, num, batches));
+
+    Matrix2Xd pos;
+    printKernel(name, "evalBatch", "whole curve", nsPerOp([&]() { curve->evalBatch(s, &pos); sink = pos(0, 0); }, num, batches));
+
+    printKernel(name, "project", "20 units off", nsPerOp([&]() {
+        double sum = 0.;
+        for(int i = 0; i < num; ++i)
+            sum += curve->project(pts[i]);
+        sink = sum;
+    }, num, batches));
+
+    printKernel(name, "derivativeAt", "whole curve", nsPerOp([&]() {
+        CurvePrimitive::ParamDer der, derTan;
+        double sum = 0.;
+        for(int i = 0; i < num; ++i)
+        {
+            curve->derivativeAt(s[i], der, derTan);
+            sum += der(0, 0) + derTan(1, 0);
+        }
+        sink = sum;
+    }, num, batches));
+}
+
+static void benchmarkErrorVector(int batches)
+{
+    //fit a wavy stroke and time the error of the candidate primitives against it
+    VectorC<Vector2d> pts(400, NOT_CIRCULAR);
+    for(int i = 0; i < pts.size(); ++i)
+        pts[i] = Vector2d(100. + 2. * i, 300. + 80. * sin(i * 0.03) + 20. * sin(i * 0.11));
+
+    Fitter fitter;
+    fitter.setOriginalSketch(new Polyline(pts));
+    fitter.run();
+
+    const ErrorComputer &errorComputer = *fitter.output<ERROR_COMPUTER>()->errorComputer;
+    const vector<FitPrimitive> &primitives = fitter.output<PRIMITIVE_FITTING>()->primitives;
+
+    const char *types[3] = { "line", "arc", "clothoid" };
+    VectorXd error;
+    MatrixXd errorDer;
+    for(int type = 0; type < 3; ++type)
+    {
+        vector<FitPrimitive> ofType;
+        int samples = 0;
+        for(int i = 0; i < (int)primitives.size(); ++i)
+        {
+            if(primitives[i].isFixed() || primitives[i].startIdx < 0 || primitives[i].curve->getType() != type)
+                continue;
+            ofType.push_back(primitives[i]);
+            samples += primitives[i].numPts;
+        }
+        if(ofType.empty())
+            continue;
+
+        printKernel("computeErrorVector", types[type], "per sample", nsPerOp([&]() {
+            double sum = 0.;
+            for(int i = 0; i < (int)ofType.size(); ++i)
+            {
+                errorComputer.computeErrorVector(ofType[i].curve, ofType[i].startIdx, ofType[i].endIdx, error, &errorDer);
+                sum += error[0];
+            }
+            sink = sum;
+        }, samples, batches));
+    }
+}
+
+void runKernelBenchmarks(int batches)
+{
+    printf("{\n  \"batches\": %d,\n  \"fresnel_vectorization\": \"%s\",\n  \"results\": [", batches, fresnelVectorization());
+
+    benchmarkFresnel("fresnel", fresnel, fresnel, batches);
+    benchmarkFresnel("fresnelApprox", fresnelApprox, fresnelApprox, batches);
+    benchmarkFresnel("fresnelTable", fresnelTable, fresnelTable, batches);
+
+    benchmarkCurve("Arc", new Arc(Vector2d(0., 0.), 0.3, 150., 0.02), batches);
+    ClothoidPtr clothoid = new Clothoid(Vector2d(0., 0.), 0.3, 150., -0.02, 0.03);
+    benchmarkCurve("Clothoid", clothoid, batches);
+    clothoid = static_pointer_cast<Clothoid>(clothoid->clone());
+    clothoid->setAccuracy(Clothoid::FULL_ACCURACY);
+    benchmarkCurve("Clothoid (full accuracy)", clothoid, batches);
+
+    benchmarkErrorVector(batches);
+
+    printf("\n  ]\n}\n");
+}
@@ -0,0 +1,29 @@
+/*--
+    KernelBenchmark.h
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_KERNELBENCHMARK_H_INCLUDED
+#define CORNUCOPIA_KERNELBENCHMARK_H_INCLUDED
+
+//Times the Fresnel integrals, curve evaluation, projection and derivatives and the error computation in
+//nanoseconds per operation, and prints them as JSON on stdout.  batches is the number of timed batches
+//each median is taken over.
+void runKernelBenchmarks(int batches);
+
+#endif //CORNUCOPIA_KERNELBENCHMARK_H_INCLUDED
@@ -39,7 +39,8 @@ bool AlgorithmBase::_initializationFinished = false;
 
 const std::vector<std::vector<AlgorithmBase *> > &AlgorithmBase::_getAlgorithms()
 {
-    _initialize();
+    static const bool initialized = (_initialize(), true); //function-local static initialization is thread-safe
+    (void)initialized;
     return _algorithms;
 }
 
@@ -47,7 +48,7 @@ void AlgorithmBase::_addAlgorithm(int stage, AlgorithmBase *algorithm)
 {
     if(_initializationFinished)
     {
-        Debugging::get()->printf("ERROR: Attempting to create algorithm too late!");
+        CORNU_DEBUG(printf("ERROR: Attempting to create algorithm too late!"));
         return; //Noop
     }
     _algorithms[stage].push_back(algorithm);
@@ -47,10 +47,27 @@ enum AlgorithmStage
     NUM_ALGORITHM_STAGES //must be last
 };
 
+class Fitter;
+class SnapshotWriter;
+class SnapshotReader;
+
 struct AlgorithmOutputBase : public smart_base
 {
+    //estimated, in bytes--objects shared with other outputs are counted by each of them
+    virtual size_t memoryUsage() const = 0;
+    //empties the output for its stage to fill in again, keeping the capacity of its containers
+    virtual void recycle() = 0;
+
+    //Binary serialization for snapshots (see Fitter::writeSnapshot).  Members that are built from earlier outputs,
+    //like the error computer, are not written: read() builds them again from the outputs the fitter already has.
+    virtual void write(SnapshotWriter &out) const = 0;
+    virtual void read(SnapshotReader &in, const Fitter &fitter) = 0;
 };
 
+//the estimated heap memory of a std::vector or VectorC
+template<typename VectorType>
+size_t vectorMemory(const VectorType &v) { return v.capacity() * sizeof(typename VectorType::value_type); }
+
 CORNU_SMART_TYPEDEFS(AlgorithmOutputBase);
 
 //The output of an algorithm stage.  It is specialized for every stage.
@@ -59,8 +76,6 @@ struct AlgorithmOutput : public AlgorithmOutputBase
 {
 };
 
-class Fitter;
-
 template<int AlgStage>
 class Algorithm
 {
@@ -71,7 +86,9 @@ class AlgorithmBase
 public:
     virtual std::string name() const { return "Default"; }
     virtual std::string stageName() const = 0;
-    virtual AlgorithmOutputBasePtr run(const Fitter &) = 0;
+    //If recycled is the only pointer to an output of a previous run, that output is reused
+    virtual AlgorithmOutputBasePtr run(const Fitter &, AlgorithmOutputBasePtr recycled) = 0;
+    virtual AlgorithmOutputBasePtr newOutput() const = 0; //an empty output of the algorithm's stage
 
     static int numAlgorithmsForStage(AlgorithmStage stage) { return (int)_getAlgorithms()[stage].size(); }
     static AlgorithmBase *get(AlgorithmStage stage, int algorithm) { return _getAlgorithms()[stage][algorithm]; }
@@ -91,13 +108,23 @@ class AlgorithmBaseTemplate : public AlgorithmBase
 {
 public:
     //override
-    AlgorithmOutputBasePtr run(const Fitter &fitter)
+    AlgorithmOutputBasePtr run(const Fitter &fitter, AlgorithmOutputBasePtr recycled)
     {
-        smart_ptr<AlgorithmOutput<AlgStage> > out = new AlgorithmOutput<AlgStage>();
+        smart_ptr<AlgorithmOutput<AlgStage> > out;
+        if(recycled.unique())
+        {
+            out = static_pointer_cast<AlgorithmOutput<AlgStage> >(recycled);
+            out->recycle();
+        }
+        else
+            out = new AlgorithmOutput<AlgStage>();
         _run(fitter, *out);
         return out;
     }
 
+    //override
+    AlgorithmOutputBasePtr newOutput() const { return new AlgorithmOutput<AlgStage>(); }
+
     static std::vector<std::string> names()
     {
         std::vector<std::string> out;
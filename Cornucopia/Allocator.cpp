@@ -0,0 +1,126 @@
+/*--
+    Allocator.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Allocator.h"
+#include "FitMetrics.h"
+
+#include <Eigen/Core>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+NAMESPACE_Cornu
+
+namespace
+{
+    class StandardAllocator : public Allocator
+    {
+    public:
+        void *allocate(size_t size, size_t alignment)
+        {
+            if(alignment <= alignof(max_align_t))
+            {
+                void *out = malloc(size);
+                if(out == NULL)
+                    throw bad_alloc();
+                return out;
+            }
+
+            //overallocate and keep what malloc returned just before the aligned block
+            void *original = malloc(size + alignment);
+            if(original == NULL)
+                throw bad_alloc();
+            void *out = reinterpret_cast<void *>((reinterpret_cast<size_t>(original) + alignment) & ~(alignment - 1));
+            static_cast<void **>(out)[-1] = original;
+            return out;
+        }
+
+        void deallocate(void *ptr, size_t, size_t alignment)
+        {
+            free(alignment <= alignof(max_align_t) ? ptr : static_cast<void **>(ptr)[-1]);
+        }
+    };
+
+    //just before the memory allocateBytes hands out
+    struct AllocationHeader
+    {
+        Allocator *allocator;
+        size_t size; //as passed to the allocator, including the header
+    };
+
+    //the header gets a whole alignment unit, so the memory after it stays aligned
+    size_t headerSize(size_t &alignment)
+    {
+        if(alignment < alignof(AllocationHeader))
+            alignment = alignof(AllocationHeader);
+        return max(sizeof(AllocationHeader), alignment);
+    }
+
+    const size_t objectAlignment = EIGEN_MAX_STATIC_ALIGN_BYTES > 16 ? EIGEN_MAX_STATIC_ALIGN_BYTES : 16;
+}
+
+Allocator *Allocator::_global = NULL;
+thread_local Allocator *Allocator::_threadAllocator = NULL;
+
+Allocator &Allocator::standard()
+{
+    static StandardAllocator *allocator = new StandardAllocator(); //never destroyed: objects may be freed at exit
+    return *allocator;
+}
+
+void Allocator::setGlobal(Allocator *allocator)
+{
+    _global = allocator;
+}
+
+void *allocateBytes(size_t size, size_t alignment)
+{
+    size_t offset = headerSize(alignment);
+    Allocator &allocator = Allocator::current();
+    char *out = static_cast<char *>(allocator.allocate(size + offset, alignment)) + offset;
+
+    AllocationHeader *header = reinterpret_cast<AllocationHeader *>(out) - 1;
+    header->allocator = &allocator;
+    header->size = size + offset;
+    FitMetrics::countAllocation((long long)header->size);
+    return out;
+}
+
+void freeBytes(void *ptr, size_t alignment)
+{
+    if(ptr == NULL)
+        return;
+    size_t offset = headerSize(alignment);
+    const AllocationHeader *header = static_cast<const AllocationHeader *>(ptr) - 1;
+    size_t size = header->size;
+    FitMetrics::countDeallocation((long long)size);
+    header->allocator->deallocate(static_cast<char *>(ptr) - offset, size, alignment);
+}
+
+void *allocateObject(size_t size)
+{
+    return allocateBytes(size, objectAlignment);
+}
+
+void freeObject(void *ptr)
+{
+    freeBytes(ptr, objectAlignment);
+}
+
+END_NAMESPACE_Cornu
@@ -0,0 +1,103 @@
+/*--
+    Allocator.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CORNUCOPIA_ALLOCATOR_H_INCLUDED
+#define CORNUCOPIA_ALLOCATOR_H_INCLUDED
+
+//Like Executor.h, this file has no dependencies, since smart_ptr.h includes it
+#include <cstddef>
+
+namespace Cornu
+{
+
+/*
+    Where the library's memory comes from: the objects that smart_ptr's manage, the storage of VectorC's and the
+    arrays of the graph.  An application that wants fits to draw from its own pools or arenas, or to fail rather than
+    grow past a budget, implements an Allocator and passes it to Fitter::setAllocator, or to setGlobal for the
+    allocations made outside of fits.  Each allocation remembers the allocator it came from, so it may be freed after
+    the fit that made it is over, but an allocator must outlive everything it allocated.  The bytes allocated during
+    a fit are counted in its FitMetrics.
+*/
+class Allocator
+{
+public:
+    virtual ~Allocator() {}
+
+    //Returns size bytes aligned to alignment (a power of two) or throws, e.g., std::bad_alloc, if it can't.
+    //Called from several threads at once when fits run in parallel.
+    virtual void *allocate(size_t size, size_t alignment) = 0;
+    virtual void deallocate(void *ptr, size_t size, size_t alignment) = 0; //with the size and alignment allocated
+
+    static Allocator &standard(); //malloc and free
+    static Allocator &global() { return _global ? *_global : standard(); } //standard() unless setGlobal was called
+    static void setGlobal(Allocator *allocator); //not owned, NULL restores standard()
+
+    //the allocator of the fit running on the calling thread (ThreadPool tasks use their caller's), or global()
+    static Allocator &current() { return _threadAllocator ? *_threadAllocator : global(); }
+
+    //While a ThreadScope exists, the library allocates from the given allocator (not owned) on its thread.
+    //A NULL allocator leaves the thread allocating from global().
+    class ThreadScope
+    {
+    public:
+        ThreadScope(Allocator *allocator) : _previous(_threadAllocator) { _threadAllocator = allocator; }
+        ~ThreadScope() { _threadAllocator = _previous; }
+
+    private:
+        ThreadScope(const ThreadScope &);
+        ThreadScope &operator=(const ThreadScope &);
+
+        Allocator *_previous;
+    };
+
+private:
+    static Allocator *_global; //NULL for standard(), so that allocating during static initialization works
+    static thread_local Allocator *_threadAllocator;
+};
+
+//Allocate from Allocator::current(), counting the bytes in FitMetrics::current().  The memory records its allocator,
+//so freeing it only needs the alignment it was allocated with.
+void *allocateBytes(size_t size, size_t alignment);
+void freeBytes(void *ptr, size_t alignment);
+
+//For smart_base objects: aligned for any fixed-size Eigen members they have
+void *allocateObject(size_t size);
+void freeObject(void *ptr);
+
+//Makes standard containers allocate through allocateBytes, aligned for T
+template<typename T>
+class StlAllocator
+{
+public:
+    typedef T value_type;
+    template<typename U> struct rebind { typedef StlAllocator<U> other; };
+
+    StlAllocator() {}
+    template<typename U> StlAllocator(const StlAllocator<U> &) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(allocateBytes(n * sizeof(T), alignof(T))); }
+    void deallocate(T *ptr, size_t) { freeBytes(ptr, alignof(T)); }
+
+    template<typename U> bool operator==(const StlAllocator<U> &) const { return true; }
+    template<typename U> bool operator!=(const StlAllocator<U> &) const { return false; }
+};
+
+} //end of namespace Cornu
+
+#endif //CORNUCOPIA_ALLOCATOR_H_INCLUDED
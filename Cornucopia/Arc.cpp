@@ -83,6 +83,39 @@ void Arc::eval(double s, Vec *pos, Vec *der, Vec *der2) const
         (*der2) = Vec(-sina, cosa) * _params[CURVATURE];
 }
 
+void Arc::evalBatch(const VectorXd &s, Matrix2Xd *pos, Matrix2Xd *der, Matrix2Xd *der2) const
+{
+    ArrayXd angle = _startAngle() + s.array() * _params[CURVATURE];
+    ArrayXd cosa, sina;
+    if(!_flat || der || der2)
+    {
+        cosa = angle.cos();
+        sina = angle.sin();
+    }
+
+    if(_flat && pos)
+        (*pos) = _startPos().replicate(1, s.size()) + _tangent * s.transpose();
+    else if(pos)
+    {
+        pos->resize(2, s.size());
+        pos->row(0) = (_center[0] + _radius * sina).matrix().transpose();
+        pos->row(1) = (_center[1] - _radius * cosa).matrix().transpose();
+    }
+
+    if(der)
+    {
+        der->resize(2, s.size());
+        der->row(0) = cosa.matrix().transpose();
+        der->row(1) = sina.matrix().transpose();
+    }
+    if(der2)
+    {
+        der2->resize(2, s.size());
+        der2->row(0) = (-_params[CURVATURE] * sina).matrix().transpose();
+        der2->row(1) = (_params[CURVATURE] * cosa).matrix().transpose();
+    }
+}
+
 double Arc::project(const Vec &point) const
 {
     double t;
@@ -134,7 +167,16 @@ void Arc::flip()
 
 void Arc::derivativeAt(double s, ParamDer &out, ParamDer &outTan) const
 {
-    outTan = out = ParamDer::Zero(2, 5);
+    FixedParamDer fixedOut, fixedOutTan;
+    derivativeAtFixed(s, fixedOut, fixedOutTan);
+    out = fixedOut;
+    outTan = fixedOutTan;
+}
+
+void Arc::derivativeAtFixed(double s, FixedParamDer &out, FixedParamDer &outTan) const
+{
+    out.setZero();
+    outTan.setZero();
     out(0, X) = 1;
     out(1, Y) = 1;
 
@@ -168,8 +210,8 @@ void Arc::derivativeAtEnd(int continuity, EndDer &out) const
 {
     out = EndDer::Zero(2 + continuity, 5);
 
-    ParamDer pDer, dummy;
-    derivativeAt(_length(), pDer, dummy);
+    FixedParamDer pDer, dummy;
+    derivativeAtFixed(_length(), pDer, dummy);
     Vector2d endTan;
     eval(_length(), NULL, &endTan);
 
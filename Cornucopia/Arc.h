@@ -37,6 +37,7 @@ public:
 
     //overrides
     void eval(double s, Vec *pos, Vec *der = NULL, Vec *der2 = NULL) const;
+    void evalBatch(const Eigen::VectorXd &s, Eigen::Matrix2Xd *pos, Eigen::Matrix2Xd *der = NULL, Eigen::Matrix2Xd *der2 = NULL) const;
 
     double project(const Vec &point) const;
 
@@ -49,17 +50,21 @@ public:
 
     PrimitiveType getType() const { return ARC; }
 
+    enum { NUM_PARAMS = 5 };
+    typedef Fixed<NUM_PARAMS>::ParamVec FixedParamVec;
+    typedef Fixed<NUM_PARAMS>::ParamDer FixedParamDer;
+
     void trim(double sFrom, double sTo);
     void flip();
     CurvePrimitivePtr clone() const { ArcPtr out = new Arc(); out->setParams(_params); return out; }
     void derivativeAt(double s, ParamDer &out, ParamDer &outTan) const;
+    void derivativeAtFixed(double s, FixedParamDer &out, FixedParamDer &outTan) const; //non-virtual, statically sized
     void derivativeAtEnd(int continuity, EndDer &out) const;
 
     //arc specific--UNDEFINED if arc is flat
     Vec center() const { return _center; }
     double radius() const { return _radius; }
 
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 protected:
     //override
     void _paramsChanged();
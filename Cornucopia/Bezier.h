@@ -49,7 +49,7 @@ CORNU_SMART_FORW_DECL(BezierSpline);
 class BezierSpline : public smart_base
 {
 public:
-    typedef VectorC<CubicBezier, Eigen::aligned_allocator<CubicBezier> > PrimitiveVector;
+    typedef VectorC<CubicBezier> PrimitiveVector;
     typedef Eigen::Vector2d Vec;
 
     BezierSpline(const PrimitiveVector &primitives) : _primitives(primitives) {}
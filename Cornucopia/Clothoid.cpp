@@ -27,6 +27,7 @@ using namespace Eigen;
 NAMESPACE_Cornu
 
 Clothoid::Clothoid(const Vec &start, double startAngle, double length, double curvature, double endCurvature)
+    : _accuracy(DEFAULT_ACCURACY)
 {
     _params.resize(numParams());
 
@@ -123,6 +124,8 @@ void Clothoid::eval(double s, Vec *pos, Vec *der, Vec *der2) const
             cs = Vector2d(t, 0);
         else if(_arc)
             cs = Vector2d(cos(t), sin(t));
+        else if(_accuracy == TABULATED_ACCURACY)
+            fresnelTable(t, &(cs[1]), &(cs[0]));
         else
             fresnel(t, &(cs[1]), &(cs[0]));
 
@@ -150,6 +153,61 @@ double Clothoid::curvature(double s) const
     return _params[CURVATURE] + s * _params[DCURVATURE];
 }
 
+//By default, positions use the vectorized single precision fresnelApprox, so they can differ from eval
+//by about 1e-6 of the size of the canonical clothoid piece (see setAccuracy).
+void Clothoid::evalBatch(const VectorXd &s, Matrix2Xd *pos, Matrix2Xd *der, Matrix2Xd *der2) const
+{
+    if(pos)
+    {
+        VectorXd t = _t1 + s.array() * _tdiff;
+
+        Matrix2Xd cs(2, s.size());
+        if(_flat)
+        {
+            cs.row(0) = t.transpose();
+            cs.row(1).setZero();
+        }
+        else if(_arc)
+        {
+            cs.row(0) = t.array().cos().matrix().transpose();
+            cs.row(1) = t.array().sin().matrix().transpose();
+        }
+        else
+        {
+            VectorXd fs, fc;
+            if(_accuracy == FULL_ACCURACY)
+                fresnel(t, &fs, &fc);
+            else if(_accuracy == TABULATED_ACCURACY)
+                fresnelTable(t, &fs, &fc);
+            else
+                fresnelApprox(t, &fs, &fc);
+            cs.row(0) = fc.transpose();
+            cs.row(1) = fs.transpose();
+        }
+
+        (*pos) = (_mat * cs).colwise() + _startShift;
+    }
+    if(der || der2)
+    {
+        ArrayXd angle = _params[ANGLE] + s.array() * (_params[CURVATURE] + 0.5 * s.array() * _params[DCURVATURE]);
+        ArrayXd cosa = angle.cos(), sina = angle.sin();
+
+        if(der)
+        {
+            der->resize(2, s.size());
+            der->row(0) = cosa.matrix().transpose();
+            der->row(1) = sina.matrix().transpose();
+        }
+        if(der2)
+        {
+            ArrayXd curvature = _params[CURVATURE] + s.array() * _params[DCURVATURE];
+            der2->resize(2, s.size());
+            der2->row(0) = (-curvature * sina).matrix().transpose();
+            der2->row(1) = (curvature * cosa).matrix().transpose();
+        }
+    }
+}
+
 double Clothoid::project(const Vec &point) const
 {
     if(_flat)
@@ -214,7 +272,16 @@ void Clothoid::flip()
 
 void Clothoid::derivativeAt(double s, ParamDer &out, ParamDer &outTan) const
 {
-    outTan = out = ParamDer::Zero(2, 6);
+    FixedParamDer fixedOut, fixedOutTan;
+    derivativeAtFixed(s, fixedOut, fixedOutTan);
+    out = fixedOut;
+    outTan = fixedOutTan;
+}
+
+void Clothoid::derivativeAtFixed(double s, FixedParamDer &out, FixedParamDer &outTan) const
+{
+    out.setZero();
+    outTan.setZero();
     out(0, X) = 1;
     out(1, Y) = 1;
 
@@ -306,12 +373,115 @@ void Clothoid::derivativeAt(double s, ParamDer &out, ParamDer &outTan) const
     }
 }
 
+//This is derivativeAtFixed for all the samples at once.  The Fresnel integrals are evaluated once per sample,
+//with the vectorized fresnel, and shared with the positions, and everything that depends only on the
+//parameters is computed once.
+void Clothoid::derivativeBatch(const VectorXd &s, MatrixXd &out, MatrixXd &outTan,
+                               Matrix2Xd *pos, Matrix2Xd *der, Matrix2Xd *der2) const
+{
+    if(_flat || _arc) //the degenerate cases are rare
+    {
+        CurvePrimitive::derivativeBatch(s, out, outTan, pos, der, der2);
+        return;
+    }
+
+    int n = (int)s.size();
+    out = MatrixXd::Zero(2 * n, 6);
+    outTan = MatrixXd::Zero(2 * n, 6);
+
+    //column j of out, viewed as a 2 x n matrix, is the derivatives with respect to parameter j
+    auto paramCol = [n](MatrixXd &m, int j) { return Map<Matrix2Xd>(m.col(j).data(), 2, n); };
+
+    //positions, as in eval
+    ArrayXd t = _t1 + s.array() * _tdiff;
+    VectorXd fs, fc;
+    fresnel(t.matrix(), &fs, &fc);
+    Matrix2Xd cs(2, n);
+    cs.row(0) = fc.transpose();
+    cs.row(1) = fs.transpose();
+    Matrix2Xd p = (_mat * cs).colwise() + _startShift;
+
+    //tangents and second derivatives, as in eval
+    ArrayXd angle = _params[ANGLE] + s.array() * (_params[CURVATURE] + 0.5 * s.array() * _params[DCURVATURE]);
+    ArrayXd cosa = angle.cos(), sina = angle.sin();
+    Matrix2Xd normal(2, n);
+    normal.row(0) = -sina.matrix().transpose();
+    normal.row(1) = cosa.matrix().transpose();
+
+    paramCol(out, X).row(0).setOnes();
+    paramCol(out, Y).row(1).setOnes();
+
+    Matrix2Xd diff = p.colwise() - _startPos();
+    paramCol(out, ANGLE).row(0) = -diff.row(1);
+    paramCol(out, ANGLE).row(1) = diff.row(0);
+
+    paramCol(outTan, ANGLE) = normal;
+    paramCol(outTan, CURVATURE) = normal * s.asDiagonal();
+    paramCol(outTan, DCURVATURE) = normal * (0.5 * s.array().square()).matrix().asDiagonal();
+
+    //the curvature and curvature derivative columns, as in derivativeAtFixed
+    double scale = sqrt(fabs(1. / (PI * _params[DCURVATURE])));
+    RowVector2d dt1dx(scale, -_params[CURVATURE] * scale / (2. * _params[DCURVATURE]));
+    Vector2d startcs;
+    fresnel(_t1, &(startcs[1]), &(startcs[0]));
+    double basicAngle = HALFPI * _t1 * _t1;
+    Vector2d dstartcs(cos(basicAngle), sin(basicAngle));
+    Vector2d matdstartcs = _mat * dstartcs;
+
+    ArrayXd halfPiTSq = HALFPI * t.square();
+    Matrix2Xd dcs(2, n);
+    dcs.row(0) = halfPiTSq.cos().matrix().transpose();
+    dcs.row(1) = halfPiTSq.sin().matrix().transpose();
+    Matrix2Xd matdcs = _mat * dcs;
+
+    Matrix2d dmatdc, dmatdd;
+
+    double angleShift;
+    if(_tdiff > 0.)
+        angleShift = _params[ANGLE] - _t1 * _t1 * HALFPI;
+    else
+        angleShift = _params[ANGLE] + _t1 * _t1 * HALFPI;
+
+    double cosAS = cos(angleShift), sinAS = sin(angleShift);
+    dmatdc << sinAS, cosAS,
+        -cosAS, sinAS;
+    dmatdc *= PI * scale * _params[CURVATURE] / _params[DCURVATURE];
+    double curvSqr = _params[CURVATURE] * _params[CURVATURE];
+    dmatdd(0, 0) = -_params[DCURVATURE] * cosAS - curvSqr * sinAS;
+    dmatdd(1, 1) = dmatdd(0, 0);
+    dmatdd(0, 1) = _params[DCURVATURE] * sinAS - curvSqr * cosAS;
+    dmatdd(1, 0) = -dmatdd(0, 1);
+    dmatdd *= HALFPI * scale / (_params[DCURVATURE] * _params[DCURVATURE]);
+
+    if(_tdiff < 0.)
+    {
+        dmatdc.col(0) *= -1;
+        dmatdd.col(0) *= -1;
+    }
+
+    Matrix2Xd csDiff = cs.colwise() - startcs;
+    RowVectorXd dtdx1 = (dt1dx[1] + (0.5 * scale) * s.array()).matrix().transpose();
+    paramCol(out, CURVATURE) = (matdcs * dt1dx[0]).colwise() - matdstartcs * dt1dx[0] + dmatdc * csDiff;
+    paramCol(out, DCURVATURE) = (matdcs * dtdx1.asDiagonal()).colwise() - matdstartcs * dt1dx[1] + dmatdd * csDiff;
+
+    if(pos)
+        *pos = p;
+    if(der)
+    {
+        der->resize(2, n);
+        der->row(0) = cosa.matrix().transpose();
+        der->row(1) = sina.matrix().transpose();
+    }
+    if(der2)
+        *der2 = normal * (_params[CURVATURE] + s.array() * _params[DCURVATURE]).matrix().asDiagonal();
+}
+
 void Clothoid::derivativeAtEnd(int continuity, EndDer &out) const
 {
     out = EndDer::Zero(2 + continuity, 6);
 
-    ParamDer pDer, dummy;
-    derivativeAt(_length(), pDer, dummy);
+    FixedParamDer pDer, dummy;
+    derivativeAtFixed(_length(), pDer, dummy);
     Vector2d endTan;
     eval(_length(), NULL, &endTan);
 
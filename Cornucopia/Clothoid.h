@@ -31,11 +31,25 @@ CORNU_SMART_FORW_DECL(Clothoid);
 class Clothoid : public CurvePrimitive
 {
 public:
-    Clothoid() {} //uninitialized
+    Clothoid() : _accuracy(DEFAULT_ACCURACY) {} //uninitialized
     Clothoid(const Vec &start, double startAngle, double length, double curvature, double endCurvature);
 
+    //How positions are evaluated, trading accuracy for speed.  By default, eval uses the double precision
+    //fresnel and evalBatch the single precision fresnelApprox.  FULL_ACCURACY makes evalBatch double
+    //precision too, and TABULATED_ACCURACY uses fresnelTable (~1e-6 of the canonical clothoid's size)
+    //for both, which is plenty for drawing and hit-testing.  Derivatives and fitting are not affected.
+    enum Accuracy
+    {
+        DEFAULT_ACCURACY = 0,
+        FULL_ACCURACY,
+        TABULATED_ACCURACY
+    };
+    void setAccuracy(Accuracy accuracy) { _accuracy = accuracy; }
+    Accuracy accuracy() const { return _accuracy; }
+
     //overrides
     void eval(double s, Vec *pos, Vec *der = NULL, Vec *der2 = NULL) const;
+    void evalBatch(const Eigen::VectorXd &s, Eigen::Matrix2Xd *pos, Eigen::Matrix2Xd *der = NULL, Eigen::Matrix2Xd *der2 = NULL) const;
 
     double project(const Vec &point) const;
 
@@ -47,11 +61,18 @@ public:
 
     PrimitiveType getType() const { return CLOTHOID; }
 
+    enum { NUM_PARAMS = 6 };
+    typedef Fixed<NUM_PARAMS>::ParamVec FixedParamVec;
+    typedef Fixed<NUM_PARAMS>::ParamDer FixedParamDer;
+
     void trim(double sFrom, double sTo);
     void flip();
-    CurvePrimitivePtr clone() const { ClothoidPtr out = new Clothoid(); out->setParams(_params); return out; }
+    CurvePrimitivePtr clone() const { ClothoidPtr out = new Clothoid(); out->_accuracy = _accuracy; out->setParams(_params); return out; }
     void derivativeAt(double s, ParamDer &out, ParamDer &outTan) const;
+    void derivativeAtFixed(double s, FixedParamDer &out, FixedParamDer &outTan) const; //non-virtual, statically sized
     void derivativeAtEnd(int continuity, EndDer &out) const;
+    void derivativeBatch(const Eigen::VectorXd &s, Eigen::MatrixXd &out, Eigen::MatrixXd &outTan,
+                         Eigen::Matrix2Xd *pos = NULL, Eigen::Matrix2Xd *der = NULL, Eigen::Matrix2Xd *der2 = NULL) const;
 
     void toEndCurvatureDerivative(Eigen::MatrixXd &der) const;
 
@@ -61,7 +82,10 @@ public:
         virtual double project(const Vec &pt, double from, double to) const = 0;
     };
 
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    //profiling: the number of projections onto clothoids and of approximating arcs they tested, over all threads
+    static void getProjectionStats(long long &outNumProjections, long long &outNumArcsTested);
+    static void resetProjectionStats();
+
 protected:
     //override
     void _paramsChanged();
@@ -74,6 +98,7 @@ private:
     double _tdiff;
     bool _arc;
     bool _flat;
+    Accuracy _accuracy;
 
     class _ClothoidProjectorImpl;
     static _ClothoidProjector *_clothoidProjector(); //projects onto a generic clothoid
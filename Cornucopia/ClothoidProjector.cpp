@@ -22,27 +22,266 @@
 #include "Arc.h"
 #include "Fresnel.h"
 
-#include <deque>
+#include <vector>
+#include <atomic>
 
 using namespace std;
 using namespace Eigen;
 NAMESPACE_Cornu
 
+//profiling counters, accumulated over all threads
+static atomic<long long> numProjections(0);
+static atomic<long long> numArcsTested(0);
+
+//a circle containing a set of points, used for culling in the arc hierarchy
+struct _BoundingCircle
+{
+    _BoundingCircle() : center(Vector2d::Zero()), radius(-1.) {}
+    _BoundingCircle(const Vector2d &c, double r) : center(c), radius(r) {}
+
+    //lower bound on the squared distance from pt to anything in the circle
+    double minDistSq(const Vector2d &pt) const
+    {
+        double dist = (pt - center).norm() - radius;
+        return dist > 0. ? dist * dist : 0.;
+    }
+
+    _BoundingCircle merged(const _BoundingCircle &other) const
+    {
+        double dist = (other.center - center).norm();
+        if(dist + other.radius <= radius)
+            return *this;
+        if(dist + radius <= other.radius)
+            return other;
+
+        double newRadius = 0.5 * (dist + radius + other.radius);
+        Vector2d newCenter = center + ((newRadius - radius) / dist) * (other.center - center);
+        return _BoundingCircle(newCenter, newRadius);
+    }
+
+    Vector2d center;
+    double radius;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+//The arcs through the points at parameters start, start + 0.05 and start + 0.1 on the generic clothoid (computed
+//with fresnelApprox), for start = -9.1, -9, ..., 9, as X, Y, ANGLE, LENGTH, CURVATURE.  They are precomputed so that
+//the first projection doesn't pay for evaluating and fitting them.
+static constexpr double approxArcParams[][5] =
+{
+    { -0.46660821920935325, -0.51041329334771957, 4.4108816432225497, 0.099999942351580287, -28.43142451549053 },
+    { -0.53536612778061454, -0.49986104768852752, 1.5677522012706511, 0.099999941892997685, -28.11726526900992 },
+    { -0.4661182049716639, -0.48855154446733062, -1.2439615716216235, 0.099999941459174513, -27.803106012323436 },
+    { -0.52796401502427215, -0.52294093466725788, 2.25892563792757, 0.099999941049168511, -27.488946745931326 },
+    { -0.48274465549513873, -0.46773905607521676, -0.48995677846315933, 0.09999994066210012, -27.174787470305297 },
+    { -0.50248285772251167, -0.53692769087931325, 3.0757617993282804, 0.099999940297148107, -26.860628185890182 },
+    { -0.51417760096107223, -0.46534124952081063, 0.38971076249992664, 0.099999939953544212, -26.546468893105491 },
+    { -0.47091285707710018, -0.52428476814652258, 4.0182607307712281, 0.099999939630580875, -26.232309592346898 },
+    { -0.53774664931234262, -0.49323233577303138, 1.3950410949544065, 0.099999939327599707, -25.918150283987497 },
+    { -0.46384247720846999, -0.48588179722095304, -1.1967628327805362, 0.099999939043995387, -25.603990968379161 },
+    { -0.52275061062320893, -0.53203939763306796, 2.5260342595627723, 0.09999993877921047, -25.289831645853653 },
+    { -0.49980218319411729, -0.46021421384488959, -0.0029382377246069957, 0.099999938532738961, -24.975672316723852 },
+    { -0.47597379117284933, -0.53234203346610998, 3.7826902942067795, 0.099999938304121377, -24.661512981284758 },
+    { -0.53947055400037491, -0.48964534318656061, 1.3165492453344436, 0.099999938092943816, -24.347353639814646 },
+    { -0.46278209759923866, -0.48201416500033922, -1.1181760729728951, 0.099999937898836697, -24.033194292576084 },
+    { -0.51563121692704894, -0.53885324521775912, 2.761699650511666, 0.099999937721481344, -23.719034939816794 },
+    { -0.51601825349583474, -0.46070123352978448, 0.38980580533974485, 0.099999937560596455, -23.404875581770764 },
+    { -0.46010185008700671, -0.51606557748647652, -1.9506722975294974, 0.099999937415945789, -23.090716218659146 },
+    { -0.53926801485695552, -0.51894733140148597, 2.0234506527367406, 0.099999937287337942, -22.776556850691325 },
+    { -0.48874395696587936, -0.45725152880928321, -0.25419595468926692, 0.099999937174619177, -22.462397478065835 },
+    { -0.47331119310900371, -0.53601735300795772, 3.7827584979658369, 0.099999937077677875, -22.148238100971501 },
+    { -0.54546709356223644, -0.49970479334813245, 1.5679433996439482, 0.099999936996442731, -21.83407871958849 },
+    { -0.47322531701885584, -0.46243950458028421, -0.61545593928345355, 0.099999936930875777, -21.519919334089494 },
+    { -0.48306982374872537, -0.54363545636998911, 3.5157457914497892, 0.099999936880976983, -21.20575994464112 },
+    { -0.5467365768033684, -0.4915014503525334, 1.3951779804692412, 0.09999993684677437, -20.89160055140519 },
+    { -0.46899141027589381, -0.46306949730869895, -0.6939740621591568, 0.099999936828327848, -20.577441154540473 },
+    { -0.48160345514397068, -0.54537645480134389, 3.5314749735352438, 0.099999936825717201, -20.263281754204481 },
+    { -0.54960455750091275, -0.49649222613481464, 1.5051544758920927, 0.099999936839036713, -19.949122350555559 },
+    { -0.47600445886941489, -0.45554542682124599, -0.48975024529962297, 0.099999936868390052, -19.634962943755031 },
+    { -0.46760840483743737, -0.53982097697596454, 3.8299461196622677, 0.099999936913873474, -19.320803533970441 },
+    { -0.54950220135237804, -0.5164770882218831, 1.8978729588568615, 0.099999936975565654, -19.006644121378475 },
+    { -0.49953147309456786, -0.44696075926695122, -0.0027844181800610324, 0.099999937053505919, -18.692484706168724 },
+    { -0.44859194957716353, -0.51633068699319251, -1.8720260091722363, 0.099999937147670262, -18.378325288548208 },
+    { -0.5298367125476402, -0.54604728863459429, 2.573333495258193, 0.099999937257941401, -18.064165868746439 },
+    { -0.53845896230806911, -0.45952838481587466, 0.76692348287413792, 0.099999937384071369, -17.75000644702175 },
+    { -0.45171362548181521, -0.4700388003179195, -1.0080707370973725, 0.099999937525626928, -17.43584702366784 },
+    { -0.47842140852288001, -0.55368406310663099, 3.5315361444976094, 0.099999937681931481, -17.121687599022479 },
+    { -0.55723378240768273, -0.51403199510426123, 1.8193735152025017, 0.099999937851985174, -16.807528173476815 },
+    { -0.50778658043484515, -0.44046778633330513, 0.13862668402894585, 0.099999938034369143, -16.49336874748623 },
+    { -0.43888747126961425, -0.49687564975411036, -1.5107043472603965, 0.099999938227116614, -16.179209321582871 },
+    { -0.49978210403928724, -0.56239008318530137, 3.1545657302085761, 0.099999938427568519, -15.865049896389605 },
+    { -0.56363119246315208, -0.49919138772975097, 1.5680663037042439, 0.099999938632183386, -15.550890472635205 },
+    { -0.50016097326337694, -0.43506735790264944, 0.012982681968267573, 0.099999938836305563, -15.236731051170972 },
+    { -0.43379657778909358, -0.49675021320411078, -1.5106851335008873, 0.099999939033887722, -14.922571632987093 },
+    { -0.49142648479282264, -0.56714547262247228, 3.2802481659137661, 0.099999939217158884, -14.608412219228891 },
+    { -0.56723668550696171, -0.5161923428282067, 1.819411967232925, 0.099999939376222174, -14.294252811210171 },
+    { -0.52602592097638212, -0.43427297236406392, 0.38999157896364361, 0.099999939498599477, -13.98009341042021 },
+    { -0.43833293880133267, -0.46226801052194277, -1.0080129976116381, 0.099999939568714544, -13.665934018521204 },
+    { -0.44944116528929445, -0.55399588900296326, -2.3746017612449832, 0.09999993956733505, -13.351774637327555 },
+    { -0.54171920383175487, -0.56319889384376653, 2.5734105964716893, 0.099999939471027685, -13.037615268758261 },
+    { -0.57369563650885946, -0.47579825690725014, 1.2696534624092632, 0.099999939251691247, -12.723455914747751 },
+    { -0.49842603325927565, -0.4205157495807777, -0.0026878549919627792, 0.099999938876318112, -12.409296577096478 },
+    { -0.42233270583005023, -0.47520240197664865, -1.2436133544011923, 0.09999993830722613, -12.095137257236621 },
+    { -0.44809494654904042, -0.56561874431738712, -2.4531230343654853, 0.099999937503135586, -11.780977955882545 },
+    { -0.54194566717760773, -0.57498035066229258, 2.6519684139365731, 0.099999936421692415, -11.466818672535211 },
+    { -0.58795326136463122, -0.492309483318011, 1.5052903780580427, 0.099999935024330827, -11.152659404813534 },
+    { -0.53257242866443832, -0.41524800845490373, 0.39002816745362068, 0.099999933284741702, -10.838500147611819 },
+    { -0.43849169717387892, -0.42964947043028062, -0.69381821514725239, 0.099999931202640516, -10.524340892144398 },
+    { -0.4056944076588469, -0.51928609399815751, -1.7462487664978503, 0.099999928824827181, -10.210181625064365 },
+    { -0.46632035767308977, -0.59334946444913106, 3.5159218243258277, 0.099999926275287435, -9.8960223280785407 },
+    { -0.56159390683794908, -0.58181585801537594, 2.5263229470080728, 0.099999923794395151, -9.5818629788603218 },
+    { -0.60572078231731896, -0.49631299141827279, 1.5681399125365973, 0.099999921782201934, -9.2677035545834077 },
+    { -0.56237644230290795, -0.41014059033576844, 0.64137272339019025, 0.099999920828939479, -8.9535440398618462 },
+    { -0.46749165346834232, -0.39152844977834367, -0.25397862118626929, 0.099999921692039959, -8.6393844405802618 },
+    { -0.39249397578437362, -0.45291748438483792, -1.1179141279972975, 0.09999992513831292, -8.3252248022102311 },
+    { -0.38893749205833539, -0.549989313586699, -1.9504338130760224, 0.09999993151871335, -8.01106522212371 },
+    { -0.45741299580548467, -0.61918175584397139, -2.7515377029352104, 0.099999939933306595, -7.6969058260557093 },
+    { -0.55496139974105141, -0.6196899769466675, 2.7619594791251263, 0.099999947059514885, -7.3827466554739107 },
+    { -0.62656171634618452, -0.55315164613847001, 2.0236871089936148, 0.09999994660703386, -7.0685874416659846 },
+    { -0.63628604265926436, -0.45570460186650741, 1.3168305553617266, 0.099999932502922134, -6.7544275100917064 },
+    { -0.58156411784965245, -0.37427335801627559, 0.64138999338051939, 0.099999910832385394, -6.4402667706126984 },
+    { -0.48825340578584475, -0.34341568597258293, -0.0026344291622026339, 0.099999914674816462, -6.1261083976958082 },
+    { -0.39447054335420229, -0.37334730062383248, -0.61524319486211665, 0.09999996112635462, -5.8119540559884157 },
+    { -0.33363292302539638, -0.4509387753211232, -1.1964370802791651, 0.099999916765509567, -5.4977810405019065 },
+    { -0.32382687869469051, -0.54919593685837853, -1.7462131125809948, 0.099999944017075057, -5.1836431654019117 },
+    { -0.36546169030528197, -0.63888768545047481, -2.2645751505043901, 0.099999927789887588, -4.8694710188306178 },
+    { -0.44526117916552194, -0.69750496107109616, -2.7515207184742878, 0.099999921882194268, -4.5553120571062173 },
+    { -0.54309577745417414, -0.71352507575344282, 3.0761350212483647, 0.099999951266129899, -4.2411520836660976 },
+    { -0.63855047000495446, -0.6863332881867733, 2.6520209944231325, 0.099999919499000667, -3.9269957832629934 },
+    { -0.71543771951274582, -0.62340091845929568, 2.2593227119931827, 0.099999925211090315, -3.6128312365690687 },
+    { -0.76380664773927642, -0.53649790903254324, 1.898040793051657, 0.09999993160610908, -3.2986719878277357 },
+    { -0.77989339390882673, -0.4382591465919865, 1.568174624715921, 0.099999927483630041, -2.9845154281853365 },
+    { -0.76482303263413698, -0.33977634508385507, 1.2697240112555457, 0.099999929002668159, -2.6703565314202606 },
+    { -0.7228441892396561, -0.2493413940140676, 1.0026891932727773, 0.099999935457520256, -2.356196098757307 },
+    { -0.65965236365273994, -0.17213645839022865, 0.76707030657649944, 0.099999938888955225, -2.0420359680716968 },
+    { -0.5810954496265186, -0.11054020746319332, 0.56286732288006847, 0.099999937472612169, -1.727876480969589 },
+    { -0.49234422180755438, -0.064732432782730137, 0.39008018743218154, 0.099999934037724295, -1.4137172402688067 },
+    { -0.39748075238742864, -0.033359432570872018, 0.2487088793390638, 0.099999931179007906, -1.0995579585170352 },
+    { -0.29940096954541978, -0.014116997957337406, 0.138753401061596, 0.099999929668430562, -0.78539858447011246 },
+    { -0.19992105288709319, -0.0041876091457464792, 0.060213759213720394, 0.099999929152403716, -0.47123915955311463 },
+    { -0.099997530230031273, -0.00052358954558464927, 0.01308995736998224, 0.099999929064132714, -0.15707972034163212 },
+    { 0, 0, -0.002618003521594775, 0.099999929064132714, 0.15707972034163209 },
+    { 0.099997530230031273, 0.00052358954558464927, 0.013089876644570671, 0.099999929152403716, 0.47123915955311441 },
+    { 0.19992105288709319, 0.0041876091457464792, 0.060213597852899772, 0.099999929668430576, 0.7853985844701129 },
+    { 0.29940096954541978, 0.014116997957337406, 0.13875315916002987, 0.099999931179007906, 1.0995579585170352 },
+    { 0.39748075238742864, 0.033359432570872018, 0.24870855665730734, 0.099999934037724308, 1.413717240268805 },
+    { 0.49234422180755438, 0.064732432782730137, 0.39007978282271222, 0.099999937472612155, 1.7278764809695926 },
+    { 0.5810954496265186, 0.11054020746319332, 0.56286683456028119, 0.099999938888955225, 2.0420359680716968 },
+    { 0.65965236365273994, 0.17213645839022865, 0.76706973547178348, 0.09999993545752027, 2.3561960987573487 },
+    { 0.7228441892396561, 0.2493413940140676, 1.0026885477017102, 0.099999929002668159, 2.670356531420222 },
+    { 0.76482303263413698, 0.33977634508385507, 1.2697232983236082, 0.099999927483630069, 2.9845154281854174 },
+    { 0.77989339390882673, 0.4382591465919865, 1.5681738198778954, 0.09999993160610908, 3.2986719878277357 },
+    { 0.76380664773927642, 0.53649790903254324, 1.898039858535985, 0.099999925211090315, 3.6128312365690687 },
+    { 0.71543771951274582, 0.62340091845929568, 2.2593217322239179, 0.099999919499000667, 3.9269957832629934 },
+    { 0.63855047000495446, 0.6863332881867733, 2.6520200195695098, 0.099999951266129899, 4.2411520836660968 },
+    { 0.54309577745417414, 0.71352507575344282, -3.2070515683339269, 0.099999921882194268, 4.5553120571062182 },
+    { 0.44526117916552194, 0.69750496107109616, -2.7515219007624019, 0.099999927789887574, 4.8694710188306143 },
+    { 0.36546169030528197, 0.63888768545047481, -2.2645771389256795, 0.099999944017075029, 5.1836431654019099 },
+    { 0.32382687869469051, 0.54919593685837853, -1.7462147267243524, 0.099999916765509567, 5.4977810405019065 },
+    { 0.33363292302539638, 0.4509387753211232, -1.1964383745291172, 0.099999961126354606, 5.811954055988414 },
+    { 0.39447054335420229, 0.37334730062383248, -0.61524474622045444, 0.099999914674816129, 6.1261083976957478 },
+    { 0.48825340578584475, 0.34341568597258293, -0.0026361094175250122, 0.099999910832385394, 6.4402667706126975 },
+    { 0.58156411784965245, 0.37427335801627559, 0.64138826025667284, 0.099999932502922176, 6.7544275100917561 },
+    { 0.63628604265926436, 0.45570460186650741, 1.3168287422398683, 0.099999946607033846, 7.0685874416659429 },
+    { 0.62656171634618452, 0.55315164613847001, 2.023685204423928, 0.099999947059514857, 7.382746655473845 },
+    { 0.55496139974105141, 0.6196899769466675, -3.5212278232130991, 0.099999939933306609, 7.6969058260557066 },
+    { 0.45741299580548467, 0.61918175584397139, -2.7515397866803379, 0.099999931518713336, 8.0110652221236798 },
+    { 0.38893749205833539, 0.549989313586699, -1.9504359849779485, 0.099999925138312948, 8.3252248022102684 },
+    { 0.39249397578437362, 0.45291748438483792, -1.1179163887117252, 0.099999921692039986, 8.6393844405802849 },
+    { 0.46749165346834232, 0.39152844977834367, -0.25398097173441792, 0.099999920828939493, 8.9535440398618551 },
+    { 0.56237644230290795, 0.41014059033576844, 0.6413702819776208, 0.099999921782201948, 9.2677035545834254 },
+    { 0.60572078231731896, 0.49631299141827279, 1.5681373793137086, 0.099999923794395096, 9.581862978860249 },
+    { 0.56159390683794908, 0.58181585801537594, 2.5263203210993743, 0.099999926275287448, 9.8960223280785602 },
+    { 0.46632035767308977, 0.59334946444913106, -2.7672662022928467, 0.099999928824827208, 10.210181625064395 },
+    { 0.4056944076588469, 0.51928609399815751, -1.7462515803148277, 0.099999931202640502, 10.524340892144384 },
+    { 0.43849169717387892, 0.42964947043028062, -0.69382112421422359, 0.099999933284741688, 10.838500147611805 },
+    { 0.53257242866443832, 0.41524800845490373, 0.39002516222819517, 0.099999935024330883, 11.152659404813567 },
+    { 0.58795326136463122, 0.492309483318011, 1.5052872757239764, 0.099999936421692401, 11.466818672535222 },
+    { 0.54194566717760773, 0.57498035066229258, -3.6312200936795564, 0.099999937503135586, 11.780977955882525 },
+    { 0.44809494654904042, 0.56561874431738712, -2.4531263339422864, 0.099999938307226144, 12.095137257236617 },
+    { 0.42233270583005023, 0.47520240197664865, -1.2436167541997112, 0.09999993887631782, 12.409296577096487 },
+    { 0.49842603325927565, 0.4205157495807777, -0.0026913561370837114, 0.099999939251691247, 12.723455914747751 },
+    { 0.57369563650885946, 0.47579825690725014, 1.2696498587493172, 0.099999939471027671, 13.037615268758259 },
+    { 0.54171920383175487, 0.56319889384376653, -3.7097784180944156, 0.09999993956733505, 13.351774637327555 },
+    { 0.44944116528929445, 0.55399588900296326, -2.3746055736137985, 0.09999993956871453, 13.665934018521202 },
+    { 0.43833293880133267, 0.46226801052194277, -1.0080169162631465, 0.099999939498599477, 13.98009341042021 },
+    { 0.52602592097638212, 0.43427297236406392, 0.38998755268351426, 0.099999939376222174, 14.294252811210171 },
+    { 0.56723668550696171, 0.5161923428282067, 1.819407831931676, 0.099999939217158884, 14.608412219228891 },
+    { 0.49142648479282264, 0.56714547262247228, -3.002941387028419, 0.099999939033887708, 14.922571632987092 },
+    { 0.43379657778909358, 0.49675021320411078, -1.5106894912140674, 0.099999938836305563, 15.23673105117097 },
+    { 0.50016097326337694, 0.43506735790264944, 0.012978210764917786, 0.099999938632183399, 15.550890472635208 },
+    { 0.56363119246315208, 0.49919138772975097, 1.5680617174193132, 0.099999938427568533, 15.865049896389607 },
+    { 0.49978210403928724, 0.56239008318530137, -3.1286242799822728, 0.099999938227116614, 16.179209321582871 },
+    { 0.43888747126961425, 0.49687564975411036, -1.5107091686976775, 0.099999938034369143, 16.493368747486226 },
+    { 0.50778658043484515, 0.44046778633330513, 0.13862174240933045, 0.099999937851985174, 16.807528173476815 },
+    { 0.55723378240768273, 0.51403199510426123, 1.8193684515858628, 0.099999937681931481, 17.121687599022479 },
+    { 0.47842140852288001, 0.55368406310663099, -2.7516543501705448, 0.099999937525626928, 17.43584702366784 },
+    { 0.45171362548181521, 0.4700388003179195, -1.0080760503949004, 0.099999937384071369, 17.750006447021754 },
+    { 0.53845896230806911, 0.45952838481587466, 0.76691804176650258, 0.099999937257941401, 18.064165868746439 },
+    { 0.5298367125476402, 0.54604728863459429, -3.7098573829064967, 0.09999993714767029, 18.378325288548211 },
+    { 0.44859194957716353, 0.51633068699319251, -1.8720317121705554, 0.099999937053505933, 18.69248470616872 },
+    { 0.49953147309456786, 0.44696075926695122, -0.0027902553979916034, 0.099999936975565654, 19.006644121378478 },
+    { 0.54950220135237804, 0.5164770882218831, 1.8978669851398799, 0.099999936913873474, 19.320803533970441 },
+    { 0.46760840483743737, 0.53982097697596454, -2.4532453000883043, 0.099999936868390052, 19.634962943755031 },
+    { 0.47600445886941489, 0.45554542682124599, -0.48975649915767883, 0.099999936839036713, 19.949122350555559 },
+    { 0.54960455750091275, 0.49649222613481464, 1.5051480782330877, 0.099999936825717201, 20.263281754204481 },
+    { 0.48160345514397068, 0.54537645480134389, -2.7517168777018375, 0.099999936828327834, 20.57744115454047 },
+    { 0.46899141027589381, 0.46306949730869895, -0.69398075529931447, 0.09999993684677437, 20.89160055140519 },
+    { 0.5467365768033684, 0.4915014503525334, 1.3951711354725271, 0.099999936880976983, 21.20575994464112 },
+    { 0.48306982374872537, 0.54363545636998911, -2.767446515449937, 0.099999936930875777, 21.519919334089494 },
+    { 0.47322531701885584, 0.46243950458028421, -0.61546309669027188, 0.099999936996442731, 21.83407871958849 },
+    { 0.54546709356223644, 0.49970479334813245, 1.5679360814872587, 0.099999937077677889, 22.148238100971504 },
+    { 0.47331119310900371, 0.53601735300795772, -2.5004342912871746, 0.099999937174619177, 22.462397478065835 },
+    { 0.48874395696587936, 0.45725152880928321, -0.25420360395387875, 0.099999937287337928, 22.776556850691321 },
+    { 0.53926801485695552, 0.51894733140148597, -4.259742474284776, 0.099999937415945789, 23.090716218659143 },
+    { 0.46010185008700671, 0.51606557748647652, -1.9506802914508603, 0.099999937560596455, 23.404875581770764 },
+    { 0.51601825349583474, 0.46070123352978448, 0.38979763371634646, 0.099999937721481344, 23.719034939816794 },
+    { 0.51563121692704894, 0.53885324521775912, -3.52149400974118, 0.099999937898836683, 24.033194292576081 },
+    { 0.46278209759923866, 0.48201416500033922, -1.1181846113740315, 0.099999938092943816, 24.347353639814649 },
+    { 0.53947055400037491, 0.48964534318656061, 1.3165405175920153, 0.099999938304121377, 24.661512981284758 },
+    { 0.47597379117284933, 0.53234203346610998, -2.5005039342108222, 0.099999938532738961, 24.975672316723852 },
+    { 0.49980218319411729, 0.46021421384488959, -0.0029473567591340455, 0.09999993877921054, 25.28983164585366 },
+    { 0.52275061062320893, 0.53203939763306796, -3.7571603689014585, 0.09999993904399529, 25.603990968379147 },
+    { 0.46384247720846999, 0.48588179722095304, -1.1967723609279535, 0.099999939327599666, 25.91815028398749 },
+    { 0.53774664931234262, 0.49323233577303138, 1.3950313551658315, 0.099999939630580834, 26.232309592346891 },
+    { 0.47091285707710018, 0.52428476814652258, -2.2649345327892512, 0.099999939953544198, 26.546468893105487 },
+    { 0.51417760096107223, 0.46534124952081063, 0.38970058439537247, 0.099999940297147913, 26.860628185890157 },
+    { 0.50248285772251167, 0.53692769087931325, -3.2074339129988716, 0.099999940662100162, 27.174787470305301 },
+    { 0.48274465549513873, 0.46773905607521676, -0.48996741616929562, 0.099999941049168539, 27.488946745931329 },
+    { 0.52796401502427215, 0.52294093466725788, -4.0242705452371901, 0.099999941459174513, 27.803106012323436 },
+    { 0.4661182049716639, 0.48855154446733062, -1.2439726918203435, 0.099999941892997726, 28.117265269009923 },
+    { 0.53536612778061454, 0.49986104768852752, 1.5677408307001894, 0.099999942351580329, 28.431424515490534 }
+};
+
 //an arc that approximates a part of a clothoid
 class _ApproxArc
 {
 public:
-    _ApproxArc(double start, double length)
-        : _start(start), _length(length)
+    //params are the arc's X, Y, ANGLE, LENGTH and CURVATURE, as in approxArcParams
+    _ApproxArc(double start, double length, const double *params)
+        : _arc(Vector2d(params[0], params[1]), params[2], params[3], params[4]), _start(start), _length(length)
     {
-        //build an arc through three points on the clothoid to approximate it
-        Vector2d p[3];
-        for(int i = 0; i < 3; ++i)
-            fresnelApprox(start + 0.5 * length * i, &(p[i][1]), &(p[i][0]));
-        _arc = new Arc(p[0], p[1], p[2]);
+    }
+
+    _BoundingCircle boundingCircle() const
+    {
+        //an arc of at most a half-turn is inside the circle whose diameter is its chord.
+        //Pad a little because test() may evaluate the arc slightly past its ends.
+        Vector2d start = _arc.startPos(), end = _arc.endPos();
+        double eps = 1e-3 * _length;
+        if(fabs(_arc.length() * _arc.curvature(0.)) <= PI)
+            return _BoundingCircle(0.5 * (start + end), 0.5 * (end - start).norm() + eps);
+        return _BoundingCircle(_arc.center(), fabs(_arc.radius()) + eps);
     }
 
     bool test(const Vector2d &pt, double &minDistSq, double &minT, double from, double to) const
+    {
+        return testArc(_arc, _start, pt, minDistSq, minT, from, to);
+    }
+
+    //tests an arc that approximates the clothoid starting at parameter start
+    static bool testArc(const Arc &arc, double start, const Vector2d &pt, double &minDistSq, double &minT, double from, double to)
     {
         //Do a quick-reject test:
         //Let r be the arc radius and let d be the distance from the point to the center.
@@ -50,26 +289,28 @@ public:
         //To avoid division and square roots (we don't have d, only d^2), we write this as:
         //((r^2 - d^2)/(r + d))^2 > minDistSq, or (r^2 - d^2)^2 > minDistSq (r + d)^2
         //Since (r + d)^2 < 2 * (r^2 + d^2), we can conservatively check (r^2 - d^2)^2 > 2 * minDistSq * (r^2 + d^2) 
-        double dSq = (pt - _arc->center()).squaredNorm();
-        double rSq = SQR(_arc->radius());
+        double dSq = (pt - arc.center()).squaredNorm();
+        double rSq = SQR(arc.radius());
         if(SQR(dSq - rSq) > 2. * minDistSq * (dSq + rSq))
             return false;
 
         //Now really check
-        double t = _arc->project(pt);
-        t = min(max(t + _start, from), to) - _start;
+        double t = arc.project(pt);
+        t = min(max(t + start, from), to) - start;
 
-        double distSq = (pt - _arc->pos(t)).squaredNorm();
+        double distSq = (pt - arc.pos(t)).squaredNorm();
         if(distSq >= minDistSq)
             return false;
 
-        minT = _start + t;
+        minT = start + t;
         minDistSq = distSq;
         return true;
     }
 
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
 private:
-    ArcPtr _arc;
+    Arc _arc; //by value, so building the projector makes no allocation per arc and the tree search stays in one block
     double _start;
     double _length;
 };
@@ -82,18 +323,31 @@ public:
     _ClothoidProjectorImpl() //initialize
         : _arcSpacing(0.1)
     {
+        vector<double> starts; //of the arcs for positive t
         double t;
         for(t = 0; t * _arcSpacing < 0.9; t += _arcSpacing)
-        {
-            _arcs.push_front(_ApproxArc(-t - _arcSpacing, _arcSpacing));
-            _arcs.push_back(_ApproxArc(t, _arcSpacing));
-        }
+            starts.push_back(t);
         _maxArcParam = t;
+
+        const int numArcs = sizeof(approxArcParams) / sizeof(approxArcParams[0]);
+        assert(2 * (int)starts.size() == numArcs); //the table must match the spacing
+        _arcs.reserve(numArcs);
+        for(int i = (int)starts.size() - 1; i >= 0; --i)
+            _arcs.push_back(_ApproxArc(-starts[i] - _arcSpacing, _arcSpacing, approxArcParams[_arcs.size()]));
+        for(int i = 0; i < (int)starts.size(); ++i)
+            _arcs.push_back(_ApproxArc(starts[i], _arcSpacing, approxArcParams[_arcs.size()]));
+
+        int treeSize = 1;
+        while(treeSize < (int)_arcs.size())
+            treeSize *= 2;
+        _tree.resize(2 * treeSize - 1);
+        _buildTree(0, 0, (int)_arcs.size());
     }
 
     double project(const Vec &pt, double from, double to) const
     {
         double minT, minDistSq;
+        int arcsTested = 0;
 
         Vector2d startPt, endPt;
         fresnelApprox(from, &(startPt[1]), &(startPt[0]));
@@ -109,21 +363,22 @@ public:
             minT = to;
         }
 
-        //A possible optimization for clothoids outside the precomputed range is to batch
-        //the fresnel integral evaluations.  Not sure how much it'll help.
+        //Arcs outside the precomputed range are only about 1/|t| long, so a spirally clothoid needs many of them.
+        //Collect them first so that the ones that can't be close are culled and the rest are evaluated in one batch.
+        _FarPiece far[2 * maxFarPieces];
+        int numFar = 0;
         int minArcIdx = (int)floor((_maxArcParam + from) / _arcSpacing);
         if(minArcIdx < 0)
         {
             minArcIdx = 0;
-            //test against arcs before the precomputed ones
+            //arcs before the precomputed ones
             double start = from;
             double stop = min(to, -_maxArcParam);
             int cnt = 0; //iteration count to prevent looping over a really spirally clothoid
-            while(start + 1e-8 < stop && ++cnt < 100)
+            while(start + 1e-8 < stop && cnt++ < maxFarPieces)
             {
                 double len = min(stop - start, -1. / start);
-                _ApproxArc(start, len).test(pt, minDistSq, minT, from, to);
-
+                far[numFar++] = _FarPiece(start, len);
                 start += len;
             }
         }
@@ -131,21 +386,25 @@ public:
         if(maxArcIdx > (int)_arcs.size())
         {
             maxArcIdx = (int)_arcs.size();
-            //test against arcs past the end of the precomputed ones
+            //arcs past the end of the precomputed ones
             double start = to;
             double stop = max(_maxArcParam, from);
             int cnt = 0; //iteration count to prevent looping over a really spirally clothoid
-            while(start - 1e-8 > stop && ++cnt < 100)
+            while(start - 1e-8 > stop && cnt++ < maxFarPieces)
             {
                 double len = min(start - stop, 1. / start);
-                _ApproxArc(start - len, len).test(pt, minDistSq, minT, from, to);
-
+                far[numFar++] = _FarPiece(start - len, len);
                 start -= len;
             }
         }
+        if(numFar > 0)
+            arcsTested += _projectFar(pt, far, numFar, from, to, minDistSq, minT);
 
-        for(int i = minArcIdx; i < maxArcIdx; ++i)
-            _arcs[i].test(pt, minDistSq, minT, from, to);
+        if(minArcIdx < maxArcIdx)
+            _projectTree(pt, 0, 0, (int)_arcs.size(), minArcIdx, maxArcIdx, from, to, minDistSq, minT, arcsTested);
+
+        numProjections.fetch_add(1, memory_order_relaxed);
+        numArcsTested.fetch_add(arcsTested, memory_order_relaxed);
 
         minT = projectNewton(minT, pt, from, to);
         minT = projectNewton(minT, pt, from, to);
@@ -153,6 +412,95 @@ public:
     }
 
 private:
+    enum { maxFarPieces = 99 }; //on each side of the precomputed range
+
+    struct _FarPiece
+    {
+        _FarPiece() {}
+        _FarPiece(double inStart, double inLength) : start(inStart), length(inLength) {}
+
+        double start, length;
+    };
+
+    //Tests the pieces outside the precomputed range and returns how many arcs were tested.
+    //For large |t|, the clothoid is close to the spiral (0.5, 0.5) + (sin(pi t^2 / 2), -cos(pi t^2 / 2)) / (pi t)
+    //(mirrored for negative t), so a piece lies in a ring around the spiral center and if that ring is farther
+    //than the best point so far, the piece is skipped without evaluating the fresnel integrals.
+    int _projectFar(const Vec &pt, const _FarPiece *pieces, int numPieces, double from, double to,
+                    double &minDistSq, double &minT) const
+    {
+        double t[6 * maxFarPieces], s[6 * maxFarPieces], c[6 * maxFarPieces];
+        int kept[2 * maxFarPieces];
+        int numKept = 0;
+        for(int i = 0; i < numPieces; ++i)
+        {
+            double start = pieces[i].start, end = start + pieces[i].length;
+            double sign = start < 0. ? -1. : 1.;
+            double nearT = min(fabs(start), fabs(end)), farT = max(fabs(start), fabs(end));
+            //the error of the asymptotic approximation is O(1/t^3) and so is how far the arc strays from the clothoid
+            double eps = 1. / (nearT * nearT * nearT) + 1e-6;
+            double dist = (pt - Vec(0.5 * sign, 0.5 * sign)).norm();
+            double gap = max(1. / (PI * farT) - eps - dist, dist - 1. / (PI * nearT) - eps);
+            if(gap > 0. && gap * gap >= minDistSq)
+                continue;
+
+            for(int j = 0; j < 3; ++j)
+                t[3 * numKept + j] = start + 0.5 * pieces[i].length * j;
+            kept[numKept++] = i;
+        }
+
+        fresnelApprox(t, 3 * numKept, s, c);
+
+        for(int i = 0; i < numKept; ++i)
+        {
+            const double *ps = s + 3 * i, *pc = c + 3 * i;
+            Arc arc(Vec(pc[0], ps[0]), Vec(pc[1], ps[1]), Vec(pc[2], ps[2]));
+            _ApproxArc::testArc(arc, pieces[kept[i]].start, pt, minDistSq, minT, from, to);
+        }
+        return numKept;
+    }
+
+    void _buildTree(int node, int from, int to) //to is exclusive
+    {
+        if(to - from == 1)
+        {
+            _tree[node] = _arcs[from].boundingCircle();
+            return;
+        }
+
+        int mid = (from + to) / 2;
+        _buildTree(2 * node + 1, from, mid);
+        _buildTree(2 * node + 2, mid, to);
+        _tree[node] = _tree[2 * node + 1].merged(_tree[2 * node + 2]);
+    }
+
+    //tests the arcs of the node's range [from, to) that are also in [minIdx, maxIdx)
+    void _projectTree(const Vec &pt, int node, int from, int to, int minIdx, int maxIdx,
+                      double fromT, double toT, double &minDistSq, double &minT, int &arcsTested) const
+    {
+        if(to - from == 1)
+        {
+            _arcs[from].test(pt, minDistSq, minT, fromT, toT);
+            ++arcsTested;
+            return;
+        }
+
+        int mid = (from + to) / 2;
+        int children[2] = { 2 * node + 1, 2 * node + 2 };
+        int childFrom[2] = { from, mid }, childTo[2] = { mid, to };
+        double childDistSq[2] = { _tree[children[0]].minDistSq(pt), _tree[children[1]].minDistSq(pt) };
+
+        //descend into the closer child first so that the other one is more likely to be culled
+        int first = childDistSq[1] < childDistSq[0] ? 1 : 0;
+        for(int i = 0; i < 2; ++i)
+        {
+            int c = i == 0 ? first : 1 - first;
+            if(childTo[c] <= minIdx || childFrom[c] >= maxIdx || childDistSq[c] >= minDistSq)
+                continue;
+            _projectTree(pt, children[c], childFrom[c], childTo[c], minIdx, maxIdx, fromT, toT, minDistSq, minT, arcsTested);
+        }
+    }
+
     double projectNewton(double guess, const Vec &pt, double from, double to) const
     {
         Vec p, der, der2;
@@ -182,8 +530,11 @@ private:
     }
 
     const double _arcSpacing;
-    deque<_ApproxArc> _arcs;
+    vector<_ApproxArc, aligned_allocator<_ApproxArc> > _arcs;
     double _maxArcParam;
+    //Bounding circle hierarchy over ranges of consecutive arcs.
+    //Node n covers a range of arcs, and its children 2n+1 and 2n+2 cover the two halves.
+    vector<_BoundingCircle, aligned_allocator<_BoundingCircle> > _tree;
 };
 
 Clothoid::_ClothoidProjector *Clothoid::_clothoidProjector()
@@ -192,6 +543,18 @@ Clothoid::_ClothoidProjector *Clothoid::_clothoidProjector()
     return projector;
 }
 
+void Clothoid::getProjectionStats(long long &outNumProjections, long long &outNumArcsTested)
+{
+    outNumProjections = numProjections;
+    outNumArcsTested = numArcsTested;
+}
+
+void Clothoid::resetProjectionStats()
+{
+    numProjections = 0;
+    numArcsTested = 0;
+}
+
 END_NAMESPACE_Cornu
 
 
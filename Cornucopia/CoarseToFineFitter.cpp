@@ -0,0 +1,198 @@
+/*--
+    CoarseToFineFitter.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CoarseToFineFitter.h"
+#include "Oversketcher.h"
+#include "Polyline.h"
+#include "PrimitiveSequence.h"
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+PrimitiveSequenceConstPtr CoarseToFineFitter::fit(PolylineConstPtr sketch)
+{
+    _curve = PrimitiveSequenceConstPtr();
+    _parameters.clear();
+    _numRefinedWindows = -1;
+    const VectorC<Vector2d> &pts = sketch->pts();
+    if(pts.size() < 2)
+        return _curve;
+
+    Parameters coarse = _params;
+    coarse.set(Parameters::MIN_PRELIM_LENGTH, _params.get(Parameters::MIN_PRELIM_LENGTH) * _coarseness);
+    coarse.set(Parameters::MAX_SAMPLING_INTERVAL, _params.get(Parameters::MAX_SAMPLING_INTERVAL) * _coarseness);
+
+    _fitter.reset();
+    _fitter.setParams(coarse);
+    _fitter.setOriginalSketch(sketch);
+    _fitter.run();
+    _curve = _fitter.finalOutput();
+    if(!_curve || _curve->isClosed())
+    {
+        _fitWhole(sketch);
+        return _curve;
+    }
+    //the combiner's parameters can be a little off, so the distances are measured by projecting onto the curve
+    Matrix2Xd toProject(2, pts.size());
+    for(int i = 0; i < pts.size(); ++i)
+        toProject.col(i) = pts[i];
+    VectorXd projected = _curve->projectMany(toProject);
+    _parameters.assign(projected.data(), projected.data() + projected.size());
+    vector<double> coarseDistSq(pts.size());
+    for(int i = 0; i < pts.size(); ++i)
+        coarseDistSq[i] = (_curve->pos(_parameters[i]) - pts[i]).squaredNorm();
+
+    //The windows are the runs of points too far from the coarse curve, widened so that the oversketcher sees them
+    //start and end on it and has room for the transitions.  Near an end of the sketch, a window goes all the way
+    //there, because the oversketcher drops the part of the base curve past an end that isn't close to it.
+    const double threshold = _fitter.scaledParameter(Parameters::ERROR_THRESHOLD);
+    const double margin = 4. * _params.get(Parameters::OVERSKETCH_THRESHOLD);
+    vector<pair<int, int> > windows;
+    int numWindowPts = 0;
+    for(int i = 0; i < pts.size(); ++i)
+    {
+        if(coarseDistSq[i] <= SQR(threshold))
+            continue;
+
+        int start = i, end = i;
+        while(end + 1 < pts.size() && coarseDistSq[end + 1] > SQR(threshold))
+            ++end;
+        while(start > 0 && sketch->idxToParam(i) - sketch->idxToParam(start) < margin)
+            --start;
+        i = end;
+        while(end + 1 < pts.size() && sketch->idxToParam(end) - sketch->idxToParam(i) < margin)
+            ++end;
+        if(sketch->idxToParam(start) < 2. * margin)
+            start = 0;
+        if(sketch->length() - sketch->idxToParam(end) < 2. * margin)
+            end = pts.size() - 1;
+
+        if(!windows.empty() && start <= windows.back().second)
+            windows.back().second = end;
+        else
+            windows.push_back(make_pair(start, end));
+        i = end;
+    }
+
+    for(int i = 0; i < (int)windows.size(); ++i)
+        numWindowPts += windows[i].second - windows[i].first + 1;
+    if(numWindowPts * 2 > pts.size())
+    {
+        _fitWhole(sketch);
+        return _curve;
+    }
+
+    //The parameters of the points from firstPending on are still those on the coarse curve: the refits so far
+    //only changed the length of the curve before them, by pendingShift.
+    int firstPending = 0;
+    double pendingShift = 0.;
+    for(int i = 0; i < (int)windows.size(); ++i)
+    {
+        if(!_refine(pts, windows[i].first, windows[i].second, firstPending, pendingShift))
+        {
+            _fitWhole(sketch);
+            return _curve;
+        }
+    }
+    for(int i = firstPending; i < pts.size(); ++i)
+        _parameters[i] += pendingShift;
+
+    _numRefinedWindows = (int)windows.size();
+    return _curve;
+}
+
+void CoarseToFineFitter::_fitWhole(PolylineConstPtr sketch)
+{
+    _numRefinedWindows = -1;
+    _fitter.reset();
+    _fitter.setParams(_params);
+    _fitter.setOriginalSketch(sketch);
+    _fitter.run();
+
+    _curve = _fitter.finalOutput();
+    _parameters.clear();
+    if(_curve)
+        _parameters = _fitter.originalSketchToFinalParameters();
+}
+
+bool CoarseToFineFitter::_refine(const VectorC<Vector2d> &pts, int start, int end, int &firstPending, double &pendingShift)
+{
+    for(; firstPending < start; ++firstPending)
+        _parameters[firstPending] += pendingShift;
+
+    PrimitiveSequenceConstPtr base = _curve;
+    VectorC<Vector2d> window(end - start + 1, NOT_CIRCULAR);
+    for(int i = 0; i < window.size(); ++i)
+        window[i] = pts[start + i];
+
+    _fitter.reset();
+    _fitter.setParams(_params);
+    _fitter.setOversketchBase(base);
+    _fitter.setOriginalSketch(new Polyline(window));
+    _fitter.run();
+
+    PrimitiveSequenceConstPtr result = _fitter.finalOutput();
+    smart_ptr<const AlgorithmOutput<OVERSKETCHING> > osOutput = _fitter.output<OVERSKETCHING>();
+    if(!result || osOutput->finallyClose)
+        return false;
+
+    //The result is the base curve up to unchangedBefore, then the refit, then the base curve from unchangedAfter
+    //on, which is at unchangedAfter + shift on the result.
+    double unchangedBefore = 0., unchangedAfter = base->length();
+    if(osOutput->toPrepend)
+        unchangedBefore = osOutput->toPrepend->length() - osOutput->toPrepend->primitives().back()->length();
+    if(osOutput->toAppend)
+        unchangedAfter = base->length() - (osOutput->toAppend->length() - osOutput->toAppend->primitives()[0]->length());
+    double shift = result->length() - base->length();
+
+    //The points whose parameters may have changed are projected onto the result, as in the incremental fitter.
+    //The final solve with fixed ends can occasionally go astray, so the result is only accepted if these points
+    //are within twice the error threshold of it, or at least (up to rounding) no farther than from the base curve.
+    int first = start, last = end;
+    while(first > 0 && _parameters[first - 1] > unchangedBefore)
+        --first;
+    while(last + 1 < pts.size() && _parameters[last + 1] + pendingShift < unchangedAfter)
+        ++last;
+
+    Matrix2Xd toProject(2, last - first + 1);
+    for(int i = first; i <= last; ++i)
+        toProject.col(i - first) = pts[i];
+    VectorXd projected = result->projectMany(toProject);
+    VectorXd projectedOnBase = base->projectMany(toProject);
+
+    double maxDistSq = SQR(2. * _fitter.scaledParameter(Parameters::ERROR_THRESHOLD)), worstDistSq = 0., baseWorstDistSq = 0.;
+    for(int i = first; i <= last; ++i)
+    {
+        worstDistSq = max(worstDistSq, (result->pos(projected[i - first]) - pts[i]).squaredNorm());
+        baseWorstDistSq = max(baseWorstDistSq, (base->pos(projectedOnBase[i - first]) - pts[i]).squaredNorm());
+    }
+    if(worstDistSq > max(maxDistSq, 1.01 * baseWorstDistSq))
+        return false;
+    for(int i = first; i <= last; ++i)
+        _parameters[i] = projected[i - first];
+
+    firstPending = last + 1;
+    pendingShift += shift;
+    _curve = result;
+    return true;
+}
+
+END_NAMESPACE_Cornu
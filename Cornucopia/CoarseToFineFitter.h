@@ -0,0 +1,79 @@
+/*--
+    CoarseToFineFitter.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_COARSETOFINEFITTER_H_INCLUDED
+#define CORNUCOPIA_COARSETOFINEFITTER_H_INCLUDED
+
+#include "defs.h"
+#include "Parameters.h"
+#include "Fitter.h"
+#include "VectorC.h"
+#include "smart_ptr.h"
+
+NAMESPACE_Cornu
+
+CORNU_SMART_FORW_DECL(Polyline);
+CORNU_SMART_FORW_DECL(PrimitiveSequence);
+
+/*
+    Fits very long sketches, like traced contours or map polylines, in time closer to linear in their length.
+    The sketch is first fit with coarser sampling, which keeps the graph small.  Then only the windows of the
+    sketch where the coarse curve is farther from it than the error threshold are refit at full resolution, each
+    as an oversketch of the curve so far, so that the refit joins the coarse primitives on both sides.  Closed
+    sketches, and sketches that would need refitting over most of their length, are fit at full resolution at once.
+*/
+class CoarseToFineFitter
+{
+public:
+    CoarseToFineFitter() : _coarseness(4.), _numRefinedWindows(0) {}
+
+    const Parameters &params() const { return _params; }
+    void setParams(const Parameters &params) { _params = params; }
+
+    //How many times coarser the sampling of the first fit is: MIN_PRELIM_LENGTH and MAX_SAMPLING_INTERVAL
+    //are multiplied by it.  The curvature-dependent sampling rate stays, as the graph needs it to fit bends.
+    double coarseness() const { return _coarseness; }
+    void setCoarseness(double coarseness) { _coarseness = coarseness; }
+
+    //returns the curve fit to the sketch (null if fitting failed)
+    PrimitiveSequenceConstPtr fit(PolylineConstPtr sketch);
+
+    PrimitiveSequenceConstPtr curve() const { return _curve; }
+    //for each point of the sketch, its parameter on curve()
+    const std::vector<double> &originalSketchToFinalParameters() const { return _parameters; }
+    //how many windows the last fit refined, or -1 if it was done at full resolution at once
+    int numRefinedWindows() const { return _numRefinedWindows; }
+
+private:
+    void _fitWhole(PolylineConstPtr sketch);
+    bool _refine(const VectorC<Eigen::Vector2d> &pts, int start, int end, int &firstPending, double &pendingShift);
+
+    Parameters _params;
+    double _coarseness;
+    Fitter _fitter; //reused by every fit, so its buffers are only allocated once
+
+    PrimitiveSequenceConstPtr _curve;
+    std::vector<double> _parameters;
+    int _numRefinedWindows;
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_COARSETOFINEFITTER_H_INCLUDED
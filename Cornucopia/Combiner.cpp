@@ -31,6 +31,10 @@
 #include "Fitter.h"
 #include "Oversketcher.h"
 #include "PiecewiseLinearUtils.h"
+#include "TwoCurveCombine.h"
+#include "Trace.h"
+#include "AngleUtils.h"
+#include "Snapshot.h"
 
 #include <iterator>
 #include <cstdio>
@@ -49,8 +53,10 @@ class MulticurveDenseEvalData : public LSEvalData
 public:
     //overrides
     double error() const { return _con.squaredNorm(); }
+    double objective() const { return _err.squaredNorm(); }
+    double predictedError(const Eigen::VectorXd &delta) const { return (_con + _conDer * delta).squaredNorm(); }
 
-    void solveForDelta(double damping, Eigen::VectorXd &out, std::set<LSBoxConstraint> &constraints)
+    void solveForDelta(double damping, Eigen::VectorXd &out, LSActiveSet &constraints)
     {
         size_t vars = _errDer.cols();
 
@@ -66,8 +72,13 @@ public:
         rhs.segment(vars, _con.size()) = -_con;
 
         int cnt = 0;
-        for(set<LSBoxConstraint>::const_iterator it = constraints.begin(); it != constraints.end(); ++it, ++cnt)
-            lhs(vars + _conDer.rows() + cnt, it->index) = lhs(it->index, vars + _conDer.rows() + cnt) = 1.;
+        for(int i = 0; i < constraints.numVars(); ++i)
+        {
+            if(!constraints.contains(i))
+                continue;
+            lhs(vars + _conDer.rows() + cnt, i) = lhs(i, vars + _conDer.rows() + cnt) = 1.;
+            ++cnt;
+        }
 
         //lhs += damping * MatrixXd::Identity(size, size);
         lhs.block(0, 0, vars, vars) += damping * MatrixXd::Identity(vars, vars);
@@ -83,16 +94,16 @@ public:
 
         //check which constraints we don't need
         cnt = 0;
-        for(set<LSBoxConstraint>::iterator it = constraints.begin(); it != constraints.end(); ++cnt)
+        for(int i = 0; i < constraints.numVars(); ++i)
         {
-            set<LSBoxConstraint>::iterator next = it;
-            ++next;
-            if(result(vars + _conDer.rows() + cnt) * it->sign > 0)
+            if(!constraints.contains(i))
+                continue;
+            if(result(vars + _conDer.rows() + cnt) * constraints.sign(i) > 0)
             {
-                //printf("Unsetting constraint on variable at index %d\n", it->index);
-                constraints.erase(it);
+                //printf("Unsetting constraint on variable at index %d\n", i);
+                constraints.erase(i);
             }
-            it = next;
+            ++cnt;
         }
     }
 
@@ -134,70 +145,169 @@ public:
 
     //overrides
     double error() const { return _con.squaredNorm(); }
+    double objective() const { return _objective; }
+    double predictedError(const Eigen::VectorXd &delta) const
+    {
+        double out = 0.;
+        int conIdx = 0, curVar = 0;
+        for(int i = 0; i < (int)_conDerCur.size(); ++i)
+        {
+            int nCon = (int)_conDerCur[i].rows();
+            int nextVar = (i + 1 == (int)_errDerBlocks.size()) ? 0 : curVar + (int)_conDerCur[i].cols(); //wraps if closed
+            out += (_con.segment(conIdx, nCon) + _conDerCur[i] * delta.segment(curVar, _conDerCur[i].cols()) +
+                    _conDerNext[i] * delta.segment(nextVar, _conDerNext[i].cols())).squaredNorm();
+            conIdx += nCon;
+            curVar += (int)_conDerCur[i].cols();
+        }
+        return out;
+    }
 
-    void solveForDelta(double damping, Eigen::VectorXd &out, std::set<LSBoxConstraint> &constraints)
+    //The KKT system is solved through the Schur complement C H^-1 C^T of the block diagonal error Hessian H,
+    //where C has the continuity constraints.  Variables held by active box constraints don't move, so they are
+    //eliminated from H and C instead of becoming constraint rows: with a fixed curve, those rows would make the
+    //Schur complement as badly conditioned as the damped Hessian.  Only neighboring junctions share a curve, so
+    //the Schur complement is block tridiagonal (with a corner block for closed curves) and the whole solve is
+    //linear in the number of curves.
+    void solveForDelta(double damping, Eigen::VectorXd &out, LSActiveSet &constraints)
     {
         _computeIndices();
 
-        size_t vars = _blockIndices.back();
-        size_t cons = _con.size() + constraints.size();
-
-        size_t size = vars + cons;
-        VectorXd rhs = VectorXd::Zero(size);
-        rhs.segment(0, vars) = _err;
-        rhs.segment(vars, _con.size()) = -_con;
-
-        BlockCholVectorType cholBlocks(_errDerBlocks.size());
-        for(size_t i = 0; i < cholBlocks.size(); ++i)
-            cholBlocks[i] = BlockCholType(_errDerBlocks[i] + damping * MatrixXd::Identity(_blockSizes[i], _blockSizes[i]));
+        int numCurves = (int)_errDerBlocks.size();
+        int numJunctions = (int)_conDerCur.size();
+        bool closed = (numJunctions == numCurves);
+        bool cyclic = closed && numJunctions >= 3;
+
+        //the variables of each curve that no active box constraint holds
+        vector<vector<int> > freeVars(numCurves);
+        for(int c = 0; c < numCurves; ++c)
+            for(int k = 0; k < (int)_blockSizes[c]; ++k)
+                if(!constraints.contains((int)_blockIndices[c] + k))
+                    freeVars[c].push_back(k);
+
+        //factor the damped error Hessian of the free variables
+        BlockCholVectorType cholBlocks(numCurves);
+        vector<VectorXd> freeErr(numCurves), hInvErr(numCurves);
+        for(int c = 0; c < numCurves; ++c)
+        {
+            const vector<int> &vars = freeVars[c];
+            int n = (int)vars.size();
+            BlockType h(n, n);
+            freeErr[c].resize(n);
+            for(int a = 0; a < n; ++a)
+            {
+                freeErr[c][a] = _err[_blockIndices[c] + vars[a]];
+                for(int b = 0; b < n; ++b)
+                    h(a, b) = _errDerBlocks[c](vars[a], vars[b]);
+                h(a, a) += damping;
+            }
+            cholBlocks[c].compute(h);
+            hInvErr[c] = cholBlocks[c].solve(freeErr[c]);
+        }
 
-        MatrixXd C = MatrixXd::Zero(cons, vars);
-        C.block(0, 0, _con.size(), vars) = _conDer;
+        //the junctions that involve each curve, with the constraint derivatives with respect to its free variables
+        vector<vector<pair<int, MatrixXd> > > touching(numCurves);
+        for(int j = 0; j < numJunctions; ++j)
+        {
+            int next = (j + 1) % numCurves;
+            touching[j].push_back(make_pair(j, _freeColumns(_conDerCur[j], freeVars[j])));
+            touching[next].push_back(make_pair(j, _freeColumns(_conDerNext[j], freeVars[next])));
+        }
 
-        int cnt = 0;
-        for(set<LSBoxConstraint>::const_iterator it = constraints.begin(); it != constraints.end(); ++it, ++cnt)
-            C(_conDer.rows() + cnt, it->index) = 1.;
+        //assemble the Schur complement: diag[j] = S(j, j), sub[j] = S(j + 1, j), corner = S(n - 1, 0)
+        vector<MatrixXd> diag(numJunctions), sub(numJunctions);
+        vector<VectorXd> q(numJunctions);
+        int conIdx = 0;
+        for(int j = 0; j < numJunctions; ++j)
+        {
+            int rows = (int)_conDerCur[j].rows();
+            diag[j] = MatrixXd::Zero(rows, rows);
+            if(j + 1 < numJunctions)
+                sub[j] = MatrixXd::Zero(_conDerCur[j + 1].rows(), rows);
+            q[j] = _con.segment(conIdx, rows);
+            conIdx += rows;
+        }
+        MatrixXd corner = MatrixXd::Zero(cyclic ? _conDerCur.back().rows() : 0, cyclic ? _conDerCur[0].rows() : 0);
 
-        MatrixXd K(C.cols(), C.rows());
-        _solveCholL(K, cholBlocks, C.transpose());
-        LLT<MatrixXd> CholK(K.transpose() * K);
+        for(int c = 0; c < numCurves; ++c)
+        {
+            for(int i = 0; i < (int)touching[c].size(); ++i)
+            {
+                int p = touching[c][i].first;
+                const MatrixXd &xp = touching[c][i].second;
+                MatrixXd hInvXpT = cholBlocks[c].solve(xp.transpose());
+                q[p] += xp * hInvErr[c];
 
-        VectorXd mid(size), result(size);
+                for(int j = 0; j < (int)touching[c].size(); ++j)
+                {
+                    int r = touching[c][j].first;
+                    const MatrixXd &xr = touching[c][j].second;
+                    if(r == p)
+                        diag[p] += xr * hInvXpT;
+                    else if(r == p + 1)
+                        sub[p] += xr * hInvXpT;
+                    else if(cyclic && r == numJunctions - 1 && p == 0)
+                        corner += xr * hInvXpT;
+                }
+            }
+        }
 
-        //solve for mid
-        _solveCholL(mid.segment(0, vars), cholBlocks, rhs.segment(0, vars));
-        mid.segment(vars, cons) = CholK.matrixL().solve(rhs.segment(vars, cons) - K.adjoint() * mid.segment(0, vars));
+        //Constraints can be dependent, e.g. a box constraint on a curvature that has to match a fixed curve's.  A
+        //tiny ridge keeps the factorization finite, and the multipliers then release the box constraint.
+        for(int j = 0; j < numJunctions; ++j)
+            if(diag[j].size() > 0)
+                diag[j].diagonal().array() += 1e-12 * (1. + diag[j].diagonal().cwiseAbs().maxCoeff());
 
-        //solve for result
-        result.segment(vars, cons) = -CholK.matrixU().solve(mid.segment(vars, cons));
-        _solveCholU(result.segment(0, vars), cholBlocks, mid.segment(0, vars) - K * result.segment(vars, cons));
+        vector<VectorXd> lambda;
+        _solveBlockTridiagonal(diag, sub, corner, q, lambda);
 
-        out = result.segment(0, vars);
-#if 0
-        if(_conDer.size() > 0)
-            printf("Con Solve err = %lf\n", (_conDer * out + _con).norm());
-#endif
+        //recover the free variables
+        out = VectorXd::Zero(_blockIndices.back());
+        for(int c = 0; c < numCurves; ++c)
+        {
+            VectorXd rhs = freeErr[c];
+            for(int i = 0; i < (int)touching[c].size(); ++i)
+                rhs -= touching[c][i].second.transpose() * lambda[touching[c][i].first];
+            VectorXd delta = cholBlocks[c].solve(rhs);
+            for(int a = 0; a < (int)freeVars[c].size(); ++a)
+                out[_blockIndices[c] + freeVars[c][a]] = delta[a];
+        }
 
-        //check which constraints we don't need
-        cnt = 0;
-        for(set<LSBoxConstraint>::iterator it = constraints.begin(); it != constraints.end(); ++cnt)
+        //check which constraints we don't need: a box constraint's multiplier is what's left of the
+        //stationarity condition on its variable
+        for(int c = 0; c < numCurves; ++c)
         {
-            set<LSBoxConstraint>::iterator next = it;
-            ++next;
-            if(result(vars + _conDer.rows() + cnt) * it->sign > 0)
+            for(int k = 0; k < (int)_blockSizes[c]; ++k)
             {
-                //printf("Unsetting constraint on variable at index %d\n", it->index);
-                constraints.erase(it);
+                int i = (int)_blockIndices[c] + k;
+                if(!constraints.contains(i))
+                    continue;
+
+                double multiplier = _err[i] - _errDerBlocks[c].row(k).dot(out.segment(_blockIndices[c], _blockSizes[c]));
+                if(c < numJunctions)
+                    multiplier -= _conDerCur[c].col(k).dot(lambda[c]);
+                if(c > 0 || closed)
+                {
+                    int prev = (c + numCurves - 1) % numCurves;
+                    multiplier -= _conDerNext[prev].col(k).dot(lambda[prev]);
+                }
+
+                if(multiplier * constraints.sign(i) > 0)
+                {
+                    //printf("Unsetting constraint on variable at index %d\n", i);
+                    constraints.erase(i);
+                }
             }
-            it = next;
         }
     }
 
     VectorXd &errVectorRef() { return _err; }
     BlockVectorType &errDerBlocksRef() { return _errDerBlocks; }
+    double &objectiveRef() { return _objective; }
 
     VectorXd &conVectorRef() { return _con; }
-    MatrixXd &conDerRef() { return _conDer; }
+    //derivatives of the constraints between curves i and i + 1 with respect to curve i and to curve i + 1
+    vector<MatrixXd> &conDerCurRef() { return _conDerCur; }
+    vector<MatrixXd> &conDerNextRef() { return _conDerNext; }
 
 private:
     void _computeIndices()
@@ -213,37 +323,91 @@ private:
         }
     }
 
-    MatrixXd _blocksToMatrix(const BlockVectorType &blocks)
+    static MatrixXd _freeColumns(const MatrixXd &m, const vector<int> &cols)
     {
-        size_t sz = _blockIndices.back();
-        MatrixXd out = MatrixXd::Zero(sz, sz);
-
-        for(int i = 0; i < (int)blocks.size(); ++i)
-            out.block(_blockIndices[i], _blockIndices[i], _blockSizes[i], _blockSizes[i]) = blocks[i];
-
+        MatrixXd out(m.rows(), cols.size());
+        for(int i = 0; i < (int)cols.size(); ++i)
+            out.col(i) = m.col(cols[i]);
         return out;
     }
 
-    template<class M1, class M2> void _solveCholL(const M1 &out, const BlockCholVectorType &chols, const M2 &rhs)
+    //Solves the symmetric positive definite block tridiagonal system by block Cholesky.  If the corner block
+    //(last row, first column) is not empty, the factor's last block row fills in, which is still linear.
+    static void _solveBlockTridiagonal(vector<MatrixXd> diag, const vector<MatrixXd> &sub, const MatrixXd &corner,
+                                       const vector<VectorXd> &rhs, vector<VectorXd> &out)
     {
-        for(int i = 0; i < (int)chols.size(); ++i)
-            const_cast<M1 &>(out).block(_blockIndices[i], 0, _blockSizes[i], out.cols()) =
-                chols[i].matrixL().solve(rhs.block(_blockIndices[i], 0, _blockSizes[i], rhs.cols()));
-    }
+        int n = (int)diag.size();
+        int last = n - 1;
+        bool cyclic = corner.size() > 0;
+
+        vector<LLT<MatrixXd> > chol(n);
+        vector<MatrixXd> lSub(n); //lSub[j] is the factor's block (j + 1, j)
+        vector<MatrixXd> lLast(n); //lLast[j] is the factor's block (last, j), for cyclic systems
+        for(int j = 0; j < n; ++j)
+        {
+            chol[j].compute(diag[j]);
+            if(j == last)
+                break;
 
-    template<class M1, class M2> void _solveCholU(const M1 &out, const BlockCholVectorType &chols, const M2 &rhs)
-    {
-        for(int i = 0; i < (int)chols.size(); ++i)
-            const_cast<M1 &>(out).block(_blockIndices[i], 0, _blockSizes[i], out.cols()) =
-                chols[i].matrixU().solve(rhs.block(_blockIndices[i], 0, _blockSizes[i], rhs.cols()));
+            if(!cyclic || j + 1 < last)
+            {
+                lSub[j] = chol[j].matrixL().solve(sub[j].transpose()).transpose();
+                diag[j + 1] -= lSub[j] * lSub[j].transpose();
+            }
+
+            if(cyclic)
+            {
+                MatrixXd r = MatrixXd::Zero(diag[last].rows(), diag[j].rows());
+                if(j == 0)
+                    r += corner;
+                if(j + 1 == last)
+                    r += sub[j];
+                if(j > 0)
+                    r -= lLast[j - 1] * lSub[j - 1].transpose();
+                lLast[j] = chol[j].matrixL().solve(r.transpose()).transpose();
+                diag[last] -= lLast[j] * lLast[j].transpose();
+            }
+        }
+
+        //forward substitution
+        vector<VectorXd> y(n);
+        for(int j = 0; j < n; ++j)
+        {
+            VectorXd r = rhs[j];
+            if(j == last && cyclic)
+            {
+                for(int k = 0; k < last; ++k)
+                    r -= lLast[k] * y[k];
+            }
+            else if(j > 0)
+                r -= lSub[j - 1] * y[j - 1];
+            y[j] = chol[j].matrixL().solve(r);
+        }
+
+        //back substitution
+        out.resize(n);
+        for(int j = last; j >= 0; --j)
+        {
+            VectorXd r = y[j];
+            if(j < last)
+            {
+                if(!cyclic || j + 1 < last)
+                    r -= lSub[j].transpose() * out[j + 1];
+                if(cyclic)
+                    r -= lLast[j].transpose() * out[last];
+            }
+            out[j] = chol[j].matrixU().solve(r);
+        }
     }
 
     vector<size_t> _blockIndices, _blockSizes;
     BlockVectorType _errDerBlocks;
 
-    Eigen::VectorXd _err;
+    Eigen::VectorXd _err; //the gradient, not the error vector
+    double _objective;
     Eigen::VectorXd _con;
-    Eigen::MatrixXd _conDer;
+    vector<MatrixXd> _conDerCur;
+    vector<MatrixXd> _conDerNext;
 };
 
 class MulticurveProblem : public LSProblem
@@ -260,11 +424,11 @@ public:
 
         for(int i = 0; i < (int)path.size(); ++i)
         {
-            _primIdcs.push_back(graph->edges[path[i]].startVtx);
-            _continuities.push_back(graph->edges[path[i]].continuity);
+            _primIdcs.push_back(graph->edgeStart[path[i]]);
+            _continuities.push_back(graph->edgeContinuity[path[i]]);
         }
         if(!_closed)
-            _primIdcs.push_back(graph->edges[path.back()].endVtx);
+            _primIdcs.push_back(graph->edgeEnd[path.back()]);
         
         _curves = VectorC<CurvePrimitivePtr>((int)_primIdcs.size(), _closed ? CIRCULAR : NOT_CIRCULAR);
         _curveRanges = VectorC<pair<int, int> >((int)_primIdcs.size(), _curves.circular());
@@ -273,6 +437,7 @@ public:
             _curveRanges[i] = make_pair(_primitives[_primIdcs[i]].startIdx, _primitives[_primIdcs[i]].endIdx);
             _curves[i] = _primitives[_primIdcs[i]].curve->clone();
         }
+        _projections.resize(_curves.size());
 
         //trim curves and ranges
         const int sampledPts = fitter.output<RESAMPLING>()->output->pts().size();
@@ -299,6 +464,59 @@ public:
         }
     }
 
+    //Starts the curves from the two-curve combinations of neighboring primitives that the path's edges were
+    //validated with.  Each curve is adjusted to join the previous one in one combination and the next one in
+    //another, so its starting point is the average of the two.
+    void warmStart(const Fitter &fitter)
+    {
+        CORNU_TRACE_SCOPE("MulticurveProblem::warmStart");
+        int numJunctions = (int)_continuities.size();
+        vector<Combination> combinations(numJunctions);
+        TwoCurveCombineContext context(fitter);
+        for(int i = 0; i < numJunctions; ++i)
+        {
+            if(_continuities[i] == 0)
+                continue;
+
+            int p1 = _primIdcs[i], p2 = _primIdcs[(i + 1) % _primIdcs.size()];
+            Combination &combination = combinations[i];
+            combination.c1 = _primitives[p1].curve->clone();
+            combination.c2 = _primitives[p2].curve->clone();
+            if(!context.cache || !context.cache->findCurves(p1, p2, _continuities[i], *combination.c1, *combination.c2))
+                combination = twoCurveCombine(p1, p2, _continuities[i], context);
+            combination.c1->flip(); //it comes out reversed
+        }
+
+        for(int i = 0; i < (int)_curves.size(); ++i)
+        {
+            int prev = (i + numJunctions - 1) % numJunctions;
+            bool joinsPrev = (_closed || i > 0) && _continuities[prev] > 0;
+            bool joinsNext = i < numJunctions && _continuities[i] > 0;
+
+            if(!joinsNext)
+            {
+                if(joinsPrev)
+                    _curves[i] = combinations[prev].c2;
+                continue;
+            }
+            if(!joinsPrev)
+            {
+                _curves[i] = combinations[i].c1;
+                continue;
+            }
+
+            //the combination with the next curve starts where the primitive did, before it was trimmed
+            const CurvePrimitivePtr &fromPrev = combinations[prev].c2;
+            CurvePrimitivePtr fromNext = combinations[i].c1;
+            fromNext->trim(fromNext->project(fromPrev->startPos()), fromNext->length());
+
+            VectorXd p = fromPrev->params(), n = fromNext->params();
+            n[CurvePrimitive::ANGLE] = AngleUtils::toRange(n[CurvePrimitive::ANGLE], p[CurvePrimitive::ANGLE] - PI);
+            _curves[i] = fromNext;
+            _curves[i]->setParams(0.5 * (p + n));
+        }
+    }
+
     vector<LSBoxConstraint> getConstraints() const
     {
         vector<LSBoxConstraint> out;
@@ -374,6 +592,7 @@ public:
     LSEvalData *createEvalData() { return new EvalDataType(); }
     void eval(const Eigen::VectorXd &x, LSEvalData *data)
     {
+        CORNU_TRACE_SCOPE("MulticurveProblem::eval");
         setParams(x);
         EvalDataType *evalData = static_cast<EvalDataType *>(data);
         _evalError(evalData);
@@ -404,7 +623,7 @@ public:
             char name[100];
             sprintf(name, "Out%d", _iter);
             for(int i = 0; i < _curves.size(); ++i)
-                Debugging::get()->drawPrimitive(_curves[i], name, i, 2.);
+                CORNU_DEBUG(drawPrimitive(_curves[i], name, i, 2.));
         }
 
         ++_iter;
@@ -454,13 +673,24 @@ public:
             bool firstCorner = (!_closed && i == 0) || (_continuities[(i + csz - 1) % csz] == 0);
             bool lastCorner = (!_closed && i + 1 == (int)_curves.size()) || (_continuities[i] == 0);
 
-            out += _errorComputer->computeError(_curves[i], _curveRanges[i].first, _curveRanges[i].second, firstCorner, lastCorner);
+            out += _errorComputer->computeErrorIncremental(_curves[i], _curveRanges[i].first, _curveRanges[i].second, _projections[i], firstCorner, lastCorner);
         }
 
         return out;
     }
 
 private:
+#if SPARSE
+    //J^T J and -J^T e for one curve, with its parameter count known statically so the products are unrolled
+    template<int NumParams>
+    static void _normalEquations(const MatrixXd &der, const VectorXd &err, EvalDataType::BlockType &outBlock, VectorXd::SegmentReturnType outRhs)
+    {
+        Map<const Matrix<double, Dynamic, NumParams> > fixedDer(der.data(), der.rows(), NumParams);
+        outBlock = fixedDer.transpose() * fixedDer;
+        outRhs = -fixedDer.transpose() * err;
+    }
+#endif
+
     void _evalError(EvalDataType *evalData)
     {
         vector<VectorXd> errVecs(_curves.size());
@@ -473,8 +703,8 @@ private:
             bool firstCorner = (!_closed && i == 0) || (_continuities[(i + csz - 1) % csz] == 0);
             bool lastCorner = (!_closed && i + 1 == (int)_curves.size()) || (_continuities[i] == 0);
 
-            _errorComputer->computeErrorVector(_curves[i], _curveRanges[i].first, _curveRanges[i].second,
-                errVecs[i], &(errVecDers[i]), firstCorner, lastCorner);
+            _errorComputer->computeErrorVectorIncremental(_curves[i], _curveRanges[i].first, _curveRanges[i].second,
+                errVecs[i], &(errVecDers[i]), _projections[i], firstCorner, lastCorner);
             
             _curves[i]->toEndCurvatureDerivative(errVecDers[i]);
 
@@ -488,6 +718,7 @@ private:
         EvalDataType::BlockVectorType &outErrDerBlocks = evalData->errDerBlocksRef();
         outErrDerBlocks.resize(_curves.size());
         outErr = VectorXd::Zero(numVar);
+        evalData->objectiveRef() = 0.;
 #else
         outErr = VectorXd::Zero(numErr);
         MatrixXd &outErrDer = evalData->errDerRef();
@@ -500,8 +731,13 @@ private:
             size_t nErr = errVecs[i].size();
             size_t nVar = errVecDers[i].cols();
 #if SPARSE
-            outErrDerBlocks[i] = errVecDers[i].transpose() * errVecDers[i];
-            outErr.segment(curVar, nVar) = -errVecDers[i].transpose() * errVecs[i];
+            switch(nVar)
+            {
+            case 4: _normalEquations<4>(errVecDers[i], errVecs[i], outErrDerBlocks[i], outErr.segment(curVar, nVar)); break;
+            case 5: _normalEquations<5>(errVecDers[i], errVecs[i], outErrDerBlocks[i], outErr.segment(curVar, nVar)); break;
+            case 6: _normalEquations<6>(errVecDers[i], errVecs[i], outErrDerBlocks[i], outErr.segment(curVar, nVar)); break;
+            }
+            evalData->objectiveRef() += errVecs[i].squaredNorm();
 #else
             outErrDer.block(curErr, curVar, nErr, nVar) = errVecDers[i];
             outErr.segment(curErr, nErr) = errVecs[i];
@@ -514,7 +750,6 @@ private:
     void _evalConstraints(EvalDataType *evalData)
     {
         VectorXd &outCon = evalData->conVectorRef();
-        MatrixXd &outConDer = evalData->conDerRef();
 
         vector<VectorXd> conVecs(_continuities.size());
         vector<MatrixXd> conVecDers(_continuities.size());
@@ -543,6 +778,33 @@ private:
             numVar += _curves.back()->numParams();
 
         outCon = VectorXd::Zero(numCon);
+#if SPARSE
+        vector<MatrixXd> &outConDerCur = evalData->conDerCurRef();
+        vector<MatrixXd> &outConDerNext = evalData->conDerNextRef();
+        outConDerCur.resize(_continuities.size());
+        outConDerNext.resize(_continuities.size());
+
+        size_t curCon = 0;
+        for(int i = 0; i < (int)_continuities.size(); ++i)
+        {
+            size_t nCon = conVecs[i].size();
+            outCon.segment(curCon, nCon) = conVecs[i];
+            outConDerCur[i] = conVecDers[i];
+
+            //the second curve only enters through its start point, angle, and curvature
+            MatrixXd &next = outConDerNext[i];
+            next = MatrixXd::Zero(nCon, _curves[i + 1]->numParams());
+            next(0, CurvePrimitive::X) = -1.;
+            next(1, CurvePrimitive::Y) = -1.;
+            if(nCon > 2)
+                next(2, CurvePrimitive::ANGLE) = -1.;
+            if(nCon > 3 && _curves[i + 1]->getType() != CurvePrimitive::LINE)
+                next(3, CurvePrimitive::CURVATURE) = -1.;
+
+            curCon += nCon;
+        }
+#else
+        MatrixXd &outConDer = evalData->conDerRef();
         outConDer = MatrixXd::Zero(numCon, numVar);
 
         size_t curCon = 0, curVar = 0;
@@ -564,6 +826,7 @@ private:
             curCon += nCon;
             curVar += nVar;
         }
+#endif
     }
 
     VectorC<CurvePrimitivePtr> _curves;
@@ -571,11 +834,72 @@ private:
     vector<int> _primIdcs;
     vector<int> _continuities; //continuity[i] is between curves i and i + 1
     VectorC<pair<int, int> > _curveRanges;
+    //of each curve's samples in the last error computation: the curves only move a little between solver
+    //iterations, so these warm-start the next one's projections
+    mutable vector<VectorXd> _projections;
     bool _closed;
     ErrorComputerConstPtr _errorComputer;
     bool _inflectionAccounting;
 };
 
+//Projects points that come in order along a primitive.  Projecting onto a clothoid searches the whole curve, but
+//a point next to the previous one projects near the previous parameter, so Newton's method from there converges
+//in a few steps.  It's only trusted close to the curve relative to its radius of curvature, where the projection
+//is unique; otherwise, or if Newton doesn't converge, this falls back to project.
+class OrderedProjector
+{
+public:
+    OrderedProjector(const CurvePrimitiveConstPtr &curve)
+        : _curve(curve), _s(-1.), _newton(curve->getType() == CurvePrimitive::CLOTHOID),
+          _maxCurvature(max(fabs(curve->startCurvature()), fabs(curve->endCurvature()))) {}
+
+    double project(const Vector2d &pt, Vector2d &outPos)
+    {
+        if(!_newton || _s < 0. || !_newtonProject(pt, outPos))
+        {
+            _s = _curve->project(pt);
+            outPos = _curve->pos(_s);
+        }
+        return _s;
+    }
+
+private:
+    bool _newtonProject(const Vector2d &pt, Vector2d &outPos)
+    {
+        const int maxIterations = 8;
+        const double len = _curve->length(), tol = 1e-9 * (1. + len);
+
+        double s = _s;
+        for(int i = 0; i < maxIterations; ++i)
+        {
+            Vector2d pos, der, der2;
+            _curve->eval(s, &pos, &der, &der2);
+            Vector2d diff = pos - pt;
+
+            //minimize the squared distance, whose derivative is diff . der
+            double secondDer = 1. + diff.dot(der2);
+            if(secondDer < 0.5)
+                return false;
+            double next = min(len, max(0., s - diff.dot(der) / secondDer));
+            if(fabs(next - s) < tol)
+            {
+                if(diff.squaredNorm() * SQR(_maxCurvature) > 0.25)
+                    return false;
+                _s = s;
+                outPos = pos;
+                return true;
+            }
+            s = next;
+        }
+        return false;
+    }
+
+    CurvePrimitiveConstPtr _curve;
+    double _s; //the parameter of the previous point, or -1 before the first
+    bool _newton;
+    double _maxCurvature;
+};
+
 class DefaultCombiner : public Algorithm<COMBINING>
 {
 public:
@@ -595,38 +919,42 @@ protected:
         VectorC<CurvePrimitiveConstPtr> outV;
 
         //if a single primitive
-        if(graph->edges[path[0]].continuity == -1)
+        if(graph->edgeContinuity[path[0]] == -1)
         {
             outV = VectorC<CurvePrimitiveConstPtr>(1, NOT_CIRCULAR);
-            outV[0] = primitives[graph->edges[path[0]].startVtx].curve;
+            outV[0] = primitives[graph->edgeStart[path[0]]].curve;
         }
         else //solve the nonlinear problem
         {
             MulticurveProblem problem(fitter);
+            problem.warmStart(fitter);
             vector<LSBoxConstraint> constraints = problem.getConstraints();
             LSSolver solver(&problem, constraints);
             solver.setDefaultDamping(fitter.params().get(Parameters::COMBINE_DAMPING));
             solver.setMaxIter(50);
             solver.setIncreaseDampingAfter(5);
             solver.setDampingIncreaseFactor(1.5);
+            solver.setObjectiveTolerance(1e-3, 1e-8);
+            solver.setDeadline(fitter.deadline());
+            solver.setCancelFlag(fitter.cancelFlag());
 
             VectorXd result = solver.solve(problem.params());
             problem.setParams(result);
-            Debugging::get()->printf("Final objective = %lf", sqrt(problem.objective()));
+            CORNU_DEBUG(printf("Final objective = %lf after %d iterations", sqrt(problem.objective()), solver.numIterations()));
+            out.numIterations = solver.numIterations();
 
             outV = problem.curves();
         }
 
         //==== track what happens to parameters ====
-        out.parameters = fitter.output<RESAMPLING>()->parameters;
         PolylineConstPtr resampledCurve = fitter.output<RESAMPLING>()->output;
         const VectorC<Vector2d> &resampled = resampledCurve->pts();
 
         vector<int> finalPrimitives; //gather the indices of the graph vertices corresponding to the primitives
         for(int i = 0; i < (int)path.size(); ++i)
-            finalPrimitives.push_back(graph->edges[path[i]].startVtx);
+            finalPrimitives.push_back(graph->edgeStart[path[i]]);
         if(outV.size() > (int)finalPrimitives.size())
-            finalPrimitives.push_back(graph->edges[path.back()].endVtx);
+            finalPrimitives.push_back(graph->edgeEnd[path.back()]);
 
         assert(outV.size() == finalPrimitives.size());
 
@@ -637,6 +965,7 @@ protected:
         for(int i = 0; i < outV.size(); ++i) //for each primitive see what projects to it
         {
             const FitPrimitive &primitive = primitives[graph->vertices[finalPrimitives[i]].primitiveIdx];
+            OrderedProjector projector(outV[i]);
             for(int j = primitive.startIdx; ; ++j) //project each associated resampled point onto this primitive
             {
                 if(j == (int)resampled.size()) //be careful with starts and ends of oversketched primitives
@@ -649,8 +978,9 @@ protected:
                 if(j < 0)
                     continue;
 
-                double proj = outV[i]->project(resampled[j]);
-                double distSq = (resampled[j] - outV[i]->pos(proj)).squaredNorm();
+                Vector2d projPos;
+                double proj = projector.project(resampled[j], projPos);
+                double distSq = (resampled[j] - projPos).squaredNorm();
                 if(distSq < idxToDistSq[j])
                 {
                     idxToDistSq[j] = distSq;
@@ -687,14 +1017,9 @@ protected:
             finalParam += idxToParam[ci.index()];
             prevToFinal.add(lenSoFar, finalParam);
         }
-        //adjust parameters into range
-        for(int i = 0; i < (int)out.parameters.size(); ++i)
-        {
-            out.parameters[i] -= resampledCurve->idxToParam(minParamSample);
-            if(out.parameters[i] < 0)
-                out.parameters[i] += resampledCurve->length();
-        }
-        prevToFinal.batchEval(out.parameters);
+        //the parameters are shifted into range before prevToFinal, and by the oversketching changes after it
+        ParameterMapPtr parameters = new ParameterMap(fitter.output<RESAMPLING>()->parameters, std::move(prevToFinal));
+        parameters->setWrap(resampledCurve->idxToParam(minParamSample), 0., resampledCurve->length());
 
         //==== combine with what needs to be done w.r.t. oversketching ====
         smart_ptr<const AlgorithmOutput<OVERSKETCHING> > osOutput = fitter.output<OVERSKETCHING>();
@@ -703,8 +1028,7 @@ protected:
         if(osOutput->toPrepend)
         {
             outFinal.insert(outFinal.end(), osOutput->toPrepend->primitives().begin(), osOutput->toPrepend->primitives().end() - 1);
-            for(int i = 0; i < (int)out.parameters.size(); ++i)
-                out.parameters[i] += (osOutput->toPrepend->length() - osOutput->toPrepend->primitives().back()->length());
+            parameters->addShift(osOutput->toPrepend->length() - osOutput->toPrepend->primitives().back()->length());
         }
         outFinal.insert(outFinal.end(), outV.begin(), outV.end());
 
@@ -729,25 +1053,50 @@ protected:
                     outFinal.pop_back();
                     //now extend the first curve to the combined length
                     outFinal[0] = outFinal[0]->trimmed(origLen - lastCurveLen, firstCurveLen);
-                    for(int i = 0; i < (int)out.parameters.size(); ++i)
-                        out.parameters[i] -= (origLen - lastCurveLen);
+                    parameters->addShift(lastCurveLen - origLen);
                 }
             }
         }
 
         out.output = new PrimitiveSequence(outFinal);
+        out.parameters = parameters;
 
 #if 1
-        for(int i = 0; i < (int)out.parameters.size(); ++i)
+        for(int i = 0; CORNU_DEBUGGING_ON && i < (int)out.parameters->values().size(); ++i)
         {
-            double paramOrig = fitter.originalSketch()->idxToParam(i);
-            Debugging::get()->drawLine(fitter.originalSketch()->pts()[i], out.output->pos(out.parameters[i]), Vector3d(1, 0, 1), "Correspondence");
+            CORNU_DEBUG(drawLine(fitter.originalSketch()->pts()[i], out.output->pos(out.parameters->values()[i]), Vector3d(1, 0, 1), "Correspondence"));
         }
 #endif
 
     }
 };
 
+size_t AlgorithmOutput<COMBINING>::memoryUsage() const
+{
+    return sizeof(*this) + (output ? output->memoryUsage() : 0) + (parameters ? parameters->memoryUsage() : 0);
+}
+
+void AlgorithmOutput<COMBINING>::recycle()
+{
+    output.reset();
+    parameters.reset();
+    numIterations = 0;
+}
+
+void AlgorithmOutput<COMBINING>::write(SnapshotWriter &out) const
+{
+    out.writeCurves(output);
+    out.writeParameterMap(parameters);
+    out.writeInt(numIterations);
+}
+
+void AlgorithmOutput<COMBINING>::read(SnapshotReader &in, const Fitter &)
+{
+    output = in.readCurves();
+    parameters = in.readParameterMap();
+    numIterations = in.readInt();
+}
+
 void Algorithm<COMBINING>::_initialize()
 {
     new DefaultCombiner();
@@ -29,12 +29,21 @@
 NAMESPACE_Cornu
 
 CORNU_SMART_FORW_DECL(PrimitiveSequence);
+CORNU_SMART_FORW_DECL(ParameterMap);
 
 template<>
 struct AlgorithmOutput<COMBINING> : public AlgorithmOutputBase
 {
+    AlgorithmOutput() : numIterations(0) {}
+
     PrimitiveSequenceConstPtr output;
-    std::vector<double> parameters; //parameters[i] is the parameter in output of the original point with index i
+    ParameterMapConstPtr parameters; //maps the original point with index i to its parameter in output
+    int numIterations; //taken by the solver that joins the primitives
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
@@ -0,0 +1,290 @@
+/*--
+    CompactCurve.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "CompactCurve.h"
+#include "PrimitiveSequence.h"
+#include "Line.h"
+#include "Arc.h"
+#include "Clothoid.h"
+
+#include <cstring>
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+static const unsigned char magic[3] = { 'C', 'N', 'B' };
+static const int version = 1;
+static const int explicitStartFlag = 4; //in a primitive's first byte, after the two bits of its type
+static const double maxSteps = 1e15; //more steps than this and the tolerance is too fine for the curve
+
+//The steps for rounding.  Rounding a value moves the end of the primitive by at most half a step times the factor
+//below, which is at most tolerance / 8, so a primitive whose start is within half the tolerance stays within the
+//tolerance.  Angles and curvatures scale with the primitive's length, which is rounded first.
+struct _Steps
+{
+    _Steps(double tolerance) : length(0.25 * tolerance), _tolerance(tolerance) {}
+
+    double angle(double len) const { return _tolerance / (4. * len); } //moves the end by len
+    double curvature(double len) const { return _tolerance / (2. * len * len); } //by len^2 / 2
+    double endCurvature(double len) const { return 1.5 * _tolerance / (len * len); } //by len^2 / 6
+
+    double length; //also for explicit start points
+
+private:
+    double _tolerance;
+};
+
+//Where the last primitive decoded ended, which the next one is stored relative to
+struct _EndState
+{
+    _EndState() : pos(Vector2d::Zero()), angle(0.), curvature(0.) {}
+
+    void set(const CurvePrimitive &prim)
+    {
+        pos = prim.endPos();
+        angle = prim.endAngle();
+        curvature = prim.getType() == CurvePrimitive::LINE ? 0. : prim.endCurvature();
+    }
+
+    Vector2d pos;
+    double angle;
+    double curvature;
+};
+
+//makes the primitive the decoder makes from the rounded values, which the encoder also needs
+static CurvePrimitivePtr _makePrimitive(int type, const Vector2d &start, double angle, double length,
+                                        double curvature, double endCurvature)
+{
+    CurvePrimitive::ParamVec params(4 + type);
+    params.head<2>() = start;
+    params[CurvePrimitive::ANGLE] = AngleUtils::toRange(angle);
+    params[CurvePrimitive::LENGTH] = length;
+
+    CurvePrimitivePtr out;
+    if(type == CurvePrimitive::LINE)
+        out = new Line();
+    else if(type == CurvePrimitive::ARC)
+        out = new Arc();
+    else
+        out = new Clothoid();
+    if(type >= CurvePrimitive::ARC)
+        params[CurvePrimitive::CURVATURE] = curvature;
+    if(type == CurvePrimitive::CLOTHOID)
+        params[CurvePrimitive::DCURVATURE] = (endCurvature - curvature) / length;
+    out->setParams(params);
+    return out;
+}
+
+//==================Encoding===========================
+
+class _Encoder
+{
+public:
+    _Encoder(vector<unsigned char> &out) : _out(out), _ok(true) {}
+
+    bool ok() const { return _ok; }
+
+    void writeByte(unsigned char c) { _out.push_back(c); }
+    void writeUnsigned(unsigned long long x)
+    {
+        while(x >= 0x80)
+        {
+            _out.push_back((unsigned char)(x | 0x80));
+            x >>= 7;
+        }
+        _out.push_back((unsigned char)x);
+    }
+
+    //writes round(x / step) with the sign folded into the lowest bit and returns the rounded value
+    double writeRounded(double x, double step)
+    {
+        double steps = floor(x / step + 0.5);
+        if(!(fabs(steps) <= maxSteps)) //also catches NaNs
+        {
+            _ok = false;
+            steps = 0.;
+        }
+        long long n = (long long)steps;
+        writeUnsigned(((unsigned long long)n << 1) ^ (unsigned long long)(n >> 63));
+        return steps * step;
+    }
+
+private:
+    vector<unsigned char> &_out;
+    bool _ok;
+};
+
+vector<unsigned char> encodeCompactCurve(PrimitiveSequenceConstPtr curve, double tolerance)
+{
+    vector<unsigned char> out;
+    if(!curve || !(tolerance > 0.))
+        return out;
+
+    const VectorC<CurvePrimitiveConstPtr> &prims = curve->primitives();
+    const _Steps steps(tolerance);
+
+    _Encoder encoder(out);
+    out.insert(out.end(), magic, magic + 3);
+    encoder.writeByte(version);
+    unsigned long long bits;
+    memcpy(&bits, &tolerance, sizeof(bits));
+    for(int i = 0; i < 8; ++i)
+        encoder.writeByte((unsigned char)(bits >> (8 * i)));
+    encoder.writeUnsigned(curve->isClosed() ? 1 : 0);
+    encoder.writeUnsigned(prims.size());
+
+    _EndState end;
+    for(int i = 0; i < prims.size(); ++i)
+    {
+        const CurvePrimitive &prim = *prims.flatAt(i);
+        int type = prim.getType();
+
+        Vector2d start = end.pos;
+        bool explicitStart = i == 0 || (prim.startPos() - end.pos).squaredNorm() > SQR(0.5 * tolerance);
+        encoder.writeByte((unsigned char)(type | (explicitStart ? explicitStartFlag : 0)));
+        if(explicitStart)
+        {
+            start[0] = encoder.writeRounded(prim.startPos()[0], steps.length);
+            start[1] = encoder.writeRounded(prim.startPos()[1], steps.length);
+        }
+
+        //lengths are stored as unsigned numbers of steps, at least one
+        double lengthSteps = max(1., floor(prim.length() / steps.length + 0.5));
+        if(lengthSteps > maxSteps)
+            return vector<unsigned char>();
+        encoder.writeUnsigned((unsigned long long)lengthSteps);
+        double length = lengthSteps * steps.length;
+
+        double angle = end.angle + encoder.writeRounded(AngleUtils::toRange(prim.startAngle() - end.angle, -PI), steps.angle(length));
+        double curvature = 0., endCurvature = 0.;
+        if(type >= CurvePrimitive::ARC)
+            curvature = end.curvature + encoder.writeRounded(prim.startCurvature() - end.curvature, steps.curvature(length));
+        if(type == CurvePrimitive::CLOTHOID)
+            endCurvature = curvature + encoder.writeRounded(prim.endCurvature() - curvature, steps.endCurvature(length));
+
+        end.set(*_makePrimitive(type, start, angle, length, curvature, endCurvature));
+    }
+
+    if(!encoder.ok())
+        out.clear();
+    return out;
+}
+
+//==================Decoding===========================
+
+class _Decoder
+{
+public:
+    _Decoder(const unsigned char *data, size_t size) : _cur(data), _end(data + size), _ok(true) {}
+
+    bool ok() const { return _ok; }
+
+    unsigned char readByte()
+    {
+        if(_cur == _end)
+        {
+            _ok = false;
+            return 0;
+        }
+        return *_cur++;
+    }
+
+    unsigned long long readUnsigned()
+    {
+        unsigned long long x = 0;
+        for(int shift = 0; shift < 64; shift += 7)
+        {
+            unsigned char c = readByte();
+            x |= (unsigned long long)(c & 0x7f) << shift;
+            if(!(c & 0x80))
+                return x;
+        }
+        _ok = false; //too long
+        return 0;
+    }
+
+    double readRounded(double step)
+    {
+        unsigned long long x = readUnsigned();
+        long long n = (long long)(x >> 1) ^ -(long long)(x & 1);
+        return (double)n * step;
+    }
+
+private:
+    const unsigned char *_cur, *_end;
+    bool _ok;
+};
+
+PrimitiveSequencePtr decodeCompactCurve(const unsigned char *data, size_t size)
+{
+    _Decoder decoder(data, size);
+    for(int i = 0; i < 3; ++i)
+        if(decoder.readByte() != magic[i])
+            return PrimitiveSequencePtr();
+    if(decoder.readByte() > version)
+        return PrimitiveSequencePtr();
+    unsigned long long bits = 0;
+    for(int i = 0; i < 8; ++i)
+        bits |= (unsigned long long)decoder.readByte() << (8 * i);
+    double tolerance;
+    memcpy(&tolerance, &bits, sizeof(tolerance));
+    bool closed = decoder.readUnsigned() != 0;
+    unsigned long long numPrims = decoder.readUnsigned();
+    //each primitive takes at least three bytes, so a bad count fails here rather than in the allocation
+    if(!decoder.ok() || !(tolerance > 0.) || numPrims == 0 || numPrims > size / 3)
+        return PrimitiveSequencePtr();
+
+    const _Steps steps(tolerance);
+    VectorC<CurvePrimitiveConstPtr> prims((int)numPrims, closed ? CIRCULAR : NOT_CIRCULAR);
+    _EndState end;
+    for(int i = 0; i < prims.size(); ++i)
+    {
+        unsigned char header = decoder.readByte();
+        int type = header & (explicitStartFlag - 1);
+        if(type > CurvePrimitive::CLOTHOID || header >= 2 * explicitStartFlag)
+            return PrimitiveSequencePtr();
+
+        Vector2d start = end.pos;
+        if(header & explicitStartFlag)
+        {
+            start[0] = decoder.readRounded(steps.length);
+            start[1] = decoder.readRounded(steps.length);
+        }
+        double length = (double)decoder.readUnsigned() * steps.length;
+        if(length <= 0.)
+            return PrimitiveSequencePtr();
+        double angle = end.angle + decoder.readRounded(steps.angle(length));
+        double curvature = 0., endCurvature = 0.;
+        if(type >= CurvePrimitive::ARC)
+            curvature = end.curvature + decoder.readRounded(steps.curvature(length));
+        if(type == CurvePrimitive::CLOTHOID)
+            endCurvature = curvature + decoder.readRounded(steps.endCurvature(length));
+        if(!decoder.ok())
+            return PrimitiveSequencePtr();
+
+        CurvePrimitivePtr prim = _makePrimitive(type, start, angle, length, curvature, endCurvature);
+        end.set(*prim);
+        prims.flatAt(i) = prim;
+    }
+
+    return new PrimitiveSequence(prims);
+}
+
+END_NAMESPACE_Cornu
@@ -0,0 +1,53 @@
+/*--
+    CompactCurve.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_COMPACTCURVE_H_INCLUDED
+#define CORNUCOPIA_COMPACTCURVE_H_INCLUDED
+
+#include "defs.h"
+#include "smart_ptr.h"
+
+#include <vector>
+
+NAMESPACE_Cornu
+
+CORNU_SMART_FORW_DECL(PrimitiveSequence);
+
+/*
+    A compact binary encoding of curves, e.g., for sending fits from a server to clients.  Each primitive starts
+    where the last one decoded ended, unless that is more than half the tolerance off, and its start angle and
+    curvature are stored as the change from the last one's end.  Those changes, the lengths and a clothoid's change
+    in curvature are rounded to steps that keep the decoded curve within the tolerance of the original, and are
+    written as variable length integers, so a G2 primitive typically takes 5 to 8 bytes.  The encoder decodes
+    as it goes, so rounding errors don't add up along the curve.
+
+    The data starts with the bytes 'C', 'N', 'B' and a version number, followed by the tolerance as a little endian
+    IEEE double.  The decoder rejects later versions.
+*/
+
+//Returns the encoding of the curve, which is empty if the curve is null or the tolerance isn't positive
+std::vector<unsigned char> encodeCompactCurve(PrimitiveSequenceConstPtr curve, double tolerance);
+//Returns null if the data isn't a valid encoding of a version this decoder reads
+PrimitiveSequencePtr decodeCompactCurve(const unsigned char *data, size_t size);
+inline PrimitiveSequencePtr decodeCompactCurve(const std::vector<unsigned char> &data) { return decodeCompactCurve(data.empty() ? NULL : &data[0], data.size()); }
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_COMPACTCURVE_H_INCLUDED
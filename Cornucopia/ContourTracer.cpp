@@ -0,0 +1,266 @@
+/*--
+    ContourTracer.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ContourTracer.h"
+#include "defs.h"
+#include "ThreadPool.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+NAMESPACE_Cornu
+
+namespace
+{
+    //A piece of an outline inside one tile, from where it enters the tile (or starts at the image border) to where
+    //it leaves it.  The ends are the ids of the cell edges they are on, which the neighboring tile's pieces share.
+    struct Fragment
+    {
+        long long start, end;
+        vector<double> xy;
+    };
+
+    struct TracedTile
+    {
+        vector<Fragment> fragments;
+        vector<vector<double> > loops; //outlines entirely inside the tile, ending with their first point again
+    };
+
+    class TileTracer
+    {
+    public:
+        TileTracer(const unsigned char *pixels, int width, int stride, double threshold)
+            : _pixels(pixels), _width(width), _stride(stride), _threshold(threshold) {}
+
+        //traces the cells [x0, x1) x [y0, y1), where cell (x, y) has pixel centers (x, y) through (x + 1, y + 1) as corners
+        void trace(int x0, int y0, int x1, int y1, TracedTile &out);
+
+    private:
+        double _value(int x, int y) const { return _pixels[(ptrdiff_t)y * _stride + x]; }
+        bool _inside(int x, int y) const { return _value(x, y) < _threshold; }
+
+        //Edge ids within the tile: edge 2i goes right from grid node i and edge 2i + 1 goes down from it
+        int _localEdge(int x, int y, int down) const { return 2 * ((y - _y0) * (_x1 - _x0 + 1) + x - _x0) + down; }
+        long long _globalEdge(int local) const;
+        void _appendCrossing(int local, vector<double> &xy) const; //the point where the contour crosses the edge
+
+        const unsigned char *_pixels;
+        int _width, _stride;
+        double _threshold;
+        int _x0, _y0, _x1;
+    };
+
+    long long TileTracer::_globalEdge(int local) const
+    {
+        int node = local / 2, rowLength = _x1 - _x0 + 1;
+        return 2 * ((long long)(_y0 + node / rowLength) * _width + _x0 + node % rowLength) + local % 2;
+    }
+
+    void TileTracer::_appendCrossing(int local, vector<double> &xy) const
+    {
+        int node = local / 2, rowLength = _x1 - _x0 + 1;
+        int x = _x0 + node % rowLength, y = _y0 + node / rowLength, down = local % 2;
+        //the same computation for both tiles next to the edge, so their fragments meet exactly
+        double v0 = _value(x, y), v1 = down ? _value(x, y + 1) : _value(x + 1, y);
+        double t = (_threshold - v0) / (v1 - v0);
+        xy.push_back(x + 0.5 + (down ? 0. : t));
+        xy.push_back(y + 0.5 + (down ? t : 0.));
+    }
+
+    void TileTracer::trace(int x0, int y0, int x1, int y1, TracedTile &out)
+    {
+        _x0 = x0;
+        _y0 = y0;
+        _x1 = x1;
+        int numEdges = 2 * (x1 - x0 + 1) * (y1 - y0 + 1);
+        vector<int> next(numEdges, -1); //the edge where the contour leaves the cell it enters through this one
+        vector<char> entered(numEdges, 0); //whether a contour in the tile reaches this edge
+
+        //Around each cell, edge k goes from corner k to corner k + 1 clockwise.  The contour segments go from an edge
+        //where the corners go from ink to paper to one where they go from paper to ink, so across a shared edge, the
+        //segment in one cell leads into the segment in the other.
+        for(int y = y0; y < y1; ++y)
+        {
+            for(int x = x0; x < x1; ++x)
+            {
+                bool in[4] = { _inside(x, y), _inside(x + 1, y), _inside(x + 1, y + 1), _inside(x, y + 1) };
+                int code = in[0] | (in[1] << 1) | (in[2] << 2) | (in[3] << 3);
+                if(code == 0 || code == 15)
+                    continue;
+                int edges[4] = { _localEdge(x, y, 0), _localEdge(x + 1, y, 1), _localEdge(x, y + 1, 0), _localEdge(x, y, 1) };
+
+                if(code == 5 || code == 10)
+                {
+                    //A saddle: the center decides whether the ink corners are connected, and the segments cut off the
+                    //two corners that aren't
+                    bool centerIn = (_value(x, y) + _value(x + 1, y) + _value(x + 1, y + 1) + _value(x, y + 1)) * 0.25 < _threshold;
+                    for(int k = 0; k < 4; ++k)
+                    {
+                        if(in[k] == centerIn)
+                            continue;
+                        int before = edges[(k + 3) % 4], after = edges[k];
+                        int from = in[k] ? after : before, to = in[k] ? before : after;
+                        next[from] = to;
+                        entered[to] = 1;
+                    }
+                    continue;
+                }
+
+                int from = -1, to = -1;
+                for(int k = 0; k < 4; ++k)
+                {
+                    if(in[k] && !in[(k + 1) % 4])
+                        from = edges[k];
+                    else if(!in[k] && in[(k + 1) % 4])
+                        to = edges[k];
+                }
+                next[from] = to;
+                entered[to] = 1;
+            }
+        }
+
+        //The fragments start at the edges nothing in the tile leads to, and whatever is left are loops
+        for(int pass = 0; pass < 2; ++pass)
+        {
+            for(int e = 0; e < numEdges; ++e)
+            {
+                if(next[e] < 0 || (pass == 0 && entered[e]))
+                    continue;
+                vector<double> xy;
+                int cur = e;
+                while(next[cur] >= 0)
+                {
+                    _appendCrossing(cur, xy);
+                    int following = next[cur];
+                    next[cur] = -1;
+                    cur = following;
+                }
+                _appendCrossing(cur, xy);
+                if(pass == 1)
+                {
+                    out.loops.push_back(std::move(xy));
+                    continue;
+                }
+                Fragment fragment = { _globalEdge(e), _globalEdge(cur), std::move(xy) };
+                out.fragments.push_back(std::move(fragment));
+            }
+        }
+    }
+
+    void appendContour(const vector<double> &xy, bool closed, int minPoints, ImageContours &out)
+    {
+        if((int)xy.size() < 2 * minPoints)
+            return;
+        out.xy.insert(out.xy.end(), xy.begin(), xy.end());
+        out.offsets.push_back((long long)out.xy.size() / 2);
+        out.closed.push_back(closed);
+    }
+}
+
+void traceContours(const unsigned char *pixels, int width, int height, int stride, double threshold, ImageContours &out,
+                   Executor &executor, int minPoints, int tileSize)
+{
+    out.xy.clear();
+    out.offsets.assign(1, 0);
+    out.closed.clear();
+    if(width < 2 || height < 2)
+        return;
+    tileSize = max(1, tileSize);
+
+    //there is a cell between every four neighboring pixel centers
+    int numTilesX = (width - 2) / tileSize + 1, numTilesY = (height - 2) / tileSize + 1;
+    vector<TracedTile> tiles(numTilesX * numTilesY);
+    executor.parallelFor((int)tiles.size(), [&](int i)
+    {
+        int x0 = (i % numTilesX) * tileSize, y0 = (i / numTilesX) * tileSize;
+        TileTracer(pixels, width, stride, threshold).trace(x0, y0, min(x0 + tileSize, width - 1), min(y0 + tileSize, height - 1), tiles[i]);
+    });
+
+    //Join the fragments at the edges where they meet, first the chains that start at the image border, and then the
+    //ones that go around
+    vector<const Fragment *> fragments;
+    unordered_map<long long, int> byStart;
+    unordered_set<long long> ends;
+    for(int i = 0; i < (int)tiles.size(); ++i)
+    {
+        for(int j = 0; j < (int)tiles[i].fragments.size(); ++j)
+        {
+            const Fragment &fragment = tiles[i].fragments[j];
+            byStart[fragment.start] = (int)fragments.size();
+            ends.insert(fragment.end);
+            fragments.push_back(&fragment);
+        }
+        for(int j = 0; j < (int)tiles[i].loops.size(); ++j)
+            appendContour(tiles[i].loops[j], true, minPoints, out);
+    }
+
+    vector<char> joined(fragments.size(), 0);
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        for(int i = 0; i < (int)fragments.size(); ++i)
+        {
+            if(joined[i] || (pass == 0 && ends.count(fragments[i]->start)))
+                continue;
+            vector<double> xy(fragments[i]->xy);
+            joined[i] = 1;
+            for(int cur = i;;)
+            {
+                unordered_map<long long, int>::const_iterator it = byStart.find(fragments[cur]->end);
+                if(it == byStart.end() || it->second == i)
+                    break;
+                cur = it->second;
+                joined[cur] = 1;
+                xy.insert(xy.end(), fragments[cur]->xy.begin() + 2, fragments[cur]->xy.end()); //its first point ends the last one
+            }
+            appendContour(xy, pass == 1, minPoints, out);
+        }
+    }
+}
+
+void vectorizeImage(const unsigned char *pixels, int width, int height, int stride, const Parameters &parameters,
+                    VectorizedImage &out, double threshold, int numThreads, ImageContours *outContours)
+{
+    if(numThreads == 0)
+    {
+        vectorizeImage(pixels, width, height, stride, parameters, ThreadPool::global(), out, threshold, outContours);
+        return;
+    }
+    ThreadPool pool(numThreads);
+    vectorizeImage(pixels, width, height, stride, parameters, pool, out, threshold, outContours);
+}
+
+void vectorizeImage(const unsigned char *pixels, int width, int height, int stride, const Parameters &parameters,
+                    Executor &executor, VectorizedImage &out, double threshold, ImageContours *outContours)
+{
+    ImageContours localContours;
+    ImageContours &contours = outContours ? *outContours : localContours;
+    traceContours(pixels, width, height, stride, threshold, contours, executor);
+    if(contours.numContours() == 0)
+    {
+        out.primitives.clear();
+        out.offsets.assign(1, 0);
+        out.closed.clear();
+        return;
+    }
+    fitBatch(&contours.xy[0], &contours.xy[1], 2, &contours.offsets[0], contours.numContours(), parameters, executor,
+             out.primitives, out.offsets, &out.closed, &contours.closed);
+}
+
+END_NAMESPACE_Cornu
@@ -0,0 +1,78 @@
+/*--
+    ContourTracer.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef CORNUCOPIA_CONTOURTRACER_H_INCLUDED
+#define CORNUCOPIA_CONTOURTRACER_H_INCLUDED
+
+//Like SimpleAPI.h, this file has no dependencies on Eigen, so that an application can vectorize its images directly
+#include "SimpleAPI.h"
+
+#include <vector>
+
+namespace Cornu
+{
+
+/*
+    Vectorizes line art, e.g., scans: the outlines of the ink in a grayscale image are traced and fit as curves.
+    Pixels darker than the threshold are ink.  The outlines are traced with marching squares between the pixel centers,
+    with the crossings interpolated, so they are accurate to a fraction of a pixel.  The image is split into square
+    tiles of cells that are traced in parallel, and the pieces of outlines that cross between tiles are joined
+    afterward.  An outline that stays inside the image is closed, and one that runs off it is open, ending at the
+    border.  The contours go to the ragged fitBatch without a polyline or vector per contour, and the closed ones are
+    fit as closed curves.
+    Point coordinates are in pixels, with the center of pixel (i, j) at (i + 0.5, j + 0.5), y pointing down.
+*/
+
+//Contour i is points offsets[i] through offsets[i + 1] - 1.  A closed contour ends with its first point again.
+struct ImageContours
+{
+    int numContours() const { return (int)closed.size(); }
+
+    std::vector<double> xy; //interleaved, so the contours are passed to fitBatch as xs = &xy[0], ys = &xy[1], stride 2
+    std::vector<long long> offsets;
+    std::vector<bool> closed;
+};
+
+//The pixels are width by height bytes, with rows stride bytes apart.  Contours with fewer than minPoints points,
+//e.g., from specks of dust, are dropped.  Contours come out in the same order regardless of the executor, but
+//depend on the tile size, which is exposed for testing (and taken to be at least 1).
+void traceContours(const unsigned char *pixels, int width, int height, int stride, double threshold, ImageContours &out,
+                   Executor &executor, int minPoints = 8, int tileSize = 256);
+
+//The fit curves of an image: curve i is primitives offsets[i] through offsets[i + 1] - 1, as from fitBatch
+struct VectorizedImage
+{
+    int numCurves() const { return (int)closed.size(); }
+
+    std::vector<BasicPrimitive> primitives;
+    std::vector<long long> offsets;
+    std::vector<bool> closed;
+};
+
+//Traces the image and fits its contours with the parameters, whose pixel size is that of the image.  If numThreads
+//is 0, the global thread pool is used, otherwise a pool with numThreads threads is created for the call.  If
+//outContours is not null, it gets the traced contours.
+void vectorizeImage(const unsigned char *pixels, int width, int height, int stride, const Parameters &parameters,
+                    VectorizedImage &out, double threshold = 128., int numThreads = 0, ImageContours *outContours = NULL);
+void vectorizeImage(const unsigned char *pixels, int width, int height, int stride, const Parameters &parameters,
+                    Executor &executor, VectorizedImage &out, double threshold = 128., ImageContours *outContours = NULL);
+
+} //end of namespace Cornu
+
+#endif //CORNUCOPIA_CONTOURTRACER_H_INCLUDED
@@ -23,6 +23,7 @@
 #include "Oversketcher.h"
 #include "Polyline.h"
 #include "PrimitiveFitter.h"
+#include "Snapshot.h"
 
 using namespace std;
 using namespace Eigen;
@@ -77,7 +78,7 @@ protected:
             out.corners[i] = valid && scores[i] > threshold;
 
             if(out.corners[i])
-                Debugging::get()->drawPoint(pts[i], Vector3d(1, 0, 0), "Corners");
+                CORNU_DEBUG(drawPoint(pts[i], Vector3d(1, 0, 0), "Corners"));
         }
     }
 
@@ -87,45 +88,79 @@ protected:
 class DefaultCornerDetector : public BaseCornerDetector
 {
 protected:
+    //The score of a point is computed from dense samples around it, smoothed at several scales.  Smoothing
+    //spreads by one sample per scale, so only the samples within twice the number of scales of the point can
+    //reach the ones the score looks at--those are the only ones evaluated, into buffers shared by all points.
+    //The buffers keep the x and y coordinates in separate columns, so that the smoothing is vectorized over the
+    //samples, and in single precision with Parameters::SINGLE_PRECISION_FRONT_END, which fits twice as many.
     virtual VectorC<double> cornerScores(const Fitter &fitter)
     {
+        if(fitter.params().get(Parameters::SINGLE_PRECISION_FRONT_END) != 0.)
+            return _cornerScores<float>(fitter);
+        return _cornerScores<double>(fitter);
+    }
+
+    template<typename Scalar>
+    VectorC<double> _cornerScores(const Fitter &fitter)
+    {
+        typedef Matrix<Scalar, Dynamic, 2> Samples;
+
         PolylineConstPtr input = fitter.output<OVERSKETCHING>()->output;
         const VectorC<Vector2d> &pts = input->pts();
         VectorC<double> out(pts.size(), pts.circular());
 
         double offset = fitter.scaledParameter(Parameters::CORNER_NEIGHBORHOOD);
+        double step = fitter.scaledParameter(Parameters::DENSE_SAMPLING_STEP);
+        int smoothingSteps = (int)fitter.params().get(Parameters::CORNER_SCALES);
+        int reach = 2 * smoothingSteps;
+        vector<Samples> smoothed(smoothingSteps, Samples(2 * reach + 1, 2));
 
+        double len = input->length();
+        Polyline::Cursor cursor(*input); //neighborhoods are sampled forward, so only their first samples search
         for(int i = 0; i < pts.size(); ++i)
         {
+            //the neighborhood of the point, clamped to the curve
             double param = input->idxToParam(i);
-            double cornerParam = offset; //corner parameter on the trimmed curve
+            double from = param - offset, to = param + offset;
             if(!input->isClosed())
-                cornerParam = min(param, offset);
-            out[i] = cornerScore(fitter, input->trimmed(param - offset, param + offset), cornerParam);
+            {
+                from = max(0., from);
+                to = min(len, to);
+            }
+            else if(to - from > len)
+            {
+                from = param - 0.5 * len;
+                to = param + 0.5 * len;
+            }
+
+            int before = min(reach, (int)((param - from) / step));
+            int after = min(reach, (int)((to - param) / step));
+            for(int j = -before; j <= after; ++j)
+                smoothed[0].row(before + j) = cursor.pos(param + j * step).transpose().template cast<Scalar>();
+
+            out[i] = cornerScore(smoothed, before + after + 1, before);
         }
 
         return out;
     }
 
-    double cornerScore(const Fitter &fitter, PolylineConstPtr cornerPoly, double cornerParam)
+    //smoothed[0] has the samples, the corner is at sample cornerIdx
+    template<typename Scalar>
+    double cornerScore(vector<Matrix<Scalar, Dynamic, 2> > &smoothed, int numSamples, int cornerIdx)
     {
-        double step = fitter.scaledParameter(Parameters::DENSE_SAMPLING_STEP);
-
-        VectorC<Vector2d> resampled(0, NOT_CIRCULAR);
-
-        for(double param = cornerParam; param >= 0.; param -= step)
-            resampled.insert(resampled.begin(), cornerPoly->pos(param));
-        int cornerIdx = resampled.size() - 1;
-        for(double param = cornerParam + step; param <= cornerPoly->length(); param += step)
-            resampled.push_back(cornerPoly->pos(param));
-
-        int smoothingSteps = (int)fitter.params().get(Parameters::CORNER_SCALES);
-        vector<VectorC<Vector2d> > smoothed(smoothingSteps, resampled);
-
         //laplacian smooth
+        int numInner = numSamples - 2;
         for(int i = 1; i < (int)smoothed.size(); ++i)
-            for(int j = 1; j + 1 < (int)resampled.size(); ++j)
-                smoothed[i][j] = 0.25 * (smoothed[i - 1][j - 1] + smoothed[i - 1][j + 1] + 2. * smoothed[i - 1][j]);
+        {
+            const Matrix<Scalar, Dynamic, 2> &prev = smoothed[i - 1];
+            smoothed[i].row(0) = prev.row(0);
+            smoothed[i].row(numSamples - 1) = prev.row(numSamples - 1);
+            if(numInner > 0)
+            {
+                smoothed[i].middleRows(1, numInner) =
+                    Scalar(0.25) * (prev.middleRows(0, numInner) + prev.middleRows(2, numInner) + Scalar(2.) * prev.middleRows(1, numInner));
+            }
+        }
 
         double maxAngle = -1e10, minAngle = 1e10;
 
@@ -134,11 +169,11 @@ protected:
             int offs = i + 1;
             if(cornerIdx - offs < 0)
                 return 0.;
-            if(cornerIdx + offs >= resampled.size())
+            if(cornerIdx + offs >= numSamples)
                 return 0.;
 
-            Vector2d v1 = smoothed[i][cornerIdx] - smoothed[i][cornerIdx - offs];
-            Vector2d v2 = smoothed[i][cornerIdx + offs] - smoothed[i][cornerIdx];
+            Vector2d v1 = (smoothed[i].row(cornerIdx) - smoothed[i].row(cornerIdx - offs)).transpose().template cast<double>();
+            Vector2d v2 = (smoothed[i].row(cornerIdx + offs) - smoothed[i].row(cornerIdx)).transpose().template cast<double>();
             double angle = AngleUtils::angle(v1, v2);
             maxAngle = max(maxAngle, angle);
             minAngle = min(minAngle, angle);
@@ -150,6 +185,26 @@ protected:
     }
 };
 
+size_t AlgorithmOutput<CORNER_DETECTION>::memoryUsage() const
+{
+    return sizeof(*this) + corners.capacity() / 8; //vector<bool> is packed
+}
+
+void AlgorithmOutput<CORNER_DETECTION>::recycle()
+{
+    corners.clear();
+}
+
+void AlgorithmOutput<CORNER_DETECTION>::write(SnapshotWriter &out) const
+{
+    out.writeBools(corners);
+}
+
+void AlgorithmOutput<CORNER_DETECTION>::read(SnapshotReader &in, const Fitter &)
+{
+    in.readBools(corners);
+}
+
 void Algorithm<CORNER_DETECTION>::_initialize()
 {
     new DefaultCornerDetector();
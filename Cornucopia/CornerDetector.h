@@ -31,6 +31,11 @@ template<>
 struct AlgorithmOutput<CORNER_DETECTION> : public AlgorithmOutputBase
 {
     VectorC<bool> corners;
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
@@ -24,8 +24,24 @@
 //This file just collects the includes necessary to use Cornucopia fully
 //For a minimalistic API, see SimpleAPI.h
 #include "Fitter.h"
+#include "IncrementalFitter.h"
+#include "PointQueue.h"
+#include "CoarseToFineFitter.h"
+#include "StaticFitter.h"
+#include "StrokePipeline.h"
+#include "FitCache.h"
+#include "FitMetrics.h"
+#include "Allocator.h"
+#include "Trace.h"
+#include "StrokeCorpus.h"
+#include "Dataset.h"
+#include "JsonReader.h"
 #include "Polyline.h"
 #include "PrimitiveSequence.h"
+#include "PrimitiveRope.h"
+#include "CompactCurve.h"
+#include "CurveIntersection.h"
+#include "CurveSimplifier.h"
 #include "Line.h"
 #include "Arc.h"
 #include "Clothoid.h"
@@ -43,6 +43,24 @@ public:
     //evaluates the curve with optionally the first and second derivatives (tangent and curvature)
     virtual void eval(double s, Vec *pos, Vec *der = NULL, Vec *der2 = NULL) const = 0;
 
+    //evaluates the curve at many parameters at once--column i of each output is the evaluation at s[i].
+    //The default just calls eval for each parameter; subclasses avoid the per-point overhead.
+    virtual void evalBatch(const Eigen::VectorXd &s, Eigen::Matrix2Xd *pos, Eigen::Matrix2Xd *der = NULL, Eigen::Matrix2Xd *der2 = NULL) const
+    {
+        if(pos) pos->resize(2, s.size());
+        if(der) der->resize(2, s.size());
+        if(der2) der2->resize(2, s.size());
+
+        Vec p, d, d2;
+        for(int i = 0; i < (int)s.size(); ++i)
+        {
+            eval(s[i], pos ? &p : NULL, der ? &d : NULL, der2 ? &d2 : NULL);
+            if(pos) pos->col(i) = p;
+            if(der) der->col(i) = d;
+            if(der2) der2->col(i) = d2;
+        }
+    }
+
     virtual double project(const Vec &point) const = 0;
     virtual double distanceSqTo(const Vec &point) const { return (point - pos(project(point))).squaredNorm(); }
     virtual double distanceTo(const Vec &point) const { return sqrt(distanceSqTo(point)); }
@@ -0,0 +1,379 @@
+/*--
+    CurveIntersection.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "CurveIntersection.h"
+#include "Arc.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+typedef Vector2d Vec;
+
+static const double maxStraightTurn = 0.25; //radians a piece may turn and still have its chord stand in for it
+static const int maxNewtonIters = 10;
+static const int maxProjectionIters = 20;
+
+static double cross(const Vec &a, const Vec &b) { return a[0] * b[1] - a[1] * b[0]; }
+
+//tolerances are relative to how far the primitives are from the origin and how long they are
+static double scaleOf(const CurvePrimitive &p1, const CurvePrimitive &p2)
+{
+    return 1. + p1.length() + p2.length() + p1.startPos().cwiseAbs().maxCoeff() + p2.startPos().cwiseAbs().maxCoeff();
+}
+
+//Returns the circle of an arc, unless the arc is so flat that the circle is badly conditioned
+static bool circleOf(const CurvePrimitive &p, Vec &center, double &radius)
+{
+    if(p.getType() != CurvePrimitive::ARC || fabs(p.params()[CurvePrimitive::CURVATURE]) * p.length() < 1e-3)
+        return false;
+    const Arc &arc = static_cast<const Arc &>(p);
+    center = arc.center();
+    radius = fabs(arc.radius());
+    return true;
+}
+
+//the closest points of segments p0-p1 and q0-q1 are at fractions t and u along them
+static void closestOnSegments(const Vec &p0, const Vec &p1, const Vec &q0, const Vec &q1, double &t, double &u)
+{
+    Vec d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+    double a = d1.squaredNorm(), e = d2.squaredNorm(), f = d2.dot(r);
+    const double eps = 1e-24;
+    t = u = 0.;
+    if(a <= eps && e <= eps)
+        return;
+    if(a <= eps)
+    {
+        u = max(0., min(1., f / e));
+        return;
+    }
+    double c = d1.dot(r);
+    if(e <= eps)
+    {
+        t = max(0., min(1., -c / a));
+        return;
+    }
+    double b = d1.dot(d2), denom = a * e - b * b;
+    t = denom > eps ? max(0., min(1., (b * f - c * e) / denom)) : 0.;
+    u = (b * t + f) / e;
+    if(u < 0.)
+    {
+        u = 0.;
+        t = max(0., min(1., -c / a));
+    }
+    else if(u > 1.)
+    {
+        u = 1.;
+        t = max(0., min(1., (b - c) / a));
+    }
+}
+
+//Polishes an intersection with Newton's method and returns whether it converged to a point on both primitives
+static bool refineIntersection(const CurvePrimitive &p1, const CurvePrimitive &p2, double tol, double &s1, double &s2)
+{
+    for(int i = 0; ; ++i)
+    {
+        Vec pos1, der1, pos2, der2;
+        p1.eval(s1, &pos1, &der1);
+        p2.eval(s2, &pos2, &der2);
+        Vec diff = pos1 - pos2;
+        if(diff.squaredNorm() <= tol * tol)
+            break;
+
+        //solve der1 * ds1 - der2 * ds2 = -diff; at a tangency the Jacobian is singular and convergence is slow,
+        //so accept a looser fit there
+        double det = cross(der2, der1);
+        if(i == maxNewtonIters || fabs(det) < 1e-12)
+        {
+            if(diff.norm() > 1000. * tol)
+                return false;
+            break;
+        }
+        s1 += cross(diff, der2) / det;
+        s2 += cross(diff, der1) / det;
+    }
+
+    if(s1 < -tol || s1 > p1.length() + tol || s2 < -tol || s2 > p2.length() + tol)
+        return false;
+    s1 = max(0., min(p1.length(), s1));
+    s2 = max(0., min(p2.length(), s2));
+    return true;
+}
+
+//Points where a line and a circle or two circles cross, including (approximately) where they touch
+static int lineCircle(const Vec &start, const Vec &dir, const Vec &center, double radius, double tol, Vec *out)
+{
+    Vec f = start - center;
+    double b = f.dot(dir), disc = b * b - (f.squaredNorm() - radius * radius);
+    if(disc < -2. * radius * tol)
+        return 0;
+    double root = sqrt(max(0., disc));
+    out[0] = start + (-b - root) * dir;
+    out[1] = start + (-b + root) * dir;
+    return 2;
+}
+
+static int circleCircle(const Vec &c1, double r1, const Vec &c2, double r2, double tol, Vec *out)
+{
+    Vec diff = c2 - c1;
+    double d = diff.norm();
+    if(d < tol || d > r1 + r2 + tol || d < fabs(r1 - r2) - tol)
+        return 0;
+    Vec e = diff / d;
+    double a = (d * d + r1 * r1 - r2 * r2) / (2. * d);
+    double h = sqrt(max(0., r1 * r1 - a * a));
+    out[0] = c1 + a * e + h * Vec(-e[1], e[0]);
+    out[1] = c1 + a * e - h * Vec(-e[1], e[0]);
+    return 2;
+}
+
+namespace
+{
+    //A stretch [from, to] of a primitive with a box around it, for pruning.  A piece that turns less than a radian
+    //stays within k * h^2 / 8 of its chord (see CurvePrimitive::boundingBox), and any piece within h / 2 of an end.
+    struct _Piece
+    {
+        _Piece(const CurvePrimitive &inPrim, double inFrom, double inTo) : prim(&inPrim), from(inFrom), to(inTo)
+        {
+            start = prim->pos(from);
+            end = prim->pos(to);
+            double h = to - from;
+            //curvature is linear in arclength, so its magnitude is largest at an end
+            turn = max(fabs(prim->curvature(from)), fabs(prim->curvature(to))) * h;
+            pad = turn < 1. ? turn * h / 8. : h / 2.;
+            box = AlignedBox2d(start.cwiseMin(end) - Vec::Constant(pad), start.cwiseMax(end) + Vec::Constant(pad));
+        }
+
+        bool straight() const { return turn <= maxStraightTurn; }
+        double mid() const { return 0.5 * (from + to); }
+
+        const CurvePrimitive *prim;
+        double from, to;
+        Vec start, end;
+        double turn; //an upper bound on how much the tangent turns
+        double pad; //an upper bound on the distance from the chord
+        AlignedBox2d box;
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+
+    //which of the pieces to split: the one that turns more, unless it's already straight
+    bool splitFirst(const _Piece &a, const _Piece &b) { return !a.straight() && (b.straight() || a.turn >= b.turn); }
+
+    void intersectPieces(const _Piece &a, const _Piece &b, double tol, vector<CurveIntersection> &out)
+    {
+        if(!a.box.intersects(b.box))
+            return;
+
+        if(a.straight() && b.straight())
+        {
+            //seed Newton's method where the chords come closest, which is where they cross if they do
+            double t, u;
+            closestOnSegments(a.start, a.end, b.start, b.end, t, u);
+            double s1 = a.from + t * (a.to - a.from), s2 = b.from + u * (b.to - b.from);
+            if(refineIntersection(*a.prim, *b.prim, tol, s1, s2))
+                out.push_back(CurveIntersection(s1, s2));
+            return;
+        }
+
+        if(splitFirst(a, b))
+        {
+            intersectPieces(_Piece(*a.prim, a.from, a.mid()), b, tol, out);
+            intersectPieces(_Piece(*a.prim, a.mid(), a.to), b, tol, out);
+        }
+        else
+        {
+            intersectPieces(a, _Piece(*b.prim, b.from, b.mid()), tol, out);
+            intersectPieces(a, _Piece(*b.prim, b.mid(), b.to), tol, out);
+        }
+    }
+
+    struct _Closest
+    {
+        const CurvePrimitive *p1, *p2;
+        double tol;
+        double minDistSq, s1, s2;
+        bool found;
+
+        void consider(double inS1, double inS2)
+        {
+            double distSq = (p1->pos(inS1) - p2->pos(inS2)).squaredNorm();
+            if(distSq < minDistSq)
+            {
+                minDistSq = distSq;
+                s1 = inS1;
+                s2 = inS2;
+                found = true;
+            }
+        }
+    };
+
+    void closestPieces(const _Piece &a, const _Piece &b, _Closest &closest)
+    {
+        if(a.box.squaredExteriorDistance(b.box) >= closest.minDistSq)
+            return;
+
+        if(a.straight() && b.straight())
+        {
+            //start where the chords come closest.  If they cross, so do the pieces, usually, and Newton's method
+            //finds where.  Otherwise alternately project onto each primitive, which converges to a pair of points
+            //whose connecting segment is normal to both.
+            double t, u;
+            closestOnSegments(a.start, a.end, b.start, b.end, t, u);
+            double s1 = a.from + t * (a.to - a.from), s2 = b.from + u * (b.to - b.from);
+            Vec chordDiff = (a.start + t * (a.end - a.start)) - (b.start + u * (b.end - b.start));
+            double lowerBound = chordDiff.norm() - a.pad - b.pad; //tighter than the boxes for slanted chords
+            if(lowerBound > 0. && lowerBound * lowerBound >= closest.minDistSq)
+                return;
+            if(chordDiff.squaredNorm() <= closest.tol * closest.tol)
+            {
+                double crossS1 = s1, crossS2 = s2;
+                if(refineIntersection(*closest.p1, *closest.p2, closest.tol, crossS1, crossS2))
+                {
+                    closest.consider(crossS1, crossS2);
+                    return;
+                }
+            }
+            for(int i = 0; i < maxProjectionIters; ++i)
+            {
+                double newS2 = closest.p2->project(closest.p1->pos(s1));
+                double newS1 = closest.p1->project(closest.p2->pos(newS2));
+                bool converged = fabs(newS1 - s1) < closest.tol && fabs(newS2 - s2) < closest.tol;
+                s1 = newS1;
+                s2 = newS2;
+                if(converged)
+                    break;
+            }
+            closest.consider(s1, s2);
+            return;
+        }
+
+        //visit the closer half first, so that the other one is more likely to be pruned
+        if(splitFirst(a, b))
+        {
+            _Piece first(*a.prim, a.from, a.mid()), second(*a.prim, a.mid(), a.to);
+            bool swap = second.box.squaredExteriorDistance(b.box) < first.box.squaredExteriorDistance(b.box);
+            closestPieces(swap ? second : first, b, closest);
+            closestPieces(swap ? first : second, b, closest);
+        }
+        else
+        {
+            _Piece first(*b.prim, b.from, b.mid()), second(*b.prim, b.mid(), b.to);
+            bool swap = a.box.squaredExteriorDistance(second.box) < a.box.squaredExteriorDistance(first.box);
+            closestPieces(a, swap ? second : first, closest);
+            closestPieces(a, swap ? first : second, closest);
+        }
+    }
+
+    bool lessByS1ThenS2(const CurveIntersection &a, const CurveIntersection &b)
+    {
+        return a.s1 < b.s1 || (a.s1 == b.s1 && a.s2 < b.s2);
+    }
+}
+
+void intersectPrimitives(const CurvePrimitive &p1, const CurvePrimitive &p2, vector<CurveIntersection> &out)
+{
+    double tol = 1e-9 * scaleOf(p1, p2);
+    int firstNew = (int)out.size();
+
+    Vec center1, center2;
+    double radius1, radius2;
+    bool line1 = p1.getType() == CurvePrimitive::LINE, circle1 = !line1 && circleOf(p1, center1, radius1);
+    bool line2 = p2.getType() == CurvePrimitive::LINE, circle2 = !line2 && circleOf(p2, center2, radius2);
+
+    if((line1 || circle1) && (line2 || circle2))
+    {
+        Vec candidates[2];
+        int numCandidates = 0;
+        if(line1 && line2)
+        {
+            Vec dir1 = p1.der(0), dir2 = p2.der(0), diff = p2.startPos() - p1.startPos();
+            double det = cross(dir1, dir2);
+            if(fabs(det) > 1e-12)
+            {
+                double t = cross(diff, dir2) / det, u = cross(diff, dir1) / det;
+                if(t > -tol && t < p1.length() + tol && u > -tol && u < p2.length() + tol)
+                    candidates[numCandidates++] = p1.startPos() + t * dir1;
+            }
+        }
+        else if(line1)
+            numCandidates = lineCircle(p1.startPos(), p1.der(0), center2, radius2, tol, candidates);
+        else if(line2)
+            numCandidates = lineCircle(p2.startPos(), p2.der(0), center1, radius1, tol, candidates);
+        else
+            numCandidates = circleCircle(center1, radius1, center2, radius2, tol, candidates);
+
+        //the points are on the lines and circles; the projections tell whether they're on the primitives
+        for(int i = 0; i < numCandidates; ++i)
+        {
+            double s1 = p1.project(candidates[i]), s2 = p2.project(candidates[i]);
+            if(refineIntersection(p1, p2, tol, s1, s2))
+                out.push_back(CurveIntersection(s1, s2));
+        }
+    }
+    else
+        intersectPieces(_Piece(p1, 0., p1.length()), _Piece(p2, 0., p2.length()), tol, out);
+
+    //a point may be found from two pieces or be a tangency found twice
+    sort(out.begin() + firstNew, out.end(), lessByS1ThenS2);
+    int numOut = firstNew;
+    for(int i = firstNew; i < (int)out.size(); ++i)
+    {
+        if(numOut > firstNew && fabs(out[i].s1 - out[numOut - 1].s1) < 100. * tol && fabs(out[i].s2 - out[numOut - 1].s2) < 100. * tol)
+            continue;
+        out[numOut++] = out[i];
+    }
+    out.resize(numOut);
+}
+
+bool closestPrimitivePoints(const CurvePrimitive &p1, const CurvePrimitive &p2, double &minDistSq, double &s1, double &s2)
+{
+    _Closest closest;
+    closest.p1 = &p1;
+    closest.p2 = &p2;
+    closest.tol = 1e-9 * scaleOf(p1, p2);
+    closest.minDistSq = minDistSq;
+    closest.found = false;
+
+    _Piece a(p1, 0., p1.length()), b(p2, 0., p2.length());
+    if(a.box.squaredExteriorDistance(b.box) >= minDistSq)
+        return false;
+
+    //the closest points are where the primitives cross, at an end of one of them, or on a segment normal to both
+    if(b.box.squaredExteriorDistance(a.start) < closest.minDistSq)
+        closest.consider(0., p2.project(a.start));
+    if(b.box.squaredExteriorDistance(a.end) < closest.minDistSq)
+        closest.consider(p1.length(), p2.project(a.end));
+    if(a.box.squaredExteriorDistance(b.start) < closest.minDistSq)
+        closest.consider(p1.project(b.start), 0.);
+    if(a.box.squaredExteriorDistance(b.end) < closest.minDistSq)
+        closest.consider(p1.project(b.end), p2.length());
+    closestPieces(a, b, closest);
+
+    if(!closest.found)
+        return false;
+    minDistSq = closest.minDistSq;
+    s1 = closest.s1;
+    s2 = closest.s2;
+    return true;
+}
+
+END_NAMESPACE_Cornu
@@ -0,0 +1,59 @@
+/*--
+    CurveIntersection.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_CURVEINTERSECTION_H_INCLUDED
+#define CORNUCOPIA_CURVEINTERSECTION_H_INCLUDED
+
+#include "defs.h"
+#include <vector>
+
+NAMESPACE_Cornu
+
+class CurvePrimitive;
+
+//A point where two curves meet, as its arclength parameter on each
+struct CurveIntersection
+{
+    CurveIntersection() {}
+    CurveIntersection(double inS1, double inS2) : s1(inS1), s2(inS2) {}
+
+    double s1, s2;
+};
+
+/*
+    Queries between pairs of primitives, which PrimitiveSequence runs on the pairs its bounding box trees can't rule
+    out.  Lines and arcs are intersected analytically.  Clothoids (and arcs so flat that their circle is badly
+    conditioned) are split by arclength, pruning pieces whose padded chord boxes are apart, until the pieces are
+    nearly straight, and the crossings of the pieces' chords seed Newton's method on the curves.  All the points
+    found are polished with Newton's method, so they are accurate to about 1e-9 of the size of the primitives.
+    Curves that overlap along a stretch, like collinear lines, do not count as intersecting there.
+*/
+
+//Appends the points where the primitives cross or touch to out, which may have the same point twice if it is near
+//the end of one of the pieces the primitives are split into
+void intersectPrimitives(const CurvePrimitive &p1, const CurvePrimitive &p2, std::vector<CurveIntersection> &out);
+
+//If the primitives come closer than sqrt(minDistSq), sets minDistSq to their smallest squared distance, sets s1 and
+//s2 to where it is, and returns true.  Otherwise returns false and leaves the arguments alone.
+bool closestPrimitivePoints(const CurvePrimitive &p1, const CurvePrimitive &p2, double &minDistSq, double &s1, double &s2);
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_CURVEINTERSECTION_H_INCLUDED
@@ -36,6 +36,51 @@ bool CurvePrimitive::isValid() const
     return isValidImpl();
 }
 
+void CurvePrimitive::derivativeBatch(const VectorXd &s, MatrixXd &out, MatrixXd &outTan,
+                                     Matrix2Xd *pos, Matrix2Xd *der, Matrix2Xd *der2) const
+{
+    int n = (int)s.size();
+    out.resize(2 * n, numParams());
+    outTan.resize(2 * n, numParams());
+    if(pos) pos->resize(2, n);
+    if(der) der->resize(2, n);
+    if(der2) der2->resize(2, n);
+
+    ParamDer d, dTan;
+    Vec p, t, t2;
+    for(int i = 0; i < n; ++i)
+    {
+        derivativeAt(s[i], d, dTan);
+        out.middleRows<2>(2 * i) = d;
+        outTan.middleRows<2>(2 * i) = dTan;
+
+        if(pos || der || der2)
+        {
+            eval(s[i], pos ? &p : NULL, der ? &t : NULL, der2 ? &t2 : NULL);
+            if(pos) pos->col(i) = p;
+            if(der) der->col(i) = t;
+            if(der2) der2->col(i) = t2;
+        }
+    }
+}
+
+AlignedBox2d CurvePrimitive::boundingBox() const
+{
+    //The curvature of a primitive is linear in arclength, so its magnitude is largest at an endpoint.
+    //A piece of length h with curvature at most k stays within k * h^2 / 8 of its chord, so the box
+    //around a few samples, grown by that much, contains the whole primitive.
+    const int numSegments = 8;
+    double h = length() / numSegments;
+    double maxCurvature = max(fabs(startCurvature()), fabs(endCurvature()));
+
+    VectorXd s = VectorXd::LinSpaced(numSegments + 1, 0., length());
+    Matrix2Xd pts;
+    evalBatch(s, &pts);
+
+    Vector2d pad = Vector2d::Constant(maxCurvature * h * h / 8.);
+    return AlignedBox2d(pts.rowwise().minCoeff() - pad, pts.rowwise().maxCoeff() + pad);
+}
+
 END_NAMESPACE_Cornu
 
 
@@ -23,6 +23,7 @@
 
 #include "defs.h"
 #include "Curve.h"
+#include <Eigen/Geometry>
 
 NAMESPACE_Cornu
 
@@ -38,6 +39,13 @@ public:
     typedef Eigen::Matrix<double, 2, Eigen::Dynamic, Eigen::AutoAlign, 2, 6> ParamDer; //derivative of x and y w.r.t. parameters
     typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::AutoAlign, 4, 6> EndDer; //derivative of x, y, angle, curvature w.r.t. parameters
 
+    //statically sized versions of the above, for code that knows which primitive it's dealing with
+    template<int NumParams> struct Fixed
+    {
+        typedef Eigen::Matrix<double, NumParams, 1> ParamVec;
+        typedef Eigen::Matrix<double, 2, NumParams> ParamDer;
+    };
+
     enum PrimitiveType
     {
         LINE = 0,
@@ -68,6 +76,12 @@ public:
     virtual void derivativeAt(double s, ParamDer &out, ParamDer &outTan) const = 0;
     virtual void derivativeAtEnd(int continuity, EndDer &out) const = 0; //continuity: 0 = position, 1 = +angle, 2 = +curvature
 
+    //derivativeAt at many parameters at once--rows 2i and 2i + 1 of out and outTan are the derivatives at s[i].
+    //Optionally also evaluates the curve there, at the accuracy of eval, since that shares most of the work.
+    //The default just calls derivativeAt and eval for each parameter.
+    virtual void derivativeBatch(const Eigen::VectorXd &s, Eigen::MatrixXd &out, Eigen::MatrixXd &outTan,
+                                 Eigen::Matrix2Xd *pos = NULL, Eigen::Matrix2Xd *der = NULL, Eigen::Matrix2Xd *der2 = NULL) const;
+
     //for clothoids, converts derivative w.r.t. dcurvature into der w.r.t. end curvature
     virtual void toEndCurvatureDerivative(Eigen::MatrixXd &) const {} 
 
@@ -83,6 +97,7 @@ public:
     //utility functions
     CurvePrimitivePtr flipped() const { CurvePrimitivePtr out = clone(); out->flip(); return out; }
     CurvePrimitivePtr trimmed(double sFrom, double sTo) const { CurvePrimitivePtr out = clone(); out->trim(sFrom, sTo); return out; }
+    Eigen::AlignedBox2d boundingBox() const; //conservative--may be slightly larger than the tightest box
 
 protected:
     //non-virtual inline functions -- use them in derived classes
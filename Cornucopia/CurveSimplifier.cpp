@@ -0,0 +1,136 @@
+/*--
+    CurveSimplifier.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "CurveSimplifier.h"
+#include "Fitter.h"
+#include "Polyline.h"
+#include "PrimitiveSequence.h"
+#include "CurveVertex.h"
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+//The fit's pixel as a fraction of the tolerance at first.  Primitives are dropped when their error is above
+//ERROR_THRESHOLD (4) pixels, and the fit usually stays within a pixel or two of the tessellation.
+static const double pixelsPerTolerance = 2.;
+static const int maxRefits = 3; //each with half the pixel size of the one before
+static const int maxDistanceSamples = 5000; //per curve, for checking versions
+
+CurveSimplifier::CurveSimplifier(PrimitiveSequenceConstPtr curve, const Parameters &params)
+    : _curve(curve), _params(params)
+{
+}
+
+PrimitiveSequenceConstPtr CurveSimplifier::simplified(double tolerance)
+{
+    if(!_curve || !(tolerance > 0.))
+        return _curve;
+
+    map<double, PrimitiveSequenceConstPtr>::iterator it = _versions.find(tolerance);
+    if(it != _versions.end())
+        return it->second;
+
+    //refit the finest version coarser than the one below, so the fits get cheaper up the levels
+    double baseTolerance;
+    PrimitiveSequenceConstPtr base = coarsestWithin(tolerance, &baseTolerance);
+
+    PrimitiveSequenceConstPtr out = base;
+    double pixelSize = tolerance / pixelsPerTolerance;
+    for(int i = 0; i < maxRefits; ++i, pixelSize *= 0.5)
+    {
+        PrimitiveSequenceConstPtr refit = _refit(base, tolerance, pixelSize);
+        if(!refit || refit->primitives().size() >= base->primitives().size())
+            break; //a finer pixel won't give fewer primitives
+        if(maxDistance(_curve, refit, 0.25 * tolerance) <= tolerance)
+        {
+            out = refit;
+            break;
+        }
+    }
+
+    _versions[tolerance] = out;
+    return out;
+}
+
+vector<PrimitiveSequenceConstPtr> CurveSimplifier::levels(double finestTolerance, int numLevels)
+{
+    vector<PrimitiveSequenceConstPtr> out;
+    double tolerance = finestTolerance;
+    for(int i = 0; i < numLevels; ++i, tolerance *= 2.)
+        out.push_back(simplified(tolerance));
+    return out;
+}
+
+PrimitiveSequenceConstPtr CurveSimplifier::coarsestWithin(double tolerance, double *outTolerance) const
+{
+    map<double, PrimitiveSequenceConstPtr>::const_iterator it = _versions.upper_bound(tolerance);
+    if(it == _versions.begin())
+    {
+        if(outTolerance)
+            (*outTolerance) = 0.;
+        return _curve;
+    }
+    --it;
+    if(outTolerance)
+        (*outTolerance) = it->first;
+    return it->second;
+}
+
+double CurveSimplifier::maxDistance(PrimitiveSequenceConstPtr curve1, PrimitiveSequenceConstPtr curve2, double spacing)
+{
+    double out = 0.;
+    for(int c = 0; c < 2; ++c)
+    {
+        const PrimitiveSequence &from = c == 0 ? *curve1 : *curve2, &to = c == 0 ? *curve2 : *curve1;
+        int numSamples = min(maxDistanceSamples, 1 + (int)ceil(from.length() / spacing));
+        Matrix2Xd pts(2, numSamples + 1);
+        for(int i = 0; i <= numSamples; ++i)
+            pts.col(i) = from.pos(from.length() * i / numSamples);
+        VectorXd params = to.projectMany(pts);
+        for(int i = 0; i <= numSamples; ++i)
+            out = max(out, (to.pos(params[i]) - pts.col(i)).norm());
+    }
+    return out;
+}
+
+PrimitiveSequenceConstPtr CurveSimplifier::_refit(PrimitiveSequenceConstPtr base, double tolerance, double pixelSize) const
+{
+    //the tessellation is much closer to the base than the tolerance, and a closed base gets its start point again
+    //at the end, which the curve closing stage recognizes
+    int numVertices = base->tessellate(0.05 * tolerance, (CurveVertex *)NULL, 0);
+    vector<CurveVertex> vertices(numVertices);
+    base->tessellate(0.05 * tolerance, &vertices[0], numVertices);
+    VectorC<Vector2d> pts(numVertices, NOT_CIRCULAR);
+    for(int i = 0; i < numVertices; ++i)
+        pts[i] = Vector2d(vertices[i].pos[0], vertices[i].pos[1]);
+
+    Parameters params = _params;
+    params.setAlgorithm(SCALE_DETECTION, 1); //none, so the pixel size isn't adjusted to the curve's size
+    params.set(Parameters::PIXEL_SIZE, pixelSize);
+
+    Fitter fitter;
+    fitter.setParams(params);
+    fitter.setDebugging(Debugging::silent());
+    fitter.setOriginalSketch(new Polyline(pts));
+    fitter.run();
+    return fitter.finalOutput();
+}
+
+END_NAMESPACE_Cornu
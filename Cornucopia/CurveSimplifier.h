@@ -0,0 +1,77 @@
+/*--
+    CurveSimplifier.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_CURVESIMPLIFIER_H_INCLUDED
+#define CORNUCOPIA_CURVESIMPLIFIER_H_INCLUDED
+
+#include "defs.h"
+#include "Parameters.h"
+#include "smart_ptr.h"
+
+#include <map>
+#include <vector>
+
+NAMESPACE_Cornu
+
+CORNU_SMART_FORW_DECL(PrimitiveSequence);
+
+/*
+    Makes lighter versions of a fitted curve, e.g., for drawing it zoomed out or for coarse hit tests.  The version
+    for a tolerance is a refit of a dense tessellation of the next finer version made so far, by a Fitter whose pixel
+    is a fraction of the tolerance, so the primitives are merged into fewer arcs and clothoids by the same graph
+    search and multicurve solve as a regular fit, just at a coarser scale.  A version is checked against the
+    original curve: if it strays farther than the tolerance, the fit is redone with smaller pixels, and if it still
+    does or has no fewer primitives than the finer version, the finer version is used.  The versions are cached by
+    tolerance.  Like the Fitter, a simplifier should only be used by one thread at a time.
+*/
+class CurveSimplifier
+{
+public:
+    //params are the base of the parameters of the refits (their scale-related ones are overridden)
+    explicit CurveSimplifier(PrimitiveSequenceConstPtr curve, const Parameters &params = Parameters());
+
+    PrimitiveSequenceConstPtr curve() const { return _curve; }
+
+    //Returns a version of the curve that is everywhere within tolerance of it, making and caching it if needed
+    PrimitiveSequenceConstPtr simplified(double tolerance);
+    //Makes the versions for finestTolerance * 2^i, i < numLevels, finest first, so each one refits the one below
+    std::vector<PrimitiveSequenceConstPtr> levels(double finestTolerance, int numLevels);
+    //Returns the cached version with the largest tolerance that is at most the given one, or the curve itself if
+    //there is none, without making anything, so a viewer can draw the coarsest version that will do.  If
+    //outTolerance is not null, it is set to the tolerance of the returned version (0 for the curve itself).
+    PrimitiveSequenceConstPtr coarsestWithin(double tolerance, double *outTolerance = NULL) const;
+
+    int numCached() const { return (int)_versions.size(); }
+    void clear() { _versions.clear(); }
+
+    //the largest distance from a point on one curve to the other, either way, measured at samples spacing apart
+    static double maxDistance(PrimitiveSequenceConstPtr curve1, PrimitiveSequenceConstPtr curve2, double spacing);
+
+private:
+    PrimitiveSequenceConstPtr _refit(PrimitiveSequenceConstPtr base, double tolerance, double pixelSize) const;
+
+    PrimitiveSequenceConstPtr _curve;
+    Parameters _params;
+    std::map<double, PrimitiveSequenceConstPtr> _versions; //by tolerance
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_CURVESIMPLIFIER_H_INCLUDED
@@ -0,0 +1,48 @@
+/*--
+    CurveVertex.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_CURVEVERTEX_H_INCLUDED
+#define CORNUCOPIA_CURVEVERTEX_H_INCLUDED
+
+//Vertex layouts for tessellated curves, for copying straight into vertex buffers.  This file has no dependencies
+//so that SimpleAPI.h can use it.
+
+namespace Cornu
+{
+
+struct CurveVertex
+{
+    float pos[2];
+    float tangent[2]; //unit length
+    float arcLength; //from the start of the curve
+};
+
+//A CurveVertex with each component mapped linearly to 0..65535: the position from the curve's bounding box, the
+//tangent components from [-1, 1], and the arc length from [0, curve length]
+struct QuantizedCurveVertex
+{
+    unsigned short pos[2];
+    unsigned short tangent[2];
+    unsigned short arcLength;
+};
+
+} //end of namespace Cornu
+
+#endif //CORNUCOPIA_CURVEVERTEX_H_INCLUDED
@@ -0,0 +1,106 @@
+/*--
+    Dataset.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Dataset.h"
+#include "Fitter.h"
+#include "GraphConstructor.h"
+#include "StrokeCorpus.h"
+#include "Polyline.h"
+#include "ThreadPool.h"
+#include "Debugging.h"
+
+#include <functional>
+#include <ostream>
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+static const char datasetTag[8] = { 'C', 'o', 'r', 'n', 'u', 'D', 'a', 't' };
+static const unsigned int datasetVersion = 1;
+static const unsigned int byteOrderMark = 0x01020304;
+
+void Dataset::write(ostream &out, int strokeIdx) const
+{
+    int header[3] = { strokeIdx, (int)vertices.size(), (int)edges.size() };
+    out.write((const char *)header, sizeof(header));
+    if(!vertices.empty())
+        out.write((const char *)&vertices[0], vertices.size() * sizeof(VertexRecord));
+    if(!edges.empty())
+        out.write((const char *)&edges[0], edges.size() * sizeof(EdgeRecord));
+}
+
+size_t Dataset::memoryUsage() const
+{
+    return sizeof(*this) + vertices.capacity() * sizeof(VertexRecord) + edges.capacity() * sizeof(EdgeRecord);
+}
+
+DatasetWriter::DatasetWriter(ostream &out) : _out(out), _numStrokes(0), _numEdges(0)
+{
+    unsigned int numFeatures[2] = { Dataset::NUM_VERTEX_FEATURES, Dataset::NUM_EDGE_FEATURES };
+    _out.write(datasetTag, sizeof(datasetTag));
+    _out.write((const char *)&datasetVersion, 4);
+    _out.write((const char *)&byteOrderMark, 4);
+    _out.write((const char *)numFeatures, sizeof(numFeatures));
+}
+
+void DatasetWriter::add(const Dataset &dataset, int strokeIdx)
+{
+    lock_guard<mutex> lock(_mutex);
+    dataset.write(_out, strokeIdx);
+    ++_numStrokes;
+    _numEdges += dataset.edges.size();
+}
+
+int generateDataset(const StrokeCorpus &corpus, const Parameters &params, ostream &out, int numThreads)
+{
+    Parameters datasetParams = params;
+    for(int i = 0; i < AlgorithmBase::numAlgorithmsForStage(GRAPH_CONSTRUCTION); ++i)
+        if(AlgorithmBase::get(GRAPH_CONSTRUCTION, i)->name() == "Dataset generation")
+            datasetParams.setAlgorithm(GRAPH_CONSTRUCTION, i);
+    datasetParams.set(Parameters::MULTITHREADED, 0.); //the strokes are done in parallel instead
+
+    DatasetWriter writer(out);
+    function<void(int)> generateOne = [&](int i)
+    {
+        StrokeSpan stroke = corpus.stroke(i);
+        if(stroke.size < 2)
+            return;
+
+        Fitter fitter;
+        fitter.setDebugging(Debugging::silent()); //the global debugging object is not in general thread-safe
+        fitter.setParams(datasetParams);
+        fitter.setOriginalSketch(stroke.toPolyline());
+        fitter.run();
+
+        smart_ptr<const AlgorithmOutput<GRAPH_CONSTRUCTION> > graph = fitter.output<GRAPH_CONSTRUCTION>();
+        if(graph && graph->dataset)
+            writer.add(*graph->dataset, i);
+    };
+
+    if(numThreads == 0)
+        ThreadPool::global().parallelFor(corpus.size(), generateOne);
+    else
+        ThreadPool(numThreads).parallelFor(corpus.size(), generateOne);
+
+    return writer.numStrokes();
+}
+
+END_NAMESPACE_Cornu
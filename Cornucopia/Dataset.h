@@ -0,0 +1,126 @@
+/*--
+    Dataset.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_DATASET_H_INCLUDED
+#define CORNUCOPIA_DATASET_H_INCLUDED
+
+#include "defs.h"
+#include "smart_ptr.h"
+#include "Parameters.h"
+
+#include <iosfwd>
+#include <mutex>
+#include <vector>
+
+NAMESPACE_Cornu
+
+class StrokeCorpus;
+
+/*
+    Training data for cost models.  The "Dataset generation" graph construction algorithm builds the usual graph and
+    also records, for each primitive and each edge, the quantities the CostEvaluator computes its costs from, along
+    with the costs.  Edges are validated by combining their curves, as the path finder does, so each edge record
+    also has the cost the path finder would see.  Lengths are in units of the scaled pixel size, so that features
+    from sketches of different sizes are comparable.
+
+    A dataset file is written as it is generated:
+        header:  "CornuDat", uint32 version, uint32 byte order mark (0x01020304), uint32 number of vertex features,
+                 uint32 number of edge features
+        strokes: for each stroke, int32 stroke index, int32 number of vertex records, int32 number of edge records,
+                 then the vertex records, then the edge records, as laid out in VertexRecord and EdgeRecord
+    Numbers are in the native byte order.  Strokes generated in parallel are written in the order they finish.
+*/
+class Dataset : public smart_base
+{
+public:
+    enum VertexFeature
+    {
+        VERTEX_TYPE, //0 = line, 1 = arc, 2 = clothoid
+        VERTEX_LENGTH,
+        VERTEX_ERROR, //the fit error, in squared length units
+        VERTEX_START_CURVATURE,
+        VERTEX_END_CURVATURE,
+        VERTEX_INFLECTION, //1 if the curvature changes sign
+        VERTEX_START_CORNER, //1 if the primitive starts at a corner
+        VERTEX_END_CORNER,
+        NUM_VERTEX_FEATURES //must be last
+    };
+
+    enum EdgeFeature
+    {
+        EDGE_POSITION_DIFF, //smallest gap between the primitives' ends over the overlap the continuity allows
+        EDGE_ANGLE_DIFF, //0 for G0 edges
+        EDGE_CURVATURE_DIFF, //0 for G0 and G1 edges
+        EDGE_EXTRA_ERROR1, //the error the join is predicted to add to the first primitive
+        EDGE_EXTRA_ERROR2,
+        EDGE_CORNER, //1 if the primitives meet at a corner
+        EDGE_INFLECTION, //1 if a G2 join has an inflection
+        NUM_EDGE_FEATURES //must be last
+    };
+
+    struct VertexRecord
+    {
+        float features[NUM_VERTEX_FEATURES];
+        float cost;
+    };
+
+    struct EdgeRecord
+    {
+        int start, end; //primitive indices
+        int continuity;
+        float features[NUM_EDGE_FEATURES];
+        float cost; //as predicted when the graph is built
+        float validatedCost;
+    };
+
+    std::vector<VertexRecord> vertices; //one per primitive
+    std::vector<EdgeRecord> edges; //dummy edges are left out
+
+    void write(std::ostream &out, int strokeIdx) const; //writes the stroke block
+    size_t memoryUsage() const;
+};
+
+CORNU_SMART_TYPEDEFS(Dataset);
+
+//Writes the dataset file header and then the stroke blocks as they are added, from any thread
+class DatasetWriter
+{
+public:
+    DatasetWriter(std::ostream &out);
+
+    void add(const Dataset &dataset, int strokeIdx);
+    int numStrokes() const { return _numStrokes; }
+    long long numEdges() const { return _numEdges; }
+
+private:
+    std::ostream &_out;
+    std::mutex _mutex;
+    int _numStrokes;
+    long long _numEdges;
+};
+
+//Fits every stroke of the corpus with the given parameters and the dataset generation algorithm, on numThreads threads
+//(0 for the global thread pool), and writes the records to out, one stroke at a time, so the memory used doesn't grow
+//with the corpus.  Strokes that can't be fit are skipped.  Returns the number of strokes written.
+int generateDataset(const StrokeCorpus &corpus, const Parameters &params, std::ostream &out, int numThreads = 0);
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_DATASET_H_INCLUDED
@@ -26,6 +26,13 @@ using namespace Eigen;
 NAMESPACE_Cornu
 
 Debugging *Debugging::_currentDebugging = new Debugging();
+thread_local Debugging *Debugging::_threadDebugging = NULL;
+
+Debugging *Debugging::silent()
+{
+    static Debugging silentDebugging;
+    return &silentDebugging;
+}
 
 void Debugging::set(Debugging *debugging)
 {
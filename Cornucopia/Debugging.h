@@ -46,11 +46,31 @@ public:
         DOTTED
     };
 
-    static Debugging *get() { return _currentDebugging; }
+    //returns the debugging object of the current thread if one is set, otherwise the global one
+    static Debugging *get() { return _threadDebugging ? _threadDebugging : _currentDebugging; }
+
+    //returns a debugging object that does nothing -- it has no state, so any number of threads can share it
+    static Debugging *silent();
+
+    //While a ThreadScope exists, Debugging::get() on its thread returns the given object.
+    //This lets each Fitter have its own debugging/timing context when fitting concurrently.
+    //A null debugging object leaves the current one in effect.  The object is not owned.
+    class ThreadScope
+    {
+    public:
+        ThreadScope(Debugging *debugging) : _previous(_threadDebugging) { if(debugging) _threadDebugging = debugging; }
+        ~ThreadScope() { _threadDebugging = _previous; }
+
+    private:
+        ThreadScope(const ThreadScope &);
+        ThreadScope &operator=(const ThreadScope &);
+
+        Debugging *_previous;
+    };
 
     virtual ~Debugging() {}
 
-    virtual bool isDebuggingOn() const { return false; }
+    virtual bool isDebuggingOn() const { return false; } //the library skips its debugging calls if this is false
 
     virtual void printf(const char * /*fmt*/, ...) {}
 
@@ -74,8 +94,19 @@ protected:
 
 private:
     static Debugging *_currentDebugging;
+    static thread_local Debugging *_threadDebugging;
 };
 
+//The library calls the debugging object through these macros, so that the arguments are only evaluated when
+//isDebuggingOn() returns true.  Defining CORNUCOPIA_NO_DEBUGGING compiles the calls out entirely.
+//Usage: CORNU_DEBUG(printf("cost = %lf", cost));  Code that only computes debugging output goes in if(CORNU_DEBUGGING_ON).
+#ifdef CORNUCOPIA_NO_DEBUGGING
+#define CORNU_DEBUGGING_ON false //the calls still get type checked
+#else
+#define CORNU_DEBUGGING_ON (Cornu::Debugging::get()->isDebuggingOn())
+#endif
+#define CORNU_DEBUG(call) do { if(CORNU_DEBUGGING_ON) Cornu::Debugging::get()->call; } while(0)
+
 END_NAMESPACE_Cornu
 
 #endif //CORNUCOPIA_DEBUGGING_H_INCLUDED
@@ -23,6 +23,12 @@
 #include "Fitter.h"
 #include "Polyline.h"
 #include "CurvePrimitive.h"
+#include "Line.h"
+#include "Arc.h"
+#include "Clothoid.h"
+#include "Snapshot.h"
+
+#include <limits>
 
 using namespace std;
 using namespace Eigen;
@@ -35,74 +41,131 @@ public:
         : _pts(fitter.output<RESAMPLING>()->output->pts())
     {
         PolylineConstPtr poly = fitter.output<RESAMPLING>()->output;
-        CircularType circular = _pts.circular();
-        _weightsLeft = VectorC<double>(_pts.size(), circular);
-        _weightsRight = VectorC<double>(_pts.size(), circular);
-        _weightLeftRoots = VectorC<double>(_pts.size(), circular);
-        _weightRightRoots = VectorC<double>(_pts.size(), circular);
-        _weightRoots = VectorC<double>(_pts.size(), circular);
-
-        for(int i = 0; i < _pts.size(); ++i)
+        int size = _pts.size();
+        int ghost = _pts.circular() ? max(0, size - 1) : 0;
+        _x.resize(size + ghost);
+        _y.resize(size + ghost);
+        _weightsLeft.resize(size + ghost);
+        _weightsRight.resize(size + ghost);
+
+        for(int i = 0; i < size; ++i)
         {
             VectorC<Vector2d>::Circulator prev = --_pts.circulator(i);
             VectorC<Vector2d>::Circulator next = ++_pts.circulator(i);
+            _x[i] = _pts[i][0];
+            _y[i] = _pts[i][1];
             _weightsLeft[i] = prev.done() ? 0 : poly->lengthFromTo(prev.index(), i);
             _weightsRight[i] = next.done() ? 0 : poly->lengthFromTo(i, next.index());
-            _weightLeftRoots[i] = sqrt(_weightsLeft[i]);
-            _weightRightRoots[i] = sqrt(_weightsRight[i]);
-            _weightRoots[i] = sqrt(_weightsLeft[i] + _weightsRight[i]);
         }
+
+        //a range that wraps around the end of a closed curve continues into a copy of its beginning
+        _x.tail(ghost) = _x.head(ghost);
+        _y.tail(ghost) = _y.head(ghost);
+        _weightsLeft.tail(ghost) = _weightsLeft.head(ghost);
+        _weightsRight.tail(ghost) = _weightsRight.head(ghost);
+
+        _weightLeftRoots = _weightsLeft.sqrt();
+        _weightRightRoots = _weightsRight.sqrt();
+        _weightRoots = (_weightsLeft + _weightsRight).sqrt();
+
+        _computeMoments();
     }
 
     double computeError(CurvePrimitiveConstPtr curve, int from, int to,
                         bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
     {
-        double error = 0;
+        double error;
+        if(curve->getType() == CurvePrimitive::LINE && _lineError(static_cast<const Line &>(*curve), from, to, firstToEndpoint, lastToEndpoint, reversed, error))
+            return error;
+        return _weightedError(curve, from, to, numeric_limits<double>::infinity(), firstToEndpoint, lastToEndpoint, reversed);
+    }
 
-        if(from < 0 || to >= (int)_pts.size())
-            return 0.;
+    double computeErrorIncremental(CurvePrimitiveConstPtr curve, int from, int to, VectorXd &inOutParams,
+                                   bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
+    {
+        double error;
+        if(curve->getType() == CurvePrimitive::LINE && _lineError(static_cast<const Line &>(*curve), from, to, firstToEndpoint, lastToEndpoint, reversed, error))
+            return error; //lines don't use the guesses
+        return _weightedError(curve, from, to, numeric_limits<double>::infinity(), firstToEndpoint, lastToEndpoint, reversed, &inOutParams);
+    }
 
-        bool first = true;
-        for(VectorC<Vector2d>::Circulator circ = _pts.circulator(from); ; ++circ)
-        {
-            int idx = circ.index();
-            bool last = (idx == to);
+    void computeErrorVector(CurvePrimitiveConstPtr curve, int from, int to, VectorXd &outError, MatrixXd *outErrorDer,
+                            bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
+    {
+        _dispatchErrorVector(*curve, from, to, outError, outErrorDer, firstToEndpoint, lastToEndpoint, reversed, NULL);
+    }
 
-            bool toFirstEndpoint = first && firstToEndpoint;
-            bool toLastEndpoint = last && lastToEndpoint;
+    void computeErrorVectorIncremental(CurvePrimitiveConstPtr curve, int from, int to, VectorXd &outError, MatrixXd *outErrorDer,
+                                       VectorXd &inOutParams, bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
+    {
+        _dispatchErrorVector(*curve, from, to, outError, outErrorDer, firstToEndpoint, lastToEndpoint, reversed, &inOutParams);
+    }
 
-            const Vector2d &pt = _pts.flatAt(idx);
+    double computeErrorForCost(CurvePrimitiveConstPtr curve, int from, int to,
+                               bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
+    {
+        return computeError(curve, from, to, firstToEndpoint, lastToEndpoint, reversed) / curve->length();
+    }
 
-            double s;
-            if(toLastEndpoint)
-                s = reversed ? 0 : curve->length();
-            else if(toFirstEndpoint)
-                s = reversed ? curve->length() : 0;
-            else
-                s = curve->project(pt);
+    double computeErrorForCostBounded(CurvePrimitiveConstPtr curve, int from, int to, double cutoff,
+                                      bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
+    {
+        double error;
+        if(_fastWeightedError(*curve, from, to, cutoff * curve->length(), firstToEndpoint, lastToEndpoint, reversed, error))
+            return error / curve->length();
+        return _weightedError(curve, from, to, cutoff * curve->length(), firstToEndpoint, lastToEndpoint, reversed) / curve->length();
+    }
 
-            double distSq = (curve->pos(s) - pt).squaredNorm();
-            double weight = 0;
-            if(!toFirstEndpoint)
-                weight += _weightsLeft.flatAt(idx);
-            if(!toLastEndpoint)
-                weight += _weightsRight.flatAt(idx);
+    double computeErrorForCostIncremental(CurvePrimitiveConstPtr curve, int from, int to, double cutoff, VectorXd &inOutParams) const
+    {
+        double error;
+        if(_fastWeightedError(*curve, from, to, cutoff * curve->length(), true, true, false, error))
+        {
+            inOutParams.resize(0); //lines and arcs project in closed form anyway
+            return error / curve->length();
+        }
+        return _weightedError(curve, from, to, cutoff * curve->length(), true, true, false, &inOutParams) / curve->length();
+    }
 
-            error += weight * distSq;
+    size_t memoryUsage() const
+    {
+        size_t dirTables = 0;
+        for(int k = 0; k < (int)_minDir.size(); ++k)
+            dirTables += _minDir[k].size() + _maxDir[k].size();
+        return sizeof(*this) + (_x.size() + _y.size() + _weightsLeft.size() + _weightsRight.size() +
+                                _weightLeftRoots.size() + _weightRightRoots.size() + _weightRoots.size() +
+                                _moments.size() + dirTables) * sizeof(double);
+    }
 
-            first = false;
-            if(last)
-                break;
+protected:
+    //dispatches on the type so that the Jacobian rows are assembled with statically sized blocks
+    void _dispatchErrorVector(const CurvePrimitive &curve, int from, int to, VectorXd &outError, MatrixXd *outErrorDer,
+                              bool firstToEndpoint, bool lastToEndpoint, bool reversed, VectorXd *warmParams) const
+    {
+        switch(curve.getType())
+        {
+        case CurvePrimitive::LINE:
+            _computeErrorVector(static_cast<const Line &>(curve), from, to, outError, outErrorDer, firstToEndpoint, lastToEndpoint, reversed, warmParams);
+            break;
+        case CurvePrimitive::ARC:
+            _computeErrorVector(static_cast<const Arc &>(curve), from, to, outError, outErrorDer, firstToEndpoint, lastToEndpoint, reversed, warmParams);
+            break;
+        case CurvePrimitive::CLOTHOID:
+            _computeErrorVector(static_cast<const Clothoid &>(curve), from, to, outError, outErrorDer, firstToEndpoint, lastToEndpoint, reversed, warmParams);
+            break;
         }
-
-        return error;
     }
 
-    void computeErrorVector(CurvePrimitiveConstPtr curve, int from, int to, VectorXd &outError, MatrixXd *outErrorDer,
-                            bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
+    //The projections are done first, and then the curve and its parameter derivatives are evaluated at all
+    //the samples at once, so a clothoid shares its Fresnel evaluations across the whole Jacobian.
+    //If warmParams is given, its entries are used as starting guesses for the projections (as in _distancesSq).
+    template<class Primitive>
+    void _computeErrorVector(const Primitive &curve, int from, int to, VectorXd &outError, MatrixXd *outErrorDer,
+                             bool firstToEndpoint, bool lastToEndpoint, bool reversed, VectorXd *warmParams) const
     {
-        int numParams = (int)curve->params().size();
-        int numOutputs = 2 * (_pts.numElems(from, to) + 1); //to is inclusive
+        const int numParams = Primitive::NUM_PARAMS;
+        int numSamples = _pts.numElems(from, to) + 1; //to is inclusive
+        int numOutputs = 2 * numSamples;
         outError.resize(numOutputs); 
         if(outErrorDer)
             outErrorDer->resize(numOutputs, numParams);
@@ -110,79 +173,398 @@ public:
         if(from < 0 || to >= (int)_pts.size())
         {
             outError.setZero();
-            outErrorDer->setZero();
+            if(outErrorDer)
+                outErrorDer->setZero();
+            if(warmParams)
+                warmParams->resize(0);
             return;
         }
-         
-        CurvePrimitive::ParamDer der, tanDer;
-        bool first = true;
-        int vecIdx = 0;
-        for(VectorC<Vector2d>::Circulator circ = _pts.circulator(from); ; ++circ, vecIdx += 2)
+
+        //sample i is at flat index from + i
+        Matrix2Xd pts(2, numSamples);
+        pts.row(0) = _x.segment(from, numSamples).matrix().transpose();
+        pts.row(1) = _y.segment(from, numSamples).matrix().transpose();
+
+        VectorXd weightRoots = _weightRoots.segment(from, numSamples).matrix();
+        if(lastToEndpoint)
+            weightRoots[numSamples - 1] = _weightLeftRoots[from + numSamples - 1];
+        if(firstToEndpoint) //takes precedence if there's only one sample
+            weightRoots[0] = _weightRightRoots[from];
+
+        int numWarm = warmParams ? (int)warmParams->size() : 0;
+        VectorXd s(numSamples);
+        for(int i = 0; i < numSamples; ++i)
         {
-            int idx = circ.index();
-            bool last = (idx == to);
-
-            bool toFirstEndpoint = first && firstToEndpoint;
-            bool toLastEndpoint = last && lastToEndpoint;
-
-            const Vector2d &pt = _pts.flatAt(idx);
-            double weightRoot = 0;
-            if(toFirstEndpoint)
-                weightRoot = _weightRightRoots.flatAt(idx);
-            else if(toLastEndpoint)
-                weightRoot = _weightLeftRoots.flatAt(idx);
+            if(i == numSamples - 1 && lastToEndpoint)
+                s[i] = reversed ? 0 : curve.length();
+            else if(i == 0 && firstToEndpoint)
+                s[i] = reversed ? curve.length() : 0;
+            else if(i < numWarm)
+                s[i] = _projectFrom(curve, pts.col(i), (*warmParams)[i]);
             else
-                weightRoot = _weightRoots.flatAt(idx);
+                s[i] = curve.project(pts.col(i));
+        }
+        if(warmParams)
+            *warmParams = s;
 
-            double s;
-            if(toLastEndpoint)
-                s = reversed ? 0 : curve->length();
-            else if(toFirstEndpoint)
-                s = reversed ? curve->length() : 0;
-            else
-                s = curve->project(pt);
+        Map<Matrix2Xd> weightedErr(outError.data(), 2, numSamples);
+        if(!outErrorDer)
+        {
+            for(int i = 0; i < numSamples; ++i)
+                weightedErr.col(i) = curve.pos(s[i]);
+            weightedErr = (weightedErr - pts) * weightRoots.asDiagonal();
+            return;
+        }
 
-            Vector2d err = curve->pos(s) - pt;
-            outError.segment<2>(vecIdx) = err * weightRoot;
+        MatrixXd der, tanDer;
+        Matrix2Xd pos, tangent, der2;
+        curve.derivativeBatch(s, der, tanDer, &pos, &tangent, &der2);
+        Matrix2Xd err = pos - pts;
+        weightedErr = err * weightRoots.asDiagonal();
 
-            if(outErrorDer)
+        const double tol = 1e-10;
+        for(int i = 0; i < numSamples; ++i)
+        {
+            Matrix<double, 1, numParams> ds = Matrix<double, 1, numParams>::Zero();
+            if(s[i] + tol >= curve.length())
+                ds(CurvePrimitive::LENGTH) = 1.;
+            else if(s[i] > tol)
             {
-                curve->derivativeAt(s, der, tanDer);
-                Vector2d tangent = curve->der(s);
-                RowVectorXd ds = RowVectorXd::Zero(numParams); 
-
-                const double tol = 1e-10;
-
-                if(s + tol >= curve->length())
-                    ds(CurvePrimitive::LENGTH) = 1.;
-                else if(s > tol)
-                {
-                    double dfds = 1. + curve->der2(s).dot(err);
-                    if(fabs(dfds) < tol)
-                        dfds = (dfds < 0. ? -tol : tol);
-                    ds = -(err.transpose() * tanDer + tangent.transpose() * der) / dfds;
-                }
-
-                outErrorDer->block(vecIdx, 0, 2, der.cols()) = (der + tangent * ds) * weightRoot;
+                double dfds = 1. + der2.col(i).dot(err.col(i));
+                if(fabs(dfds) < tol)
+                    dfds = (dfds < 0. ? -tol : tol);
+                ds = -(err.col(i).transpose() * tanDer.block<2, numParams>(2 * i, 0) +
+                       tangent.col(i).transpose() * der.block<2, numParams>(2 * i, 0)) / dfds;
             }
 
-            first = false;
-            if(last)
+            outErrorDer->block<2, numParams>(2 * i, 0) = (der.block<2, numParams>(2 * i, 0) + tangent.col(i) * ds) * weightRoots[i];
+        }
+    }
+
+    //Computes the squared distance of each sample between from and to (incl.) to its projection on the curve
+    //(or to the curve endpoint, as described for computeError) along with the sample's weight.  The samples are
+    //processed in chunks, and after each chunk, process(distSq, weights) is called and the computation stops
+    //if it returns false.  The chunk size is a multiple of the SIMD packet size, so batch evaluation gives
+    //the same result for a sample regardless of where the computation stops.
+    //If warmParams is given, its entries are used as starting guesses for projecting the corresponding samples
+    //and they are overwritten by the parameters computed here.
+    template<typename Process>
+    void _distancesSq(const CurvePrimitiveConstPtr &curve, int from, int to, bool firstToEndpoint, bool lastToEndpoint,
+                      bool reversed, Process process, VectorXd *warmParams = NULL) const
+    {
+        int num = _pts.numElems(from, to) + 1; //to is inclusive
+        int numWarm = warmParams ? (int)warmParams->size() : 0;
+        if(warmParams && numWarm != num)
+            warmParams->conservativeResize(num);
+
+        for(int i = 0; i < num; ) //sample i is at flat index from + i
+        {
+            int size = min(num - i, _chunkSize);
+            _ChunkBuffers &chunk = _chunkBuffers(size);
+            chunk.pts.row(0) = _x.segment(from + i, size).matrix().transpose();
+            chunk.pts.row(1) = _y.segment(from + i, size).matrix().transpose();
+            chunk.weights = (_weightsLeft.segment(from + i, size) + _weightsRight.segment(from + i, size)).matrix();
+
+            for(int j = 0; j < size; ++j, ++i)
+            {
+                bool toFirstEndpoint = (i == 0 && firstToEndpoint);
+                bool toLastEndpoint = (i == num - 1 && lastToEndpoint);
+
+                double &param = chunk.params[j];
+                if(toLastEndpoint)
+                    param = reversed ? 0 : curve->length();
+                else if(toFirstEndpoint)
+                    param = reversed ? curve->length() : 0;
+                else if(i < numWarm)
+                    param = _projectFrom(*curve, chunk.pts.col(j), (*warmParams)[i]);
+                else
+                    param = curve->project(chunk.pts.col(j));
+                if(warmParams)
+                    (*warmParams)[i] = param; //the guess for this sample has been used, so it can be overwritten
+
+                if(toFirstEndpoint || toLastEndpoint)
+                    chunk.weights[j] = (toFirstEndpoint ? 0. : _weightsLeft[from + i]) + (toLastEndpoint ? 0. : _weightsRight[from + i]);
+            }
+
+            curve->evalBatch(chunk.params, &chunk.curvePts);
+            chunk.distSq = (chunk.curvePts - chunk.pts).colwise().squaredNorm().transpose();
+            if(!process(chunk.distSq, chunk.weights))
                 break;
         }
     }
 
-    double computeErrorForCost(CurvePrimitiveConstPtr curve, int from, int to,
-                               bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
+    static const int _chunkSize = 32;
+
+    //Scratch space for _distancesSq.  Each chunk length has its own buffers, so they are allocated once per
+    //thread instead of on every error computation in the primitive fitting loops.
+    struct _ChunkBuffers
     {
-        return computeError(curve, from, to, firstToEndpoint, lastToEndpoint, reversed) / curve->length();
+        VectorXd params, weights, distSq;
+        Matrix2Xd pts, curvePts;
+    };
+
+    static _ChunkBuffers &_chunkBuffers(int size)
+    {
+        static thread_local vector<_ChunkBuffers> buffers(_chunkSize + 1);
+        _ChunkBuffers &out = buffers[size];
+        if(out.params.size() != size)
+        {
+            out.params.resize(size);
+            out.weights.resize(size);
+            out.distSq.resize(size);
+            out.pts.resize(2, size);
+            out.curvePts.resize(2, size);
+        }
+        return out;
+    }
+
+    //Projects pt onto the curve with Newton's method starting at guess, falling back to a full projection if that
+    //doesn't converge quickly.  Lines and arcs have closed-form projections, so this only helps clothoids.
+    //Newton's method finds the local minimum of the distance nearest the guess, which need not be the closest point.
+    //A curve that turns less than a quarter turn can't come back near the point, so the minimum is only trusted if
+    //the curve doesn't turn more, the step from the guess was short, and the point is well within the radius of
+    //curvature; otherwise the full projection is used.
+    static double _projectFrom(const CurvePrimitive &curve, const Vector2d &pt, double guess)
+    {
+        if(curve.getType() != CurvePrimitive::CLOTHOID)
+            return curve.project(pt);
+
+        const double tol = 1e-10;
+        double len = curve.length();
+        if(len * max(fabs(curve.startCurvature()), fabs(curve.endCurvature())) > HALFPI) //bounds the turning
+            return curve.project(pt);
+
+        double start = min(max(guess, 0.), len);
+        double s = start;
+        for(int iter = 0; iter < 4; ++iter)
+        {
+            Vector2d pos, der, der2;
+            curve.eval(s, &pos, &der, &der2);
+            double dot = der.dot(pos - pt);
+            double dotDer = der.squaredNorm() + der2.dot(pos - pt);
+            if(dotDer < tol) //not near a local minimum
+                break;
+
+            double newS = min(max(s - dot / dotDer, 0.), len);
+            double step = fabs(newS - s);
+            s = newS;
+            if(step < tol * (1. + len))
+            {
+                if(fabs(s - start) > 0.1 * len || der2.norm() * (pos - pt).norm() > 0.5)
+                    break;
+                return s;
+            }
+        }
+
+        return curve.project(pt);
+    }
+
+    /*
+        Lines and arcs can often be measured from sums over the samples instead of by projecting each one.
+        _moments.col(k) is the sum over flat indices below k of w * (1, x, y, q, xx, xy, yy, xq, yq, qq), where w is a
+        sample's weight, (x, y) its position relative to _origin (for precision), and q = xx + yy.  So the weighted sum
+        of any quadratic in (1, x, y, q) over a range of samples is a difference of two columns.  The direction from
+        each sample to the next, unwrapped into a continuous angle, has its range minima and maxima in sparse tables:
+        _minDir[k][i] is the minimum of the 2^k directions starting at i.
+    */
+    void _computeMoments()
+    {
+        int size = (int)_x.size();
+        _origin = Vector2d(_x.mean(), _y.mean());
+        _moments.setZero(10, size + 1);
+        _minWeight = numeric_limits<double>::infinity();
+        for(int i = 0; i < size; ++i)
+        {
+            double w = _weightsLeft[i] + _weightsRight[i];
+            double x = _x[i] - _origin[0], y = _y[i] - _origin[1], q = x * x + y * y;
+            Matrix<double, 10, 1> m;
+            m << 1., x, y, q, x * x, x * y, y * y, x * q, y * q, q * q;
+            _moments.col(i + 1) = _moments.col(i) + w * m;
+            if(w > 0.)
+                _minWeight = min(_minWeight, w);
+        }
+
+        int numDirs = max(0, size - 1);
+        _minDir.assign(1, ArrayXd(numDirs));
+        Vector2d prevDir(1., 0.);
+        double prevAngle = 0.;
+        for(int i = 0; i < numDirs; ++i)
+        {
+            Vector2d dir(_x[i + 1] - _x[i], _y[i + 1] - _y[i]);
+            if(dir.squaredNorm() > 0.) //a repeated sample keeps the previous direction
+            {
+                prevAngle = (i == 0 ? AngleUtils::angle(dir) : prevAngle + AngleUtils::angle(prevDir, dir));
+                prevDir = dir;
+            }
+            _minDir[0][i] = prevAngle;
+        }
+        _maxDir = _minDir;
+        for(int k = 1; (1 << k) <= numDirs; ++k)
+        {
+            int half = 1 << (k - 1), num = numDirs - (1 << k) + 1;
+            _minDir.push_back(_minDir[k - 1].head(num).min(_minDir[k - 1].segment(half, num)));
+            _maxDir.push_back(_maxDir[k - 1].head(num).max(_maxDir[k - 1].segment(half, num)));
+        }
+    }
+
+    //the moments of the samples at flat indices from through to (incl.), as the matrix of the sums of w * f * f^T,
+    //f = (1, x, y, q)
+    Matrix4d _momentMatrix(int from, int to) const
+    {
+        Matrix<double, 10, 1> m = _moments.col(to + 1) - _moments.col(from);
+        Matrix4d out;
+        out << m[0], m[1], m[2], m[3],
+               m[1], m[4], m[5], m[7],
+               m[2], m[5], m[6], m[8],
+               m[3], m[7], m[8], m[9];
+        return out;
+    }
+
+    //Whether the directions from each sample to the next between flat indices from and to (incl.) are all within
+    //90 degrees of angle, or all within 90 degrees of its opposite, so that the samples' projections onto a line at
+    //that angle are in order
+    bool _monotoneAlong(double angle, int from, int to) const
+    {
+        if(to <= from)
+            return true;
+        int num = to - from, k = 0;
+        while((2 << k) <= num)
+            ++k;
+        double minDir = min(_minDir[k][from], _minDir[k][to - (1 << k)]);
+        double maxDir = max(_maxDir[k][from], _maxDir[k][to - (1 << k)]);
+        if(maxDir - minDir > PI)
+            return false;
+        for(int side = 0; side < 2; ++side)
+        {
+            double a = angle + side * PI;
+            a += TWOPI * floor((0.5 * (minDir + maxDir) - a) / TWOPI + 0.5); //the copy of the angle nearest the directions
+            if(minDir >= a - HALFPI && maxDir <= a + HALFPI)
+                return true;
+        }
+        return false;
+    }
+
+    //The flat indices of a range's first and last samples and of the samples in it that are projected rather than
+    //measured to an endpoint.  Returns false if there are none of the latter.
+    bool _projectedRange(int from, int to, bool firstToEndpoint, bool lastToEndpoint, int &last, int &projFrom, int &projTo) const
+    {
+        last = from + _pts.numElems(from, to);
+        projFrom = from + (firstToEndpoint ? 1 : 0);
+        projTo = last - (lastToEndpoint ? 1 : 0);
+        return projFrom <= projTo;
+    }
+
+    //the weighted squared distances of a range's first and last samples to the curve's endpoints, where requested
+    double _endpointError(const CurvePrimitive &curve, int from, int last, bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
+    {
+        double out = 0.;
+        if(firstToEndpoint)
+            out += _weightsRight[from] * (Vector2d(_x[from], _y[from]) - (reversed ? curve.endPos() : curve.startPos())).squaredNorm();
+        if(lastToEndpoint)
+            out += _weightsLeft[last] * (Vector2d(_x[last], _y[last]) - (reversed ? curve.startPos() : curve.endPos())).squaredNorm();
+        return out;
+    }
+
+    //The weighted sum of squared distances from the samples to a line, as _weightedError computes it.  The projected
+    //samples' squared distances to the infinite line are a quadratic form of their moments, which is a lower bound
+    //on their distances to the segment, and it's exact if none of them projects past an end.  That's certain if
+    //they're in order along the line, starting and ending on the segment.  Returns whether out is exact; if not,
+    //it's a lower bound.
+    bool _lineError(const Line &line, int from, int to, bool firstToEndpoint, bool lastToEndpoint, bool reversed, double &out) const
+    {
+        int last, projFrom, projTo;
+        if(from < 0 || to >= (int)_pts.size() || to == from || !_projectedRange(from, to, firstToEndpoint, lastToEndpoint, last, projFrom, projTo))
+        {
+            out = 0.;
+            return false;
+        }
+
+        Vector2d dir = line.der(0.), normal(-dir[1], dir[0]);
+        Vector3d a(normal.dot(_origin - line.startPos()), normal[0], normal[1]); //the signed distance is a^T (1, x, y)
+        out = max(0., a.dot(_momentMatrix(projFrom, projTo).topLeftCorner<3, 3>() * a));
+        out += _endpointError(line, from, last, firstToEndpoint, lastToEndpoint, reversed);
+
+        const double tol = 1e-9 * (1. + line.length());
+        double startParam = dir.dot(Vector2d(_x[projFrom], _y[projFrom]) - line.startPos());
+        double endParam = dir.dot(Vector2d(_x[projTo], _y[projTo]) - line.startPos());
+        return min(startParam, endParam) >= -tol && max(startParam, endParam) <= line.length() + tol &&
+               _monotoneAlong(AngleUtils::angle(dir), projFrom, projTo);
+    }
+
+    //A lower bound on the weighted sum of squared distances from the samples to an arc--unless some sample is
+    //farther than maxDist from its circle.  The sum of w * e^2, where e = d^2 - r^2 = (d - r)(d + r) is the algebraic
+    //distance of a sample at distance d from the center, is a quadratic form of the moments.  If d - r <= maxDist,
+    //(d - r)^2 >= e^2 / (2r + maxDist)^2, and the squared distance to the arc is at least (d - r)^2.  Returns false
+    //if the circle is too large for the moments to give e accurately.
+    bool _arcErrorBound(const Arc &arc, int from, int to, double maxDist, double &out) const
+    {
+        int last, projFrom, projTo;
+        out = 0.;
+        if(from < 0 || to >= (int)_pts.size() || to == from || fabs(arc.curvature(0.)) < 1e-6)
+            return false;
+        out = _endpointError(arc, from, from + _pts.numElems(from, to), true, true, false);
+        if(!_projectedRange(from, to, true, true, last, projFrom, projTo))
+            return true;
+
+        double radius = fabs(arc.radius());
+        Vector2d center = arc.center() - _origin;
+        Vector4d a(center.squaredNorm() - radius * radius, -2. * center[0], -2. * center[1], 1.); //e = a^T (1, x, y, q)
+        double sum = a.dot(_momentMatrix(projFrom, projTo) * a);
+
+        //the rounding error of the sums is relative to the largest of them, which are over the whole curve
+        Matrix4d total = _momentMatrix(0, (int)_x.size() - 1);
+        double roundoff = 1e-12 * SQR(a.cwiseAbs().dot(total.diagonal().cwiseSqrt()));
+        if(!(sum - roundoff > 0.))
+            return true;
+        out += (sum - roundoff) / SQR(2. * radius + maxDist);
+        return true;
+    }
+
+    //Measures lines and rejects arcs from the moments where possible, returning false if the samples need to be
+    //projected.  If it returns true for an arc, error is above cutoff.
+    bool _fastWeightedError(const CurvePrimitive &curve, int from, int to, double cutoff,
+                            bool firstToEndpoint, bool lastToEndpoint, bool reversed, double &error) const
+    {
+        if(curve.getType() == CurvePrimitive::LINE)
+            return _lineError(static_cast<const Line &>(curve), from, to, firstToEndpoint, lastToEndpoint, reversed, error) || error > cutoff;
+        if(curve.getType() == CurvePrimitive::ARC && firstToEndpoint && lastToEndpoint && !reversed && cutoff < numeric_limits<double>::infinity())
+            return _arcErrorBound(static_cast<const Arc &>(curve), from, to, sqrt(cutoff / _minWeight), error) && error > cutoff;
+        return false;
+    }
+
+    //the weighted sum of squared distances, stopping once it exceeds cutoff
+    double _weightedError(const CurvePrimitiveConstPtr &curve, int from, int to, double cutoff,
+                          bool firstToEndpoint, bool lastToEndpoint, bool reversed, VectorXd *warmParams = NULL) const
+    {
+        if(from < 0 || to >= (int)_pts.size())
+            return 0.;
+
+        double error = 0;
+        _distancesSq(curve, from, to, firstToEndpoint, lastToEndpoint, reversed, [&](const VectorXd &distSq, const VectorXd &weights)
+        {
+            error += weights.dot(distSq);
+            return error <= cutoff;
+        }, warmParams);
+
+        return error;
     }
 
-protected:
     const VectorC<Vector2d> &_pts;
-    VectorC<double> _weightsLeft, _weightsRight, _weightLeftRoots, _weightRightRoots, _weightRoots;
+
+    //The samples and their weights, stored flat so that sample i of a range starting at from is at index from + i.
+    //For closed curves, the arrays are followed by a copy of all but their last element, so no range wraps around.
+    ArrayXd _x, _y;
+    ArrayXd _weightsLeft, _weightsRight, _weightLeftRoots, _weightRightRoots, _weightRoots;
+
+    //see _computeMoments
+    Vector2d _origin;
+    Matrix<double, 10, Dynamic> _moments;
+    double _minWeight; //of the samples with any
+    vector<ArrayXd> _minDir, _maxDir;
 };
 
+const int L2ErrorComputer::_chunkSize; //std::min takes it by reference
+
 class LInfErrorComputer : public L2ErrorComputer
 {
 public:
@@ -192,41 +574,73 @@ public:
     double computeErrorForCost(CurvePrimitiveConstPtr curve, int from, int to,
                                bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
     {
-        double error = 0;
+        return computeErrorForCostBounded(curve, from, to, numeric_limits<double>::infinity(), firstToEndpoint, lastToEndpoint, reversed);
+    }
 
-        if(from < 0 || to >= (int)_pts.size())
-            return 0.;
+    double computeErrorForCostBounded(CurvePrimitiveConstPtr curve, int from, int to, double cutoff,
+                                      bool firstToEndpoint, bool lastToEndpoint, bool reversed) const
+    {
+        double error;
+        if(_meanExceeds(*curve, from, to, cutoff, firstToEndpoint, lastToEndpoint, reversed, error))
+            return error;
+        return _maxDistSq(curve, from, to, cutoff, firstToEndpoint, lastToEndpoint, reversed);
+    }
 
-        bool first = true;
-        for(VectorC<Vector2d>::Circulator circ = _pts.circulator(from); ; ++circ)
+    double computeErrorForCostIncremental(CurvePrimitiveConstPtr curve, int from, int to, double cutoff, VectorXd &inOutParams) const
+    {
+        double error;
+        if(_meanExceeds(*curve, from, to, cutoff, true, true, false, error))
         {
-            int idx = circ.index();
-            bool last = (idx == to);
-
-            bool toFirstEndpoint = first && firstToEndpoint;
-            bool toLastEndpoint = last && lastToEndpoint;
-
-            const Vector2d &pt = _pts.flatAt(idx);
-
-            double s;
-            if(toLastEndpoint)
-                s = reversed ? 0 : curve->length();
-            else if(toFirstEndpoint)
-                s = reversed ? curve->length() : 0;
-            else
-                s = curve->project(pt);
+            inOutParams.resize(0);
+            return error;
+        }
+        return _maxDistSq(curve, from, to, cutoff, true, true, false, &inOutParams);
+    }
 
-            double distSq = (curve->pos(s) - pt).squaredNorm();
+private:
+    //The maximum squared distance is at least the weighted mean, which the moments bound from below for lines and
+    //arcs (the arc bound only needs to hold when no sample is more than sqrt(cutoff) away).  Returns whether that
+    //bound, which goes in error, exceeds cutoff.
+    bool _meanExceeds(const CurvePrimitive &curve, int from, int to, double cutoff,
+                      bool firstToEndpoint, bool lastToEndpoint, bool reversed, double &error) const
+    {
+        if(!(cutoff < numeric_limits<double>::infinity()) || from < 0 || to >= (int)_pts.size() || to == from)
+            return false;
+
+        double sum;
+        if(curve.getType() == CurvePrimitive::LINE)
+            _lineError(static_cast<const Line &>(curve), from, to, firstToEndpoint, lastToEndpoint, reversed, sum);
+        else if(curve.getType() != CurvePrimitive::ARC || !firstToEndpoint || !lastToEndpoint || reversed ||
+                !_arcErrorBound(static_cast<const Arc &>(curve), from, to, sqrt(cutoff), sum))
+            return false;
+
+        int last, projFrom, projTo;
+        double weight = (firstToEndpoint ? _weightsRight[from] : 0.);
+        if(_projectedRange(from, to, firstToEndpoint, lastToEndpoint, last, projFrom, projTo))
+            weight += _moments(0, projTo + 1) - _moments(0, projFrom);
+        weight += (lastToEndpoint ? _weightsLeft[last] : 0.);
+        if(!(weight > 0.))
+            return false;
+        error = sum / weight;
+        return error > cutoff;
+    }
 
-            error = max(error, distSq);
+    //the maximum squared distance, stopping once it exceeds cutoff
+    double _maxDistSq(const CurvePrimitiveConstPtr &curve, int from, int to, double cutoff,
+                      bool firstToEndpoint, bool lastToEndpoint, bool reversed, VectorXd *warmParams = NULL) const
+    {
+        if(from < 0 || to >= (int)_pts.size())
+            return 0.;
 
-            first = false;
-            if(last)
-                break;
-        }
+        double maxDistSq = 0;
+        _distancesSq(curve, from, to, firstToEndpoint, lastToEndpoint, reversed, [&](const VectorXd &distSq, const VectorXd &)
+        {
+            maxDistSq = max(maxDistSq, distSq.maxCoeff());
+            return maxDistSq <= cutoff;
+        }, warmParams);
 
-        return error;
-    }    
+        return maxDistSq;
+    }
 };
 
 class ErrorComputerCreator : public Algorithm<ERROR_COMPUTER>
@@ -237,15 +651,61 @@ public:
 
     string name() const { return _lInf ? "L-Infinity" : "L2"; }
 
+    ErrorComputerConstPtr create(const Fitter &fitter) const
+    {
+        if(_lInf)
+            return new LInfErrorComputer(fitter);
+        return new L2ErrorComputer(fitter);
+    }
+
 protected:
     void _run(const Fitter &fitter, AlgorithmOutput<ERROR_COMPUTER> &out)
     {
-        out.errorComputer = _lInf ? new LInfErrorComputer(fitter) : new L2ErrorComputer(fitter);
+        out.errorComputer = create(fitter);
     }
 private:
     bool _lInf;
 };
 
+class CPUErrorBackend : public ErrorBackend
+{
+public:
+    //override
+    void computeErrorsForCost(const ErrorComputer &errorComputer, const Polyline &, const ErrorCandidate *candidates,
+                              int count, double cutoff, double *outErrors)
+    {
+        for(int i = 0; i < count; ++i)
+            outErrors[i] = errorComputer.computeErrorForCostBounded(candidates[i].curve, candidates[i].from, candidates[i].to, cutoff);
+    }
+};
+
+ErrorBackend &ErrorBackend::cpu()
+{
+    static CPUErrorBackend backend;
+    return backend;
+}
+
+size_t AlgorithmOutput<ERROR_COMPUTER>::memoryUsage() const
+{
+    return sizeof(*this) + (errorComputer ? errorComputer->memoryUsage() : 0);
+}
+
+void AlgorithmOutput<ERROR_COMPUTER>::recycle()
+{
+    errorComputer.reset();
+}
+
+void AlgorithmOutput<ERROR_COMPUTER>::write(SnapshotWriter &) const
+{
+    //the error computer only has sums over the resampled points, which read() computes again
+}
+
+void AlgorithmOutput<ERROR_COMPUTER>::read(SnapshotReader &, const Fitter &fitter)
+{
+    AlgorithmBase *creator = AlgorithmBase::get(ERROR_COMPUTER, fitter.params().getAlgorithm(ERROR_COMPUTER));
+    errorComputer = static_cast<ErrorComputerCreator *>(creator)->create(fitter);
+}
+
 void Algorithm<ERROR_COMPUTER>::_initialize()
 {
     new ErrorComputerCreator(true);
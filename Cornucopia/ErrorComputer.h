@@ -41,17 +41,75 @@ public:
     virtual void computeErrorVector(CurvePrimitiveConstPtr curve, int from, int to,
                                     Eigen::VectorXd &outError, Eigen::MatrixXd *outErrorDer = NULL,
                                     bool firstToEndpoint = true, bool lastToEndpoint = true, bool reversed = false) const = 0;
+    //Like computeErrorVector, for a curve that changes a little between calls, as in each iteration of a solver.  On
+    //input, inOutParams holds the projection parameters of the samples from the previous call (empty for the first
+    //call), which are used to warm-start the projections onto this curve.  On output, it holds this curve's.
+    virtual void computeErrorVectorIncremental(CurvePrimitiveConstPtr curve, int from, int to, Eigen::VectorXd &outError,
+                                               Eigen::MatrixXd *outErrorDer, Eigen::VectorXd &inOutParams,
+                                               bool firstToEndpoint = true, bool lastToEndpoint = true, bool reversed = false) const
+    { inOutParams.resize(0); computeErrorVector(curve, from, to, outError, outErrorDer, firstToEndpoint, lastToEndpoint, reversed); }
+    //Like computeError, warm-starting the projections as computeErrorVectorIncremental does (and sharing inOutParams
+    //with it, so a solver can alternate between the two).
+    virtual double computeErrorIncremental(CurvePrimitiveConstPtr curve, int from, int to, Eigen::VectorXd &inOutParams,
+                                           bool firstToEndpoint = true, bool lastToEndpoint = true, bool reversed = false) const
+    { inOutParams.resize(0); return computeError(curve, from, to, firstToEndpoint, lastToEndpoint, reversed); }
     //Computes the error to be used in the graph weight--by default, the squared maximum distance to the curve
     virtual double computeErrorForCost(CurvePrimitiveConstPtr curve, int from, int to,
                                        bool firstToEndpoint = true, bool lastToEndpoint = true, bool reversed = false) const = 0;
+    //Like computeErrorForCost, but may stop early once the error is known to exceed cutoff.  In that case the
+    //return value is greater than cutoff, but not necessarily the full error.
+    virtual double computeErrorForCostBounded(CurvePrimitiveConstPtr curve, int from, int to, double /*cutoff*/,
+                                              bool firstToEndpoint = true, bool lastToEndpoint = true, bool reversed = false) const
+    { return computeErrorForCost(curve, from, to, firstToEndpoint, lastToEndpoint, reversed); }
+    //Like computeErrorForCostBounded, for a sequence of candidates that grow at the end over samples starting at from.
+    //On input, inOutParams holds the projection parameters of the previous candidate's samples (empty for the first
+    //candidate), which are used to warm-start the projections onto this curve.  On output, it holds this curve's.
+    virtual double computeErrorForCostIncremental(CurvePrimitiveConstPtr curve, int from, int to, double cutoff, Eigen::VectorXd &inOutParams) const
+    { inOutParams.resize(0); return computeErrorForCostBounded(curve, from, to, cutoff); }
+
+    virtual size_t memoryUsage() const { return sizeof(*this); } //estimated, in bytes
 };
 
 CORNU_SMART_TYPEDEFS(ErrorComputer);
+CORNU_SMART_FORW_DECL(Polyline);
+
+//A candidate primitive for ErrorBackend: the curve and the first and last samples it covers
+struct ErrorCandidate
+{
+    CurvePrimitiveConstPtr curve;
+    int from, to;
+};
+
+/*
+    Evaluates the errors of batches of candidate primitives for the primitive fitter, when
+    Parameters::ERROR_BATCH_SIZE is above one.  A batch is every candidate fit from a start point over the next
+    several end points, so an application with a GPU can evaluate it as one kernel over (candidate, sample) pairs,
+    and passes its backend to Fitter::setErrorBackend.  cpu(), the default, calls the fit's ErrorComputer for one
+    candidate at a time and is the reference: a backend's error for a candidate must match
+    computeErrorForCostBounded's with the same cutoff up to rounding, except that any value above the cutoff will
+    do when the error is above it.  The samples are the fit's resampled polyline.  Called from several threads at
+    once when the fit is multithreaded.
+*/
+class ErrorBackend
+{
+public:
+    virtual ~ErrorBackend() {}
+
+    virtual void computeErrorsForCost(const ErrorComputer &errorComputer, const Polyline &samples,
+                                      const ErrorCandidate *candidates, int count, double cutoff, double *outErrors) = 0;
+
+    static ErrorBackend &cpu();
+};
 
 template<>
 struct AlgorithmOutput<ERROR_COMPUTER> : public AlgorithmOutputBase
 {
     ErrorComputerConstPtr errorComputer;
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
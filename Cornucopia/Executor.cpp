@@ -0,0 +1,85 @@
+/*--
+    Executor.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Executor.h"
+#include "FitMetrics.h"
+#include "Allocator.h"
+
+#include <exception>
+#include <mutex>
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+class SerialExecutor : public Executor
+{
+protected:
+    void _run(int count, const function<void(int)> &task)
+    {
+        for(int i = 0; i < count; ++i)
+            task(i);
+    }
+};
+
+Executor &Executor::serial()
+{
+    static SerialExecutor executor;
+    return executor;
+}
+
+void Executor::parallelFor(int count, const function<void(int)> &func)
+{
+    if(count <= 0)
+        return;
+    if(count == 1)
+    {
+        func(0);
+        return;
+    }
+
+    Debugging *debugging = Debugging::get(); //tasks use the caller's debugging context, metrics and allocator
+    FitMetrics *metrics = FitMetrics::current();
+    Allocator *allocator = &Allocator::current();
+    mutex errorMutex;
+    exception_ptr error;
+
+    _run(count, [&](int i)
+    {
+        try
+        {
+            Debugging::ThreadScope debuggingScope(debugging);
+            FitMetrics::ThreadScope metricsScope(metrics);
+            Allocator::ThreadScope allocatorScope(allocator);
+            func(i);
+        }
+        catch(...)
+        {
+            lock_guard<mutex> lock(errorMutex);
+            if(!error)
+                error = current_exception();
+        }
+    });
+
+    if(error)
+        rethrow_exception(error);
+}
+
+END_NAMESPACE_Cornu
@@ -0,0 +1,64 @@
+/*--
+    Executor.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_EXECUTOR_H_INCLUDED
+#define CORNUCOPIA_EXECUTOR_H_INCLUDED
+
+//Like SimpleAPI.h, this file has no dependencies, so that applications can implement executors without Eigen
+#include <functional>
+
+namespace Cornu
+{
+
+/*
+    Runs the library's parallel loops: those of the fitting stages when Parameters::MULTITHREADED is set, of the
+    pieces between corners, and of batch fits.  An application with its own scheduler (a TBB arena, a fiber
+    scheduler, ...) implements _run on top of it and passes the executor to Fitter::setExecutor or fitBatch, so
+    that the library doesn't start threads of its own.  ThreadPool is the built-in executor, and serial() runs
+    the loops on the calling thread.
+*/
+class Executor
+{
+public:
+    virtual ~Executor() {}
+
+    //Runs func(i) for every i in [0, count) and returns when all calls are done.  The calls use the caller's
+    //debugging object, fit metrics and allocator.  If any call throws, the first exception is rethrown after all
+    //calls finish.
+    void parallelFor(int count, const std::function<void(int)> &func);
+
+    //Starts the task and returns without waiting for it, e.g., for fitAsync.  The task must not throw.
+    void submit(const std::function<void()> &task) { _submit(task); }
+
+    static Executor &serial();
+
+protected:
+    //Runs task(i) for every i in [0, count), in any order and on any threads, including the calling one, and
+    //returns when all calls are done.  The task doesn't throw.  It may call _run again (through parallelFor), so
+    //a thread waiting for its calls to finish should keep running tasks rather than block a worker.
+    virtual void _run(int count, const std::function<void(int)> &task) = 0;
+
+    //By default, the task runs right away on the calling thread, which suits executors with nowhere else to run it
+    virtual void _submit(const std::function<void()> &task) { task(); }
+};
+
+} //end of namespace Cornu
+
+#endif //CORNUCOPIA_EXECUTOR_H_INCLUDED
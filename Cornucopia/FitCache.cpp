@@ -0,0 +1,158 @@
+/*--
+    FitCache.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FitCache.h"
+#include "Fitter.h"
+#include "Polyline.h"
+#include "PrimitiveSequence.h"
+#include "Clothoid.h"
+#include "Algorithm.h"
+
+#include <functional>
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+FitCache::FitCache(size_t maxMemory)
+    : _maxMemory(maxMemory), _memoryUsage(0), _hits(0), _misses(0)
+{
+}
+
+PrimitiveSequenceConstPtr FitCache::fit(PolylineConstPtr sketch, const Parameters &params, vector<double> *outParameters)
+{
+    size_t hash = _hash(sketch, params);
+    _EntryList::iterator it = _find(hash, sketch, params);
+
+    if(it != _entries.end())
+    {
+        ++_hits;
+        _entries.splice(_entries.begin(), _entries, it); //mark as most recently used
+    }
+    else
+    {
+        ++_misses;
+
+        Fitter fitter;
+        fitter.setParams(params);
+        fitter.setOriginalSketch(sketch);
+        fitter.setLean(true);
+        fitter.run();
+
+        _entries.push_front(_Entry());
+        _Entry &entry = _entries.front();
+        entry.hash = hash;
+        entry.sketch = sketch;
+        entry.params = params;
+        entry.curve = fitter.finalOutput();
+        if(entry.curve)
+            entry.parameters = fitter.originalSketchToFinalParameters();
+
+        //rough estimate--the primitives are counted as clothoids, the largest type
+        entry.memory = sizeof(_Entry) + sketch->pts().size() * sizeof(Vector2d) + entry.parameters.size() * sizeof(double);
+        if(entry.curve)
+            entry.memory += entry.curve->primitives().size() * (sizeof(Clothoid) + sizeof(CurvePrimitiveConstPtr));
+
+        _index.insert(make_pair(hash, _entries.begin()));
+        _memoryUsage += entry.memory;
+    }
+
+    //copy the result out before evicting, in case the budget is smaller than this entry
+    const _Entry &entry = _entries.front();
+    PrimitiveSequenceConstPtr out = entry.curve;
+    if(outParameters)
+        *outParameters = entry.parameters;
+
+    _evict();
+    return out;
+}
+
+void FitCache::clear()
+{
+    _entries.clear();
+    _index.clear();
+    _memoryUsage = 0;
+}
+
+static void hashCombine(size_t &seed, size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+size_t FitCache::_hash(PolylineConstPtr sketch, const Parameters &params)
+{
+    hash<double> hashDouble;
+    size_t out = sketch->pts().circular();
+
+    for(int i = 0; i < sketch->pts().size(); ++i)
+    {
+        hashCombine(out, hashDouble(sketch->pts()[i][0]));
+        hashCombine(out, hashDouble(sketch->pts()[i][1]));
+    }
+
+    for(int i = 0; i < (int)Parameters::parameters().size(); ++i)
+        hashCombine(out, hashDouble(params.get(Parameters::parameters()[i].type)));
+    for(int i = 0; i < NUM_ALGORITHM_STAGES; ++i)
+        hashCombine(out, params.getAlgorithm(i));
+
+    return out;
+}
+
+FitCache::_EntryList::iterator FitCache::_find(size_t hash, PolylineConstPtr sketch, const Parameters &params)
+{
+    typedef unordered_multimap<size_t, _EntryList::iterator>::iterator IndexIterator;
+    pair<IndexIterator, IndexIterator> range = _index.equal_range(hash);
+
+    for(IndexIterator it = range.first; it != range.second; ++it)
+    {
+        const _Entry &entry = *(it->second);
+        if(entry.params != params)
+            continue;
+        if(entry.sketch == sketch ||
+           (entry.sketch->pts() == sketch->pts() && entry.sketch->pts().circular() == sketch->pts().circular()))
+            return it->second;
+    }
+
+    return _entries.end();
+}
+
+void FitCache::_evict()
+{
+    while(_memoryUsage > _maxMemory && !_entries.empty())
+    {
+        const _Entry &entry = _entries.back();
+
+        typedef unordered_multimap<size_t, _EntryList::iterator>::iterator IndexIterator;
+        pair<IndexIterator, IndexIterator> range = _index.equal_range(entry.hash);
+        for(IndexIterator it = range.first; it != range.second; ++it)
+        {
+            if(&*(it->second) == &entry)
+            {
+                _index.erase(it);
+                break;
+            }
+        }
+
+        _memoryUsage -= entry.memory;
+        _entries.pop_back();
+    }
+}
+
+END_NAMESPACE_Cornu
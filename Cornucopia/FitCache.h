@@ -0,0 +1,90 @@
+/*--
+    FitCache.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_FITCACHE_H_INCLUDED
+#define CORNUCOPIA_FITCACHE_H_INCLUDED
+
+#include "defs.h"
+#include "Parameters.h"
+#include "smart_ptr.h"
+
+#include <list>
+#include <unordered_map>
+
+NAMESPACE_Cornu
+
+CORNU_SMART_FORW_DECL(Polyline);
+CORNU_SMART_FORW_DECL(PrimitiveSequence);
+
+/*
+    Remembers the results of recent fits so that fitting the same sketch with the same parameters
+    again (undo/redo, re-exporting, identical strokes) does not rerun the pipeline.  Entries are keyed
+    on the sketch points and on the parameter values and algorithm choices.  When the estimated memory
+    used by the entries exceeds the budget, the least recently used ones are dropped.
+    Like the Fitter, a cache should only be used by one thread at a time.
+*/
+class FitCache
+{
+public:
+    explicit FitCache(size_t maxMemory = 64 * 1024 * 1024); //in bytes
+
+    //Returns the fit of the sketch (null if fitting failed), running a Fitter if the result is not cached.
+    //If outParameters is not null, it is set to the final curve parameter of each sketch point.
+    PrimitiveSequenceConstPtr fit(PolylineConstPtr sketch, const Parameters &params, std::vector<double> *outParameters = NULL);
+
+    size_t maxMemory() const { return _maxMemory; }
+    void setMaxMemory(size_t maxMemory) { _maxMemory = maxMemory; _evict(); }
+    size_t memoryUsage() const { return _memoryUsage; } //estimated
+    int numEntries() const { return (int)_entries.size(); }
+
+    int hits() const { return _hits; }
+    int misses() const { return _misses; }
+    void resetCounters() { _hits = _misses = 0; }
+
+    void clear();
+
+private:
+    struct _Entry
+    {
+        size_t hash;
+        PolylineConstPtr sketch;
+        Parameters params;
+        PrimitiveSequenceConstPtr curve;
+        std::vector<double> parameters;
+        size_t memory;
+    };
+    typedef std::list<_Entry> _EntryList;
+
+    static size_t _hash(PolylineConstPtr sketch, const Parameters &params);
+    _EntryList::iterator _find(size_t hash, PolylineConstPtr sketch, const Parameters &params);
+    void _evict();
+
+    _EntryList _entries; //most recently used first
+    std::unordered_multimap<size_t, _EntryList::iterator> _index;
+
+    size_t _maxMemory;
+    size_t _memoryUsage;
+    int _hits;
+    int _misses;
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_FITCACHE_H_INCLUDED
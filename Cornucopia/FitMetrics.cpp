@@ -0,0 +1,59 @@
+/*--
+    FitMetrics.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FitMetrics.h"
+
+using namespace std;
+NAMESPACE_Cornu
+
+thread_local FitMetrics *FitMetrics::_threadMetrics = NULL;
+
+FitMetrics &FitMetrics::operator=(const FitMetrics &other)
+{
+    for(int i = 0; i < NUM_ALGORITHM_STAGES; ++i)
+        _stageTimes[i] = other._stageTimes[i];
+    _totalTime = other._totalTime;
+    for(int i = 0; i < NUM_COUNTERS; ++i)
+        _counters[i].store(other.counter((Counter)i), memory_order_relaxed);
+    _liveBytes.store(other._liveBytes.load(memory_order_relaxed), memory_order_relaxed);
+    _peakBytes.store(other.peakBytes(), memory_order_relaxed);
+    return *this;
+}
+
+void FitMetrics::clear()
+{
+    for(int i = 0; i < NUM_ALGORITHM_STAGES; ++i)
+        _stageTimes[i] = 0.;
+    _totalTime = 0.;
+    for(int i = 0; i < NUM_COUNTERS; ++i)
+        _counters[i].store(0, memory_order_relaxed);
+    _liveBytes.store(0, memory_order_relaxed);
+    _peakBytes.store(0, memory_order_relaxed);
+}
+
+const char *FitMetrics::counterName(Counter counter)
+{
+    static const char *names[NUM_COUNTERS] = { "candidate_primitives", "graph_vertices", "graph_edges", "edge_validations",
+                                               "edge_invalidations", "path_finder_iterations", "solver_iterations",
+                                               "solver_halvings", "deadline_stops", "allocator_bytes" };
+    return names[counter];
+}
+
+END_NAMESPACE_Cornu
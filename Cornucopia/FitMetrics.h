@@ -0,0 +1,122 @@
+/*--
+    FitMetrics.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_FITMETRICS_H_INCLUDED
+#define CORNUCOPIA_FITMETRICS_H_INCLUDED
+
+#include "defs.h"
+#include "Algorithm.h"
+
+#include <atomic>
+
+NAMESPACE_Cornu
+
+/*
+    Measurements of a Fitter::run: the wall time of each stage that ran, from a monotonic clock, and
+    counts of the work done.  Stages add to the counters with FitMetrics::count, which goes to the
+    metrics of the fit running on the calling thread (ThreadPool tasks use their caller's), so the
+    counts are right when fits run concurrently.
+*/
+class FitMetrics
+{
+public:
+    enum Counter
+    {
+        CANDIDATE_PRIMITIVES, //fit by the primitive fitter, i.e., potential graph vertices
+        GRAPH_VERTICES, //not pruned
+        GRAPH_EDGES,
+        EDGE_VALIDATIONS, //edges whose cost the path finder validated by combining their curves
+        EDGE_INVALIDATIONS, //validated edges that turned out more expensive than predicted, each forcing another search
+        PATH_FINDER_ITERATIONS, //shortest path searches, each followed by validating the path found
+        SOLVER_ITERATIONS, //of the least squares solver, in every stage
+        SOLVER_HALVINGS, //step halvings, or rejected steps with adaptive damping
+        DEADLINE_STOPS, //searches and solves cut short by the fitter's time budget
+        ALLOCATOR_BYTES, //through the fit's Allocator, in total (see Allocator.h)
+        NUM_COUNTERS //must be last
+    };
+
+    FitMetrics() { clear(); }
+    FitMetrics(const FitMetrics &other) { *this = other; }
+    FitMetrics &operator=(const FitMetrics &other);
+
+    void clear();
+
+    double stageTime(AlgorithmStage stage) const { return _stageTimes[stage]; } //in seconds, zero if the stage didn't run
+    double totalTime() const { return _totalTime; } //in seconds
+    long long counter(Counter counter) const { return _counters[counter].load(std::memory_order_relaxed); }
+    bool truncated() const { return counter(DEADLINE_STOPS) > 0; } //if the time budget ran out and the result may be worse
+    double invalidationRate() const //the fraction of edge validations where the predicted cost was too low
+    { return counter(EDGE_VALIDATIONS) ? double(counter(EDGE_INVALIDATIONS)) / counter(EDGE_VALIDATIONS) : 0.; }
+
+    //the most bytes the fit had allocated and not yet freed at any one time, not counting what it freed that was
+    //allocated before it started
+    long long peakBytes() const { return _peakBytes.load(std::memory_order_relaxed); }
+
+    static const char *counterName(Counter counter); //e.g., "graph_edges", for exporting
+
+    //adds to the counter of the metrics current on the calling thread, if there are any
+    static void count(Counter counter, long long amount = 1)
+    { if(_threadMetrics) _threadMetrics->_counters[counter].fetch_add(amount, std::memory_order_relaxed); }
+
+    //called by allocateBytes and freeBytes for the metrics current on the calling thread
+    static void countAllocation(long long bytes)
+    {
+        if(!_threadMetrics)
+            return;
+        _threadMetrics->_counters[ALLOCATOR_BYTES].fetch_add(bytes, std::memory_order_relaxed);
+        long long live = _threadMetrics->_liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        long long peak = _threadMetrics->_peakBytes.load(std::memory_order_relaxed);
+        while(live > peak && !_threadMetrics->_peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    }
+    static void countDeallocation(long long bytes)
+    { if(_threadMetrics) _threadMetrics->_liveBytes.fetch_sub(bytes, std::memory_order_relaxed); }
+
+    static FitMetrics *current() { return _threadMetrics; } //on the calling thread, may be null
+
+    //While a ThreadScope exists, FitMetrics::count on its thread adds to the given metrics (not owned).
+    class ThreadScope
+    {
+    public:
+        ThreadScope(FitMetrics *metrics) : _previous(_threadMetrics) { _threadMetrics = metrics; }
+        ~ThreadScope() { _threadMetrics = _previous; }
+
+    private:
+        ThreadScope(const ThreadScope &);
+        ThreadScope &operator=(const ThreadScope &);
+
+        FitMetrics *_previous;
+    };
+
+private:
+    friend class Fitter;
+    friend class SnapshotWriter;
+    friend class SnapshotReader;
+
+    double _stageTimes[NUM_ALGORITHM_STAGES];
+    double _totalTime;
+    std::atomic<long long> _counters[NUM_COUNTERS];
+    std::atomic<long long> _liveBytes, _peakBytes; //live may go negative when the fit frees older memory
+
+    static thread_local FitMetrics *_threadMetrics;
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_FITMETRICS_H_INCLUDED
@@ -22,55 +22,499 @@
 #include "Preprocessing.h"
 #include "Polyline.h"
 #include "Resampler.h"
+#include "Oversketcher.h"
+#include "ErrorComputer.h"
+#include "PrimitiveFitter.h"
+#include "GraphConstructor.h"
+#include "PathFinder.h"
 #include "Combiner.h"
+#include "PiecewiseLinearUtils.h"
 #include "PrimitiveSequence.h"
+#include "Trace.h"
+#include "Snapshot.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <sstream>
 
 using namespace std;
 using namespace Eigen;
 NAMESPACE_Cornu
 
-void Fitter::run()
+void Fitter::run(AlgorithmStage through)
 {
-    Debugging::get()->clear();
-    Debugging::get()->printf("============= Starting =============");
-    Debugging::get()->drawCurve(_originalSketch, Vector3d(0, 0, 0), "Original Sketch", 2., Debugging::DOTTED);
-    Debugging::get()->startTiming("Total");
+    typedef chrono::steady_clock Clock;
 
-    for(int i = 0; i < NUM_ALGORITHM_STAGES; ++i)
+    CORNU_TRACE_SCOPE("Fitter::run");
+    Debugging::ThreadScope debuggingScope(_debugging);
+    Allocator::ThreadScope allocatorScope(_allocator);
+    _metrics.clear();
+    FitMetrics::ThreadScope metricsScope(&_metrics);
+    Clock::time_point runStart = Clock::now();
+    _deadline = Clock::time_point::max();
+    if(_timeBudget > 0.)
+        _deadline = runStart + chrono::duration_cast<Clock::duration>(chrono::duration<double>(_timeBudget));
+
+    CORNU_DEBUG(clear());
+    CORNU_DEBUG(printf("============= Starting ============="));
+    CORNU_DEBUG(drawCurve(_originalSketch, Vector3d(0, 0, 0), "Original Sketch", 2., Debugging::DOTTED));
+    CORNU_DEBUG(startTiming("Total"));
+
+    //released outputs only need to be recomputed if some stage has to run anyway
+    bool anyInvalid = false;
+    for(int i = 0; i <= through; ++i)
+        anyInvalid = anyInvalid || (!_outputs[i] && !_released[i]);
+
+    for(int i = 0; i <= through && anyInvalid && !cancelled(); ++i)
     {
+        _peakMemoryUsage[i] = 0;
         if(!(_outputs[i]))
         {
-            std::string stageName = AlgorithmBase::get((AlgorithmStage)i, 0)->stageName();
-            Debugging::get()->startTiming(stageName);
-            _runStage((AlgorithmStage)i);
-            if(Debugging::get()->getTimeElapsed(stageName) > 0.001) //only print significant times
-                Debugging::get()->elapsedTime(stageName);
+            std::string stageName; //only needed for output
+            if(CORNU_DEBUGGING_ON || Trace::enabled())
+                stageName = AlgorithmBase::get((AlgorithmStage)i, 0)->stageName();
+            CORNU_DEBUG(startTiming(stageName));
+            Clock::time_point stageStart = Clock::now();
+            {
+                CORNU_TRACE_SCOPE(stageName);
+                bool split = i == PRIMITIVE_FITTING && _params.get(Parameters::SPLIT_AT_CORNERS) != 0. && _fitPieces();
+                if(!split && !cancelled())
+                    _runStage((AlgorithmStage)i);
+            }
+            _metrics._stageTimes[i] = chrono::duration<double>(Clock::now() - stageStart).count();
+            if(cancelled()) //the stage may have been cut short, so it runs again next time
+            {
+                _outputs[i] = AlgorithmOutputBasePtr();
+                break;
+            }
+            if(_metrics._stageTimes[i] > 0.001) //only print significant times
+                CORNU_DEBUG(elapsedTime(stageName));
+
+            for(int j = 0; j <= i; ++j)
+                if(_outputs[j])
+                    _peakMemoryUsage[i] += _outputs[j]->memoryUsage();
+            if(_lean)
+                _releaseUnneeded((AlgorithmStage)i);
         }
     }
-    Debugging::get()->elapsedTime("Total");
+    _metrics._totalTime = chrono::duration<double>(Clock::now() - runStart).count();
+    CORNU_DEBUG(elapsedTime("Total"));
 
-    if(Debugging::get()->isDebuggingOn() && finalOutput())
+    if(!_captureDirectory.empty() && !cancelled() && _slowRun())
+        _captureRun();
+
+    if(CORNU_DEBUGGING_ON && finalOutput())
     {
         // Now output some the final curve and a normal field for debugging
         PrimitiveSequenceConstPtr out = finalOutput();
         for(int i = 0; i < out->primitives().size(); ++i)
         {
-            Debugging::get()->drawPrimitive(out->primitives()[i], "Final Result Color", i, 3.);
-            Debugging::get()->drawCurve(out->primitives()[i], Vector3d(0, 0, 0), "Final Result");
-            Debugging::get()->drawCurvatureField(out->primitives()[i], Vector3d(1, 0, 0), "Normal Field");
+            CORNU_DEBUG(drawPrimitive(out->primitives()[i], "Final Result Color", i, 3.));
+            CORNU_DEBUG(drawCurve(out->primitives()[i], Vector3d(0, 0, 0), "Final Result"));
+            CORNU_DEBUG(drawCurvatureField(out->primitives()[i], Vector3d(1, 0, 0), "Normal Field"));
+        }
+    }
+}
+
+static const char snapshotTag[8] = { 'C', 'o', 'r', 'n', 'u', 'S', 'n', 'p' };
+static const int snapshotVersion = 4;
+
+bool Fitter::writeSnapshot(std::ostream &out, AlgorithmStage stage) const
+{
+    for(int i = 0; i < stage; ++i)
+        if(!_outputs[i])
+            return false;
+
+    SnapshotWriter writer(out);
+    out.write(snapshotTag, sizeof(snapshotTag));
+    writer.writeInt(snapshotVersion);
+    writer.writeInt(stage);
+    writer.writeParameters(_params);
+    writer.writePolyline(_originalSketch);
+    writer.writeCurves(_oversketchBase);
+    writer.writeMetrics(_metrics);
+    for(int i = 0; i < stage; ++i)
+        _outputs[i]->write(writer);
+    return writer.ok();
+}
+
+bool Fitter::loadSnapshot(std::istream &in)
+{
+    reset();
+
+    char tag[sizeof(snapshotTag)];
+    if(!in.read(tag, sizeof(tag)) || memcmp(tag, snapshotTag, sizeof(tag)))
+        return false;
+    SnapshotReader reader(in);
+    int version = reader.readInt();
+    int stage = reader.readInt();
+    if(version != snapshotVersion || stage < 0 || stage >= NUM_ALGORITHM_STAGES)
+        return false;
+
+    Parameters params = _params;
+    reader.readParameters(params);
+    PolylineConstPtr originalSketch = reader.readPolyline();
+    PrimitiveSequenceConstPtr oversketchBase = reader.readCurves();
+    FitMetrics metrics;
+    reader.readMetrics(metrics);
+    if(!reader.ok() || !originalSketch)
+        return false;
+    setParams(params);
+    _originalSketch = originalSketch;
+    _oversketchBase = oversketchBase;
+    _metrics = metrics;
+
+    //each output may build parts of itself from the ones before it
+    for(int i = 0; i < stage && reader.ok(); ++i)
+    {
+        AlgorithmOutputBasePtr output = AlgorithmBase::get((AlgorithmStage)i, _params.getAlgorithm(i))->newOutput();
+        output->read(reader, *this);
+        _outputs[i] = output;
+    }
+
+    if(!reader.ok())
+    {
+        reset();
+        return false;
+    }
+    return true;
+}
+
+AlgorithmStage Fitter::_firstAffectedStage(const Parameters &oldParams, const Parameters &newParams)
+{
+    AlgorithmStage firstAffected = (AlgorithmStage)Parameters::firstAffectedStage(oldParams, newParams);
+    //when fitting pieces separately, primitive fitting through path finding run together
+    if(newParams.get(Parameters::SPLIT_AT_CORNERS) != 0. && firstAffected > PRIMITIVE_FITTING && firstAffected < COMBINING)
+        firstAffected = PRIMITIVE_FITTING;
+    return firstAffected;
+}
+
+void Fitter::setParams(const Parameters &params)
+{
+    AlgorithmStage firstAffected = _firstAffectedStage(_params, params);
+    _params = params;
+    _clearBefore(firstAffected);
+}
+
+Executor &Fitter::executor() const
+{
+    return _executor ? *_executor : ThreadPool::global();
+}
+
+ErrorBackend &Fitter::errorBackend() const
+{
+    return _errorBackend ? *_errorBackend : ErrorBackend::cpu();
+}
+
+Fitter Fitter::fork(const Parameters &params) const
+{
+#ifdef CORNUCOPIA_ATOMIC_REFCOUNT
+    return _fork(params, true);
+#else
+    return _fork(params, false);
+#endif
+}
+
+Fitter Fitter::_fork(const Parameters &params, bool share) const
+{
+    Fitter out;
+    AlgorithmStage firstAffected = _firstAffectedStage(_params, params);
+    if(share)
+    {
+        out._originalSketch = _originalSketch;
+        out._oversketchBase = _oversketchBase;
+        out._params = params;
+        for(int i = 0; i < firstAffected; ++i)
+        {
+            out._outputs[i] = _outputs[i];
+            out._released[i] = _released[i];
         }
     }
+    else
+    {
+        //The sketch and the outputs go through a snapshot, so the fork has no pointers in common with this fitter.
+        //Outputs released in lean mode can't be copied, so the fork runs their stages and the ones after them again.
+        int numCopied = 0;
+        while(numCopied < firstAffected && _outputs[numCopied])
+            ++numCopied;
+        stringstream snapshot;
+        if(_originalSketch && writeSnapshot(snapshot, (AlgorithmStage)numCopied) && out.loadSnapshot(snapshot))
+            out._metrics = FitMetrics();
+        out.setParams(params);
+    }
+    out._debugging = _debugging;
+    out._executor = _executor;
+    out._allocator = _allocator;
+    out._errorBackend = _errorBackend;
+    out._cancel = _cancel;
+    out._timeBudget = _timeBudget;
+    out._lean = _lean;
+    out._captureDirectory = _captureDirectory;
+    out._captureTotalSeconds = _captureTotalSeconds;
+    out._captureStageSeconds = _captureStageSeconds;
+
+    if(firstAffected > PRIMITIVE_FITTING && !_currentPath(out._previousPath))
+        out._previousPath = _previousPath;
+    return out;
+}
+
+bool Fitter::_slowRun() const
+{
+    if(_captureTotalSeconds > 0. && _metrics.totalTime() > _captureTotalSeconds)
+        return true;
+    for(int i = 0; i < NUM_ALGORITHM_STAGES; ++i)
+        if(_captureStageSeconds > 0. && _metrics.stageTime((AlgorithmStage)i) > _captureStageSeconds)
+            return true;
+    return false;
+}
+
+//The file names combine the wall clock time with a count, so that captures by fitters in this process and others
+//don't overwrite each other.  The manifest is appended to under a lock, as fitters on several threads may capture.
+void Fitter::_captureRun() const
+{
+    static mutex manifestMutex;
+    static atomic<int> numCaptures(0);
+
+    long long micros = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    ostringstream name;
+    name << "slow_" << micros << "_" << numCaptures++;
+    {
+        ofstream out((_captureDirectory + "/" + name.str() + ".snp").c_str(), ios::binary);
+        if(!out || !writeSnapshot(out, SCALE_DETECTION))
+            return;
+    }
+
+    lock_guard<mutex> lock(manifestMutex);
+    ofstream manifest((_captureDirectory + "/snapshots.txt").c_str(), ios::app);
+    manifest << name.str() << "\n";
 }
 
 void Fitter::_runStage(AlgorithmStage stage)
 {
-    _outputs[stage] = AlgorithmBase::get(stage, _params.getAlgorithm(stage))->run(*this);
+    _outputs[stage] = AlgorithmBase::get(stage, _params.getAlgorithm(stage))->run(*this, std::move(_recycled[stage]));
+    _released[stage] = false;
+}
+
+//Fits the pieces of the resampled curve between corners with a fitter each, from the error computer through path
+//finding, and joins their primitives, graphs, and paths into those of the whole curve, which the normal combiner
+//then turns into one curve.  No primitive spans a corner, so the pieces are fit as they would be in one graph--only
+//the paths can differ, because each is the best one for its piece given a G0 join at each end.  The time is counted
+//in the primitive fitting stage.  Returns false, leaving the outputs unset, if the curve has no corners to split at,
+//is an oversketch (the base curve would have to be joined to the pieces at its ends), or a piece couldn't be fit.
+bool Fitter::_fitPieces()
+{
+    typedef chrono::steady_clock Clock;
+
+    PolylineConstPtr poly = output<RESAMPLING>()->output;
+    const VectorC<bool> &corners = output<RESAMPLING>()->corners;
+    const VectorC<Vector2d> &pts = poly->pts();
+    bool closed = output<CURVE_CLOSING>()->closed;
+    if(_oversketchBase)
+        return false;
+
+    //piece i goes from sample bounds[i] through sample bounds[i + 1]
+    vector<int> bounds;
+    if(!closed)
+        bounds.push_back(0);
+    for(int i = closed ? 0 : 1; i < (closed ? pts.size() : pts.size() - 1); ++i)
+        if(corners[i])
+            bounds.push_back(i);
+    if(closed && !bounds.empty())
+        bounds.push_back(bounds[0] + pts.size());
+    else if(!closed)
+        bounds.push_back(pts.size() - 1);
+    int numPieces = (int)bounds.size() - 1;
+    if(numPieces < (closed ? 1 : 2))
+        return false;
+
+    vector<Fitter> pieces(numPieces);
+    for(int i = 0; i < numPieces; ++i)
+    {
+        int numPts = bounds[i + 1] - bounds[i] + 1;
+        VectorC<Vector2d> piecePts(numPts, NOT_CIRCULAR);
+        smart_ptr<AlgorithmOutput<RESAMPLING> > resampled = new AlgorithmOutput<RESAMPLING>();
+        resampled->corners = VectorC<bool>(numPts, NOT_CIRCULAR);
+        for(int j = 0; j < numPts; ++j)
+        {
+            piecePts[j] = pts[bounds[i] + j];
+            resampled->corners[j] = corners[bounds[i] + j];
+        }
+        resampled->output = new Polyline(std::move(piecePts));
+
+        //the stages after resampling only read these outputs
+        smart_ptr<AlgorithmOutput<CURVE_CLOSING> > closing = new AlgorithmOutput<CURVE_CLOSING>();
+        closing->output = resampled->output;
+        closing->closed = false;
+        smart_ptr<AlgorithmOutput<OVERSKETCHING> > oversketching = new AlgorithmOutput<OVERSKETCHING>();
+        oversketching->output = resampled->output;
+        oversketching->startContinuity = oversketching->endContinuity = 2;
+        oversketching->finallyClose = false;
+
+        Fitter &piece = pieces[i];
+        piece._params = _params;
+        piece._executor = _executor;
+        piece._allocator = _allocator;
+        piece._errorBackend = _errorBackend;
+        piece._cancel = _cancel;
+        piece._timeBudget = _timeBudget;
+        piece._deadline = _deadline;
+        piece._originalSketch = resampled->output;
+        //the pieces run in parallel, so each gets its own outputs rather than sharing (and counting references to) ours
+        smart_ptr<AlgorithmOutput<SCALE_DETECTION> > scale = new AlgorithmOutput<SCALE_DETECTION>();
+        scale->scale = output<SCALE_DETECTION>()->scale;
+        piece._outputs[SCALE_DETECTION] = scale;
+        piece._outputs[CURVE_CLOSING] = closing;
+        piece._outputs[OVERSKETCHING] = oversketching;
+        piece._outputs[RESAMPLING] = resampled;
+    }
+
+    //each piece has its own debugging (silenced, as its samples are numbered differently) and metrics
+    auto fitPiece = [&](int i)
+    {
+        Fitter &piece = pieces[i];
+        Debugging::ThreadScope debuggingScope(Debugging::silent());
+        FitMetrics::ThreadScope metricsScope(&piece._metrics);
+        for(int stage = ERROR_COMPUTER; stage < COMBINING && !piece.cancelled(); ++stage)
+        {
+            Clock::time_point stageStart = Clock::now();
+            piece._runStage((AlgorithmStage)stage);
+            piece._metrics._stageTimes[stage] = chrono::duration<double>(Clock::now() - stageStart).count();
+        }
+    };
+    if(_params.get(Parameters::MULTITHREADED) == 0.)
+    {
+        for(int i = 0; i < numPieces; ++i)
+            fitPiece(i);
+    }
+    else
+        executor().parallelFor(numPieces, fitPiece);
+
+    //the pieces' allocations are this fit's, with their peaks counted as if they came at once
+    long long liveBytes = _metrics._liveBytes.load(memory_order_relaxed), peakBytes = liveBytes;
+    for(int i = 0; i < numPieces; ++i)
+    {
+        const FitMetrics &metrics = pieces[i]._metrics;
+        FitMetrics::count(FitMetrics::ALLOCATOR_BYTES, metrics.counter(FitMetrics::ALLOCATOR_BYTES));
+        liveBytes += metrics._liveBytes.load(memory_order_relaxed);
+        peakBytes += metrics.peakBytes();
+    }
+    _metrics._liveBytes.store(liveBytes, memory_order_relaxed);
+    _metrics._peakBytes.store(max(peakBytes, _metrics.peakBytes()), memory_order_relaxed);
+
+    if(cancelled())
+        return false;
+    for(int i = 0; i < numPieces; ++i)
+        if(!pieces[i]._outputs[PATH_FINDING] || pieces[i].output<PATH_FINDING>()->path.empty())
+            return false;
+
+    //the samples of piece i are numbered from bounds[i] in the whole curve
+    smart_ptr<AlgorithmOutput<PRIMITIVE_FITTING> > primitives = new AlgorithmOutput<PRIMITIVE_FITTING>();
+    smart_ptr<AlgorithmOutput<GRAPH_CONSTRUCTION> > graph = new AlgorithmOutput<GRAPH_CONSTRUCTION>();
+    smart_ptr<AlgorithmOutput<PATH_FINDING> > path = new AlgorithmOutput<PATH_FINDING>();
+    vector<const AlgorithmOutput<GRAPH_CONSTRUCTION> *> pieceGraphs(numPieces);
+    vector<const vector<int> *> piecePaths(numPieces);
+    path->numValidations = 0;
+    for(int i = 0; i < numPieces; ++i)
+    {
+        const vector<FitPrimitive> &piecePrimitives = pieces[i].output<PRIMITIVE_FITTING>()->primitives;
+        for(int j = 0; j < (int)piecePrimitives.size(); ++j)
+        {
+            primitives->primitives.push_back(piecePrimitives[j]);
+            FitPrimitive &primitive = primitives->primitives.back();
+            primitive.startIdx = pts.toLinearIdx(primitive.startIdx + bounds[i]);
+            primitive.endIdx = pts.toLinearIdx(primitive.endIdx + bounds[i]);
+        }
+        pieceGraphs[i] = pieces[i].output<GRAPH_CONSTRUCTION>().get();
+        piecePaths[i] = &pieces[i].output<PATH_FINDING>()->path;
+        path->numValidations += pieces[i].output<PATH_FINDING>()->numValidations;
+
+        for(int c = 0; c < FitMetrics::NUM_COUNTERS; ++c)
+            FitMetrics::count((FitMetrics::Counter)c, pieces[i].metrics().counter((FitMetrics::Counter)c));
+    }
+
+    primitives->updateColumns();
+    _outputs[PRIMITIVE_FITTING] = primitives; //the graph's cost evaluator reads them
+    graph->joinPieces(*this, pieceGraphs, piecePaths, path->path);
+    _outputs[GRAPH_CONSTRUCTION] = graph;
+    _outputs[PATH_FINDING] = path;
+    _released[PRIMITIVE_FITTING] = _released[GRAPH_CONSTRUCTION] = _released[PATH_FINDING] = false;
+    return true;
+}
+
+void Fitter::reset()
+{
+    _originalSketch = PolylineConstPtr();
+    _oversketchBase = PrimitiveSequenceConstPtr();
+    _clearBefore(SCALE_DETECTION);
 }
 
 void Fitter::_clearBefore(AlgorithmStage stage)
 {
+    _alternativeOutputs.clear();
+    if(stage <= PRIMITIVE_FITTING)
+        _previousPath.clear();
+    else if(stage <= PATH_FINDING)
+        _currentPath(_previousPath);
+
     for(int i = stage; i < NUM_ALGORITHM_STAGES; ++i)
-        _outputs[i] = AlgorithmOutputBasePtr();
+    {
+        if(_outputs[i])
+            _recycled[i] = std::move(_outputs[i]);
+        _released[i] = false;
+    }
+}
+
+//the path of the last run in terms of primitives, if it and the graph it goes through are available
+bool Fitter::_currentPath(vector<PathEdge> &out) const
+{
+    smart_ptr<const AlgorithmOutput<GRAPH_CONSTRUCTION> > graph = output<GRAPH_CONSTRUCTION>();
+    smart_ptr<const AlgorithmOutput<PATH_FINDING> > path = output<PATH_FINDING>();
+    if(!graph || !path || path->path.empty())
+        return false;
+
+    out.resize(path->path.size());
+    for(int i = 0; i < (int)path->path.size(); ++i)
+    {
+        int edge = path->path[i];
+        PathEdge pathEdge = { graph->edgeStart[edge], graph->edgeEnd[edge], graph->edgeContinuity[edge] };
+        out[i] = pathEdge;
+    }
+    return true;
+}
+
+//Releases the outputs that no stage after lastRun reads.  Some outputs keep references into earlier ones (the error
+//computer into the resampled points, the graph's cost evaluator into the primitives and corners), so those are
+//released together.
+void Fitter::_releaseUnneeded(AlgorithmStage lastRun)
+{
+    static const int lastReader[NUM_ALGORITHM_STAGES] =
+    {
+        NUM_ALGORITHM_STAGES, //SCALE_DETECTION: scale() is used throughout and by callers
+        CURVE_CLOSING,        //PRELIM_RESAMPLING
+        COMBINING,            //CURVE_CLOSING
+        COMBINING,            //OVERSKETCHING
+        RESAMPLING,           //CORNER_DETECTION
+        COMBINING,            //RESAMPLING
+        COMBINING,            //ERROR_COMPUTER
+        COMBINING,            //PRIMITIVE_FITTING
+        COMBINING,            //GRAPH_CONSTRUCTION
+        COMBINING,            //PATH_FINDING
+        NUM_ALGORITHM_STAGES  //COMBINING: the final output
+    };
+
+    for(int i = 0; i < NUM_ALGORITHM_STAGES; ++i)
+    {
+        if(_outputs[i] && lastReader[i] <= lastRun)
+        {
+            _outputs[i] = AlgorithmOutputBasePtr();
+            _released[i] = true;
+        }
+    }
 }
 
 double Fitter::scale() const
@@ -85,12 +529,45 @@ double Fitter::scaledParameter(Parameters::ParameterType param) const
 
 PrimitiveSequenceConstPtr Fitter::finalOutput() const
 {
+    if(!_outputs[COMBINING]) //cancelled
+        return PrimitiveSequenceConstPtr();
     return output<COMBINING>()->output;
 }
 
+int Fitter::numAlternatives() const
+{
+    smart_ptr<const AlgorithmOutput<PATH_FINDING> > paths = output<PATH_FINDING>();
+    if(!paths || paths->path.empty())
+        return 0;
+    return 1 + (int)paths->alternatives.size();
+}
+
+PrimitiveSequenceConstPtr Fitter::alternativeOutput(int alternative) const
+{
+    if(alternative == 0)
+        return finalOutput();
+    if(alternative < 0 || alternative >= numAlternatives())
+        return PrimitiveSequenceConstPtr();
+
+    _alternativeOutputs.resize(numAlternatives());
+    if(!_alternativeOutputs[alternative])
+    {
+        smart_ptr<AlgorithmOutput<PATH_FINDING> > path = new AlgorithmOutput<PATH_FINDING>();
+        path->path = output<PATH_FINDING>()->alternatives[alternative - 1];
+        path->numValidations = 0;
+
+        Fitter combiner = _fork(_params, true); //on this thread, so it can share everything
+        combiner._outputs[PATH_FINDING] = path;
+        combiner._outputs[COMBINING] = AlgorithmOutputBasePtr();
+        combiner.run();
+        _alternativeOutputs[alternative] = combiner.finalOutput();
+    }
+    return _alternativeOutputs[alternative];
+}
+
 const vector<double> &Fitter::originalSketchToFinalParameters() const
 {
-    return output<COMBINING>()->parameters;
+    return output<COMBINING>()->parameters->values();
 }
 
 
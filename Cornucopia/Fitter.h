@@ -24,19 +24,44 @@
 #include "defs.h"
 #include "Parameters.h"
 #include "Algorithm.h"
+#include "FitMetrics.h"
+#include "Executor.h"
+#include "Allocator.h"
+
+#include <atomic>
+#include <chrono>
+#include <iosfwd>
 
 NAMESPACE_Cornu
 
 CORNU_SMART_FORW_DECL(Polyline);
 CORNU_SMART_FORW_DECL(PrimitiveSequence);
+class ErrorBackend;
 
 class Fitter
 {
 public:
-    Fitter() : _outputs(NUM_ALGORITHM_STAGES) {}
+    Fitter() : _debugging(NULL), _executor(NULL), _allocator(NULL), _errorBackend(NULL), _cancel(NULL), _timeBudget(0.), _lean(false),
+        _captureTotalSeconds(0.), _captureStageSeconds(0.), _outputs(NUM_ALGORITHM_STAGES), _released(NUM_ALGORITHM_STAGES, false),
+        _recycled(NUM_ALGORITHM_STAGES), _peakMemoryUsage(NUM_ALGORITHM_STAGES, 0) {}
+
+    //Gets the fitter ready for a new sketch, keeping the parameters.  Outputs that are invalidated (by this or by
+    //changing the inputs or parameters) are kept, if nothing else points to them, and reused by the next run of
+    //their stage, so the containers in them don't have to be allocated again.  Outputs released in lean mode are not.
+    void reset();
 
     const Parameters &params() const { return _params; }
-    void setParams(const Parameters &params) { _params = params; _clearBefore(SCALE_DETECTION); }
+    void setParams(const Parameters &params); //only invalidates the stages that depend on what changed
+
+    //Returns a fitter for the same sketch and oversketch base, but with the given parameters, that starts with this
+    //one's outputs of the stages those parameters don't affect, e.g., to fit a sketch under many parameter variants
+    //with the stages before the first one they differ in run once.  The fork and this fitter can run on different
+    //threads: the outputs are copied (through a snapshot, see writeSnapshot), since copying smart pointers to them
+    //from several threads would race on their reference counts, unless the library is built with
+    //CORNUCOPIA_ATOMIC_REFCOUNT, in which case they are shared--outputs don't change once their stage has run and
+    //shared ones aren't recycled.  The debugging object, executor, allocator, error backend, cancel flag, time
+    //budget, lean mode and slow fit capture are copied.
+    Fitter fork(const Parameters &params) const;
 
     PolylineConstPtr originalSketch() const { return _originalSketch; }
     void setOriginalSketch(PolylineConstPtr originalSketch) { _originalSketch = originalSketch; _clearBefore(SCALE_DETECTION); }
@@ -44,29 +69,146 @@ public:
     PrimitiveSequenceConstPtr oversketchBase() const { return _oversketchBase; }
     void setOversketchBase(PrimitiveSequenceConstPtr oversketchBase) { _oversketchBase = oversketchBase; _clearBefore(SCALE_DETECTION); }
 
+    //an edge of a path through the fitted primitives: the indices of the two it joins and their continuity
+    struct PathEdge
+    {
+        int start, end, continuity;
+    };
+
+    //A path found by an earlier run over the same primitives.  The path finder validates it under the current costs
+    //first and uses its cost as an upper bound, so it spends no validations on paths that can't be cheaper.  When a
+    //change, e.g., of a cost parameter, invalidates the path but not the primitives, the old path is kept here, and
+    //forks that share the primitives start with this fitter's path.  Changing the primitives clears it.  A path
+    //that doesn't fit the graph (some edge is missing or it doesn't connect the ends) is ignored.
+    const std::vector<PathEdge> &previousPath() const { return _previousPath; }
+    void setPreviousPath(const std::vector<PathEdge> &path) { _previousPath = path; }
+
+    //The debugging object used while this fitter runs (not owned).  If null, the global one is used.
+    //Setting a separate one per fitter allows fitting on several threads at once.
+    Debugging *debugging() const { return _debugging; }
+    void setDebugging(Debugging *debugging) { _debugging = debugging; }
+
+    //The executor that runs the parallel loops of the stages when Parameters::MULTITHREADED is set (not owned).
+    //If null, the global ThreadPool is used.
+    Executor &executor() const;
+    void setExecutor(Executor *executor) { _executor = executor; }
+
+    //The allocator that the stage outputs, the primitives and the other objects and arrays made while this fitter
+    //runs come from (not owned), e.g., an arena per fit or one that throws past a memory budget, which run() passes
+    //on.  If null, Allocator::global() is used.  It must outlive everything allocated from it, including the
+    //outputs it keeps.  metrics() has the bytes allocated and their peak.
+    Allocator *allocator() const { return _allocator; }
+    void setAllocator(Allocator *allocator) { _allocator = allocator; }
+
+    //What evaluates the primitive fitter's candidates in batches when Parameters::ERROR_BATCH_SIZE is above one,
+    //e.g., on a GPU (not owned).  If null, ErrorBackend::cpu() is used.
+    ErrorBackend &errorBackend() const;
+    void setErrorBackend(ErrorBackend *errorBackend) { _errorBackend = errorBackend; }
+
+    //In lean mode, each stage's output is released as soon as no later stage needs it, so after a run only the
+    //final output and the scale detection output remain and output() returns null for the others.  Released
+    //outputs are recomputed if a later run needs them.
+    bool lean() const { return _lean; }
+    void setLean(bool lean) { _lean = lean; }
+
+    //If the flag (not owned, may be null) is set while run() is going, e.g., from another thread, run() returns
+    //after the current stage.  The stages that didn't run are left invalid, so the next run() picks up from there.
+    //The path finder and the combiner's solver also check it, and a stage they cut short is left invalid as well.
+    void setCancelFlag(const std::atomic<bool> *cancel) { _cancel = cancel; }
+    const std::atomic<bool> *cancelFlag() const { return _cancel; }
+    bool cancelled() const { return _cancel && _cancel->load(std::memory_order_relaxed); }
+
+    //If positive, run() aims to finish within this many seconds: once they are up, the path finder returns the last
+    //path it found and the combiner's solver stops at its best iterate, and metrics().truncated() is true.  The
+    //other stages aren't cut short, so a budget smaller than their time is overrun.  Truncated outputs stay valid.
+    double timeBudget() const { return _timeBudget; }
+    void setTimeBudget(double seconds) { _timeBudget = seconds; }
+    //the end of the current run's budget, or the maximum time point if there is no budget
+    std::chrono::steady_clock::time_point deadline() const { return _deadline; }
+    bool pastDeadline() const { return _timeBudget > 0. && std::chrono::steady_clock::now() > _deadline; }
+
+    //Opt-in capture of slow fits, so that ones seen in production can be reproduced: after a run that took more than
+    //totalSeconds, or in which some stage took more than stageSeconds (budgets that aren't positive are ignored),
+    //a snapshot taken before the first stage--the sketch, the oversketch base, the parameters and the run's metrics--
+    //is written to a new file in the directory, and its name is added to the directory's snapshots.txt, from which
+    //Benchmark -replay reruns it.  Replays run without a time budget.  An empty directory (the default) turns
+    //capturing off.  Files that can't be written are skipped.
+    void setSlowFitCapture(const std::string &directory, double totalSeconds, double stageSeconds = 0.)
+    { _captureDirectory = directory; _captureTotalSeconds = totalSeconds; _captureStageSeconds = stageSeconds; }
+    const std::string &slowFitCaptureDirectory() const { return _captureDirectory; }
+
+    //The estimated memory, in bytes, held by all stage outputs right after the given stage ran in the last run
+    //(0 if it didn't run)
+    size_t peakMemoryUsage(AlgorithmStage stage) const { return _peakMemoryUsage[stage]; }
+
+    //The stage times and work counts of the last run.  Stages whose outputs were still valid didn't run and
+    //count nothing.
+    const FitMetrics &metrics() const { return _metrics; }
+
     template<int AlgStage>
     smart_ptr<const AlgorithmOutput<AlgStage> > output() const
     {
         return static_pointer_cast<const AlgorithmOutput<AlgStage> >(_outputs[AlgStage]);
     }
 
-    void run();
-
-    PrimitiveSequenceConstPtr finalOutput() const; //returns null if fitting failed for some reason
-    const std::vector<double> &originalSketchToFinalParameters() const; //returns a vector that for each original sketch point has the final parameter value
+    //Runs the stages up to and including the given one that aren't valid, e.g., so that a stroke can be handed from
+    //thread to thread between groups of stages (see StrokePipeline.h)
+    void run(AlgorithmStage through = COMBINING);
+
+    //A snapshot holds the sketch, the oversketch base, the parameters, the metrics of the last run and the outputs of
+    //the stages before the given one, which must all be available (not released in lean mode).  Loading it replaces
+    //all of these, so the next run() starts at that stage with the inputs it had when the snapshot was written, and
+    //metrics() are those of the run before it until then.  Caches start empty.
+    //Both return false on failure, in which case loading leaves the fitter reset.
+    bool writeSnapshot(std::ostream &out, AlgorithmStage stage) const;
+    bool loadSnapshot(std::istream &in);
+
+    PrimitiveSequenceConstPtr finalOutput() const; //returns null if fitting failed for some reason or was cancelled
+
+    //Alternative fits of the sketch from the same graph, e.g., with more arcs or fewer corners, found by the path
+    //finder with Parameters::NUM_ALTERNATIVES above one (see AlgorithmOutput<PATH_FINDING>::alternatives).
+    //Alternative 0 is finalOutput(); each of the others is combined on its first request, by a fork that shares all
+    //other outputs with this fitter, and kept until the path changes.  In lean mode, the path finder's output is
+    //released, so there are no alternatives.  alternativeOutput returns null if there is no such alternative.
+    int numAlternatives() const;
+    PrimitiveSequenceConstPtr alternativeOutput(int alternative) const;
+    const std::vector<double> &originalSketchToFinalParameters() const; //returns a vector that for each original sketch point has the final parameter value (computed on the first call)
 
     double scale() const;  //returns the scale (pixel size * detected scale)
     double scaledParameter(Parameters::ParameterType param) const;
 
 private:
     void _runStage(AlgorithmStage stage);
+    bool _fitPieces();
     void _clearBefore(AlgorithmStage stage);
+    bool _currentPath(std::vector<PathEdge> &out) const;
+    Fitter _fork(const Parameters &params, bool share) const; //sharing the outputs is only safe on one thread
+    static AlgorithmStage _firstAffectedStage(const Parameters &oldParams, const Parameters &newParams);
+    void _releaseUnneeded(AlgorithmStage lastRun);
+    bool _slowRun() const;
+    void _captureRun() const;
 
     PrimitiveSequenceConstPtr _oversketchBase;
     PolylineConstPtr _originalSketch;
     Parameters _params;
+    Debugging *_debugging;
+    Executor *_executor;
+    Allocator *_allocator;
+    ErrorBackend *_errorBackend;
+    const std::atomic<bool> *_cancel;
+    double _timeBudget;
+    std::chrono::steady_clock::time_point _deadline;
+    bool _lean;
+    std::string _captureDirectory;
+    double _captureTotalSeconds, _captureStageSeconds;
 
     std::vector<AlgorithmOutputBasePtr> _outputs;
+    std::vector<bool> _released; //outputs that are missing only because of lean mode
+    std::vector<AlgorithmOutputBasePtr> _recycled;
+    std::vector<size_t> _peakMemoryUsage;
+    FitMetrics _metrics;
+    std::vector<PathEdge> _previousPath;
+    mutable std::vector<PrimitiveSequenceConstPtr> _alternativeOutputs;
 };
 
 END_NAMESPACE_Cornu
@@ -25,20 +25,27 @@ Copyright 1984, 1987, 1989, 2000 by Stephen L. Moshier
 */
 
 #include "Fresnel.h"
+#include "FresnelPacket.h"
 #include <vector>
 #include <iostream>
 
 using namespace std;
 using namespace Eigen;
 using namespace internal; //use Eigen's internal namespace for packet math
+
+//32-bit ARM has no double precision packets, so the double precision version is scalar there
+#if defined(EIGEN_VECTORIZE_SSE) || (defined(EIGEN_VECTORIZE_NEON) && defined(__aarch64__))
+#define CORNUCOPIA_FRESNEL_DOUBLE_PACKETS
+#endif
+
 NAMESPACE_Cornu
 
 //Polynomial evaluation routines
-template<typename Scalar>
-static Scalar polevl( const Scalar &x, const Matrix<Scalar, Dynamic, 1> &coefVec ) //regular
+template<typename Scalar, int N>
+static Scalar polevl( const Scalar &x, const Scalar (&coefs)[N] ) //regular
 {
-    int i = (int)coefVec.size() - 1;
-    const Scalar *coef = &(coefVec[0]);
+    int i = N - 1;
+    const Scalar *coef = coefs;
     Scalar ans = *coef++;
 
     do
@@ -49,11 +56,11 @@ static Scalar polevl( const Scalar &x, const Matrix<Scalar, Dynamic, 1> &coefVec
     return ans;
 }
 
-template<typename Scalar>
-static Scalar p1evl( const Scalar &x, const Matrix<Scalar, Dynamic, 1> &coefVec ) //leading coef is 1
+template<typename Scalar, int N>
+static Scalar p1evl( const Scalar &x, const Scalar (&coefs)[N] ) //leading coef is 1
 {
-    int i = (int)coefVec.size() - 1;
-    const Scalar *coef = &(coefVec[0]);
+    int i = N - 1;
+    const Scalar *coef = coefs;
 
     Scalar ans = x + *coef++;
 
@@ -67,158 +74,184 @@ static Scalar p1evl( const Scalar &x, const Matrix<Scalar, Dynamic, 1> &coefVec
 
 //==================Coefficients===========================
 
-//double precision rational coefficients for s, c, f, and g
-static VectorXd dsn(6), dsd(6);
-static VectorXd dcn(6), dcd(7);
-static VectorXd dfn(10), dfd(10);
-static VectorXd dgn(11), dgd(11);
-//single precision polynomial coefficients
-static VectorXf ssn(7);
-static VectorXf scn(7);
-static VectorXf sfn(8);
-static VectorXf sgn(8);
-//double precision polynomial coefficients
-static VectorXd dssn(7);
-static VectorXd dscn(7);
-static VectorXd dsfn(8);
-static VectorXd dsgn(8);
-
-struct InitCoefs
+//The coefficients are constant data, so they are in place before any code runs, no first call
+//pays for setting them up, and the Fresnel evaluations are safe to call from multiple threads.
+
+//double precision polynomial coefficients for the approximation
+static constexpr double dssn[7] =
 {
-    InitCoefs()
-    {
-        initPolynomial();
-        initRational();
-        ssn = dssn.cast<float>();
-        scn = dscn.cast<float>();
-        sfn = dsfn.cast<float>();
-        sgn = dsgn.cast<float>();
+    1.647629463788700E-009,
+    -1.522754752581096E-007,
+    8.424748808502400E-006,
+    -3.120693124703272E-004,
+    7.244727626597022E-003,
+    -9.228055941124598E-002,
+    5.235987735681432E-001
+};
+static constexpr double dscn[7] =
+{
+    1.416802502367354E-008,
+    -1.157231412229871E-006,
+    5.387223446683264E-005,
+    -1.604381798862293E-003,
+    2.818489036795073E-002,
+    -2.467398198317899E-001,
+    9.999999760004487E-001
+};
+static constexpr double dsfn[8] =
+{
+    -1.903009855649792E+012,
+    1.355942388050252E+011,
+    -4.158143148511033E+009,
+    7.343848463587323E+007,
+    -8.732356681548485E+005,
+    8.560515466275470E+003,
+    -1.032877601091159E+002,
+    2.999401847870011E+000
+};
+static constexpr double dsgn[8] =
+{
+    -1.860843997624650E+011,
+    1.278350673393208E+010,
+    -3.779387713202229E+008,
+    6.492611570598858E+006,
+    -7.787789623358162E+004,
+    8.602931494734327E+002,
+    -1.493439396592284E+001,
+    9.999841934744914E-001
+};
+
+//the approximation's coefficients again in single precision, and the double precision rational ones
+//(p1evl denominators leave out the leading 1), as plain arrays for the vectorized code too
+static constexpr FresnelPacketCoefs coefs =
+{
+    { float(dssn[0]), float(dssn[1]), float(dssn[2]), float(dssn[3]), float(dssn[4]), float(dssn[5]), float(dssn[6]) },
+    { float(dscn[0]), float(dscn[1]), float(dscn[2]), float(dscn[3]), float(dscn[4]), float(dscn[5]), float(dscn[6]) },
+    { float(dsfn[0]), float(dsfn[1]), float(dsfn[2]), float(dsfn[3]), float(dsfn[4]), float(dsfn[5]), float(dsfn[6]), float(dsfn[7]) },
+    { float(dsgn[0]), float(dsgn[1]), float(dsgn[2]), float(dsgn[3]), float(dsgn[4]), float(dsgn[5]), float(dsgn[6]), float(dsgn[7]) },
+    { //dsn
+        -2.99181919401019853726E3,
+        7.08840045257738576863E5,
+        -6.29741486205862506537E7,
+        2.54890880573376359104E9,
+        -4.42979518059697779103E10,
+        3.18016297876567817986E11
+    },
+    { //dsd
+        2.81376268889994315696E2,
+        4.55847810806532581675E4,
+        5.17343888770096400730E6,
+        4.19320245898111231129E8,
+        2.24411795645340920940E10,
+        6.07366389490084639049E11
+    },
+    { //dcn
+        -4.98843114573573548651E-8,
+        9.50428062829859605134E-6,
+        -6.45191435683965050962E-4,
+        1.88843319396703850064E-2,
+        -2.05525900955013891793E-1,
+        9.99999999999999998822E-1
+    },
+    { //dcd
+        3.99982968972495980367E-12,
+        9.15439215774657478799E-10,
+        1.25001862479598821474E-7,
+        1.22262789024179030997E-5,
+        8.68029542941784300606E-4,
+        4.12142090722199792936E-2,
+        1.00000000000000000118E0
+    },
+    { //dfn
+        4.21543555043677546506E-1,
+        1.43407919780758885261E-1,
+        1.15220955073585758835E-2,
+        3.45017939782574027900E-4,
+        4.63613749287867322088E-6,
+        3.05568983790257605827E-8,
+        1.02304514164907233465E-10,
+        1.72010743268161828879E-13,
+        1.34283276233062758925E-16,
+        3.76329711269987889006E-20
+    },
+    { //dfd
+        7.51586398353378947175E-1,
+        1.16888925859191382142E-1,
+        6.44051526508858611005E-3,
+        1.55934409164153020873E-4,
+        1.84627567348930545870E-6,
+        1.12699224763999035261E-8,
+        3.60140029589371370404E-11,
+        5.88754533621578410010E-14,
+        4.52001434074129701496E-17,
+        1.25443237090011264384E-20
+    },
+    { //dgn
+        5.04442073643383265887E-1,
+        1.97102833525523411709E-1,
+        1.87648584092575249293E-2,
+        6.84079380915393090172E-4,
+        1.15138826111884280931E-5,
+        9.82852443688422223854E-8,
+        4.45344415861750144738E-10,
+        1.08268041139020870318E-12,
+        1.37555460633261799868E-15,
+        8.36354435630677421531E-19,
+        1.86958710162783235106E-22
+    },
+    { //dgd
+        1.47495759925128324529E0,
+        3.37748989120019970451E-1,
+        2.53603741420338795122E-2,
+        8.14679107184306179049E-4,
+        1.27545075667729118702E-5,
+        1.04314589657571990585E-7,
+        4.60680728146520428211E-10,
+        1.10273215066240270757E-12,
+        1.38796531259578871258E-15,
+        8.39158816283118707363E-19,
+        1.86958710162783236342E-22
     }
+};
 
-    void initPolynomial()
+//Values and derivatives of the Fresnel integrals at evenly spaced points on [0, END), for fresnelTable.
+//The cubic Hermite interpolation error is at most step^4 / 384 times the fourth derivative, which is
+//below 2.5e-6 up to END, and the whole table (16K) stays in the L1 cache.
+struct FresnelTable
+{
+    static const FresnelTable &get()
     {
-        dssn <<
-            1.647629463788700E-009,
-            -1.522754752581096E-007,
-            8.424748808502400E-006,
-            -3.120693124703272E-004,
-            7.244727626597022E-003,
-            -9.228055941124598E-002,
-            5.235987735681432E-001;
-        dscn <<
-            1.416802502367354E-008,
-            -1.157231412229871E-006,
-            5.387223446683264E-005,
-            -1.604381798862293E-003,
-            2.818489036795073E-002,
-            -2.467398198317899E-001,
-            9.999999760004487E-001;
-        dsfn <<
-            -1.903009855649792E+012,
-            1.355942388050252E+011,
-            -4.158143148511033E+009,
-            7.343848463587323E+007,
-            -8.732356681548485E+005,
-            8.560515466275470E+003,
-            -1.032877601091159E+002,
-            2.999401847870011E+000;
-        dsgn <<
-            -1.860843997624650E+011,
-            1.278350673393208E+010,
-            -3.779387713202229E+008,
-            6.492611570598858E+006,
-            -7.787789623358162E+004,
-            8.602931494734327E+002,
-            -1.493439396592284E+001,
-            9.999841934744914E-001;
+        static const FresnelTable table; //function-local static initialization is thread-safe
+        return table;
     }
 
-    void initRational()
+    enum { STEPS_PER_UNIT = 64, END = 8, SIZE = STEPS_PER_UNIT * END + 1 };
+
+    struct Node
+    {
+        double s, c;
+        double ds, dc; //derivatives, premultiplied by the step size
+    };
+    Node nodes[SIZE];
+
+private:
+    FresnelTable()
     {
-        dsn <<
-            -2.99181919401019853726E3,
-            7.08840045257738576863E5,
-            -6.29741486205862506537E7,
-            2.54890880573376359104E9,
-            -4.42979518059697779103E10,
-            3.18016297876567817986E11;
-        dsd <<
-            /* 1.00000000000000000000E0,*/
-            2.81376268889994315696E2,
-            4.55847810806532581675E4,
-            5.17343888770096400730E6,
-            4.19320245898111231129E8,
-            2.24411795645340920940E10,
-            6.07366389490084639049E11;
-        dcn <<
-            -4.98843114573573548651E-8,
-            9.50428062829859605134E-6,
-            -6.45191435683965050962E-4,
-            1.88843319396703850064E-2,
-            -2.05525900955013891793E-1,
-            9.99999999999999998822E-1;
-        dcd <<
-            3.99982968972495980367E-12,
-            9.15439215774657478799E-10,
-            1.25001862479598821474E-7,
-            1.22262789024179030997E-5,
-            8.68029542941784300606E-4,
-            4.12142090722199792936E-2,
-            1.00000000000000000118E0;
-        dfn <<
-            4.21543555043677546506E-1,
-            1.43407919780758885261E-1,
-            1.15220955073585758835E-2,
-            3.45017939782574027900E-4,
-            4.63613749287867322088E-6,
-            3.05568983790257605827E-8,
-            1.02304514164907233465E-10,
-            1.72010743268161828879E-13,
-            1.34283276233062758925E-16,
-            3.76329711269987889006E-20;
-        dfd <<
-            /*  1.00000000000000000000E0,*/
-            7.51586398353378947175E-1,
-            1.16888925859191382142E-1,
-            6.44051526508858611005E-3,
-            1.55934409164153020873E-4,
-            1.84627567348930545870E-6,
-            1.12699224763999035261E-8,
-            3.60140029589371370404E-11,
-            5.88754533621578410010E-14,
-            4.52001434074129701496E-17,
-            1.25443237090011264384E-20;
-        dgn <<
-            5.04442073643383265887E-1,
-            1.97102833525523411709E-1,
-            1.87648584092575249293E-2,
-            6.84079380915393090172E-4,
-            1.15138826111884280931E-5,
-            9.82852443688422223854E-8,
-            4.45344415861750144738E-10,
-            1.08268041139020870318E-12,
-            1.37555460633261799868E-15,
-            8.36354435630677421531E-19,
-            1.86958710162783235106E-22;
-        dgd <<
-            /*  1.00000000000000000000E0,*/
-            1.47495759925128324529E0,
-            3.37748989120019970451E-1,
-            2.53603741420338795122E-2,
-            8.14679107184306179049E-4,
-            1.27545075667729118702E-5,
-            1.04314589657571990585E-7,
-            4.60680728146520428211E-10,
-            1.10273215066240270757E-12,
-            1.38796531259578871258E-15,
-            8.39158816283118707363E-19,
-            1.86958710162783236342E-22;
+        const double step = 1. / STEPS_PER_UNIT;
+        for(int i = 0; i < SIZE; ++i)
+        {
+            double x = i * step;
+            fresnel(x, &(nodes[i].s), &(nodes[i].c));
+            nodes[i].ds = step * sin(HALFPI * x * x);
+            nodes[i].dc = step * cos(HALFPI * x * x);
+        }
     }
-} init;
+};
 
 //full double precision accuracy using rational functions
 void fresnel( double xxa, double *ssa, double *cca )
 {
+    const FresnelPacketCoefs &k = coefs;
     double f, g, cc, ss, c, s, t, u;
     double x, x2;
 
@@ -227,8 +260,8 @@ void fresnel( double xxa, double *ssa, double *cca )
     if( x2 < 2.5625 )
     {
         t = x2 * x2;
-        ss = x * x2 * polevl( t, dsn)/p1evl( t, dsd);
-        cc = x * polevl( t, dcn)/polevl(t, dcd);
+        ss = x * x2 * polevl( t, k.dsn)/p1evl( t, k.dsd);
+        cc = x * polevl( t, k.dcn)/polevl(t, k.dcd);
         goto done;
     }
 
@@ -246,8 +279,8 @@ void fresnel( double xxa, double *ssa, double *cca )
     t = PI * x2;
     u = 1.0/(t * t);
     t = 1.0/t;
-    f = 1.0 - u * polevl( u, dfn)/p1evl(u, dfd);
-    g = t * polevl( u, dgn)/p1evl(u, dgd);
+    f = 1.0 - u * polevl( u, k.dfn)/p1evl(u, k.dfd);
+    g = t * polevl( u, k.dgn)/p1evl(u, k.dgd);
 
     t = HALFPI * x2;
     c = cos(t);
@@ -318,208 +351,250 @@ done:
     *ssa = ss;
 }
 
-//The double precision version is not vectorized because the scalar version is actually faster
-void fresnel(const VectorXd &t, VectorXd *s, VectorXd *c)
+//about 2.5e-6 absolute accuracy, by interpolating a precomputed table, and using the first
+//few terms of the asymptotic series (which are at least as accurate) past the end of the table
+void fresnelTable( double xxa, double *ssa, double *cca )
 {
-    s->resize(t.size());
-    c->resize(t.size());
-    for(int i = 0; i < t.size(); ++i)
-        fresnel(t[i], &((*s)[i]), &((*c)[i]));
-}
-
-//Vectorization stuff
-#ifdef EIGEN_VECTORIZE_SSE
-typedef Packet4f PSETParam;
+    double cc, ss;
+    double x = fabs(xxa);
 
-//vectorized polynomial evaluation
-template<typename Packet>
-static Packet vecpolevl( const Packet &x, const Matrix<typename unpacket_traits<Packet>::type, Dynamic, 1> &coefVec )
-{
-    int i = (int)coefVec.size() - 1;
-    const typename unpacket_traits<Packet>::type *coef = &(coefVec[0]);
-    Packet ans = pset1<PSETParam>(*coef++);
+    if( x < FresnelTable::END )
+    {
+        const FresnelTable &table = FresnelTable::get();
+        double pos = x * FresnelTable::STEPS_PER_UNIT;
+        int i = (int)pos;
+        double u = pos - i;
+        const FresnelTable::Node &a = table.nodes[i];
+        const FresnelTable::Node &b = table.nodes[i + 1];
+
+        //cubic Hermite basis
+        double u2 = u * u, u3 = u2 * u;
+        double ha = 2. * u3 - 3. * u2 + 1., hb = 1. - ha;
+        double hda = u3 - 2. * u2 + u, hdb = u3 - u2;
+
+        ss = ha * a.s + hb * b.s + hda * a.ds + hdb * b.ds;
+        cc = ha * a.c + hb * b.c + hda * a.dc + hdb * b.dc;
+    }
+    else
+    {
+        //the auxiliary functions from fresnel, from their asymptotic series
+        double x2 = x * x;
+        double t = 1.0 / (PI * x2);
+        double u = t * t;
+        double f = 1.0 - u * (3.0 - 105.0 * u);
+        double g = t * (1.0 - u * (15.0 - 945.0 * u));
+
+        t = HALFPI * x2;
+        double c = cos(t);
+        double s = sin(t);
+        t = PI * x;
+        cc = 0.5  +  (f * s  -  g * c)/t;
+        ss = 0.5  -  (f * c  +  g * s)/t;
+    }
 
-    do
+    if( xxa < 0.0 )
     {
-        ans = padd(pmul(ans, x), pset1<PSETParam>(*coef++));
-    } while(--i);
+        cc = -cc;
+        ss = -ss;
+    }
 
-    return ans;
+    *cca = cc;
+    *ssa = ss;
 }
 
-template<typename Packet>
-static Packet vecp1evl( const Packet &x, const Matrix<typename unpacket_traits<Packet>::type, Dynamic, 1> &coefVec )
+//not vectorized--the table lookups would have to be gathers
+void fresnelTable(const VectorXd &t, VectorXd *s, VectorXd *c)
 {
-    int i = (int)coefVec.size() - 1;
-    const typename unpacket_traits<Packet>::type *coef = &(coefVec[0]);
-    Packet ans = padd(x, pset1<PSETParam>(*coef++));
-
-    do
-    {
-        ans = padd(pmul(ans, x), pset1<PSETParam>(*coef++));
-    } while(--i);
-
-    return ans;
+    s->resize(t.size());
+    c->resize(t.size());
+    for(int i = 0; i < t.size(); ++i)
+        fresnelTable(t[i], &((*s)[i]), &((*c)[i]));
 }
 
-//other vectorized utilities
-EIGEN_STRONG_INLINE Packet4f packetTransferSign(const Packet4f& to, const Packet4f& from)
+//Vectorization stuff
+#if defined(EIGEN_VECTORIZE_SSE) || defined(EIGEN_VECTORIZE_NEON)
+
+namespace
 {
-  const Packet4f mask = _mm_and_ps(from, _mm_castsi128_ps(_mm_setr_epi32(0x80000000,0x80000000,0x80000000,0x80000000)));
-  return _mm_or_ps(to, mask);
-}
-EIGEN_STRONG_INLINE Packet2d packetTransferSign(const Packet2d& to, const Packet2d from)
+//rounding to the nearest integer, per instruction set
+//(the double versions are only called on values below 2^31)
+#ifdef EIGEN_VECTORIZE_SSE
+EIGEN_STRONG_INLINE Packet4f packetRound(const Packet4f &a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+EIGEN_STRONG_INLINE Packet2d packetRound(const Packet2d &a) { return _mm_cvtepi32_pd(_mm_cvtpd_epi32(a)); }
+#endif
+#ifdef EIGEN_VECTORIZE_NEON
+#ifdef __aarch64__
+EIGEN_STRONG_INLINE Packet4f packetRound(const Packet4f &a) { return vrndnq_f32(a); }
+EIGEN_STRONG_INLINE Packet2d packetRound(const Packet2d &a) { return vrndnq_f64(a); }
+#else
+//32-bit ARM has no rounding instruction, so add 0.5 with the sign of a and truncate
+EIGEN_STRONG_INLINE Packet4f packetRound(const Packet4f &a)
 {
-  const Packet2d mask = _mm_and_pd(from, _mm_castsi128_pd(_mm_setr_epi32(0x00000000,0x80000000,0x00000000,0x80000000)));
-  return _mm_or_pd(to, mask);
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(a), vdupq_n_u32(0x80000000u));
+    float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(0.5f)), sign));
+    return vcvtq_f32_s32(vcvtq_s32_f32(vaddq_f32(a, half)));
 }
-
-EIGEN_STRONG_INLINE Packet4f packetFmod(const Packet4f &a, const Packet4f &b)
+#endif
+#endif
+
+//Eigen's 128-bit packets of each scalar type
+template<typename Scalar> struct Packet128;
+template<> struct Packet128<float> { typedef Packet4f type; enum { size = 4 }; };
+#ifdef CORNUCOPIA_FRESNEL_DOUBLE_PACKETS
+template<> struct Packet128<double> { typedef Packet2d type; enum { size = 2 }; };
+#endif
+
+//the operations FresnelPacket.h needs, on Eigen's 128-bit packets
+template<typename S>
+struct EigenPacketOps
 {
-    Packet4f div = pdiv(a, b);
-    div = _mm_cvtepi32_ps(_mm_cvtps_epi32(div));
-    return psub(a, pmul(div, b));
-}
-
-//vectorized for the low branch of the Fresnel approximation
-void fresnelLow( const Packet4f &xxa, Packet4f *ssa, Packet4f *cca )
+    typedef typename Packet128<S>::type Packet;
+    typedef Packet Mask;
+    typedef S Scalar;
+    enum { size = Packet128<S>::size };
+
+    static Packet set1(Scalar a) { return pset1<Packet>(a); }
+    static Packet load(const Scalar *from) { return ploadu<Packet>(from); }
+    static void store(Scalar *to, const Packet &from) { pstoreu(to, from); }
+    static Packet add(const Packet &a, const Packet &b) { return padd(a, b); }
+    static Packet sub(const Packet &a, const Packet &b) { return psub(a, b); }
+    static Packet mul(const Packet &a, const Packet &b) { return pmul(a, b); }
+    static Packet div(const Packet &a, const Packet &b) { return pdiv(a, b); }
+    static Packet madd(const Packet &a, const Packet &b, const Packet &c) { return pmadd(a, b, c); }
+    static Packet abs(const Packet &a) { return pabs(a); }
+    static Packet negate(const Packet &a) { return pnegate(a); }
+    static Packet round(const Packet &a) { return packetRound(a); }
+    static Mask lt(const Packet &a, const Packet &b) { return pcmp_lt(a, b); }
+    static Mask eq(const Packet &a, const Packet &b) { return pcmp_eq(a, b); }
+    static Mask maskOr(const Mask &a, const Mask &b) { return por(a, b); }
+    static Packet select(const Mask &mask, const Packet &a, const Packet &b) { return pselect(mask, a, b); }
+};
+} //end of anonymous namespace
+
+//On x86 with GCC or Clang, the AVX versions are compiled separately and picked at runtime
+#ifdef CORNUCOPIA_FRESNEL_DISPATCH
+enum FresnelSIMD { FRESNEL_SSE, FRESNEL_AVX, FRESNEL_AVX512 };
+
+static FresnelSIMD detectFresnelSIMD()
 {
-    Packet4f cc, ss, t;
-    Packet4f x, x2;
-
-    x = pabs(xxa);
-    x2 = pmul(x, x);
-
-    t = pmul(x2, x2);
-    ss = pmul(x, pmul(x2, vecpolevl( t, ssn)));
-    cc = pmul(x, vecpolevl( t, scn));
-
-    *ssa = packetTransferSign(ss, xxa);
-    *cca = packetTransferSign(cc, xxa);
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+        return FRESNEL_AVX512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return FRESNEL_AVX;
+    return FRESNEL_SSE;
 }
+#endif //CORNUCOPIA_FRESNEL_DISPATCH
 
-//vectorized for the high branch
-void fresnelMed( const Packet4f &xxa, Packet4f *ssa, Packet4f *cca )
+//This version is vectorized
+void fresnelApprox(const double *t, int n, double *s, double *c)
 {
-    Packet4f cc, ss, t, u, f, g, c, s;
-    Packet4f x, x2;
-
-    x = pabs(xxa);
-    x2 = pmul(x, x);
-
-    t = pmul(pset1<PSETParam>(float(PI)), x2);
-    t = pdiv(pset1<PSETParam>(float(1.0)), t);
-    u = pmul(t, t);
-    f = psub(pset1<PSETParam>(float(1.0)), pmul(u, vecpolevl( u, sfn)));
-    g = pmul(t, vecpolevl( u, sgn));
-
-    t = pmul(pset1<PSETParam>(float(HALFPI)), x2);
-
-    //The following line is necessary because Eigen's psin and pcos don't handle large
-    //inputs well.
-    t = packetFmod(t, pset1<PSETParam>(float(TWOPI))); 
+    const FresnelPacketCoefs &k = coefs;
 
-    c = pcos(t);
-    s = psin(t);
+    if(n == 0)
+        return;
 
-    t = pdiv(pset1<PSETParam>(float(1. / PI)), x);
-    cc = padd(pset1<PSETParam>(float(0.5)), pmul(t, psub(pmul(f, s), pmul(g, c))));
-    ss = psub(pset1<PSETParam>(float(0.5)), pmul(t, padd(pmul(f, c), pmul(g, s))));
+#ifdef CORNUCOPIA_FRESNEL_DISPATCH
+    static const FresnelSIMD simd = detectFresnelSIMD();
+    if(simd == FRESNEL_AVX512)
+    {
+        fresnelApproxAVX512(k, t, n, s, c);
+        return;
+    }
+    if(simd == FRESNEL_AVX)
+    {
+        fresnelApproxAVX(k, t, n, s, c);
+        return;
+    }
+#endif //CORNUCOPIA_FRESNEL_DISPATCH
 
-    *ssa = packetTransferSign(ss, xxa);
-    *cca = packetTransferSign(cc, xxa);
+    fresnelApproxPackets<EigenPacketOps<float> >(k, t, n, s, c);
 }
 
-//This version is vectorized
 void fresnelApprox(const VectorXd &t, VectorXd *s, VectorXd *c)
 {
-    const int packetSize = 4;
-    typedef Packet4f Packet;
-    typedef float Scalar;
+    s->resize(t.size());
+    c->resize(t.size());
+    fresnelApprox(t.data(), (int)t.size(), s->data(), c->data());
+}
 
-    typedef Matrix<float, packetSize, 1> ValVec;
-    typedef Matrix<int, packetSize, 1> IdxVec;
+#ifdef CORNUCOPIA_FRESNEL_DOUBLE_PACKETS
+//The double precision version, vectorized the same way
+void fresnel(const VectorXd &t, VectorXd *s, VectorXd *c)
+{
+    const FresnelPacketCoefs &k = coefs;
 
     s->resize(t.size());
     c->resize(t.size());
+    if(t.size() == 0)
+        return;
 
-    ValVec lowVal, medVal;
-    IdxVec lowIdx, medIdx;
-    Packet pval, ps, pc;
-    ValVec vs, vc;
-    int lowNum = 0, medNum = 0;
-
-    for(int i = 0; i < t.size(); ++i)
+#ifdef CORNUCOPIA_FRESNEL_DISPATCH
+    static const FresnelSIMD simd = detectFresnelSIMD();
+    if(simd == FRESNEL_AVX512)
     {
-        double vsq = t[i] * t[i];
-        if(vsq > 1367076676)
-        {
-            if(t[i] < 0)
-                (*s)[i] = (*c)[i] = -0.5;
-            else
-                (*s)[i] = (*c)[i] = 0.5;
-
-            continue;
-        }
-        if(vsq < 2.5625) //low
-        {
-            lowVal[lowNum] = Scalar(t[i]);
-            lowIdx[lowNum++] = i;
-
-            if(lowNum == packetSize)
-            {
-                pval = lowVal.packet<Aligned>(0);
-                fresnelLow(pval, &ps, &pc);
-                vs.writePacket<Aligned>(0, ps);
-                vc.writePacket<Aligned>(0, pc);
-                for(int j = 0; j < packetSize; ++j)
-                {
-                    (*s)[lowIdx[j]] = vs[j];
-                    (*c)[lowIdx[j]] = vc[j];
-                }
-                lowNum = 0;
-            }
-        }
-        else //med
-        {
-            medVal[medNum] = Scalar(t[i]);
-            medIdx[medNum++] = i;
-
-            if(medNum == packetSize)
-            {
-                pval = medVal.packet<Aligned>(0);
-                fresnelMed(pval, &ps, &pc);
-                vs.writePacket<Aligned>(0, ps);
-                vc.writePacket<Aligned>(0, pc);
-                for(int j = 0; j < packetSize; ++j)
-                {
-                    (*s)[medIdx[j]] = vs[j];
-                    (*c)[medIdx[j]] = vc[j];
-                }
-                medNum = 0;
-            }
-        }
+        fresnelAVX512(k, t.data(), (int)t.size(), s->data(), c->data());
+        return;
+    }
+    if(simd == FRESNEL_AVX)
+    {
+        fresnelAVX(k, t.data(), (int)t.size(), s->data(), c->data());
+        return;
     }
+#endif //CORNUCOPIA_FRESNEL_DISPATCH
 
-    //finish up
-    for(int i = 0; i < lowNum; ++i)
-        fresnelApprox(lowVal[i], &((*s)[lowIdx[i]]), &((*c)[lowIdx[i]]));
-    for(int i = 0; i < medNum; ++i)
-        fresnelApprox(medVal[i], &((*s)[medIdx[i]]), &((*c)[medIdx[i]]));
+    fresnelDoublePackets<EigenPacketOps<double> >(k, t.data(), (int)t.size(), s->data(), c->data());
 }
+#endif //CORNUCOPIA_FRESNEL_DOUBLE_PACKETS
 
-#else //EIGEN_VECTORIZE_SSE
+#else //EIGEN_VECTORIZE_SSE || EIGEN_VECTORIZE_NEON
 
 //The unvectorized version
+void fresnelApprox(const double *t, int n, double *s, double *c)
+{
+    for(int i = 0; i < n; ++i)
+        fresnelApprox(t[i], s + i, c + i);
+}
+
 void fresnelApprox(const VectorXd &t, VectorXd *s, VectorXd *c)
+{
+    s->resize(t.size());
+    c->resize(t.size());
+    fresnelApprox(t.data(), (int)t.size(), s->data(), c->data());
+}
+
+#endif //EIGEN_VECTORIZE_SSE || EIGEN_VECTORIZE_NEON
+
+#ifndef CORNUCOPIA_FRESNEL_DOUBLE_PACKETS
+//The unvectorized double precision version
+void fresnel(const VectorXd &t, VectorXd *s, VectorXd *c)
 {
     s->resize(t.size());
     c->resize(t.size());
     for(int i = 0; i < t.size(); ++i)
-        fresnelApprox(t[i], &((*s)[i]), &((*c)[i]));
+        fresnel(t[i], &((*s)[i]), &((*c)[i]));
 }
+#endif //CORNUCOPIA_FRESNEL_DOUBLE_PACKETS
 
-#endif //EIGEN_VECTORIZE_SSE
+const char *fresnelVectorization()
+{
+#if defined(EIGEN_VECTORIZE_SSE) || defined(EIGEN_VECTORIZE_NEON)
+#ifdef CORNUCOPIA_FRESNEL_DISPATCH
+    static const FresnelSIMD simd = detectFresnelSIMD();
+    if(simd == FRESNEL_AVX512)
+        return "AVX-512";
+    if(simd == FRESNEL_AVX)
+        return "AVX2";
+#endif //CORNUCOPIA_FRESNEL_DISPATCH
+#ifdef EIGEN_VECTORIZE_NEON
+    return "NEON";
+#else
+    return "SSE";
+#endif
+#else //EIGEN_VECTORIZE_SSE || EIGEN_VECTORIZE_NEON
+    return "none";
+#endif //EIGEN_VECTORIZE_SSE || EIGEN_VECTORIZE_NEON
+}
 
 END_NAMESPACE_Cornu
 
@@ -28,11 +28,19 @@ NAMESPACE_Cornu
 
 //almost full double-precision accuracy, using rational approximations
 void fresnel(double xxa, double *ssa, double *cca);
-void fresnel(const Eigen::VectorXd &t, Eigen::VectorXd *s, Eigen::VectorXd *c);
+void fresnel(const Eigen::VectorXd &t, Eigen::VectorXd *s, Eigen::VectorXd *c); //vectorized like fresnelApprox below
 
 //roughly single-precision accuracy, using polynomial approximations
 void fresnelApprox(double xxa, double *ssa, double *cca);
-void fresnelApprox(const Eigen::VectorXd &t, Eigen::VectorXd *s, Eigen::VectorXd *c); //sse vectorized
+void fresnelApprox(const Eigen::VectorXd &t, Eigen::VectorXd *s, Eigen::VectorXd *c); //vectorized: SSE or NEON, and AVX2 or AVX-512 if the processor has them
+void fresnelApprox(const double *t, int n, double *s, double *c); //same, on raw arrays, for callers that keep their own buffers
+
+//about 2.5e-6 absolute accuracy, interpolating a small precomputed table--the fastest of the three
+void fresnelTable(double xxa, double *ssa, double *cca);
+void fresnelTable(const Eigen::VectorXd &t, Eigen::VectorXd *s, Eigen::VectorXd *c);
+
+//names the instruction set the vectorized versions use on this processor, e.g., "AVX2"
+const char *fresnelVectorization();
 
 END_NAMESPACE_Cornu
 
@@ -0,0 +1,98 @@
+/*--
+    FresnelAVX.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//This file is compiled with AVX2 and FMA enabled (-mavx2 -mfma, see CMakeLists.txt) and is only
+//called after checking at runtime that the processor supports them.  If the flags are not set, it is empty.
+//The packets are used directly through intrinsics, and Eigen isn't included, so nothing compiled here with
+//AVX instructions can take the place of code the other files share (see FresnelPacket.h).
+
+#include "FresnelPacket.h"
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+namespace Cornu
+{
+
+namespace
+{
+struct AVXFloatOps
+{
+    typedef __m256 Packet;
+    typedef __m256 Mask;
+    typedef float Scalar;
+    enum { size = 8 };
+
+    static Packet set1(Scalar a) { return _mm256_set1_ps(a); }
+    static Packet load(const Scalar *from) { return _mm256_loadu_ps(from); }
+    static void store(Scalar *to, const Packet &from) { _mm256_storeu_ps(to, from); }
+    static Packet add(const Packet &a, const Packet &b) { return _mm256_add_ps(a, b); }
+    static Packet sub(const Packet &a, const Packet &b) { return _mm256_sub_ps(a, b); }
+    static Packet mul(const Packet &a, const Packet &b) { return _mm256_mul_ps(a, b); }
+    static Packet div(const Packet &a, const Packet &b) { return _mm256_div_ps(a, b); }
+    static Packet madd(const Packet &a, const Packet &b, const Packet &c) { return _mm256_fmadd_ps(a, b, c); }
+    static Packet abs(const Packet &a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+    static Packet negate(const Packet &a) { return _mm256_xor_ps(_mm256_set1_ps(-0.f), a); }
+    static Packet round(const Packet &a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Mask lt(const Packet &a, const Packet &b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Mask eq(const Packet &a, const Packet &b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static Mask maskOr(const Mask &a, const Mask &b) { return _mm256_or_ps(a, b); }
+    static Packet select(const Mask &mask, const Packet &a, const Packet &b) { return _mm256_blendv_ps(b, a, mask); }
+};
+
+struct AVXDoubleOps
+{
+    typedef __m256d Packet;
+    typedef __m256d Mask;
+    typedef double Scalar;
+    enum { size = 4 };
+
+    static Packet set1(Scalar a) { return _mm256_set1_pd(a); }
+    static Packet load(const Scalar *from) { return _mm256_loadu_pd(from); }
+    static void store(Scalar *to, const Packet &from) { _mm256_storeu_pd(to, from); }
+    static Packet add(const Packet &a, const Packet &b) { return _mm256_add_pd(a, b); }
+    static Packet sub(const Packet &a, const Packet &b) { return _mm256_sub_pd(a, b); }
+    static Packet mul(const Packet &a, const Packet &b) { return _mm256_mul_pd(a, b); }
+    static Packet div(const Packet &a, const Packet &b) { return _mm256_div_pd(a, b); }
+    static Packet madd(const Packet &a, const Packet &b, const Packet &c) { return _mm256_fmadd_pd(a, b, c); }
+    static Packet abs(const Packet &a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.), a); }
+    static Packet negate(const Packet &a) { return _mm256_xor_pd(_mm256_set1_pd(-0.), a); }
+    static Packet round(const Packet &a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Mask lt(const Packet &a, const Packet &b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static Mask eq(const Packet &a, const Packet &b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static Mask maskOr(const Mask &a, const Mask &b) { return _mm256_or_pd(a, b); }
+    static Packet select(const Mask &mask, const Packet &a, const Packet &b) { return _mm256_blendv_pd(b, a, mask); }
+};
+} //end of anonymous namespace
+
+void fresnelApproxAVX(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c)
+{
+    fresnelApproxPackets<AVXFloatOps>(k, t, n, s, c);
+}
+
+void fresnelAVX(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c)
+{
+    fresnelDoublePackets<AVXDoubleOps>(k, t, n, s, c);
+}
+
+} //namespace Cornu
+
+#endif //__AVX2__
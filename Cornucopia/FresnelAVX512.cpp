@@ -0,0 +1,97 @@
+/*--
+    FresnelAVX512.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//This file is compiled with AVX-512 enabled (-mavx512f -mavx512dq, see CMakeLists.txt) and is only
+//called after checking at runtime that the processor supports them.  If the flags are not set, it is empty.
+//As in FresnelAVX.cpp, the packets are used directly through intrinsics rather than through Eigen.
+
+#include "FresnelPacket.h"
+
+#ifdef __AVX512F__
+
+#include <immintrin.h>
+
+namespace Cornu
+{
+
+namespace
+{
+struct AVX512FloatOps
+{
+    typedef __m512 Packet;
+    typedef __mmask16 Mask;
+    typedef float Scalar;
+    enum { size = 16 };
+
+    static Packet set1(Scalar a) { return _mm512_set1_ps(a); }
+    static Packet load(const Scalar *from) { return _mm512_loadu_ps(from); }
+    static void store(Scalar *to, const Packet &from) { _mm512_storeu_ps(to, from); }
+    static Packet add(const Packet &a, const Packet &b) { return _mm512_add_ps(a, b); }
+    static Packet sub(const Packet &a, const Packet &b) { return _mm512_sub_ps(a, b); }
+    static Packet mul(const Packet &a, const Packet &b) { return _mm512_mul_ps(a, b); }
+    static Packet div(const Packet &a, const Packet &b) { return _mm512_div_ps(a, b); }
+    static Packet madd(const Packet &a, const Packet &b, const Packet &c) { return _mm512_fmadd_ps(a, b, c); }
+    static Packet abs(const Packet &a) { return _mm512_abs_ps(a); }
+    static Packet negate(const Packet &a) { return _mm512_xor_ps(_mm512_set1_ps(-0.f), a); }
+    static Packet round(const Packet &a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Mask lt(const Packet &a, const Packet &b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static Mask eq(const Packet &a, const Packet &b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+    static Mask maskOr(const Mask &a, const Mask &b) { return _mm512_kor(a, b); }
+    static Packet select(const Mask &mask, const Packet &a, const Packet &b) { return _mm512_mask_blend_ps(mask, b, a); }
+};
+
+struct AVX512DoubleOps
+{
+    typedef __m512d Packet;
+    typedef __mmask8 Mask;
+    typedef double Scalar;
+    enum { size = 8 };
+
+    static Packet set1(Scalar a) { return _mm512_set1_pd(a); }
+    static Packet load(const Scalar *from) { return _mm512_loadu_pd(from); }
+    static void store(Scalar *to, const Packet &from) { _mm512_storeu_pd(to, from); }
+    static Packet add(const Packet &a, const Packet &b) { return _mm512_add_pd(a, b); }
+    static Packet sub(const Packet &a, const Packet &b) { return _mm512_sub_pd(a, b); }
+    static Packet mul(const Packet &a, const Packet &b) { return _mm512_mul_pd(a, b); }
+    static Packet div(const Packet &a, const Packet &b) { return _mm512_div_pd(a, b); }
+    static Packet madd(const Packet &a, const Packet &b, const Packet &c) { return _mm512_fmadd_pd(a, b, c); }
+    static Packet abs(const Packet &a) { return _mm512_abs_pd(a); }
+    static Packet negate(const Packet &a) { return _mm512_xor_pd(_mm512_set1_pd(-0.), a); }
+    static Packet round(const Packet &a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static Mask lt(const Packet &a, const Packet &b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static Mask eq(const Packet &a, const Packet &b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+    static Mask maskOr(const Mask &a, const Mask &b) { return Mask(a | b); }
+    static Packet select(const Mask &mask, const Packet &a, const Packet &b) { return _mm512_mask_blend_pd(mask, b, a); }
+};
+} //end of anonymous namespace
+
+void fresnelApproxAVX512(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c)
+{
+    fresnelApproxPackets<AVX512FloatOps>(k, t, n, s, c);
+}
+
+void fresnelAVX512(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c)
+{
+    fresnelDoublePackets<AVX512DoubleOps>(k, t, n, s, c);
+}
+
+} //namespace Cornu
+
+#endif //__AVX512F__
@@ -0,0 +1,337 @@
+/*--
+    FresnelPacket.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_FRESNELPACKET_H_INCLUDED
+#define CORNUCOPIA_FRESNELPACKET_H_INCLUDED
+
+//The vectorized Fresnel integrals: the approximation, written for any float packet, and the double
+//precision rational version, written for any double packet.  The packets are used through an Ops class
+//(see EigenPacketOps in Fresnel.cpp) that gives the packet type and its operations as static functions.
+//Fresnel.cpp instantiates them for Eigen's 128-bit packets.  The files compiled with AVX flags instantiate
+//them for Ops written directly with intrinsics and don't include Eigen at all: Eigen's functions are inline
+//functions with external linkage, and a copy compiled with AVX instructions could be the one the linker
+//keeps for the SSE version.  For the same reason, this header includes nothing, and everything in it that
+//is compiled is in an anonymous namespace, as is every Ops class, so the instantiations for different
+//instruction sets have internal linkage.  Not part of the public interface.
+
+namespace Cornu
+{
+
+//the scalar versions from Fresnel.h, for the leftovers
+void fresnel(double xxa, double *ssa, double *cca);
+void fresnelApprox(double xxa, double *ssa, double *cca);
+
+struct FresnelPacketCoefs
+{
+    //single precision polynomial coefficients for the approximation
+    float sn[7];
+    float cn[7];
+    float fn[8];
+    float gn[8];
+    //double precision rational coefficients (p1evl denominators leave out the leading 1)
+    double dsn[6], dsd[6];
+    double dcn[6], dcd[7];
+    double dfn[10], dfd[10];
+    double dgn[11], dgd[11];
+};
+
+//these take raw arrays rather than Eigen vectors so that no Eigen code is shared between the
+//translation units compiled for different instruction sets
+void fresnelApproxAVX(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c);
+void fresnelApproxAVX512(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c);
+void fresnelAVX(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c);
+void fresnelAVX512(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c);
+
+namespace
+{
+
+//PI and HALFPI from defs.h, which includes Eigen
+const double packetPi = 3.1415926535897932385;
+const double packetHalfPi = 1.5707963267948966192;
+
+/*
+    An Ops class has the typedefs Packet, Mask (the result of a comparison) and Scalar, the packet size in
+    the enum value size, and these static functions:
+    set1(Scalar), load(const Scalar *), store(Scalar *, Packet), add, sub, mul, div, madd(a, b, c) = a * b + c,
+    abs, negate, round (to the nearest integer), lt and eq (giving Masks), maskOr, and select(mask, a, b),
+    which gives a where mask is set and b elsewhere.
+*/
+
+//vectorized polynomial evaluation
+template<typename Ops, typename Scalar, int N>
+typename Ops::Packet vecpolevl(const typename Ops::Packet &x, const Scalar (&coef)[N])
+{
+    typedef typename Ops::Scalar S;
+    typename Ops::Packet ans = Ops::set1(S(coef[0]));
+    for(int i = 1; i < N; ++i)
+        ans = Ops::madd(ans, x, Ops::set1(S(coef[i])));
+    return ans;
+}
+
+template<typename Ops, typename Scalar, int N>
+typename Ops::Packet vecp1evl(const typename Ops::Packet &x, const Scalar (&coef)[N]) //leading coef is 1
+{
+    typedef typename Ops::Scalar S;
+    typename Ops::Packet ans = Ops::add(x, Ops::set1(S(coef[0])));
+    for(int i = 1; i < N; ++i)
+        ans = Ops::madd(ans, x, Ops::set1(S(coef[i])));
+    return ans;
+}
+
+//gives the magnitude of to the sign of from (to must be nonnegative)
+template<typename Ops>
+inline typename Ops::Packet packetTransferSign(const typename Ops::Packet &to, const typename Ops::Packet &from)
+{
+    return Ops::select(Ops::lt(from, Ops::set1(0)), Ops::negate(to), to);
+}
+
+//sin and cos of (pi / 2) * x, for 0 <= x < 2^33.  The argument is reduced exactly, because x - 4 * round(x / 4)
+//is representable, so this is as accurate as the scalar sin and cos of HALFPI * x (more, for large x).  In single
+//precision, it is as accurate as x is.
+template<typename Ops>
+void packetSinCosHalfPi(const typename Ops::Packet &x, typename Ops::Packet *sOut, typename Ops::Packet *cOut)
+{
+    typedef typename Ops::Packet Packet;
+    typedef typename Ops::Scalar Scalar;
+    typedef typename Ops::Mask Mask;
+
+    //Cephes' coefficients for sin and cos on [-pi/4, pi/4]
+    static const double sinCoefs[6] = { 1.58962301576546568060E-10, -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+                                        -1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1 };
+    static const double cosCoefs[6] = { -1.13585365213876817300E-11, 2.08757008419747316778E-9, -2.75573141792967388112E-7,
+                                        2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2 };
+
+    Packet r = Ops::sub(x, Ops::mul(Ops::set1(4), Ops::round(Ops::mul(x, Ops::set1(Scalar(0.25)))))); //in [-2, 2]
+    Packet q = Ops::round(r); //quarter turns
+    Packet a = Ops::mul(Ops::set1(Scalar(packetHalfPi)), Ops::sub(r, q)); //in [-pi/4, pi/4]
+    Packet z = Ops::mul(a, a);
+
+    Packet s = Ops::madd(Ops::mul(a, z), vecpolevl<Ops>(z, sinCoefs), a);
+    Packet c = Ops::madd(Ops::mul(z, z), vecpolevl<Ops>(z, cosCoefs), Ops::sub(Ops::set1(1), Ops::mul(Ops::set1(Scalar(0.5)), z)));
+
+    //rotate by q quarter turns (q is -2, -1, 0, 1, or 2)
+    Mask odd = Ops::eq(Ops::abs(q), Ops::set1(1));
+    Packet rs = Ops::select(odd, c, s);
+    Packet rc = Ops::select(odd, s, c);
+    Mask negS = Ops::maskOr(Ops::lt(q, Ops::set1(Scalar(-0.5))), Ops::lt(Ops::set1(Scalar(1.5)), q));
+    Mask negC = Ops::maskOr(Ops::lt(Ops::set1(Scalar(0.5)), q), Ops::lt(q, Ops::set1(Scalar(-1.5))));
+    *sOut = Ops::select(negS, Ops::negate(rs), rs);
+    *cOut = Ops::select(negC, Ops::negate(rc), rc);
+}
+
+//vectorized for the low branch of the Fresnel approximation
+template<typename Ops>
+void fresnelLow(const FresnelPacketCoefs &k, const typename Ops::Packet &xxa, typename Ops::Packet *ssa, typename Ops::Packet *cca)
+{
+    typedef typename Ops::Packet Packet;
+    Packet cc, ss, t;
+    Packet x, x2;
+
+    x = Ops::abs(xxa);
+    x2 = Ops::mul(x, x);
+
+    t = Ops::mul(x2, x2);
+    ss = Ops::mul(x, Ops::mul(x2, vecpolevl<Ops>(t, k.sn)));
+    cc = Ops::mul(x, vecpolevl<Ops>(t, k.cn));
+
+    *ssa = packetTransferSign<Ops>(ss, xxa);
+    *cca = packetTransferSign<Ops>(cc, xxa);
+}
+
+//vectorized for the high branch
+template<typename Ops>
+void fresnelMed(const FresnelPacketCoefs &k, const typename Ops::Packet &xxa, typename Ops::Packet *ssa, typename Ops::Packet *cca)
+{
+    typedef typename Ops::Packet Packet;
+    Packet cc, ss, t, u, f, g, c, s;
+    Packet x, x2;
+
+    x = Ops::abs(xxa);
+    x2 = Ops::mul(x, x);
+
+    t = Ops::mul(Ops::set1(float(packetPi)), x2);
+    t = Ops::div(Ops::set1(1.f), t);
+    u = Ops::mul(t, t);
+    f = Ops::sub(Ops::set1(1.f), Ops::mul(u, vecpolevl<Ops>(u, k.fn)));
+    g = Ops::mul(t, vecpolevl<Ops>(u, k.gn));
+
+    packetSinCosHalfPi<Ops>(x2, &s, &c);
+
+    t = Ops::div(Ops::set1(float(1. / packetPi)), x);
+    cc = Ops::add(Ops::set1(0.5f), Ops::mul(t, Ops::sub(Ops::mul(f, s), Ops::mul(g, c))));
+    ss = Ops::sub(Ops::set1(0.5f), Ops::mul(t, Ops::add(Ops::mul(f, c), Ops::mul(g, s))));
+
+    *ssa = packetTransferSign<Ops>(ss, xxa);
+    *cca = packetTransferSign<Ops>(cc, xxa);
+}
+
+//vectorized for the low branch of the double precision version
+template<typename Ops>
+void fresnelLowDouble(const FresnelPacketCoefs &k, const typename Ops::Packet &xxa, typename Ops::Packet *ssa, typename Ops::Packet *cca)
+{
+    typedef typename Ops::Packet Packet;
+    Packet cc, ss, t;
+    Packet x, x2;
+
+    x = Ops::abs(xxa);
+    x2 = Ops::mul(x, x);
+
+    t = Ops::mul(x2, x2);
+    ss = Ops::mul(Ops::mul(x, x2), Ops::div(vecpolevl<Ops>(t, k.dsn), vecp1evl<Ops>(t, k.dsd)));
+    cc = Ops::mul(x, Ops::div(vecpolevl<Ops>(t, k.dcn), vecpolevl<Ops>(t, k.dcd)));
+
+    *ssa = packetTransferSign<Ops>(ss, xxa);
+    *cca = packetTransferSign<Ops>(cc, xxa);
+}
+
+//vectorized for the high branch of the double precision version
+template<typename Ops>
+void fresnelMedDouble(const FresnelPacketCoefs &k, const typename Ops::Packet &xxa, typename Ops::Packet *ssa, typename Ops::Packet *cca)
+{
+    typedef typename Ops::Packet Packet;
+    Packet cc, ss, t, u, f, g, c, s;
+    Packet x, x2;
+
+    x = Ops::abs(xxa);
+    x2 = Ops::mul(x, x);
+
+    t = Ops::mul(Ops::set1(packetPi), x2);
+    u = Ops::div(Ops::set1(1.), Ops::mul(t, t));
+    t = Ops::div(Ops::set1(1.), t);
+    f = Ops::sub(Ops::set1(1.), Ops::div(Ops::mul(u, vecpolevl<Ops>(u, k.dfn)), vecp1evl<Ops>(u, k.dfd)));
+    g = Ops::div(Ops::mul(t, vecpolevl<Ops>(u, k.dgn)), vecp1evl<Ops>(u, k.dgd));
+
+    packetSinCosHalfPi<Ops>(x2, &s, &c);
+
+    t = Ops::mul(Ops::set1(packetPi), x);
+    cc = Ops::add(Ops::set1(0.5), Ops::div(Ops::sub(Ops::mul(f, s), Ops::mul(g, c)), t));
+    ss = Ops::sub(Ops::set1(0.5), Ops::div(Ops::add(Ops::mul(f, c), Ops::mul(g, s)), t));
+
+    *ssa = packetTransferSign<Ops>(ss, xxa);
+    *cca = packetTransferSign<Ops>(cc, xxa);
+}
+
+//the kernels for each version, for fresnelPackets below
+struct FresnelApproxKernels
+{
+    template<typename Ops>
+    static void low(const FresnelPacketCoefs &k, const typename Ops::Packet &x, typename Ops::Packet *s, typename Ops::Packet *c) { fresnelLow<Ops>(k, x, s, c); }
+    template<typename Ops>
+    static void med(const FresnelPacketCoefs &k, const typename Ops::Packet &x, typename Ops::Packet *s, typename Ops::Packet *c) { fresnelMed<Ops>(k, x, s, c); }
+    static void scalar(double x, double *s, double *c) { fresnelApprox(x, s, c); }
+};
+
+struct FresnelDoubleKernels
+{
+    template<typename Ops>
+    static void low(const FresnelPacketCoefs &k, const typename Ops::Packet &x, typename Ops::Packet *s, typename Ops::Packet *c) { fresnelLowDouble<Ops>(k, x, s, c); }
+    template<typename Ops>
+    static void med(const FresnelPacketCoefs &k, const typename Ops::Packet &x, typename Ops::Packet *s, typename Ops::Packet *c) { fresnelMedDouble<Ops>(k, x, s, c); }
+    static void scalar(double x, double *s, double *c) { fresnel(x, s, c); }
+};
+
+//Sorts the inputs into the two branches and evaluates each branch a full packet at a time.
+//The leftovers are evaluated with the scalar version.
+template<typename Ops, typename Kernels>
+void fresnelPackets(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c)
+{
+    typedef typename Ops::Scalar Scalar;
+    enum { packetSize = Ops::size };
+
+    Scalar lowVal[packetSize], medVal[packetSize];
+    int lowIdx[packetSize], medIdx[packetSize];
+    Scalar vs[packetSize], vc[packetSize];
+    typename Ops::Packet ps, pc;
+    int lowNum = 0, medNum = 0;
+
+    for(int i = 0; i < n; ++i)
+    {
+        double vsq = t[i] * t[i];
+        if(vsq > 1367076676)
+        {
+            if(t[i] < 0)
+                s[i] = c[i] = -0.5;
+            else
+                s[i] = c[i] = 0.5;
+
+            continue;
+        }
+        if(vsq < 2.5625) //low
+        {
+            lowVal[lowNum] = Scalar(t[i]);
+            lowIdx[lowNum++] = i;
+
+            if(lowNum == packetSize)
+            {
+                Kernels::template low<Ops>(k, Ops::load(lowVal), &ps, &pc);
+                Ops::store(vs, ps);
+                Ops::store(vc, pc);
+                for(int j = 0; j < packetSize; ++j)
+                {
+                    s[lowIdx[j]] = vs[j];
+                    c[lowIdx[j]] = vc[j];
+                }
+                lowNum = 0;
+            }
+        }
+        else //med
+        {
+            medVal[medNum] = Scalar(t[i]);
+            medIdx[medNum++] = i;
+
+            if(medNum == packetSize)
+            {
+                Kernels::template med<Ops>(k, Ops::load(medVal), &ps, &pc);
+                Ops::store(vs, ps);
+                Ops::store(vc, pc);
+                for(int j = 0; j < packetSize; ++j)
+                {
+                    s[medIdx[j]] = vs[j];
+                    c[medIdx[j]] = vc[j];
+                }
+                medNum = 0;
+            }
+        }
+    }
+
+    //finish up
+    for(int i = 0; i < lowNum; ++i)
+        Kernels::scalar(lowVal[i], s + lowIdx[i], c + lowIdx[i]);
+    for(int i = 0; i < medNum; ++i)
+        Kernels::scalar(medVal[i], s + medIdx[i], c + medIdx[i]);
+}
+
+template<typename Ops>
+void fresnelApproxPackets(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c)
+{
+    fresnelPackets<Ops, FresnelApproxKernels>(k, t, n, s, c);
+}
+
+template<typename Ops>
+void fresnelDoublePackets(const FresnelPacketCoefs &k, const double *t, int n, double *s, double *c)
+{
+    fresnelPackets<Ops, FresnelDoubleKernels>(k, t, n, s, c);
+}
+
+} //end of anonymous namespace
+
+} //namespace Cornu
+
+#endif //CORNUCOPIA_FRESNELPACKET_H_INCLUDED
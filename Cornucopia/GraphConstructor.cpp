@@ -27,6 +27,12 @@
 #include "Preprocessing.h"
 #include "TwoCurveCombine.h"
 #include "Oversketcher.h"
+#include "FitMetrics.h"
+#include "Trace.h"
+#include "Snapshot.h"
+#include "Dataset.h"
+
+#include <algorithm>
 
 using namespace std;
 using namespace Eigen;
@@ -34,17 +40,18 @@ NAMESPACE_Cornu
 
 struct PrimitiveCacheData
 {
-    double x, y, angle, curvature, param;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Vector4d values; //x, y, angle, curvature--packed so that differencing two of them is a couple of vector operations
+    double param;
 
     static PrimitiveCacheData make(CurvePrimitiveConstPtr curve, double param)
     {
         PrimitiveCacheData out;
-        Vector2d pos = curve->pos(param);
         out.param = param;
-        out.x = pos[0];
-        out.y = pos[1];
-        out.angle = curve->angle(param);
-        out.curvature = curve->curvature(param);
+        out.values.head<2>() = curve->pos(param);
+        out.values[2] = curve->angle(param);
+        out.values[3] = curve->curvature(param);
         return out;
     }
 };
@@ -52,6 +59,8 @@ struct PrimitiveCacheData
 class PrimitiveCache
 {
 public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
     PrimitiveCache(const PrimitiveCache &other)
     {
         _numVals = other._numVals;
@@ -97,6 +106,7 @@ class CostEvaluator : public smart_base
 public:
     CostEvaluator(const Fitter &fitter) :
         _primitives(fitter.output<PRIMITIVE_FITTING>()->primitives),
+        _columns(fitter.output<PRIMITIVE_FITTING>()->columns),
         _corners(fitter.output<RESAMPLING>()->corners)
     {
         for(int i = 0; i < 3; ++i)
@@ -116,28 +126,28 @@ public:
 
     double vertexCost(int p) const
     {
-        if(_primitives[p].isFixed())
+        if(_columns.fixed[p])
             return 0.;
 
         //complexity
-        double out = _curveCost[_primitives[p].curve->getType()];
+        double out = _curveCost[_columns.type[p]];
 
         //error
-        out += _errorCost(_primitives[p].error);
+        out += _errorCost(_columns.error[p]);
 
         //inflection
-        if(_primitives[p].startCurvSign != _primitives[p].endCurvSign)
+        if(_columns.startCurvSign[p] != _columns.endCurvSign[p])
             out += _inflectionCost;
 
         //shortness
-        double len = _primitives[p].curve->length();
+        double len = _columns.length[p];
         if(_continuityCost[0] == Parameters::infinity)
         {
             //figure out how much we expect the length to decrease when we join things up
             double lenDecrease = 0;
-            if(!_corners[_primitives[p].startIdx])
+            if(!_corners[_columns.startIdx[p]])
                 lenDecrease += _primitiveCache[p].start(1).param;
-            if(!_corners[_primitives[p].endIdx])
+            if(!_corners[_columns.endIdx[p]])
                 lenDecrease += len - _primitiveCache[p].end(1).param;
             if(_continuityCost[1] != Parameters::infinity)
                 lenDecrease *= 0.5;
@@ -149,21 +159,27 @@ public:
         return out;
     }
 
+    //false if every edge with this continuity from the primitive would cost infinity, e.g., G2 with lines and arcs
+    bool continuityAllowed(int p1, int continuity) const
+    {
+        return _continuityCost[continuity] < Parameters::infinity || _corners[_columns.endIdx[p1]];
+    }
+
     double edgeCost(int p1, int p2, int continuity, double error1 = -1., double error2 = -1.) const
     {
         double out = 0.;
 
         //continuity
-        if(!_corners[_primitives[p1].endIdx]) //no primitive spans a corner, so the start index is also there
+        if(!_corners[_columns.endIdx[p1]]) //no primitive spans a corner, so the start index is also there
             out += _continuityCost[continuity];
 
-        //inflection
-        if(continuity > 1 && _primitives[p1].endCurvSign != _primitives[p2].startCurvSign)
+        //inflection--a line takes the sign of its neighbors, which the path finder keeps track of
+        if(_inflects(p1, p2, continuity))
             out += _inflectionCost;
 
         //error
-        double err1 = _primitives[p1].error;
-        double err2 = _primitives[p2].error;
+        double err1 = _columns.error[p1];
+        double err2 = _columns.error[p2];
 
         if(error1 < 0.) //we need to predict the error
         {
@@ -182,27 +198,82 @@ public:
         return out;
     }
 
+    //the quantities the vertex cost is computed from (see Dataset.h), in units of the scaled pixel size
+    void vertexFeatures(int p, float *out) const
+    {
+        const FitPrimitive &primitive = _primitives[p];
+        out[Dataset::VERTEX_TYPE] = (float)primitive.curve->getType();
+        out[Dataset::VERTEX_LENGTH] = (float)(primitive.curve->length() * _lengthScale);
+        out[Dataset::VERTEX_ERROR] = (float)(primitive.error * SQR(_lengthScale));
+        out[Dataset::VERTEX_START_CURVATURE] = (float)(primitive.curve->startCurvature() / _lengthScale);
+        out[Dataset::VERTEX_END_CURVATURE] = (float)(primitive.curve->endCurvature() / _lengthScale);
+        out[Dataset::VERTEX_INFLECTION] = primitive.startCurvSign != primitive.endCurvSign ? 1.f : 0.f;
+        out[Dataset::VERTEX_START_CORNER] = !primitive.isFixed() && _corners[primitive.startIdx] ? 1.f : 0.f;
+        out[Dataset::VERTEX_END_CORNER] = !primitive.isFixed() && _corners[primitive.endIdx] ? 1.f : 0.f;
+    }
+
+    //the quantities the edge cost is computed from (see Dataset.h), in units of the scaled pixel size
+    void edgeFeatures(int p1, int p2, int continuity, float *out) const
+    {
+        int offset = continuity;
+        if(continuity > 0 && _columns.endIdx[p1] == _columns.startIdx[p2])
+            offset = 0;
+        Vector3d diffs = _getDiffs(p1, p2, offset);
+        double extra1, extra2;
+        _getExtraError(p1, p2, continuity, extra1, extra2);
+
+        out[Dataset::EDGE_POSITION_DIFF] = (float)(diffs[0] * _lengthScale);
+        out[Dataset::EDGE_ANGLE_DIFF] = continuity >= 1 ? (float)diffs[1] : 0.f;
+        out[Dataset::EDGE_CURVATURE_DIFF] = continuity >= 2 ? (float)(diffs[2] / _lengthScale) : 0.f;
+        out[Dataset::EDGE_EXTRA_ERROR1] = (float)(extra1 * SQR(_lengthScale));
+        out[Dataset::EDGE_EXTRA_ERROR2] = (float)(extra2 * SQR(_lengthScale));
+        out[Dataset::EDGE_CORNER] = _corners[_columns.endIdx[p1]] ? 1.f : 0.f;
+        out[Dataset::EDGE_INFLECTION] = _inflects(p1, p2, continuity) ? 1.f : 0.f;
+    }
+
+    size_t memoryUsage() const
+    {
+        return sizeof(CostEvaluator) + _primitiveCache.capacity() * sizeof(PrimitiveCache);
+    }
+
 private:
     double _errorCost(double error) const
     {
         return _errorCostFactor * (error * SQR(_lengthScale)); //simple for now
     }
 
+    //lines are fitted with one sign, and whether they inflect depends on the path (see PathFindingGraph)
+    bool _inflects(int p1, int p2, int continuity) const
+    {
+        if(continuity < 2 || _freeLine(p1) || _freeLine(p2))
+            return false;
+        return _columns.endCurvSign[p1] != _columns.startCurvSign[p2];
+    }
+
+    bool _freeLine(int p) const { return _columns.type[p] == CurvePrimitive::LINE && !_columns.fixed[p]; }
+
     void _getExtraError(int p1, int p2, int continuity, double &outExtra1, double &outExtra2) const
     {
         //outExtra1 = outExtra2 = 0.;  return;
         int offset = continuity;
-        if(continuity > 0 && _primitives[p1].endIdx == _primitives[p2].startIdx)
+        if(continuity > 0 && _columns.endIdx[p1] == _columns.startIdx[p2])
             offset = 0; //one of the curve is a start or an end curve
         Vector3d diffs = _getDiffs(p1, p2, offset);
         for(int i = continuity + 1; i < 3; ++i)
             diffs[i] = 0.; //don't count more than necessary
 
-        double len1 = _primitives[p1].curve->length();
-        double len2 = _primitives[p2].curve->length();
+        double len1 = _columns.length[p1];
+        double len2 = _columns.length[p2];
 
         outExtra1 = diffs[0] * 0.5 + len1 * diffs[1] * 0.25 + SQR(len1) * diffs[2] * 0.125;
         outExtra2 = diffs[0] * 0.5 + len2 * diffs[1] * 0.25 + SQR(len2) * diffs[2] * 0.125;
+
+        //The terms above grow too slowly for large mismatches, which then turn out much more expensive when the
+        //path finder validates them.  So add the linearized cost of the combination: each curve takes half of the
+        //mismatch, spread over its length as a linear (position, angle) or quadratic (curvature) displacement,
+        //whose mean squared size is what it adds to the error.
+        outExtra1 += SQR(diffs[0] * 0.5) / 3. + SQR(len1 * diffs[1] * 0.5) / 3. + SQR(SQR(len1) * diffs[2] * 0.25) / 5.;
+        outExtra2 += SQR(diffs[0] * 0.5) / 3. + SQR(len2 * diffs[1] * 0.5) / 3. + SQR(SQR(len2) * diffs[2] * 0.25) / 5.;
     }
 
     Vector3d _getDiffs(int p1, int p2, int offset) const
@@ -220,17 +291,18 @@ private:
         {
             const PrimitiveCacheData &d1 = cache1.end(offset - i);
             const PrimitiveCacheData &d2 = cache2.start(i);
+            Vector4d diff = d1.values - d2.values;
 
             //position
-            minDistSq = min(minDistSq, Vector2d(d1.x - d2.x, d1.y - d2.y).squaredNorm());
+            minDistSq = min(minDistSq, diff.head<2>().squaredNorm());
 
             //angle
-            double angleDiff = AngleUtils::toRange(d1.angle - d2.angle, -PI);
+            double angleDiff = AngleUtils::toRange(diff[2], -PI);
             minAngleDiff = min(angleDiff, minAngleDiff);
             maxAngleDiff = max(angleDiff, maxAngleDiff);
 
             //curvature
-            double cDiff = d1.curvature - d2.curvature;
+            double cDiff = diff[3];
             minCurvatureDiff = min(cDiff, minCurvatureDiff);
             maxCurvatureDiff = max(cDiff, maxCurvatureDiff);
         }
@@ -242,13 +314,9 @@ private:
         return out;
     }
 
-    struct PointData
-    {
-        double x, y, angle, curvature;
-    };
-
     const vector<FitPrimitive> &_primitives;
-    vector<PrimitiveCache> _primitiveCache;
+    const FitPrimitiveColumns &_columns;
+    vector<PrimitiveCache, Eigen::aligned_allocator<PrimitiveCache> > _primitiveCache;
     const VectorC<bool> &_corners;
 
     double _curveCost[3];
@@ -277,12 +345,25 @@ protected:
 
         out.costEvaluator = new CostEvaluator(fitter);
 
-        //create vertices
+        vector<float> vertexCosts(primitives.size());
+        for(int i = 0; i < (int)primitives.size(); ++i)
+            vertexCosts[i] = (float)out.costEvaluator->vertexCost(i);
+
+        vector<bool> pruned;
+        _prune(fitter, vertexCosts, pruned);
+
+        //create vertices--pruned primitives still get (isolated) vertices so that vertex indices match primitive indices
+        int numVertices = 0;
         out.vertices.resize(primitives.size());
         for(int i = 0; i < (int)primitives.size(); ++i)
         {
             out.vertices[i].primitiveIdx = i;            
             out.vertices[i].source = out.vertices[i].target = false;
+            out.vertices[i].cost = vertexCosts[i];
+            if(pruned[i])
+                continue;
+            ++numVertices;
+
             if(!closed)
             {
                 if(osOutput->startCurve)
@@ -295,106 +376,511 @@ protected:
                 else
                     out.vertices[i].target = (primitives[i].endIdx + 1 == pts.size());
             }
-
-            out.vertices[i].cost = (float)out.costEvaluator->vertexCost(i);
-
-            if(out.vertices[i].source && out.vertices[i].target) //one primitive over the entire curve--create dummy edge
-            {
-                Edge e;
-                e.continuity = -1;
-                e.startVtx = e.endVtx = i;
-                e.cost = out.vertices[i].cost;
-                out.vertices[i].edges.push_back((int)out.edges.size());
-                out.edges.push_back(e);
-            }
         }
 
         //create edges
         VectorC<vector<int> > curvesStartingAt(pts.size(), pts.circular());
         for(int i = 0; i < (int)primitives.size(); ++i)
-            if(!primitives[i].isStartCurve())
+            if(!primitives[i].isStartCurve() && !pruned[i])
                 curvesStartingAt[primitives[i].startIdx].push_back(i);
 
-        for(int i = 0; i < (int)primitives.size(); ++i)
+        _EdgeContext context;
+        context.columns = &fitter.output<PRIMITIVE_FITTING>()->columns;
+        context.pruned = &pruned;
+        context.curvesStartingAt = &curvesStartingAt;
+        context.vertices = &out.vertices;
+        context.costEvaluator = out.costEvaluator.get();
+        context.closed = closed;
+
+        //Edges from each contiguous chunk of start vertices go into their own buffer, and the buffers are
+        //appended in order, so edges are sorted by start vertex and the result is the same as the serial one.
+        const int verticesPerChunk = 16;
+        int numChunks = ((int)primitives.size() + verticesPerChunk - 1) / verticesPerChunk;
+        int nextVertex = 0; //first vertex whose edge offset is not set yet
+        out.edgeOffsets.resize(primitives.size() + 1);
+
+        if(fitter.params().get(Parameters::MULTITHREADED) == 0.)
         {
-            if(primitives[i].isEndCurve()) //no edges from end curves
+            vector<_NewEdge> edges;
+            for(int chunk = 0; chunk < numChunks; ++chunk)
+            {
+                edges.clear();
+                _createEdges(chunk * verticesPerChunk, min((int)primitives.size(), (chunk + 1) * verticesPerChunk), context, edges);
+                _appendEdges(edges, nextVertex, out);
+            }
+        }
+        else
+        {
+            vector<vector<_NewEdge> > chunkEdges(numChunks);
+            fitter.executor().parallelFor(numChunks, [&](int chunk)
+            {
+                _createEdges(chunk * verticesPerChunk, min((int)primitives.size(), (chunk + 1) * verticesPerChunk), context, chunkEdges[chunk]);
+            });
+
+            for(int chunk = 0; chunk < numChunks; ++chunk)
+                _appendEdges(chunkEdges[chunk], nextVertex, out);
+        }
+
+        while(nextVertex <= (int)primitives.size())
+            out.edgeOffsets[nextVertex++] = out.numEdges();
+
+        CORNU_DEBUG(printf("Graph vertices = %d (of %d primitives) edges = %d", numVertices, (int)primitives.size(), out.numEdges()));
+        FitMetrics::count(FitMetrics::GRAPH_VERTICES, numVertices);
+        FitMetrics::count(FitMetrics::GRAPH_EDGES, out.numEdges());
+    }
+
+private:
+    //Creating the edges from a start vertex only reads the context, so different start vertices can be
+    //processed concurrently.  The context holds plain pointers because smart pointer reference counts
+    //aren't safe to modify from several threads.
+    struct _EdgeContext
+    {
+        const FitPrimitiveColumns *columns;
+        const vector<bool> *pruned;
+        const VectorC<vector<int> > *curvesStartingAt;
+        const vector<Vertex, StlAllocator<Vertex> > *vertices;
+        const CostEvaluator *costEvaluator;
+        bool closed;
+    };
+
+    struct _NewEdge
+    {
+        int start;
+        int end;
+        char continuity;
+        float cost;
+    };
+
+    //appends the edges that start at vertices from through to - 1, in order of start vertex
+    void _createEdges(int from, int to, const _EdgeContext &context, vector<_NewEdge> &out) const
+    {
+        const FitPrimitiveColumns &columns = *context.columns;
+        const VectorC<vector<int> > &curvesStartingAt = *context.curvesStartingAt;
+        const vector<Vertex, StlAllocator<Vertex> > &vertices = *context.vertices;
+
+        for(int i = from; i < to; ++i)
+        {
+            if(vertices[i].source && vertices[i].target) //one primitive over the entire curve--create dummy edge
+            {
+                _NewEdge e = { i, i, -1, vertices[i].cost };
+                out.push_back(e);
+            }
+
+            if((columns.fixed[i] && columns.startIdx[i] != -1) || (*context.pruned)[i]) //no edges from end curves
                 continue;
 
-            int endIdx = primitives[i].endIdx;
-            int curve1len = primitives[i].numPts - 1;
+            int endIdx = columns.endIdx[i];
+            int curve1len = columns.numPts[i] - 1;
 
             for(int continuity = 0; continuity <= 2; ++continuity)
             {
                 int offset = continuity;
                 int startIdx = endIdx - offset;
-                if(!closed && startIdx < 0)
+                if(!context.closed && startIdx < 0)
                     continue;
                 if(curve1len <= offset * 2) //if the first curve is already too short
                     continue;
+                if(!context.costEvaluator->continuityAllowed(i, continuity)) //skip the error estimates for nothing
+                    continue;
 
-                bool firstCurveConstrained = (primitives[i].curve->getType() < continuity) || primitives[i].isFixed();
-                int minType = firstCurveConstrained ? continuity : 0;
+                bool firstCurveConstrained = (columns.type[i] < continuity) || columns.fixed[i];
 
                 for(int j = 0; j < (int)curvesStartingAt[startIdx].size(); ++j)
                 {
                     int k = curvesStartingAt[startIdx][j]; //index of the second primitive
-                    int curve2len = primitives[k].numPts - 1;
+                    int curve2len = columns.numPts[k] - 1;
                     if(curve2len <= offset * 2)
                         continue;
 
-                    bool secondCurveConstrained = (primitives[k].curve->getType() < continuity) || primitives[k].isFixed();
+                    bool secondCurveConstrained = (columns.type[k] < continuity) || columns.fixed[k];
                     if(firstCurveConstrained && secondCurveConstrained)
                         continue;
 
                     //create edge
-                    Edge e;
-                    e.startVtx = i;
-                    e.endVtx = k;
-                    e.continuity = continuity;
-                    e.cost = (float)out.costEvaluator->edgeCost(i, k, continuity);
-                    e.cost += out.vertices[i].cost * (out.vertices[i].source ? 1.f : 0.5f);
-                    e.cost += out.vertices[k].cost * (out.vertices[k].target ? 1.f : 0.5f);
-                    if(e.cost >= Parameters::infinity)
+                    float cost = (float)context.costEvaluator->edgeCost(i, k, continuity);
+                    cost += vertices[i].cost * (vertices[i].source ? 1.f : 0.5f);
+                    cost += vertices[k].cost * (vertices[k].target ? 1.f : 0.5f);
+                    if(cost >= Parameters::infinity)
                         continue;
-                    out.vertices[i].edges.push_back((int)out.edges.size());
-                    out.edges.push_back(e);
+                    _NewEdge e = { i, k, (char)continuity, cost };
+                    out.push_back(e);
+
+                    if(cost != cost)
+                        CORNU_DEBUG(printf("Error! Nan cost for edge"));
+                }
+            }
+        }
+    }
+
+    //appends edges sorted by start vertex to the graph, setting the offsets of the vertices up to the last start
+    void _appendEdges(const vector<_NewEdge> &edges, int &nextVertex, AlgorithmOutput<GRAPH_CONSTRUCTION> &out) const
+    {
+        for(int i = 0; i < (int)edges.size(); ++i)
+        {
+            while(nextVertex <= edges[i].start)
+                out.edgeOffsets[nextVertex++] = out.numEdges();
+            out.addEdge(edges[i].start, edges[i].end, edges[i].continuity, edges[i].cost);
+        }
+    }
+
+    //Marks primitives to leave out of the graph.  A primitive is dominated if another one of the same type with
+    //the same span and curvature signs costs no more and has nearly the same ends: they allow the same edges
+    //at nearly the same costs, so the cheaper one is almost always at least as good.  Then, if the graph could
+    //exceed the vertex or edge budget, only the k primitives with the lowest cost per sample (plus a few needed
+    //to keep the graph connected) are kept at each start index.  An edge goes from a primitive to one starting
+    //at most two samples before it ends, so there are then at most about 3 * k * (number of vertices) edges.
+    void _prune(const Fitter &fitter, const vector<float> &vertexCosts, vector<bool> &outPruned) const
+    {
+        const vector<FitPrimitive> &primitives = fitter.output<PRIMITIVE_FITTING>()->primitives;
+        const VectorC<Vector2d> &pts = fitter.output<RESAMPLING>()->output->pts();
+        outPruned.assign(primitives.size(), false);
+
+        //dominance: sort so that equivalent primitives are adjacent, cheapest first
+        vector<int> order;
+        for(int i = 0; i < (int)primitives.size(); ++i)
+            if(!primitives[i].isFixed())
+                order.push_back(i);
+        sort(order.begin(), order.end(), _DominanceOrder(primitives, vertexCosts));
+        double posTol = 0.25 * fitter.scaledParameter(Parameters::ERROR_THRESHOLD);
+        for(int i = 0, classStart = 0; i < (int)order.size(); ++i)
+        {
+            if(!_DominanceOrder::sameClass(primitives[order[classStart]], primitives[order[i]]))
+                classStart = i;
+            for(int j = classStart; j < i; ++j)
+            {
+                if(!outPruned[order[j]] && _similarEnds(*primitives[order[j]].curve, *primitives[order[i]].curve, posTol))
+                {
+                    outPruned[order[i]] = true;
+                    break;
+                }
+            }
+        }
+
+        //budget
+        double maxVertices = fitter.params().get(Parameters::MAX_GRAPH_VERTICES);
+        double maxEdges = fitter.params().get(Parameters::MAX_GRAPH_EDGES);
+        int numPts = max(1, pts.size());
+        double perStart = min(maxVertices / numPts, sqrt(maxEdges / (3. * numPts)));
+        int maxPerStart = max(1, (int)perStart);
+
+        VectorC<vector<int> > startingAt(pts.size(), pts.circular());
+        for(int i = 0; i < (int)primitives.size(); ++i)
+            if(!primitives[i].isFixed() && !outPruned[i])
+                startingAt[primitives[i].startIdx].push_back(i);
+
+        int numBudgetPruned = 0;
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            vector<int> &here = startingAt[i];
+            if((int)here.size() <= maxPerStart)
+                continue;
+
+            //To keep the graph connected, always keep, for each type, the shortest primitive, the shortest one long
+            //enough for a G2 edge, and one reaching the end of the curve.
+            int mustKeep[3][3] = { { -1, -1, -1 }, { -1, -1, -1 }, { -1, -1, -1 } };
+            for(int j = 0; j < (int)here.size(); ++j)
+            {
+                const FitPrimitive &prim = primitives[here[j]];
+                int *keep = mustKeep[prim.curve->getType()];
+                if(keep[0] < 0 || prim.numPts < primitives[keep[0]].numPts)
+                    keep[0] = here[j];
+                if(prim.numPts > 5 && (keep[1] < 0 || prim.numPts < primitives[keep[1]].numPts))
+                    keep[1] = here[j];
+                if(prim.endIdx + 1 == pts.size() && (keep[2] < 0 || vertexCosts[here[j]] < vertexCosts[keep[2]]))
+                    keep[2] = here[j];
+            }
 
-                    if(e.cost != e.cost)
-                        Debugging::get()->printf("Error! Nan cost for edge");
+            sort(here.begin(), here.end(), _CostPerSampleOrder(primitives, vertexCosts));
+            int kept = 0;
+            for(int j = 0; j < (int)here.size(); ++j)
+            {
+                int p = here[j];
+                bool must = false;
+                for(int k = 0; k < 9; ++k)
+                    must = must || p == mustKeep[k / 3][k % 3];
+                if(must || kept < maxPerStart)
+                {
+                    ++kept;
+                    continue;
                 }
+                outPruned[p] = true;
+                ++numBudgetPruned;
             }
         }
 
-        Debugging::get()->printf("Graph vertices = %d edges = %d", out.vertices.size(), out.edges.size());
+        if(numBudgetPruned > 0)
+            CORNU_DEBUG(printf("Graph budget: pruned %d primitives (at most %d per start point)", numBudgetPruned, maxPerStart));
+    }
+
+    //whether the curves' ends are close enough in position, angle, and curvature that edges to them would cost about the same
+    static bool _similarEnds(const CurvePrimitive &c1, const CurvePrimitive &c2, double posTol)
+    {
+        const double angleTol = 0.02;
+        double len = max(c1.length(), c2.length());
+        return (c1.startPos() - c2.startPos()).norm() < posTol && (c1.endPos() - c2.endPos()).norm() < posTol &&
+               fabs(AngleUtils::toRange(c1.startAngle() - c2.startAngle(), -PI)) < angleTol &&
+               fabs(AngleUtils::toRange(c1.endAngle() - c2.endAngle(), -PI)) < angleTol &&
+               fabs(c1.startCurvature() - c2.startCurvature()) * len < angleTol &&
+               fabs(c1.endCurvature() - c2.endCurvature()) * len < angleTol;
     }
+
+    struct _DominanceOrder
+    {
+        _DominanceOrder(const vector<FitPrimitive> &primitives, const vector<float> &costs) : _primitives(primitives), _costs(costs) {}
+
+        static bool sameClass(const FitPrimitive &p1, const FitPrimitive &p2)
+        {
+            return p1.startIdx == p2.startIdx && p1.endIdx == p2.endIdx && p1.curve->getType() == p2.curve->getType() &&
+                   p1.startCurvSign == p2.startCurvSign && p1.endCurvSign == p2.endCurvSign;
+        }
+
+        bool operator()(int i1, int i2) const
+        {
+            const FitPrimitive &p1 = _primitives[i1], &p2 = _primitives[i2];
+            if(p1.startIdx != p2.startIdx) return p1.startIdx < p2.startIdx;
+            if(p1.endIdx != p2.endIdx) return p1.endIdx < p2.endIdx;
+            if(p1.curve->getType() != p2.curve->getType()) return p1.curve->getType() < p2.curve->getType();
+            if(p1.startCurvSign != p2.startCurvSign) return p1.startCurvSign < p2.startCurvSign;
+            if(p1.endCurvSign != p2.endCurvSign) return p1.endCurvSign < p2.endCurvSign;
+            if(_costs[i1] != _costs[i2]) return _costs[i1] < _costs[i2];
+            return i1 < i2; //deterministic on ties
+        }
+
+    private:
+        const vector<FitPrimitive> &_primitives;
+        const vector<float> &_costs;
+    };
+
+    struct _CostPerSampleOrder
+    {
+        _CostPerSampleOrder(const vector<FitPrimitive> &primitives, const vector<float> &costs) : _primitives(primitives), _costs(costs) {}
+
+        bool operator()(int i1, int i2) const
+        {
+            double c1 = _costs[i1] / max(1, _primitives[i1].numPts - 1);
+            double c2 = _costs[i2] / max(1, _primitives[i2].numPts - 1);
+            if(c1 != c2) return c1 < c2;
+            return i1 < i2;
+        }
+
+    private:
+        const vector<FitPrimitive> &_primitives;
+        const vector<float> &_costs;
+    };
 };
 
-float Edge::validatedCost(const Fitter &fitter) const
+//Builds the same graph as the default and records the features and costs of its vertices and edges for training cost
+//models (see Dataset.h).  Validating every edge makes it much slower.
+class DatasetGraphConstructor : public DefaultGraphConstructor
 {
+public:
+    string name() const { return "Dataset generation"; }
+
+protected:
+    void _run(const Fitter &fitter, AlgorithmOutput<GRAPH_CONSTRUCTION> &out)
+    {
+        DefaultGraphConstructor::_run(fitter, out);
+
+        DatasetPtr dataset = new Dataset();
+        const CostEvaluator &costEvaluator = *out.costEvaluator;
+        dataset->vertices.resize(out.vertices.size());
+        for(int i = 0; i < (int)out.vertices.size(); ++i)
+        {
+            costEvaluator.vertexFeatures(i, dataset->vertices[i].features);
+            dataset->vertices[i].cost = out.vertices[i].cost;
+        }
+
+        vector<int> edges;
+        for(int i = 0; i < out.numEdges(); ++i)
+            if(out.edgeContinuity[i] >= 0)
+                edges.push_back(i);
+        dataset->edges.resize(edges.size());
+
+        TwoCurveCombineContext context(fitter);
+        auto recordEdge = [&](int j)
+        {
+            int edge = edges[j];
+            Dataset::EdgeRecord &record = dataset->edges[j];
+            record.start = out.edgeStart[edge];
+            record.end = out.edgeEnd[edge];
+            record.continuity = out.edgeContinuity[edge];
+            costEvaluator.edgeFeatures(record.start, record.end, record.continuity, record.features);
+            record.cost = out.edgeCost[edge];
+            record.validatedCost = out.validatedEdgeCost(edge, context);
+        };
+
+        if(fitter.params().get(Parameters::MULTITHREADED) == 0.)
+        {
+            for(int j = 0; j < (int)edges.size(); ++j)
+                recordEdge(j);
+        }
+        else
+            fitter.executor().parallelFor((int)edges.size(), recordEdge);
+
+        out.dataset = dataset;
+    }
+};
+
+float AlgorithmOutput<GRAPH_CONSTRUCTION>::validatedEdgeCost(int edge, const Fitter &fitter) const
+{
+    return validatedEdgeCost(edge, TwoCurveCombineContext(fitter));
+}
+
+float AlgorithmOutput<GRAPH_CONSTRUCTION>::validatedEdgeCost(int edge, const TwoCurveCombineContext &context) const
+{
+    CORNU_TRACE_SCOPE("validatedEdgeCost");
+    int startVtx = edgeStart[edge];
+    int endVtx = edgeEnd[edge];
+    int continuity = edgeContinuity[edge];
+    float cost = edgeCost[edge];
+
     if(continuity < 0) //dummy edge
         return cost;
 
-    Combination comb;
-    comb = twoCurveCombine(startVtx, endVtx, continuity, fitter);
+    double err1, err2;
+    if(!context.cache || !context.cache->find(startVtx, endVtx, continuity, err1, err2))
+    {
+        Combination comb = twoCurveCombine(startVtx, endVtx, continuity, context);
+        err1 = comb.err1;
+        err2 = comb.err2;
+        if(context.cache)
+            context.cache->insert(startVtx, endVtx, continuity, comb);
 
 #if 0
-    if(fitter.output<GRAPH_CONSTRUCTION>()->vertices[startVtx].source)
-    {
-        Debugging::get()->drawCurve(comb.c1, Debugging::Color(1, 0, 0), "Combined");
-        Debugging::get()->drawCurve(comb.c2, Debugging::Color(0.8, 0.5, 0), "Combined");
-    }
+        if(vertices[startVtx].source)
+        {
+            CORNU_DEBUG(drawCurve(comb.c1, Debugging::Color(1, 0, 0), "Combined"));
+            CORNU_DEBUG(drawCurve(comb.c2, Debugging::Color(0.8, 0.5, 0), "Combined"));
+        }
 #endif
+    }
     
     float newCost;
-     newCost = (float)fitter.output<GRAPH_CONSTRUCTION>()->costEvaluator->edgeCost(startVtx, endVtx, continuity, comb.err1, comb.err2);
+     newCost = (float)costEvaluator->edgeCost(startVtx, endVtx, continuity, err1, err2);
 
     //only increase cost
     return max(newCost, cost);
 }
 
+void AlgorithmOutput<GRAPH_CONSTRUCTION>::joinPieces(const Fitter &fitter, const vector<const AlgorithmOutput *> &pieces,
+                                                     const vector<const vector<int> *> &piecePaths, vector<int> &outPath)
+{
+    bool closed = fitter.output<CURVE_CLOSING>()->closed;
+    int numPieces = (int)pieces.size();
+    costEvaluator = new CostEvaluator(fitter);
+
+    //the first primitive of each piece comes after the primitives of the pieces before it
+    vector<int> firstPrimitive(numPieces + 1, 0);
+    for(int i = 0; i < numPieces; ++i)
+        firstPrimitive[i + 1] = firstPrimitive[i] + (int)pieces[i]->vertices.size();
+
+    //the joining edge from the end of each piece's path (a path of one primitive is a dummy edge from it to itself)
+    vector<int> joinTo(firstPrimitive.back(), -1);
+    vector<float> joinCost(firstPrimitive.back());
+    for(int i = 0; i < numPieces; ++i)
+    {
+        int next = (i + 1) % numPieces;
+        if(!closed && next == 0)
+            break;
+        const Vertex &from = pieces[i]->vertices[pieces[i]->edgeEnd[piecePaths[i]->back()]];
+        const Vertex &to = pieces[next]->vertices[pieces[next]->edgeStart[piecePaths[next]->front()]];
+        int fromIdx = from.primitiveIdx + firstPrimitive[i], toIdx = to.primitiveIdx + firstPrimitive[next];
+        bool source = from.source && !closed && i == 0, target = to.target && !closed && next + 1 == numPieces;
+
+        joinTo[fromIdx] = toIdx;
+        joinCost[fromIdx] = (float)costEvaluator->edgeCost(fromIdx, toIdx, 0);
+        joinCost[fromIdx] += from.cost * (source ? 1.f : 0.5f) + to.cost * (target ? 1.f : 0.5f);
+    }
+
+    outPath.clear();
+    for(int i = 0; i < numPieces; ++i)
+    {
+        const AlgorithmOutput &piece = *pieces[i];
+        int offset = firstPrimitive[i];
+        vector<int> edgeIdx(piece.numEdges()); //in the joined graph
+        int joiningEdge = -1;
+
+        for(int v = 0; v < (int)piece.vertices.size(); ++v)
+        {
+            Vertex vertex = piece.vertices[v];
+            vertex.primitiveIdx += offset;
+            vertex.source = vertex.source && !closed && i == 0;
+            vertex.target = vertex.target && !closed && i + 1 == numPieces;
+            vertices.push_back(vertex);
+
+            edgeOffsets.push_back(numEdges());
+            for(int e = piece.edgeOffsets[v]; e < piece.edgeOffsets[v + 1]; ++e)
+            {
+                edgeIdx[e] = numEdges();
+                addEdge(piece.edgeStart[e] + offset, piece.edgeEnd[e] + offset, piece.edgeContinuity[e], piece.edgeCost[e]);
+            }
+
+            if(joinTo[v + offset] >= 0)
+            {
+                joiningEdge = numEdges();
+                addEdge(v + offset, joinTo[v + offset], 0, joinCost[v + offset]);
+            }
+        }
+
+        for(int j = 0; j < (int)piecePaths[i]->size(); ++j)
+        {
+            int e = (*piecePaths[i])[j];
+            if(piece.edgeContinuity[e] != -1)
+                outPath.push_back(edgeIdx[e]);
+        }
+        if(joiningEdge >= 0)
+            outPath.push_back(joiningEdge);
+    }
+    edgeOffsets.push_back(numEdges());
+}
+
+size_t AlgorithmOutput<GRAPH_CONSTRUCTION>::memoryUsage() const
+{
+    return sizeof(*this) + vectorMemory(vertices) + vectorMemory(edgeOffsets) + vectorMemory(edgeStart) + vectorMemory(edgeEnd) +
+        vectorMemory(edgeContinuity) + vectorMemory(edgeCost) + (costEvaluator ? costEvaluator->memoryUsage() : 0) +
+        (dataset ? dataset->memoryUsage() : 0);
+}
+
+void AlgorithmOutput<GRAPH_CONSTRUCTION>::recycle()
+{
+    vertices.clear();
+    edgeOffsets.clear();
+    edgeStart.clear();
+    edgeEnd.clear();
+    edgeContinuity.clear();
+    edgeCost.clear();
+    costEvaluator.reset();
+    dataset.reset();
+}
+
+void AlgorithmOutput<GRAPH_CONSTRUCTION>::write(SnapshotWriter &out) const
+{
+    out.writeVector(vertices);
+    out.writeVector(edgeOffsets);
+    out.writeVector(edgeStart);
+    out.writeVector(edgeEnd);
+    out.writeVector(edgeContinuity);
+    out.writeVector(edgeCost);
+    //the dataset is not written
+}
+
+void AlgorithmOutput<GRAPH_CONSTRUCTION>::read(SnapshotReader &in, const Fitter &fitter)
+{
+    in.readVector(vertices);
+    in.readVector(edgeOffsets);
+    in.readVector(edgeStart);
+    in.readVector(edgeEnd);
+    in.readVector(edgeContinuity);
+    in.readVector(edgeCost);
+
+    if(in.ok())
+        costEvaluator = new CostEvaluator(fitter);
+}
+
 void Algorithm<GRAPH_CONSTRUCTION>::_initialize()
 {
     new DefaultGraphConstructor();
+    new DatasetGraphConstructor();
 }
 
 END_NAMESPACE_Cornu
@@ -32,30 +32,50 @@ struct Vertex
     bool source;
     bool target;
     float cost;
-
-    std::vector<int> edges; //edges that start at this vertex
-};
-
-struct Edge
-{
-    int startVtx;
-    int endVtx;
-    char continuity; //continuity = -1 for a dummy edge from a vertex to itself
-    float cost; //includes the half the cost of the vertex behind and the vertex in front (full cost for source and target vertices).
-
-    float validatedCost(const Fitter &fitter) const;
 };
 
+struct TwoCurveCombineContext;
 CORNU_SMART_FORW_DECL(Dataset);
 CORNU_SMART_FORW_DECL(CostEvaluator);
 
 template<>
 struct AlgorithmOutput<GRAPH_CONSTRUCTION> : public AlgorithmOutputBase
 {
-    std::vector<Vertex> vertices;
-    std::vector<Edge> edges;
+    //The arrays come from the fit's Allocator.
+    std::vector<Vertex, StlAllocator<Vertex> > vertices;
+
+    //The edges are stored in compressed sparse row order, with each field in its own array:
+    //the edges that start at vertex v are edgeOffsets[v] through edgeOffsets[v + 1] - 1.
+    std::vector<int, StlAllocator<int> > edgeOffsets; //one more entry than there are vertices
+    std::vector<int, StlAllocator<int> > edgeStart;
+    std::vector<int, StlAllocator<int> > edgeEnd;
+    std::vector<char, StlAllocator<char> > edgeContinuity; //continuity = -1 for a dummy edge from a vertex to itself
+    std::vector<float, StlAllocator<float> > edgeCost; //includes the half the cost of the vertex behind and the vertex in front (full cost for source and target vertices).
+
+    int numEdges() const { return (int)edgeStart.size(); }
+    void addEdge(int start, int end, char continuity, float cost)
+    {
+        edgeStart.push_back(start);
+        edgeEnd.push_back(end);
+        edgeContinuity.push_back(continuity);
+        edgeCost.push_back(cost);
+    }
+    float validatedEdgeCost(int edge, const Fitter &fitter) const;
+    float validatedEdgeCost(int edge, const TwoCurveCombineContext &context) const; //may be called from several threads at once
     CostEvaluatorPtr costEvaluator;
     DatasetPtr dataset; //only if the algorithm selected is dataset generation
+
+    //Builds the graph of the whole curve from the graphs of pieces fit separately (see Parameters::SPLIT_AT_CORNERS),
+    //whose primitives are, in order, the ones the fitter has.  Each piece's path, given as edges of its graph, is
+    //joined to the next one's with a G0 edge (the last to the first if the curve is closed), and the path through
+    //the whole graph goes into outPath.
+    void joinPieces(const Fitter &fitter, const std::vector<const AlgorithmOutput *> &pieces,
+                    const std::vector<const std::vector<int> *> &piecePaths, std::vector<int> &outPath);
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
@@ -0,0 +1,122 @@
+/*--
+    IncrementalFitter.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "IncrementalFitter.h"
+#include "Fitter.h"
+#include "Oversketcher.h"
+#include "Polyline.h"
+#include "PrimitiveSequence.h"
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+void IncrementalFitter::clear()
+{
+    _pts.clear();
+    _curve = PrimitiveSequenceConstPtr();
+    _parameters.clear();
+    _numFitPts = 0;
+}
+
+PrimitiveSequenceConstPtr IncrementalFitter::update()
+{
+    if(_pts.size() == _numFitPts)
+        return _curve;
+
+    //The refit starts this far back along the sketch from the last fitted point, so that
+    //the oversketcher sees it start on the current curve and has room for the transition.
+    const double overlap = 4. * _params.get(Parameters::OVERSKETCH_THRESHOLD);
+
+    int tailStart = _numFitPts - 1;
+    double overlapLength = 0.;
+    while(tailStart > 0 && overlapLength < overlap)
+    {
+        overlapLength += (_pts[tailStart] - _pts[tailStart - 1]).norm();
+        --tailStart;
+    }
+
+    if(!_curve || overlapLength < overlap || _curve->length() < 2. * overlap || !_fitTail(tailStart))
+        _fitAll();
+
+    _numFitPts = _pts.size();
+    return _curve;
+}
+
+void IncrementalFitter::_fitAll()
+{
+    _curve = PrimitiveSequenceConstPtr();
+    _parameters.clear();
+    if(_pts.size() < 2)
+        return;
+
+    _fitter.reset();
+    _fitter.setParams(_params);
+    _fitter.setOriginalSketch(new Polyline(_pts));
+    _fitter.run();
+
+    _curve = _fitter.finalOutput();
+    if(_curve)
+        _parameters = _fitter.originalSketchToFinalParameters();
+}
+
+bool IncrementalFitter::_fitTail(int tailStart)
+{
+    VectorC<Vector2d> tail(_pts.size() - tailStart, NOT_CIRCULAR);
+    for(int i = 0; i < tail.size(); ++i)
+        tail[i] = _pts[tailStart + i];
+
+    _fitter.reset();
+    _fitter.setParams(_params);
+    _fitter.setOversketchBase(_curve);
+    _fitter.setOriginalSketch(new Polyline(tail));
+    _fitter.run();
+
+    //the tail must replace the end of the current curve and nothing else
+    PrimitiveSequenceConstPtr result = _fitter.finalOutput();
+    smart_ptr<const AlgorithmOutput<OVERSKETCHING> > osOutput = _fitter.output<OVERSKETCHING>();
+    if(!result || !osOutput->toPrepend || osOutput->toAppend)
+        return false;
+
+    //The combiner's sketch-to-curve parameters are not reliable when a start curve is given,
+    //so the tail points are projected onto the result instead.  The final solve with a fixed
+    //start curve can also occasionally go astray on a short tail--accept the result only if
+    //the tail points are still close to the curve.
+    vector<double> tailParameters(tail.size());
+    const double maxDist = 2. * _fitter.scaledParameter(Parameters::ERROR_THRESHOLD);
+    for(int i = 0; i < tail.size(); ++i)
+    {
+        tailParameters[i] = result->project(tail[i]);
+        if((result->pos(tailParameters[i]) - tail[i]).squaredNorm() > SQR(maxDist))
+            return false;
+    }
+
+    //the parameters of the points before the tail are unchanged, except where the curve was peeled back
+    _parameters.resize(_pts.size());
+    for(int i = 0; i < tailStart; ++i)
+        _parameters[i] = min(_parameters[i], tailParameters[0]);
+    for(int i = tailStart; i < _pts.size(); ++i)
+        _parameters[i] = tailParameters[i - tailStart];
+
+    _curve = result;
+    return true;
+}
+
+END_NAMESPACE_Cornu
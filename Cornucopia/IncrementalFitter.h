@@ -0,0 +1,81 @@
+/*--
+    IncrementalFitter.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_INCREMENTALFITTER_H_INCLUDED
+#define CORNUCOPIA_INCREMENTALFITTER_H_INCLUDED
+
+#include "defs.h"
+#include "Parameters.h"
+#include "Fitter.h"
+#include "VectorC.h"
+#include "smart_ptr.h"
+#include "PointQueue.h"
+
+NAMESPACE_Cornu
+
+CORNU_SMART_FORW_DECL(PrimitiveSequence);
+
+/*
+    Fits a sketch while it is still being drawn.  Points are appended with addPoint(s) and update()
+    refits only the end of the stroke: the curve fitted so far is used as the oversketch base for the
+    new points plus a short overlap, so the cost of an update depends on the number of new points rather
+    than on the length of the whole stroke.  The result approximates fitting the whole sketch at once--
+    for the final curve, run a regular Fitter on the finished sketch.  When the points arrive on another
+    thread, e.g., pen samples, that thread pushes them into a PointQueue and the fitting thread calls
+    update(queue).
+*/
+class IncrementalFitter
+{
+public:
+    IncrementalFitter() : _numFitPts(0) {}
+
+    const Parameters &params() const { return _params; }
+    void setParams(const Parameters &params) { _params = params; clear(); }
+
+    void clear(); //starts a new sketch
+    void addPoint(const Eigen::Vector2d &pt) { _pts.push_back(pt); }
+    void addPoints(const VectorC<Eigen::Vector2d> &pts) { _pts.insert(_pts.end(), pts.begin(), pts.end()); }
+    const VectorC<Eigen::Vector2d> &points() const { return _pts; }
+
+    //fits the points added since the last update and returns the curve for the whole sketch (null if fitting failed)
+    PrimitiveSequenceConstPtr update();
+    //adds all the points waiting in the queue and updates once, however many there were
+    PrimitiveSequenceConstPtr update(PointQueue &queue) { queue.popAll(_pts); return update(); }
+
+    PrimitiveSequenceConstPtr curve() const { return _curve; }
+    //for each point fitted so far, its parameter on curve()
+    const std::vector<double> &originalSketchToFinalParameters() const { return _parameters; }
+
+private:
+    void _fitAll();
+    bool _fitTail(int tailStart); //returns false if the tail does not continue the current curve
+
+    Parameters _params;
+    VectorC<Eigen::Vector2d> _pts;
+    Fitter _fitter; //reused by every update, so its buffers are only allocated once
+
+    PrimitiveSequenceConstPtr _curve;
+    std::vector<double> _parameters;
+    int _numFitPts; //how many points _curve was fit to
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_INCREMENTALFITTER_H_INCLUDED
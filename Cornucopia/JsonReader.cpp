@@ -0,0 +1,237 @@
+/*--
+    JsonReader.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "JsonReader.h"
+
+#include <cctype>
+#include <limits>
+#include <locale>
+#include <sstream>
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+static bool isWordChar(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '+' || c == '-' || c == '.' || c == '_';
+}
+
+static bool equalsNoCase(const char *begin, const char *end, const char *word)
+{
+    for(; begin < end && *word; ++begin, ++word)
+    {
+        if(tolower((unsigned char)*begin) != *word)
+            return false;
+    }
+    return begin == end && !*word;
+}
+
+bool JsonReader::parseNumber(const char *begin, const char *end, double &out)
+{
+    const char *pos = begin;
+    bool negative = pos < end && *pos == '-';
+    if(pos < end && (*pos == '-' || *pos == '+'))
+        ++pos;
+
+    if(equalsNoCase(pos, end, "inf") || equalsNoCase(pos, end, "infinity"))
+    {
+        out = negative ? -numeric_limits<double>::infinity() : numeric_limits<double>::infinity();
+        return true;
+    }
+    if(equalsNoCase(pos, end, "nan"))
+    {
+        out = numeric_limits<double>::quiet_NaN();
+        return true;
+    }
+
+    //Up to 15 significant digits and a power of 10 up to 22 are both exact in a double, so one multiplication or
+    //division rounds correctly.  That covers the points DemoUI writes; anything longer goes to the slow path.
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool anyDigits = false, fast = true;
+    for(; pos < end && *pos >= '0' && *pos <= '9'; ++pos)
+    {
+        anyDigits = true;
+        if(mantissa == 0 && *pos == '0')
+            continue;
+        if(++digits > 15)
+            fast = false;
+        mantissa = mantissa * 10 + (*pos - '0');
+    }
+    if(pos < end && *pos == '.')
+    {
+        for(++pos; pos < end && *pos >= '0' && *pos <= '9'; ++pos)
+        {
+            anyDigits = true;
+            if(mantissa == 0 && *pos == '0')
+            {
+                --exponent;
+                continue;
+            }
+            if(++digits > 15)
+                fast = false;
+            mantissa = mantissa * 10 + (*pos - '0');
+            --exponent;
+        }
+    }
+    if(!anyDigits)
+        return false;
+    if(pos < end && (*pos == 'e' || *pos == 'E'))
+    {
+        ++pos;
+        bool negativeExponent = pos < end && *pos == '-';
+        if(pos < end && (*pos == '-' || *pos == '+'))
+            ++pos;
+        if(pos == end || *pos < '0' || *pos > '9')
+            return false;
+        int written = 0;
+        for(; pos < end && *pos >= '0' && *pos <= '9'; ++pos)
+            written = min(written * 10 + (*pos - '0'), 100000);
+        exponent += negativeExponent ? -written : written;
+    }
+    if(pos != end)
+        return false;
+
+    static const double powersOf10[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+                                           1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    if(fast && mantissa == 0)
+        out = 0.;
+    else if(fast && exponent >= -22 && exponent <= 22)
+        out = exponent < 0 ? double(mantissa) / powersOf10[-exponent] : double(mantissa) * powersOf10[exponent];
+    else
+    {
+        istringstream in(string(begin, end));
+        in.imbue(locale::classic());
+        in >> out;
+        if(in.fail()) //out of range
+            out = exponent > 0 ? numeric_limits<double>::infinity() : 0.;
+        else
+            return true; //has the sign
+    }
+    if(negative)
+        out = -out;
+    return true;
+}
+
+void JsonReader::_skipSeparators()
+{
+    while(_pos < _end && (isspace((unsigned char)*_pos) || *_pos == ',' || *_pos == ':'))
+        ++_pos;
+}
+
+JsonReader::Token JsonReader::peek()
+{
+    _skipSeparators();
+    if(_pos == _end)
+        return END;
+    switch(*_pos)
+    {
+    case '[': return BEGIN_ARRAY;
+    case ']': return END_ARRAY;
+    case '{': return BEGIN_OBJECT;
+    case '}': return END_OBJECT;
+    case '"': return STRING;
+    }
+    return isWordChar(*_pos) ? WORD : ERROR; //a WORD may turn out to be a NUMBER
+}
+
+JsonReader::Token JsonReader::next()
+{
+    _token = peek();
+    switch(_token)
+    {
+    case BEGIN_ARRAY:
+    case END_ARRAY:
+    case BEGIN_OBJECT:
+    case END_OBJECT:
+        ++_pos;
+        break;
+    case STRING:
+        _text.clear();
+        for(++_pos; _pos < _end && *_pos != '"'; ++_pos)
+        {
+            if(*_pos == '\\' && _pos + 1 < _end) //escapes other than \" and \\ don't occur in .cnc files
+                ++_pos;
+            _text += *_pos;
+        }
+        if(_pos == _end)
+            _token = ERROR;
+        else
+            ++_pos;
+        break;
+    case WORD:
+    {
+        const char *start = _pos;
+        while(_pos < _end && isWordChar(*_pos))
+            ++_pos;
+        if(parseNumber(start, _pos, _number))
+            _token = NUMBER;
+        else
+            _text.assign(start, _pos);
+        break;
+    }
+    default:
+        break;
+    }
+    return _token;
+}
+
+bool JsonReader::skipRest()
+{
+    int depth = (_token == BEGIN_ARRAY || _token == BEGIN_OBJECT) ? 1 : 0;
+    while(depth > 0)
+    {
+        Token token = next();
+        if(token == BEGIN_ARRAY || token == BEGIN_OBJECT)
+            ++depth;
+        else if(token == END_ARRAY || token == END_OBJECT)
+            --depth;
+        else if(token == END || token == ERROR)
+            return false;
+    }
+    return _token != END && _token != ERROR;
+}
+
+bool JsonReader::readNumbers(vector<double> &out)
+{
+    out.clear();
+    while(next() == NUMBER)
+        out.push_back(_number);
+    return _token == END_ARRAY;
+}
+
+bool JsonReader::readPoints(VectorC<Vector2d> &out)
+{
+    out.clear();
+    double x = 0.;
+    bool haveX = false;
+    while(next() == NUMBER)
+    {
+        if(haveX)
+            out.push_back(Vector2d(x, _number));
+        else
+            x = _number;
+        haveX = !haveX;
+    }
+    return _token == END_ARRAY && !haveX;
+}
+
+END_NAMESPACE_Cornu
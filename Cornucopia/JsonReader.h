@@ -0,0 +1,85 @@
+/*--
+    JsonReader.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_JSONREADER_H_INCLUDED
+#define CORNUCOPIA_JSONREADER_H_INCLUDED
+
+#include "defs.h"
+#include "VectorC.h"
+
+#include <string>
+#include <vector>
+
+NAMESPACE_Cornu
+
+/*
+    Reads JSON, such as the .cnc files DemoUI saves, a token at a time without building a tree of values.  Arrays
+    of numbers, like the points of a sketch, can be read straight into buffers.  Commas and colons are not checked,
+    so an object's members come as a STRING for the name followed by the value.  Numbers are read the same way
+    whatever the C locale is (Qt sets the user's), and inf, infinity and nan are read as numbers because that is
+    how infinite parameters are written.  Other bare words (true, false, null) are WORDs.
+*/
+class JsonReader
+{
+public:
+    enum Token
+    {
+        BEGIN_ARRAY,
+        END_ARRAY,
+        BEGIN_OBJECT,
+        END_OBJECT,
+        STRING,
+        NUMBER,
+        WORD,
+        END, //of the text
+        ERROR
+    };
+
+    JsonReader(const char *begin, const char *end) : _pos(begin), _end(end), _token(ERROR), _number(0.) {}
+
+    Token next();
+    Token peek();
+    Token token() const { return _token; } //the last one next returned
+    const std::string &text() const { return _text; } //of a STRING or a WORD
+    double number() const { return _number; }
+
+    //After the first token of a value, skips the rest of it.  Returns false on an error or the end of the text.
+    bool skipRest();
+
+    //After BEGIN_ARRAY, read the numbers up to and including END_ARRAY.  They return false if there is anything
+    //else in the array, or, for readPoints, an odd number of numbers, which are x, y pairs.
+    bool readNumbers(std::vector<double> &out);
+    bool readPoints(VectorC<Eigen::Vector2d> &out);
+
+    static bool parseNumber(const char *begin, const char *end, double &out); //returns false if it isn't one
+
+private:
+    void _skipSeparators();
+
+    const char *_pos;
+    const char *_end;
+    Token _token;
+    std::string _text;
+    double _number;
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_JSONREADER_H_INCLUDED
@@ -69,6 +69,16 @@ void Line::eval(double s, Vec *pos, Vec *der, Vec *der2) const
         *der2 = Vec::Zero();
 }
 
+void Line::evalBatch(const VectorXd &s, Matrix2Xd *pos, Matrix2Xd *der, Matrix2Xd *der2) const
+{
+    if(pos)
+        (*pos) = _startPos().replicate(1, s.size()) + _der * s.transpose();
+    if(der)
+        (*der) = _der.replicate(1, s.size());
+    if(der2)
+        (*der2) = Matrix2Xd::Zero(2, s.size());
+}
+
 void Line::trim(double sFrom, double sTo)
 {
     Vec newStart = _startPos() + sFrom * _der;
@@ -88,7 +98,16 @@ void Line::flip()
 
 void Line::derivativeAt(double s, ParamDer &out, ParamDer &outTan) const
 {
-    outTan = out = ParamDer::Zero(2, 4);
+    FixedParamDer fixedOut, fixedOutTan;
+    derivativeAtFixed(s, fixedOut, fixedOutTan);
+    out = fixedOut;
+    outTan = fixedOutTan;
+}
+
+void Line::derivativeAtFixed(double s, FixedParamDer &out, FixedParamDer &outTan) const
+{
+    out.setZero();
+    outTan.setZero();
     out(0, X) = 1;
     out(1, Y) = 1;
     out(0, ANGLE) = -s * _der(1);
@@ -36,6 +36,7 @@ public:
 
     //overrides
     void eval(double s, Vec *pos, Vec *der = NULL, Vec *der2 = NULL) const;
+    void evalBatch(const Eigen::VectorXd &s, Eigen::Matrix2Xd *pos, Eigen::Matrix2Xd *der = NULL, Eigen::Matrix2Xd *der2 = NULL) const;
 
     double project(const Vec &point) const;
 
@@ -52,13 +53,17 @@ public:
 
     PrimitiveType getType() const { return LINE; }
 
+    enum { NUM_PARAMS = 4 };
+    typedef Fixed<NUM_PARAMS>::ParamVec FixedParamVec;
+    typedef Fixed<NUM_PARAMS>::ParamDer FixedParamDer;
+
     void trim(double sFrom, double sTo);
     void flip();
     CurvePrimitivePtr clone() const { LinePtr out = new Line(); out->setParams(_params); return out; }
     void derivativeAt(double s, ParamDer &out, ParamDer &outTan) const;
+    void derivativeAtFixed(double s, FixedParamDer &out, FixedParamDer &outTan) const; //non-virtual, statically sized
     void derivativeAtEnd(int continuity, EndDer &out) const;
 
-    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 protected:
     //override
     void _paramsChanged() { _der = Vec(cos(_startAngle()), sin(_startAngle())); }
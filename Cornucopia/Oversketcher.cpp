@@ -24,6 +24,8 @@
 #include "PrimitiveSequence.h"
 #include "PiecewiseLinearUtils.h"
 #include "Polyline.h"
+#include "Clothoid.h"
+#include "Snapshot.h"
 
 using namespace std;
 using namespace Eigen;
@@ -118,7 +120,7 @@ protected:
         PiecewiseLinearMonotone prevToCur(PiecewiseLinearMonotone::POSITIVE);
 
         //construct the transitions
-        VectorC<Vector2d> cur = curve->trimmed(startSketchTransition, endSketchTransition)->pts();
+        VectorC<Vector2d> cur = curve->trimmedPts(startSketchTransition, endSketchTransition);
         VectorC<Vector2d> pre, post;
         if(startClose)
         {
@@ -145,7 +147,7 @@ protected:
         pre.insert(pre.end(), cur.begin(), cur.end());
         pre.insert(pre.end(), post.begin(), post.end());
         out.output = new Polyline(pre);
-        prevToCur.batchEval(out.parameters);
+        out.parameters = new ParameterMap(out.parameters, std::move(prevToCur));
 
         //construct the trimmed toAppend and toPrepend curves
         if(base->isClosed() || (startClose && endClose && startBaseTransition > endBaseTransition))
@@ -170,16 +172,16 @@ protected:
             }
         }
 
-        Debugging::get()->drawCurve(base, Debugging::Color(0, 0, 0), "Base Curve", 1., Debugging::DASHED);
-        Debugging::get()->drawCurve(out.output, Debugging::Color(1, 0, 1), "Oversketch Modified");
+        CORNU_DEBUG(drawCurve(base, Debugging::Color(0, 0, 0), "Base Curve", 1., Debugging::DASHED));
+        CORNU_DEBUG(drawCurve(out.output, Debugging::Color(1, 0, 1), "Oversketch Modified"));
         if(out.startCurve)
-            Debugging::get()->drawPrimitive(out.startCurve, "Start Curve", 0, 2);
+            CORNU_DEBUG(drawPrimitive(out.startCurve, "Start Curve", 0, 2));
         if(out.endCurve)
-            Debugging::get()->drawPrimitive(out.endCurve, "End Curve", 0, 2);
+            CORNU_DEBUG(drawPrimitive(out.endCurve, "End Curve", 0, 2));
         if(out.toAppend)
-            Debugging::get()->drawCurve(out.toAppend, Debugging::Color(1, 0, 0), "To Append");
+            CORNU_DEBUG(drawCurve(out.toAppend, Debugging::Color(1, 0, 0), "To Append"));
         if(out.toPrepend)
-            Debugging::get()->drawCurve(out.toPrepend, Debugging::Color(1, 0, 0), "To Prepend");
+            CORNU_DEBUG(drawCurve(out.toPrepend, Debugging::Color(1, 0, 0), "To Prepend"));
     }
 
     static VectorC<Vector2d> buildTransition(CurveConstPtr from, CurveConstPtr to, double fromStart, double fromEnd, double toStart, double toEnd, int numSteps)
@@ -206,6 +208,50 @@ protected:
     }
 };
 
+size_t AlgorithmOutput<OVERSKETCHING>::memoryUsage() const
+{
+    size_t out = sizeof(*this) + (output ? output->memoryUsage() : 0) + (parameters ? parameters->memoryUsage() : 0);
+    out += ((startCurve ? 1 : 0) + (endCurve ? 1 : 0)) * sizeof(Clothoid);
+    out += (toAppend ? toAppend->memoryUsage() : 0) + (toPrepend ? toPrepend->memoryUsage() : 0);
+    return out;
+}
+
+void AlgorithmOutput<OVERSKETCHING>::recycle()
+{
+    output.reset();
+    parameters.reset();
+    startCurve.reset();
+    endCurve.reset();
+    toAppend.reset();
+    toPrepend.reset();
+}
+
+void AlgorithmOutput<OVERSKETCHING>::write(SnapshotWriter &out) const
+{
+    out.writePolyline(output);
+    out.writeParameterMap(parameters);
+    out.writeCurve(startCurve);
+    out.writeCurve(endCurve);
+    out.writeInt(startContinuity);
+    out.writeInt(endContinuity);
+    out.writeCurves(toAppend);
+    out.writeCurves(toPrepend);
+    out.writeBool(finallyClose);
+}
+
+void AlgorithmOutput<OVERSKETCHING>::read(SnapshotReader &in, const Fitter &)
+{
+    output = in.readPolyline();
+    parameters = in.readParameterMap();
+    startCurve = in.readCurve();
+    endCurve = in.readCurve();
+    startContinuity = in.readInt();
+    endContinuity = in.readInt();
+    toAppend = in.readCurves();
+    toPrepend = in.readCurves();
+    finallyClose = in.readBool();
+}
+
 void Algorithm<OVERSKETCHING>::_initialize()
 {
     new DefaultOversketcher();
@@ -28,12 +28,13 @@ NAMESPACE_Cornu
 
 CORNU_SMART_FORW_DECL(Polyline);
 CORNU_SMART_FORW_DECL(PrimitiveSequence);
+CORNU_SMART_FORW_DECL(ParameterMap);
 
 template<>
 struct AlgorithmOutput<OVERSKETCHING> : public AlgorithmOutputBase
 {
     PolylineConstPtr output;
-    std::vector<double> parameters; //parameters[i] is the parameter in output of the original point with index i
+    ParameterMapConstPtr parameters; //maps the original point with index i to its parameter in output
     CurvePrimitiveConstPtr startCurve;
     CurvePrimitiveConstPtr endCurve;
     int startContinuity;
@@ -41,6 +42,11 @@ struct AlgorithmOutput<OVERSKETCHING> : public AlgorithmOutputBase
     PrimitiveSequenceConstPtr toAppend;
     PrimitiveSequenceConstPtr toPrepend;
     bool finallyClose;
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
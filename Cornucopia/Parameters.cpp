@@ -25,67 +25,111 @@ using namespace std;
 using namespace Eigen;
 NAMESPACE_Cornu
 
+//The description of a parameter, with the stages that read it (see Parameters::Parameter)
+struct ParameterDesc
+{
+    Parameters::ParameterType type;
+    const char *name;
+    double min, max, defaultVal;
+    bool infinityAllowed;
+    int stage;
+    int zeroOrInfinityStage;
+};
+
+static constexpr ParameterDesc userParameter(Parameters::ParameterType type, const char *name, double min, double max, double defaultVal,
+                                             int stage, int zeroOrInfinityStage = NUM_ALGORITHM_STAGES)
+{
+    return ParameterDesc { type, name, min, max, defaultVal, true, stage, zeroOrInfinityStage < stage ? zeroOrInfinityStage : stage };
+}
+
+static constexpr ParameterDesc internalParameter(Parameters::ParameterType type, const char *name, double value, int stage)
+{
+    return ParameterDesc { type, name, value, value, value, false, stage, stage };
+}
+
+//All the parameters, in ParameterType order, with the stage that first reads each one.  The table is constant
+//data, so constructing and comparing Parameters objects doesn't wait for anything to be built on first use.
+static constexpr ParameterDesc parameterDescs[] =
+{
+    userParameter(Parameters::LINE_COST, "Line cost", 0., 20., 7.5, GRAPH_CONSTRUCTION, PRIMITIVE_FITTING),
+    userParameter(Parameters::ARC_COST, "Arc cost", 0., 30., 9., GRAPH_CONSTRUCTION, PRIMITIVE_FITTING),
+    userParameter(Parameters::CLOTHOID_COST, "Clothoid cost", 0., 50., 15., GRAPH_CONSTRUCTION, PRIMITIVE_FITTING),
+    userParameter(Parameters::G0_COST, "G0 cost", 0., 50., Parameters::infinity, GRAPH_CONSTRUCTION),
+    userParameter(Parameters::G1_COST, "G1 cost", 0., 50., Parameters::infinity, GRAPH_CONSTRUCTION),
+    userParameter(Parameters::G2_COST, "G2 cost", 0., 50., 0., GRAPH_CONSTRUCTION),
+    userParameter(Parameters::ERROR_COST, "Error cost", 0., 10., 1., GRAPH_CONSTRUCTION),
+    userParameter(Parameters::SHORTNESS_COST, "Shortness cost", 0., 10., 2., GRAPH_CONSTRUCTION),
+    userParameter(Parameters::INFLECTION_COST, "Inflection cost", 0., 100., 20., GRAPH_CONSTRUCTION, PRIMITIVE_FITTING),
+
+    userParameter(Parameters::INTERNAL_PARAMETERS_MARKER, "NOT A PARAMETER", 0., 0., 0., NUM_ALGORITHM_STAGES),
+    internalParameter(Parameters::PIXEL_SIZE, "Pixel size", 1., SCALE_DETECTION),
+    internalParameter(Parameters::SMALL_CURVE_PIXELS, "Small curve pixels", 200., SCALE_DETECTION),
+    internalParameter(Parameters::LARGE_CURVE_PIXELS, "Large curve pixels", 500., SCALE_DETECTION),
+    internalParameter(Parameters::MAX_RESCALE, "Max rescale", 2., SCALE_DETECTION),
+    internalParameter(Parameters::MIN_PRELIM_LENGTH, "Min prelim length", 2., PRELIM_RESAMPLING),
+    internalParameter(Parameters::DP_CUTOFF, "Douglas-Peucker cutoff", 3., PRELIM_RESAMPLING),
+    internalParameter(Parameters::CLOSEDNESS_THRESHOLD, "Closedness threshold", 20., CURVE_CLOSING),
+    internalParameter(Parameters::MINIMUM_CORNER_SPACING, "Min corner spacing", 5., CORNER_DETECTION),
+    internalParameter(Parameters::CORNER_NEIGHBORHOOD, "Corner neighborhood", 15., CORNER_DETECTION),
+    internalParameter(Parameters::DENSE_SAMPLING_STEP, "Dense sampling step", 1., CORNER_DETECTION),
+    internalParameter(Parameters::CORNER_SCALES, "Num corner scales (int)", 5., CORNER_DETECTION),
+    internalParameter(Parameters::CORNER_THRESHOLD, "Corner angle threshold", 0.78539816339744830962, CORNER_DETECTION), //PI / 4
+    internalParameter(Parameters::MAX_SAMPLING_INTERVAL, "Maximum sampling interval", 50., RESAMPLING),
+    internalParameter(Parameters::CURVATURE_ESTIMATE_REGION, "Curvature estimate region", 20., RESAMPLING),
+    internalParameter(Parameters::POINTS_PER_CIRCLE, "Points per circle", 20., RESAMPLING),
+    internalParameter(Parameters::MAX_SAMPLE_RATE_SLOPE, "Max sample rate slope", 0.4, RESAMPLING),
+    internalParameter(Parameters::ERROR_THRESHOLD, "Error Threshold", 4., PRIMITIVE_FITTING),
+    internalParameter(Parameters::SHORTNESS_THRESHOLD, "Shortness Threshold", 50., GRAPH_CONSTRUCTION),
+    internalParameter(Parameters::TWO_CURVE_CURVATURE_ADJUST, "Two-Curve Adjustment Point", 2., GRAPH_CONSTRUCTION),
+    internalParameter(Parameters::CURVE_ADJUST_DAMPING, "Curve Adjust Damping", 1., PRIMITIVE_FITTING),
+    internalParameter(Parameters::COMBINE_DAMPING, "Combine Damping", 2., COMBINING),
+    internalParameter(Parameters::OVERSKETCH_THRESHOLD, "Oversketch Threshold", 15., OVERSKETCHING),
+    internalParameter(Parameters::MULTITHREADED, "Multithreaded (bool)", 0., NUM_ALGORITHM_STAGES),
+    internalParameter(Parameters::MAX_GRAPH_VERTICES, "Max graph vertices", 20000., GRAPH_CONSTRUCTION),
+    internalParameter(Parameters::MAX_GRAPH_EDGES, "Max graph edges", 300000., GRAPH_CONSTRUCTION),
+    internalParameter(Parameters::SPLIT_AT_CORNERS, "Split at corners (bool)", 0., PRIMITIVE_FITTING),
+    internalParameter(Parameters::NUM_ALTERNATIVES, "Num alternatives (int)", 1., PATH_FINDING),
+    internalParameter(Parameters::SINGLE_PRECISION_FRONT_END, "Single precision front end (bool)", 0., CORNER_DETECTION),
+    internalParameter(Parameters::ERROR_BATCH_SIZE, "Error batch size (int)", 1., PRIMITIVE_FITTING),
+    internalParameter(Parameters::INPUT_DECIMATION, "Input decimation", 0.5, PRELIM_RESAMPLING)
+};
+static const int numParameters = sizeof(parameterDescs) / sizeof(parameterDescs[0]);
+static_assert(numParameters == Parameters::INPUT_DECIMATION + 1, "every parameter needs a description");
+
 Parameters::Parameters(const string &name)
-: _name(name), _algorithms(NUM_ALGORITHM_STAGES, 0)
+: _name(name), _values(numParameters), _algorithms(NUM_ALGORITHM_STAGES, 0)
 {
-    _initializeParameters();
-    _values.resize(_parameters.size());
-    for(int i = 0; i < (int)_parameters.size(); ++i)
-        _values[i] = _parameters[i].defaultVal;
+    for(int i = 0; i < numParameters; ++i)
+        _values[i] = parameterDescs[i].defaultVal;
 }
 
 void Parameters::_initializeParameters()
 {
-    static bool initialized = false;
-    if(initialized)
-        return;
-    initialized = true;
-
-    _parameters.push_back(Parameter(LINE_COST, "Line cost", 0., 20., 7.5));
-    _parameters.push_back(Parameter(ARC_COST, "Arc cost", 0., 30., 9.));
-    _parameters.push_back(Parameter(CLOTHOID_COST, "Clothoid cost", 0., 50., 15.));
-    _parameters.push_back(Parameter(G0_COST, "G0 cost", 0., 50., infinity));
-    _parameters.push_back(Parameter(G1_COST, "G1 cost", 0., 50., infinity));
-    _parameters.push_back(Parameter(G2_COST, "G2 cost", 0., 50., 0.));
-    _parameters.push_back(Parameter(ERROR_COST, "Error cost", 0., 10., 1.));
-    _parameters.push_back(Parameter(SHORTNESS_COST, "Shortness cost", 0., 10., 2.));
-    _parameters.push_back(Parameter(INFLECTION_COST, "Inflection cost", 0., 100., 20.));
-
-    _parameters.push_back(Parameter(INTERNAL_PARAMETERS_MARKER, "NOT A PARAMETER", 0., 0., 0.));
-    _parameters.push_back(Parameter(PIXEL_SIZE, "Pixel size", 1.));
-    _parameters.push_back(Parameter(SMALL_CURVE_PIXELS, "Small curve pixels", 200.));
-    _parameters.push_back(Parameter(LARGE_CURVE_PIXELS, "Large curve pixels", 500.));
-    _parameters.push_back(Parameter(MAX_RESCALE, "Max rescale", 2.));
-    _parameters.push_back(Parameter(MIN_PRELIM_LENGTH, "Min prelim length", 2.));
-    _parameters.push_back(Parameter(DP_CUTOFF, "Douglas-Peucker cutoff", 3.));
-    _parameters.push_back(Parameter(CLOSEDNESS_THRESHOLD, "Closedness threshold", 20.));
-    _parameters.push_back(Parameter(MINIMUM_CORNER_SPACING, "Min corner spacing", 5.));
-    _parameters.push_back(Parameter(CORNER_NEIGHBORHOOD, "Corner neighborhood", 15.));
-    _parameters.push_back(Parameter(DENSE_SAMPLING_STEP, "Dense sampling step", 1.));
-    _parameters.push_back(Parameter(CORNER_SCALES, "Num corner scales (int)", 5.));
-    _parameters.push_back(Parameter(CORNER_THRESHOLD, "Corner angle threshold", PI * 0.25));
-    _parameters.push_back(Parameter(MAX_SAMPLING_INTERVAL, "Maximum sampling interval", 50.));
-    _parameters.push_back(Parameter(CURVATURE_ESTIMATE_REGION, "Curvature estimate region", 20.));
-    _parameters.push_back(Parameter(POINTS_PER_CIRCLE, "Points per circle", 20.));
-    _parameters.push_back(Parameter(MAX_SAMPLE_RATE_SLOPE, "Max sample rate slope", 0.4));
-    _parameters.push_back(Parameter(ERROR_THRESHOLD, "Error Threshold", 4.));
-    _parameters.push_back(Parameter(SHORTNESS_THRESHOLD, "Shortness Threshold", 50.));
-    _parameters.push_back(Parameter(TWO_CURVE_CURVATURE_ADJUST, "Two-Curve Adjustment Point", 2.));
-    _parameters.push_back(Parameter(CURVE_ADJUST_DAMPING, "Curve Adjust Damping", 1.));
-    _parameters.push_back(Parameter(REDUCE_GRAPH_EVERY, "Reduce Graph Every", 10.));
-    _parameters.push_back(Parameter(COMBINE_DAMPING, "Combine Damping", 2.));
-    _parameters.push_back(Parameter(OVERSKETCH_THRESHOLD, "Oversketch Threshold", 15.));
+    static const bool initialized = _buildParameters(); //function-local static initialization is thread-safe
+    (void)initialized;
 }
 
 void Parameters::_initializePresets()
 {
-    static bool initialized = false;
-    if(initialized)
-        return;
-    initialized = true;
+    static const bool initialized = _buildPresets();
+    (void)initialized;
+}
 
-    _initializeParameters();
+bool Parameters::_buildParameters()
+{
+    for(int i = 0; i < numParameters; ++i)
+    {
+        const ParameterDesc &desc = parameterDescs[i];
+        Parameter param(desc.type, desc.name, desc.min, desc.max, desc.defaultVal, desc.infinityAllowed);
+        param.stage = desc.stage;
+        param.zeroOrInfinityStage = desc.zeroOrInfinityStage;
+        _parameters.push_back(param);
+    }
+    return true;
+}
 
+bool Parameters::_buildPresets()
+{
     _presets.resize(NUM_PRESETS);
 
     //default
@@ -138,9 +182,42 @@ void Parameters::_initializePresets()
     co.set(LINE_COST, infinity);
     co.set(ARC_COST, infinity);
     _presets[CLOTHOID_ONLY] = co;
+
+    return true;
+}
+
+static int zeroOrInfinity(double val)
+{
+    return val <= 0. ? 0 : (val >= Parameters::infinity ? 2 : 1);
+}
+
+int Parameters::firstAffectedStage(const Parameters &params1, const Parameters &params2)
+{
+    int out = NUM_ALGORITHM_STAGES;
+    for(int i = 0; i < NUM_ALGORITHM_STAGES; ++i)
+    {
+        if(params1._algorithms[i] != params2._algorithms[i])
+        {
+            out = i;
+            break;
+        }
+    }
+
+    for(int i = 0; i < numParameters; ++i)
+    {
+        double val1 = params1._values[i], val2 = params2._values[i];
+        if(val1 == val2)
+            continue;
+        if(zeroOrInfinity(val1) != zeroOrInfinity(val2))
+            out = min(out, parameterDescs[i].zeroOrInfinityStage);
+        else
+            out = min(out, parameterDescs[i].stage);
+    }
+
+    return out;
 }
 
-const double Parameters::infinity = 1e30;
+constexpr double Parameters::infinity;
 vector<Parameters::Parameter> Parameters::_parameters;
 vector<Parameters> Parameters::_presets;
 
@@ -73,9 +73,16 @@ public:
         SHORTNESS_THRESHOLD, //Primitives below this length are considered "short" for the purposes of the shortness cost
         TWO_CURVE_CURVATURE_ADJUST, //When combining two curves and matching their curvature, how much to compensate with the curvature at the opposite endpoints
         CURVE_ADJUST_DAMPING, //How much regularization is added to the solver for edge validation--increasing this makes the solver more stable, but converge slower
-        REDUCE_GRAPH_EVERY, //How many invalid paths are found before the A* heuristic is recomputed.  Setting this too high or too low hurts performance.
         COMBINE_DAMPING, //How much regularization is added to the solver for the final combine--increasing this makes the solver more stable, but converge slower
-        OVERSKETCH_THRESHOLD //How far the endpoints need to be from the base curve for them to be considered on the curve
+        OVERSKETCH_THRESHOLD, //How far the endpoints need to be from the base curve for them to be considered on the curve
+        MULTITHREADED, //If nonzero, stages that support it split their work over the global thread pool.  The results are the same as single-threaded.
+        MAX_GRAPH_VERTICES, //Budget for the number of primitives in the shortest path graph.  Long, smooth curves that exceed it keep the cheapest primitives per sample.
+        MAX_GRAPH_EDGES, //Budget for the number of edges in the shortest path graph.  Decreasing these budgets bounds the running time, but may hurt quality.
+        SPLIT_AT_CORNERS, //If nonzero, the pieces between corners get their own primitives, graphs, and paths (concurrently if multithreaded), which are joined with G0 edges for combining.
+        NUM_ALTERNATIVES, //If above one, the path finder also finds the next cheapest paths of other structures, up to this many paths in all, as alternative fits (see Fitter::alternativeOutput).
+        SINGLE_PRECISION_FRONT_END, //If nonzero, corner detection smooths its dense samples in single precision, which is enough for tablet input.  The curves and the later stages stay in double precision.
+        ERROR_BATCH_SIZE, //If above one, the primitive fitter fits this many candidates from a start point ahead and has the fitter's error backend (see Fitter::setErrorBackend) evaluate them together, instead of warm-starting each one's error from the last.
+        INPUT_DECIMATION //Preliminary resampling first drops the input points that are closer than this many (scaled) pixels to the last point kept, so high-rate stylus input doesn't slow it down.  Zero keeps every point.
     };
 
     enum Preset
@@ -114,24 +121,38 @@ public:
     struct Parameter
     {
         Parameter(ParameterType inType, const std::string &inName, double inMin, double inMax, double inDefault, bool inInfinityAllowed = true)
-            : type(inType), typeName(inName), min(inMin), max(inMax), defaultVal(inDefault), infinityAllowed(inInfinityAllowed) {}
+            : type(inType), typeName(inName), min(inMin), max(inMax), defaultVal(inDefault), infinityAllowed(inInfinityAllowed), stage(0), zeroOrInfinityStage(0) {}
         Parameter(ParameterType inType, const std::string &inName, double inValue) //for internal parameters
-            : type(inType), typeName(inName), min(inValue), max(inValue), defaultVal(inValue), infinityAllowed(false) {}
+            : type(inType), typeName(inName), min(inValue), max(inValue), defaultVal(inValue), infinityAllowed(false), stage(0), zeroOrInfinityStage(0) {}
 
         ParameterType type;
         std::string typeName;
         double min, max, defaultVal;
         bool infinityAllowed;
+
+        //The first fitting stage (an AlgorithmStage) whose output depends on the value--changing the parameter
+        //invalidates this stage and all later ones.  Some stages only check whether the value is zero, infinite,
+        //or in between (e.g., the primitive fitter skips lines if their cost is infinite): the first of those
+        //is zeroOrInfinityStage.  NUM_ALGORITHM_STAGES is used for parameters that do not affect the output.
+        int stage;
+        int zeroOrInfinityStage;
     };
 
-    static const double infinity;
+    static constexpr double infinity = 1e30;
 
     static const std::vector<Parameter> &parameters() { _initializeParameters(); return _parameters; }
     static const std::vector<Parameters> &presets() { _initializePresets(); return _presets; }
 
+    //returns the earliest fitting stage whose output may differ between the two sets of parameters
+    //(NUM_ALGORITHM_STAGES if none)
+    static int firstAffectedStage(const Parameters &params1, const Parameters &params2);
+
 private:
-    static void _initializeParameters(); 
-    static void _initializePresets(); 
+    //thread-safe, build the static data only once (constructing Parameters objects doesn't need it)
+    static void _initializeParameters();
+    static void _initializePresets();
+    static bool _buildParameters();
+    static bool _buildPresets();
     static std::vector<Parameter> _parameters;
     static std::vector<Parameters> _presets;
 };
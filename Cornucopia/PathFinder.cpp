@@ -24,8 +24,15 @@
 #include "CurvePrimitive.h"
 #include "Preprocessing.h"
 #include "Fitter.h"
+#include "TwoCurveCombine.h"
+#include "FitMetrics.h"
+#include "Trace.h"
+#include "Snapshot.h"
 
 #include <queue>
+#include <set>
+#include <algorithm>
+#include <climits>
 
 using namespace std;
 using namespace Eigen;
@@ -34,178 +41,584 @@ NAMESPACE_Cornu
 struct PathFindingVertexData
 {
     PathFindingVertexData()
-        : distance(0.), finished(false), prevEdge(-1), source(false), target(false), fixed(false), numIncoming(0), numOutgoing(0)
+        : distance(0.), potential(0.), finished(false), queued(false), prevEdge(-1), source(false), target(false), fixed(false),
+          freeSign(false), startSign(1), endSign(1), numIncoming(0), numOutgoing(0)
     {
     }
 
     double distance;
+    double potential; //cost of the cheapest way to a target, ignoring edges that cross the cut, if any
     bool finished;
+    bool queued; //for repairing the potential
     int prevEdge;
     bool source;
     bool target;
     bool fixed;
+    bool freeSign; //a line that takes the curvature sign of this state
+    signed char startSign, endSign; //curvature signs
     int numIncoming, numOutgoing;
     CurvePrimitive::PrimitiveType primitiveType;
 };
 
-class PathFindingEdgeData
+/*
+    The path finder searches a graph of states rather than of the graph's vertices directly.  A line has no
+    curvature, so with inflection accounting, it continues the curvature sign of whatever it is G2 continuous with,
+    and an inflection is charged where the sign changes along the path.  Rather than fitting every line twice with
+    opposite signs, each (not fixed) line vertex is split into a state for each sign, and the graph's edges into and
+    out of it are repeated for each state, with the inflection cost added where the signs differ.  The graph edge
+    costs leave out inflections at lines (see CostEvaluator::edgeCost), and the states of an edge share its
+    validation, since combining the curves doesn't depend on the sign of a line.  Other vertices have one state.
+    The states of a vertex are numbered consecutively and in vertex order, so the order of the states along the
+    curve is that of the vertices.
+*/
+
+class PathFindingGraph
 {
 public:
-    PathFindingEdgeData(const Edge *edge)
-        : _edge(edge), _validated(false), _cost(_edge->cost), _reducedCost(0)
+    PathFindingGraph(const AlgorithmOutput<GRAPH_CONSTRUCTION> &graph, const Fitter &fitter)
+        : _graph(graph), _fitter(fitter), _combineContext(fitter)
     {
-        _ignore = _cost >= Parameters::infinity;
+        _multithreaded = (fitter.params().get(Parameters::MULTITHREADED) != 0.);
+        _inflectionCost = fitter.params().get(Parameters::INFLECTION_COST);
+        _numValidations = 0;
+        _numInvalidations = 0;
+
+        const FitPrimitiveColumns &primitives = _fitter.output<PRIMITIVE_FITTING>()->columns;
+        int numVertices = (int)graph.vertices.size();
+        int numEdges = graph.numEdges();
+
+        //the states of vertex v are firstState[v] through firstState[v + 1] - 1
+        vector<int> firstState(numVertices + 1);
+        for(int v = 0; v < numVertices; ++v)
+        {
+            firstState[v] = (int)_vData.size();
+            CurvePrimitive::PrimitiveType type = (CurvePrimitive::PrimitiveType)primitives.type[v];
+            bool split = _inflectionCost > 0. && type == CurvePrimitive::LINE && !primitives.fixed[v];
+            for(int sign = 1; sign >= (split ? -1 : 1); sign -= 2)
+            {
+                PathFindingVertexData data;
+                data.fixed = primitives.fixed[v];
+                data.primitiveType = type;
+                data.freeSign = split;
+                data.startSign = (signed char)(split ? sign : primitives.startCurvSign[v]);
+                data.endSign = (signed char)(split ? sign : primitives.endCurvSign[v]);
+                _vData.push_back(data);
+                _stateVertex.push_back(v);
+            }
+        }
+        firstState[numVertices] = (int)_vData.size();
+
+        //only the costs, which validation may increase, and the flags are kept per graph edge
+        _flags.assign(numEdges, 0);
+        for(int i = 0; i < numEdges; ++i)
+        {
+            if(graph.edgeCost[i] >= Parameters::infinity)
+                _flags[i] = IGNORED;
+        }
+
+        //the edges between states, grouped by start state
+        _outOffsets.assign(1, 0);
+        for(int v = 0; v < numVertices; ++v)
+        {
+            for(int src = firstState[v]; src < firstState[v + 1]; ++src)
+            {
+                for(int e = graph.edgeOffsets[v]; e < graph.edgeOffsets[v + 1]; ++e)
+                {
+                    int w = graph.edgeEnd[e];
+                    for(int tgt = firstState[w]; tgt < firstState[w + 1]; ++tgt)
+                    {
+                        if(graph.edgeContinuity[e] < 0 && tgt != src) //a dummy edge stays in its state
+                            continue;
+                        _edgeStart.push_back(src);
+                        _edgeEnd.push_back(tgt);
+                        _edgeOf.push_back(e);
+                        _cost.push_back(graph.edgeCost[e] + _inflectionCostOf((int)_edgeStart.size() - 1));
+                    }
+                }
+                _outOffsets.push_back((int)_edgeStart.size());
+            }
+        }
+
+        int numStateEdges = (int)_edgeStart.size();
+        for(int i = 0; i < numStateEdges; ++i)
+        {
+            _vData[_edgeStart[i]].numOutgoing++;
+            _vData[_edgeEnd[i]].numIncoming++;
+        }
+
+        //incoming edges and the state edges of each graph edge, in the same compressed form as the outgoing ones
+        _inOffsets.assign(_vData.size() + 1, 0);
+        for(size_t i = 0; i < _vData.size(); ++i)
+            _inOffsets[i + 1] = _inOffsets[i] + _vData[i].numIncoming;
+        _inEdges.resize(numStateEdges);
+        vector<int> next(_inOffsets.begin(), _inOffsets.end() - 1);
+        for(int i = 0; i < numStateEdges; ++i)
+            _inEdges[next[_edgeEnd[i]]++] = i;
+
+        _stateEdgeOffsets.assign(numEdges + 1, 0);
+        for(int i = 0; i < numStateEdges; ++i)
+            _stateEdgeOffsets[_edgeOf[i] + 1]++;
+        for(int i = 0; i < numEdges; ++i)
+            _stateEdgeOffsets[i + 1] += _stateEdgeOffsets[i];
+        _stateEdges.resize(numStateEdges);
+        next.assign(_stateEdgeOffsets.begin(), _stateEdgeOffsets.end() - 1);
+        for(int i = 0; i < numStateEdges; ++i)
+            _stateEdges[next[_edgeOf[i]]++] = i;
     }
 
-    bool validate(const Fitter &fitter)
+    vector<int> shortestPath() { return _toGraphEdges(_shortestStatePath()); }
+
+    //Yen's algorithm on the state graph: each next path is the cheapest that leaves the last one found at some state
+    //by an edge no path found so far with the same beginning takes there.  The ways to the target from those states
+    //are read off the potentials and validated like the shortest path, so the validated costs are shared by all
+    //paths and the paths are the cheapest under the validated costs.  Paths of the same structure, i.e., sequence of
+    //primitive types and continuities, count as one, the cheapest.  Returns up to count paths of distinct
+    //structures, cheapest first and starting with the shortest path, and their costs.  The search gives up after a
+    //number of paths proportional to count, so long curves, whose cheapest other paths mostly shift breakpoints,
+    //don't enumerate all of those.
+    vector<vector<int> > alternativePaths(int count, vector<double> &costs)
     {
-        if(_validated)
-            return true;
-        _validated = true;
-        float newCost = _edge->validatedCost(fitter);
-        if(newCost > _cost)
+        CORNU_TRACE_SCOPE("PathFindingGraph::alternativePaths");
+        vector<vector<int> > out;
+        costs.clear();
+        vector<vector<int> > found(1, _shortestStatePath());
+        if(found[0].empty())
+            return out;
+
+        set<vector<int> > structures;
+        set<vector<int> > seen(found.begin(), found.end());
+        set<pair<double, vector<int> > > candidates;
+        structures.insert(_structure(found[0]));
+        out.push_back(_toGraphEdges(found[0]));
+        costs.push_back(_pathCost(found[0]));
+
+        while((int)out.size() < count && (int)found.size() < count * _pathsPerAlternative && !_outOfTime())
         {
-            //Debugging::get()->printf("Inv");
-            _reducedCost += newCost - _cost;
-            _cost = newCost;
-            return false;
+            const vector<int> last = found.back();
+            for(int i = 0; i < (int)last.size() && !_outOfTime(); ++i)
+            {
+                if(i > 0 && _ignored(last[i - 1])) //later validations ruled out the beginning
+                    break;
+                vector<int> excluded;
+                for(int j = 0; j < (int)found.size(); ++j)
+                {
+                    if((int)found[j].size() > i && equal(last.begin(), last.begin() + i, found[j].begin()))
+                        excluded.push_back(found[j][i]);
+                }
+
+                vector<int> path(last.begin(), last.begin() + i);
+                if(!_validDeviation(path, _edgeStart[last[i]], excluded))
+                    continue;
+                if(seen.insert(path).second)
+                    candidates.insert(make_pair(_pathCost(path), path));
+            }
+
+            //candidates are validated, but later validations may have ruled out some of their edges
+            while(!candidates.empty() && _anyIgnored(candidates.begin()->second))
+                candidates.erase(candidates.begin());
+            if(candidates.empty())
+                break;
+            found.push_back(candidates.begin()->second);
+            candidates.erase(candidates.begin());
+            if(structures.insert(_structure(found.back())).second)
+            {
+                out.push_back(_toGraphEdges(found.back()));
+                costs.push_back(_pathCost(found.back()));
+            }
         }
-        //Debugging::get()->printf("Val");
-        return true;
+
+        CORNU_DEBUG(printf("Found %d alternatives among %d paths, %d validations", out.size(), found.size(), _numValidations));
+        return out;
     }
 
-    bool ignore() const { return _ignore; }
-    void setIgnore() { _ignore = true; }
-    double cost() const { return _cost; }
-    double reducedCost() const { return _reducedCost; }
-    void reduce(double by) { _reducedCost = _cost - (float)by; }
+    //A cycle around the curve covers every sample, so it goes through one of the vertices whose primitives cover
+    //the sample covered by the fewest.  The cheapest cycle is therefore the cheapest of the cheapest cycles through
+    //each of those.  The potentials with the graph cut at a candidate give a lower bound on its cycle, and
+    //validation only raises costs, so candidates are tried cheapest bound first and most never need a search.
+    vector<int> shortestCycle()
+    {
+        CORNU_TRACE_SCOPE("PathFindingGraph::shortestCycle");
+        vector<int> candidates = _cutCandidates();
 
-private:
-    const Edge *_edge; //the actual edge in the graph
-    bool _validated;
-    bool _ignore;
-    float _cost;
-    float _reducedCost;
-};
+        vector<pair<double, int> > bounds;
+        for(int i = 0; i < (int)candidates.size(); ++i)
+            bounds.push_back(make_pair(_cycleBound(candidates[i]), candidates[i]));
+        sort(bounds.begin(), bounds.end());
 
-class PathFindingGraph
-{
-public:
-    PathFindingGraph(const vector<Vertex> &vertices, const vector<Edge> &edges, const Fitter &fitter)
-        : _vertices(vertices), _edges(edges), _fitter(fitter)
-    {
-        const vector<FitPrimitive> &primitives = _fitter.output<PRIMITIVE_FITTING>()->primitives;
+        vector<int> best; //starting from the previous cycle, which prunes the candidates that can't be cheaper
+        double bestCost = _previousCycleCost(best);
+        int searched = 0;
 
-        _vData.resize(vertices.size());
-        _eData.reserve(edges.size());
-        for(size_t i = 0; i < edges.size(); ++i)
-            _eData.push_back(PathFindingEdgeData(&(edges[i])));
-        for(size_t i = 0; i < vertices.size(); ++i)
+        for(int i = 0; i < (int)bounds.size() && bounds[i].first < bestCost && !(!best.empty() && _outOfTime()); ++i)
         {
-            _vData[i].numOutgoing = (int)vertices[i].edges.size();
-            _vData[i].fixed = primitives[i].isFixed();
-            _vData[i].primitiveType = primitives[i].curve->getType();
+            int vertex = bounds[i].second;
+            if(_cycleBound(vertex) >= bestCost) //costs may have gone up since the bound was computed
+                continue;
+            ++searched;
+
+            vector<int> sources(1, vertex);
+            _vData[vertex].source = _vData[vertex].target = true;
+
+            vector<int> sp;
+            _initPotentials(sources, vertex);
+            for(int j = 0; j < _maxIter; ++j)
+            {
+                sp = _shortestPath(sources, bestCost);
+                if(sp.empty() || _validatePath(sp) || _outOfTime())
+                    break;
+            }
+
+            _vData[vertex].source = _vData[vertex].target = false;
+
+            double total = 0;
+            for(int j = 0; j < (int)sp.size(); ++j)
+                total += _cost[sp[j]];
+            if(!sp.empty() && total < bestCost)
+            {
+                bestCost = total;
+                best = sp;
+            }
         }
-        for(size_t i = 0; i < edges.size(); ++i)
-            _vData[edges[i].endVtx].numIncoming++;
+
+        //debugging output
+        CORNU_DEBUG(printf("Found cycle, len = %d, cost = %lf, searched %d of %d cut vertices, %d validations",
+                           best.size(), bestCost, searched, candidates.size(), _numValidations));
+
+        return _toGraphEdges(best);
     }
 
-    vector<int> shortestPath()
+    int numValidations() const { return _numValidations; }
+    int numInvalidations() const { return _numInvalidations; }
+
+private:
+    static const int _maxIter = 10000;
+    static const int _pathsPerAlternative = 10;
+
+    //the cheapest validated path from a source to a target, as state edges, leaving the potentials on the uncut graph
+    vector<int> _shortestStatePath()
     {
+        CORNU_TRACE_SCOPE("PathFindingGraph::shortestPath");
         vector<int> sources;
-        for(int i = 0; i < (int)_vertices.size(); ++i)
+        for(int i = 0; i < (int)_vData.size(); ++i)
         {
-            if(_vertices[i].source)
+            const Vertex &vertex = _graph.vertices[_stateVertex[i]];
+            if(vertex.source)
                 sources.push_back(i);
-            _vData[i].source = _vertices[i].source;
-            _vData[i].target = _vertices[i].target;
+            _vData[i].source = vertex.source;
+            _vData[i].target = vertex.target;
         }
 
-        int reduceEvery = max(1, (int)_fitter.params().get(Parameters::REDUCE_GRAPH_EVERY));
         vector<int> sp;
 
+        _initPotentials(sources, -1);
+        vector<int> previousEdges = _previousGraphEdges();
+        vector<int> previous = _cheapestStates(previousEdges, false);
         for(int i = 0; i < _maxIter; ++i)
         {
-            if(i % reduceEvery == 0)
-                _reduceForPath(sources);
+            sp = _pathFromPotentials();
 
-            sp = _shortestPath(sources);
-
-            if(_validatePath(sp))
+            //Once no path is cheaper than the previous one, it's a shortest path if validation doesn't make it more
+            //expensive.  When time runs out, it's a better answer than the last path found, which isn't validated.
+            if(!previous.empty() && (_sourcePotential >= _pathCost(previous) || _outOfTime()))
+            {
+                if(_validatePath(previous))
+                {
+                    sp = previous;
+                    break;
+                }
+                previous = _cheapestStates(previousEdges, false);
+                continue;
+            }
+            if(_validatePath(sp) || _outOfTime())
                 break;
         }
 
         //debugging output
-        double total = 0;
-        for(int j = 0; j < (int)sp.size(); ++j)
-            total += _eData[sp[j]].cost();
-        Debugging::get()->printf("Found path, len = %d, cost = %lf", sp.size(), total);
+        if(CORNU_DEBUGGING_ON)
+        {
+            double total = 0;
+            for(int j = 0; j < (int)sp.size(); ++j)
+                total += _cost[sp[j]];
+            CORNU_DEBUG(printf("Found path, len = %d, cost = %lf, %d validations", sp.size(), total, _numValidations));
+        }
 
         return sp;
     }
 
-    vector<int> shortestCycle()
+    vector<int> _toGraphEdges(const vector<int> &stateEdges) const
+    {
+        vector<int> out(stateEdges.size());
+        for(int i = 0; i < (int)stateEdges.size(); ++i)
+            out[i] = _edgeOf[stateEdges[i]];
+        return out;
+    }
+
+    //the inflection cost the graph edge cost leaves out, charged where a line's sign differs from its G2 neighbor's
+    double _inflectionCostOf(int edge) const
+    {
+        const PathFindingVertexData &src = _vData[_edgeStart[edge]];
+        const PathFindingVertexData &tgt = _vData[_edgeEnd[edge]];
+        if(_graph.edgeContinuity[_edgeOf[edge]] < 2 || !(src.freeSign || tgt.freeSign) || src.endSign == tgt.startSign)
+            return 0.;
+        return _inflectionCost;
+    }
+
+    //Past the fitter's deadline, the search stops with the last path it found.  That path is only missing
+    //validation of some edges, so it connects the ends like any other.  The search also stops if the fit is
+    //cancelled, in which case the fitter discards the path.
+    bool _outOfTime() const
+    {
+        if(_fitter.cancelled())
+            return true;
+        if(!_fitter.pastDeadline())
+            return false;
+        FitMetrics::count(FitMetrics::DEADLINE_STOPS);
+        return true;
+    }
+
+    //the connected states whose primitives cover the sample covered by the fewest of them
+    vector<int> _cutCandidates() const
     {
-        //start with the vertex that has an edge both cheap and with very connected vertices
-        double minEdgeCost = Parameters::infinity;
-        size_t bestEdge = 0;
+        const vector<FitPrimitive> &primitives = *_combineContext.primitives;
+        int numSamples = _combineContext.numSampledPts;
 
-        for(size_t i = 0; i < _eData.size(); ++i)
+        //count the primitives covering each sample with a difference array
+        vector<int> coverChange(numSamples + 1, 0);
+        for(int i = 0; i < (int)_vData.size(); ++i)
         {
-            double cost = _eData[i].cost() - double(_vData[_edges[i].startVtx].numIncoming) * _vData[_edges[i].endVtx].numOutgoing;
-            if(cost < minEdgeCost)
+            if(_vData[i].numIncoming == 0 || _vData[i].numOutgoing == 0)
+                continue;
+            const FitPrimitive &primitive = primitives[_stateVertex[i]];
+            int start = primitive.startIdx;
+            int end = start + min(primitive.numPts, numSamples);
+            coverChange[start]++;
+            if(end <= numSamples)
+                coverChange[end]--;
+            else
             {
-                minEdgeCost = cost;
-                bestEdge = i;
+                coverChange[numSamples]--;
+                coverChange[0]++;
+                coverChange[end - numSamples]--;
             }
         }
 
-        vector<int> sources(1, _edges[bestEdge].startVtx);
-
-        int reduceEvery = max(1, (int)_fitter.params().get(Parameters::REDUCE_GRAPH_EVERY));
-
-        vector<int> sp;
-
-        for(int iter = 0; iter < 2; ++iter)
+        int bestSample = 0;
+        int minCover = INT_MAX;
+        for(int i = 0, cover = 0; i < numSamples; ++i)
         {
-            _vData[sources[0]].source = _vData[sources[0]].target = true;
-
-            for(int i = 0; i < _maxIter; ++i)
+            cover += coverChange[i];
+            if(cover < minCover)
             {
-                if(i % reduceEvery == 0)
-                    _reduceForCycle(sources[0]);
+                minCover = cover;
+                bestSample = i;
+            }
+        }
 
-                sp = _shortestPath(sources);
+        vector<int> out;
+        for(int i = 0; i < (int)_vData.size(); ++i)
+        {
+            if(_vData[i].numIncoming == 0 || _vData[i].numOutgoing == 0)
+                continue;
+            const FitPrimitive &primitive = primitives[_stateVertex[i]];
+            int offset = (bestSample - primitive.startIdx + numSamples) % numSamples;
+            if(offset < primitive.numPts)
+                out.push_back(i);
+        }
+        return out;
+    }
 
-                if(sp.empty()) //should not happen
-                    return sp;
+    //a lower bound on the cost of any cycle through the vertex, given the current costs
+    double _cycleBound(int vertex)
+    {
+        vector<int> sources(1, vertex);
+        _vData[vertex].source = _vData[vertex].target = true;
+        _initPotentials(sources, vertex);
+        _vData[vertex].source = _vData[vertex].target = false;
+        return _sourcePotential;
+    }
 
-                if(_validatePath(sp))
-                    break;
+    //the graph edges of the previous path (see Fitter::previousPath), or none if some edge isn't in this graph
+    vector<int> _previousGraphEdges() const
+    {
+        const vector<Fitter::PathEdge> &previous = _fitter.previousPath();
+        vector<int> out(previous.size(), -1);
+        for(int i = 0; i < (int)previous.size(); ++i)
+        {
+            const Fitter::PathEdge &pathEdge = previous[i];
+            if(pathEdge.start < 0 || pathEdge.start >= (int)_graph.vertices.size())
+                return vector<int>();
+            for(int e = _graph.edgeOffsets[pathEdge.start]; e < _graph.edgeOffsets[pathEdge.start + 1] && out[i] < 0; ++e)
+            {
+                if(_graph.edgeEnd[e] == pathEdge.end && _graph.edgeContinuity[e] == pathEdge.continuity)
+                    out[i] = e;
             }
+            if(out[i] < 0)
+                return vector<int>();
+        }
+        return out;
+    }
 
-            _vData[sources[0]].source = _vData[sources[0]].target = false;
+    //The previous cycle as state edges, validated, and its cost, or an empty cycle and infinity if it isn't one
+    //in this graph.  The potentials are left cut at its first state.
+    double _previousCycleCost(vector<int> &out)
+    {
+        CORNU_TRACE_SCOPE("PathFindingGraph::previousCycle");
+        vector<int> edges = _previousGraphEdges();
+        out = _cheapestStates(edges, true);
+        if(out.empty())
+            return Parameters::infinity;
+
+        int cut = _edgeStart[out[0]];
+        _vData[cut].source = _vData[cut].target = true;
+        _initPotentials(vector<int>(1, cut), cut);
+        if(!_validatePath(out)) //some edges got more expensive, which may change the cheapest states
+            out = _cheapestStates(edges, true);
+        _vData[cut].source = _vData[cut].target = false;
+        return out.empty() ? Parameters::infinity : _pathCost(out);
+    }
 
-            sources[0] = _edges[sp[sp.size() / 2]].endVtx; //the new source is the middlemost vertex
+    double _pathCost(const vector<int> &path) const
+    {
+        double out = 0.;
+        for(int i = 0; i < (int)path.size(); ++i)
+            out += _cost[path[i]];
+        return out;
+    }
 
-            //debugging output
-            double total = 0;
-            for(int j = 0; j < (int)sp.size(); ++j)
-                total += _eData[sp[j]].cost();
-            Debugging::get()->printf("Found cycle, len = %d, cost = %lf", sp.size(), total);
+    bool _anyIgnored(const vector<int> &path) const
+    {
+        for(int i = 0; i < (int)path.size(); ++i)
+            if(_ignored(path[i]))
+                return true;
+        return false;
+    }
+
+    //the primitive types along the path and the continuities between them, in which alternatives differ
+    vector<int> _structure(const vector<int> &path) const
+    {
+        vector<int> out;
+        for(int i = 0; i < (int)path.size(); ++i)
+        {
+            out.push_back(_vData[_edgeStart[path[i]]].primitiveType);
+            out.push_back(_graph.edgeContinuity[_edgeOf[path[i]]]);
         }
+        if(!path.empty() && _graph.edgeContinuity[_edgeOf[path.back()]] >= 0)
+            out.push_back(_vData[_edgeEnd[path.back()]].primitiveType);
+        return out;
+    }
 
-        return sp;
+    //Appends to the validated path ending at the given state the cheapest way from it to a target that doesn't start
+    //with an excluded edge, such that the whole path is valid.  Returns false if there's none or time runs out.
+    bool _validDeviation(vector<int> &path, int state, const vector<int> &excluded)
+    {
+        int rootSize = (int)path.size();
+        for(int i = 0; i < _maxIter && !_outOfTime(); ++i)
+        {
+            path.resize(rootSize);
+            if(!_followPotentials(state, excluded, path))
+                return false;
+            if(_validatePath(path))
+                return true;
+            if(_anyIgnored(vector<int>(path.begin(), path.begin() + rootSize)))
+                return false;
+        }
+        return false;
     }
 
-private:
-    static const int _maxIter = 10000;
+    //The cheapest chain of states along the given graph edges under the current costs, as state edges, or an empty
+    //one if there's none.  A path goes from a source to a target; a cycle ends in the state it starts from.
+    vector<int> _cheapestStates(const vector<int> &edges, bool cycle) const
+    {
+        vector<int> best;
+        double bestCost = Parameters::infinity;
+        if(edges.empty())
+            return best;
+
+        //for each step, the cost of the cheapest chain ending in each of its graph edge's state edges, and the
+        //chain's state edge in the step before
+        int numSteps = (int)edges.size();
+        vector<vector<pair<double, int> > > chains(numSteps);
+        for(int first = _stateEdgeOffsets[edges[0]]; first < _stateEdgeOffsets[edges[0] + 1]; ++first)
+        {
+            int firstEdge = _stateEdges[first];
+            if(_ignored(firstEdge) || (!cycle && !_vData[_edgeStart[firstEdge]].source))
+                continue;
+
+            for(int k = 0; k < numSteps; ++k)
+            {
+                int offset = _stateEdgeOffsets[edges[k]];
+                chains[k].assign(_stateEdgeOffsets[edges[k] + 1] - offset, make_pair(Parameters::infinity, -1));
+                for(int j = 0; j < (int)chains[k].size(); ++j)
+                {
+                    int edge = _stateEdges[offset + j];
+                    if(_ignored(edge))
+                        continue;
+                    if(k == 0)
+                    {
+                        if(edge == firstEdge)
+                            chains[k][j] = make_pair((double)_cost[edge], -1);
+                        continue;
+                    }
+                    for(int i = 0; i < (int)chains[k - 1].size(); ++i)
+                    {
+                        double cost = chains[k - 1][i].first + _cost[edge];
+                        if(_edgeEnd[_stateEdges[_stateEdgeOffsets[edges[k - 1]] + i]] == _edgeStart[edge] && cost < chains[k][j].first)
+                            chains[k][j] = make_pair(cost, i);
+                    }
+                }
+            }
+
+            int last = _stateEdgeOffsets[edges.back()];
+            for(int j = 0; j < (int)chains.back().size(); ++j)
+            {
+                int end = _edgeEnd[_stateEdges[last + j]];
+                if(chains.back()[j].first >= bestCost || !(cycle ? end == _edgeStart[firstEdge] : _vData[end].target))
+                    continue;
+                bestCost = chains.back()[j].first;
+                best.resize(numSteps);
+                for(int k = numSteps - 1, i = j; k >= 0; i = chains[k--][i].second)
+                    best[k] = _stateEdges[_stateEdgeOffsets[edges[k]] + i];
+            }
+        }
+        return best;
+    }
 
+    //validates the graph edges of the path's edges, repairing the potentials if any became more expensive
     bool _validatePath(const vector<int> &path)
     {
+        CORNU_TRACE_SCOPE("PathFindingGraph::validatePath");
         bool valid = true;
-        for(int i = 0; i < (int)path.size(); ++i)
-            valid = _eData[path[i]].validate(_fitter) && valid;
+        vector<int> changed; //graph edges whose cost went up or that are now ignored
+        if(_multithreaded)
+        {
+            //Every edge on the path gets validated, so the solves for the ones not validated yet are
+            //run concurrently and their costs applied in path order, as the serial loop would.
+            vector<int> edges;
+            for(int i = 0; i < (int)path.size(); ++i)
+                if(!(_flags[_edgeOf[path[i]]] & VALIDATED))
+                    edges.push_back(_edgeOf[path[i]]);
+
+            vector<float> newCosts(edges.size());
+            _fitter.executor().parallelFor((int)edges.size(), [&](int i)
+            {
+                newCosts[i] = _graph.validatedEdgeCost(edges[i], _combineContext);
+            });
+
+            for(int i = 0; i < (int)edges.size(); ++i)
+            {
+                if(!_setValidatedCost(edges[i], newCosts[i]))
+                    changed.push_back(edges[i]);
+            }
+        }
+        else
+        {
+            for(int i = 0; i < (int)path.size(); ++i)
+            {
+                if(!_validate(_edgeOf[path[i]]))
+                    changed.push_back(_edgeOf[path[i]]);
+            }
+        }
+        valid = changed.empty();
 
         //line-clothoid-line
         if(valid)
@@ -214,131 +627,194 @@ private:
             for(int i = 0; i < last; ++i)
             {
                 int ni = (i + 1) % path.size();
-                if(_edges[path[i]].continuity != 2 || _edges[path[ni]].continuity != 2)
+                if(_graph.edgeContinuity[_edgeOf[path[i]]] != 2 || _graph.edgeContinuity[_edgeOf[path[ni]]] != 2)
                     continue;
-                if(!_vData[_edges[path[i]].startVtx].fixed && _vData[_edges[path[i]].startVtx].primitiveType != CurvePrimitive::LINE)
+                if(!_vData[_edgeStart[path[i]]].fixed && _vData[_edgeStart[path[i]]].primitiveType != CurvePrimitive::LINE)
                     continue;
-                if(!_vData[_edges[path[ni]].endVtx].fixed && _vData[_edges[path[ni]].endVtx].primitiveType != CurvePrimitive::LINE)
+                if(!_vData[_edgeEnd[path[ni]]].fixed && _vData[_edgeEnd[path[ni]]].primitiveType != CurvePrimitive::LINE)
                     continue;
                 //the middle one has to be a clothoid
                 //Debugging::get()->printf("Line-clothoid-line!");
                 //kill the higher cost edge
-                if(_edges[path[i]].cost > _edges[path[ni]].cost)
-                    _eData[path[i]].setIgnore();
-                else
-                    _eData[path[ni]].setIgnore();
+                int kill = (_graph.edgeCost[_edgeOf[path[i]]] > _graph.edgeCost[_edgeOf[path[ni]]]) ? _edgeOf[path[i]] : _edgeOf[path[ni]];
+                _flags[kill] |= IGNORED;
+                changed.push_back(kill);
                 valid = false;
             }
         }
 
+        if(!changed.empty())
+            _repairPotentials(changed);
+
         return valid;
     }
 
-    void _reduceForPath(const vector<int> &sourceVertices)
+    //A* heuristic: the potential of each vertex is the cost of the cheapest way from it to a target.  For a cycle,
+    //the graph is cut at the source vertex and edges that jump over it are left out of the potentials, so the
+    //remaining edges form a DAG.  Edge costs only go up, so the potentials stay valid lower bounds, and only the
+    //potentials upstream of edges that got more expensive need to be repaired.
+    void _initPotentials(const vector<int> &sources, int cutVertex)
     {
-        //compute distances
-        for(int i = 0; i < (int)_vertices.size(); ++i)
-            _vData[i].distance = _vData[i].target ? 0. : Parameters::infinity;
+        _sources = sources;
+        _cutVertex = cutVertex;
 
-        for(int i = (int)_edges.size() - 1; i >= 0; --i)
+        //visit the states downstream first
+        int numStates = (int)_vData.size();
+        for(int r = numStates - 1; r >= 0; --r)
         {
-            if(_eData[i].ignore())
-                continue;
-            int src = _edges[i].startVtx;
-            int tgt = _edges[i].endVtx;
+            int v = _cutVertex < 0 ? r : (r + _cutVertex) % numStates;
+            _vData[v].potential = _vData[v].target ? 0. : _outPotential(v);
+        }
+        _updateSourcePotential();
+    }
+
+    void _repairPotentials(const vector<int> &changedGraphEdges)
+    {
+        priority_queue<pair<int, int> > todo; //by rank, downstream first
 
-            _vData[src].distance = min(_vData[src].distance, _eData[i].cost() + _vData[tgt].distance);
+        for(int i = 0; i < (int)changedGraphEdges.size(); ++i)
+        {
+            int e = changedGraphEdges[i];
+            for(int j = _stateEdgeOffsets[e]; j < _stateEdgeOffsets[e + 1]; ++j)
+                _queueForRepair(_edgeStart[_stateEdges[j]], todo);
         }
 
-        //reduce
-        const double reductionTol = 1e-8;
-        double minDist = Parameters::infinity;
-        for(int i = 0; i < (int)sourceVertices.size(); ++i)
-            minDist = min(minDist, _vData[sourceVertices[i]].distance);
+        while(!todo.empty())
+        {
+            int v = todo.top().second;
+            todo.pop();
+            _vData[v].queued = false;
 
-        for(int i = 0; i < (int)_edges.size(); ++i) {
-            if(_eData[i].ignore())
+            double potential = _outPotential(v);
+            if(potential == _vData[v].potential)
                 continue;
+            _vData[v].potential = potential;
 
-            int src = _edges[i].startVtx;
-            int tgt = _edges[i].endVtx;
-            
-            if(_vData[src].source)
-                _eData[i].reduce(minDist - _vData[tgt].distance - reductionTol);
-            else
-                _eData[i].reduce(_vData[src].distance - _vData[tgt].distance - reductionTol);
-
-            if(_eData[i].reducedCost() < 0.)
-                Debugging::get()->printf("Reducing error!");
+            for(int i = _inOffsets[v]; i < _inOffsets[v + 1]; ++i)
+            {
+                int e = _inEdges[i];
+                if(!_ignored(e) && !_crossesCut(e))
+                    _queueForRepair(_edgeStart[e], todo);
+            }
         }
+        _updateSourcePotential();
     }
 
-    void _reduceForCycle(int vertex)
+    void _queueForRepair(int v, priority_queue<pair<int, int> > &todo)
     {
-        //compute distances
-        for(int i = 0; i < (int)_vertices.size(); ++i)
-            _vData[i].distance = Parameters::infinity;
-        _vData[vertex].distance = 0.;
-
-        int startEdge = _vertices[vertex].edges[0] - 1;
-        int lastSourceEdge = _vertices[vertex].edges.back();
+        if(_vData[v].target || _vData[v].queued) //targets' potentials are always zero
+            return;
+        _vData[v].queued = true;
+        todo.push(make_pair(_rank(v), v));
+    }
 
-        size_t count = 0;
+    //all sources start at distance zero, so they have to share a potential
+    void _updateSourcePotential()
+    {
+        _sourcePotential = Parameters::infinity;
+        for(int i = 0; i < (int)_sources.size(); ++i)
+            _sourcePotential = min(_sourcePotential, _outPotential(_sources[i]));
+    }
 
-        for(int i = startEdge; count < _edges.size(); --i, ++count)
+    double _outPotential(int v) const
+    {
+        double out = Parameters::infinity;
+        for(int e = _outOffsets[v]; e < _outOffsets[v + 1]; ++e)
         {
-            if(i < 0)
-                i = (int)_edges.size() - 1;
-
-            if(i == lastSourceEdge)
-                _vData[vertex].distance = Parameters::infinity;
+            if(!_ignored(e) && !_crossesCut(e))
+                out = min(out, _cost[e] + _inPotential(_edgeEnd[e]));
+        }
+        return out;
+    }
 
-            if(_eData[i].ignore())
-                continue;
+    double _inPotential(int v) const { return _vData[v].target ? 0. : _vData[v].potential; }
 
-            int src = _edges[i].startVtx;
-            int tgt = _edges[i].endVtx;
+    //position along the curve, starting after the cut; edges in the DAG go to vertices of higher rank or to the target
+    int _rank(int v) const { return _cutVertex < 0 ? v : (v - _cutVertex + (int)_vData.size()) % (int)_vData.size(); }
 
-            _vData[src].distance = min(_vData[src].distance, _eData[i].cost() + _vData[tgt].distance);
-        }
+    bool _crossesCut(int edge) const
+    {
+        if(_cutVertex < 0)
+            return false;
+        int src = _edgeStart[edge];
+        int tgt = _edgeEnd[edge];
+        if(_vData[tgt].target)
+            return false;
+        if(src < tgt)
+            return src < _cutVertex && _cutVertex < tgt;
+        return src < _cutVertex || _cutVertex < tgt;
+    }
 
-        //reduce
+    double _reducedCost(int edge) const
+    {
         const double reductionTol = 1e-8;
 
-        for(int i = 0; i < (int)_edges.size(); ++i) {
-            if(_eData[i].ignore())
-                continue;
+        int src = _edgeStart[edge];
+        double srcPotential = _vData[src].source ? _sourcePotential : _vData[src].potential;
+        if(_crossesCut(edge) || srcPotential >= Parameters::infinity)
+            return _cost[edge];
+        return _cost[edge] - srcPotential + _inPotential(_edgeEnd[edge]) + reductionTol;
+    }
 
-            int src = _edges[i].startVtx;
-            int tgt = _edges[i].endVtx;
-            
-            if(_vData[tgt].target)
-            {
-                _eData[i].reduce(_vData[src].distance - reductionTol);
-                continue;
-            }
-            else
+    //Without a cut, the states are in topological order and the potentials are the exact costs of the cheapest ways
+    //to a target, computed by a sweep over the states in reverse and kept up to date by _repairPotentials.  So the
+    //shortest path just follows, from the cheapest source, an edge whose cost plus the potential of its end is the
+    //potential of its start, with no search.
+    vector<int> _pathFromPotentials() const
+    {
+        CORNU_TRACE_SCOPE("PathFindingGraph::search");
+        FitMetrics::count(FitMetrics::PATH_FINDER_ITERATIONS);
+        vector<int> out;
+        if(_sourcePotential >= Parameters::infinity)
+            return out; //no path
+
+        int cur = -1;
+        for(int i = 0; i < (int)_sources.size() && cur < 0; ++i)
+        {
+            if(_outPotential(_sources[i]) == _sourcePotential)
+                cur = _sources[i];
+        }
+
+        if(!_followPotentials(cur, vector<int>(), out))
+            return vector<int>();
+        return out;
+    }
+
+    //Appends to out the edges of the cheapest way from the state to a target that takes none of the excluded edges,
+    //or returns false if there's none
+    bool _followPotentials(int cur, const vector<int> &excluded, vector<int> &out) const
+    {
+        do
+        {
+            int best = -1;
+            double bestCost = Parameters::infinity;
+            for(int e = _outOffsets[cur]; e < _outOffsets[cur + 1]; ++e)
             {
-                bool crossesSource;
-                if(src < tgt)
-                    crossesSource = src < vertex && vertex < tgt;
-                else
-                    crossesSource = src < vertex || vertex < tgt;
-
-                if(!crossesSource && _vData[src].distance < Parameters::infinity) //if the edge does not cross the starting vertex
-                    _eData[i].reduce(_vData[src].distance - _vData[tgt].distance - reductionTol);
-                else
-                    _eData[i].reduce(0);
+                if(_ignored(e) || find(excluded.begin(), excluded.end(), e) != excluded.end())
+                    continue;
+                double cost = _cost[e] + _inPotential(_edgeEnd[e]);
+                if(cost < bestCost)
+                {
+                    bestCost = cost;
+                    best = e;
+                }
             }
+            if(best < 0)
+                return false;
+            out.push_back(best);
+            cur = _edgeEnd[best];
+        } while(!_vData[cur].target);
 
-            if(_eData[i].reducedCost() < 0.)
-                Debugging::get()->printf("Reducing error!");
-        }
+        return true;
     }
 
-    vector<int> _shortestPath(const vector<int> &sourceVertices)
+    //Dijkstra's algorithm with the reduced costs.  The reduced distance of a state plus the source potential is a
+    //lower bound on the cost of any path through it, so states where that is at least bound aren't expanded.
+    vector<int> _shortestPath(const vector<int> &sourceVertices, double bound = Parameters::infinity)
     {
-        for(size_t i = 0; i < _vertices.size(); ++i)
+        CORNU_TRACE_SCOPE("PathFindingGraph::search");
+        FitMetrics::count(FitMetrics::PATH_FINDER_ITERATIONS);
+        for(size_t i = 0; i < _vData.size(); ++i)
         {
             _vData[i].prevEdge = -1;
             _vData[i].distance = Parameters::infinity;
@@ -366,7 +842,7 @@ private:
                 do
                 {
                     out.push_back(_vData[cur].prevEdge);
-                    cur = _edges[out.back()].startVtx;
+                    cur = _edgeStart[out.back()];
                 } while(_vData[cur].prevEdge >= 0 && cur != v);
 
                 reverse(out.begin(), out.end());
@@ -377,13 +853,14 @@ private:
                 continue;
             _vData[v].finished = true;
 
-            for(int i = 0; i < (int)_vertices[v].edges.size(); ++i)
+            for(int e = _outOffsets[v]; e < _outOffsets[v + 1]; ++e)
             {
-                int e = _vertices[v].edges[i];
-                if(_eData[e].ignore())
+                if(_ignored(e))
+                    continue;
+                int tgt = _edgeEnd[e];
+                double newDist = curDistance + _reducedCost(e);
+                if(newDist + _sourcePotential >= bound)
                     continue;
-                int tgt = _edges[e].endVtx;
-                double newDist = curDistance + _eData[e].reducedCost();
 
                 if(newDist < _vData[tgt].distance)
                 {
@@ -398,11 +875,66 @@ private:
         return vector<int>();
     }
 
-    const vector<Vertex> &_vertices;
-    const vector<Edge> &_edges;
-    vector<PathFindingEdgeData> _eData;
+    enum EdgeFlags
+    {
+        VALIDATED = 1,
+        IGNORED = 2
+    };
+
+    bool _ignored(int edge) const { return (_flags[_edgeOf[edge]] & IGNORED) != 0; }
+
+    //validate and _setValidatedCost take graph edges
+    bool _validate(int edge)
+    {
+        if(_flags[edge] & VALIDATED)
+            return true;
+        return _setValidatedCost(edge, _graph.validatedEdgeCost(edge, _combineContext));
+    }
+
+    //returns false if the edge turned out to be more expensive
+    bool _setValidatedCost(int edge, float newCost)
+    {
+        if(_flags[edge] & VALIDATED)
+            return true;
+        _flags[edge] |= VALIDATED;
+        ++_numValidations;
+        if(newCost > _graph.edgeCost[edge])
+        {
+            ++_numInvalidations;
+            for(int i = _stateEdgeOffsets[edge]; i < _stateEdgeOffsets[edge + 1]; ++i)
+                _cost[_stateEdges[i]] = newCost + _inflectionCostOf(_stateEdges[i]);
+            return false;
+        }
+        return true;
+    }
+
+    const AlgorithmOutput<GRAPH_CONSTRUCTION> &_graph;
+    double _inflectionCost;
+
+    //the state graph; unless noted, vertices and edges below are states and the edges between them
+    vector<int> _stateVertex; //graph vertex of each state
+    vector<int> _edgeStart;
+    vector<int> _edgeEnd;
+    vector<int> _edgeOf; //graph edge of each edge
+    vector<float> _cost;
+    vector<unsigned char> _flags; //per graph edge
+
+    vector<int> _outOffsets;
+    vector<int> _inOffsets;
+    vector<int> _inEdges; //edge indices, grouped by end vertex
+    vector<int> _stateEdgeOffsets;
+    vector<int> _stateEdges; //edge indices, grouped by graph edge
+
+    vector<int> _sources;
+    int _cutVertex; //-1 if looking for a path rather than a cycle
+    double _sourcePotential;
+
     vector<PathFindingVertexData> _vData;
     const Fitter &_fitter;
+    TwoCurveCombineContext _combineContext;
+    bool _multithreaded;
+    int _numValidations;
+    int _numInvalidations;
 };
 
 class DefaultPathFinder : public Algorithm<PATH_FINDING>
@@ -417,41 +949,97 @@ protected:
         const vector<FitPrimitive> &primitives = fitter.output<PRIMITIVE_FITTING>()->primitives;
 
         //construct the path finding graph
-        PathFindingGraph pfgraph(graph->vertices, graph->edges, fitter);
+        PathFindingGraph pfgraph(*graph, fitter);
         
         bool closed = fitter.output<CURVE_CLOSING>()->closed;
 
+        int numAlternatives = (int)fitter.params().get(Parameters::NUM_ALTERNATIVES);
+
         vector<int> shortestPath;
+        out.alternatives.clear();
+        out.alternativeCosts.clear();
         if(closed)
             shortestPath = pfgraph.shortestCycle();
+        else if(numAlternatives > 1)
+        {
+            out.alternatives = pfgraph.alternativePaths(numAlternatives, out.alternativeCosts);
+            if(!out.alternatives.empty())
+            {
+                shortestPath.swap(out.alternatives[0]);
+                out.alternatives.erase(out.alternatives.begin());
+                out.alternativeCosts.erase(out.alternativeCosts.begin());
+            }
+        }
         else
             shortestPath = pfgraph.shortestPath();
 
         //debugging output
-        ostringstream ss;
-        for(int i = 0; i < (int)shortestPath.size(); ++i)
+        if(CORNU_DEBUGGING_ON)
         {
-            char curveTypes[3] = { 'L', 'A', 'C' }; //line, arc, clothoid
-            ss << curveTypes[primitives[graph->edges[shortestPath[i]].startVtx].curve->getType()];
-            if(graph->edges[shortestPath[i]].continuity == -1)
-                break;
-            ss << "-" << (int)graph->edges[shortestPath[i]].continuity << "-";
-            if(!closed && i + 1 == (int)shortestPath.size())
-                ss << curveTypes[primitives[graph->edges[shortestPath[i]].endVtx].curve->getType()];
-        }
-        Debugging::get()->printf("Curves = %s", ss.str().c_str());
+            ostringstream ss;
+            for(int i = 0; i < (int)shortestPath.size(); ++i)
+            {
+                char curveTypes[3] = { 'L', 'A', 'C' }; //line, arc, clothoid
+                ss << curveTypes[primitives[graph->edgeStart[shortestPath[i]]].curve->getType()];
+                if(graph->edgeContinuity[shortestPath[i]] == -1)
+                    break;
+                ss << "-" << (int)graph->edgeContinuity[shortestPath[i]] << "-";
+                if(!closed && i + 1 == (int)shortestPath.size())
+                    ss << curveTypes[primitives[graph->edgeEnd[shortestPath[i]]].curve->getType()];
+            }
+            CORNU_DEBUG(printf("Curves = %s", ss.str().c_str()));
 
-        for(int i = 0; i < (int)shortestPath.size(); ++i)
-        {
-            Debugging::get()->drawPrimitive(primitives[graph->edges[shortestPath[i]].startVtx].curve, "Path", i);
+            for(int i = 0; i < (int)shortestPath.size(); ++i)
+            {
+                CORNU_DEBUG(drawPrimitive(primitives[graph->edgeStart[shortestPath[i]]].curve, "Path", i));
+            }
+            if(shortestPath.size() > 0 && graph->edgeContinuity[shortestPath[0]] != -1)
+                CORNU_DEBUG(drawPrimitive(primitives[graph->edgeEnd[shortestPath.back()]].curve, "Path", (int)shortestPath.size()));
         }
-        if(shortestPath.size() > 0 && graph->edges[shortestPath[0]].continuity != -1)
-            Debugging::get()->drawPrimitive(primitives[graph->edges[shortestPath.back()].endVtx].curve, "Path", (int)shortestPath.size());
 
         out.path = shortestPath;
+        out.numValidations = pfgraph.numValidations();
+        FitMetrics::count(FitMetrics::EDGE_VALIDATIONS, out.numValidations);
+        FitMetrics::count(FitMetrics::EDGE_INVALIDATIONS, pfgraph.numInvalidations());
     }
 };
 
+size_t AlgorithmOutput<PATH_FINDING>::memoryUsage() const
+{
+    size_t out = sizeof(*this) + vectorMemory(path) + vectorMemory(alternatives) + vectorMemory(alternativeCosts);
+    for(int i = 0; i < (int)alternatives.size(); ++i)
+        out += vectorMemory(alternatives[i]);
+    return out;
+}
+
+void AlgorithmOutput<PATH_FINDING>::recycle()
+{
+    path.clear();
+    alternatives.clear();
+    alternativeCosts.clear();
+    numValidations = 0;
+}
+
+void AlgorithmOutput<PATH_FINDING>::write(SnapshotWriter &out) const
+{
+    out.writeVector(path);
+    out.writeInt((int)alternatives.size());
+    for(int i = 0; i < (int)alternatives.size(); ++i)
+        out.writeVector(alternatives[i]);
+    out.writeVector(alternativeCosts);
+    out.writeInt(numValidations);
+}
+
+void AlgorithmOutput<PATH_FINDING>::read(SnapshotReader &in, const Fitter &)
+{
+    in.readVector(path);
+    alternatives.resize(in.readSize());
+    for(int i = 0; i < (int)alternatives.size() && in.ok(); ++i)
+        in.readVector(alternatives[i]);
+    in.readVector(alternativeCosts);
+    numValidations = in.readInt();
+}
+
 void Algorithm<PATH_FINDING>::_initialize()
 {
     new DefaultPathFinder();
@@ -30,6 +30,17 @@ template<>
 struct AlgorithmOutput<PATH_FINDING> : public AlgorithmOutputBase
 {
     std::vector<int> path; //list of edges
+    //With Parameters::NUM_ALTERNATIVES above one, the next cheapest paths (up to one fewer than that many) whose
+    //sequences of primitive types and continuities differ from path's and each other's, cheapest first, and their
+    //costs.  They are only found for open curves.
+    std::vector<std::vector<int> > alternatives;
+    std::vector<double> alternativeCosts;
+    int numValidations; //how many edges had their costs validated by combining their curves
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
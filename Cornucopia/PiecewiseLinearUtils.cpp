@@ -19,6 +19,7 @@
 */
 
 #include "PiecewiseLinearUtils.h"
+#include "Polyline.h"
 #include <limits>
 
 using namespace std;
@@ -36,9 +37,9 @@ void PiecewiseLinearMonotone::add(double x, double y)
 
     //self test
     if(it != _points.begin() && y + tol < (--it)->y)
-        Debugging::get()->printf("ERROR: Not monotone w.r.t. prev!");
+        CORNU_DEBUG(printf("ERROR: Not monotone w.r.t. prev!"));
     if(++it2 != _points.end() && y - tol > it2->y)
-        Debugging::get()->printf("ERROR: Not monotone w.r.t. next!");        
+        CORNU_DEBUG(printf("ERROR: Not monotone w.r.t. next!"));        
 }
 
 bool PiecewiseLinearMonotone::eval(double x, double &outY) const
@@ -168,13 +169,62 @@ bool PiecewiseLinearMonotone::batchEval(vector<double> &inXoutY) const
     {
         if(!eval(inXoutY[i], inXoutY[i]))
         {
-            Debugging::get()->printf("PiecewiseLinearMonotone evaluation error!");
+            CORNU_DEBUG(printf("PiecewiseLinearMonotone evaluation error!"));
             allGood = false;
         }
     }
     return allGood;
 }
 
+ParameterMap::ParameterMap(const PolylineConstPtr &sketch)
+    : _sketch(sketch), _step(PiecewiseLinearMonotone::POSITIVE), _offset(0.), _wrapBelow(0.), _period(0.), _shift(0.), _evaluated(false)
+{
+}
+
+ParameterMap::~ParameterMap()
+{
+}
+
+const vector<double> &ParameterMap::values() const
+{
+    if(!_evaluated)
+        call_once(_evaluateOnce, [this]() { evaluate(_values); });
+    return _values;
+}
+
+void ParameterMap::evaluate(vector<double> &out) const
+{
+    if(_evaluated)
+    {
+        out = _values;
+        return;
+    }
+    if(_sketch)
+    {
+        out.resize(_sketch->pts().size());
+        for(int i = 0; i < (int)out.size(); ++i)
+            out[i] = _sketch->idxToParam(i);
+        return;
+    }
+
+    _prev->evaluate(out);
+    for(int i = 0; i < (int)out.size(); ++i)
+    {
+        out[i] -= _offset;
+        if(out[i] < _wrapBelow)
+            out[i] += _period;
+    }
+    _step.batchEval(out);
+    for(int i = 0; i < (int)out.size(); ++i)
+        out[i] += _shift;
+}
+
+size_t ParameterMap::memoryUsage() const
+{
+    //a set node holds a point and about four pointers
+    return sizeof(*this) + _values.capacity() * sizeof(double) + _step.size() * (sizeof(double) * 3 + sizeof(void *) * 4);
+}
+
 END_NAMESPACE_Cornu
 
 
@@ -22,8 +22,10 @@
 #define CORNUCOPIA_PIECEWISELINEARUTILS_H_INCLUDED
 
 #include "defs.h"
+#include "smart_ptr.h"
 #include <vector>
 #include <set>
+#include <mutex>
 
 NAMESPACE_Cornu
 
@@ -43,6 +45,7 @@ public:
 
     double minX() const;
     double maxX() const;
+    int size() const { return (int)_points.size(); }
 
     bool batchEval(std::vector<double> &inXoutY) const; //returns false if any evaluation fails
 private:
@@ -61,6 +64,46 @@ private:
     std::set<PLPoint> _points;
 };
 
+CORNU_SMART_FORW_DECL(Polyline);
+CORNU_SMART_FORW_DECL(ParameterMap);
+
+//Maps the index of each original sketch point to its parameter in a stage's output.  Rather than transform a
+//vector with an entry for every original point, each stage composes its own monotone step onto the map of the
+//stage before, and the composition is only evaluated when someone asks for the values.
+class ParameterMap : public smart_base
+{
+public:
+    ParameterMap(const PolylineConstPtr &sketch); //the arc length parameters of the sketch points
+    ParameterMap(const std::vector<double> &values)
+        : _step(PiecewiseLinearMonotone::POSITIVE), _offset(0.), _wrapBelow(0.), _period(0.), _shift(0.), _values(values), _evaluated(true) {}
+    //Applies step to the parameters prev maps to.  Before the step, offset is subtracted from a parameter and then,
+    //if it is below wrapBelow, period is added, to bring parameters on closed curves into the step's range.
+    //After the step, shift is added.
+    ParameterMap(const ParameterMapConstPtr &prev, PiecewiseLinearMonotone step)
+        : _prev(prev), _step(std::move(step)), _offset(0.), _wrapBelow(0.), _period(0.), _shift(0.), _evaluated(false) {}
+    ~ParameterMap();
+
+    void setWrap(double offset, double wrapBelow, double period) { _offset = offset; _wrapBelow = wrapBelow; _period = period; }
+    void addShift(double shift) { _shift += shift; }
+
+    //Evaluates the whole composition the first time and keeps the result.  Safe to call from several threads.
+    const std::vector<double> &values() const;
+    //evaluates the composition into out without keeping it
+    void evaluate(std::vector<double> &out) const;
+
+    size_t memoryUsage() const; //of this step only, not the ones before it
+
+private:
+    PolylineConstPtr _sketch;
+    ParameterMapConstPtr _prev;
+    PiecewiseLinearMonotone _step;
+    double _offset, _wrapBelow, _period, _shift;
+
+    mutable std::vector<double> _values;
+    mutable std::once_flag _evaluateOnce;
+    bool _evaluated; //true if _values were given
+};
+
 END_NAMESPACE_Cornu
 
 #endif //CORNUCOPIA_PIECEWISELINEARUTILS_H_INCLUDED
@@ -0,0 +1,91 @@
+/*--
+    PointQueue.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_POINTQUEUE_H_INCLUDED
+#define CORNUCOPIA_POINTQUEUE_H_INCLUDED
+
+#include "defs.h"
+#include "VectorC.h"
+
+#include <atomic>
+
+NAMESPACE_Cornu
+
+/*
+    A bounded queue of sketch points from one producer thread, e.g., the one receiving pen samples, to one consumer
+    thread, e.g., the one running an IncrementalFitter.  Neither side locks or waits: push() fails when the queue is
+    full, and the consumer takes all the pending points at once (see IncrementalFitter::update(PointQueue &)), so
+    each refit sees the newest points instead of working through the states in between.  The capacity should cover
+    the samples that arrive during the longest refit.
+*/
+class PointQueue
+{
+public:
+    explicit PointQueue(int capacity = 4096) : _head(0), _tail(0)
+    {
+        int size = 1;
+        while(size < capacity)
+            size *= 2;
+        _buffer.resize(size);
+        _mask = size - 1;
+    }
+
+    //producer only: returns false, and drops the point, if the queue is full
+    bool push(const Eigen::Vector2d &pt)
+    {
+        unsigned int tail = _tail.load(std::memory_order_relaxed);
+        if(tail - _head.load(std::memory_order_acquire) > (unsigned int)_mask)
+            return false;
+        _buffer[tail & _mask] = pt;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //consumer only: appends the pending points to out and returns how many there were
+    int popAll(VectorC<Eigen::Vector2d> &out)
+    {
+        unsigned int head = _head.load(std::memory_order_relaxed);
+        unsigned int tail = _tail.load(std::memory_order_acquire);
+        for(unsigned int i = head; i != tail; ++i)
+            out.push_back(_buffer[i & _mask]);
+        _head.store(tail, std::memory_order_release);
+        return (int)(tail - head);
+    }
+
+    //exact on the consumer thread; elsewhere the answer may be out of date by the time it's returned
+    bool empty() const { return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire); }
+    int capacity() const { return _mask + 1; }
+
+private:
+    PointQueue(const PointQueue &);
+    PointQueue &operator=(const PointQueue &);
+
+    VectorC<Eigen::Vector2d> _buffer;
+    int _mask;
+    //the counters only ever increase (modulo 2^32) and are written by one side each; the padding keeps them on
+    //separate cache lines, so the two threads don't keep taking the line from each other
+    std::atomic<unsigned int> _head; //written by the consumer
+    char _padding[64];
+    std::atomic<unsigned int> _tail; //written by the producer
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_POINTQUEUE_H_INCLUDED
@@ -25,12 +25,29 @@ using namespace Eigen;
 NAMESPACE_Cornu
 
 Polyline::Polyline(const VectorC<Eigen::Vector2d> &pts) : _pts(pts)
+{
+    _computeLengths();
+}
+
+Polyline::Polyline(VectorC<Eigen::Vector2d> &&pts) : _pts(std::move(pts))
+{
+    _computeLengths();
+}
+
+void Polyline::addPoint(const Vector2d &pt)
+{
+    assert(!isClosed());
+    _lengths.push_back(_lengths.back() + (pt - _pts.back()).norm());
+    _pts.push_back(pt);
+}
+
+void Polyline::_computeLengths()
 {
     assert(_pts.size() > 1);
-    _lengths.reserve(pts.size() + 1);
+    _lengths.reserve(_pts.size() + 1);
     _lengths.push_back(0);
-    for(int i = 0; i < pts.endIdx(1); ++i)
-        _lengths.push_back(_lengths.back() + (pts[i] - pts[i + 1]).norm());
+    for(int i = 0; i < _pts.endIdx(1); ++i)
+        _lengths.push_back(_lengths.back() + (_pts[i] - _pts[i + 1]).norm());
 }
 
 int Polyline::paramToIdx(double param, double *outParam) const
@@ -61,6 +78,24 @@ void Polyline::eval(double s, Vec *pos, Vec *der, Vec *der2) const
         (*der2) = Vec();
 }
 
+void Polyline::evalBatch(const VectorXd &s, Matrix2Xd *pos, Matrix2Xd *der, Matrix2Xd *der2) const
+{
+    if(pos) pos->resize(2, s.size());
+    if(der) der->resize(2, s.size());
+    if(der2) der2->setZero(2, s.size());
+
+    Cursor cursor(*this);
+    Vec p, d;
+    for(int i = 0; i < (int)s.size(); ++i)
+    {
+        cursor.eval(s[i], pos ? &p : NULL, der ? &d : NULL);
+        if(pos)
+            pos->col(i) = p;
+        if(der)
+            der->col(i) = d;
+    }
+}
+
 double Polyline::project(const Vector2d &point) const
 {
     double bestS = 0.;
@@ -97,7 +132,17 @@ double Polyline::lengthFromTo(int fromIdx, int toIdx) const
     return out;
 }
 
+size_t Polyline::memoryUsage() const
+{
+    return sizeof(Polyline) + _pts.capacity() * sizeof(Vector2d) + _lengths.capacity() * sizeof(double);
+}
+
 PolylinePtr Polyline::trimmed(double from, double to) const
+{
+    return new Polyline(trimmedPts(from, to));
+}
+
+VectorC<Vector2d> Polyline::trimmedPts(double from, double to) const
 {
     double len = length();
 
@@ -139,19 +184,16 @@ PolylinePtr Polyline::trimmed(double from, double to) const
 
     if(startIdx != endIdx || (to + tol < from)) //add points from existing polyline if necessary
     {
-        for(VectorC<Vector2d>::Circulator circ = _pts.circulator(startIdx + 1); !circ.done() ; ++circ)
-        {
-            out.push_back(*circ);
-
-            if(circ.index() == endIdx)
-                break;
-        }
+        VectorC<Vector2d>::FlatSpan spans[2];
+        int numSpans = _pts.flatSpans(startIdx + 1, _pts.numElems(startIdx + 1, endIdx) + 1, spans);
+        for(int i = 0; i < numSpans; ++i)
+            out.insert(out.end(), _pts.begin() + spans[i].begin, _pts.begin() + spans[i].end);
     }
 
     if(paramRemainder > tol) //if there's something leftover at the end, add the endpoint
         out.push_back(pos(to));
 
-    return new Polyline(out);
+    return out;
 }
 
 END_NAMESPACE_Cornu
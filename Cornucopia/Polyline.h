@@ -34,12 +34,18 @@ class Polyline : public Curve
 {
 public:
     Polyline(const VectorC<Eigen::Vector2d> &pts);
+    Polyline(VectorC<Eigen::Vector2d> &&pts); //takes over the points without copying them
+
+    //Extends an open polyline, e.g., one that is still being drawn, in amortized constant time.  Nothing else
+    //should be using the polyline while it grows.
+    void addPoint(const Eigen::Vector2d &pt);
 
     //overrides
     double length() const { return _lengths.back(); }
     bool isClosed() const { return _pts.circular() == CIRCULAR; }
 
     void eval(double s, Vec *pos, Vec *der = NULL, Vec *der2 = NULL) const;
+    void evalBatch(const Eigen::VectorXd &s, Eigen::Matrix2Xd *pos, Eigen::Matrix2Xd *der = NULL, Eigen::Matrix2Xd *der2 = NULL) const;
 
     double project(const Vec &point) const;
 
@@ -53,16 +59,81 @@ public:
     //the length of the original curve.  Arguments can be negative and to can be smaller
     //than from for a closed polyline.
     PolylinePtr trimmed(double from, double to) const;
+    //the points of the trimmed curve, for when the polyline itself isn't needed
+    VectorC<Eigen::Vector2d> trimmedPts(double from, double to) const;
 
     const VectorC<Eigen::Vector2d> &pts() const { return _pts; }
 
+    size_t memoryUsage() const; //estimated, in bytes
+
+    //Evaluates the polyline at parameters in mostly increasing order, like dense samples, by walking on from the
+    //segment of the previous parameter instead of searching for each one--O(1) amortized per parameter for a
+    //sweep.  A parameter behind the previous one or far ahead of it costs a search.
+    class Cursor
+    {
+    public:
+        explicit Cursor(const Polyline &polyline) : _polyline(polyline), _idx(0) {}
+
+        void eval(double s, Vec *pos, Vec *der = NULL);
+        Vec pos(double s) { Vec out; eval(s, &out); return out; }
+        int paramToIdx(double param, double *outParam = NULL); //like Polyline::paramToIdx
+
+    private:
+        const Polyline &_polyline;
+        int _idx; //the segment of the previous parameter
+    };
+
 private:
+    void _computeLengths();
+
     VectorC<Eigen::Vector2d> _pts;
     //lengths[x] = \sum_{i=1}^{i=x} ||pts[i]-pts[i-1]||, i.e., length up to point x
     //For closed curves, _lengths has a last member which is the total curve length.
     std::vector<double> _lengths; 
 };
 
+inline int Polyline::Cursor::paramToIdx(double param, double *outParam)
+{
+    const std::vector<double> &lengths = _polyline._lengths;
+    const int maxWalk = 8; //segments to walk before a search is cheaper
+    int last = (int)lengths.size() - 2;
+    if(param < lengths[_idx])
+        _idx = std::max(0, _polyline.paramToIdx(param));
+    else
+    {
+        for(int i = 0; _idx < last && param >= lengths[_idx + 1]; ++i, ++_idx)
+        {
+            if(i == maxWalk)
+            {
+                _idx = _polyline.paramToIdx(param);
+                break;
+            }
+        }
+    }
+    if(outParam)
+        *outParam = param - lengths[_idx];
+    return _idx;
+}
+
+inline void Polyline::Cursor::eval(double s, Vec *pos, Vec *der)
+{
+    const Polyline &p = _polyline;
+    if(p._pts.circular())
+    {
+        s = fmod(s, p._lengths.back());
+        if(s < 0.)
+            s += p._lengths.back();
+    }
+    double cParam;
+    int idx = paramToIdx(s, &cParam);
+    int nidx = (idx + 1) % p._pts.size();
+    double invLength = (1. / (p._lengths[idx + 1] - p._lengths[idx]));
+    if(pos)
+        (*pos) = p._pts.flatAt(idx) + (cParam * invLength) * (p._pts.flatAt(nidx) - p._pts.flatAt(idx));
+    if(der)
+        (*der) = (p._pts.flatAt(nidx) - p._pts.flatAt(idx)) * invLength;
+}
+
 END_NAMESPACE_Cornu
 
 #endif //CORNUCOPIA_POLYLINE_H_INCLUDED
@@ -24,7 +24,10 @@
 #include "Debugging.h"
 #include "Line.h"
 #include "PiecewiseLinearUtils.h"
+#include "StreamingSimplifier.h"
+#include "Snapshot.h"
 #include <iostream>
+#include <algorithm>
 
 #include <Eigen/Geometry>
 
@@ -74,6 +77,26 @@ protected:
     }
 };
 
+size_t AlgorithmOutput<SCALE_DETECTION>::memoryUsage() const
+{
+    return sizeof(*this);
+}
+
+void AlgorithmOutput<SCALE_DETECTION>::recycle()
+{
+    scale = 1.;
+}
+
+void AlgorithmOutput<SCALE_DETECTION>::write(SnapshotWriter &out) const
+{
+    out.writeDouble(scale);
+}
+
+void AlgorithmOutput<SCALE_DETECTION>::read(SnapshotReader &in, const Fitter &)
+{
+    scale = in.readDouble();
+}
+
 void Algorithm<SCALE_DETECTION>::_initialize()
 {
     new AdaptiveScaleDetector();
@@ -90,14 +113,28 @@ public:
 protected:
     void _run(const Fitter &fitter, AlgorithmOutput<PRELIM_RESAMPLING> &out)
     {
-        const VectorC<Vector2d> &pts = fitter.originalSketch()->pts();
+        //High-rate input has many nearly coincident points, so those are dropped before anything else looks at them.
+        //origIdx maps the remaining points to the sketch (and is empty if none were dropped).
+        VectorC<Vector2d> decimated(0, NOT_CIRCULAR);
+        vector<int> origIdx;
+        //A closed sketch is resampled as an open one that ends where it starts, and the curve closer closes it again.
+        VectorC<Vector2d> unrolled(0, NOT_CIRCULAR);
+        if(fitter.originalSketch()->isClosed())
+        {
+            unrolled = VectorC<Vector2d>(fitter.originalSketch()->pts(), NOT_CIRCULAR);
+            unrolled.push_back(unrolled[0]);
+        }
+        const VectorC<Vector2d> &pts = _decimate(fitter.originalSketch()->isClosed() ? unrolled : fitter.originalSketch()->pts(),
+                                                 fitter.scaledParameter(Parameters::INPUT_DECIMATION), decimated, origIdx);
+        auto origParam = [&](int idx) { return fitter.originalSketch()->idxToParam(origIdx.empty() ? idx : origIdx[idx]); };
+
         VectorC<Vector2d> outPts(0, NOT_CIRCULAR);
         PiecewiseLinearMonotone origToCur(PiecewiseLinearMonotone::POSITIVE);
 
         const double radius = fitter.scaledParameter(Parameters::MIN_PRELIM_LENGTH);
 
-        //First mark the points on the original curve we definitely want to keep (e.g., corners) using Douglas-Peucker
-        vector<bool> keep = _markDouglasPeucker(pts, fitter.scaledParameter(Parameters::DP_CUTOFF));
+        //First mark the points on the original curve we definitely want to keep (e.g., corners)
+        vector<bool> keep = _markKeep(pts, fitter.scaledParameter(Parameters::DP_CUTOFF));
 
         //Go through the points and resample them at the rate of radius, discarding those that are too close
         //to the previous output point, and subdiving the line segments between points that are too far.
@@ -117,7 +154,7 @@ protected:
             if(idx + 1 == pts.size() || keep[idx])
             {
                 lengthSoFar += sqrt(distSqToCur);
-                origToCur.add(fitter.originalSketch()->idxToParam(idx), lengthSoFar);
+                origToCur.add(origParam(idx), lengthSoFar);
                 if(distSqToCur > 1e-16)
                     outPts.push_back(curPt);
                 continue;
@@ -140,7 +177,7 @@ protected:
             if(distSqToLine < 1e-16)
             {
                 lengthSoFar += sqrt(distSqToCur);
-                origToCur.add(fitter.originalSketch()->idxToParam(idx), lengthSoFar);
+                origToCur.add(origParam(idx), lengthSoFar);
                 outPts.push_back(curPt);
                 continue;
             }
@@ -148,57 +185,106 @@ protected:
             Vector2d newPt = closestOnLine + y * line.direction(); //y is positive, so this will find the correct point
 
             lengthSoFar += (curResampled - newPt).norm();
-            origToCur.add(fitter.originalSketch()->idxToParam(idx - 1) + projectedLineParam + y, lengthSoFar);
+            origToCur.add(origParam(idx - 1) + projectedLineParam + y, lengthSoFar);
             outPts.push_back(newPt);
             --idx;
         }
 
         out.output = new Polyline(outPts);
-        out.parameters.resize(pts.size());
-        for(int i = 0; i < pts.size(); ++i)
+        out.parameters = new ParameterMap(new ParameterMap(fitter.originalSketch()), std::move(origToCur));
+
+        for(int i = 0; CORNU_DEBUGGING_ON && i < (int)outPts.size(); ++i)
+            CORNU_DEBUG(drawPoint(outPts[i], Vector3d(0, (i % 10 == 0) ? 0.6 : 0, 1), "Prelim resampled"));
+        CORNU_DEBUG(drawCurve(out.output, Vector3d(0, 0, 1), "Prelim resampled curve"));
+    }
+
+    //Keeps the ends and each point at least radius from the last point kept, so every point dropped is within radius of
+    //the decimated polyline.  Returns pts itself if nothing is dropped and decimated otherwise.
+    static const VectorC<Vector2d> &_decimate(const VectorC<Vector2d> &pts, double radius, VectorC<Vector2d> &decimated, vector<int> &origIdx)
+    {
+        const double radiusSq = SQR(radius);
+        int last = 0;
+        for(int i = 1; i + 1 < (int)pts.size(); ++i)
         {
-            double paramOrig = fitter.originalSketch()->idxToParam(i);
-            double paramNew;
-            if(!origToCur.eval(paramOrig, paramNew))
-                Debugging::get()->printf("Evaluation error!");
-            out.parameters[i] = paramNew;
-            //Debugging::get()->drawLine(pts[i], out.output->pos(paramNew), Vector3d(1, 0, 1), "Correspondence");
+            if((pts[i] - pts[last]).squaredNorm() >= radiusSq)
+            {
+                last = i;
+                if(!origIdx.empty())
+                    origIdx.push_back(i);
+            }
+            else if(origIdx.empty()) //the first point dropped--all the ones before it were kept
+            {
+                origIdx.reserve(pts.size());
+                for(int j = 0; j < i; ++j)
+                    origIdx.push_back(j);
+            }
         }
-
-        for(int i = 0; i < (int)outPts.size(); ++i)
-            Debugging::get()->drawPoint(outPts[i], Vector3d(0, (i % 10 == 0) ? 0.6 : 0, 1), "Prelim resampled");
-        Debugging::get()->drawCurve(out.output, Vector3d(0, 0, 1), "Prelim resampled curve");
+        if(origIdx.empty())
+            return pts;
+
+        origIdx.push_back((int)pts.size() - 1);
+        decimated.resize(origIdx.size());
+        for(int i = 0; i < (int)origIdx.size(); ++i)
+            decimated[i] = pts[origIdx[i]];
+        return decimated;
     }
 
-private:
-    vector<bool> _markDouglasPeucker(const VectorC<Vector2d> &pts, double cutoff)
+    //marks the points to keep using Douglas-Peucker
+    virtual vector<bool> _markKeep(const VectorC<Vector2d> &pts, double cutoff)
     {
         vector<bool> out(pts.size(), false);
         out.front() = out.back() = true;
 
-        _dpHelper(pts, out, cutoff, 0, pts.size());
+        //the ranges still to split are kept on a stack rather than recursed on, since on long, curvy sketches the
+        //recursion can get as deep as the number of points
+        vector<pair<int, int> > ranges(1, make_pair(0, pts.size()));
+        while(!ranges.empty())
+        {
+            int start = ranges.back().first, end = ranges.back().second;
+            ranges.pop_back();
+
+            Line cur(pts[start], pts[end - 1]);
+            double maxDist = cutoff;
+            int mid = -1;
+            for(int i = start; i < end; ++i)
+            {
+                double dist = cur.distanceTo(pts[i]);
+                if(dist > maxDist)
+                {
+                    maxDist = dist;
+                    mid = i;
+                }
+            }
+            if(mid < 0)
+                continue;
+            out[mid] = true;
+            ranges.push_back(make_pair(mid, end));
+            ranges.push_back(make_pair(start, mid + 1));
+        }
         return out;
     }
+};
 
-    void _dpHelper(const VectorC<Vector2d> &pts, vector<bool> &out, double cutoff, int start, int end)
+//Marks the points to keep with a StreamingSimplifier, which looks at each point once, instead of Douglas-Peucker,
+//which can take quadratic time
+class StreamingPrelimResampling : public DefaultPrelimResampling
+{
+public:
+    string name() const { return "Streaming"; }
+
+protected:
+    vector<bool> _markKeep(const VectorC<Vector2d> &pts, double cutoff)
     {
-        Line cur(pts[start], pts[end - 1]);
-        double maxDist = cutoff;
-        int mid = -1;
-        for(int i = start; i < end; ++i)
+        vector<bool> out(pts.size(), false);
+        StreamingSimplifier simplifier(cutoff);
+        for(int i = 0; i < pts.size(); ++i)
         {
-            double dist = cur.distanceTo(pts[i]);
-            if(dist > maxDist)
-            {
-                maxDist = dist;
-                mid = i;
-            }
+            int kept = simplifier.addPoint(pts[i]);
+            if(kept >= 0)
+                out[kept] = true;
         }
-        if(mid < 0)
-            return;
-        out[mid] = true;
-        _dpHelper(pts, out, cutoff, start, mid + 1);
-        _dpHelper(pts, out, cutoff, mid, end);
+        out.back() = true;
+        return out;
     }
 };
 
@@ -211,16 +297,38 @@ protected:
     void _run(const Fitter &fitter, AlgorithmOutput<PRELIM_RESAMPLING> &out)
     {
         out.output = fitter.originalSketch();
-        out.parameters.resize(fitter.originalSketch()->pts().size());
-        for(int i = 0; i < (int)out.parameters.size(); ++i)
-            out.parameters[i] = fitter.originalSketch()->idxToParam(i);
+        out.parameters = new ParameterMap(fitter.originalSketch());
     }
 };
 
+size_t AlgorithmOutput<PRELIM_RESAMPLING>::memoryUsage() const
+{
+    return sizeof(*this) + (output ? output->memoryUsage() : 0) + (parameters ? parameters->memoryUsage() : 0);
+}
+
+void AlgorithmOutput<PRELIM_RESAMPLING>::recycle()
+{
+    output.reset();
+    parameters.reset();
+}
+
+void AlgorithmOutput<PRELIM_RESAMPLING>::write(SnapshotWriter &out) const
+{
+    out.writePolyline(output);
+    out.writeParameterMap(parameters);
+}
+
+void AlgorithmOutput<PRELIM_RESAMPLING>::read(SnapshotReader &in, const Fitter &)
+{
+    output = in.readPolyline();
+    parameters = in.readParameterMap();
+}
+
 void Algorithm<PRELIM_RESAMPLING>::_initialize()
 {
     new DefaultPrelimResampling();
     new NoPrelimResampling();
+    new StreamingPrelimResampling();
 }
 
 //========================Curve Closer=============================
@@ -247,6 +355,12 @@ protected:
         if(pts.size() < 3)
             return; //definitely not closed
 
+        if(fitter.originalSketch()->isClosed())
+        {
+            _closeAtEnds(fitter, out);
+            return;
+        }
+
         Vector2d start = pts[0], end = pts.back();
 
         //find point farthest away from start-end line segment
@@ -272,23 +386,7 @@ protected:
         //now find the points closest to each other that are within tol of each
         //other and of the segment connecting the start and end points
         int closest0 = 0, closest1 = (int)pts.size() - 1;
-        double minDistSq = tolSq;
-        for(int i = 0; i < farthest; ++i) {
-            double t = startEnd.project(pts[i]);
-            if((pts[i] - startEnd.pos(t)).squaredNorm() > tolSq)
-                break;
-            for(int j = (int)pts.size() - 1; j > farthest; --j) {
-                double t2 = startEnd.project(pts[j]);
-                if((pts[j] - startEnd.pos(t2)).squaredNorm() > tolSq)
-                    break;
-                double distSq = (pts[i] - pts[j]).squaredNorm();
-                if(distSq > minDistSq)
-                    continue;
-                minDistSq = distSq;
-                closest0 = i;
-                closest1 = j;
-            }
-        }
+        double minDistSq = _closestPair(pts, startEnd, farthest, tolSq, closest0, closest1);
 
         if(minDistSq == tolSq)
             return;
@@ -329,19 +427,143 @@ protected:
             else
                 prevToCur.add(prevParam, out.output->idxToParam(i - closest0));
         }
-        prevToCur.batchEval(out.parameters);
+        out.parameters = new ParameterMap(out.parameters, std::move(prevToCur));
 
 #if 0
-        for(int i = 0; i < (int)out.parameters.size(); ++i)
-            Debugging::get()->drawLine(fitter.originalSketch()->pts()[i], out.output->pos(out.parameters[i]), Vector3d(1, 0, 1), "Closed Correspondence");
+        for(int i = 0; i < (int)out.parameters->values().size(); ++i)
+            CORNU_DEBUG(drawLine(fitter.originalSketch()->pts()[i], out.output->pos(out.parameters->values()[i]), Vector3d(1, 0, 1), "Closed Correspondence"));
 #endif
 
-        Debugging::get()->drawCurve(out.output, Debugging::Color(0., 0., 0.), "Closed", 2., Debugging::DOTTED);
+        CORNU_DEBUG(drawCurve(out.output, Debugging::Color(0., 0., 0.), "Closed", 2., Debugging::DOTTED));
+    }
+
+    //A sketch given as closed needn't have its ends found: its preliminary resampling ends where it starts.
+    void _closeAtEnds(const Fitter &fitter, AlgorithmOutput<CURVE_CLOSING> &out)
+    {
+        out.closed = true;
+
+        PolylineConstPtr prevOutput = fitter.output<PRELIM_RESAMPLING>()->output;
+        VectorC<Vector2d>::Base newPts = prevOutput->pts();
+        bool dropLast = (newPts.back() - newPts[0]).squaredNorm() < 1e-16;
+        if(dropLast)
+            newPts.pop_back();
+        out.output = new Polyline(VectorC<Vector2d>(newPts, CIRCULAR));
+
+        PiecewiseLinearMonotone prevToCur(PiecewiseLinearMonotone::POSITIVE);
+        for(int i = 0; i < (int)newPts.size(); ++i)
+            prevToCur.add(prevOutput->idxToParam(i), out.output->idxToParam(i));
+        if(dropLast)
+            prevToCur.add(prevOutput->length(), out.output->length());
+        out.parameters = new ParameterMap(out.parameters, std::move(prevToCur));
+
+        CORNU_DEBUG(drawCurve(out.output, Debugging::Color(0., 0., 0.), "Closed", 2., Debugging::DOTTED));
+    }
+
+    //Looks at the runs of points before and after farthest that are within tol of the start-end segment and returns the
+    //smallest squared distance between a point of each, or tolSq if no pair is closer than that.
+    //This version checks all pairs.
+    virtual double _closestPair(const VectorC<Vector2d> &pts, const Line &startEnd, int farthest, double tolSq,
+                                int &closest0, int &closest1)
+    {
+        double minDistSq = tolSq;
+        for(int i = 0; i < farthest; ++i) {
+            double t = startEnd.project(pts[i]);
+            if((pts[i] - startEnd.pos(t)).squaredNorm() > tolSq)
+                break;
+            for(int j = (int)pts.size() - 1; j > farthest; --j) {
+                double t2 = startEnd.project(pts[j]);
+                if((pts[j] - startEnd.pos(t2)).squaredNorm() > tolSq)
+                    break;
+                double distSq = (pts[i] - pts[j]).squaredNorm();
+                if(distSq > minDistSq)
+                    continue;
+                minDistSq = distSq;
+                closest0 = i;
+                closest1 = j;
+            }
+        }
+        return minDistSq;
+    }
+};
+
+//Finds the same pair as the old closer, but sorts the points near the end by x so that each point near the start
+//is only compared to the ones whose x is within the best distance so far.  The old closer compares all pairs, which
+//is quadratic when a stroke lingers near its start and end.
+class SweepCurveCloser : public OldCurveCloser
+{
+public:
+    string name() const { return "Default"; }
+
+protected:
+    double _closestPair(const VectorC<Vector2d> &pts, const Line &startEnd, int farthest, double tolSq,
+                        int &closest0, int &closest1)
+    {
+        int numStart = 0, endBegin = (int)pts.size() - 1; //the end run is (endBegin, size)
+        while(numStart < farthest && (pts[numStart] - startEnd.pos(startEnd.project(pts[numStart]))).squaredNorm() <= tolSq)
+            ++numStart;
+        while(endBegin > farthest && (pts[endBegin] - startEnd.pos(startEnd.project(pts[endBegin]))).squaredNorm() <= tolSq)
+            --endBegin;
+
+        vector<pair<double, int> > byX;
+        byX.reserve(pts.size() - 1 - endBegin);
+        for(int j = endBegin + 1; j < (int)pts.size(); ++j)
+            byX.push_back(make_pair(pts[j][0], j));
+        sort(byX.begin(), byX.end());
+
+        double minDistSq = tolSq;
+        for(int i = 0; i < numStart; ++i)
+        {
+            int mid = (int)(lower_bound(byX.begin(), byX.end(), make_pair(pts[i][0], -1)) - byX.begin());
+            for(int dir = 0; dir < 2; ++dir)
+            {
+                for(int k = (dir == 0 ? mid : mid - 1); k >= 0 && k < (int)byX.size(); k += (dir == 0 ? 1 : -1))
+                {
+                    if(SQR(byX[k].first - pts[i][0]) > minDistSq)
+                        break;
+                    int j = byX[k].second;
+                    double distSq = (pts[i] - pts[j]).squaredNorm();
+                    //on ties, the old closer ends up with the later start point and the earlier end point
+                    if(distSq > minDistSq || (distSq == minDistSq && i == closest0 && j > closest1))
+                        continue;
+                    minDistSq = distSq;
+                    closest0 = i;
+                    closest1 = j;
+                }
+            }
+        }
+        return minDistSq;
     }
 };
 
+size_t AlgorithmOutput<CURVE_CLOSING>::memoryUsage() const
+{
+    return sizeof(*this) + (output ? output->memoryUsage() : 0) + (parameters ? parameters->memoryUsage() : 0);
+}
+
+void AlgorithmOutput<CURVE_CLOSING>::recycle()
+{
+    output.reset();
+    closed = false;
+    parameters.reset();
+}
+
+void AlgorithmOutput<CURVE_CLOSING>::write(SnapshotWriter &out) const
+{
+    out.writePolyline(output);
+    out.writeBool(closed);
+    out.writeParameterMap(parameters);
+}
+
+void AlgorithmOutput<CURVE_CLOSING>::read(SnapshotReader &in, const Fitter &)
+{
+    output = in.readPolyline();
+    closed = in.readBool();
+    parameters = in.readParameterMap();
+}
+
 void Algorithm<CURVE_CLOSING>::_initialize()
 {
+    new SweepCurveCloser();
     new OldCurveCloser();
 }
 
@@ -27,6 +27,7 @@
 NAMESPACE_Cornu
 
 CORNU_SMART_FORW_DECL(Polyline)
+CORNU_SMART_FORW_DECL(ParameterMap)
 
 template<>
 struct AlgorithmOutput<SCALE_DETECTION> : public AlgorithmOutputBase
@@ -34,13 +35,23 @@ struct AlgorithmOutput<SCALE_DETECTION> : public AlgorithmOutputBase
     AlgorithmOutput() : scale(1.) {}
 
     double scale;
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
 struct AlgorithmOutput<PRELIM_RESAMPLING> : public AlgorithmOutputBase
 {
     PolylineConstPtr output;
-    std::vector<double> parameters; //parameters[i] is the parameter in output of the original point with index i
+    ParameterMapConstPtr parameters; //maps the original point with index i to its parameter in output
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
@@ -48,7 +59,12 @@ struct AlgorithmOutput<CURVE_CLOSING> : public AlgorithmOutputBase
 {
     PolylineConstPtr output;
     bool closed;
-    std::vector<double> parameters; //parameters[i] is the parameter in output of the original point with index i
+    ParameterMapConstPtr parameters; //maps the original point with index i to its parameter in output
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
@@ -26,6 +26,8 @@
 #include "Fresnel.h"
 
 #include <Eigen/Eigenvalues>
+#include <Eigen/Cholesky>
+#include <Eigen/LU>
 
 using namespace std;
 using namespace Eigen;
@@ -46,6 +48,34 @@ void LineFitter::addPointW(const Vector2d &pt, double weight)
     _crossSum += weight * pt[0] * pt[1];
 }
 
+void LineFitter::addPoints(const Vector2d *pts, const double *weights, int n)
+{
+    if(n <= 0)
+        return;
+    if(_numPts == 0)
+        _firstPoint = pts[0];
+    _lastPoint = pts[n - 1];
+    _numPts += n;
+
+    //the sums go in locals so that the loop vectorizes
+    double totWeight = 0., sumX = 0., sumY = 0., sumXX = 0., sumYY = 0., sumXY = 0.;
+    for(int i = 0; i < n; ++i)
+    {
+        double w = weights ? weights[i] : 1., x = pts[i][0], y = pts[i][1];
+        totWeight += w;
+        sumX += w * x;
+        sumY += w * y;
+        sumXX += w * x * x;
+        sumYY += w * y * y;
+        sumXY += w * x * y;
+    }
+
+    _totWeight += totWeight;
+    _sum += Vector2d(sumX, sumY);
+    _squaredSum += Vector2d(sumXX, sumYY);
+    _crossSum += sumXY;
+}
+
 LinePtr LineFitter::getCurve() const
 {
     if(_numPts < 2)
@@ -69,20 +99,78 @@ LinePtr LineFitter::getCurve() const
     return new Line(pt0, pt1);
 }
 
+//counts the point, keeping every _sampleStep-th one and thinning them out when the buffer fills up
+void ArcFitter::_addSample(const Vector2d &pt)
+{
+    if(_numPts % _sampleStep == 0)
+    {
+        if(_numSamples == maxSamples)
+        {
+            for(int i = 0; 2 * i < maxSamples; ++i)
+                _samples[i] = _samples[2 * i];
+            _numSamples = maxSamples / 2;
+            _sampleStep *= 2;
+        }
+        if(_numPts % _sampleStep == 0)
+            _samples[_numSamples++] = pt;
+    }
+    ++_numPts;
+}
+
 void ArcFitter::addPointW(const Vector2d &pt, double weight)
 {
-    _pts.push_back(pt);
+    if(_numPts == 0)
+        _firstPoint = pt;
+    _lastPoint = pt;
+    _addSample(pt);
 
-    Vector3d pt3(pt[0] - _pts[0][0], pt[1] - _pts[0][1], (pt - _pts[0]).squaredNorm());
+    Vector3d pt3(pt[0] - _firstPoint[0], pt[1] - _firstPoint[1], (pt - _firstPoint).squaredNorm());
 
     _totWeight += weight;
     _sum += weight * pt3;
     _squaredSum += weight * pt3 * pt3.transpose();
 }
 
+void ArcFitter::addPoints(const Vector2d *pts, const double *weights, int n)
+{
+    if(n <= 0)
+        return;
+    if(_numPts == 0)
+        _firstPoint = pts[0];
+    _lastPoint = pts[n - 1];
+    for(int i = 0; i < n; ++i)
+        _addSample(pts[i]);
+
+    //as in addPointW, but with the sums in locals so that the loop vectorizes
+    double totWeight = 0., sx = 0., sy = 0., sz = 0., sxx = 0., sxy = 0., sxz = 0., syy = 0., syz = 0., szz = 0.;
+    for(int i = 0; i < n; ++i)
+    {
+        double w = weights ? weights[i] : 1.;
+        double x = pts[i][0] - _firstPoint[0], y = pts[i][1] - _firstPoint[1], z = x * x + y * y;
+        totWeight += w;
+        sx += w * x;
+        sy += w * y;
+        sz += w * z;
+        sxx += w * x * x;
+        sxy += w * x * y;
+        sxz += w * x * z;
+        syy += w * y * y;
+        syz += w * y * z;
+        szz += w * z * z;
+    }
+
+    _totWeight += totWeight;
+    _sum += Vector3d(sx, sy, sz);
+    Matrix3d squaredSum;
+    squaredSum << sxx, sxy, sxz,
+                  sxy, syy, syz,
+                  sxz, syz, szz;
+    _squaredSum += squaredSum;
+}
+
 ArcPtr ArcFitter::getCurve() const
 {
-    if((int)_pts.size() < 2)
+    if(_numPts < 2)
         return ArcPtr();
 
     double factor = 1. / _totWeight;
@@ -100,11 +188,12 @@ ArcPtr ArcFitter::getCurve() const
     //dir[0] * x + dir[1] * y + (x^2+y^2) = dot
     Vector2d center = -0.5 * Vector2d(dir[0], dir[1]);
     double radius = sqrt(1e-16 + dot + center.squaredNorm());
-    center += _pts[0];
+    center += _firstPoint;
 
     //TODO: convert code to use AngleUtils
-    //Now get the arc
-    Vector2d c[3] = { _pts[0], _pts[_pts.size() / 2], _pts.back() };
+    //Now get the arc, using the kept point closest to the middle to tell which way it goes
+    int midSample = min(_numSamples - 1, (_numPts / 2 + _sampleStep / 2) / _sampleStep);
+    Vector2d c[3] = { _firstPoint, _samples[midSample], _lastPoint };
     double angle[3];
     for(int i = 0; i < 3; ++i) {
         c[i] = (c[i] - center).normalized() * radius;
@@ -133,12 +222,11 @@ ArcPtr ArcFitter::getCurve() const
 
 void ClothoidFitter::addPoint(const Vector2d &pt)
 {
-    _pts.push_back(pt);
-
-    if((int)_pts.size() < 2)
+    Vector2d prevPt = _lastPoint;
+    _lastPoint = pt;
+    if(++_numPts < 2)
         return;
 
-    const Vector2d &prevPt = _pts[_pts.size() - 2];
     double segmentLength = (pt - prevPt).norm();
     _centerOfMass += (pt + prevPt) * (0.5 * segmentLength);
 
@@ -159,13 +247,21 @@ void ClothoidFitter::addPoint(const Vector2d &pt)
     _angleIntegral += segmentLength * angle;
 }
 
+void ClothoidFitter::addPoints(const Vector2d *pts, const double *, int n) //weights are unsupported
+{
+    //each point's angle is unwrapped against the previous one, so this is inherently sequential
+    for(int i = 0; i < n; ++i)
+        ClothoidFitter::addPoint(pts[i]);
+}
+
 ClothoidPtr ClothoidFitter::getCurve() const
 {
     Matrix4d lhs;
 
     lhs = _getLhs(_totalLength);
 
-    Vector4d abcd = lhs.inverse() * _rhs;
+    //solve rather than invert: Eigen's vectorized 4x4 inverse breaks under -ffast-math
+    Vector4d abcd = lhs.ldlt().solve(_rhs);
     return getClothoidWithParams(abcd);
 }
 
@@ -184,7 +280,7 @@ ClothoidPtr ClothoidFitter::getCurveWithZeroCurvature(double param) const
            constraint.transpose(),  0;
     rhs << _rhs, 0;
 
-    Vector4d abcd = (lhs.inverse() * rhs).head<4>();
+    Vector4d abcd = lhs.partialPivLu().solve(rhs).head<4>();
     return getClothoidWithParams(abcd);
 }
 
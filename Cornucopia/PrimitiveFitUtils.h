@@ -39,6 +39,13 @@ public:
 
     virtual void addPointW(const Eigen::Vector2d &pt, double weight) = 0;
     virtual void addPoint(const Eigen::Vector2d &pt) { addPointW(pt, 1.); }
+    //Adds n consecutive points, with unit weights if weights is NULL.  The fitters below accumulate a block
+    //without a virtual call per point, so callers that know several points up front should use this.
+    virtual void addPoints(const Eigen::Vector2d *pts, const double *weights, int n)
+    {
+        for(int i = 0; i < n; ++i)
+            addPointW(pts[i], weights ? weights[i] : 1.);
+    }
     virtual CurvePrimitivePtr getPrimitive() const = 0;
 };
 CORNU_SMART_TYPEDEFS(FitterBase);
@@ -55,6 +62,7 @@ public:
 
     //overrides
     void addPointW(const Eigen::Vector2d &pt, double weight);
+    void addPoints(const Eigen::Vector2d *pts, const double *weights, int n);
     CurvePrimitivePtr getPrimitive() const { return getCurve(); }
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -70,19 +78,34 @@ private:
 class ArcFitter : public FitterBase
 {
 public:
-    ArcFitter() : _totWeight(0.), _squaredSum(_squaredSum.Zero()), _sum(_sum.Zero()) {}
+    typedef Eigen::Vector2d Vec;
+
+    ArcFitter() : _squaredSum(_squaredSum.Zero()), _sum(_sum.Zero()), _firstPoint(Vec::Zero()), _lastPoint(Vec::Zero()),
+        _numPts(0), _totWeight(0.), _numSamples(0), _sampleStep(1) {}
 
     ArcPtr getCurve() const;
 
     //overrides
     void addPointW(const Eigen::Vector2d &pt, double weight);
+    void addPoints(const Eigen::Vector2d *pts, const double *weights, int n);
     CurvePrimitivePtr getPrimitive() const { return getCurve(); }
 
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 private:
+    void _addSample(const Vec &pt);
+
     Eigen::Matrix3d _squaredSum;
-    Eigen::Vector3d _sum;
-    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > _pts;
+    Eigen::Vector3d _sum; //of points relative to the first point, lifted to the paraboloid z = x^2 + y^2
+    Vec _firstPoint, _lastPoint;
+    int _numPts;
     double _totWeight;
+
+    //Every _sampleStep-th point, for finding one near the middle to orient the arc.  The step doubles
+    //when the buffer fills, so the memory is bounded and the middle is off by at most (n / maxSamples).
+    enum { maxSamples = 32 };
+    Vec _samples[maxSamples];
+    int _numSamples;
+    int _sampleStep;
 };
 
 //This fits a clothoid by fitting a cubic polynomial to the integral of the angle function,
@@ -91,8 +114,8 @@ private:
 class ClothoidFitter : public FitterBase
 {
 public:
-    ClothoidFitter() : _totalLength(0), _prevAngle(0), _angleIntegral(0),
-                       _centerOfMass(_centerOfMass.Zero()), _rhs(_rhs.Zero()) {}
+    ClothoidFitter() : _numPts(0), _totalLength(0), _prevAngle(0), _angleIntegral(0),
+                       _centerOfMass(_centerOfMass.Zero()), _rhs(_rhs.Zero()), _lastPoint(Eigen::Vector2d::Zero()) {}
 
     ClothoidPtr getCurve() const;
     ClothoidPtr getCurveWithZeroCurvature(double param) const;
@@ -100,6 +123,7 @@ public:
     //overrides
     void addPoint(const Eigen::Vector2d &pt);
     void addPointW(const Eigen::Vector2d &pt, double weight) { addPoint(pt); } //weight is unsupported
+    void addPoints(const Eigen::Vector2d *pts, const double *weights, int n);
     CurvePrimitivePtr getPrimitive() const { return getCurve(); }
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -111,7 +135,8 @@ private:
 
     Eigen::Vector2d _centerOfMass;
     Eigen::Vector4d _rhs;
-    std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > _pts;
+    Eigen::Vector2d _lastPoint;
+    int _numPts;
     double _prevAngle;
     double _angleIntegral;
 
@@ -22,10 +22,13 @@
 #include "Resampler.h"
 #include "Fitter.h"
 #include "Polyline.h"
+#include "Clothoid.h"
 #include "PrimitiveFitUtils.h"
 #include "ErrorComputer.h"
 #include "Solver.h"
 #include "Oversketcher.h"
+#include "FitMetrics.h"
+#include "Snapshot.h"
 
 using namespace std;
 using namespace Eigen;
@@ -34,27 +37,29 @@ NAMESPACE_Cornu
 class OneCurveProblem : public LSProblem
 {
 public:
-    OneCurveProblem(const FitPrimitive &primitive, ErrorComputerConstPtr errorComputer)
+    typedef LSSmallDenseEvalData<6> EvalData; //at most six parameters (clothoid)
+
+    OneCurveProblem(const FitPrimitive &primitive, const ErrorComputer &errorComputer)
         : _primitive(primitive), _errorComputer(errorComputer)  {}
 
     //overrides
     double error(const VectorXd &x, LSEvalData *)
     {
         setParams(x);
-        return _errorComputer->computeError(_primitive.curve, _primitive.startIdx, _primitive.endIdx);
+        return _errorComputer.computeErrorIncremental(_primitive.curve, _primitive.startIdx, _primitive.endIdx, _projections);
     }
 
     LSEvalData *createEvalData()
     {
-        return new LSDenseEvalData();
+        return new EvalData();
     }
     void eval(const VectorXd &x, LSEvalData *data)
     {
-        LSDenseEvalData *curveData = static_cast<LSDenseEvalData *>(data);
+        EvalData *curveData = static_cast<EvalData *>(data);
         setParams(x);
         MatrixXd &errDer = curveData->errDerRef();
-        _errorComputer->computeErrorVector(_primitive.curve, _primitive.startIdx, _primitive.endIdx,
-                                           curveData->errVectorRef(), &errDer);
+        _errorComputer.computeErrorVectorIncremental(_primitive.curve, _primitive.startIdx, _primitive.endIdx,
+                                                     curveData->errVectorRef(), &errDer, _projections);
 
         _primitive.curve->toEndCurvatureDerivative(errDer);
     }
@@ -83,7 +88,8 @@ public:
 
 private:
     FitPrimitive _primitive;
-    ErrorComputerConstPtr _errorComputer;
+    const ErrorComputer &_errorComputer;
+    VectorXd _projections; //of the samples in the last error computation, to warm-start the next
 };
 
 class DefaultPrimitiveFitter : public Algorithm<PRIMITIVE_FITTING>
@@ -108,7 +114,6 @@ protected:
         const VectorC<Vector2d> &pts = poly->pts();
 
         const double errorThreshold = fitter.scaledParameter(Parameters::ERROR_THRESHOLD);
-        std::string typeNames[3] = { "Lines", "Arcs", "Clothoids" };
         bool inflectionAccounting = fitter.params().get(Parameters::INFLECTION_COST) > 0.;
 
         if(osOutput->startCurve)
@@ -134,7 +139,7 @@ protected:
                 fit.curve->trim(0, fit.curve->project(pts[i]));
 
                 fit.endCurvSign = (fit.curve->endCurvature() >= 0) ? 1 : -1;
-                fit.error = errorComputer->computeErrorForCost(fit.curve, 0, fit.endIdx, false);
+                fit.error = errorComputer->computeErrorForCostBounded(fit.curve, 0, fit.endIdx, errorThreshold * errorThreshold, false);
 
                 fit.numPts++;
 
@@ -173,7 +178,7 @@ protected:
                 fit.curve->trim(fit.curve->project(pts[i]), fit.curve->length());
 
                 fit.startCurvSign = (fit.curve->startCurvature() >= 0) ? 1 : -1;
-                fit.error = errorComputer->computeErrorForCost(fit.curve, fit.startIdx, (int)pts.size() - 1, true, false);
+                fit.error = errorComputer->computeErrorForCostBounded(fit.curve, fit.startIdx, (int)pts.size() - 1, errorThreshold * errorThreshold, true, false);
 
                 fit.numPts++;
 
@@ -189,116 +194,246 @@ protected:
             }
         }
 
-        for(int i = 0; i < pts.size(); ++i) //iterate over start points
+        _Context context;
+        context.corners = &corners;
+        context.poly = poly.get();
+        context.errorComputer = errorComputer.get();
+        context.errorThresholdSq = SQR(errorThreshold);
+        context.inflectionAccounting = inflectionAccounting;
+        context.adjustDamping = fitter.params().get(Parameters::CURVE_ADJUST_DAMPING);
+        context.batchSize = max(1, (int)fitter.params().get(Parameters::ERROR_BATCH_SIZE));
+        context.errorBackend = &fitter.errorBackend();
+        for(int type = 0; type <= 2; ++type)
+            context.needType[type] = fitter.params().get(Parameters::ParameterType(Parameters::LINE_COST + type)) < Parameters::infinity;
+
+        if(fitter.params().get(Parameters::MULTITHREADED) == 0.)
         {
-            FitterBasePtr fitters[3];
-            fitters[0] = new LineFitter();
-            fitters[1] = new ArcFitter();
-            fitters[2] = new ClothoidFitter();
-
-            for(int type = 0; type <= 2; ++type) //iterate over lines, arcs, clothoids
+            for(int i = 0; i < pts.size(); ++i) //iterate over start points
+                _fitFromStartPoint(i, context, out.primitives);
+        }
+        else
+        {
+            //Split the start points into contiguous chunks, fit each chunk into its own buffer,
+            //and concatenate the buffers in order, so the result is the same as the serial one.
+            const int pointsPerChunk = 4;
+            int numChunks = (pts.size() + pointsPerChunk - 1) / pointsPerChunk;
+            vector<vector<FitPrimitive> > chunkPrimitives(numChunks);
+            fitter.executor().parallelFor(numChunks, [&](int chunk)
             {
-                int fitSoFar = 0;
+                int end = min(pts.size(), (chunk + 1) * pointsPerChunk);
+                for(int i = chunk * pointsPerChunk; i < end; ++i)
+                    _fitFromStartPoint(i, context, chunkPrimitives[chunk]);
+            });
 
-                bool needType = fitter.params().get(Parameters::ParameterType(Parameters::LINE_COST + type)) < Parameters::infinity;
+            for(int chunk = 0; chunk < numChunks; ++chunk)
+                out.primitives.insert(out.primitives.end(), chunkPrimitives[chunk].begin(), chunkPrimitives[chunk].end());
+        }
 
-                for(VectorC<Vector2d>::Circulator circ = pts.circulator(i); !circ.done(); ++circ)
-                {
-                    ++fitSoFar;
+        out.updateColumns();
+        FitMetrics::count(FitMetrics::CANDIDATE_PRIMITIVES, (long long)out.primitives.size());
+    }
 
-                    if(!needType && (type == 2 || fitSoFar >= 3 + type)) //if we don't need primitives of this type
-                        break;
+    //Fitting from a start point only reads the context, so different start points can be fit
+    //concurrently.  The context holds plain pointers because smart pointer reference counts
+    //aren't safe to modify from several threads.
+    struct _Context
+    {
+        const VectorC<bool> *corners;
+        const Polyline *poly;
+        const ErrorComputer *errorComputer;
+        double errorThresholdSq;
+        bool inflectionAccounting;
+        bool needType[3];
+        double adjustDamping;
+        int batchSize;
+        ErrorBackend *errorBackend;
+    };
+
+    //The candidates with zero curvature at the start and at the end that go with an inflecting clothoid (the
+    //clothoid fitter's last fit), over the same samples.  The variants start out as copies of the clothoid's fit.
+    void _inflectionVariants(const FitterBasePtr &clothoidFitter, const _Context &context,
+                             FitPrimitive &startNoCurv, FitPrimitive &endNoCurv) const
+    {
+        double start = context.poly->idxToParam(startNoCurv.startIdx);
+        double end = context.poly->idxToParam(startNoCurv.endIdx);
+        const ClothoidFitter &fitter = static_cast<const ClothoidFitter &>(*clothoidFitter);
+        startNoCurv.curve = fitter.getCurveWithZeroCurvature(0);
+        startNoCurv.startCurvSign = startNoCurv.endCurvSign = (startNoCurv.curve->endCurvature() > 0. ? 1 : -1);
+        endNoCurv.curve = fitter.getCurveWithZeroCurvature(end - start);
+        endNoCurv.startCurvSign = endNoCurv.endCurvSign = (endNoCurv.curve->startCurvature() > 0. ? 1 : -1);
+
+        if(_adjust)
+        {
+            adjustPrimitive(startNoCurv, context);
+            adjustPrimitive(endNoCurv, context);
+        }
+    }
 
-                    fitters[type]->addPoint(*circ);
-                    if(fitSoFar >= 2 + type) //at least two points per line, etc.
-                    {
-                        CurvePrimitivePtr curve = fitters[type]->getPrimitive();
-                        Vector3d color(0, 0, 0);
-                        color[type] = 1;
+    //A candidate fit ahead, whose error is computed with the rest of its batch.  The two candidates with zero
+    //curvature at an end that go with an inflecting clothoid follow it, as variants, and are only kept if it is.
+    struct _PendingFit
+    {
+        FitPrimitive fit;
+        bool variant;
+    };
+
+    //Computes the errors of the pending fits, adds the ones under the threshold to out in order, and clears them.
+    //Returns false if a candidate that isn't a variant was over the threshold, i.e., fitting from the start point
+    //should have stopped there.
+    bool _flushPending(vector<_PendingFit> &pending, const _Context &context, vector<FitPrimitive> &out) const
+    {
+        vector<ErrorCandidate> candidates(pending.size());
+        for(int i = 0; i < (int)pending.size(); ++i)
+        {
+            candidates[i].curve = pending[i].fit.curve;
+            candidates[i].from = pending[i].fit.startIdx;
+            candidates[i].to = pending[i].fit.endIdx;
+        }
+        vector<double> errors(pending.size());
+        context.errorBackend->computeErrorsForCost(*context.errorComputer, *context.poly, candidates.data(),
+                                                   (int)candidates.size(), context.errorThresholdSq, errors.data());
 
-                        FitPrimitive fit;
-                        fit.curve = curve;
-                        fit.startIdx = i;
-                        fit.endIdx = circ.index();
-                        fit.numPts = fitSoFar;
-                        fit.startCurvSign = (curve->startCurvature() >= 0) ? 1 : -1;
-                        fit.endCurvSign = (curve->endCurvature() >= 0) ? 1 : -1;
+        bool keepGoing = true;
+        for(int i = 0; i < (int)pending.size() && keepGoing; ++i)
+        {
+            pending[i].fit.error = errors[i];
+            if(pending[i].variant)
+            {
+                if(errors[i] < context.errorThresholdSq)
+                    out.push_back(pending[i].fit);
+            }
+            else if(errors[i] > context.errorThresholdSq)
+                keepGoing = false;
+            else
+                out.push_back(pending[i].fit);
+            //the variants after a candidate that is over the threshold are skipped with it
+        }
+        pending.clear();
+        return keepGoing;
+    }
 
-                        if(_adjust)
-                            adjustPrimitive(fit, fitter);
+    void _fitFromStartPoint(int i, const _Context &context, vector<FitPrimitive> &out) const
+    {
+        //a disabled type still gets its shortest primitives (so that there is always some path), except clothoids
+        FitterBasePtr fitters[3];
+        fitters[0] = new LineFitter();
+        fitters[1] = new ArcFitter();
+        if(context.needType[2])
+            fitters[2] = new ClothoidFitter();
 
-                        fit.error = errorComputer->computeErrorForCost(curve, i, fit.endIdx);
+        for(int type = 0; type <= 2; ++type) //iterate over lines, arcs, clothoids
+        {
+            int fitSoFar = 0;
+            VectorXd projectionParams; //of the previous candidate, to warm-start the error computation
+            vector<_PendingFit> pending; //with a batch size above one
+            int numPending = 0; //not counting variants
+
+            bool needType = context.needType[type];
+
+            //The points before the first candidate go in as a block, unless there's a corner among them
+            //(which ends the fit--the loop below takes care of that)
+            const VectorC<Vector2d> &pts = context.poly->pts();
+            VectorC<Vector2d>::Circulator circ = pts.circulator(i);
+            int numBlock = (needType || type < 2) ? 1 + type : 0;
+            for(int k = 1; k < numBlock; ++k)
+            {
+                if(!(circ + k).done() && (*context.corners)[(circ + k).index()])
+                    numBlock = 0;
+            }
+            VectorC<Vector2d>::FlatSpan spans[2];
+            int numSpans = pts.flatSpans(i, numBlock, spans);
+            for(int s = 0; s < numSpans; ++s)
+            {
+                int num = spans[s].end - spans[s].begin;
+                fitters[type]->addPoints(&pts.flatAt(spans[s].begin), NULL, num);
+                fitSoFar += num;
+                circ += num;
+            }
 
-                        double length = poly->lengthFromTo(i, fit.endIdx);
-                        if(fit.error > errorThreshold * errorThreshold)
-                            break;
+            for(; !circ.done(); ++circ)
+            {
+                ++fitSoFar;
 
-                        //Debugging::get()->drawCurve(curve, color, typeNames[type]);
-                        out.primitives.push_back(fit);
+                if(!needType && (type == 2 || fitSoFar >= 3 + type)) //if we don't need primitives of this type
+                    break;
 
-                        if(type == 0 && inflectionAccounting) //line with "opposite" curvature
+                fitters[type]->addPoint(*circ);
+                if(fitSoFar >= 2 + type) //at least two points per line, etc.
+                {
+                    CurvePrimitivePtr curve = fitters[type]->getPrimitive();
+                    Vector3d color(0, 0, 0);
+                    color[type] = 1;
+
+                    FitPrimitive fit;
+                    fit.curve = curve;
+                    fit.startIdx = i;
+                    fit.endIdx = circ.index();
+                    fit.numPts = fitSoFar;
+                    fit.startCurvSign = (curve->startCurvature() >= 0) ? 1 : -1;
+                    fit.endCurvSign = (curve->endCurvature() >= 0) ? 1 : -1;
+
+                    if(_adjust)
+                        adjustPrimitive(fit, context);
+
+                    bool inflecting = fit.startCurvSign != fit.endCurvSign && context.inflectionAccounting;
+                    if(context.batchSize > 1)
+                    {
+                        _PendingFit pendingFit = { fit, false };
+                        pending.push_back(pendingFit);
+                        if(inflecting)
                         {
-                            fit.startCurvSign = -fit.startCurvSign;
-                            fit.endCurvSign = -fit.endCurvSign;
-                            out.primitives.push_back(fit);
+                            _PendingFit variants[2] = { { fit, true }, { fit, true } };
+                            _inflectionVariants(fitters[2], context, variants[0].fit, variants[1].fit);
+                            pending.insert(pending.end(), variants, variants + 2);
                         }
-
-                        //if different start and end curvatures
-                        if(fit.startCurvSign != fit.endCurvSign && inflectionAccounting)
+                        if(++numPending == context.batchSize)
                         {
-                            double start = poly->idxToParam(i);
-                            double end = poly->idxToParam(fit.endIdx);
-                            CurvePrimitivePtr startNoCurv = static_pointer_cast<ClothoidFitter>(fitters[2])->getCurveWithZeroCurvature(0);
-                            CurvePrimitivePtr endNoCurv = static_pointer_cast<ClothoidFitter>(fitters[2])->getCurveWithZeroCurvature(end - start);
-
-                            fit.curve = startNoCurv;
-                            fit.startCurvSign = fit.endCurvSign = (startNoCurv->endCurvature() > 0. ? 1 : -1);
-
-                            if(_adjust)
-                                adjustPrimitive(fit, fitter);
-
-                            fit.error = errorComputer->computeErrorForCost(fit.curve, i, fit.endIdx);
-
-                            if(fit.error < errorThreshold * errorThreshold)
-                            {
-                                out.primitives.push_back(fit);
-                                //Debugging::get()->drawCurve(fit.curve, color, typeNames[type]);
-                            }
-
-                            fit.curve = endNoCurv;
-                            fit.startCurvSign = fit.endCurvSign = (endNoCurv->startCurvature() > 0. ? 1 : -1);
+                            numPending = 0;
+                            if(!_flushPending(pending, context, out))
+                                break;
+                        }
+                    }
+                    else
+                    {
+                        fit.error = context.errorComputer->computeErrorForCostIncremental(curve, i, fit.endIdx, context.errorThresholdSq, projectionParams);
 
-                            if(_adjust)
-                                adjustPrimitive(fit, fitter);
+                        if(fit.error > context.errorThresholdSq)
+                            break;
 
-                            fit.error = errorComputer->computeErrorForCost(fit.curve, i, fit.endIdx);
+                        //Debugging::get()->drawCurve(curve, color, "Fitted Primitives");
+                        out.push_back(fit); //a line is fitted once; the path finder picks its curvature sign
 
-                            if(fit.error < errorThreshold * errorThreshold)
+                        //if different start and end curvatures
+                        if(inflecting)
+                        {
+                            FitPrimitive variants[2] = { fit, fit };
+                            _inflectionVariants(fitters[2], context, variants[0], variants[1]);
+                            for(int k = 0; k < 2; ++k)
                             {
-                                out.primitives.push_back(fit);
-                                //Debugging::get()->drawCurve(fit.curve, color, typeNames[type]);
+                                variants[k].error = context.errorComputer->computeErrorForCostBounded(variants[k].curve, i, fit.endIdx, context.errorThresholdSq);
+                                if(variants[k].error < context.errorThresholdSq)
+                                    out.push_back(variants[k]);
                             }
                         }
                     }
-                    if(fitSoFar > 1 && corners[circ.index()])
-                        break;
                 }
+                if(fitSoFar > 1 && (*context.corners)[circ.index()])
+                    break;
             }
+            if(!pending.empty())
+                _flushPending(pending, context, out);
         }
     }
 
-    void adjustPrimitive(const FitPrimitive &primitive, const Fitter &fitter)
+    void adjustPrimitive(const FitPrimitive &primitive, const _Context &context) const
     {
-        ErrorComputerConstPtr errorComputer = fitter.output<ERROR_COMPUTER>()->errorComputer;
-        bool inflectionAccounting = fitter.params().get(Parameters::INFLECTION_COST) > 0.;
-
         vector<LSBoxConstraint> constraints;
 
         //minimum length constraint
         constraints.push_back(LSBoxConstraint(CurvePrimitive::LENGTH, primitive.curve->length() * 0.5, 1));
 
         //curvature sign constraints
-        if(inflectionAccounting)
+        if(context.inflectionAccounting)
         {
             if(primitive.curve->getType() >= CurvePrimitive::ARC)
                 constraints.push_back(LSBoxConstraint(CurvePrimitive::CURVATURE, 0., primitive.startCurvSign));
@@ -307,14 +442,104 @@ protected:
         }
 
         //solve
-        OneCurveProblem problem(primitive, errorComputer);
+        OneCurveProblem problem(primitive, *context.errorComputer);
         LSSolver solver(&problem, constraints);
-        solver.setDefaultDamping(fitter.params().get(Parameters::CURVE_ADJUST_DAMPING));
+        solver.setWorkspace(&LSWorkspace::forThread());
+        solver.setDefaultDamping(context.adjustDamping);
         solver.setMaxIter(1);
         problem.setParams(solver.solve(problem.params()));
     }
 };
 
+void FitPrimitiveColumns::assign(const vector<FitPrimitive> &primitives)
+{
+    int num = (int)primitives.size();
+    type.resize(num);
+    fixed.resize(num);
+    startCurvSign.resize(num);
+    endCurvSign.resize(num);
+    startIdx.resize(num);
+    endIdx.resize(num);
+    numPts.resize(num);
+    length.resize(num);
+    error.resize(num);
+    for(int i = 0; i < num; ++i)
+    {
+        const FitPrimitive &primitive = primitives[i];
+        type[i] = (unsigned char)primitive.curve->getType();
+        fixed[i] = primitive.fixed;
+        startCurvSign[i] = (signed char)primitive.startCurvSign;
+        endCurvSign[i] = (signed char)primitive.endCurvSign;
+        startIdx[i] = primitive.startIdx;
+        endIdx[i] = primitive.endIdx;
+        numPts[i] = primitive.numPts;
+        length[i] = primitive.curve->length();
+        error[i] = primitive.error;
+    }
+}
+
+size_t FitPrimitiveColumns::memoryUsage() const
+{
+    return vectorMemory(type) + fixed.capacity() / 8 + vectorMemory(startCurvSign) + vectorMemory(endCurvSign) +
+           vectorMemory(startIdx) + vectorMemory(endIdx) + vectorMemory(numPts) + vectorMemory(length) + vectorMemory(error);
+}
+
+size_t AlgorithmOutput<PRIMITIVE_FITTING>::memoryUsage() const
+{
+    return sizeof(*this) + vectorMemory(primitives) + primitives.size() * sizeof(Clothoid) + columns.memoryUsage() +
+           combineCache->memoryUsage();
+}
+
+void AlgorithmOutput<PRIMITIVE_FITTING>::recycle()
+{
+    primitives.clear();
+    columns.assign(primitives);
+    if(combineCache.unique())
+        combineCache->clear();
+    else
+        combineCache = new TwoCurveCombineCache();
+}
+
+void AlgorithmOutput<PRIMITIVE_FITTING>::write(SnapshotWriter &out) const
+{
+    out.writeInt((int)primitives.size());
+    for(int i = 0; i < (int)primitives.size(); ++i)
+    {
+        const FitPrimitive &primitive = primitives[i];
+        out.writeCurve(primitive.curve);
+        out.writeInt(primitive.startIdx);
+        out.writeInt(primitive.endIdx);
+        out.writeInt(primitive.numPts);
+        out.writeDouble(primitive.error);
+        out.writeInt(primitive.startCurvSign);
+        out.writeInt(primitive.endCurvSign);
+        out.writeBool(primitive.fixed);
+    }
+    //the combine cache is not written, so a replay starts with it empty
+}
+
+void AlgorithmOutput<PRIMITIVE_FITTING>::read(SnapshotReader &in, const Fitter &)
+{
+    primitives.resize(in.readSize());
+    for(int i = 0; i < (int)primitives.size() && in.ok(); ++i)
+    {
+        FitPrimitive &primitive = primitives[i];
+        primitive.curve = in.readCurve();
+        primitive.startIdx = in.readInt();
+        primitive.endIdx = in.readInt();
+        primitive.numPts = in.readInt();
+        primitive.error = in.readDouble();
+        primitive.startCurvSign = in.readInt();
+        primitive.endCurvSign = in.readInt();
+        primitive.fixed = in.readBool();
+        if(!primitive.curve)
+            in.fail();
+    }
+    if(!in.ok())
+        primitives.clear();
+    updateColumns();
+}
+
 void Algorithm<PRIMITIVE_FITTING>::_initialize()
 {
     new DefaultPrimitiveFitter(false);
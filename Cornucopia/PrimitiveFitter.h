@@ -23,6 +23,7 @@
 
 #include "defs.h"
 #include "Algorithm.h"
+#include "TwoCurveCombine.h"
 
 NAMESPACE_Cornu
 
@@ -30,7 +31,7 @@ CORNU_SMART_FORW_DECL(CurvePrimitive);
 
 struct FitPrimitive
 {
-    FitPrimitive() : fixed(false) {}
+    FitPrimitive() : error(0.), fixed(false) {}
 
     CurvePrimitivePtr curve;
     int startIdx;
@@ -46,10 +47,41 @@ struct FitPrimitive
     bool isFixed() const { return fixed; }
 };
 
+//The fields of the primitives that graph construction reads for every pair of candidates, stored by column,
+//so that those loops walk small arrays instead of following each primitive's curve pointer
+struct FitPrimitiveColumns
+{
+    int size() const { return (int)type.size(); }
+    void assign(const std::vector<FitPrimitive> &primitives);
+    size_t memoryUsage() const;
+
+    std::vector<unsigned char> type; //CurvePrimitive::PrimitiveType
+    std::vector<bool> fixed;
+    std::vector<signed char> startCurvSign;
+    std::vector<signed char> endCurvSign;
+    std::vector<int> startIdx;
+    std::vector<int> endIdx;
+    std::vector<int> numPts;
+    std::vector<double> length;
+    std::vector<double> error;
+};
+
 template<>
 struct AlgorithmOutput<PRIMITIVE_FITTING> : public AlgorithmOutputBase
 {
+    AlgorithmOutput() : combineCache(new TwoCurveCombineCache()) {}
+
+    //call after changing primitives
+    void updateColumns() { columns.assign(primitives); }
+
     std::vector<FitPrimitive> primitives;
+    FitPrimitiveColumns columns;
+    TwoCurveCombineCachePtr combineCache; //combinations of these primitives computed so far
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
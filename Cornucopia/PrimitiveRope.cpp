@@ -0,0 +1,303 @@
+/*--
+    PrimitiveRope.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PrimitiveRope.h"
+#include "PrimitiveSequence.h"
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+PrimitiveRope::PrimitiveRope(const VectorC<CurvePrimitiveConstPtr> &primitives)
+{
+    if(!primitives.empty())
+        _root = _build(primitives, 0, primitives.size());
+}
+
+PrimitiveRope::PrimitiveRope(CurvePrimitiveConstPtr primitive) : _root(_leaf(primitive))
+{
+}
+
+CurvePrimitiveConstPtr PrimitiveRope::primitive(int idx) const
+{
+    assert(idx >= 0 && idx < size());
+    const _Node *node = _root.get();
+    while(node->left)
+    {
+        if(idx < node->left->count)
+            node = node->left.get();
+        else
+        {
+            idx -= node->left->count;
+            node = node->right.get();
+        }
+    }
+    return node->primitive;
+}
+
+int PrimitiveRope::paramToIdx(double param, double *outParam) const
+{
+    assert(_root);
+    param = max(0., min(param, _root->length));
+    const _Node *node = _root.get();
+    int idx = 0;
+    while(node->left)
+    {
+        //a parameter between two primitives goes to the second, as in PrimitiveSequence
+        if(param < node->left->length)
+            node = node->left.get();
+        else
+        {
+            param -= node->left->length;
+            idx += node->left->count;
+            node = node->right.get();
+        }
+    }
+    if(outParam)
+        *outParam = max(0., min(param, node->length));
+    return idx;
+}
+
+void PrimitiveRope::eval(double s, Vec *pos, Vec *der, Vec *der2) const
+{
+    double localS;
+    int idx = paramToIdx(s, &localS);
+    primitive(idx)->eval(localS, pos, der, der2);
+}
+
+double PrimitiveRope::project(const Vec &point) const
+{
+    assert(_root);
+    double bestParam = 0., minDistSq = 1e50;
+    _project(point, _root.get(), 0., bestParam, minDistSq);
+    return bestParam;
+}
+
+PrimitiveRope PrimitiveRope::concatenated(const PrimitiveRope &other) const
+{
+    return _fromRoot(_join(_root, other._root));
+}
+
+PrimitiveRope PrimitiveRope::sliced(int from, int to) const
+{
+    from = max(0, from);
+    to = min(size(), to);
+    if(from >= to)
+        return PrimitiveRope();
+
+    _NodeConstPtr before, rest, middle, after;
+    _split(_root, from, before, rest);
+    _split(rest, to - from, middle, after);
+    return _fromRoot(middle);
+}
+
+PrimitiveRope PrimitiveRope::trimmed(double from, double to) const
+{
+    const double tol = 1e-10;
+
+    from = max(0., from);
+    to = min(length(), to);
+    if(to - from < tol)
+        return PrimitiveRope();
+
+    double fromS, toS;
+    int fromIdx = paramToIdx(from, &fromS);
+    int toIdx = paramToIdx(to, &toS);
+    if(toS < tol && toIdx > fromIdx) //ends exactly at the start of a primitive
+    {
+        toIdx--;
+        toS = primitive(toIdx)->length();
+    }
+
+    //the primitives cut by the trim are replaced, like in PrimitiveSequence::trimmed
+    CurvePrimitiveConstPtr first = primitive(fromIdx), last = primitive(toIdx);
+    if(fromIdx == toIdx)
+    {
+        if(fromS < tol && toS > first->length() - tol)
+            return sliced(fromIdx, fromIdx + 1);
+        return PrimitiveRope(first->trimmed(fromS, toS));
+    }
+
+    PrimitiveRope out = sliced(fromIdx + 1, toIdx);
+    if(fromS < tol)
+        out = PrimitiveRope(first).concatenated(out);
+    else if(first->length() - fromS >= tol)
+        out = PrimitiveRope(first->trimmed(fromS, first->length())).concatenated(out);
+    if(toS > last->length() - tol)
+        out = out.concatenated(PrimitiveRope(last));
+    else if(toS >= tol)
+        out = out.concatenated(PrimitiveRope(last->trimmed(0., toS)));
+    return out;
+}
+
+PrimitiveRope PrimitiveRope::spliced(double from, double to, const PrimitiveRope &replacement) const
+{
+    return trimmed(0., from).concatenated(replacement).concatenated(trimmed(to, length()));
+}
+
+PrimitiveSequencePtr PrimitiveRope::toSequence(CircularType circular) const
+{
+    assert(_root);
+    VectorC<CurvePrimitiveConstPtr> primitives(0, circular);
+    primitives.reserve(size());
+    _collect(_root.get(), primitives);
+    return new PrimitiveSequence(primitives);
+}
+
+PrimitiveRope::_NodeConstPtr PrimitiveRope::_leaf(const CurvePrimitiveConstPtr &primitive)
+{
+    _Node *out = new _Node();
+    out->primitive = primitive;
+    out->height = out->count = 1;
+    out->length = primitive->length();
+    out->box = primitive->boundingBox();
+    return out;
+}
+
+PrimitiveRope::_NodeConstPtr PrimitiveRope::_node(const _NodeConstPtr &left, const _NodeConstPtr &right)
+{
+    _Node *out = new _Node();
+    out->left = left;
+    out->right = right;
+    out->height = max(left->height, right->height) + 1;
+    out->count = left->count + right->count;
+    out->length = left->length + right->length;
+    out->box = left->box.merged(right->box);
+    return out;
+}
+
+//A single or double rotation, as in an AVL tree, when one side is two taller than the other
+PrimitiveRope::_NodeConstPtr PrimitiveRope::_balanced(const _NodeConstPtr &left, const _NodeConstPtr &right)
+{
+    if(left->height > right->height + 1)
+    {
+        if(_height(left->left) >= _height(left->right))
+            return _node(left->left, _node(left->right, right));
+        return _node(_node(left->left, left->right->left), _node(left->right->right, right));
+    }
+    if(right->height > left->height + 1)
+    {
+        if(_height(right->right) >= _height(right->left))
+            return _node(_node(left, right->left), right->right);
+        return _node(_node(left, right->left->left), _node(right->left->right, right->right));
+    }
+    return _node(left, right);
+}
+
+//Walks down the taller tree's spine to a subtree as tall as the shorter tree, so it takes time proportional to the
+//difference in heights
+PrimitiveRope::_NodeConstPtr PrimitiveRope::_join(const _NodeConstPtr &left, const _NodeConstPtr &right)
+{
+    if(!left)
+        return right;
+    if(!right)
+        return left;
+    if(left->height > right->height + 1)
+        return _balanced(left->left, _join(left->right, right));
+    if(right->height > left->height + 1)
+        return _balanced(_join(left, right->left), right->right);
+    return _node(left, right);
+}
+
+//The joins on the way back up take O(log n) altogether, because the heights they join telescope
+void PrimitiveRope::_split(const _NodeConstPtr &node, int idx, _NodeConstPtr &first, _NodeConstPtr &rest)
+{
+    if(!node || idx <= 0)
+    {
+        first.reset();
+        rest = node;
+        return;
+    }
+    if(idx >= node->count)
+    {
+        first = node;
+        rest.reset();
+        return;
+    }
+
+    _NodeConstPtr a, b;
+    if(idx < node->left->count)
+    {
+        _split(node->left, idx, a, b);
+        first = a;
+        rest = _join(b, node->right);
+    }
+    else
+    {
+        _split(node->right, idx - node->left->count, a, b);
+        first = _join(node->left, a);
+        rest = b;
+    }
+}
+
+PrimitiveRope::_NodeConstPtr PrimitiveRope::_build(const VectorC<CurvePrimitiveConstPtr> &primitives, int from, int to)
+{
+    if(to - from == 1)
+        return _leaf(primitives.flatAt(from));
+    int mid = (from + to) / 2;
+    return _node(_build(primitives, from, mid), _build(primitives, mid, to));
+}
+
+void PrimitiveRope::_project(const Vec &point, const _Node *node, double offset, double &bestParam, double &minDistSq)
+{
+    if(!node->left)
+    {
+        double localS = node->primitive->project(point);
+        double distSq = (node->primitive->pos(localS) - point).squaredNorm();
+        if(distSq < minDistSq)
+        {
+            minDistSq = distSq;
+            bestParam = offset + localS;
+        }
+        return;
+    }
+
+    //visit the closer child first, so that the other one is more likely to be pruned
+    double leftDistSq = node->left->box.squaredExteriorDistance(point);
+    double rightDistSq = node->right->box.squaredExteriorDistance(point);
+    double rightOffset = offset + node->left->length;
+    if(rightDistSq < leftDistSq)
+    {
+        if(rightDistSq <= minDistSq)
+            _project(point, node->right.get(), rightOffset, bestParam, minDistSq);
+        if(leftDistSq <= minDistSq)
+            _project(point, node->left.get(), offset, bestParam, minDistSq);
+    }
+    else
+    {
+        if(leftDistSq <= minDistSq)
+            _project(point, node->left.get(), offset, bestParam, minDistSq);
+        if(rightDistSq <= minDistSq)
+            _project(point, node->right.get(), rightOffset, bestParam, minDistSq);
+    }
+}
+
+void PrimitiveRope::_collect(const _Node *node, VectorC<CurvePrimitiveConstPtr> &out)
+{
+    if(!node->left)
+    {
+        out.push_back(node->primitive);
+        return;
+    }
+    _collect(node->left.get(), out);
+    _collect(node->right.get(), out);
+}
+
+END_NAMESPACE_Cornu
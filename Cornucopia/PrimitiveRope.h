@@ -0,0 +1,98 @@
+/*--
+    PrimitiveRope.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_PRIMITIVEROPE_H_INCLUDED
+#define CORNUCOPIA_PRIMITIVEROPE_H_INCLUDED
+
+#include "defs.h"
+#include "CurvePrimitive.h"
+#include "VectorC.h"
+
+NAMESPACE_Cornu
+
+CORNU_SMART_FORW_DECL(PrimitiveSequence);
+
+/*
+    An open sequence of primitives for editing long curves.  The primitives are the leaves of a balanced tree whose
+    nodes cache their count, length and bounding box, and nodes are never changed after they are made.  So finding
+    the primitive at a parameter, trimming, concatenating and splicing take O(log n) and share all the untouched
+    nodes with the ropes they came from.  Copying a rope copies a pointer, so keeping old versions around for undo
+    is free.  A PrimitiveSequence, which the fitting stages use, is made from a rope in O(n) with toSequence().
+*/
+class PrimitiveRope
+{
+    typedef Eigen::Vector2d Vec;
+
+public:
+    PrimitiveRope() {} //empty
+    PrimitiveRope(const VectorC<CurvePrimitiveConstPtr> &primitives);
+    PrimitiveRope(CurvePrimitiveConstPtr primitive);
+
+    bool isEmpty() const { return !_root; }
+    int size() const { return _root ? _root->count : 0; }
+    double length() const { return _root ? _root->length : 0.; }
+    CurvePrimitiveConstPtr primitive(int idx) const;
+
+    //same as PrimitiveSequence's: the primitive at param and, in outParam, the parameter on it
+    int paramToIdx(double param, double *outParam = NULL) const;
+    void eval(double s, Vec *pos, Vec *der = NULL, Vec *der2 = NULL) const;
+    Vec pos(double s) const { Vec out; eval(s, &out); return out; }
+    double project(const Vec &point) const;
+
+    //all of these leave this rope unchanged
+    PrimitiveRope concatenated(const PrimitiveRope &other) const;
+    PrimitiveRope sliced(int from, int to) const; //the primitives from (inclusive) to to (exclusive)
+    PrimitiveRope trimmed(double from, double to) const; //primitives cut at the ends, whole ones shared
+    PrimitiveRope spliced(double from, double to, const PrimitiveRope &replacement) const; //replaces [from, to]
+
+    PrimitiveSequencePtr toSequence(CircularType circular = NOT_CIRCULAR) const;
+
+private:
+    CORNU_SMART_FORW_DECL(_Node);
+    class _Node : public smart_base
+    {
+    public:
+        _NodeConstPtr left, right; //both null for a leaf
+        CurvePrimitiveConstPtr primitive; //only for a leaf
+        int height, count;
+        double length;
+        Eigen::AlignedBox2d box;
+    };
+
+    static PrimitiveRope _fromRoot(const _NodeConstPtr &root) { PrimitiveRope out; out._root = root; return out; }
+
+    static _NodeConstPtr _leaf(const CurvePrimitiveConstPtr &primitive);
+    static _NodeConstPtr _node(const _NodeConstPtr &left, const _NodeConstPtr &right);
+    static _NodeConstPtr _balanced(const _NodeConstPtr &left, const _NodeConstPtr &right); //heights differ by at most 2
+    static _NodeConstPtr _join(const _NodeConstPtr &left, const _NodeConstPtr &right);
+    static void _split(const _NodeConstPtr &node, int idx, _NodeConstPtr &first, _NodeConstPtr &rest);
+    static _NodeConstPtr _build(const VectorC<CurvePrimitiveConstPtr> &primitives, int from, int to);
+    static int _height(const _NodeConstPtr &node) { return node ? node->height : 0; }
+
+    //updates bestParam with the closest point in node, which starts at offset along the rope
+    static void _project(const Vec &point, const _Node *node, double offset, double &bestParam, double &minDistSq);
+    static void _collect(const _Node *node, VectorC<CurvePrimitiveConstPtr> &out);
+
+    _NodeConstPtr _root;
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_PRIMITIVEROPE_H_INCLUDED
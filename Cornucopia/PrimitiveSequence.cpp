@@ -20,6 +20,7 @@
 
 #include "PrimitiveSequence.h"
 #include "Bezier.h"
+#include "Clothoid.h"
 
 using namespace std;
 using namespace Eigen;
@@ -31,6 +32,26 @@ PrimitiveSequence::PrimitiveSequence(const VectorC<CurvePrimitiveConstPtr> &prim
     _lengths.resize(_primitives.size() + 1, 0);
     for(int i = 0; i < (int)_primitives.size(); ++i)
         _lengths[i + 1] = _lengths[i] + _primitives[i]->length();
+
+    int treeSize = 1;
+    while(treeSize < _primitives.size())
+        treeSize *= 2;
+    _tree.resize(2 * treeSize - 1);
+    _buildTree(0, 0, _primitives.size());
+}
+
+void PrimitiveSequence::_buildTree(int node, int from, int to)
+{
+    if(to - from == 1)
+    {
+        _tree[node] = _primitives[from]->boundingBox();
+        return;
+    }
+
+    int mid = (from + to) / 2;
+    _buildTree(2 * node + 1, from, mid);
+    _buildTree(2 * node + 2, mid, to);
+    _tree[node] = _tree[2 * node + 1].merged(_tree[2 * node + 2]);
 }
 
 int PrimitiveSequence::paramToIdx(double param, double *outParam) const
@@ -54,24 +75,257 @@ void PrimitiveSequence::eval(double s, Vec *pos, Vec *der, Vec *der2) const
     _primitives[idx]->eval(cParam, pos, der, der2);
 }
 
+void PrimitiveSequence::evalBatch(const VectorXd &s, Matrix2Xd *pos, Matrix2Xd *der, Matrix2Xd *der2) const
+{
+    if(pos) pos->resize(2, s.size());
+    if(der) der->resize(2, s.size());
+    if(der2) der2->resize(2, s.size());
+
+    Cursor cursor(*this);
+    VectorXi idx(s.size());
+    VectorXd cParams(s.size());
+    for(int i = 0; i < (int)s.size(); ++i)
+    {
+        double param = s[i];
+        if(_primitives.circular())
+        {
+            param = fmod(param, _lengths.back());
+            if(param < 0.)
+                param += _lengths.back();
+        }
+        idx[i] = cursor.paramToIdx(param, &(cParams[i]));
+    }
+
+    //evaluate each run of consecutive parameters on the same primitive together
+    Matrix2Xd runPos, runDer, runDer2;
+    for(int start = 0; start < (int)s.size(); )
+    {
+        int end = start + 1;
+        while(end < (int)s.size() && idx[end] == idx[start])
+            ++end;
+
+        _primitives[idx[start]]->evalBatch(cParams.segment(start, end - start), pos ? &runPos : NULL, der ? &runDer : NULL, der2 ? &runDer2 : NULL);
+        if(pos) pos->middleCols(start, end - start) = runPos;
+        if(der) der->middleCols(start, end - start) = runDer;
+        if(der2) der2->middleCols(start, end - start) = runDer2;
+
+        start = end;
+    }
+}
+
 double PrimitiveSequence::project(const Vector2d &point) const
 {
+    int bestIdx = 0;
+    double bestS = 0.;
+    double minDistSq = 1e50;
+    _projectTree(point, 0, 0, _primitives.size(), bestIdx, bestS, minDistSq);
+
+    return _lengths[bestIdx] + bestS;
+}
+
+double PrimitiveSequence::distanceSqTo(const Vector2d &point) const
+{
+    int bestIdx = 0;
     double bestS = 0.;
     double minDistSq = 1e50;
+    _projectTree(point, 0, 0, _primitives.size(), bestIdx, bestS, minDistSq);
+
+    return minDistSq;
+}
+
+VectorXd PrimitiveSequence::projectMany(const Matrix2Xd &points) const
+{
+    VectorXd out(points.cols());
+    int bestIdx = 0;
+    for(int i = 0; i < (int)points.cols(); ++i)
+    {
+        //nearby points usually project onto the same primitive, so start from the previous one's--
+        //a tight initial distance lets the tree skip most of the nodes
+        const Vector2d &point = points.col(i);
+        double bestS = _primitives[bestIdx]->project(point);
+        double minDistSq = (_primitives[bestIdx]->pos(bestS) - point).squaredNorm();
+        _projectTree(point, 0, 0, _primitives.size(), bestIdx, bestS, minDistSq);
+
+        out[i] = _lengths[bestIdx] + bestS;
+    }
+    return out;
+}
 
-    for(int i = 0; i < _primitives.size(); ++i)
+void PrimitiveSequence::_projectTree(const Vec &point, int node, int from, int to, int &bestIdx, double &bestS, double &minDistSq) const
+{
+    if(to - from == 1)
     {
-        double localS = _primitives[i]->project(point);
-        Vector2d pt = _primitives[i]->pos(localS);
-        double distSq = (pt - point).squaredNorm();
-        if(distSq < minDistSq)
+        double localS = _primitives[from]->project(point);
+        double distSq = (_primitives[from]->pos(localS) - point).squaredNorm();
+        //on ties, the earlier primitive wins, as in a linear scan
+        if(distSq < minDistSq || (distSq == minDistSq && from < bestIdx))
         {
             minDistSq = distSq;
-            bestS = _lengths[i] + localS;
+            bestIdx = from;
+            bestS = localS;
+        }
+        return;
+    }
+
+    //visit the closer child first, so that the other one is more likely to be pruned
+    int mid = (from + to) / 2;
+    int first = 2 * node + 1, second = 2 * node + 2;
+    double firstDistSq = _tree[first].squaredExteriorDistance(point);
+    double secondDistSq = _tree[second].squaredExteriorDistance(point);
+
+    if(secondDistSq < firstDistSq)
+    {
+        if(secondDistSq <= minDistSq)
+            _projectTree(point, second, mid, to, bestIdx, bestS, minDistSq);
+        if(firstDistSq <= minDistSq)
+            _projectTree(point, first, from, mid, bestIdx, bestS, minDistSq);
+    }
+    else
+    {
+        if(firstDistSq <= minDistSq)
+            _projectTree(point, first, from, mid, bestIdx, bestS, minDistSq);
+        if(secondDistSq <= minDistSq)
+            _projectTree(point, second, mid, to, bestIdx, bestS, minDistSq);
+    }
+}
+
+vector<CurveIntersection> PrimitiveSequence::intersections(const PrimitiveSequence &other) const
+{
+    vector<CurveIntersection> out;
+    _intersectTrees(other, 0, 0, _primitives.size(), 0, 0, other._primitives.size(), out);
+
+    //on a closed curve, the end is the start
+    for(int i = 0; i < (int)out.size(); ++i)
+    {
+        if(isClosed() && out[i].s1 >= length())
+            out[i].s1 -= length();
+        if(other.isClosed() && out[i].s2 >= other.length())
+            out[i].s2 -= other.length();
+    }
+
+    //a point where primitives meet is found from both of them
+    const double tol = 1e-7 * (1. + length() + other.length());
+    sort(out.begin(), out.end(), [](const CurveIntersection &a, const CurveIntersection &b) { return a.s1 < b.s1; });
+    int numOut = 0;
+    for(int i = 0; i < (int)out.size(); ++i)
+    {
+        bool duplicate = false;
+        for(int j = numOut - 1; j >= 0 && out[i].s1 - out[j].s1 < tol && !duplicate; --j)
+            duplicate = fabs(out[i].s2 - out[j].s2) < tol;
+        if(!duplicate)
+            out[numOut++] = out[i];
+    }
+    out.resize(numOut);
+    return out;
+}
+
+void PrimitiveSequence::_intersectTrees(const PrimitiveSequence &other, int node, int from, int to,
+                                        int otherNode, int otherFrom, int otherTo, vector<CurveIntersection> &out) const
+{
+    if(!_tree[node].intersects(other._tree[otherNode]))
+        return;
+
+    if(to - from == 1 && otherTo - otherFrom == 1)
+    {
+        int firstNew = (int)out.size();
+        intersectPrimitives(*_primitives[from], *other._primitives[otherFrom], out);
+        for(int i = firstNew; i < (int)out.size(); ++i)
+        {
+            out[i].s1 += _lengths[from];
+            out[i].s2 += other._lengths[otherFrom];
+        }
+        return;
+    }
+
+    //split the range with more primitives
+    if(to - from >= otherTo - otherFrom)
+    {
+        int mid = (from + to) / 2;
+        _intersectTrees(other, 2 * node + 1, from, mid, otherNode, otherFrom, otherTo, out);
+        _intersectTrees(other, 2 * node + 2, mid, to, otherNode, otherFrom, otherTo, out);
+    }
+    else
+    {
+        int otherMid = (otherFrom + otherTo) / 2;
+        _intersectTrees(other, node, from, to, 2 * otherNode + 1, otherFrom, otherMid, out);
+        _intersectTrees(other, node, from, to, 2 * otherNode + 2, otherMid, otherTo, out);
+    }
+}
+
+double PrimitiveSequence::closestApproach(const PrimitiveSequence &other, double *s, double *otherS, double maxDistance) const
+{
+    double minDistSq = maxDistance * maxDistance;
+    int bestIdx = -1, otherBestIdx = -1;
+    double bestS = 0., otherBestS = 0.;
+    _closestTrees(other, 0, 0, _primitives.size(), 0, 0, other._primitives.size(), minDistSq, bestIdx, bestS, otherBestIdx, otherBestS);
+
+    if(bestIdx < 0)
+        return numeric_limits<double>::infinity();
+    if(s)
+        *s = _lengths[bestIdx] + bestS;
+    if(otherS)
+        *otherS = other._lengths[otherBestIdx] + otherBestS;
+    return sqrt(minDistSq);
+}
+
+void PrimitiveSequence::_closestTrees(const PrimitiveSequence &other, int node, int from, int to, int otherNode, int otherFrom, int otherTo,
+                                      double &minDistSq, int &bestIdx, double &bestS, int &otherBestIdx, double &otherBestS) const
+{
+    if(_tree[node].squaredExteriorDistance(other._tree[otherNode]) >= minDistSq)
+        return;
+
+    if(to - from == 1 && otherTo - otherFrom == 1)
+    {
+        if(closestPrimitivePoints(*_primitives[from], *other._primitives[otherFrom], minDistSq, bestS, otherBestS))
+        {
+            bestIdx = from;
+            otherBestIdx = otherFrom;
+        }
+        return;
+    }
+
+    //split the range with more primitives and visit the closer half first, as in _projectTree
+    if(to - from >= otherTo - otherFrom)
+    {
+        int mid = (from + to) / 2;
+        int first = 2 * node + 1, second = 2 * node + 2;
+        const AlignedBox2d &otherBox = other._tree[otherNode];
+        if(_tree[second].squaredExteriorDistance(otherBox) < _tree[first].squaredExteriorDistance(otherBox))
+        {
+            _closestTrees(other, second, mid, to, otherNode, otherFrom, otherTo, minDistSq, bestIdx, bestS, otherBestIdx, otherBestS);
+            _closestTrees(other, first, from, mid, otherNode, otherFrom, otherTo, minDistSq, bestIdx, bestS, otherBestIdx, otherBestS);
+        }
+        else
+        {
+            _closestTrees(other, first, from, mid, otherNode, otherFrom, otherTo, minDistSq, bestIdx, bestS, otherBestIdx, otherBestS);
+            _closestTrees(other, second, mid, to, otherNode, otherFrom, otherTo, minDistSq, bestIdx, bestS, otherBestIdx, otherBestS);
+        }
+    }
+    else
+    {
+        int otherMid = (otherFrom + otherTo) / 2;
+        int first = 2 * otherNode + 1, second = 2 * otherNode + 2;
+        const AlignedBox2d &box = _tree[node];
+        if(other._tree[second].squaredExteriorDistance(box) < other._tree[first].squaredExteriorDistance(box))
+        {
+            _closestTrees(other, node, from, to, second, otherMid, otherTo, minDistSq, bestIdx, bestS, otherBestIdx, otherBestS);
+            _closestTrees(other, node, from, to, first, otherFrom, otherMid, minDistSq, bestIdx, bestS, otherBestIdx, otherBestS);
+        }
+        else
+        {
+            _closestTrees(other, node, from, to, first, otherFrom, otherMid, minDistSq, bestIdx, bestS, otherBestIdx, otherBestS);
+            _closestTrees(other, node, from, to, second, otherMid, otherTo, minDistSq, bestIdx, bestS, otherBestIdx, otherBestS);
         }
     }
+}
 
-    return bestS;
+//Primitives that the trim keeps whole are shared rather than copied, so that an edit of a long curve, like
+//oversketching, leaves most of its primitives the same objects
+static CurvePrimitiveConstPtr trimmedPrimitive(const CurvePrimitiveConstPtr &primitive, double from, double to, double tol)
+{
+    if(from < tol && to > primitive->length() - tol)
+        return primitive;
+    return primitive->trimmed(from, to);
 }
 
 PrimitiveSequencePtr PrimitiveSequence::trimmed(double from, double to) const
@@ -125,21 +379,18 @@ PrimitiveSequencePtr PrimitiveSequence::trimmed(double from, double to) const
 
     if(startIdx == endIdx && startParamRemainder < endParamRemainder)
     {
-        out.push_back(_primitives[startIdx]->trimmed(startParamRemainder, endParamRemainder));
+        out.push_back(trimmedPrimitive(_primitives[startIdx], startParamRemainder, endParamRemainder, tol));
     }
     else
     {
-        out.push_back(_primitives[startIdx]->trimmed(startParamRemainder, _primitives[startIdx]->length()));
-
-        for(VectorC<CurvePrimitiveConstPtr>::Circulator circ = _primitives.circulator(startIdx + 1); !circ.done() ; ++circ)
-        {
-            if(circ.index() == endIdx)
-                break;
+        out.push_back(trimmedPrimitive(_primitives[startIdx], startParamRemainder, _primitives[startIdx]->length(), tol));
 
-            out.push_back(*circ);
-        }
+        VectorC<CurvePrimitiveConstPtr>::FlatSpan spans[2];
+        int numSpans = _primitives.flatSpans(startIdx + 1, _primitives.numElems(startIdx + 1, endIdx), spans);
+        for(int i = 0; i < numSpans; ++i)
+            out.insert(out.end(), _primitives.begin() + spans[i].begin, _primitives.begin() + spans[i].end);
 
-        out.push_back(_primitives[endIdx]->trimmed(0, endParamRemainder));
+        out.push_back(trimmedPrimitive(_primitives[endIdx], 0, endParamRemainder, tol));
     }
 
     return new PrimitiveSequence(out);
@@ -156,6 +407,13 @@ PrimitiveSequencePtr PrimitiveSequence::flipped() const
     return new PrimitiveSequence(out);
 }
 
+size_t PrimitiveSequence::memoryUsage() const
+{
+    //clothoids are the largest primitives
+    return sizeof(PrimitiveSequence) + _primitives.capacity() * sizeof(CurvePrimitiveConstPtr) + _primitives.size() * sizeof(Clothoid) +
+        _lengths.capacity() * sizeof(double) + _tree.capacity() * sizeof(AlignedBox2d);
+}
+
 BezierSplinePtr PrimitiveSequence::toBezierSpline(double tolerance) const
 {
     BezierSpline::PrimitiveVector segments;
@@ -212,6 +470,174 @@ BezierSplinePtr PrimitiveSequence::toBezierSpline(double tolerance) const
     return new BezierSpline(segments);
 }
 
+//deepest subdivision for toAdaptiveBezierSpline, so at most 2^16 Beziers per primitive, even for a zero tolerance
+static const int maxBezierDepth = 16;
+
+//The Hermite Bezier through the ends of an arc of the given angle and unit radius is farthest from the circle at
+//its middle, where it is 1 - cos(angle / 2) - (angle / 4) sin(angle / 2) (about angle^4 / 384) inside it
+static double _arcBezierError(double angle)
+{
+    return fabs(1. - cos(0.5 * angle) - 0.25 * angle * sin(0.5 * angle));
+}
+
+//the number of equal pieces an arc must be split into so that their Beziers are within tolerance
+static int _arcBezierCount(double angle, double radius, double tolerance)
+{
+    const int maxCount = 1 << maxBezierDepth;
+    double maxAngle = pow(384. * max(tolerance, 0.) / radius, 0.25);
+    int count = (int)min((double)maxCount, max(1., ceil(angle / max(maxAngle, 1e-100))));
+    while(count > 1 && radius * _arcBezierError(angle / (count - 1)) <= tolerance)
+        --count;
+    while(count < maxCount && radius * _arcBezierError(angle / count) > tolerance)
+        ++count;
+    return count;
+}
+
+//Appends the Beziers for the primitive between s0 and s1.  pos and der hold the primitive at s0, the three quarter
+//points, and s1.  If the Hermite Bezier strays from the quarter points by more than the tolerance, the two halves
+//are done separately, and the current quarter points are their ends and middles.
+static void _adaptiveBeziers(const CurvePrimitive &primitive, double s0, double s1, const Vector2d pos[5], const Vector2d der[5],
+                             double toleranceSq, int depth, BezierSpline::PrimitiveVector &out)
+{
+    double length = s1 - s0;
+    CubicBezier cur = CubicBezier::hermite(pos[0], pos[4], der[0] * length, der[4] * length);
+
+    bool split = false;
+    for(int m = 1; m < 4 && !split && depth < maxBezierDepth; ++m)
+    {
+        Vector2d splinePt;
+        cur.eval(0.25 * m, &splinePt);
+        split = (splinePt - pos[m]).squaredNorm() > toleranceSq;
+    }
+    if(!split)
+    {
+        out.push_back(cur);
+        return;
+    }
+
+    for(int half = 0; half < 2; ++half)
+    {
+        Vector2d halfPos[5], halfDer[5];
+        for(int m = 0; m < 5; m += 2)
+        {
+            halfPos[m] = pos[2 * half + m / 2];
+            halfDer[m] = der[2 * half + m / 2];
+        }
+        for(int m = 1; m < 4; m += 2)
+            primitive.eval(s0 + length * (0.5 * half + 0.125 * m), &halfPos[m], &halfDer[m]);
+
+        double mid = s0 + 0.5 * length;
+        _adaptiveBeziers(primitive, half ? mid : s0, half ? s1 : mid, halfPos, halfDer, toleranceSq, depth + 1, out);
+    }
+}
+
+BezierSplinePtr PrimitiveSequence::toAdaptiveBezierSpline(double tolerance) const
+{
+    BezierSpline::PrimitiveVector segments;
+
+    for(int i = 0; i < (int)_primitives.size(); ++i) //loop over primitives
+    {
+        const CurvePrimitive &primitive = *_primitives[i];
+        double length = primitive.length();
+
+        int count = 0; //the number of equal pieces, if known without subdividing
+        if(primitive.getType() == CurvePrimitive::LINE)
+            count = 1;
+        else if(primitive.getType() == CurvePrimitive::ARC)
+        {
+            double curvature = fabs(primitive.startCurvature());
+            count = curvature == 0. ? 1 : _arcBezierCount(curvature * length, 1. / curvature, tolerance);
+        }
+
+        if(count > 0)
+        {
+            Matrix2Xd pos, der;
+            primitive.evalBatch(VectorXd::LinSpaced(count + 1, 0., length), &pos, &der);
+            double step = length / count;
+            for(int k = 0; k < count; ++k)
+                segments.push_back(CubicBezier::hermite(pos.col(k), pos.col(k + 1), der.col(k) * step, der.col(k + 1) * step));
+            continue;
+        }
+
+        Vector2d pos[5], der[5];
+        for(int m = 0; m < 5; ++m)
+            primitive.eval(0.25 * length * m, &pos[m], &der[m]);
+        _adaptiveBeziers(primitive, 0., length, pos, der, SQR(tolerance), 0, segments);
+    }
+
+    return new BezierSpline(segments);
+}
+
+template<typename Write>
+int PrimitiveSequence::_tessellate(double tolerance, int capacity, const Write &write) const
+{
+    //A piece of length h with curvature at most k is within k h^2 / 8 of its chord, and a clothoid's curvature is
+    //largest at one of its ends, so the number of pieces of each primitive is known before evaluating anything
+    const int maxPieces = 1 << 16;
+    vector<int> pieces(_primitives.size());
+    int total = 1;
+    for(int i = 0; i < (int)_primitives.size(); ++i)
+    {
+        const CurvePrimitive &primitive = *_primitives[i];
+        double curvature = primitive.getType() == CurvePrimitive::LINE ? 0. :
+            max(fabs(primitive.startCurvature()), fabs(primitive.endCurvature()));
+        double count = ceil(primitive.length() * sqrt(curvature / (8. * max(tolerance, 1e-100))));
+        pieces[i] = (int)max(1., min((double)maxPieces, count));
+        total += pieces[i];
+    }
+
+    Matrix2Xd pos, der;
+    int idx = 0;
+    for(int i = 0; i < (int)_primitives.size() && idx < capacity; ++i)
+    {
+        //each primitive writes its start and the inside vertices, and the last one writes its end too
+        int count = pieces[i] + (i + 1 == (int)_primitives.size() ? 1 : 0);
+        count = min(count, capacity - idx);
+        double length = _primitives[i]->length();
+        VectorXd s = VectorXd::LinSpaced(pieces[i] + 1, 0., length).head(count);
+        _primitives[i]->evalBatch(s, &pos, &der);
+        for(int j = 0; j < count; ++j)
+            write(idx++, pos.col(j), der.col(j), _lengths[i] + s[j]);
+    }
+    return total;
+}
+
+int PrimitiveSequence::tessellate(double tolerance, CurveVertex *out, int capacity) const
+{
+    return _tessellate(tolerance, capacity, [out](int idx, const Vec &pos, const Vec &tangent, double arcLength)
+    {
+        CurveVertex &v = out[idx];
+        v.pos[0] = (float)pos[0];
+        v.pos[1] = (float)pos[1];
+        v.tangent[0] = (float)tangent[0];
+        v.tangent[1] = (float)tangent[1];
+        v.arcLength = (float)arcLength;
+    });
+}
+
+//maps x from [from, to] to 0..65535
+static unsigned short _quantize(double x, double from, double to)
+{
+    double t = to > from ? (x - from) / (to - from) : 0.;
+    return (unsigned short)(min(1., max(0., t)) * 65535. + 0.5);
+}
+
+int PrimitiveSequence::tessellate(double tolerance, QuantizedCurveVertex *out, int capacity) const
+{
+    const AlignedBox2d &box = boundingBox();
+    double totalLength = length();
+    return _tessellate(tolerance, capacity, [out, &box, totalLength](int idx, const Vec &pos, const Vec &tangent, double arcLength)
+    {
+        QuantizedCurveVertex &v = out[idx];
+        for(int k = 0; k < 2; ++k)
+        {
+            v.pos[k] = _quantize(pos[k], box.min()[k], box.max()[k]);
+            v.tangent[k] = _quantize(tangent[k], -1., 1.);
+        }
+        v.arcLength = _quantize(arcLength, 0., totalLength);
+    });
+}
+
 END_NAMESPACE_Cornu
 
 
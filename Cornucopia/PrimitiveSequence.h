@@ -24,6 +24,10 @@
 #include "defs.h"
 #include "CurvePrimitive.h"
 #include "VectorC.h"
+#include "CurveVertex.h"
+#include "CurveIntersection.h"
+
+#include <limits>
 
 NAMESPACE_Cornu
 
@@ -40,8 +44,25 @@ public:
     bool isClosed() const { return _primitives.circular() == CIRCULAR; }
 
     void eval(double s, Vec *pos, Vec *der = NULL, Vec *der2 = NULL) const;
+    void evalBatch(const Eigen::VectorXd &s, Eigen::Matrix2Xd *pos, Eigen::Matrix2Xd *der = NULL, Eigen::Matrix2Xd *der2 = NULL) const;
 
     double project(const Vec &point) const;
+    double distanceSqTo(const Vec &point) const;
+
+    //projects each column of points--faster than calling project for each one
+    Eigen::VectorXd projectMany(const Eigen::Matrix2Xd &points) const;
+
+    const Eigen::AlignedBox2d &boundingBox() const { return _tree[0]; }
+
+    //Returns where this curve (s1) meets another one (s2), sorted by s1.  Both bounding box trees are walked
+    //together, so only pairs of primitives whose boxes overlap are intersected.  Not for intersecting a curve with
+    //itself: its consecutive primitives meet at their ends.
+    std::vector<CurveIntersection> intersections(const PrimitiveSequence &other) const;
+    //Returns the distance between the closest points of this curve and another one and sets s and otherS to
+    //their parameters, e.g., for snapping a stroke to a curve.  If the curves don't come closer than maxDistance,
+    //returns infinity and leaves s and otherS alone--a small maxDistance lets the trees prune more.
+    double closestApproach(const PrimitiveSequence &other, double *s = NULL, double *otherS = NULL,
+                           double maxDistance = std::numeric_limits<double>::infinity()) const;
 
     //utility functions
     int paramToIdx(double param, double *outParam = NULL) const;
@@ -56,13 +77,91 @@ public:
     const VectorC<CurvePrimitiveConstPtr> &primitives() const { return _primitives; }
 
     BezierSplinePtr toBezierSpline(double tolerance) const;
+    //Like toBezierSpline, but with as many Beziers per primitive as the tolerance needs.  Arcs are split into equal
+    //pieces using the exact error, and clothoids are halved only where they don't meet the tolerance.
+    BezierSplinePtr toAdaptiveBezierSpline(double tolerance) const;
+
+    //Tessellates the curve into a polyline within tolerance of it (lines only get their ends) and writes up to capacity
+    //of its vertices to out.  Returns the number of vertices, which may be greater than capacity.  The quantized
+    //version is relative to boundingBox() and length().
+    int tessellate(double tolerance, CurveVertex *out, int capacity) const;
+    int tessellate(double tolerance, QuantizedCurveVertex *out, int capacity) const;
+
+    size_t memoryUsage() const; //estimated, in bytes, including the primitives
+
+    //Evaluates the curve at parameters in mostly increasing order by walking on from the primitive of the previous
+    //parameter instead of searching for each one, as Polyline::Cursor does
+    class Cursor
+    {
+    public:
+        explicit Cursor(const PrimitiveSequence &curve) : _curve(curve), _idx(0) {}
+
+        void eval(double s, Vec *pos, Vec *der = NULL, Vec *der2 = NULL);
+        Vec pos(double s) { Vec out; eval(s, &out); return out; }
+        int paramToIdx(double param, double *outParam = NULL); //like PrimitiveSequence::paramToIdx
+
+    private:
+        const PrimitiveSequence &_curve;
+        int _idx; //the primitive of the previous parameter
+    };
 
 private:
     VectorC<CurvePrimitiveConstPtr> _primitives;
     //lengths[x] = \sum_{i=1}^{i=x} _primitives[i-1]->length(), i.e., length up to the start of the primitive at x
     std::vector<double> _lengths; 
+
+    //Bounding box hierarchy over ranges of consecutive primitives (which are usually close to each other).
+    //Node n covers a range of primitives, and its children 2n+1 and 2n+2 cover the two halves.
+    std::vector<Eigen::AlignedBox2d, Eigen::aligned_allocator<Eigen::AlignedBox2d> > _tree;
+    void _buildTree(int node, int from, int to); //to is exclusive
+    //updates bestIdx and bestS (parameter on primitive bestIdx) with the closest point in the node's range
+    void _projectTree(const Vec &point, int node, int from, int to, int &bestIdx, double &bestS, double &minDistSq) const;
+    //Walk node of this tree, over primitives [from, to), together with otherNode of other's tree.  The closest
+    //version updates the indices and local parameters of the closest primitives found so far.
+    void _intersectTrees(const PrimitiveSequence &other, int node, int from, int to,
+                         int otherNode, int otherFrom, int otherTo, std::vector<CurveIntersection> &out) const;
+    void _closestTrees(const PrimitiveSequence &other, int node, int from, int to, int otherNode, int otherFrom, int otherTo,
+                       double &minDistSq, int &bestIdx, double &bestS, int &otherBestIdx, double &otherBestS) const;
+    //calls write(idx, pos, tangent, arcLength) for each tessellation vertex below capacity and returns the vertex count
+    template<typename Write> int _tessellate(double tolerance, int capacity, const Write &write) const;
 };
 
+inline int PrimitiveSequence::Cursor::paramToIdx(double param, double *outParam)
+{
+    const std::vector<double> &lengths = _curve._lengths;
+    const int maxWalk = 8; //primitives to walk before a search is cheaper
+    int last = (int)lengths.size() - 2;
+    if(param < lengths[_idx])
+        _idx = std::max(0, _curve.paramToIdx(param));
+    else
+    {
+        for(int i = 0; _idx < last && param >= lengths[_idx + 1]; ++i, ++_idx)
+        {
+            if(i == maxWalk)
+            {
+                _idx = _curve.paramToIdx(param);
+                break;
+            }
+        }
+    }
+    if(outParam)
+        *outParam = param - lengths[_idx];
+    return _idx;
+}
+
+inline void PrimitiveSequence::Cursor::eval(double s, Vec *pos, Vec *der, Vec *der2)
+{
+    if(_curve.isClosed())
+    {
+        s = fmod(s, _curve.length());
+        if(s < 0.)
+            s += _curve.length();
+    }
+    double cParam;
+    int idx = paramToIdx(s, &cParam);
+    _curve._primitives[idx]->eval(cParam, pos, der, der2);
+}
+
 END_NAMESPACE_Cornu
 
 #endif //CORNUCOPIA_PRIMITIVESEQUENCE_H_INCLUDED
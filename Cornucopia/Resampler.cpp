@@ -24,9 +24,11 @@
 #include "Polyline.h"
 #include "Preprocessing.h"
 #include "CornerDetector.h"
-#include "PrimitiveFitUtils.h"
 #include "PiecewiseLinearUtils.h"
 #include "Arc.h"
+#include "Snapshot.h"
+
+#include <Eigen/Eigenvalues>
 
 #include <iterator>
 #include <map>
@@ -63,13 +65,16 @@ protected:
         {
             vector<double> samples = _resample(fitter, poly);
             out.output = _processSamples(samples, poly, 0, 0, prevToCur);
-            out.corners = VectorC<bool>(vector<bool>(out.output->pts().size(), false), CIRCULAR);
-            prevToCur.batchEval(out.parameters);
-            displayOutput(out, fitter);
+            out.corners.assign(out.output->pts().size(), false);
+            out.corners.setCircular(CIRCULAR);
+            out.parameters = new ParameterMap(out.parameters, std::move(prevToCur));
+            if(CORNU_DEBUGGING_ON)
+                displayOutput(out, fitter);
             return;
         }
 
-        out.corners = VectorC<bool>(0, pts.circular());
+        out.corners.clear();
+        out.corners.setCircular(pts.circular());
         VectorC<Vector2d> outputPts(0, pts.circular());
 
         double lengthSoFar = 0;
@@ -111,12 +116,13 @@ protected:
         }
 
         out.output = new Polyline(outputPts);
-        //adjust the parameters into the range that the PiecewiseLinearMontone object uses
-        for(int i = 0; i < (int)out.parameters.size(); ++i)
-            if(out.parameters[i] < prevToCur.minX())
-                out.parameters[i] += poly->length();
-        prevToCur.batchEval(out.parameters);
-        displayOutput(out, fitter);
+        //the parameters are wrapped into the range that the PiecewiseLinearMontone object uses
+        double minParam = prevToCur.minX();
+        ParameterMapPtr parameters = new ParameterMap(out.parameters, std::move(prevToCur));
+        parameters->setWrap(0., minParam, poly->length());
+        out.parameters = parameters;
+        if(CORNU_DEBUGGING_ON)
+            displayOutput(out, fitter);
     }
 
     virtual vector<double> _resample(const Fitter &fitter, PolylineConstPtr poly, bool denseNearStart = false, bool denseNearEnd = false) = 0;
@@ -126,10 +132,13 @@ private:
                                      double offsetCur, PiecewiseLinearMonotone &prevToCur)
     {
         VectorC<Vector2d> out(samples.size(), prev->pts().circular());
+        Matrix2Xd samplePts;
+        prev->evalBatch(VectorXd::Map(samples.data(), samples.size()), &samplePts);
+
         double lenSoFar = 0;
         for(int i = 0; i < (int)samples.size(); ++i)
         {
-            out[i] = prev->pos(samples[i]);
+            out[i] = samplePts.col(i);
             if(i > 0)
                 lenSoFar += (out[i] - out[i - 1]).norm();
             prevToCur.add(offsetPrev + samples[i], offsetCur + lenSoFar);
@@ -144,17 +153,17 @@ private:
     {
         for(int i = 0; i < out.output->pts().size(); ++i)
         {
-            Debugging::get()->drawPoint(out.output->pts()[i], Vector3d(0, (i % 10 == 0) ? 0.6 : 0, 0), "Resampled");
+            CORNU_DEBUG(drawPoint(out.output->pts()[i], Vector3d(0, (i % 10 == 0) ? 0.6 : 0, 0), "Resampled"));
             if(out.corners[i])
-                Debugging::get()->drawPoint(out.output->pts()[i], Vector3d(0, 0, 0), "Resampled Corners");
+                CORNU_DEBUG(drawPoint(out.output->pts()[i], Vector3d(0, 0, 0), "Resampled Corners"));
         }
-        Debugging::get()->printf("Num samples = %d", out.output->pts().size());
+        CORNU_DEBUG(printf("Num samples = %d", out.output->pts().size()));
 
 #if 0
-        Debugging::get()->drawCurve(out.output, Vector3d(0, 0, 0), "Resampled curve");
-        for(int i = 0; i < (int)out.parameters.size(); ++i)
+        CORNU_DEBUG(drawCurve(out.output, Vector3d(0, 0, 0), "Resampled curve"));
+        for(int i = 0; i < (int)out.parameters->values().size(); ++i)
         {
-            Debugging::get()->drawLine(fitter.originalSketch()->pts()[i], out.output->pos(out.parameters[i]), Vector3d(1, 0, 1), "Resampled Correspondence");
+            CORNU_DEBUG(drawLine(fitter.originalSketch()->pts()[i], out.output->pos(out.parameters->values()[i]), Vector3d(1, 0, 1), "Resampled Correspondence"));
         }
 #endif
     }
@@ -166,7 +175,7 @@ class SampleSpacingFunction
 {
 public:
     SampleSpacingFunction(PolylineConstPtr poly)
-        : _values(vector<double>(poly->pts().size(), 0.), poly->pts().circular()), _maxSlope(1e10), _basePoly(poly)
+        : _values(vector<double>(poly->pts().size(), 0.), poly->pts().circular()), _maxSlope(1e10)
     {
         _lengths.resize(1 + poly->pts().endIdx(1), 0.);
         for(int i = 0; i < (int)_lengths.size(); ++i)
@@ -212,36 +221,104 @@ public:
 
     //Returns the maximum step we can take starting at s.  It's the side length of the largest square
     //we can inscribe under the function plot with a corner at s.
-    double evalStep(double s)
+    double evalStep(double s) const
     {
+        const double tol = 1e-10;
         double maxStep = eval(s);
-        SampleSpacingFunction tr = trimmed(s, s + maxStep);
+        double stepLength = isClosed() ? min(maxStep, _lengths.back()) : min(maxStep, _lengths.back() - s);
+
+        //walk the segments of the function from s to s + stepLength, with positions relative to s
+        double start = s;
+        if(isClosed())
+        {
+            start = fmod(start, _lengths.back());
+            if(start < 0.)
+                start += _lengths.back();
+        }
+        int idx = paramToIdx(start, NULL);
+        double lapOffset = 0.; //added to _lengths after wrapping around a closed curve
 
-        double out = 0;
+        double x1 = 0., r1 = maxStep;
         double minSoFar = maxStep;
-        for(int i = 0; i + 1 < tr._values.size(); ++i)
+        while(true)
         {
-            //consider the segment from i to i + 1
-            double len = tr._lengths[i + 1] - tr._lengths[i];
-            double r1 = tr._values[i], r2 = tr._values[i + 1];
+            //consider the segment from x1 to the next vertex or the end of the step, whichever is first
+            double x2 = _lengths[idx + 1] + lapOffset - start;
+            double r2;
+            bool last = (x2 >= stepLength - tol);
+            if(last)
+            {
+                x2 = stepLength;
+                r2 = eval(s + stepLength);
+            }
+            else
+                r2 = _values.flatAt((idx + 1) % _values.size());
 
             //check if we get this entire segment
-            if(min(minSoFar, r2) >= out + len)
+            if(min(minSoFar, r2) >= x2)
             {
                 minSoFar = min(minSoFar, r2);
-                out += len;
+                if(last)
+                    return minSoFar;
+
+                x1 = x2;
+                r1 = r2;
+                if(++idx + 1 == (int)_lengths.size()) //only possible for closed curves
+                {
+                    idx = 0;
+                    lapOffset += _lengths.back();
+                }
                 continue;
             }
 
+            double len = x2 - x1;
             double maxFromBefore = minSoFar;
             double curSlope = (r2 - r1) / (len + 1e-16);
-            double curYIntercept = r1 - curSlope * tr._lengths[i];
+            double curYIntercept = r1 - curSlope * x1;
             double maxFromCurrent = curYIntercept / (1. - curSlope);
 
             return min(maxFromBefore, maxFromCurrent);
         }
+    }
 
-        return minSoFar;
+    //Returns samples from 0 spaced like the steps of evalStep, scaled so that a whole number of them covers the
+    //curve and, unless it is closed, the last is at its end.  Where the function is a + b * x, each step of evalStep
+    //changes the function by a factor of 1 + |b|, so the number of steps up to x is log(1 + b * x / a) / q, where
+    //q = log(1 + b) for b >= 0 and -log(1 - b) otherwise.  That is easy to invert, so this takes a single pass.
+    vector<double> placeSamples() const
+    {
+        int numSegments = (int)_lengths.size() - 1;
+        vector<double> steps(numSegments + 1, 0.); //the number of steps from 0 to each vertex
+        for(int i = 0; i < numSegments; ++i)
+        {
+            double a, b, q;
+            _segmentLinear(i, &a, &b, &q);
+            double len = _lengths[i + 1] - _lengths[i];
+            steps[i + 1] = steps[i] + (b == 0. ? len / a : log1p(b * len / a) / q);
+        }
+
+        int numIntervals = max(1, (int)floor(steps.back() + 0.5));
+        double perInterval = steps.back() / numIntervals;
+
+        vector<double> out;
+        out.reserve(numIntervals + 1);
+        int seg = 0;
+        for(int i = 0; i < numIntervals; ++i)
+        {
+            double target = i * perInterval;
+            while(seg + 1 < numSegments && steps[seg + 1] <= target)
+                ++seg;
+
+            double a, b, q;
+            _segmentLinear(seg, &a, &b, &q);
+            double t = target - steps[seg];
+            double x = (b == 0. ? a * t : a * expm1(q * t) / b);
+            out.push_back(_lengths[seg] + min(x, _lengths[seg + 1] - _lengths[seg]));
+        }
+        if(!isClosed())
+            out.push_back(_lengths.back());
+
+        return out;
     }
 
     int paramToIdx(double param, double *outParam) const
@@ -252,18 +329,6 @@ public:
         return idx;
     }
 
-    SampleSpacingFunction trimmed(double from, double to)
-    {
-        //Trim the base polyline and evaluate the function on it.  Not the fastest way to do it, but it works
-        PolylineConstPtr trimmedPoly = _basePoly->trimmed(from, to);
-        SampleSpacingFunction out(trimmedPoly);
-
-        for(int i = 0; i < trimmedPoly->pts().size(); ++i)
-            out.values()[i] = eval(from + trimmedPoly->idxToParam(i));
-
-        return out;
-    }
-
     void draw()
     {
         char name[100];
@@ -271,9 +336,9 @@ public:
         ++cnt;
         sprintf(name, "Func %d", cnt);
         Vector2d offs(10, 20 + 50 * cnt);
-        Debugging::get()->drawLine(offs, offs + Vector2d(_lengths.back(), 0), Vector3d(0, 0, 0), name);
+        CORNU_DEBUG(drawLine(offs, offs + Vector2d(_lengths.back(), 0), Vector3d(0, 0, 0), name));
         for(int i = 0; i < _values.endIdx(1); ++i)
-            Debugging::get()->drawLine(offs + Vector2d(_lengths[i], -_values[i]), offs + Vector2d(_lengths[i + 1], -_values[i + 1]), Vector3d(1, 0, 0), name);
+            CORNU_DEBUG(drawLine(offs + Vector2d(_lengths[i], -_values[i]), offs + Vector2d(_lengths[i + 1], -_values[i + 1]), Vector3d(1, 0, 0), name));
 
         //draw the inscribed squares
         double param = 0;
@@ -281,9 +346,9 @@ public:
         {
             double step = evalStep(param);
             Vector2d corner = offs + Vector2d(param, 0);
-            Debugging::get()->drawLine(corner, corner + Vector2d(0, -step), Vector3d(0, 1, 0), name);
-            Debugging::get()->drawLine(corner + Vector2d(0, -step), corner + Vector2d(step, -step), Vector3d(0, 1, 0), name);
-            Debugging::get()->drawLine(corner + Vector2d(step, -step), corner + Vector2d(step, 0), Vector3d(0, 1, 0), name);
+            CORNU_DEBUG(drawLine(corner, corner + Vector2d(0, -step), Vector3d(0, 1, 0), name));
+            CORNU_DEBUG(drawLine(corner + Vector2d(0, -step), corner + Vector2d(step, -step), Vector3d(0, 1, 0), name));
+            CORNU_DEBUG(drawLine(corner + Vector2d(step, -step), corner + Vector2d(step, 0), Vector3d(0, 1, 0), name));
             param += step;
         }
     }
@@ -332,11 +397,98 @@ public:
     }
 
 private: 
+    //the value over the segment starting at vertex idx is a + b * x, where x is the distance from the vertex,
+    //and each step of evalStep over it changes the value by a factor of exp(q)
+    void _segmentLinear(int idx, double *a, double *b, double *q) const
+    {
+        double len = _lengths[idx + 1] - _lengths[idx];
+        *a = _values.flatAt(idx);
+        *b = len > 0. ? (_values.flatAt((idx + 1) % _values.size()) - *a) / len : 0.;
+        *q = *b >= 0. ? log1p(*b) : -log1p(-*b);
+    }
+
     double _maxSlope;
     //organized like Polyline
     VectorC<double> _values;
     vector<double> _lengths;
-    PolylineConstPtr _basePoly;
+};
+
+//The least-squares circle fit of ArcFitter, over a window of samples that only moves forward, so that points
+//can be removed from it as well as added.  The points are lifted to the paraboloid relative to an anchor sample
+//in the window; when the anchor leaves, the sums are rebuilt around the newest sample, which keeps them
+//well-conditioned and costs amortized constant time per step.
+class SlidingArcWindow
+{
+public:
+    //for circular samples, the window indices may be out of range and wrap around
+    SlidingArcWindow(const Matrix2Xd &samples, bool circular)
+        : _samples(samples), _circular(circular), _begin(0), _end(0), _anchor(0) { _clear(); }
+
+    //moves the window to the samples from begin (inclusive) to end (exclusive), neither of which may go back
+    void slideTo(int begin, int end)
+    {
+        if(begin > _anchor || begin >= _end)
+        {
+            _begin = _end = begin;
+            _anchor = max(begin, end - 1);
+            _clear();
+        }
+        for(; _end < end; ++_end)
+            _update(_end, 1.);
+        for(; _begin < begin; ++_begin)
+            _update(_begin, -1.);
+    }
+
+    //returns the absolute curvature of the best-fit circle, or zero if there are too few samples for one
+    double curvature() const
+    {
+        if(_end - _begin < 3)
+            return 0.;
+
+        double factor = 1. / (_end - _begin);
+        Vector3d pt = _sum * factor;
+        Matrix3d cov = factor * _squaredSum - pt * pt.transpose();
+
+        SelfAdjointEigenSolver<Matrix3d> eigenSolver(cov);
+        Vector3d dir = eigenSolver.eigenvectors().col(0); //0 is the index of the smallest eigenvalue
+        dir /= (1e-16 + dir[2]);
+
+        double dot = dir.dot(pt);
+        Vector2d center = -0.5 * Vector2d(dir[0], dir[1]);
+        return 1. / sqrt(1e-16 + dot + center.squaredNorm());
+    }
+
+private:
+    Vector2d _sample(int idx) const
+    {
+        if(_circular)
+        {
+            idx %= (int)_samples.cols();
+            if(idx < 0)
+                idx += (int)_samples.cols();
+        }
+        return _samples.col(idx);
+    }
+
+    void _update(int idx, double weight)
+    {
+        Vector2d pt = _sample(idx) - _sample(_anchor);
+        Vector3d pt3(pt[0], pt[1], pt.squaredNorm());
+        _sum += weight * pt3;
+        _squaredSum += weight * pt3 * pt3.transpose();
+    }
+
+    void _clear()
+    {
+        _sum.setZero();
+        _squaredSum.setZero();
+    }
+
+    const Matrix2Xd &_samples;
+    bool _circular;
+    int _begin, _end, _anchor;
+    Matrix3d _squaredSum;
+    Vector3d _sum;
 };
 
 class DefaultResampler : public BaseResampler
@@ -347,7 +499,6 @@ public:
 protected:
     vector<double> _resample(const Fitter &fitter, PolylineConstPtr poly, bool denseNearStart = false, bool denseNearEnd = false)
     {
-        vector<double> outSamples;
         const VectorC<Vector2d> pts = poly->pts();
         SampleSpacingFunction spacing(poly);
 
@@ -356,20 +507,32 @@ protected:
         double regionSize = fitter.scaledParameter(Parameters::CURVATURE_ESTIMATE_REGION);
         double maxInterval = fitter.scaledParameter(Parameters::MAX_SAMPLING_INTERVAL);
         double pointsPerCircle = fitter.params().get(Parameters::POINTS_PER_CIRCLE);
-        double arcFitterScale = 1. / fitter.scale(); //our ArcFitter is approximate and not scale-invariant, so we scale its input and output
+        double arcFitterScale = 1. / fitter.scale(); //the circle fit is approximate and not scale-invariant, so we scale its input and output
+
+        //Sample the polyline densely once and slide the curvature estimation region along the samples.  As the point
+        //parameters increase, the region's ends only move forward, so each sample enters and leaves it once.
+        int numDense = poly->isClosed() ? max(1, (int)ceil(poly->length() / step)) : 1 + (int)(poly->length() / step);
+        Matrix2Xd dense;
+        poly->evalBatch(VectorXd::LinSpaced(numDense, 0., (numDense - 1) * step), &dense);
+        dense *= arcFitterScale;
+        SlidingArcWindow window(dense, poly->isClosed());
 
         for(int i = 0; i < pts.size(); ++i)
         {
-            ArcFitter arcFitter;
-            //step forward
+            //the region is the samples less than regionSize away from the point
             double startParam = poly->idxToParam(i);
-            for(double param = startParam; poly->isParamValid(param) && param < startParam + regionSize; param += step)
-                arcFitter.addPoint(poly->pos(param) * arcFitterScale);
-            //step backward
-            for(double param = startParam; poly->isParamValid(param) && param > startParam - regionSize; param -= step)
-                arcFitter.addPoint(poly->pos(param) * arcFitterScale);
+            int begin = (int)floor((startParam - regionSize) / step) + 1;
+            int end = (int)ceil((startParam + regionSize) / step);
+            if(poly->isClosed())
+                end = min(end, begin + numDense);
+            else
+            {
+                begin = max(begin, 0);
+                end = min(end, numDense);
+            }
+            window.slideTo(begin, end);
 
-            double curvature = fabs(arcFitter.getCurve()->startCurvature()) * arcFitterScale;
+            double curvature = window.curvature() * arcFitterScale;
             spacing.values()[i] = TWOPI / max(pointsPerCircle * curvature, TWOPI / maxInterval);
             if((i == 0 && denseNearStart) || ((i + 1) == pts.size() && denseNearEnd))
                 spacing.values()[i] = 1;
@@ -381,77 +544,17 @@ protected:
 
 #if RESAMPLING_DEBUG
         if(!spacing.selfTest())
-            Debugging::get()->printf("Error: spacing self-test failed");
+            CORNU_DEBUG(printf("Error: spacing self-test failed"));
 #endif
 
-        //We need for the last sample to end precisely at the end of the curve.  This won't happen naturally,
-        //so we scale the sampling rate until it does.
-        //Start by figuring out how many samples we'll have and what the "remainder" is and an initial guess at
-        //how much we need to scale.
-        int numPts = 0;
-        double param = 0;
-        while(true)
-        {
-            double step = spacing.evalStep(param);
-            param += step;
-            ++numPts;
-            if(param + step * 0.5 > poly->length())
-                break;
-        }
-
-        //We maintain the sampling spacing scales and the ratio of the last parameter to the curve length
-        //as a piecewise linear function.
-        //It is guaranteed to be monotone--reducing the sampling spacing must reduce the last parameter.
-        PiecewiseLinearMonotone pl(PiecewiseLinearMonotone::NEGATIVE);
-
-        double scale = poly->length() / param;
-        pl.add(1., scale);
-#if RESAMPLING_DEBUG
-        Debugging::get()->printf("Log scale error at 1 = %lf", log(scale));
-#endif
-
-        for(int iters = 0; iters < 3; ++iters) //three iterations have been sufficient for convergence
-        {
-            SampleSpacingFunction scaledSpacing = spacing;
-            scaledSpacing.scale(scale);
-
-            param = 0;
-            for(int i = 0; i < numPts; ++i)
-                param += scaledSpacing.evalStep(param);
+        //The samples are spaced so that the integral of 1 / spacing between consecutive ones is the same, with
+        //a whole number of intervals, so that the last sample lands precisely at the end of the curve.
+        vector<double> outSamples = spacing.placeSamples();
 
-            double y = poly->length() / param;
-            pl.add(scale, y);
 #if RESAMPLING_DEBUG
-            Debugging::get()->printf("Log scale error at %lf = %lf", scale, log(y));
-#endif
-
-            //scale = pl.invert(1.);
-            //if(scale < 0)
-            if(!pl.invert(1., scale))
-            {
-                scale = 1;
-                break;
-            }
-        }
-
-        spacing.scale(scale);
-
-        param = 0;
-        for(int i = 0; i < numPts; ++i)
-        {
-            outSamples.push_back(param);
-            param += spacing.evalStep(param);
-        }
-
-#if RESAMPLING_DEBUG
-        //DBG:
-        Debugging::get()->printf("Log scale error Final = %lf", log(poly->length() / param));
         spacing.draw();
 #endif
 
-        if(!poly->isClosed())
-            outSamples.push_back(poly->length());
-
         return outSamples;
     }
 };
@@ -477,6 +580,32 @@ protected:
     }
 };
 
+size_t AlgorithmOutput<RESAMPLING>::memoryUsage() const
+{
+    return sizeof(*this) + corners.capacity() / 8 + (output ? output->memoryUsage() : 0) + (parameters ? parameters->memoryUsage() : 0);
+}
+
+void AlgorithmOutput<RESAMPLING>::recycle()
+{
+    corners.clear();
+    output.reset();
+    parameters.reset();
+}
+
+void AlgorithmOutput<RESAMPLING>::write(SnapshotWriter &out) const
+{
+    out.writeBools(corners);
+    out.writePolyline(output);
+    out.writeParameterMap(parameters);
+}
+
+void AlgorithmOutput<RESAMPLING>::read(SnapshotReader &in, const Fitter &)
+{
+    in.readBools(corners);
+    output = in.readPolyline();
+    parameters = in.readParameterMap();
+}
+
 void Algorithm<RESAMPLING>::_initialize()
 {
     new DefaultResampler();
@@ -28,13 +28,19 @@
 NAMESPACE_Cornu
 
 CORNU_SMART_FORW_DECL(Polyline);
+CORNU_SMART_FORW_DECL(ParameterMap);
 
 template<>
 struct AlgorithmOutput<RESAMPLING> : public AlgorithmOutputBase
 {
     VectorC<bool> corners;
     PolylineConstPtr output;
-    std::vector<double> parameters; //parameters[i] is the parameter in output of the original point with index i
+    ParameterMapConstPtr parameters; //maps the original point with index i to its parameter in output
+
+    size_t memoryUsage() const; //override
+    void recycle(); //override
+    void write(SnapshotWriter &out) const; //override
+    void read(SnapshotReader &in, const Fitter &fitter); //override
 };
 
 template<>
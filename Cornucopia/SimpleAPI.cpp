@@ -20,48 +20,558 @@
 
 #include "SimpleAPI.h"
 #include "Cornucopia.h"
+#include "FitCache.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 using namespace Eigen;
 NAMESPACE_Cornu
 
-vector<BasicPrimitive> fit(const vector<Point> &points, const Parameters &parameters, bool *outClosed)
+//returns null if fitting failed
+static PrimitiveSequenceConstPtr _fitSketch(const PolylineConstPtr &sketch, const Parameters &parameters, Debugging *debugging, FitCache *cache,
+                                            const PrimitiveSequenceConstPtr &oversketchBase = PrimitiveSequenceConstPtr(),
+                                            Executor *executor = NULL)
 {
+    if(cache && !oversketchBase) //the cache doesn't know about bases
+        return cache->fit(sketch, parameters);
+
     Fitter fitter;
     fitter.setParams(parameters);
+    fitter.setDebugging(debugging);
+    fitter.setExecutor(executor);
+    fitter.setLean(true); //only the final output is needed
+    fitter.setOriginalSketch(sketch);
+    if(oversketchBase)
+        fitter.setOversketchBase(oversketchBase);
+    fitter.run();
+    return fitter.finalOutput();
+}
+
+//a copy that shares no objects with the curve, for a fit on another thread
+static PrimitiveSequenceConstPtr _deepCopy(const PrimitiveSequenceConstPtr &curve)
+{
+    if(!curve)
+        return curve;
+    VectorC<CurvePrimitiveConstPtr> primitives(curve->primitives().size(), curve->primitives().circular());
+    for(int i = 0; i < primitives.size(); ++i)
+        primitives[i] = curve->primitives()[i]->clone();
+    return new PrimitiveSequence(primitives);
+}
 
+static BasicPrimitive _toBasicPrimitive(const CurvePrimitiveConstPtr &cur)
+{
+    BasicPrimitive out;
+    out.type = (BasicPrimitive::PrimitiveType)cur->getType();
+    out.start = Point(cur->startPos()[0], cur->startPos()[1]);
+    out.length = cur->length();
+    out.startAngle = cur->startAngle();
+    out.startCurvature = cur->startCurvature();
+    out.curvatureDerivative = 0;
+    if(cur->getType() == CurvePrimitive::CLOTHOID)
+        out.curvatureDerivative = cur->params()[CurvePrimitive::DCURVATURE];
+    return out;
+}
+
+static PolylinePtr _toPolyline(const vector<Point> &points)
+{
     VectorC<Vector2d> pts((int)points.size(), NOT_CIRCULAR);
     for(int i = 0; i < pts.size(); ++i)
         pts[i] = Vector2d(points[i].x, points[i].y);
+    return new Cornu::Polyline(std::move(pts));
+}
 
+//the points are read straight into the polyline's storage
+template<typename Real>
+static PolylinePtr _toPolyline(const Real *xs, const Real *ys, int stride, int count, bool closed = false)
+{
+    if(closed && count > 3 && xs[0] == xs[(ptrdiff_t)(count - 1) * stride] && ys[0] == ys[(ptrdiff_t)(count - 1) * stride])
+        --count; //a closed polyline doesn't repeat its first point
+    VectorC<Vector2d> pts(count, (closed && count > 2) ? CIRCULAR : NOT_CIRCULAR);
+    for(int i = 0; i < count; ++i)
+        pts.flatAt(i) = Vector2d(xs[(ptrdiff_t)i * stride], ys[(ptrdiff_t)i * stride]);
+    return new Cornu::Polyline(std::move(pts));
+}
+
+static vector<BasicPrimitive> _toBasicPrimitives(const PrimitiveSequenceConstPtr &output, bool *outClosed)
+{
+    if(outClosed)
+        (*outClosed) = output && output->isClosed();
+    if(!output) //fitting failed
+        return vector<BasicPrimitive>();
+
+    vector<BasicPrimitive> out(output->primitives().size());
+    for(int i = 0; i < (int)out.size(); ++i)
+        out[i] = _toBasicPrimitive(output->primitives()[i]);
+
+    return out;
+}
+
+static vector<BasicPrimitive> _fit(const vector<Point> &points, const Parameters &parameters, bool *outClosed, Debugging *debugging, FitCache *cache)
+{
     //pass it to the fitter and process it
-    fitter.setOriginalSketch(new Cornu::Polyline(pts));
-    fitter.run();
+    return _toBasicPrimitives(_fitSketch(_toPolyline(points), parameters, debugging, cache), outClosed);
+}
+
+template<typename Real>
+static int _fit(const Real *xs, const Real *ys, int stride, int count, const Parameters &parameters,
+                BasicPrimitive *out, int capacity, bool *outClosed, FitCache *cache)
+{
+    if(outClosed)
+        (*outClosed) = false;
+    if(count < 2)
+        return 0;
 
-    //process the output -- count the number of primitives of each type
-    PrimitiveSequenceConstPtr output = fitter.finalOutput();
+    PrimitiveSequenceConstPtr output = _fitSketch(_toPolyline(xs, ys, stride, count), parameters, NULL, cache);
 
     if(outClosed)
-        (*outClosed) = output->isClosed();
+        (*outClosed) = output && output->isClosed();
+    if(!output) //fitting failed
+        return 0;
 
-    vector<BasicPrimitive> out(output->primitives().size());
+    int size = output->primitives().size();
+    for(int i = 0; i < min(size, capacity); ++i)
+        out[i] = _toBasicPrimitive(output->primitives()[i]);
 
-    for(int i = 0; i < (int)out.size(); ++i)
+    return size;
+}
+
+vector<BasicPrimitive> fit(const vector<Point> &points, const Parameters &parameters, bool *outClosed, FitCache *cache)
+{
+    return _fit(points, parameters, outClosed, NULL, cache);
+}
+
+int fit(const double *xs, const double *ys, int stride, int count, const Parameters &parameters,
+        BasicPrimitive *out, int capacity, bool *outClosed, FitCache *cache)
+{
+    return _fit(xs, ys, stride, count, parameters, out, capacity, outClosed, cache);
+}
+
+int fit(const float *xs, const float *ys, int stride, int count, const Parameters &parameters,
+        BasicPrimitive *out, int capacity, bool *outClosed, FitCache *cache)
+{
+    return _fit(xs, ys, stride, count, parameters, out, capacity, outClosed, cache);
+}
+
+vector<vector<BasicPrimitive> > fitBatch(const vector<vector<Point> > &points, const Parameters &parameters, vector<bool> *outClosed, int numThreads)
+{
+    if(numThreads == 0)
+        return fitBatch(points, parameters, ThreadPool::global(), outClosed);
+    ThreadPool pool(numThreads);
+    return fitBatch(points, parameters, pool, outClosed);
+}
+
+vector<vector<BasicPrimitive> > fitBatch(const vector<vector<Point> > &points, const Parameters &parameters, Executor &executor, vector<bool> *outClosed)
+{
+    vector<vector<BasicPrimitive> > out(points.size());
+    vector<char> closed(points.size(), 0); //not vector<bool>: its elements can't be written concurrently
+
+    //the global debugging object is not in general thread-safe, so batch fits don't use it
+    function<void(int)> fitOne = [&](int i)
+    {
+        bool isClosed = false;
+        out[i] = _toBasicPrimitives(_fitSketch(_toPolyline(points[i]), parameters, Debugging::silent(), NULL,
+                                               PrimitiveSequenceConstPtr(), &executor), &isClosed);
+        closed[i] = isClosed;
+    };
+    executor.parallelFor((int)points.size(), fitOne);
+
+    if(outClosed)
+        outClosed->assign(closed.begin(), closed.end());
+
+    return out;
+}
+
+template<typename Real>
+static void _fitBatch(const Real *xs, const Real *ys, int stride, const long long *offsets, int numCurves, const Parameters &parameters,
+                      Executor &executor, vector<BasicPrimitive> &outPrimitives, vector<long long> &outOffsets, vector<bool> *outClosed,
+                      const vector<bool> *inClosed)
+{
+    vector<vector<BasicPrimitive> > results(numCurves);
+    vector<char> closed(numCurves, 0); //not vector<bool>: its elements can't be written concurrently
+
+    executor.parallelFor(numCurves, [&](int i)
+    {
+        long long count = offsets[i + 1] - offsets[i];
+        if(count < 2)
+            return;
+        ptrdiff_t first = (ptrdiff_t)offsets[i] * stride;
+        PolylinePtr sketch = _toPolyline(xs + first, ys + first, stride, (int)count, inClosed && (*inClosed)[i]);
+        bool isClosed = false;
+        results[i] = _toBasicPrimitives(_fitSketch(sketch, parameters, Debugging::silent(), NULL, PrimitiveSequenceConstPtr(), &executor),
+                                        &isClosed);
+        closed[i] = isClosed;
+    });
+
+    outOffsets.resize(numCurves + 1);
+    outOffsets[0] = 0;
+    for(int i = 0; i < numCurves; ++i)
+        outOffsets[i + 1] = outOffsets[i] + (long long)results[i].size();
+    outPrimitives.clear();
+    outPrimitives.reserve((size_t)outOffsets.back());
+    for(int i = 0; i < numCurves; ++i)
+        outPrimitives.insert(outPrimitives.end(), results[i].begin(), results[i].end());
+
+    if(outClosed)
+        outClosed->assign(closed.begin(), closed.end());
+}
+
+void fitBatch(const double *xs, const double *ys, int stride, const long long *offsets, int numCurves, const Parameters &parameters,
+              vector<BasicPrimitive> &outPrimitives, vector<long long> &outOffsets, vector<bool> *outClosed, int numThreads,
+              const vector<bool> *closed)
+{
+    if(numThreads == 0)
+    {
+        _fitBatch(xs, ys, stride, offsets, numCurves, parameters, ThreadPool::global(), outPrimitives, outOffsets, outClosed, closed);
+        return;
+    }
+    ThreadPool pool(numThreads);
+    _fitBatch(xs, ys, stride, offsets, numCurves, parameters, pool, outPrimitives, outOffsets, outClosed, closed);
+}
+
+void fitBatch(const float *xs, const float *ys, int stride, const long long *offsets, int numCurves, const Parameters &parameters,
+              vector<BasicPrimitive> &outPrimitives, vector<long long> &outOffsets, vector<bool> *outClosed, int numThreads,
+              const vector<bool> *closed)
+{
+    if(numThreads == 0)
+    {
+        _fitBatch(xs, ys, stride, offsets, numCurves, parameters, ThreadPool::global(), outPrimitives, outOffsets, outClosed, closed);
+        return;
+    }
+    ThreadPool pool(numThreads);
+    _fitBatch(xs, ys, stride, offsets, numCurves, parameters, pool, outPrimitives, outOffsets, outClosed, closed);
+}
+
+void fitBatch(const double *xs, const double *ys, int stride, const long long *offsets, int numCurves, const Parameters &parameters,
+              Executor &executor, vector<BasicPrimitive> &outPrimitives, vector<long long> &outOffsets, vector<bool> *outClosed,
+              const vector<bool> *closed)
+{
+    _fitBatch(xs, ys, stride, offsets, numCurves, parameters, executor, outPrimitives, outOffsets, outClosed, closed);
+}
+
+void fitBatch(const float *xs, const float *ys, int stride, const long long *offsets, int numCurves, const Parameters &parameters,
+              Executor &executor, vector<BasicPrimitive> &outPrimitives, vector<long long> &outOffsets, vector<bool> *outClosed,
+              const vector<bool> *closed)
+{
+    _fitBatch(xs, ys, stride, offsets, numCurves, parameters, executor, outPrimitives, outOffsets, outClosed, closed);
+}
+
+vector<vector<BasicPrimitive> > fitBatch(const vector<vector<Point> > &points, const vector<int> &oversketch, const Parameters &parameters,
+                                         vector<bool> *outClosed, int numThreads)
+{
+    if(numThreads == 0)
+        return fitBatch(points, oversketch, parameters, ThreadPool::global(), outClosed);
+    ThreadPool pool(numThreads);
+    return fitBatch(points, oversketch, parameters, pool, outClosed);
+}
+
+vector<vector<BasicPrimitive> > fitBatch(const vector<vector<Point> > &points, const vector<int> &oversketch, const Parameters &parameters,
+                                         Executor &executor, vector<bool> *outClosed)
+{
+    //Each sketch has at most one base, so the dependencies form trees rooted at the sketches drawn from scratch.
+    //A tree's children are fit in parallel as soon as its root's curve is done.
+    vector<vector<int> > dependents(points.size());
+    vector<int> roots;
+    for(int i = 0; i < (int)points.size(); ++i)
+    {
+        int base = i < (int)oversketch.size() ? oversketch[i] : -1;
+        if(base >= 0 && base < i)
+            dependents[base].push_back(i);
+        else
+            roots.push_back(i);
+    }
+
+    //An oversketch shares primitives with its base, and reference counts can't be changed from several threads, so
+    //each child gets its own copy of the base curve, made before the children start.
+    vector<PrimitiveSequenceConstPtr> curves(points.size());
+    function<void(int, const PrimitiveSequenceConstPtr &)> fitTree = [&](int i, const PrimitiveSequenceConstPtr &baseCurve)
+    {
+        curves[i] = _fitSketch(_toPolyline(points[i]), parameters, Debugging::silent(), NULL, baseCurve, &executor);
+
+        const vector<int> &next = dependents[i];
+        vector<PrimitiveSequenceConstPtr> bases(next.size());
+        for(int j = 0; j < (int)next.size(); ++j)
+            bases[j] = _deepCopy(curves[i]);
+        executor.parallelFor((int)next.size(), [&](int j) { fitTree(next[j], bases[j]); });
+    };
+    executor.parallelFor((int)roots.size(), [&](int j) { fitTree(roots[j], PrimitiveSequenceConstPtr()); });
+
+    vector<vector<BasicPrimitive> > out(points.size());
+    vector<bool> closed(points.size());
+    for(int i = 0; i < (int)points.size(); ++i)
+    {
+        bool isClosed;
+        out[i] = _toBasicPrimitives(curves[i], &isClosed);
+        closed[i] = isClosed;
+    }
+    if(outClosed)
+        outClosed->swap(closed);
+
+    return out;
+}
+
+struct AsyncFit::State
+{
+    State() : cancel(false), done(false), closed(false) {}
+
+    std::atomic<bool> cancel;
+    mutable std::mutex mutex;
+    mutable std::condition_variable finished;
+    bool done;
+    vector<BasicPrimitive> result;
+    bool closed;
+};
+
+void AsyncFit::_complete(vector<BasicPrimitive> &result, bool closed) const
+{
+    lock_guard<mutex> lock(_state->mutex);
+    _state->result.swap(result);
+    _state->closed = closed;
+    _state->done = true;
+    _state->finished.notify_all();
+}
+
+void AsyncFit::cancel()
+{
+    if(_state)
+        _state->cancel = true;
+}
+
+bool AsyncFit::ready() const
+{
+    if(!_state)
+        return false;
+    lock_guard<mutex> lock(_state->mutex);
+    return _state->done;
+}
+
+void AsyncFit::wait() const
+{
+    if(!_state)
+        return;
+    unique_lock<mutex> lock(_state->mutex);
+    while(!_state->done)
+        _state->finished.wait(lock);
+}
+
+const vector<BasicPrimitive> &AsyncFit::get(bool *outClosed) const
+{
+    static const vector<BasicPrimitive> empty;
+    if(!_state)
+        return empty;
+    wait();
+    if(outClosed)
+        (*outClosed) = _state->closed;
+    return _state->result;
+}
+
+AsyncFit fitAsync(const vector<Point> &points, const Parameters &parameters)
+{
+    return fitAsync(points, parameters, ThreadPool::global());
+}
+
+AsyncFit fitAsync(const vector<Point> &points, const Parameters &parameters, Executor &executor)
+{
+    AsyncFit out;
+    out._state = make_shared<AsyncFit::State>();
+    AsyncFit handle = out; //the task keeps the state alive if the other handles go away
+    AsyncFit::State *state = out._state.get();
+
+    //the polyline is made by the task, as smart pointer reference counts aren't safe to share between threads
+    executor.submit([handle, state, points, parameters, &executor]()
     {
-        CurvePrimitiveConstPtr cur = output->primitives()[i];
-        out[i].type = (BasicPrimitive::PrimitiveType)cur->getType();
-        out[i].start = Point(cur->startPos()[0], cur->startPos()[1]);
-        out[i].length = cur->length();
-        out[i].startAngle = cur->startAngle();
-        out[i].startCurvature = cur->startCurvature();
-        out[i].curvatureDerivative = 0;
-        if(cur->getType() == CurvePrimitive::CLOTHOID)
-            out[i].curvatureDerivative = cur->params()[CurvePrimitive::DCURVATURE];
+        vector<BasicPrimitive> result;
+        bool closed = false;
+        if(!state->cancel)
+        {
+            try
+            {
+                Fitter fitter;
+                fitter.setParams(parameters);
+                fitter.setDebugging(Debugging::silent()); //the global debugging object is not in general thread-safe
+                fitter.setExecutor(&executor);
+                fitter.setCancelFlag(&state->cancel);
+                fitter.setLean(true);
+                fitter.setOriginalSketch(_toPolyline(points));
+                fitter.run();
+                if(!fitter.cancelled())
+                    result = _toBasicPrimitives(fitter.finalOutput(), &closed);
+            }
+            catch(...) //submitted tasks must not throw, so the fit just fails
+            {
+                result.clear();
+                closed = false;
+            }
+        }
+
+        handle._complete(result, closed);
+    });
+
+    return out;
+}
+
+struct FitScheduler::_Impl
+{
+    _Impl() : stopping(false) {}
+
+    struct Job
+    {
+        Job() : nextStage(0), failed(false), queueWait(0.), serviceTime(0.) {}
+
+        bool runStage(); //returns true if the fit is done
+
+        AsyncFit handle;
+        vector<Point> points;
+        Parameters parameters;
+        Priority priority;
+        unique_ptr<Fitter> fitter; //made when the job first runs, as it holds reference counted objects
+        int nextStage;
+        bool failed;
+        chrono::steady_clock::time_point submitted;
+        double queueWait;
+        double serviceTime;
+    };
+
+    void work();
+    void finish(unique_ptr<Job> job); //called with the lock held
+
+    std::mutex guard;
+    condition_variable changed;
+    deque<unique_ptr<Job> > queues[NUM_PRIORITIES];
+    Stats stats[NUM_PRIORITIES];
+    bool stopping;
+    vector<thread> threads;
+};
+
+FitScheduler::FitScheduler(int numThreads)
+    : _impl(new _Impl())
+{
+    if(numThreads <= 0)
+        numThreads = max(1, (int)thread::hardware_concurrency());
+    for(int i = 0; i < numThreads; ++i)
+        _impl->threads.push_back(thread(&_Impl::work, _impl.get()));
+}
+
+FitScheduler::~FitScheduler()
+{
+    {
+        lock_guard<std::mutex> lock(_impl->guard);
+        _impl->stopping = true;
+        _impl->changed.notify_all();
     }
+    for(int i = 0; i < (int)_impl->threads.size(); ++i)
+        _impl->threads[i].join();
+}
 
+AsyncFit FitScheduler::fit(const vector<Point> &points, const Parameters &parameters, Priority priority)
+{
+    unique_ptr<_Impl::Job> job(new _Impl::Job());
+    job->handle._state = make_shared<AsyncFit::State>();
+    job->points = points;
+    job->parameters = parameters;
+    job->priority = priority;
+    job->submitted = chrono::steady_clock::now();
+    AsyncFit out = job->handle;
+
+    lock_guard<std::mutex> lock(_impl->guard);
+    _impl->queues[priority].push_back(std::move(job));
+    _impl->changed.notify_one();
     return out;
 }
 
+FitScheduler::Stats FitScheduler::stats(Priority priority) const
+{
+    lock_guard<std::mutex> lock(_impl->guard);
+    return _impl->stats[priority];
+}
+
+bool FitScheduler::_Impl::Job::runStage()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if(!fitter)
+    {
+        queueWait = chrono::duration<double>(start - submitted).count();
+        if(handle._state->cancel)
+            return true;
+        fitter.reset(new Fitter());
+        fitter->setParams(parameters);
+        fitter->setDebugging(Debugging::silent()); //the global debugging object is not in general thread-safe
+        fitter->setCancelFlag(&handle._state->cancel);
+        fitter->setLean(true);
+    }
+
+    try
+    {
+        if(nextStage == 0)
+            fitter->setOriginalSketch(_toPolyline(points));
+        fitter->run((AlgorithmStage)nextStage);
+    }
+    catch(...) //the thread must go on, so the fit just fails
+    {
+        failed = true;
+    }
+    ++nextStage;
+
+    serviceTime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return failed || fitter->cancelled() || nextStage == NUM_ALGORITHM_STAGES;
+}
+
+void FitScheduler::_Impl::work()
+{
+    unique_lock<std::mutex> lock(guard);
+    unique_ptr<Job> job;
+    while(true)
+    {
+        if(!job)
+        {
+            while(queues[INTERACTIVE].empty() && queues[BULK].empty() && !stopping)
+                changed.wait(lock);
+            int priority = queues[INTERACTIVE].empty() ? BULK : INTERACTIVE;
+            if(queues[priority].empty()) //stopping with nothing left
+                return;
+            job = std::move(queues[priority].front());
+            queues[priority].pop_front();
+        }
+
+        lock.unlock();
+        bool done = job->runStage();
+        lock.lock();
+
+        if(done)
+            finish(std::move(job));
+        else if(job->priority == BULK && !queues[INTERACTIVE].empty())
+        {
+            //park the bulk fit in front of the other bulk fits, so it resumes before they start
+            ++stats[BULK].numPreemptions;
+            queues[BULK].push_front(std::move(job));
+            job = std::move(queues[INTERACTIVE].front());
+            queues[INTERACTIVE].pop_front();
+        }
+    }
+}
+
+void FitScheduler::_Impl::finish(unique_ptr<Job> job)
+{
+    Stats &s = stats[job->priority];
+    ++s.numFits;
+    s.totalQueueWait += job->queueWait;
+    s.maxQueueWait = max(s.maxQueueWait, job->queueWait);
+    s.totalServiceTime += job->serviceTime;
+    s.maxServiceTime = max(s.maxServiceTime, job->serviceTime);
+
+    vector<BasicPrimitive> result;
+    bool closed = false;
+    if(job->fitter && !job->failed && !job->fitter->cancelled())
+        result = _toBasicPrimitives(job->fitter->finalOutput(), &closed);
+    job->handle._complete(result, closed);
+}
+
 //converts a BasicPrimitive to a CurvePrimitive
 CurvePrimitivePtr _toCurvePrimitive(const BasicPrimitive &primitive)
 {
@@ -111,31 +621,116 @@ void BasicPrimitive::eval(double s, Point *outPos, Point *outDer, Point *outDer2
         *outDer2 = Point(der2[0], der2[1]);
 }
 
-vector<BasicBezier> toBezierSpline(const vector<BasicPrimitive> &curve, double tolerance)
+//evaluates the primitive at s into count points starting at each non-null output
+static void _evalBatch(const BasicPrimitive &primitive, const VectorXd &s, Point *outPos, Point *outDer, Point *outDer2)
 {
-    VectorC<CurvePrimitiveConstPtr> curvePrimitives;
-    for(int i = 0; i < (int)curve.size(); ++i)
-        curvePrimitives.push_back(_toCurvePrimitive(curve[i]));
+    CurvePrimitivePtr curvePrimitive = _toCurvePrimitive(primitive);
+    if(primitive.type == BasicPrimitive::CLOTHOID) //evalBatch is single precision by default
+        static_pointer_cast<Clothoid>(curvePrimitive)->setAccuracy(Clothoid::FULL_ACCURACY);
 
-    PrimitiveSequence seq(curvePrimitives);
+    Matrix2Xd pos, der, der2;
+    curvePrimitive->evalBatch(s, outPos ? &pos : NULL, outDer ? &der : NULL, outDer2 ? &der2 : NULL);
 
-    BezierSplinePtr spline = seq.toBezierSpline(tolerance);
+    for(int i = 0; i < (int)s.size(); ++i)
+    {
+        if(outPos)
+            outPos[i] = Point(pos(0, i), pos(1, i));
+        if(outDer)
+            outDer[i] = Point(der(0, i), der(1, i));
+        if(outDer2)
+            outDer2[i] = Point(der2(0, i), der2(1, i));
+    }
+}
 
-    vector<BasicBezier> out(spline->primitives().size());
+void BasicPrimitive::evalBatch(const double *s, int count, Point *outPos, Point *outDer, Point *outDer2) const
+{
+    _evalBatch(*this, Map<const VectorXd>(s, count), outPos, outDer, outDer2);
+}
 
-    for(int i = 0; i < (int)spline->primitives().size(); ++i)
+void tessellate(const BasicPrimitive *primitives, int numPrimitives, int samplesPerPrimitive, Point *outPos, Point *outDer, Point *outDer2)
+{
+    for(int i = 0; i < numPrimitives; ++i)
     {
-        for(int j = 0; j < 4; ++j)
+        int offset = i * samplesPerPrimitive;
+        _evalBatch(primitives[i], VectorXd::LinSpaced(samplesPerPrimitive, 0., primitives[i].length),
+                   outPos ? outPos + offset : NULL, outDer ? outDer + offset : NULL, outDer2 ? outDer2 + offset : NULL);
+    }
+}
+
+static PrimitiveSequencePtr _toPrimitiveSequence(const BasicPrimitive *primitives, int numPrimitives)
+{
+    VectorC<CurvePrimitiveConstPtr> curvePrimitives(numPrimitives, NOT_CIRCULAR);
+    for(int i = 0; i < numPrimitives; ++i)
+        curvePrimitives.flatAt(i) = _toCurvePrimitive(primitives[i]);
+
+    return new PrimitiveSequence(curvePrimitives);
+}
+
+int tessellate(const BasicPrimitive *primitives, int numPrimitives, double tolerance, CurveVertex *out, int capacity)
+{
+    if(numPrimitives == 0)
+        return 0;
+    return _toPrimitiveSequence(primitives, numPrimitives)->tessellate(tolerance, out, capacity);
+}
+
+int tessellate(const BasicPrimitive *primitives, int numPrimitives, double tolerance, QuantizedCurveVertex *out, int capacity,
+               double *outBounds, double *outLength)
+{
+    if(numPrimitives == 0)
+        return 0;
+    PrimitiveSequencePtr curve = _toPrimitiveSequence(primitives, numPrimitives);
+    if(outBounds)
+    {
+        for(int k = 0; k < 2; ++k)
         {
-            Vector2d pt = spline->primitives()[i].controlPoint(j);
-            out[i].controlPoint[j].x = pt[0];
-            out[i].controlPoint[j].y = pt[1];
+            outBounds[k] = curve->boundingBox().min()[k];
+            outBounds[k + 2] = curve->boundingBox().max()[k];
         }
     }
+    if(outLength)
+        *outLength = curve->length();
+    return curve->tessellate(tolerance, out, capacity);
+}
+
+static BezierSplinePtr _toBezierSpline(const BasicPrimitive *curve, int count, double tolerance)
+{
+    return _toPrimitiveSequence(curve, count)->toAdaptiveBezierSpline(tolerance);
+}
+
+static BasicBezier _toBasicBezier(const CubicBezier &bezier)
+{
+    BasicBezier out;
+    for(int j = 0; j < 4; ++j)
+    {
+        Vector2d pt = bezier.controlPoint(j);
+        out.controlPoint[j].x = pt[0];
+        out.controlPoint[j].y = pt[1];
+    }
+    return out;
+}
+
+vector<BasicBezier> toBezierSpline(const vector<BasicPrimitive> &curve, double tolerance)
+{
+    BezierSplinePtr spline = _toBezierSpline(curve.data(), (int)curve.size(), tolerance);
+
+    vector<BasicBezier> out(spline->primitives().size());
+    for(int i = 0; i < (int)out.size(); ++i)
+        out[i] = _toBasicBezier(spline->primitives()[i]);
 
     return out;
 }
 
+int toBezierSpline(const BasicPrimitive *curve, int count, double tolerance, BasicBezier *out, int capacity)
+{
+    BezierSplinePtr spline = _toBezierSpline(curve, count, tolerance);
+
+    int size = spline->primitives().size();
+    for(int i = 0; i < min(size, capacity); ++i)
+        out[i] = _toBasicBezier(spline->primitives()[i]);
+
+    return size;
+}
+
 END_NAMESPACE_Cornu
 
 
@@ -25,6 +25,10 @@
 //To use Cornucopia, you only need to include this file, construct a vector of Points, Parameters, and run the fit(...) function.
 
 #include "Parameters.h"
+#include "CurveVertex.h"
+#include "Executor.h"
+
+#include <memory>
 
 namespace Cornu
 {
@@ -57,11 +61,142 @@ struct BasicPrimitive
     //Evaluates this primitive at (arclength) parameter s (between 0 and length) and returns the position and first and second derivatives.
     //This function is slower than using CurvePrimitive's evaluators
     void eval(double s, Point *outPos, Point *outDer = NULL, Point *outDer2 = NULL) const;
+    //Evaluates this primitive at the count parameters in s, as accurately as eval, but with the per-primitive setup done
+    //once and the Fresnel integrals evaluated several at a time.  Any of the outputs may be null.
+    void evalBatch(const double *s, int count, Point *outPos, Point *outDer = NULL, Point *outDer2 = NULL) const;
 };
 
+//Evaluates each primitive at samplesPerPrimitive (at least 2) evenly spaced parameters from 0 to its length, e.g., for
+//drawing.  Each output that isn't null receives numPrimitives * samplesPerPrimitive points, one primitive after another.
+void tessellate(const BasicPrimitive *primitives, int numPrimitives, int samplesPerPrimitive,
+                Point *outPos, Point *outDer = NULL, Point *outDer2 = NULL);
+
+//Tessellates the curve into a polyline within tolerance of it, e.g., a fraction of a pixel, and writes up to capacity
+//of its vertices to out.  Returns the number of vertices, which may be greater than capacity.  For the quantized
+//version, outBounds receives minX, minY, maxX, maxY of the box the positions are relative to and outLength the arc
+//length of the curve (see CurveVertex.h).
+int tessellate(const BasicPrimitive *primitives, int numPrimitives, double tolerance, CurveVertex *out, int capacity);
+int tessellate(const BasicPrimitive *primitives, int numPrimitives, double tolerance, QuantizedCurveVertex *out, int capacity,
+               double *outBounds = NULL, double *outLength = NULL);
+
+class FitCache;
+
 //The basic API function: takes a vector of points and a Parameters object (see Parameters.h)
-//and returns a vector of primitives and (optionally) whether the curve is closed
-std::vector<BasicPrimitive> fit(const std::vector<Point> &points, const Parameters &parameters, bool *outClosed = NULL);
+//and returns a vector of primitives and (optionally) whether the curve is closed.
+//If a cache is given (see FitCache.h), repeated fits of the same points and parameters are looked up in it.
+std::vector<BasicPrimitive> fit(const std::vector<Point> &points, const Parameters &parameters, bool *outClosed = NULL, FitCache *cache = NULL);
+
+//Versions of fit for callers that keep their own point and result arrays, e.g., across a foreign function interface.
+//Point i is (xs[i * stride], ys[i * stride]), so an interleaved xy array is passed as xs = data, ys = data + 1, stride = 2.
+//Up to capacity primitives are written to out, and the return value is the number of primitives in the result
+//(0 if fitting failed).  If it is greater than capacity, the result was truncated--fitting again with a FitCache
+//and a larger buffer doesn't redo the work.
+int fit(const double *xs, const double *ys, int stride, int count, const Parameters &parameters,
+        BasicPrimitive *out, int capacity, bool *outClosed = NULL, FitCache *cache = NULL);
+int fit(const float *xs, const float *ys, int stride, int count, const Parameters &parameters,
+        BasicPrimitive *out, int capacity, bool *outClosed = NULL, FitCache *cache = NULL);
+
+//Fits many independent curves in parallel and returns the results in input order.
+//If numThreads is 0, the global thread pool (one thread per core) is used, otherwise a pool
+//with numThreads threads is created for the call.  Batch fits produce no debugging output.
+std::vector<std::vector<BasicPrimitive> > fitBatch(const std::vector<std::vector<Point> > &points, const Parameters &parameters,
+                                                   std::vector<bool> *outClosed = NULL, int numThreads = 0);
+//Runs the fits, and the parallel loops inside them, on the given executor (see Executor.h) instead of a thread pool
+std::vector<std::vector<BasicPrimitive> > fitBatch(const std::vector<std::vector<Point> > &points, const Parameters &parameters,
+                                                   Executor &executor, std::vector<bool> *outClosed = NULL);
+//Like fitBatch above, but a sketch may be drawn over the curve fit to an earlier one, as in an editing session:
+//oversketch[i] is the index of that earlier sketch (less than i), or -1.  Each result is the curve its sketch
+//makes of its base's result.  Sketches are fit as soon as their own base is done, so independent chains run in
+//parallel.
+std::vector<std::vector<BasicPrimitive> > fitBatch(const std::vector<std::vector<Point> > &points, const std::vector<int> &oversketch,
+                                                   const Parameters &parameters, std::vector<bool> *outClosed = NULL, int numThreads = 0);
+std::vector<std::vector<BasicPrimitive> > fitBatch(const std::vector<std::vector<Point> > &points, const std::vector<int> &oversketch,
+                                                   const Parameters &parameters, Executor &executor, std::vector<bool> *outClosed = NULL);
+
+//Like fitBatch above, for a ragged batch of curves whose points are all in one array, e.g., NumPy arrays across a
+//foreign function interface, so that the caller needn't build a vector per curve.  Curve i is points offsets[i]
+//through offsets[i + 1] - 1, and point j is (xs[j * stride], ys[j * stride]).  The primitives go to outPrimitives one
+//curve after another, curve i's from outOffsets[i] through outOffsets[i + 1] - 1 (outOffsets gets numCurves + 1
+//entries), and outClosed, if not null, gets whether each curve is closed.  Curves with fewer than two points, or
+//whose fit failed, get no primitives.  If closed is not null, the curves whose entry is true are known to be closed
+//and are fit that way, e.g., traced outlines (a last point that repeats the first is then dropped); whether the
+//others are closed is still decided from how near their ends are.
+void fitBatch(const double *xs, const double *ys, int stride, const long long *offsets, int numCurves, const Parameters &parameters,
+              std::vector<BasicPrimitive> &outPrimitives, std::vector<long long> &outOffsets, std::vector<bool> *outClosed = NULL,
+              int numThreads = 0, const std::vector<bool> *closed = NULL);
+void fitBatch(const float *xs, const float *ys, int stride, const long long *offsets, int numCurves, const Parameters &parameters,
+              std::vector<BasicPrimitive> &outPrimitives, std::vector<long long> &outOffsets, std::vector<bool> *outClosed = NULL,
+              int numThreads = 0, const std::vector<bool> *closed = NULL);
+void fitBatch(const double *xs, const double *ys, int stride, const long long *offsets, int numCurves, const Parameters &parameters,
+              Executor &executor, std::vector<BasicPrimitive> &outPrimitives, std::vector<long long> &outOffsets,
+              std::vector<bool> *outClosed = NULL, const std::vector<bool> *closed = NULL);
+void fitBatch(const float *xs, const float *ys, int stride, const long long *offsets, int numCurves, const Parameters &parameters,
+              Executor &executor, std::vector<BasicPrimitive> &outPrimitives, std::vector<long long> &outOffsets,
+              std::vector<bool> *outClosed = NULL, const std::vector<bool> *closed = NULL);
+
+//A fit started by fitAsync.  Copies refer to the same fit, and all the functions may be called from any thread.
+class AsyncFit
+{
+public:
+    bool valid() const { return _state.get() != NULL; } //false if default constructed
+
+    //Asks the fit to stop.  It checks between stages, path finder searches and solver iterations, and then finishes
+    //with an empty result.  Cancelling a fit that is done has no effect.
+    void cancel();
+    bool ready() const;
+    void wait() const;
+    //Waits for the fit and returns its result, which is empty if fitting failed or was cancelled
+    const std::vector<BasicPrimitive> &get(bool *outClosed = NULL) const;
+
+private:
+    friend AsyncFit fitAsync(const std::vector<Point> &, const Parameters &, Executor &);
+    friend class FitScheduler;
+    struct State;
+    void _complete(std::vector<BasicPrimitive> &result, bool closed) const; //wakes up the threads waiting for it
+    std::shared_ptr<State> _state;
+};
+
+//Starts fitting the points on the executor (see Executor.h), or the global thread pool, and returns right away, so
+//that a server doesn't block a thread per fit and can abandon fits whose result is no longer wanted.  The fit's
+//parallel loops (with Parameters::MULTITHREADED) run on the same executor, which must outlive the fit.  Async fits
+//produce no debugging output.
+AsyncFit fitAsync(const std::vector<Point> &points, const Parameters &parameters);
+AsyncFit fitAsync(const std::vector<Point> &points, const Parameters &parameters, Executor &executor);
+
+//Runs async fits on its own threads in two priority classes, so that latency-critical fits (a user just lifted the
+//pen) can share a machine with bulk ones (re-vectorizing a document).  Idle threads take interactive fits first, and
+//a thread running a bulk fit checks between stages whether an interactive fit is waiting; if so, it parks the bulk
+//fit, which a thread picks up again from the next stage once no interactive fits wait.  Bulk fits can thus keep all
+//the cores busy while an interactive fit waits for at most about one stage of one.  Fits produce no debugging output,
+//and their parallel loops (with Parameters::MULTITHREADED) run on the global thread pool.
+class FitScheduler
+{
+public:
+    enum Priority { INTERACTIVE, BULK, NUM_PRIORITIES };
+
+    struct Stats //of the fits of a class that are done, including failed and cancelled ones
+    {
+        Stats() : numFits(0), numPreemptions(0), totalQueueWait(0.), maxQueueWait(0.), totalServiceTime(0.), maxServiceTime(0.) {}
+
+        int numFits;
+        int numPreemptions; //the number of times fits of this class were parked for interactive ones
+        double totalQueueWait, maxQueueWait; //seconds from being submitted to starting to run
+        double totalServiceTime, maxServiceTime; //seconds spent running, not counting the time parked
+    };
+
+    explicit FitScheduler(int numThreads = 0); //0 means one thread per core
+    ~FitScheduler(); //finishes the fits already submitted
+
+    AsyncFit fit(const std::vector<Point> &points, const Parameters &parameters, Priority priority);
+    Stats stats(Priority priority) const;
+
+private:
+    FitScheduler(const FitScheduler &);
+    FitScheduler &operator=(const FitScheduler &);
+
+    struct _Impl;
+    std::unique_ptr<_Impl> _impl;
+};
 
 struct BasicBezier
 {
@@ -69,6 +204,9 @@ struct BasicBezier
 };
 
 std::vector<BasicBezier> toBezierSpline(const std::vector<BasicPrimitive> &curve, double tolerance);
+//Converts count primitives and writes up to capacity Bezier segments to out.  Returns the number of segments
+//in the result, which may be greater than capacity, like fit above.
+int toBezierSpline(const BasicPrimitive *curve, int count, double tolerance, BasicBezier *out, int capacity);
 
 } //end of namespace Cornu
 
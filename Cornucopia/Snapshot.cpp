@@ -0,0 +1,287 @@
+/*--
+    Snapshot.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Snapshot.h"
+#include "Algorithm.h"
+#include "Parameters.h"
+#include "FitMetrics.h"
+#include "Polyline.h"
+#include "PiecewiseLinearUtils.h"
+#include "PrimitiveSequence.h"
+#include "Line.h"
+#include "Arc.h"
+#include "Clothoid.h"
+
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+bool SnapshotWriter::ok() const
+{
+    return !_out.fail();
+}
+
+void SnapshotWriter::_write(const void *data, size_t size)
+{
+    _out.write((const char *)data, size);
+}
+
+void SnapshotWriter::writeString(const string &s)
+{
+    writeInt((int)s.size());
+    _write(s.data(), s.size());
+}
+
+void SnapshotWriter::writeBools(const VectorC<bool> &v)
+{
+    writeBool(v.circular() == CIRCULAR);
+    writeInt(v.size());
+    for(int i = 0; i < v.size(); ++i)
+        writeBool(v.flatAt(i));
+}
+
+void SnapshotWriter::writePoints(const VectorC<Vector2d> &pts)
+{
+    writeBool(pts.circular() == CIRCULAR);
+    writeVector(pts);
+}
+
+void SnapshotWriter::writePolyline(PolylineConstPtr poly)
+{
+    writeBool(poly);
+    if(poly)
+        writePoints(poly->pts());
+}
+
+void SnapshotWriter::writeCurve(CurvePrimitiveConstPtr curve)
+{
+    writeInt(curve ? curve->getType() : -1);
+    if(!curve)
+        return;
+    if(curve->getType() == CurvePrimitive::CLOTHOID)
+        writeInt(static_pointer_cast<const Clothoid>(curve)->accuracy());
+    for(int i = 0; i < curve->numParams(); ++i)
+        writeDouble(curve->params()[i]);
+}
+
+void SnapshotWriter::writeCurves(PrimitiveSequenceConstPtr curves)
+{
+    writeBool(curves);
+    if(!curves)
+        return;
+    writeBool(curves->isClosed());
+    writeInt(curves->primitives().size());
+    for(int i = 0; i < curves->primitives().size(); ++i)
+        writeCurve(curves->primitives().flatAt(i));
+}
+
+void SnapshotWriter::writeParameterMap(ParameterMapConstPtr map)
+{
+    vector<double> values;
+    if(map)
+        map->evaluate(values);
+    writeVector(values);
+}
+
+void SnapshotWriter::writeParameters(const Parameters &params)
+{
+    writeString(params.name());
+    const vector<Parameters::Parameter> &parameters = Parameters::parameters();
+    writeInt((int)parameters.size());
+    for(int i = 0; i < (int)parameters.size(); ++i)
+    {
+        writeInt(parameters[i].type);
+        writeDouble(params.get(parameters[i].type));
+    }
+    writeInt(NUM_ALGORITHM_STAGES);
+    for(int i = 0; i < NUM_ALGORITHM_STAGES; ++i)
+        writeInt(params.getAlgorithm(i));
+}
+
+void SnapshotWriter::writeMetrics(const FitMetrics &metrics)
+{
+    writeInt(NUM_ALGORITHM_STAGES);
+    for(int i = 0; i < NUM_ALGORITHM_STAGES; ++i)
+        writeDouble(metrics._stageTimes[i]);
+    writeDouble(metrics._totalTime);
+    writeInt(FitMetrics::NUM_COUNTERS);
+    for(int i = 0; i < FitMetrics::NUM_COUNTERS; ++i)
+        writeDouble((double)metrics.counter((FitMetrics::Counter)i));
+    writeDouble((double)metrics.peakBytes());
+}
+
+void SnapshotReader::_read(void *data, size_t size)
+{
+    if(_ok && !_in.read((char *)data, size))
+        _ok = false;
+    if(!_ok)
+        memset(data, 0, size);
+}
+
+int SnapshotReader::readSize()
+{
+    int size = readInt();
+    if(size < 0 || size > (1 << 26))
+        _ok = false;
+    return _ok ? size : 0;
+}
+
+string SnapshotReader::readString()
+{
+    string out(readSize(), ' ');
+    if(!out.empty())
+        _read(&out[0], out.size());
+    return _ok ? out : string();
+}
+
+void SnapshotReader::readBools(VectorC<bool> &v)
+{
+    v.setCircular(readBool() ? CIRCULAR : NOT_CIRCULAR);
+    v.resize(readSize());
+    for(int i = 0; i < v.size(); ++i)
+        v.flatAt(i) = readBool();
+}
+
+void SnapshotReader::readPoints(VectorC<Vector2d> &pts)
+{
+    pts.setCircular(readBool() ? CIRCULAR : NOT_CIRCULAR);
+    readVector(pts);
+}
+
+PolylineConstPtr SnapshotReader::readPolyline()
+{
+    if(!readBool())
+        return PolylineConstPtr();
+    VectorC<Vector2d> pts;
+    readPoints(pts);
+    if(!_ok || pts.size() < 2)
+    {
+        _ok = false;
+        return PolylineConstPtr();
+    }
+    return new Polyline(std::move(pts));
+}
+
+ParameterMapConstPtr SnapshotReader::readParameterMap()
+{
+    vector<double> values;
+    readVector(values);
+    if(values.empty())
+        return ParameterMapConstPtr();
+    return new ParameterMap(values);
+}
+
+CurvePrimitivePtr SnapshotReader::readCurve()
+{
+    CurvePrimitivePtr out;
+    int type = readInt();
+    if(type == CurvePrimitive::LINE)
+        out = new Line();
+    else if(type == CurvePrimitive::ARC)
+        out = new Arc();
+    else if(type == CurvePrimitive::CLOTHOID)
+    {
+        int accuracy = readInt();
+        if(accuracy < Clothoid::DEFAULT_ACCURACY || accuracy > Clothoid::TABULATED_ACCURACY)
+            _ok = false;
+        ClothoidPtr clothoid = new Clothoid();
+        clothoid->setAccuracy((Clothoid::Accuracy)accuracy);
+        out = clothoid;
+    }
+    else if(type != -1)
+        _ok = false;
+
+    if(!out || !_ok)
+        return CurvePrimitivePtr();
+
+    CurvePrimitive::ParamVec params(out->numParams());
+    for(int i = 0; i < out->numParams(); ++i)
+        params[i] = readDouble();
+    out->setParams(params);
+    return _ok ? out : CurvePrimitivePtr();
+}
+
+PrimitiveSequenceConstPtr SnapshotReader::readCurves()
+{
+    if(!readBool())
+        return PrimitiveSequenceConstPtr();
+    bool closed = readBool();
+    VectorC<CurvePrimitiveConstPtr> primitives(readSize(), closed ? CIRCULAR : NOT_CIRCULAR);
+    for(int i = 0; i < primitives.size(); ++i)
+    {
+        primitives.flatAt(i) = readCurve();
+        if(!primitives.flatAt(i))
+            _ok = false;
+    }
+    if(!_ok || primitives.size() == 0)
+    {
+        _ok = false;
+        return PrimitiveSequenceConstPtr();
+    }
+    return new PrimitiveSequence(primitives);
+}
+
+void SnapshotReader::readParameters(Parameters &params)
+{
+    params.setName(readString());
+    int numParameters = readSize();
+    for(int i = 0; i < numParameters && _ok; ++i)
+    {
+        int type = readInt();
+        double value = readDouble();
+        if(type < 0 || type >= (int)Parameters::parameters().size())
+            _ok = false;
+        else
+            params.set((Parameters::ParameterType)type, value);
+    }
+    if(readInt() != NUM_ALGORITHM_STAGES)
+        _ok = false;
+    for(int i = 0; i < NUM_ALGORITHM_STAGES && _ok; ++i)
+    {
+        int algorithm = readInt();
+        if(algorithm < 0 || algorithm >= AlgorithmBase::numAlgorithmsForStage((AlgorithmStage)i))
+            _ok = false;
+        else
+            params.setAlgorithm(i, algorithm);
+    }
+}
+
+void SnapshotReader::readMetrics(FitMetrics &metrics)
+{
+    metrics.clear();
+    if(readInt() != NUM_ALGORITHM_STAGES)
+        _ok = false;
+    for(int i = 0; i < NUM_ALGORITHM_STAGES && _ok; ++i)
+        metrics._stageTimes[i] = readDouble();
+    metrics._totalTime = readDouble();
+    if(readInt() != FitMetrics::NUM_COUNTERS)
+        _ok = false;
+    for(int i = 0; i < FitMetrics::NUM_COUNTERS && _ok; ++i)
+        metrics._counters[i].store((long long)readDouble(), std::memory_order_relaxed);
+    metrics._peakBytes.store((long long)readDouble(), std::memory_order_relaxed);
+    if(!_ok)
+        metrics.clear();
+}
+
+END_NAMESPACE_Cornu
@@ -0,0 +1,127 @@
+/*--
+    Snapshot.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_SNAPSHOT_H_INCLUDED
+#define CORNUCOPIA_SNAPSHOT_H_INCLUDED
+
+#include "defs.h"
+#include "smart_ptr.h"
+#include "VectorC.h"
+
+#include <iosfwd>
+#include <string>
+
+NAMESPACE_Cornu
+
+CORNU_SMART_FORW_DECL(Polyline);
+CORNU_SMART_FORW_DECL(CurvePrimitive);
+CORNU_SMART_FORW_DECL(PrimitiveSequence);
+CORNU_SMART_FORW_DECL(ParameterMap);
+class Parameters;
+class FitMetrics;
+
+/*
+    A snapshot holds a Fitter's inputs, its parameters and the outputs of the stages before a given one, so that
+    the later stages can be rerun, e.g., to time them, on exactly the inputs they saw before (see
+    Fitter::writeSnapshot).  Each AlgorithmOutput writes and reads its own members with these classes.
+    Numbers are stored in the native byte order, so a snapshot should be read on the kind of machine that wrote it.
+*/
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(std::ostream &out) : _out(out) {}
+
+    bool ok() const;
+
+    void writeInt(int x) { _write(&x, sizeof(x)); }
+    void writeDouble(double x) { _write(&x, sizeof(x)); }
+    void writeBool(bool x) { char c = x; _write(&c, 1); }
+    void writeString(const std::string &s);
+
+    template<typename VectorType>
+    void writeVector(const VectorType &v) //the elements must be plain data
+    {
+        writeInt((int)v.size());
+        if(!v.empty())
+            _write(&v[0], v.size() * sizeof(v[0]));
+    }
+    void writeBools(const VectorC<bool> &v);
+    void writePoints(const VectorC<Eigen::Vector2d> &pts);
+
+    //the pointers may be null
+    void writePolyline(PolylineConstPtr poly);
+    void writeCurve(CurvePrimitiveConstPtr curve);
+    void writeCurves(PrimitiveSequenceConstPtr curves);
+    void writeParameterMap(ParameterMapConstPtr map); //as the vector of its values, so it is read back flattened
+
+    void writeParameters(const Parameters &params);
+    void writeMetrics(const FitMetrics &metrics);
+
+private:
+    void _write(const void *data, size_t size);
+
+    std::ostream &_out;
+};
+
+//After a read fails (the stream ends or has data that doesn't make sense), ok() returns false and the reads
+//return empty values.
+class SnapshotReader
+{
+public:
+    SnapshotReader(std::istream &in) : _in(in), _ok(true) {}
+
+    bool ok() const { return _ok; }
+    void fail() { _ok = false; }
+
+    int readInt() { int x = 0; _read(&x, sizeof(x)); return x; }
+    double readDouble() { double x = 0.; _read(&x, sizeof(x)); return x; }
+    bool readBool() { char c = 0; _read(&c, 1); return c != 0; }
+    int readSize(); //fails on negative or implausibly large sizes
+    std::string readString();
+
+    template<typename VectorType>
+    void readVector(VectorType &v)
+    {
+        int size = readSize();
+        v.resize(size);
+        if(size)
+            _read(&v[0], size * sizeof(v[0]));
+    }
+    void readBools(VectorC<bool> &v);
+    void readPoints(VectorC<Eigen::Vector2d> &pts);
+
+    PolylineConstPtr readPolyline();
+    CurvePrimitivePtr readCurve();
+    PrimitiveSequenceConstPtr readCurves();
+    ParameterMapConstPtr readParameterMap();
+
+    void readParameters(Parameters &params);
+    void readMetrics(FitMetrics &metrics);
+
+private:
+    void _read(void *data, size_t size);
+
+    std::istream &_in;
+    bool _ok;
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_SNAPSHOT_H_INCLUDED
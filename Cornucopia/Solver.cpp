@@ -19,6 +19,8 @@
 */
 
 #include "Solver.h"
+#include "FitMetrics.h"
+#include "Trace.h"
 #include <Eigen/Cholesky>
 #include <iostream> //TODO: TMP
 
@@ -28,26 +30,114 @@ NAMESPACE_Cornu
 
 LSSolver::LSSolver(LSProblem *problem, const vector<LSBoxConstraint> &constraints)
 : _problem(problem), _constraints(constraints), _damping(1.), _maxIter(100),
-  _increaseDampingAfter(0), _dampingIncreaseFactor(1.)
+  _increaseDampingAfter(0), _dampingIncreaseFactor(1.), _objectiveTolerance(0.), _objectiveMaxError(0.),
+  _strategy(FIXED_DAMPING), _geodesicAcceleration(false), _deadline(chrono::steady_clock::time_point::max()), _cancel(NULL), _truncated(false), _workspace(NULL), _numAllocations(0), _numIterations(0), _numHalvings(0), _numEvaluations(0)
 {
 };
 
+LSWorkspace::~LSWorkspace()
+{
+    for(int i = 0; i < (int)_evalDatas.size(); ++i)
+        delete _evalDatas[i].evalData;
+}
+
+LSWorkspace &LSWorkspace::forThread()
+{
+    static thread_local LSWorkspace workspace;
+    return workspace;
+}
+
+LSEvalData *LSWorkspace::_evalData(LSProblem *problem, int &numAllocations, int slot)
+{
+    //eval data is reused by problems of the same type
+    const type_info &type = typeid(*problem);
+    for(int i = 0; i < (int)_evalDatas.size(); ++i)
+        if(*_evalDatas[i].problemType == type && _evalDatas[i].slot == slot)
+            return _evalDatas[i].evalData;
+
+    ++numAllocations;
+    _EvalDataEntry entry = { &type, slot, problem->createEvalData() };
+    _evalDatas.push_back(entry);
+    return entry.evalData;
+}
+
 VectorXd LSSolver::solve(const VectorXd &guess)
 {
-    VectorXd best;
+    CORNU_TRACE_SCOPE("LSSolver::solve");
+    _numAllocations = 0;
+    _numHalvings = 0;
+    _numEvaluations = 0;
+    _truncated = false;
+
+    //if the workspace is already in use (or there is none), use a temporary one
+    LSWorkspace local;
+    LSWorkspace &workspace = (_workspace != NULL && !_workspace->_busy) ? *_workspace : local;
+    workspace._busy = true;
+
+    VectorXd &best = workspace._best;
+    VectorXd &x = workspace._x;
+    LSEvalData *evalData = workspace._evalData(_problem, _numAllocations);
+
+    bool haveBest = false;
     double bestError = 1e100;
-    VectorXd x = guess;
-    LSEvalData *evalData = _problem->createEvalData();
+    _resize(x, (int)guess.size());
+    _resize(best, (int)guess.size());
+    _resize(workspace._delta, (int)guess.size());
+    x = guess;
+
+    if(workspace._activeSet.numVars() != x.size())
+        ++_numAllocations;
+    _clamp(x, workspace._activeSet);
+    if(workspace._prevActiveSet.numVars() != x.size())
+        ++_numAllocations;
+
+    if(_strategy == ADAPTIVE_DAMPING)
+        _numIterations = _iterateAdaptive(workspace, evalData, bestError, haveBest);
+    else
+        _numIterations = _iterateFixed(workspace, evalData, bestError, haveBest);
+    FitMetrics::count(FitMetrics::SOLVER_ITERATIONS, _numIterations);
+    FitMetrics::count(FitMetrics::SOLVER_HALVINGS, _numHalvings);
+    if(_truncated)
+        FitMetrics::count(FitMetrics::DEADLINE_STOPS);
+
+    double error = _error(x, evalData);
+    if(_numIterations > 5)
+        CORNU_DEBUG(printf("After %d iterations, error = %lf", _numIterations, sqrt(error)));
+    if(error < bestError)
+    {
+        best = x;
+        haveBest = true;
+    }
 
-    set<LSBoxConstraint> activeSet = _clamp(x);
+    workspace._busy = false;
+    return haveBest ? best : VectorXd();
+}
+
+bool LSSolver::_pastDeadline()
+{
+    if(_cancel && _cancel->load(memory_order_relaxed))
+        return true; //not truncation: the caller throws the result away
+    if(_deadline == chrono::steady_clock::time_point::max() || chrono::steady_clock::now() <= _deadline)
+        return false;
+    _truncated = true;
+    return true;
+}
+
+int LSSolver::_iterateFixed(LSWorkspace &workspace, LSEvalData *&evalData, double &bestError, bool &haveBest)
+{
+    VectorXd &best = workspace._best;
+    VectorXd &x = workspace._x;
+    VectorXd &delta = workspace._delta;
+    LSActiveSet &activeSet = workspace._activeSet;
+    LSActiveSet &prevActiveSet = workspace._prevActiveSet;
+    double prevObjective = 0.;
 
-    VectorXd delta;
     int iter;
     for(iter = 0; iter < _maxIter; ++iter)
     {
         if(iter > _increaseDampingAfter)
             _damping *= _dampingIncreaseFactor;
-        _problem->eval(x, evalData);
+        _eval(x, evalData);
 
         double error = evalData->error();
         //printf("Iter = %d, error = %lf\n", iter, error);
@@ -55,12 +145,16 @@ VectorXd LSSolver::solve(const VectorXd &guess)
         {
             bestError = error;
             best = x;
+            haveBest = true;
 
             if(error < 1e-10)
                 break;
         }
 
-        set<LSBoxConstraint> prevActiveSet = activeSet;
+        if(_objectiveConverged(evalData, error, iter, prevObjective) || _pastDeadline())
+            break;
+
+        prevActiveSet = activeSet;
         evalData->solveForDelta(_damping, delta, activeSet);
 
         if(delta.squaredNorm() < 1e-14)
@@ -74,13 +168,14 @@ VectorXd LSSolver::solve(const VectorXd &guess)
         x += delta;
 
         int halvings = 0;
-        while(_problem->error(x, evalData) > error && delta.squaredNorm() > 1e-8)
+        while(_error(x, evalData) > error && delta.squaredNorm() > 1e-8)
         {
             //printf("Halving\n");
             delta *= 0.5;
             x -= delta;
             ++halvings;
         }
+        _numHalvings += halvings;
         if(halvings > 0) //halve again -- won't hurt and may actually help
         {
             delta *= 0.5;
@@ -88,21 +183,146 @@ VectorXd LSSolver::solve(const VectorXd &guess)
         }
     }
 
-    double error = _problem->error(x, evalData);
-    if(iter > 5)
-        Debugging::get()->printf("After %d iterations, error = %lf", iter, sqrt(error));
+    return iter;
+}
+
+//Levenberg-Marquardt with the damping update of Nielsen (1999): the gain ratio compares the actual decrease in
+//error to the one the linearization predicted.  Rejected steps increase the damping and are retried from the
+//same point, so no step halving is needed.
+int LSSolver::_iterateAdaptive(LSWorkspace &workspace, LSEvalData *&evalData, double &bestError, bool &haveBest)
+{
+    VectorXd &best = workspace._best;
+    VectorXd &x = workspace._x;
+    VectorXd &delta = workspace._delta;
+    VectorXd &trial = workspace._trial;
+    LSActiveSet &activeSet = workspace._activeSet;
+    LSActiveSet &prevActiveSet = workspace._prevActiveSet;
+    LSEvalData *trialData = workspace._evalData(_problem, _numAllocations, 1);
+    _resize(trial, (int)x.size());
+
+    double damping = _damping;
+    double dampingGrowth = 2.;
+    double prevObjective = 0.;
+
+    _eval(x, evalData);
+    double error = evalData->error();
+
+    int iter;
+    for(iter = 0; iter < _maxIter; ++iter)
+    {
+        if(error < bestError)
+        {
+            bestError = error;
+            best = x;
+            haveBest = true;
+        }
+        if(error < 1e-10 || _pastDeadline())
+            break;
+
+        prevActiveSet = activeSet;
+        evalData->solveForDelta(damping, delta, activeSet);
+
+        if(delta.squaredNorm() < 1e-14)
+            break;
+
+        if(_geodesicAcceleration)
+            _accelerate(workspace, evalData, damping, activeSet);
+
+        int newConstraint = _project(x, delta, prevActiveSet);
+        double predicted = evalData->predictedError(delta);
+
+        trial = x;
+        trial += delta;
+        _eval(trial, trialData);
+        double trialError = trialData->error();
+
+        double gain = predicted < error ? (error - trialError) / (error - predicted) : -1.;
+        if(gain > 0.) //accept
+        {
+            if(newConstraint != -1)
+                activeSet.insert(_constraints[newConstraint]);
+            x = trial;
+            swap(evalData, trialData);
+            error = trialError;
+
+            damping *= max(1. / 3., 1. - pow(2. * gain - 1., 3));
+            dampingGrowth = 2.;
+
+            if(_objectiveConverged(evalData, error, iter, prevObjective))
+            {
+                ++iter;
+                break;
+            }
+        }
+        else //reject
+        {
+            ++_numHalvings;
+            activeSet = prevActiveSet;
+            damping *= dampingGrowth;
+            dampingGrowth *= 2.;
+        }
+    }
+
     if(error < bestError)
     {
+        bestError = error;
         best = x;
+        haveBest = true;
     }
+    return iter;
+}
 
-    delete evalData;
-    return best;
+//Adds the geodesic acceleration term of Transtrum and Sethna (2012) to the step, unless it is too large compared to
+//the step itself, which means the linearization isn't to be trusted that far.
+void LSSolver::_accelerate(LSWorkspace &workspace, LSEvalData *evalData, double damping, const LSActiveSet &activeSet)
+{
+    const double h = 0.1; //finite difference step, as a fraction of delta
+    const double maxRatio = 0.75;
+    if(!evalData->canAccelerate())
+        return;
+
+    VectorXd &delta = workspace._delta;
+    VectorXd &trial = workspace._trial;
+    VectorXd &accel = workspace._accel;
+    LSEvalData *shiftedData = workspace._evalData(_problem, _numAllocations, 2);
+    _resize(trial, (int)delta.size());
+    _resize(accel, (int)delta.size());
+
+    trial = workspace._x;
+    trial += h * delta;
+    _eval(trial, shiftedData);
+    if(!evalData->solveForAcceleration(damping, *shiftedData, h, delta, activeSet, accel))
+        return;
+
+    if(2. * accel.norm() <= maxRatio * delta.norm())
+        delta += 0.5 * accel;
 }
 
-set<LSBoxConstraint> LSSolver::_clamp(VectorXd &x)
+bool LSSolver::_objectiveConverged(LSEvalData *evalData, double error, int iter, double &prevObjective) const
 {
-    set<LSBoxConstraint> out;
+    if(_objectiveTolerance <= 0.)
+        return false;
+
+    double objective = evalData->objective();
+    bool converged = iter > 0 && error <= _objectiveMaxError && fabs(objective - prevObjective) <= _objectiveTolerance * prevObjective;
+    prevObjective = objective;
+    return converged;
+}
+
+void LSSolver::_resize(VectorXd &v, int size)
+{
+    if(v.size() == size)
+        return;
+    ++_numAllocations;
+    //Eigen can't allocate through an Allocator, but the fit's metrics still count the bytes
+    FitMetrics::countDeallocation((long long)(v.size() * sizeof(double)));
+    v.resize(size);
+    FitMetrics::countAllocation((long long)(size * sizeof(double)));
+}
+
+void LSSolver::_clamp(VectorXd &x, LSActiveSet &out)
+{
+    out.reset((int)x.size());
     for(int i = 0; i < (int)_constraints.size(); ++i)
     {
         const LSBoxConstraint &c = _constraints[i];
@@ -113,10 +333,9 @@ set<LSBoxConstraint> LSSolver::_clamp(VectorXd &x)
             //cout << "Clamping constraint " << i << endl;
         }
     }
-    return out;
 }
 
-int LSSolver::_project(const VectorXd &from, VectorXd &delta, const set<LSBoxConstraint> &activeSet)
+int LSSolver::_project(const VectorXd &from, VectorXd &delta, const LSActiveSet &activeSet)
 {
     int closestConstraint = -1;
     double minScale = 1.;
@@ -128,7 +347,7 @@ int LSSolver::_project(const VectorXd &from, VectorXd &delta, const set<LSBoxCon
         if(c.sign == 0)
             delta[c.index] = 0; //just in case
 
-        if(activeSet.count(c))
+        if(activeSet.contains(c.index))
             continue; //already constrained
         
         double scale = (c.value - from[c.index]) / delta[c.index];
@@ -178,82 +397,84 @@ bool LSSolver::verifyDerivatives(const Eigen::VectorXd &pt, double eps) const
     double err = (numDer - exactDer).norm();
 
     //TODO: just print the error for now
-    Debugging::get()->printf("Derivative Error = %lf", err);
+    CORNU_DEBUG(printf("Derivative Error = %lf", err));
 #if 0
     for(int i = 0; i < numDer.cols(); ++i)
-        Debugging::get()->printf("Col %d err = %lf", i, (numDer.col(i) - exactDer.col(i)).norm());
+        CORNU_DEBUG(printf("Col %d err = %lf", i, (numDer.col(i) - exactDer.col(i)).norm()));
     for(int i = 0; i < numDer.rows(); ++i)
-        Debugging::get()->printf("Row %d err = %lf", i, (numDer.row(i) - exactDer.row(i)).norm());
+        CORNU_DEBUG(printf("Row %d err = %lf", i, (numDer.row(i) - exactDer.row(i)).norm()));
 #endif
     delete evalData;
 
     return true;
 }
 
-void LSDenseEvalData::solveForDelta(double damping, VectorXd &out, set<LSBoxConstraint> &constraints)
+void LSDenseEvalData::solveForDelta(double damping, VectorXd &out, LSActiveSet &constraints)
 {
     int vars = (int)_errDer.cols();
+    out.resize(vars);
     if(constraints.empty())
     {
-        LDLT<MatrixXd> ldlt(MatrixXd::Identity(vars, vars) * damping + _errDer.transpose() * _errDer);
-        out = ldlt.solve(-_errDer.transpose() * _err);
+        _normal.noalias() = _errDer.transpose() * _errDer;
+        _normal.diagonal().array() += damping;
+        _ldlt.compute(_normal);
+        _rhs.noalias() = _errDer.transpose() * _err;
+        _rhs = -_rhs;
+        out = _ldlt.solve(_rhs);
     }
     else
     {
-        VectorXd rhs = -_err;
-
-        vector<bool> constraintIndices(vars, false);
-        for(set<LSBoxConstraint>::const_iterator it = constraints.begin(); it != constraints.end(); ++it)
-            constraintIndices[it->index] = true;
+        _rhs = -_err;
 
-        if(vars > (int)constraints.size())
+        int freeVars = vars - constraints.size();
+        if(freeVars > 0)
         {
-            MatrixXd lhs(_errDer.rows(), vars - (int)constraints.size());
+            _lhs.resize(_errDer.rows(), freeVars);
             int offs = 0;
             for(int i = 0; i < vars; ++i)
             {
-                if(constraintIndices[i])
+                if(constraints.contains(i))
                 {
                     ++offs;
                     continue;
                 }
-                lhs.col(i - offs) = _errDer.col(i);
+                _lhs.col(i - offs) = _errDer.col(i);
             }
 
-            LDLT<MatrixXd> ldlt(MatrixXd::Identity(lhs.cols(), lhs.cols()) * damping + lhs.transpose() * lhs);
-            VectorXd x = ldlt.solve(lhs.transpose() * rhs);
-            
-            out.resize(_errDer.cols());
-            offs = 0;
+            _normal.noalias() = _lhs.transpose() * _lhs;
+            _normal.diagonal().array() += damping;
+            _ldlt.compute(_normal);
+            _residual.noalias() = _lhs.transpose() * _rhs;
+            _solution = _ldlt.solve(_residual);
 
+            offs = 0;
             for(int i = 0; i < vars; ++i)
             {
-                if(constraintIndices[i])
+                if(constraints.contains(i))
                 {
                     out[i] = 0.;
                     ++offs;
                     continue;
                 }
-                out[i] = x[i - offs];
+                out[i] = _solution[i - offs];
             }
         }
         else //as many variables as constraints
         {
-            out = VectorXd::Zero(_errDer.cols());
+            out.setZero();
         }
 
         //check which constraints we don't need
-        VectorXd gradient = _errDer.transpose() * (_errDer * out - rhs);
-        for(set<LSBoxConstraint>::iterator it = constraints.begin(); it != constraints.end(); )
+        _residual.noalias() = _errDer * out;
+        _residual -= _rhs;
+        _gradient.noalias() = _errDer.transpose() * _residual;
+        for(int i = 0; i < vars; ++i)
         {
-            set<LSBoxConstraint>::iterator next = it;
-            ++next;
-            if(gradient[it->index] * it->sign < 0) //if sign is zero, constraint will not get erased
+            if(constraints.contains(i) && _gradient[i] * constraints.sign(i) < 0) //if sign is zero, constraint will not get erased
             {
-                //cout << "Unsetting constraint on variable at index " << it->index << endl;
-                constraints.erase(it);
+                //cout << "Unsetting constraint on variable at index " << i << endl;
+                constraints.erase(i);
             }
-            it = next;
         }
     }
 }
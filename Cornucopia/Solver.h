@@ -23,8 +23,11 @@
 
 #include "defs.h"
 #include <vector>
-#include <set>
+#include <atomic>
+#include <chrono>
+#include <typeinfo>
 #include <Eigen/Core>
+#include <Eigen/Cholesky>
 
 NAMESPACE_Cornu
 
@@ -38,13 +41,45 @@ struct LSBoxConstraint
     int sign; //variable greater than value if sign is positive, less than value if negative, equal if zero
 };
 
+//The active box constraints, stored as flags indexed by variable so that lookups and copies don't allocate.
+//At most one constraint per variable can be active.
+class LSActiveSet
+{
+public:
+    LSActiveSet() : _size(0) {}
+
+    void reset(int numVars) { _active.assign(numVars, false); _sign.resize(numVars); _size = 0; }
+    int numVars() const { return (int)_active.size(); }
+    int size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    bool contains(int var) const { return _active[var]; }
+    int sign(int var) const { return _sign[var]; } //of the active constraint on var
+    void insert(const LSBoxConstraint &c) { if(!_active[c.index]) { _active[c.index] = true; _sign[c.index] = (signed char)c.sign; ++_size; } }
+    void erase(int var) { if(_active[var]) { _active[var] = false; --_size; } }
+
+private:
+    std::vector<bool> _active;
+    std::vector<signed char> _sign;
+    int _size;
+};
+
 class LSEvalData
 {
 public:
     virtual ~LSEvalData() {}
 
     virtual double error() const = 0;
-    virtual void solveForDelta(double damping, Eigen::VectorXd &out, std::set<LSBoxConstraint> &constraints) = 0;
+    virtual double objective() const { return error(); } //differs from error() if error() measures constraint violation
+    virtual void solveForDelta(double damping, Eigen::VectorXd &out, LSActiveSet &constraints) = 0;
+
+    //the error that the linearization predicts after the step delta
+    virtual double predictedError(const Eigen::VectorXd &/*delta*/) const { return 0.; }
+    //Geodesic acceleration: the second order correction to the step delta, given the data evaluated at x + h * delta.
+    //Returns false if it can't be computed.
+    virtual bool canAccelerate() const { return false; }
+    virtual bool solveForAcceleration(double /*damping*/, const LSEvalData &/*shifted*/, double /*h*/, const Eigen::VectorXd &/*delta*/,
+                                      const LSActiveSet &/*constraints*/, Eigen::VectorXd &/*out*/) { return false; }
 
     //debugging functions for derivative check
     virtual Eigen::VectorXd errVec() const { return Eigen::VectorXd(); }
@@ -61,22 +96,79 @@ public:
     virtual void eval(const Eigen::VectorXd &x, LSEvalData *data) = 0;
 };
 
+//Storage that LSSolver keeps between solves: the eval data (one per problem type) and the iterates.  When
+//repeated solves have the same size, they don't allocate.  A workspace must only be used by one thread at a time.
+class LSWorkspace
+{
+public:
+    LSWorkspace() : _busy(false) {}
+    ~LSWorkspace();
+
+    static LSWorkspace &forThread(); //a workspace for the calling thread
+
+private:
+    friend class LSSolver;
+    LSEvalData *_evalData(LSProblem *problem, int &numAllocations, int slot = 0); //a solve may need several
+
+    struct _EvalDataEntry
+    {
+        const std::type_info *problemType;
+        int slot;
+        LSEvalData *evalData;
+    };
+
+    std::vector<_EvalDataEntry> _evalDatas;
+    Eigen::VectorXd _x, _best, _delta, _trial, _accel;
+    LSActiveSet _activeSet, _prevActiveSet;
+    bool _busy; //if a solve is using this workspace
+};
+
 class LSSolver
 {
 public:
+    enum Strategy
+    {
+        FIXED_DAMPING, //damping follows the schedule set below and steps are halved until the error doesn't increase
+        ADAPTIVE_DAMPING //Levenberg-Marquardt: damping adapts to how well the linearization predicted each step
+    };
+
     LSSolver(LSProblem *problem, const std::vector<LSBoxConstraint> &constraints);
 
     Eigen::VectorXd solve(const Eigen::VectorXd &guess);
+    //with a workspace, solves reuse its storage instead of allocating their own
+    void setWorkspace(LSWorkspace *workspace) { _workspace = workspace; }
+    //how many times the last solve allocated eval data or solver storage
+    int numAllocations() const { return _numAllocations; }
+    int numIterations() const { return _numIterations; } //taken by the last solve
+    int numHalvings() const { return _numHalvings; } //step halvings (rejected steps with adaptive damping) in the last solve
+    int numEvaluations() const { return _numEvaluations; } //of the problem, by the last solve
     void setDefaultDamping(double damping) { _damping = damping; }
     void setMaxIter(int maxIter) { _maxIter = maxIter; }
     void setIncreaseDampingAfter(int iter) { _increaseDampingAfter = iter; }
     void setDampingIncreaseFactor(double factor) { _dampingIncreaseFactor = factor; }
+    void setStrategy(Strategy strategy) { _strategy = strategy; }
+    void setGeodesicAcceleration(bool accelerate) { _geodesicAcceleration = accelerate; } //only with adaptive damping
+    //stop once the error is at most maxError and an iteration changes the objective by at most relTol of it
+    void setObjectiveTolerance(double relTol, double maxError) { _objectiveTolerance = relTol; _objectiveMaxError = maxError; }
+    //once the deadline has passed, or the flag (not owned, may be null) is set, the solve stops and returns the best point so far
+    void setDeadline(std::chrono::steady_clock::time_point deadline) { _deadline = deadline; }
+    void setCancelFlag(const std::atomic<bool> *cancel) { _cancel = cancel; }
+    bool truncated() const { return _truncated; } //if the last solve stopped at the deadline
 
     bool verifyDerivatives(const Eigen::VectorXd &pt, double eps = 1e-6) const;
 
 private:
-    int _project(const Eigen::VectorXd &from, Eigen::VectorXd &x, const std::set<LSBoxConstraint> &activeSet); //returns the index of the constraint
-    std::set<LSBoxConstraint> _clamp(Eigen::VectorXd &x);
+    int _iterateFixed(LSWorkspace &workspace, LSEvalData *&evalData, double &bestError, bool &haveBest);
+    int _iterateAdaptive(LSWorkspace &workspace, LSEvalData *&evalData, double &bestError, bool &haveBest);
+    void _accelerate(LSWorkspace &workspace, LSEvalData *evalData, double damping, const LSActiveSet &activeSet);
+    void _eval(const Eigen::VectorXd &x, LSEvalData *evalData) { ++_numEvaluations; _problem->eval(x, evalData); }
+    double _error(const Eigen::VectorXd &x, LSEvalData *evalData) { ++_numEvaluations; return _problem->error(x, evalData); }
+    bool _objectiveConverged(LSEvalData *evalData, double error, int iter, double &prevObjective) const;
+    bool _pastDeadline();
+
+    int _project(const Eigen::VectorXd &from, Eigen::VectorXd &x, const LSActiveSet &activeSet); //returns the index of the constraint
+    void _clamp(Eigen::VectorXd &x, LSActiveSet &out);
+    void _resize(Eigen::VectorXd &v, int size);
 
     LSProblem *_problem;
     std::vector<LSBoxConstraint> _constraints;
@@ -84,6 +176,18 @@ private:
     int _maxIter;
     int _increaseDampingAfter;
     double _dampingIncreaseFactor;
+    double _objectiveTolerance;
+    double _objectiveMaxError;
+    Strategy _strategy;
+    bool _geodesicAcceleration;
+    std::chrono::steady_clock::time_point _deadline;
+    const std::atomic<bool> *_cancel;
+    bool _truncated;
+    LSWorkspace *_workspace;
+    int _numAllocations;
+    int _numIterations;
+    int _numHalvings;
+    int _numEvaluations;
 };
 
 class LSDenseEvalData : public LSEvalData
@@ -91,7 +195,8 @@ class LSDenseEvalData : public LSEvalData
 public:
     //overrides
     double error() const { return _err.squaredNorm(); }
-    void solveForDelta(double damping, Eigen::VectorXd &out, std::set<LSBoxConstraint> &constraints);
+    void solveForDelta(double damping, Eigen::VectorXd &out, LSActiveSet &constraints);
+    double predictedError(const Eigen::VectorXd &delta) const { return (_err + _errDer * delta).squaredNorm(); }
     Eigen::VectorXd errVec() const { return _err; }
     Eigen::MatrixXd errVecDer() const { return _errDer; }
 
@@ -100,6 +205,126 @@ public:
 private:
     Eigen::VectorXd _err;
     Eigen::MatrixXd _errDer;
+
+    //solve storage, kept so that solving again at the same size doesn't allocate
+    Eigen::MatrixXd _lhs, _normal;
+    Eigen::VectorXd _rhs, _solution, _residual, _gradient;
+    Eigen::LDLT<Eigen::MatrixXd> _ldlt;
+};
+
+//Dense eval data for problems with at most MaxVars variables.  The normal equations are formed on the stack and
+//factored at their exact (compile-time) size, so Eigen can unroll the factorization.  Only the Jacobian, whose
+//height depends on the number of points, is dynamically allocated.
+template<int MaxVars>
+class LSSmallDenseEvalData : public LSEvalData
+{
+public:
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, MaxVars, MaxVars> NormalMatrix;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MaxVars, 1> SmallVector;
+
+    //overrides
+    double error() const { return _err.squaredNorm(); }
+    void solveForDelta(double damping, Eigen::VectorXd &out, LSActiveSet &constraints)
+    {
+        int vars = (int)_errDer.cols();
+        eigen_assert(vars <= MaxVars);
+
+        NormalMatrix normal(vars, vars);
+        normal.noalias() = _errDer.transpose() * _errDer;
+        SmallVector errGradient(vars);
+        errGradient.noalias() = _errDer.transpose() * _err;
+        _solveFree(normal, errGradient, damping, constraints, out);
+
+        //check which constraints we don't need
+        if(!constraints.empty())
+        {
+            SmallVector gradient(vars);
+            gradient.noalias() = normal * out;
+            gradient += errGradient;
+            for(int i = 0; i < vars; ++i)
+                if(constraints.contains(i) && gradient[i] * constraints.sign(i) < 0) //if sign is zero, constraint will not get erased
+                    constraints.erase(i);
+        }
+    }
+    double predictedError(const Eigen::VectorXd &delta) const
+    {
+        _residual.noalias() = _errDer * delta;
+        _residual += _err;
+        return _residual.squaredNorm();
+    }
+    bool canAccelerate() const { return true; }
+    bool solveForAcceleration(double damping, const LSEvalData &shiftedData, double h, const Eigen::VectorXd &delta,
+                              const LSActiveSet &constraints, Eigen::VectorXd &out)
+    {
+        const LSSmallDenseEvalData &shifted = static_cast<const LSSmallDenseEvalData &>(shiftedData);
+        if(shifted._err.size() != _err.size())
+            return false;
+
+        //finite difference second directional derivative of the error vector
+        _residual = (shifted._err - _err) / h;
+        _residual.noalias() -= _errDer * delta;
+        _residual *= 2. / h;
+
+        int vars = (int)_errDer.cols();
+        NormalMatrix normal(vars, vars);
+        normal.noalias() = _errDer.transpose() * _errDer;
+        SmallVector gradient(vars);
+        gradient.noalias() = _errDer.transpose() * _residual;
+        _solveFree(normal, gradient, damping, constraints, out);
+        return true;
+    }
+    Eigen::VectorXd errVec() const { return _err; }
+    Eigen::MatrixXd errVecDer() const { return _errDer; }
+
+    Eigen::VectorXd &errVectorRef() { return _err; }
+    Eigen::MatrixXd &errDerRef() { return _errDer; }
+private:
+    //solves (normal + damping * I) out = -gradient for the unconstrained variables; constrained ones don't move
+    static void _solveFree(const NormalMatrix &normal, const SmallVector &gradient, double damping,
+                           const LSActiveSet &constraints, Eigen::VectorXd &out)
+    {
+        int vars = (int)normal.rows();
+        int freeVars[MaxVars];
+        int numFree = 0;
+        for(int i = 0; i < vars; ++i)
+            if(!constraints.contains(i))
+                freeVars[numFree++] = i;
+
+        out.setZero(vars);
+        if(numFree == 0)
+            return;
+
+        NormalMatrix lhs(numFree, numFree);
+        SmallVector rhs(numFree), x(numFree);
+        for(int i = 0; i < numFree; ++i)
+        {
+            for(int j = 0; j < numFree; ++j)
+                lhs(i, j) = normal(freeVars[i], freeVars[j]);
+            lhs(i, i) += damping;
+            rhs[i] = -gradient[freeVars[i]];
+        }
+
+        _solve<1>(lhs, rhs, x);
+        for(int i = 0; i < numFree; ++i)
+            out[freeVars[i]] = x[i];
+    }
+
+    //dispatches to the fixed-size factorization of the system's actual size
+    template<int N>
+    static void _solve(const NormalMatrix &lhs, const SmallVector &rhs, SmallVector &x)
+    {
+        if(N == MaxVars || lhs.rows() == N)
+        {
+            Eigen::LDLT<Eigen::Matrix<double, N, N> > ldlt(lhs.template topLeftCorner<N, N>());
+            x = ldlt.solve(rhs.template head<N>());
+        }
+        else
+            _solve<(N < MaxVars ? N + 1 : N)>(lhs, rhs, x);
+    }
+
+    Eigen::VectorXd _err;
+    Eigen::MatrixXd _errDer;
+    mutable Eigen::VectorXd _residual; //scratch
 };
 
 
@@ -0,0 +1,70 @@
+/*--
+    StaticFitter.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_STATICFITTER_H_INCLUDED
+#define CORNUCOPIA_STATICFITTER_H_INCLUDED
+
+#include "defs.h"
+#include "Fitter.h"
+
+NAMESPACE_Cornu
+
+/*
+    A fitter whose algorithms are fixed when it is compiled: the template arguments are the algorithm indices for
+    the stages in order (as in Parameters::setAlgorithm), and stages past the last argument use algorithm 0.
+    Parameters are set as for Fitter, but their algorithm choices are ignored, so an application that ships one
+    configuration can't end up running another.  Outputs are returned by reference to the stage's concrete type.
+
+    The algorithms are defined in their stages' source files and reach the earlier outputs through Fitter, so they
+    are still called through AlgorithmBase and their outputs are still allocated (and recycled) as for Fitter.
+*/
+template<int... Algorithms>
+class StaticFitter : public Fitter
+{
+public:
+    StaticFitter() { setParams(Parameters()); }
+
+    void setParams(const Parameters &params)
+    {
+        static_assert(sizeof...(Algorithms) <= NUM_ALGORITHM_STAGES, "More algorithms than stages");
+        const int algorithms[] = { Algorithms..., 0 }; //not empty even with no arguments
+
+        Parameters fixed = params;
+        for(int stage = 0; stage < NUM_ALGORITHM_STAGES; ++stage)
+        {
+            int algorithm = stage < (int)sizeof...(Algorithms) ? algorithms[stage] : 0;
+            assert(algorithm < AlgorithmBase::numAlgorithmsForStage((AlgorithmStage)stage));
+            fixed.setAlgorithm(stage, algorithm);
+        }
+        Fitter::setParams(fixed);
+    }
+
+    //only valid after run() has produced the stage's output
+    template<int AlgStage>
+    const AlgorithmOutput<AlgStage> &stageOutput() const { return *Fitter::output<AlgStage>(); }
+
+private:
+    //would bypass the fixed algorithms
+    bool loadSnapshot(std::istream &in);
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_STATICFITTER_H_INCLUDED
@@ -0,0 +1,91 @@
+/*--
+    StreamingSimplifier.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StreamingSimplifier.h"
+#include "AngleUtils.h"
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+int StreamingSimplifier::addPoint(const Vector2d &pt)
+{
+    int idx = _numPts++;
+    if(idx == 0)
+    {
+        _startAt(pt);
+        return 0;
+    }
+
+    int kept = -1;
+    if(!_extend(pt))
+    {
+        //the previous point is the farthest a segment from the apex can reach, so it is kept and the cone restarts there
+        kept = idx - 1;
+        _startAt(_prev);
+        _extend(pt); //always succeeds, since the previous point is the apex
+    }
+    _prev = pt;
+    return kept;
+}
+
+void StreamingSimplifier::_startAt(const Vector2d &apex)
+{
+    _apex = _prev = apex;
+    _hasCone = false;
+    _baseAngle = _lo = _hi = 0.;
+    _maxDist = 0.;
+}
+
+bool StreamingSimplifier::_extend(const Vector2d &pt)
+{
+    Vector2d toPt = pt - _apex;
+    double dist = toPt.norm();
+
+    //The points are kept within 0.8 * cutoff of the segment's line and at most 0.6 * cutoff past its end, which
+    //together put them within the cutoff of the segment.  A point that doubles back toward the apex would leave
+    //the points past it too far.
+    if(dist < _maxDist - 0.6 * _cutoff)
+        return false;
+    _maxDist = max(_maxDist, dist);
+
+    double angle = atan2(toPt[1], toPt[0]);
+    if(!_hasCone)
+    {
+        if(dist <= _cutoff) //all the points so far are near every segment from the apex
+            return true;
+        _hasCone = true;
+        _baseAngle = angle;
+        _lo = -HALFPI;
+        _hi = HALFPI;
+    }
+
+    //the segment to this point must be in the cone to pass near all the points so far, and then the cone is
+    //narrowed to the rays that pass near this point
+    double relAngle = AngleUtils::toRange(angle - _baseAngle, -PI);
+    if(relAngle < _lo || relAngle > _hi)
+        return false;
+    double halfWidth = dist > 0.8 * _cutoff ? asin(0.8 * _cutoff / dist) : HALFPI;
+    _lo = max(_lo, relAngle - halfWidth);
+    _hi = min(_hi, relAngle + halfWidth);
+    return true;
+}
+
+END_NAMESPACE_Cornu
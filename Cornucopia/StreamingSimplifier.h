@@ -0,0 +1,65 @@
+/*--
+    StreamingSimplifier.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_STREAMINGSIMPLIFIER_H_INCLUDED
+#define CORNUCOPIA_STREAMINGSIMPLIFIER_H_INCLUDED
+
+#include "defs.h"
+#include <Eigen/Core>
+
+NAMESPACE_Cornu
+
+/*
+    Picks points to keep from a polyline as its points arrive, like Douglas-Peucker does for a whole polyline: the
+    kept points form a polyline that passes within the cutoff of every dropped point.  It is a sleeve-fitting
+    variant of the Reumann-Witkam strip: from the last kept point, it tracks the cone of directions whose rays pass
+    within the cutoff of every point since.  When a point falls outside the cone (or doubles back), the point
+    before it is kept and becomes the new apex, so corners are kept.  The lookahead is one point, the work is
+    constant per point, and there is no recursion.
+*/
+class StreamingSimplifier
+{
+public:
+    StreamingSimplifier(double cutoff) : _cutoff(cutoff), _numPts(0) {}
+
+    //Adds the next point.  Returns the index (in the order added) of the point that it caused to be kept, or -1.
+    //The first point is always kept, and when the polyline ends, so should the last one be.
+    int addPoint(const Eigen::Vector2d &pt);
+
+    int numPoints() const { return _numPts; }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+private:
+    void _startAt(const Eigen::Vector2d &apex);
+    bool _extend(const Eigen::Vector2d &pt); //returns false if the point can't be reached from the apex
+
+    double _cutoff;
+    int _numPts;
+
+    Eigen::Vector2d _apex, _prev;
+    bool _hasCone; //false while all the points since the apex are within the cutoff of it
+    double _baseAngle; //the cone is from _baseAngle + _lo to _baseAngle + _hi
+    double _lo, _hi;
+    double _maxDist; //of the points since the apex from it
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_STREAMINGSIMPLIFIER_H_INCLUDED
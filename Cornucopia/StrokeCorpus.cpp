@@ -0,0 +1,217 @@
+/*--
+    StrokeCorpus.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StrokeCorpus.h"
+#include "Polyline.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+static const char corpusTag[8] = { 'C', 'o', 'r', 'n', 'u', 'S', 't', 'k' };
+static const unsigned int corpusVersion = 1;
+static const unsigned int byteOrderMark = 0x01020304;
+static const int headerSize = 32;
+static const int indexEntrySize = 16;
+
+template<typename T>
+static T readAt(const char *data, size_t offset)
+{
+    T out;
+    memcpy(&out, data + offset, sizeof(T));
+    return out;
+}
+
+PolylinePtr StrokeSpan::toPolyline() const
+{
+    if(size < 2)
+        return PolylinePtr();
+    VectorC<Vector2d> copy(size, closed ? CIRCULAR : NOT_CIRCULAR);
+    std::copy(pts, pts + size, copy.begin());
+    return new Polyline(std::move(copy));
+}
+
+StrokeCorpus::StrokeCorpus() : _data(NULL), _fileSize(0), _numStrokes(0), _index(NULL)
+#ifdef _WIN32
+    , _file(INVALID_HANDLE_VALUE), _mapping(NULL)
+#endif
+{
+}
+
+bool StrokeCorpus::open(const string &fileName)
+{
+    close();
+    _error.clear();
+
+#ifdef _WIN32
+    _file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(_file == INVALID_HANDLE_VALUE)
+        return _fail("could not open the file");
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(_file, &size) || size.QuadPart < headerSize)
+        return _fail("not a stroke corpus");
+    _fileSize = (size_t)size.QuadPart;
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(_mapping != NULL)
+        _data = (const char *)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if(_data == NULL)
+        return _fail("could not map the file");
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+        return _fail("could not open the file");
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size < headerSize)
+    {
+        ::close(fd);
+        return _fail("not a stroke corpus");
+    }
+    _fileSize = (size_t)info.st_size;
+    void *data = mmap(NULL, _fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); //the mapping stays valid
+    if(data == MAP_FAILED)
+        return _fail("could not map the file");
+    _data = (const char *)data;
+#endif
+
+    if(memcmp(_data, corpusTag, sizeof(corpusTag)) != 0)
+        return _fail("not a stroke corpus");
+    if(readAt<unsigned int>(_data, 8) != corpusVersion)
+        return _fail("unsupported stroke corpus version");
+    if(readAt<unsigned int>(_data, 12) != byteOrderMark)
+        return _fail("stroke corpus was written with a different byte order");
+
+    unsigned long long numStrokes = readAt<unsigned long long>(_data, 16);
+    unsigned long long indexOffset = readAt<unsigned long long>(_data, 24);
+    if(numStrokes > (unsigned long long)numeric_limits<int>::max() || indexOffset < headerSize || indexOffset > _fileSize ||
+       numStrokes > (_fileSize - indexOffset) / indexEntrySize)
+        return _fail("stroke corpus index is damaged");
+    _numStrokes = (int)numStrokes;
+    _index = _data + indexOffset;
+
+    //Checking that every stroke is inside the file makes stroke() safe without touching the points themselves
+    for(int i = 0; i < _numStrokes; ++i)
+    {
+        unsigned long long offset = readAt<unsigned long long>(_index, i * indexEntrySize);
+        unsigned long long numPts = readAt<unsigned int>(_index, i * indexEntrySize + 8);
+        if(offset < headerSize || offset % 16 != 0 || offset > indexOffset || numPts > (indexOffset - offset) / sizeof(Vector2d))
+            return _fail("stroke corpus index is damaged");
+    }
+    return true;
+}
+
+void StrokeCorpus::close()
+{
+#ifdef _WIN32
+    if(_data != NULL)
+        UnmapViewOfFile(_data);
+    if(_mapping != NULL)
+        CloseHandle(_mapping);
+    if(_file != INVALID_HANDLE_VALUE)
+        CloseHandle(_file);
+    _mapping = NULL;
+    _file = INVALID_HANDLE_VALUE;
+#else
+    if(_data != NULL)
+        munmap((void *)_data, _fileSize);
+#endif
+    _data = NULL;
+    _index = NULL;
+    _fileSize = 0;
+    _numStrokes = 0;
+}
+
+StrokeSpan StrokeCorpus::stroke(int idx) const
+{
+    assert(idx >= 0 && idx < _numStrokes);
+    StrokeSpan out;
+    out.pts = (const Vector2d *)(_data + readAt<unsigned long long>(_index, idx * indexEntrySize));
+    out.size = (int)readAt<unsigned int>(_index, idx * indexEntrySize + 8);
+    out.closed = (readAt<unsigned int>(_index, idx * indexEntrySize + 12) & 1) != 0;
+    return out;
+}
+
+bool StrokeCorpusWriter::open(const string &fileName)
+{
+    close();
+    _entries.clear();
+    _out.open(fileName.c_str(), ios::binary | ios::trunc);
+    char header[headerSize] = { 0 }; //filled in by close()
+    _out.write(header, headerSize);
+    _ok = _out.good();
+    return _ok;
+}
+
+void StrokeCorpusWriter::add(const VectorC<Vector2d> &pts)
+{
+    if(!_ok)
+        return;
+    Entry entry = { (unsigned long long)_out.tellp(), (unsigned int)pts.size(), pts.circular() ? 1u : 0u };
+    if(!pts.empty())
+        _out.write((const char *)&pts.flatAt(0), pts.size() * sizeof(Vector2d)); //the header keeps this 16-byte aligned
+    _entries.push_back(entry);
+    _ok = _out.good();
+}
+
+bool StrokeCorpusWriter::close()
+{
+    if(!_out.is_open())
+        return _ok;
+
+    if(_ok)
+    {
+        unsigned long long indexOffset = (unsigned long long)_out.tellp();
+        for(int i = 0; i < (int)_entries.size(); ++i)
+        {
+            _out.write((const char *)&_entries[i].offset, 8);
+            _out.write((const char *)&_entries[i].numPts, 4);
+            _out.write((const char *)&_entries[i].flags, 4);
+        }
+
+        unsigned long long numStrokes = _entries.size();
+        _out.seekp(0);
+        _out.write(corpusTag, sizeof(corpusTag));
+        _out.write((const char *)&corpusVersion, 4);
+        _out.write((const char *)&byteOrderMark, 4);
+        _out.write((const char *)&numStrokes, 8);
+        _out.write((const char *)&indexOffset, 8);
+    }
+
+    _out.close();
+    _ok = _ok && !_out.fail();
+    _entries.clear();
+    return _ok;
+}
+
+END_NAMESPACE_Cornu
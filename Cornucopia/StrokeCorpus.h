@@ -0,0 +1,118 @@
+/*--
+    StrokeCorpus.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_STROKECORPUS_H_INCLUDED
+#define CORNUCOPIA_STROKECORPUS_H_INCLUDED
+
+#include "defs.h"
+#include "smart_ptr.h"
+#include "VectorC.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+NAMESPACE_Cornu
+
+CORNU_SMART_FORW_DECL(Polyline);
+
+/*
+    A stroke corpus file holds many strokes for bulk fitting in a form that needs no parsing:
+        header:  "CornuStk", uint32 version, uint32 byte order mark (0x01020304), uint64 number of strokes,
+                 uint64 offset of the index
+        points:  for each stroke, its points as x, y doubles, starting at a multiple of 16 bytes
+        index:   for each stroke, uint64 offset of its points, uint32 number of points, uint32 flags (1 = closed)
+    Numbers are in the native byte order; the byte order mark rejects files from machines with the other order.
+    StrokeCorpus maps the file into memory and hands out the strokes by index without copying them.
+*/
+
+//A stroke in a mapped corpus, valid while the corpus is open
+struct StrokeSpan
+{
+    StrokeSpan() : pts(NULL), size(0), closed(false) {}
+
+    const Eigen::Vector2d *pts;
+    int size;
+    bool closed;
+
+    //A polyline for Fitter::setOriginalSketch.  The fitter owns its sketch, so this is one bulk copy of the points.
+    PolylinePtr toPolyline() const;
+};
+
+class StrokeCorpus
+{
+public:
+    StrokeCorpus();
+    ~StrokeCorpus() { close(); }
+
+    //Maps the file and checks the header and the index.  On failure, returns false and error() says why.
+    bool open(const std::string &fileName);
+    void close();
+
+    bool isOpen() const { return _data != NULL; }
+    const std::string &error() const { return _error; }
+
+    int size() const { return _numStrokes; }
+    StrokeSpan stroke(int idx) const;
+
+private:
+    StrokeCorpus(const StrokeCorpus &); //not copyable
+    StrokeCorpus &operator=(const StrokeCorpus &);
+
+    bool _fail(const std::string &error) { close(); _error = error; return false; }
+
+    const char *_data;
+    size_t _fileSize;
+    int _numStrokes;
+    const char *_index;
+    std::string _error;
+#ifdef _WIN32
+    void *_file;
+    void *_mapping;
+#endif
+};
+
+//Writes strokes one at a time, so the corpus never has to be in memory.  The index is written by close().
+class StrokeCorpusWriter
+{
+public:
+    StrokeCorpusWriter() : _ok(false) {}
+    ~StrokeCorpusWriter() { close(); }
+
+    bool open(const std::string &fileName);
+    void add(const VectorC<Eigen::Vector2d> &pts);
+    bool close(); //returns false if anything failed to be written
+
+private:
+    struct Entry
+    {
+        unsigned long long offset;
+        unsigned int numPts;
+        unsigned int flags;
+    };
+
+    std::ofstream _out;
+    std::vector<Entry> _entries;
+    bool _ok;
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_STROKECORPUS_H_INCLUDED
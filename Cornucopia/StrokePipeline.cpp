@@ -0,0 +1,116 @@
+/*--
+    StrokePipeline.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StrokePipeline.h"
+#include "Fitter.h"
+#include "Polyline.h"
+#include "PrimitiveSequence.h"
+
+#include <climits>
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+//The last stage of each group.  On short strokes, the stages up to resampling, the error computer and primitive
+//fitting, and the rest each take about a third of the time.
+static const AlgorithmStage groupLastStage[StrokePipeline::numGroups] = { RESAMPLING, PRIMITIVE_FITTING, COMBINING };
+
+StrokePipeline::StrokePipeline(const Parameters &params, int queueCapacity)
+    : _params(params)
+{
+    for(int i = 0; i <= numGroups; ++i)
+        _queues.push_back(unique_ptr<_Queue>(new _Queue(i < numGroups ? max(1, queueCapacity) : INT_MAX)));
+    for(int i = 0; i < numGroups; ++i)
+        _threads.push_back(thread(&StrokePipeline::_work, this, i));
+}
+
+StrokePipeline::~StrokePipeline()
+{
+    finish();
+    for(int i = 0; i < numGroups; ++i)
+        _threads[i].join();
+}
+
+void StrokePipeline::push(const VectorC<Vector2d> &pts)
+{
+    unique_ptr<Fitter> fitter(new Fitter());
+    fitter->setParams(_params);
+    fitter->setDebugging(Debugging::silent()); //the global debugging object is not in general thread-safe
+    fitter->setLean(true);
+    fitter->setOriginalSketch(new Polyline(pts));
+    _queues[0]->push(std::move(fitter));
+}
+
+void StrokePipeline::finish()
+{
+    _queues[0]->close();
+}
+
+bool StrokePipeline::pop(PrimitiveSequenceConstPtr &outCurve)
+{
+    unique_ptr<Fitter> fitter;
+    if(!_queues[numGroups]->pop(fitter))
+        return false;
+    outCurve = fitter->finalOutput();
+    return true;
+}
+
+void StrokePipeline::_work(int group)
+{
+    unique_ptr<Fitter> fitter;
+    while(_queues[group]->pop(fitter))
+    {
+        fitter->run(groupLastStage[group]);
+        _queues[group + 1]->push(std::move(fitter));
+    }
+    _queues[group + 1]->close();
+}
+
+void StrokePipeline::_Queue::push(unique_ptr<Fitter> fitter)
+{
+    unique_lock<mutex> lock(_mutex);
+    while((int)_fitters.size() >= _capacity)
+        _changed.wait(lock);
+    _fitters.push_back(std::move(fitter));
+    _changed.notify_all();
+}
+
+bool StrokePipeline::_Queue::pop(unique_ptr<Fitter> &out)
+{
+    unique_lock<mutex> lock(_mutex);
+    while(_fitters.empty() && !_closed)
+        _changed.wait(lock);
+    if(_fitters.empty())
+        return false;
+    out = std::move(_fitters.front());
+    _fitters.pop_front();
+    _changed.notify_all();
+    return true;
+}
+
+void StrokePipeline::_Queue::close()
+{
+    lock_guard<mutex> lock(_mutex);
+    _closed = true;
+    _changed.notify_all();
+}
+
+END_NAMESPACE_Cornu
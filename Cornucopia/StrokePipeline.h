@@ -0,0 +1,97 @@
+/*--
+    StrokePipeline.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_STROKEPIPELINE_H_INCLUDED
+#define CORNUCOPIA_STROKEPIPELINE_H_INCLUDED
+
+#include "defs.h"
+#include "Parameters.h"
+#include "smart_ptr.h"
+#include "VectorC.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+NAMESPACE_Cornu
+
+CORNU_SMART_FORW_DECL(PrimitiveSequence);
+class Fitter;
+
+/*
+    Fits a stream of strokes, e.g., the replay of a handwriting session, like an assembly line: the stages are split
+    into groups, each run by its own thread, so while one stroke is in path finding, the next can be in primitive
+    fitting and the one after in resampling.  That gets parallelism out of streams of small strokes, for which the
+    parallel loops inside the stages don't pay off.  The queues between the groups are bounded, so push() blocks
+    while the first group is behind, and results come out in the order the strokes went in.  Each stroke gets its
+    own fitter, which moves from thread to thread with it, and fits produce no debugging output.
+*/
+class StrokePipeline
+{
+public:
+    //queueCapacity is the number of strokes that can wait in front of each group
+    explicit StrokePipeline(const Parameters &params, int queueCapacity = 2);
+    ~StrokePipeline(); //finishes the strokes already pushed, whose results are dropped if not popped
+
+    //The points are taken rather than a polyline because smart pointer reference counts aren't safe to share
+    //between threads.  Blocks while the first group's queue is full.
+    void push(const VectorC<Eigen::Vector2d> &pts);
+    void finish(); //no more strokes will be pushed
+
+    //Waits for the result of the next stroke in push order and returns true, or returns false if finish() was called
+    //and all results were popped.  The curve is null if fitting failed.
+    bool pop(PrimitiveSequenceConstPtr &outCurve);
+
+    static const int numGroups = 3;
+
+private:
+    StrokePipeline(const StrokePipeline &);
+    StrokePipeline &operator=(const StrokePipeline &);
+
+    class _Queue
+    {
+    public:
+        _Queue(int capacity) : _capacity(capacity), _closed(false) {}
+
+        void push(std::unique_ptr<Fitter> fitter); //waits for room
+        bool pop(std::unique_ptr<Fitter> &out); //waits for a fitter; false once closed and empty
+        void close();
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _changed;
+        std::deque<std::unique_ptr<Fitter> > _fitters;
+        int _capacity;
+        bool _closed;
+    };
+
+    void _work(int group);
+
+    Parameters _params;
+    std::vector<std::unique_ptr<_Queue> > _queues; //in front of each group, and the last one holds the results
+    std::vector<std::thread> _threads;
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_STROKEPIPELINE_H_INCLUDED
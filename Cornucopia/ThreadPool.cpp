@@ -0,0 +1,162 @@
+/*--
+    ThreadPool.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace Eigen;
+NAMESPACE_Cornu
+
+//which pool and queue the current thread works on, if any
+static thread_local const ThreadPool *currentPool = NULL;
+static thread_local int currentQueue = 0;
+
+ThreadPool::ThreadPool(int numThreads)
+    : _numQueued(0), _nextQueue(0), _stop(false)
+{
+    if(numThreads <= 0)
+        numThreads = max(1, (int)thread::hardware_concurrency());
+
+    for(int i = 0; i < numThreads; ++i)
+        _queues.push_back(new _Queue());
+    for(int i = 0; i < numThreads; ++i)
+        _threads.push_back(thread(&ThreadPool::_workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(_sleepMutex);
+        _stop = true;
+    }
+    _wakeUp.notify_all();
+
+    for(int i = 0; i < (int)_threads.size(); ++i)
+        _threads[i].join();
+    for(int i = 0; i < (int)_queues.size(); ++i)
+        delete _queues[i];
+}
+
+ThreadPool &ThreadPool::global()
+{
+    static ThreadPool pool; //function-local static initialization is thread-safe
+    return pool;
+}
+
+void ThreadPool::_run(int count, const function<void(int)> &task)
+{
+    atomic<int> remaining(count);
+    mutex doneMutex;
+    condition_variable done;
+
+    for(int i = 0; i < count; ++i)
+    {
+        _push([&, i]()
+        {
+            task(i);
+
+            //decrement under the lock so the waiting thread can't return (and destroy these
+            //locals) between the decrement and the notification
+            lock_guard<mutex> lock(doneMutex);
+            if(--remaining == 0)
+                done.notify_all();
+        });
+    }
+
+    //help out until our tasks are all taken, then wait for the ones still running
+    int queue = _currentQueue();
+    while(remaining > 0 && _tryRunOne(queue))
+        ;
+
+    unique_lock<mutex> lock(doneMutex);
+    while(remaining > 0)
+        done.wait(lock);
+}
+
+void ThreadPool::_push(const Task &task)
+{
+    int queue = currentPool == this ? currentQueue : (int)(_nextQueue++ % (unsigned int)_queues.size());
+    {
+        lock_guard<mutex> lock(_queues[queue]->mutex);
+        _queues[queue]->tasks.push_back(task);
+    }
+
+    {
+        lock_guard<mutex> lock(_sleepMutex); //so a worker can't miss the wakeup between checking and sleeping
+        ++_numQueued;
+    }
+    _wakeUp.notify_one();
+}
+
+bool ThreadPool::_tryRunOne(int startQueue)
+{
+    Task task;
+    for(int i = 0; i < (int)_queues.size() && !task; ++i)
+    {
+        int idx = (startQueue + i) % (int)_queues.size();
+        lock_guard<mutex> lock(_queues[idx]->mutex);
+        deque<Task> &tasks = _queues[idx]->tasks;
+        if(tasks.empty())
+            continue;
+
+        if(i == 0) //own queue: most recently pushed first
+        {
+            task = tasks.back();
+            tasks.pop_back();
+        }
+        else //steal the oldest task
+        {
+            task = tasks.front();
+            tasks.pop_front();
+        }
+    }
+
+    if(!task)
+        return false;
+
+    --_numQueued;
+    task();
+    return true;
+}
+
+void ThreadPool::_workerLoop(int idx)
+{
+    currentPool = this;
+    currentQueue = idx;
+
+    while(true)
+    {
+        if(_tryRunOne(idx))
+            continue;
+
+        unique_lock<mutex> lock(_sleepMutex);
+        while(!_stop && _numQueued == 0)
+            _wakeUp.wait(lock);
+        if(_stop && _numQueued == 0)
+            return;
+    }
+}
+
+int ThreadPool::_currentQueue() const
+{
+    return currentPool == this ? currentQueue : 0;
+}
+
+END_NAMESPACE_Cornu
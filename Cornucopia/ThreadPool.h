@@ -0,0 +1,86 @@
+/*--
+    ThreadPool.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_THREADPOOL_H_INCLUDED
+#define CORNUCOPIA_THREADPOOL_H_INCLUDED
+
+#include "defs.h"
+#include "Executor.h"
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+NAMESPACE_Cornu
+
+/*
+    A work-stealing thread pool.  Each worker has its own task queue: it takes work from the back
+    of its own queue and, when that is empty, steals from the front of the others.  A thread that
+    waits for a parallelFor also runs queued tasks, so parallelFor may be called from inside a task.
+    It is the library's built-in executor.
+*/
+class ThreadPool : public Executor
+{
+public:
+    typedef std::function<void()> Task;
+
+    explicit ThreadPool(int numThreads = 0); //0 means one thread per hardware core
+    ~ThreadPool();
+
+    int numThreads() const { return (int)_threads.size(); }
+
+    static ThreadPool &global(); //shared pool, created on first use, and the default executor
+
+protected:
+    void _run(int count, const std::function<void(int)> &task); //override
+    void _submit(const std::function<void()> &task) { _push(task); } //override
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    struct _Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void _push(const Task &task);
+    bool _tryRunOne(int startQueue); //returns false if there was nothing to run
+    void _workerLoop(int idx);
+    int _currentQueue() const; //index of the queue of the calling worker, or 0 for outside threads
+
+    std::vector<std::thread> _threads;
+    std::vector<_Queue *> _queues;
+
+    std::mutex _sleepMutex;
+    std::condition_variable _wakeUp;
+    std::atomic<int> _numQueued;
+    std::atomic<unsigned int> _nextQueue;
+    bool _stop;
+};
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_THREADPOOL_H_INCLUDED
@@ -0,0 +1,189 @@
+/*--
+    Trace.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+using namespace std;
+NAMESPACE_Cornu
+
+atomic<bool> Trace::_enabled(false);
+
+struct TraceEvent
+{
+    const char *name;
+    long long start; //in nanoseconds
+    long long duration;
+};
+
+//A thread's events.  Once full, new events overwrite the oldest ones.
+struct TraceBuffer
+{
+    TraceBuffer(int size, int inThreadId) : events(size), next(0), full(false), threadId(inThreadId) {}
+
+    vector<TraceEvent> events;
+    int next;
+    bool full;
+    int threadId;
+};
+
+//The buffers outlive their threads, so the events of finished threads can still be written
+struct TraceRegistry
+{
+    TraceRegistry() : bufferSize(1 << 16) {}
+
+    mutex lock;
+    vector<unique_ptr<TraceBuffer> > buffers;
+    set<string> names; //interned
+    int bufferSize;
+
+    static TraceRegistry &get() { static TraceRegistry registry; return registry; }
+};
+
+static thread_local TraceBuffer *threadBuffer = NULL;
+
+static long long now()
+{
+    static const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+static TraceBuffer &buffer()
+{
+    if(!threadBuffer)
+    {
+        TraceRegistry &registry = TraceRegistry::get();
+        lock_guard<mutex> guard(registry.lock);
+        registry.buffers.push_back(unique_ptr<TraceBuffer>(new TraceBuffer(registry.bufferSize, (int)registry.buffers.size() + 1)));
+        threadBuffer = registry.buffers.back().get();
+    }
+    return *threadBuffer;
+}
+
+static void writeEscaped(ostream &out, const char *str)
+{
+    for(; *str; ++str)
+    {
+        if(*str == '"' || *str == '\\')
+            out << '\\';
+        out << *str;
+    }
+}
+
+void Trace::Scope::_begin(const char *name)
+{
+    _name = name;
+    _start = now();
+}
+
+void Trace::Scope::_end()
+{
+    TraceBuffer &buf = buffer();
+    TraceEvent &event = buf.events[buf.next];
+    event.name = _name;
+    event.start = _start;
+    event.duration = now() - _start;
+    if(++buf.next == (int)buf.events.size())
+    {
+        buf.next = 0;
+        buf.full = true;
+    }
+}
+
+const char *Trace::_intern(const string &name)
+{
+    TraceRegistry &registry = TraceRegistry::get();
+    lock_guard<mutex> guard(registry.lock);
+    return registry.names.insert(name).first->c_str();
+}
+
+void Trace::setBufferSize(int events)
+{
+    TraceRegistry &registry = TraceRegistry::get();
+    lock_guard<mutex> guard(registry.lock);
+    registry.bufferSize = max(1, events);
+}
+
+void Trace::clear()
+{
+    TraceRegistry &registry = TraceRegistry::get();
+    lock_guard<mutex> guard(registry.lock);
+    for(int i = 0; i < (int)registry.buffers.size(); ++i)
+    {
+        registry.buffers[i]->next = 0;
+        registry.buffers[i]->full = false;
+    }
+}
+
+int Trace::numEvents()
+{
+    TraceRegistry &registry = TraceRegistry::get();
+    lock_guard<mutex> guard(registry.lock);
+    int out = 0;
+    for(int i = 0; i < (int)registry.buffers.size(); ++i)
+        out += registry.buffers[i]->full ? (int)registry.buffers[i]->events.size() : registry.buffers[i]->next;
+    return out;
+}
+
+void Trace::writeChromeJson(ostream &out)
+{
+    TraceRegistry &registry = TraceRegistry::get();
+    lock_guard<mutex> guard(registry.lock);
+
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    char buffer[100];
+    for(int i = 0; i < (int)registry.buffers.size(); ++i)
+    {
+        const TraceBuffer &buf = *registry.buffers[i];
+        int numEvents = buf.full ? (int)buf.events.size() : buf.next;
+        int oldest = buf.full ? buf.next : 0;
+        for(int j = 0; j < numEvents; ++j)
+        {
+            const TraceEvent &event = buf.events[(oldest + j) % buf.events.size()];
+            out << (first ? "\n" : ",\n") << "{\"name\":\"";
+            writeEscaped(out, event.name);
+            //times are in microseconds
+            snprintf(buffer, sizeof(buffer), "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                     event.start * 1e-3, event.duration * 1e-3, buf.threadId);
+            out << buffer;
+            first = false;
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+bool Trace::writeChromeJson(const string &fileName)
+{
+    ofstream out(fileName.c_str());
+    if(!out)
+        return false;
+    writeChromeJson(out);
+    return (bool)out;
+}
+
+END_NAMESPACE_Cornu
@@ -0,0 +1,87 @@
+/*--
+    Trace.h  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORNUCOPIA_TRACE_H_INCLUDED
+#define CORNUCOPIA_TRACE_H_INCLUDED
+
+#include "defs.h"
+
+#include <atomic>
+#include <iosfwd>
+#include <string>
+
+NAMESPACE_Cornu
+
+/*
+    Optional tracing of where the time goes in a fit.  While tracing is enabled, each CORNU_TRACE_SCOPE
+    records an event with its start time and duration into a ring buffer of the calling thread, which keeps
+    the most recent events.  writeChromeJson writes the events in the Chrome trace format, which
+    chrome://tracing and Perfetto load.  While tracing is disabled, a scope only checks a flag.
+    Defining CORNUCOPIA_NO_TRACE compiles the scopes out entirely.
+*/
+class Trace
+{
+public:
+    static bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+
+    static void setBufferSize(int events); //per thread, for buffers created afterwards
+
+    //These access every thread's buffer, so they must not be called while traced code is running
+    static void clear(); //discards the recorded events
+    static int numEvents();
+    static void writeChromeJson(std::ostream &out);
+    static bool writeChromeJson(const std::string &fileName); //returns false if the file can't be written
+
+    class Scope
+    {
+    public:
+        Scope(const char *name) : _name(NULL) { if(enabled()) _begin(name); } //name must outlive the trace
+        Scope(const std::string &name) : _name(NULL) { if(enabled()) _begin(_intern(name)); }
+        ~Scope() { if(_name) _end(); }
+
+    private:
+        Scope(const Scope &);
+        Scope &operator=(const Scope &);
+
+        void _begin(const char *name);
+        void _end();
+
+        const char *_name;
+        long long _start; //in nanoseconds
+    };
+
+private:
+    static const char *_intern(const std::string &name);
+
+    static std::atomic<bool> _enabled;
+};
+
+#ifdef CORNUCOPIA_NO_TRACE
+#define CORNU_TRACE_SCOPE(name)
+#else
+#define CORNU_TRACE_SCOPE_CONCAT(a, b) a##b
+#define CORNU_TRACE_SCOPE_VAR(line) CORNU_TRACE_SCOPE_CONCAT(traceScope, line)
+#define CORNU_TRACE_SCOPE(name) Cornu::Trace::Scope CORNU_TRACE_SCOPE_VAR(__LINE__)(name)
+#endif
+
+END_NAMESPACE_Cornu
+
+#endif //CORNUCOPIA_TRACE_H_INCLUDED
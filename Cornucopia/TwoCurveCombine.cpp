@@ -27,6 +27,7 @@
 #include "ErrorComputer.h"
 #include "AngleUtils.h"
 #include "Solver.h"
+#include "Trace.h"
 #include <map>
 #include <cstdio> //TMP
 #include <iostream> //TMP
@@ -38,12 +39,12 @@ NAMESPACE_Cornu
 class CombinedCurve
 {
 public:
-    CombinedCurve(FitPrimitive p[2], int continuity, const Fitter &fitter)
+    CombinedCurve(FitPrimitive p[2], int continuity, const TwoCurveCombineContext &context)
         : _continuity(continuity), _evalCount(0)
     {
-        _errorComputer = fitter.output<ERROR_COMPUTER>()->errorComputer;
-        int sampledPts = fitter.output<RESAMPLING>()->output->pts().size();
-        double adjustmentPoint = fitter.params().get(Parameters::TWO_CURVE_CURVATURE_ADJUST);
+        _errorComputer = context.errorComputer;
+        int sampledPts = context.numSampledPts;
+        double adjustmentPoint = context.curvatureAdjust;
 
         CurvePrimitive::ParamVec v[2];
         for(int i = 0; i < 2; ++i)
@@ -249,8 +250,8 @@ public:
 
     double computeError() const
     {
-        return _errorComputer->computeError(_c[0], _from[0], _to[0], true, _continuity == 0, true) +
-               _errorComputer->computeError(_c[1], _from[1], _to[1], _continuity == 0, true);
+        return _errorComputer->computeErrorIncremental(_c[0], _from[0], _to[0], _projections[0], true, _continuity == 0, true) +
+               _errorComputer->computeErrorIncremental(_c[1], _from[1], _to[1], _projections[1], _continuity == 0, true);
     }
 
     void computeErrorVector(VectorXd &outError, MatrixXd &outErrorDer) const
@@ -258,15 +259,16 @@ public:
 #if 0
         char name[100];
         sprintf(name, "Curves %d", const_cast<CombinedCurve *>(this)->_evalCount++);
-        Debugging::get()->drawCurve(_c[0], Vector3d(1, 0, 0), name);
-        Debugging::get()->drawCurve(_c[1], Vector3d(0, 0, 1), name);
+        CORNU_DEBUG(drawCurve(_c[0], Vector3d(1, 0, 0), name));
+        CORNU_DEBUG(drawCurve(_c[1], Vector3d(0, 0, 1), name));
 #endif
         VectorXd err[2];
         MatrixXd errDer[2];
 
         //perhaps it should be whether that point is a corner, rather than continuity
-        _errorComputer->computeErrorVector(_c[0], _from[0], _to[0], err[0], errDer + 0, true, _continuity == 0, true);
-        _errorComputer->computeErrorVector(_c[1], _from[1], _to[1], err[1], errDer + 1, _continuity == 0, true);
+        //The curves only change a little between solver iterations, so the projections start from the last ones.
+        _errorComputer->computeErrorVectorIncremental(_c[0], _from[0], _to[0], err[0], errDer + 0, _projections[0], true, _continuity == 0, true);
+        _errorComputer->computeErrorVectorIncremental(_c[1], _from[1], _to[1], err[1], errDer + 1, _projections[1], _continuity == 0, true);
 
 #if 1
         CurvePrimitive::EndDer endDer;
@@ -368,18 +370,21 @@ private:
     CurvePrimitivePtr _c[2];
     int _from[2], _to[2];
     CurvePrimitive::PrimitiveType _type[2];
-    ErrorComputerConstPtr _errorComputer;
+    const ErrorComputer *_errorComputer;
     int _continuity;
     int _evalCount;
     double _angleWeight[2];
     double _curvatureWeight[2];
     double _origEndAngle[2];
     double _origEndCurvature[2];
+    mutable VectorXd _projections[2]; //of the samples onto each curve in the last error computation
 };
 
 class TwoCurveProblem : public LSProblem
 {
 public:
+    typedef LSSmallDenseEvalData<12> EvalData; //the parameters of two clothoids at most
+
     TwoCurveProblem(CombinedCurve &curves) : _curves(curves) {}
 
     //overrides
@@ -390,11 +395,11 @@ public:
     }
     LSEvalData *createEvalData()
     {
-        return new LSDenseEvalData();
+        return new EvalData();
     }
     void eval(const Eigen::VectorXd &x, LSEvalData *data)
     {
-        LSDenseEvalData *twoCurveData = static_cast<LSDenseEvalData *>(data);
+        EvalData *twoCurveData = static_cast<EvalData *>(data);
         _curves.setParams(x);
         _curves.computeErrorVector(twoCurveData->errVectorRef(), twoCurveData->errDerRef());
         //cout << "Err = " << twoCurveData->error() << endl;
@@ -404,11 +409,117 @@ private:
     CombinedCurve &_curves;
 };
 
+TwoCurveCombineContext::TwoCurveCombineContext(const Fitter &fitter)
+{
+    primitives = &fitter.output<PRIMITIVE_FITTING>()->primitives;
+    errorComputer = fitter.output<ERROR_COMPUTER>()->errorComputer.get();
+    numSampledPts = fitter.output<RESAMPLING>()->output->pts().size();
+    curvatureAdjust = fitter.params().get(Parameters::TWO_CURVE_CURVATURE_ADJUST);
+    damping = fitter.params().get(Parameters::CURVE_ADJUST_DAMPING);
+    inflectionAccounting = fitter.params().get(Parameters::INFLECTION_COST) > 0.;
+    cache = fitter.output<PRIMITIVE_FITTING>()->combineCache.get();
+    if(cache)
+        cache->setCurvatureAdjust(curvatureAdjust);
+}
+
+bool TwoCurveCombineCache::find(int p1, int p2, int continuity, double &outErr1, double &outErr2) const
+{
+    lock_guard<mutex> lock(_mutex);
+    unordered_map<long long, _Entry>::const_iterator it = _entries.find(_key(p1, p2, continuity));
+    if(it == _entries.end())
+        return false;
+    outErr1 = it->second.err[0];
+    outErr2 = it->second.err[1];
+    return true;
+}
+
+bool TwoCurveCombineCache::findCurves(int p1, int p2, int continuity, CurvePrimitive &c1, CurvePrimitive &c2) const
+{
+    lock_guard<mutex> lock(_mutex);
+    unordered_map<long long, _Entry>::const_iterator it = _entries.find(_key(p1, p2, continuity));
+    if(it == _entries.end())
+        return false;
+
+    CurvePrimitive *curves[2] = { &c1, &c2 };
+    for(int i = 0; i < 2; ++i)
+    {
+        assert(it->second.numParams[i] == curves[i]->numParams());
+        curves[i]->setParams(Map<const CurvePrimitive::ParamVec>(it->second.params[i], it->second.numParams[i]));
+    }
+    return true;
+}
+
+void TwoCurveCombineCache::insert(int p1, int p2, int continuity, const Combination &combination)
+{
+    _Entry entry;
+    entry.err[0] = combination.err1;
+    entry.err[1] = combination.err2;
+    const CurvePrimitivePtr *curves[2] = { &combination.c1, &combination.c2 };
+    for(int i = 0; i < 2; ++i)
+    {
+        const CurvePrimitive::ParamVec &params = (*curves[i])->params();
+        entry.numParams[i] = (int)params.size();
+        Map<CurvePrimitive::ParamVec>(entry.params[i], params.size()) = params;
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    _entries[_key(p1, p2, continuity)] = entry;
+}
+
+int TwoCurveCombineCache::size() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return (int)_entries.size();
+}
+
+size_t TwoCurveCombineCache::memoryUsage() const
+{
+    lock_guard<mutex> lock(_mutex);
+    //each entry is a hash node with the key, the value and a next pointer; the buckets are pointers
+    return sizeof(TwoCurveCombineCache) + _entries.size() * (sizeof(long long) + sizeof(_Entry) + sizeof(void *)) +
+        _entries.bucket_count() * sizeof(void *);
+}
+
+void TwoCurveCombineCache::clear()
+{
+    lock_guard<mutex> lock(_mutex);
+    _entries.clear();
+    _curvatureAdjust = 0.;
+}
+
+void TwoCurveCombineCache::setCurvatureAdjust(double curvatureAdjust)
+{
+    lock_guard<mutex> lock(_mutex);
+    if(curvatureAdjust == _curvatureAdjust)
+        return;
+    _entries.clear();
+    _curvatureAdjust = curvatureAdjust;
+}
+
+//copy of the primitive with a different curve--copying the original curve pointer would touch a shared reference count
+static FitPrimitive withCurve(const FitPrimitive &primitive, const CurvePrimitivePtr &curve)
+{
+    FitPrimitive out;
+    out.curve = curve;
+    out.startIdx = primitive.startIdx;
+    out.endIdx = primitive.endIdx;
+    out.numPts = primitive.numPts;
+    out.error = primitive.error;
+    out.startCurvSign = primitive.startCurvSign;
+    out.endCurvSign = primitive.endCurvSign;
+    out.fixed = primitive.fixed;
+    return out;
+}
+
 Combination twoCurveCombine(int p1, int p2, int continuity, const Fitter &fitter)
 {
-    const vector<FitPrimitive> &primitives = fitter.output<PRIMITIVE_FITTING>()->primitives;
-    const VectorC<Vector2d> &pts = fitter.output<RESAMPLING>()->output->pts();
-    ErrorComputerConstPtr errorComputer = fitter.output<ERROR_COMPUTER>()->errorComputer;
+    return twoCurveCombine(p1, p2, continuity, TwoCurveCombineContext(fitter));
+}
+
+Combination twoCurveCombine(int p1, int p2, int continuity, const TwoCurveCombineContext &context)
+{
+    CORNU_TRACE_SCOPE("twoCurveCombine");
+    const vector<FitPrimitive> &primitives = *context.primitives;
 
     Combination out;
 
@@ -424,11 +535,9 @@ Combination twoCurveCombine(int p1, int p2, int continuity, const Fitter &fitter
 
     out.c1->flip();
 
-    FitPrimitive primArray[2] = { primitives[p1], primitives[p2] };
-    primArray[0].curve = out.c1;
-    primArray[1].curve = out.c2;
+    FitPrimitive primArray[2] = { withCurve(primitives[p1], out.c1), withCurve(primitives[p2], out.c2) };
 
-    CombinedCurve combined(primArray, continuity, fitter);
+    CombinedCurve combined(primArray, continuity, context);
 
     VectorXd x;
     combined.getParams(x);
@@ -455,8 +564,8 @@ Combination twoCurveCombine(int p1, int p2, int continuity, const Fitter &fitter
     bool origDrawn = !constraints.empty() && !(cnt++);
     if(origDrawn)
     {
-        Debugging::get()->drawCurve(primitives[p1].curve, Vector3d(1, 0, 0), "Curves Orig");
-        Debugging::get()->drawCurve(primitives[p2].curve, Vector3d(0, 0, 1), "Curves Orig");
+        CORNU_DEBUG(drawCurve(primitives[p1].curve, Vector3d(1, 0, 0), "Curves Orig"));
+        CORNU_DEBUG(drawCurve(primitives[p2].curve, Vector3d(0, 0, 1), "Curves Orig"));
     }
 #endif
 
@@ -467,9 +576,7 @@ Combination twoCurveCombine(int p1, int p2, int continuity, const Fitter &fitter
             constraints.push_back(LSBoxConstraint(combined.getParamIndex(curveIdx, CurvePrimitive::LENGTH),
                                                   combined.getCurve(curveIdx)->length() * 0.5, 1));
 
-        bool inflectionAccounting = fitter.params().get(Parameters::INFLECTION_COST) > 0.;
-
-        if(inflectionAccounting)
+        if(context.inflectionAccounting)
         {
             bool constantCurvature = primArray[0].startCurvSign == primArray[0].endCurvSign &&
                                      primArray[0].startCurvSign == primArray[1].startCurvSign &&
@@ -499,8 +606,10 @@ Combination twoCurveCombine(int p1, int p2, int continuity, const Fitter &fitter
 
     TwoCurveProblem problem(combined);
     LSSolver solver(&problem, constraints);
-    solver.setDefaultDamping(fitter.params().get(Parameters::CURVE_ADJUST_DAMPING));
-    solver.setMaxIter(5);
+    solver.setWorkspace(&LSWorkspace::forThread()); //this runs for every edge on every path, so keep storage around
+    solver.setDefaultDamping(context.damping);
+    solver.setMaxIter(6); //rejected steps count as iterations
+    solver.setStrategy(LSSolver::ADAPTIVE_DAMPING);
     //solver.verifyDerivatives(x);
     x = solver.solve(x);
     combined.setParams(x);
@@ -508,8 +617,8 @@ Combination twoCurveCombine(int p1, int p2, int continuity, const Fitter &fitter
 #if 0
     if(origDrawn)
     {
-        Debugging::get()->drawCurve(combined.getCurve(0), Vector3d(1, 0, 0), "Curves Final");
-        Debugging::get()->drawCurve(combined.getCurve(1), Vector3d(0, 0, 1), "Curves Final");
+        CORNU_DEBUG(drawCurve(combined.getCurve(0), Vector3d(1, 0, 0), "Curves Final"));
+        CORNU_DEBUG(drawCurve(combined.getCurve(1), Vector3d(0, 0, 1), "Curves Final"));
     }
 #endif
 
@@ -24,6 +24,10 @@
 #include "defs.h"
 #include "smart_ptr.h"
 
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
 NAMESPACE_Cornu
 
 class Fitter;
@@ -37,7 +41,66 @@ struct Combination
     double err2;
 };
 
+class ErrorComputer;
+struct FitPrimitive;
+
+/*
+    Remembers two-curve combinations (their errors and the combined curves' parameters), keyed by primitive
+    pair and continuity.  They depend on the primitives but not on the costs, so they stay valid when only cost
+    parameters change and the graph is rebuilt.  The primitive fitting output owns one, so it is thrown away
+    along with the primitives.  It may be used from several threads at once.
+*/
+class TwoCurveCombineCache : public smart_base
+{
+public:
+    TwoCurveCombineCache() : _curvatureAdjust(0.) {}
+
+    bool find(int p1, int p2, int continuity, double &outErr1, double &outErr2) const;
+    //sets the parameters of c1 and c2, copies of the two primitives' curves, to the combination's (c1 is reversed,
+    //as twoCurveCombine returns it)
+    bool findCurves(int p1, int p2, int continuity, CurvePrimitive &c1, CurvePrimitive &c2) const;
+    void insert(int p1, int p2, int continuity, const Combination &combination);
+    int size() const;
+    size_t memoryUsage() const; //estimated, in bytes
+    void clear(); //keeps the allocated buckets
+
+    //the combination depends on this parameter, which does not change the primitives, so changing it empties the cache
+    void setCurvatureAdjust(double curvatureAdjust);
+
+private:
+    static long long _key(int p1, int p2, int continuity) { return (((long long)p1 * 3 + continuity) << 32) | p2; }
+
+    struct _Entry
+    {
+        double err[2];
+        int numParams[2];
+        double params[2][6];
+    };
+
+    mutable std::mutex _mutex;
+    std::unordered_map<long long, _Entry> _entries;
+    double _curvatureAdjust;
+};
+
+CORNU_SMART_TYPEDEFS(TwoCurveCombineCache);
+
+//What combining reads from the fitter.  It holds plain pointers because smart pointer reference counts
+//aren't safe to modify from several threads, so one context can be shared by concurrent combines.
+struct TwoCurveCombineContext
+{
+    TwoCurveCombineContext(const Fitter &fitter);
+
+    const std::vector<FitPrimitive> *primitives;
+    const ErrorComputer *errorComputer;
+    int numSampledPts;
+    double curvatureAdjust;
+    double damping;
+    bool inflectionAccounting;
+    TwoCurveCombineCache *cache;
+};
+
 Combination twoCurveCombine(int p1, int p2, int continuity, const Fitter &fitter);
+Combination twoCurveCombine(int p1, int p2, int continuity, const TwoCurveCombineContext &context);
 
 END_NAMESPACE_Cornu
 
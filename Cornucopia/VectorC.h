@@ -22,6 +22,7 @@
 #define CORNUCOPIA_VECTORC_H_INCLUDED
 
 #include "defs.h"
+#include "Allocator.h"
 #include <vector>
 #include "Eigen/StdVector"
 
@@ -33,14 +34,10 @@ enum CircularType
     CIRCULAR
 };
 
+//from the current Allocator, which aligns Eigen types like Vector2d
 template<typename T> struct default_allocator_traits
 {
-    typedef std::allocator<T> allocator;
-};
-
-template<> struct default_allocator_traits<Eigen::Vector2d>
-{
-    typedef Eigen::aligned_allocator<Eigen::Vector2d> allocator;
+    typedef StlAllocator<T> allocator;
 };
 
 //VectorC represents a vector with possibly circular access.
@@ -57,7 +54,13 @@ public:
     VectorC() : _circular(NOT_CIRCULAR) {}
     VectorC(int size, CircularType circular) : Base(size), _circular(circular) {}
     VectorC(const Base &base, CircularType circular) : Base(base), _circular(circular) {}
+    template<typename OtherAlloc> //e.g., from an std::vector with Eigen::aligned_allocator
+    VectorC(const std::vector<T, OtherAlloc> &other, CircularType circular) : Base(other.begin(), other.end()), _circular(circular) {}
     VectorC(const VectorC &other) : Base(other), _circular(other._circular) {}
+    VectorC(VectorC &&other) : Base(std::move(other)), _circular(other._circular) {}
+
+    VectorC &operator=(const VectorC &other) { Base::operator=(other); _circular = other._circular; return *this; }
+    VectorC &operator=(VectorC &&other) { Base::operator=(std::move(other)); _circular = other._circular; return *this; }
 
     int size() const { return (int)Base::size(); }
 
@@ -74,31 +77,31 @@ public:
     //returns the size for iteration where at each iteration we access elements i, i+1, ..., i+offset
     int endIdx(int offset) const { return _circular ? (int)Base::size() : std::max(0, (int)size() - offset); }
 
+    //The circulator keeps its flat index in range as it moves, so stepping and dereferencing don't need toLinearIdx.
+    //It also counts its steps from the start, which is what done() checks for circular vectors.
     class Circulator
     {
     public:
-        Circulator(const VectorC<T> *ptr, int idx) : _ptr(ptr), _idx(idx), _startIdx(idx) {}
+        Circulator(const VectorC<T> *ptr, int idx) : _ptr(ptr), _idx(idx), _steps(0) {}
 
-        const_reference operator*() const { return (*_ptr)[_idx]; }
-        bool operator==(const Circulator &other) const { return _ptr == other._ptr && _ptr->toLinearIdx(_idx) == _ptr->toLinearIdx(other._idx); }
+        const_reference operator*() const { return _ptr->flatAt(_idx); }
+        bool operator==(const Circulator &other) const { return _ptr == other._ptr && _idx == other._idx; }
         bool operator!=(const Circulator &other) const { return !(*this == other); }
 
-        Circulator &operator++() { ++_idx; return *this; }
-        Circulator &operator--() { --_idx; return *this; }
-        Circulator &operator+=(int x) { _idx += x; return *this; }
-        Circulator &operator-=(int x) { _idx -= x; return *this; }
-        Circulator operator+(int x) const { return Circulator(_ptr, _idx + x, _startIdx); }
-        Circulator operator-(int x) const { return Circulator(_ptr, _idx - x, _startIdx); }
+        Circulator &operator++() { ++_steps; if(++_idx == _ptr->size() && _ptr->circular()) _idx = 0; return *this; }
+        Circulator &operator--() { --_steps; if(_idx-- == 0 && _ptr->circular()) _idx = _ptr->size() - 1; return *this; }
+        Circulator &operator+=(int x) { _steps += x; _idx = _ptr->toLinearIdx(_idx + x); return *this; }
+        Circulator &operator-=(int x) { return *this += -x; }
+        Circulator operator+(int x) const { return Circulator(*this) += x; }
+        Circulator operator-(int x) const { return Circulator(*this) += -x; }
 
-        bool done() const { if(_ptr->circular()) return abs(_idx - _startIdx) >= _ptr->size(); else return _idx < 0 || _idx >= _ptr->size(); }
-        int index() const { return _ptr->toLinearIdx(_idx); }
+        bool done() const { if(_ptr->circular()) return abs(_steps) >= _ptr->size(); else return _idx < 0 || _idx >= _ptr->size(); }
+        int index() const { return _idx; }
 
     private:
-        Circulator(const VectorC<T> *ptr, int idx, int startIdx) : _ptr(ptr), _idx(idx), _startIdx(startIdx) {}
-
         const VectorC<T> *_ptr;
         int _idx;
-        int _startIdx;
+        int _steps;
     };
 
     Circulator beginCirculator() const { return Circulator(this, 0); }
@@ -106,7 +109,7 @@ public:
 
     int toLinearIdx(int idx) const
     {
-        if(!_circular)
+        if(!_circular || (unsigned)idx < (unsigned)size()) //usually already in range
             return idx;
         int out = idx % size();
         if(out >= 0)
@@ -114,6 +117,30 @@ public:
         return out + size();
     }
 
+    //flat indices from begin (inclusive) to end (exclusive)
+    struct FlatSpan
+    {
+        int begin, end;
+    };
+
+    //Splits the count elements starting at from into at most two runs of consecutive flat indices, so that loops
+    //over them don't need a circulator.  The elements wrap around if the vector is circular and stop at the end
+    //otherwise.  Returns the number of runs written to out.
+    int flatSpans(int from, int count, FlatSpan *out) const
+    {
+        from = toLinearIdx(from);
+        count = std::min(count, _circular ? size() : size() - from);
+        if(count <= 0)
+            return 0;
+        FlatSpan first = { from, std::min(from + count, size()) };
+        out[0] = first;
+        if(first.end - first.begin == count)
+            return 1;
+        FlatSpan second = { 0, from + count - size() };
+        out[1] = second;
+        return 2;
+    }
+
     int numElems(int from, int to) const //returns the number of elements between from (inclusive) and to (exclusive)
     {
         if(from > to)
@@ -22,16 +22,27 @@
 #define CORNUCOPIA_SMART_PTR_H_INCLUDED
 
 #include "defs.h"
+#include "Allocator.h"
 #include <algorithm>
+#include <utility>
+#ifdef CORNUCOPIA_ATOMIC_REFCOUNT
+#include <atomic>
+#endif
 
 NAMESPACE_Cornu
 
 template<typename T> class smart_ptr;
 
+//Reference counts are plain ints unless the library is built with CORNUCOPIA_ATOMIC_REFCOUNT, which makes it
+//safe to share (and release) pointers to the same object from several threads, at some cost.
 class smart_base
 {
 private:
+#ifdef CORNUCOPIA_ATOMIC_REFCOUNT
+    mutable std::atomic<int> _refCount;
+#else
     mutable int _refCount;
+#endif
 
 public:
     smart_base() : _refCount(0) {}
@@ -41,20 +52,37 @@ public:
     //assigning to a smart_base should not change the reference count
     smart_base &operator=(const smart_base &) { return *this; }
 
+    //from the current Allocator, aligned for Eigen members, so derived classes must not define their own
+    static void *operator new(size_t size) { return allocateObject(size); }
+    static void operator delete(void *ptr) { freeObject(ptr); }
+
 protected:
     template<class U> friend class smart_ptr;
 
-    virtual void addRef() const
+    //not virtual, since they run on every pointer copy--freeRef is the hook for customizing deletion
+#ifdef CORNUCOPIA_ATOMIC_REFCOUNT
+    void addRef() const
+    {
+        _refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    void releaseRef() const
+    {
+        if(_refCount.fetch_sub(1, std::memory_order_acq_rel) <= 1)
+            const_cast<smart_base *>(this)->freeRef();
+    }
+#else
+    void addRef() const
     {
         ++_refCount;
     }
-    virtual void releaseRef() const
+    void releaseRef() const
     {
         bool free = false;
         free = (--_refCount <= 0);
         if (free)
             const_cast<smart_base *>(this)->freeRef();
     }
+#endif
     virtual void freeRef() { delete this; }
 
     int getRefCount() const { return _refCount; }
@@ -95,6 +123,20 @@ public:
             ptr->addRef(); 
     }
 
+    //moving takes over the reference instead of adding one
+    template<class U>
+    smart_ptr(smart_ptr<U> &&smartPtr) : ptr(smartPtr.ptr), typedPtr(smartPtr.typedPtr)
+    {
+        smartPtr.ptr = 0;
+        smartPtr.typedPtr = 0;
+    }
+
+    smart_ptr(smart_ptr &&smartPtr) : ptr(smartPtr.ptr), typedPtr(smartPtr.typedPtr)
+    {
+        smartPtr.ptr = 0;
+        smartPtr.typedPtr = 0;
+    }
+
     ~smart_ptr()
     {
         if(ptr)
@@ -118,6 +160,19 @@ public:
         return *this;
     }
 
+    template<class U>
+    smart_ptr<T> &operator=(smart_ptr<U> &&other)
+    {
+        smart_ptr<T>(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    smart_ptr<T> &operator=(smart_ptr &&other)
+    {
+        smart_ptr<T>(std::move(other)).swap(*this);
+        return *this;
+    }
+
     smart_ptr<T> &operator=(T *other)
     {
         smart_ptr<T>(other).swap(*this);
@@ -138,6 +193,7 @@ public:
     }
 
     T *get() const { return typedPtr; }
+    bool unique() const { return ptr && ptr->getRefCount() == 1; } //whether this is the only pointer to the object
     void reset() 
     {
         if(ptr)
@@ -23,7 +23,6 @@
 #include "SceneItem.h"
 #include "Curve.h"
 
-#include <ctime>
 #include <cstdarg>
 #include <cstdio>
 
@@ -62,7 +61,7 @@ void DebuggingImpl::printf(const char *fmt, ...)
 
 void DebuggingImpl::startTiming(const string &description)
 {
-    _startTimes[QString(description.c_str())] = clock();
+    _startTimes[QString(description.c_str())] = chrono::steady_clock::now();
 }
 
 void DebuggingImpl::elapsedTime(const string &description)
@@ -74,8 +73,8 @@ void DebuggingImpl::elapsedTime(const string &description)
 
         return;
     }
-    int diff = clock() - _startTimes[desc];
-    printf("Timing: %20s  ---  %.3lf", description.c_str(), double(diff) / CLOCKS_PER_SEC);
+    double diff = chrono::duration<double>(chrono::steady_clock::now() - _startTimes[desc]).count();
+    printf("Timing: %20s  ---  %.3lf", description.c_str(), diff);
 }
 
 double DebuggingImpl::getTimeElapsed(const string &description)
@@ -83,7 +82,7 @@ double DebuggingImpl::getTimeElapsed(const string &description)
     QString desc(description.c_str());
     if(!_startTimes.contains(desc))
         return 0.;
-    return double(clock() - _startTimes[desc]) / CLOCKS_PER_SEC;
+    return chrono::duration<double>(chrono::steady_clock::now() - _startTimes[desc]).count();
 }
 
 void DebuggingImpl::clear(const std::string &groups)
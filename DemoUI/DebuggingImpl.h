@@ -27,6 +27,7 @@
 #include <QObject>
 #include <QHash>
 #include <QPen>
+#include <chrono>
 
 class ScrollScene;
 
@@ -37,7 +38,7 @@ public:
     static DebuggingImpl *get();
 
     //overrides
-    bool isDebuggingOn() const { return true; }
+    bool isDebuggingOn() const { return _scene != NULL; } //the library only produces output while the debug window is shown
 
     void printf(const char *fmt, ...);
 
@@ -64,7 +65,7 @@ private:
 
     ScrollScene *_scene;
 
-    QHash<QString, int> _startTimes;
+    QHash<QString, std::chrono::steady_clock::time_point> _startTimes; //wall time
 };
 
 #endif //CORNUCOPIA_DEBUGGINGIMPL_H_INCLUDED
@@ -63,9 +63,12 @@ void Document::curveDrawn(Cornu::PolylineConstPtr polyline)
     {
         if(!_sketches[i].selected)
             continue;
-        Cornu::CurveConstPtr curve = _sketches[i].curve;
+        Cornu::PrimitiveSequenceConstPtr curve = _sketches[i].curve;
         if(!curve)
             continue;
+        if(curve->boundingBox().squaredExteriorDistance(startPos) > threshold &&
+           curve->boundingBox().squaredExteriorDistance(endPos) > threshold)
+            continue;
         double distStart = curve->distanceSqTo(startPos);
         double distEnd = curve->distanceSqTo(endPos);
         if(distStart > threshold && distEnd > threshold)
@@ -168,7 +171,9 @@ void Document::selectAt(const Eigen::Vector2d &point, bool shift, double radius)
     {
         if(!_sketches[i].sceneItem)
             continue;
-        Cornu::CurveConstPtr curve = _sketches[i].sceneItem->curve();
+        Cornu::PrimitiveSequenceConstPtr curve = _sketches[i].curve;
+        if(curve->boundingBox().squaredExteriorDistance(point) >= minDistSq) //cheap rejection for faraway curves
+            continue;
         double distSq = curve->distanceSqTo(point);
         if(distSq < minDistSq)
         {
@@ -187,12 +192,16 @@ void Document::_processSketch(int idx)
 {
     _view->scene()->clearGroups(_sketches[idx].name);
 
-    Cornu::Fitter fitter;
+    Cornu::Fitter &fitter = _sketches[idx].fitter;
 
     fitter.setParams(_sketches[idx].params);
-    fitter.setOriginalSketch(_sketches[idx].pts);
+    if(fitter.originalSketch() != _sketches[idx].pts)
+        fitter.setOriginalSketch(_sketches[idx].pts);
+    Cornu::PrimitiveSequenceConstPtr oversketchBase;
     if(_sketches[idx].oversketch >= 0)
-        fitter.setOversketchBase(_sketches[_sketches[idx].oversketch].curve);
+        oversketchBase = _sketches[_sketches[idx].oversketch].curve;
+    if(fitter.oversketchBase() != oversketchBase)
+        fitter.setOversketchBase(oversketchBase);
     fitter.run();
 
     _sketches[idx].curve = fitter.finalOutput();
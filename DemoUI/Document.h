@@ -23,6 +23,7 @@
 
 #include "defs.h"
 #include "Parameters.h"
+#include "Fitter.h"
 #include <vector>
 
 #include <QObject>
@@ -70,6 +71,7 @@ private:
         CurveSceneItemPtr sceneItem;
         bool selected;
         int oversketch; //index of the sketch over which this one is sketched, or -1 if this is a new curve
+        Cornu::Fitter fitter; //kept so that refitting with new parameters only reruns the stages they affect
     };
 
     void _selectionChanged() const;
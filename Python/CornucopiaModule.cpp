@@ -0,0 +1,218 @@
+/*--
+    CornucopiaModule.cpp  
+
+    This file is part of the Cornucopia curve sketching library.
+    Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+//The _cornucopia extension module that cornucopia.py wraps.  It takes the points of a ragged batch of curves as any
+//object with the buffer protocol, e.g., an N x 2 float64 or float32 NumPy array, and fits them in place with the ragged
+//fitBatch of SimpleAPI.h, with the GIL released.  It only needs the Python headers, not NumPy's.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "SimpleAPI.h"
+
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    //a buffer that is held until the end of the call
+    class Buffer
+    {
+    public:
+        Buffer() : _held(false) {}
+        ~Buffer() { if(_held) PyBuffer_Release(&view); }
+
+        bool get(PyObject *object, int flags) { _held = (PyObject_GetBuffer(object, &view, flags) == 0); return _held; }
+
+        //the element type of the buffer's format, if it is native, e.g., 'd' for "d", "@d" or "=d"
+        char type() const
+        {
+            const char *format = view.format ? view.format : "B";
+            if(format[0] == '@' || format[0] == '=')
+                ++format;
+            return format[1] == '\0' ? format[0] : '\0';
+        }
+
+        Py_buffer view;
+
+    private:
+        bool _held;
+    };
+
+    PyObject *fail(PyObject *type, const char *message)
+    {
+        PyErr_SetString(type, message);
+        return NULL;
+    }
+
+    template<typename T>
+    PyObject *toByteArray(const vector<T> &v)
+    {
+        return PyByteArray_FromStringAndSize(v.empty() ? "" : reinterpret_cast<const char *>(&v[0]), (Py_ssize_t)(v.size() * sizeof(T)));
+    }
+
+    //fit_batch(points, offsets, preset, overrides, num_threads) -> (primitives, primitive offsets, closed) as bytearrays
+    //of BasicPrimitive records, int64 and uint8.  overrides is a sequence of (parameter index, value) pairs.
+    PyObject *fitBatch(PyObject *, PyObject *args)
+    {
+        PyObject *pointsObject, *offsetsObject, *overrides;
+        int preset, numThreads;
+        if(!PyArg_ParseTuple(args, "OOiOi", &pointsObject, &offsetsObject, &preset, &overrides, &numThreads))
+            return NULL;
+
+        Buffer points, offsetsBuffer;
+        if(!points.get(pointsObject, PyBUF_STRIDES | PyBUF_FORMAT) || !offsetsBuffer.get(offsetsObject, PyBUF_STRIDES | PyBUF_FORMAT))
+            return NULL;
+        char type = points.type();
+        if(points.view.ndim != 2 || points.view.shape[1] != 2 || (type != 'd' && type != 'f'))
+            return fail(PyExc_TypeError, "points must be an N x 2 array of native float64 or float32");
+        Py_ssize_t itemSize = points.view.itemsize;
+        if(points.view.strides[0] % itemSize != 0 || points.view.strides[1] % itemSize != 0)
+            return fail(PyExc_ValueError, "points must be aligned to their elements--pass numpy.ascontiguousarray(points)");
+        Py_ssize_t numPoints = points.view.shape[0];
+
+        //the offsets are few, so they are copied, which also allows any integer type
+        char offsetType = offsetsBuffer.type();
+        if(offsetsBuffer.view.ndim != 1 || offsetsBuffer.view.shape[0] < 1 || !strchr("bBhHiIlLqQ", offsetType))
+            return fail(PyExc_TypeError, "offsets must be a one-dimensional integer array with one more entry than there are curves");
+        vector<long long> offsets(offsetsBuffer.view.shape[0]);
+        for(int i = 0; i < (int)offsets.size(); ++i)
+        {
+            PyObject *item = PySequence_GetItem(offsetsObject, i);
+            if(item == NULL)
+                return NULL;
+            offsets[i] = PyLong_AsLongLong(item);
+            Py_DECREF(item);
+            if(offsets[i] == -1 && PyErr_Occurred())
+                return NULL;
+            if(offsets[i] < (i ? offsets[i - 1] : 0) || offsets[i] > numPoints)
+                return fail(PyExc_ValueError, "offsets must be nondecreasing and within the points");
+        }
+        int numCurves = (int)offsets.size() - 1;
+
+        if(preset < 0 || preset >= Cornu::Parameters::NUM_PRESETS)
+            return fail(PyExc_ValueError, "no such preset");
+        Cornu::Parameters parameters((Cornu::Parameters::Preset)preset);
+        PyObject *overrideList = PySequence_Fast(overrides, "overrides must be a sequence of (index, value) pairs");
+        if(overrideList == NULL)
+            return NULL;
+        bool overridesOk = true;
+        for(Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(overrideList) && overridesOk; ++i)
+        {
+            int index;
+            double value;
+            overridesOk = PyArg_ParseTuple(PySequence_Fast_GET_ITEM(overrideList, i), "id", &index, &value) &&
+                          index >= 0 && index < (int)Cornu::Parameters::parameters().size();
+            if(overridesOk)
+                parameters.set((Cornu::Parameters::ParameterType)index, value);
+        }
+        Py_DECREF(overrideList);
+        if(!overridesOk)
+            return PyErr_Occurred() ? NULL : fail(PyExc_ValueError, "no such parameter");
+
+        vector<Cornu::BasicPrimitive> primitives;
+        vector<long long> primitiveOffsets;
+        vector<bool> closed;
+        string error;
+        Py_BEGIN_ALLOW_THREADS
+        try
+        {
+            const char *data = static_cast<const char *>(points.view.buf);
+            int stride = (int)(points.view.strides[0] / itemSize);
+            const char *ys = data + points.view.strides[1];
+            if(type == 'd')
+            {
+                Cornu::fitBatch(reinterpret_cast<const double *>(data), reinterpret_cast<const double *>(ys), stride, &offsets[0],
+                                numCurves, parameters, primitives, primitiveOffsets, &closed, numThreads);
+            }
+            else
+            {
+                Cornu::fitBatch(reinterpret_cast<const float *>(data), reinterpret_cast<const float *>(ys), stride, &offsets[0],
+                                numCurves, parameters, primitives, primitiveOffsets, &closed, numThreads);
+            }
+        }
+        catch(const exception &e)
+        {
+            error = e.what();
+            if(error.empty())
+                error = "fitting failed";
+        }
+        Py_END_ALLOW_THREADS
+        if(!error.empty())
+            return fail(PyExc_RuntimeError, error.c_str());
+
+        vector<unsigned char> closedBytes(closed.begin(), closed.end());
+        return Py_BuildValue("(NNN)", toByteArray(primitives), toByteArray(primitiveOffsets), toByteArray(closedBytes));
+    }
+
+    //primitive_layout() -> (record size, [(field, struct format, offset), ...]) of BasicPrimitive, for a NumPy dtype
+    PyObject *primitiveLayout(PyObject *, PyObject *)
+    {
+        typedef Cornu::BasicPrimitive P;
+        const char *typeFormat = sizeof(P::PrimitiveType) == 4 ? "i4" : "i8";
+        return Py_BuildValue("(n[(ssn)(ssn)(ssn)(ssn)(ssn)(ssn)(ssn)])", (Py_ssize_t)sizeof(P),
+                             "type", typeFormat, (Py_ssize_t)offsetof(P, type),
+                             "start_x", "f8", (Py_ssize_t)(offsetof(P, start) + offsetof(Cornu::Point, x)),
+                             "start_y", "f8", (Py_ssize_t)(offsetof(P, start) + offsetof(Cornu::Point, y)),
+                             "length", "f8", (Py_ssize_t)offsetof(P, length),
+                             "start_angle", "f8", (Py_ssize_t)offsetof(P, startAngle),
+                             "start_curvature", "f8", (Py_ssize_t)offsetof(P, startCurvature),
+                             "curvature_derivative", "f8", (Py_ssize_t)offsetof(P, curvatureDerivative));
+    }
+
+    //parameter_names() and preset_names() -> lists of the names, in index order
+    PyObject *parameterNames(PyObject *, PyObject *)
+    {
+        const vector<Cornu::Parameters::Parameter> &descs = Cornu::Parameters::parameters();
+        PyObject *out = PyList_New((Py_ssize_t)descs.size());
+        for(int i = 0; out && i < (int)descs.size(); ++i)
+            PyList_SET_ITEM(out, i, PyUnicode_FromString(descs[i].typeName.c_str()));
+        return out;
+    }
+
+    PyObject *presetNames(PyObject *, PyObject *)
+    {
+        const vector<Cornu::Parameters> &presets = Cornu::Parameters::presets();
+        PyObject *out = PyList_New((Py_ssize_t)presets.size());
+        for(int i = 0; out && i < (int)presets.size(); ++i)
+            PyList_SET_ITEM(out, i, PyUnicode_FromString(presets[i].name().c_str()));
+        return out;
+    }
+
+    PyMethodDef methods[] =
+    {
+        { "fit_batch", fitBatch, METH_VARARGS, "Fits a ragged batch of curves; see cornucopia.fit_batch." },
+        { "primitive_layout", primitiveLayout, METH_NOARGS, "The record size and fields of a fit primitive." },
+        { "parameter_names", parameterNames, METH_NOARGS, "The names of the parameters, in index order." },
+        { "preset_names", presetNames, METH_NOARGS, "The names of the parameter presets, in index order." },
+        { NULL, NULL, 0, NULL }
+    };
+
+    PyModuleDef module = { PyModuleDef_HEAD_INIT, "_cornucopia", "Cornucopia curve fitting (see cornucopia.py).", -1, methods };
+}
+
+PyMODINIT_FUNC PyInit__cornucopia()
+{
+    return PyModule_Create(&module);
+}
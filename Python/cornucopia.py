@@ -0,0 +1,91 @@
+#   cornucopia.py
+#
+#   This file is part of the Cornucopia curve sketching library.
+#   Copyright (C) 2010 Ilya Baran (baran37@gmail.com)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""NumPy bindings for Cornucopia.
+
+Points are N x 2 float64 or float32 arrays that are read in place (any row stride works, so slices don't need to be
+copied), a batch of curves is one points array split by offsets, and the fit primitives come back as a structured
+array with PRIMITIVE_DTYPE.  The fitting runs with the GIL released.
+
+    primitives, offsets, closed = cornucopia.fit_batch(points, offsets, preset='lines_and_arcs', num_threads=4)
+    for i in range(len(closed)):
+        curve = primitives[offsets[i]:offsets[i + 1]]
+
+Parameters are passed as keyword arguments named like the C++ ones, e.g., line_cost=10 for "Line cost".
+"""
+
+import re
+
+import numpy as np
+
+import _cornucopia
+
+LINE, ARC, CLOTHOID = 0, 1, 2
+
+_itemsize, _fields = _cornucopia.primitive_layout()
+PRIMITIVE_DTYPE = np.dtype({'names': [f[0] for f in _fields], 'formats': [f[1] for f in _fields],
+                            'offsets': [f[2] for f in _fields], 'itemsize': _itemsize})
+
+
+def _key(name):
+    # "Default (G2)" -> "default", "Lines And Arcs" -> "lines_and_arcs"
+    return re.sub(r'[\s-]+', '_', re.sub(r'\s*\(.*\)', '', name).strip()).lower()
+
+
+PARAMETERS = dict((_key(name), i) for i, name in enumerate(_cornucopia.parameter_names()))
+PRESETS = dict((_key(name), i) for i, name in enumerate(_cornucopia.preset_names()))
+
+
+def _points(points):
+    points = np.asarray(points)
+    if points.dtype not in (np.float64, np.float32):
+        points = points.astype(np.float64)
+    if points.ndim != 2 or points.shape[1] != 2:
+        raise ValueError('points must be an N x 2 array')
+    if any(s % points.itemsize for s in points.strides):
+        points = np.ascontiguousarray(points)
+    return points
+
+
+def fit_batch(points, offsets, preset='default', num_threads=0, **parameters):
+    """Fits the curves points[offsets[i]:offsets[i + 1]] for each i.
+
+    Returns (primitives, primitive_offsets, closed): the fit primitives of all curves as one PRIMITIVE_DTYPE array,
+    the offsets of each curve's primitives in it, and whether each curve was fit as closed.  num_threads=0 uses the
+    library's global thread pool.
+    """
+    if preset not in PRESETS:
+        raise ValueError('unknown preset %r; one of %s' % (preset, ', '.join(sorted(PRESETS))))
+    overrides = []
+    for name, value in parameters.items():
+        if name not in PARAMETERS:
+            raise ValueError('unknown parameter %r' % name)
+        overrides.append((PARAMETERS[name], float(value)))
+    offsets = np.ascontiguousarray(offsets, dtype=np.int64)
+
+    primitives, primitive_offsets, closed = _cornucopia.fit_batch(_points(points), offsets, PRESETS[preset],
+                                                                  overrides, int(num_threads))
+    return (np.frombuffer(primitives, dtype=PRIMITIVE_DTYPE), np.frombuffer(primitive_offsets, dtype=np.int64),
+            np.frombuffer(closed, dtype=np.uint8).astype(bool))
+
+
+def fit(points, preset='default', **parameters):
+    """Fits one curve and returns (primitives, closed)."""
+    points = _points(points)
+    primitives, _, closed = fit_batch(points, [0, len(points)], preset, 1, **parameters)
+    return primitives, bool(closed[0])
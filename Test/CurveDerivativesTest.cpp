@@ -22,6 +22,7 @@
 #include "Line.h"
 #include "Arc.h"
 #include "Clothoid.h"
+#include "PrimitiveSequence.h"
 
 #include <iostream>
 
@@ -41,6 +42,8 @@ public:
         testLine();
         testArc();
         testClothoid();
+        testBatch();
+        testDerivativeBatch();
     }
 
     void testLine()
@@ -160,6 +163,64 @@ public:
             }
         }
     }
+
+    //evalBatch should agree with eval (clothoid positions are only single-precision accurate)
+    void testBatch()
+    {
+        VectorC<CurvePrimitiveConstPtr> primitives(0, NOT_CIRCULAR);
+        primitives.push_back(new Line(Vector2d(1., 3.), Vector2d(3., 4.)));
+        primitives.push_back(new Arc(primitives.back()->endPos(), primitives.back()->endAngle(), 3., 0.1));
+        primitives.push_back(new Clothoid(primitives.back()->endPos(), primitives.back()->endAngle(), 5., 0.1, -0.2));
+        CurveConstPtr curves[4] = { primitives[0], primitives[1], primitives[2], new PrimitiveSequence(primitives) };
+
+        for(int c = 0; c < 4; ++c)
+        {
+            VectorXd s = VectorXd::LinSpaced(50, 0., curves[c]->length());
+            Matrix2Xd pos, der, der2;
+            curves[c]->evalBatch(s, &pos, &der, &der2);
+
+            for(int i = 0; i < (int)s.size(); ++i)
+            {
+                Vector2d p, d, d2;
+                curves[c]->eval(s[i], &p, &d, &d2);
+                CORNU_ASSERT_LT_MSG((p - pos.col(i)).norm(), 1e-5, "-- Curve = " << c << " s = " << s[i]);
+                CORNU_ASSERT_LT_MSG((d - der.col(i)).norm(), 1e-10, "-- Curve = " << c << " s = " << s[i]);
+                CORNU_ASSERT_LT_MSG((d2 - der2.col(i)).norm(), 1e-10, "-- Curve = " << c << " s = " << s[i]);
+            }
+        }
+    }
+
+    //derivativeBatch should agree with derivativeAt and eval
+    void testDerivativeBatch()
+    {
+        CurvePrimitiveConstPtr primitives[5] = { new Line(Vector2d(1., 3.), Vector2d(3., 4.)),
+                                                 new Arc(Vector2d(1., 3.), 0.5, 3., 0.1),
+                                                 new Clothoid(Vector2d(1., 3.), 0.5, 5., 0.1, -0.2),
+                                                 new Clothoid(Vector2d(1., 3.), 2.5, 4., -0.3, 0.5),
+                                                 new Clothoid(Vector2d(1., 3.), 0.5, 3., 0., 0.) };
+
+        for(int c = 0; c < 5; ++c)
+        {
+            VectorXd s = VectorXd::LinSpaced(37, 0., primitives[c]->length());
+            MatrixXd der, tanDer;
+            Matrix2Xd pos, tangent, der2;
+            primitives[c]->derivativeBatch(s, der, tanDer, &pos, &tangent, &der2);
+
+            for(int i = 0; i < (int)s.size(); ++i)
+            {
+                CurvePrimitive::ParamDer d, dTan;
+                primitives[c]->derivativeAt(s[i], d, dTan);
+                Vector2d p, t, t2;
+                primitives[c]->eval(s[i], &p, &t, &t2);
+
+                CORNU_ASSERT_LT_MSG((der.middleRows<2>(2 * i) - d).norm(), 1e-10, "-- Curve = " << c << " s = " << s[i]);
+                CORNU_ASSERT_LT_MSG((tanDer.middleRows<2>(2 * i) - dTan).norm(), 1e-10, "-- Curve = " << c << " s = " << s[i]);
+                CORNU_ASSERT_LT_MSG((p - pos.col(i)).norm(), 1e-10, "-- Curve = " << c << " s = " << s[i]);
+                CORNU_ASSERT_LT_MSG((t - tangent.col(i)).norm(), 1e-10, "-- Curve = " << c << " s = " << s[i]);
+                CORNU_ASSERT_LT_MSG((t2 - der2.col(i)).norm(), 1e-10, "-- Curve = " << c << " s = " << s[i]);
+            }
+        }
+    }
 };
 
 static CurveDerivativesTest test;
@@ -63,13 +63,25 @@ public:
 
         maxDot = 0;
 
+        Clothoid::resetProjectionStats();
         for(int i = 0; i < 200; ++i)
         {
             ClothoidPtr clothoid = new Clothoid(Vector2d(0.5, 1), 0.3, drand(0.01, 3.), drand(-5.1, 5.1), drand(-5.1, 5.1));
             testProject(clothoid);
         }
+        //tight spirals, outside the precomputed approximating arcs
+        for(int i = 0; i < 20; ++i)
+        {
+            ClothoidPtr clothoid = new Clothoid(Vector2d(0.5, 1), 0.3, drand(0.5, 4.), drand(-80., 80.), drand(-5.1, 5.1));
+            testProject(clothoid);
+        }
 
         Debugging::get()->printf("Projection max dot product = %.10lf", maxDot);
+
+        long long numProjections, numArcsTested;
+        Clothoid::getProjectionStats(numProjections, numArcsTested);
+        CORNU_ASSERT(numProjections > 0);
+        Debugging::get()->printf("Approximating arcs tested per clothoid projection = %.2lf", double(numArcsTested) / numProjections);
     }
 
     void testProject(CurvePtr curve)
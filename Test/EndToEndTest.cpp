@@ -18,10 +18,157 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
 #include "Test.h"
 #include "SimpleAPI.h" //just the simple API
+#include "ContourTracer.h"
 #include "Cornucopia.h" //includes everything necessary to use the library
+#include "GraphConstructor.h"
+#include "PrimitiveFitter.h"
+#include "PathFinder.h"
+#include "Combiner.h"
+#include "CornerDetector.h"
+#include "Oversketcher.h"
+#include "Preprocessing.h"
+#include "StreamingSimplifier.h"
+#include "StaticFitter.h"
+#include "StrokeCorpus.h"
+#include "ThreadPool.h"
+#include "Dataset.h"
+#include "ErrorComputer.h"
+#include "Resampler.h"
+
+//counts the debugging calls the library makes
+class CountingDebugging : public Cornu::Debugging
+{
+public:
+    CountingDebugging(bool on) : numCalls(0), _on(on) {}
+
+    //overrides
+    bool isDebuggingOn() const { return _on; }
+    void printf(const char *, ...) { ++numCalls; }
+    void drawCurve(Cornu::CurveConstPtr, const Color &, const std::string &, double, LineStyle) { ++numCalls; }
+
+    int numCalls;
+
+private:
+    bool _on;
+};
+
+//runs the loops on the calling thread, counting the tasks
+class CountingExecutor : public Cornu::Executor
+{
+public:
+    CountingExecutor() : numTasks(0) {}
+
+    std::atomic<int> numTasks;
+
+protected:
+    void _run(int count, const std::function<void(int)> &task) //override
+    {
+        for(int i = 0; i < count; ++i)
+        {
+            ++numTasks;
+            task(i);
+        }
+    }
+};
+
+//runs tasks inline and sets the cancel flag on the first parallel loop after the graph is built, i.e., when the
+//path finder validates the edges of its first path, in the middle of a stage
+class CancellingExecutor : public Cornu::Executor
+{
+public:
+    CancellingExecutor(std::atomic<bool> &cancel) : fitter(NULL), _cancel(cancel) {}
+
+    const Cornu::Fitter *fitter;
+
+protected:
+    //overrides
+    void _run(int count, const std::function<void(int)> &task)
+    {
+        if(fitter && fitter->output<Cornu::GRAPH_CONSTRUCTION>())
+            _cancel = true;
+        for(int i = 0; i < count; ++i)
+            task(i);
+    }
+
+private:
+    std::atomic<bool> &_cancel;
+};
+
+//keeps submitted tasks until told to run them
+class DeferringExecutor : public Cornu::Executor
+{
+public:
+    void runSubmitted()
+    {
+        for(int i = 0; i < (int)_tasks.size(); ++i)
+            _tasks[i]();
+        _tasks.clear();
+    }
+
+protected:
+    //overrides
+    void _run(int count, const std::function<void(int)> &task) { for(int i = 0; i < count; ++i) task(i); }
+    void _submit(const std::function<void()> &task) { _tasks.push_back(task); }
+
+private:
+    std::vector<std::function<void()> > _tasks;
+};
+
+//counts the bytes it hands out and refuses to go past its budget
+class BudgetAllocator : public Cornu::Allocator
+{
+public:
+    BudgetAllocator(long long budget) : liveBytes(0), numAllocations(0), _budget(budget) {}
+
+    std::atomic<long long> liveBytes;
+    std::atomic<int> numAllocations;
+
+    //overrides
+    void *allocate(size_t size, size_t alignment)
+    {
+        if(liveBytes + (long long)size > _budget)
+            throw std::bad_alloc();
+        liveBytes += size;
+        ++numAllocations;
+        return Cornu::Allocator::standard().allocate(size, alignment);
+    }
+    void deallocate(void *ptr, size_t size, size_t alignment)
+    {
+        liveBytes -= size;
+        Cornu::Allocator::standard().deallocate(ptr, size, alignment);
+    }
+
+private:
+    long long _budget;
+};
+
+//evaluates on the CPU, like a GPU backend would in batches, counting them
+class CountingErrorBackend : public Cornu::ErrorBackend
+{
+public:
+    CountingErrorBackend() : numBatches(0), numCandidates(0), largestBatch(0) {}
+
+    std::atomic<int> numBatches, numCandidates, largestBatch;
+
+    //override
+    void computeErrorsForCost(const Cornu::ErrorComputer &errorComputer, const Cornu::Polyline &samples,
+                              const Cornu::ErrorCandidate *candidates, int count, double cutoff, double *outErrors)
+    {
+        ++numBatches;
+        numCandidates += count;
+        int largest = largestBatch;
+        while(count > largest && !largestBatch.compare_exchange_weak(largest, count)) {}
+        Cornu::ErrorBackend::cpu().computeErrorsForCost(errorComputer, samples, candidates, count, cutoff, outErrors);
+    }
+};
 
 class EndToEndTest : public TestCase
 {
@@ -33,6 +180,46 @@ public:
     void run()
     {
         simpleAPITest();
+        batchAPITest();
+        executorTest();
+        oversketchBatchTest();
+        bufferAPITest();
+        imageTest();
+        evalBatchTest();
+        incrementalTest();
+        invalidationTest();
+        cancelTest();
+        asyncTest();
+        schedulerTest();
+        metricsTest();
+        traceTest();
+        debuggingTest();
+        snapshotTest();
+        slowCaptureTest();
+        allocatorTest();
+        performanceTest();
+        leanTest();
+        resetTest();
+        cacheTest();
+        forkTest();
+        graphBudgetTest();
+        combineCacheTest();
+        previousPathTest();
+        alternativesTest();
+        singlePrecisionTest();
+        errorBackendTest();
+        warmErrorVectorTest();
+        momentErrorTest();
+        splitAtCornersTest();
+        coarseToFineTest();
+        streamingPrelimTest();
+        inputDecimationTest();
+        curveClosingTest();
+        datasetTest();
+        deadlineTest();
+        staticFitterTest();
+        pipelineTest();
+        simplifierTest();
         fullAPITest();
     }
 
@@ -62,6 +249,1633 @@ public:
         Cornu::Debugging::get()->printf("Conversion to Bezier results in %d segments\n", bezier.size());
     }
 
+    void batchAPITest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::Parameters params;
+        std::vector<std::vector<Cornu::Point> > strokes(20);
+
+        for(int i = 0; i < (int)strokes.size(); ++i)
+        {
+            for(int j = 0; j < 100; ++j)
+            {
+                double t = double(j) / 99.;
+                strokes[i].push_back(Cornu::Point(100. + 300. * t, 100. + (20. + 2. * i) * sin(3. * t + 0.1 * i)));
+            }
+        }
+
+        std::vector<bool> closed;
+        std::vector<std::vector<Cornu::BasicPrimitive> > result = Cornu::fitBatch(strokes, params, &closed);
+
+        CORNU_ASSERT(result.size() == strokes.size() && closed.size() == strokes.size());
+        for(int i = 0; i < (int)strokes.size(); ++i)
+        {
+            bool isClosed;
+            std::vector<Cornu::BasicPrimitive> single = Cornu::fit(strokes[i], params, &isClosed);
+
+            CORNU_ASSERT_MSG(single.size() == result[i].size() && isClosed == closed[i], "Batch result differs for stroke " << i);
+            for(int j = 0; j < (int)single.size(); ++j)
+            {
+                CORNU_ASSERT_MSG(single[j].type == result[i][j].type && single[j].length == result[i][j].length,
+                                 "Batch result differs for stroke " << i << " primitive " << j);
+            }
+        }
+
+        //the same strokes as one ragged array of interleaved coordinates
+        std::vector<double> xy;
+        std::vector<long long> offsets(1, 0);
+        for(int i = 0; i < (int)strokes.size(); ++i)
+        {
+            for(int j = 0; j < (int)strokes[i].size(); ++j)
+            {
+                xy.push_back(strokes[i][j].x);
+                xy.push_back(strokes[i][j].y);
+            }
+            offsets.push_back(offsets.back() + (long long)strokes[i].size());
+        }
+        std::vector<Cornu::BasicPrimitive> primitives;
+        std::vector<long long> primitiveOffsets;
+        std::vector<bool> raggedClosed;
+        Cornu::fitBatch(xy.data(), xy.data() + 1, 2, offsets.data(), (int)strokes.size(), params, primitives, primitiveOffsets, &raggedClosed);
+        CORNU_ASSERT(primitiveOffsets.size() == strokes.size() + 1 && raggedClosed == closed);
+        CORNU_ASSERT(primitiveOffsets.back() == (long long)primitives.size());
+        for(int i = 0; i < (int)strokes.size(); ++i)
+        {
+            CORNU_ASSERT_MSG(primitiveOffsets[i + 1] - primitiveOffsets[i] == (long long)result[i].size(), "Ragged batch result differs for stroke " << i);
+            for(int j = 0; j < (int)result[i].size(); ++j)
+                CORNU_ASSERT(primitives[primitiveOffsets[i] + j].length == result[i][j].length);
+        }
+    }
+
+    void executorTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::Parameters params;
+        params.set(Cornu::Parameters::MULTITHREADED, 1.);
+        std::vector<std::vector<Cornu::Point> > strokes(4);
+        for(int i = 0; i < (int)strokes.size(); ++i)
+            for(int j = 0; j < 100; ++j)
+                strokes[i].push_back(Cornu::Point(100. + 3. * j, 100. + (20. + 5. * i) * sin(0.03 * j + 0.2 * i)));
+
+        //the batch and the parallel loops of each fit all go to the executor
+        CountingExecutor executor;
+        std::vector<std::vector<Cornu::BasicPrimitive> > result = Cornu::fitBatch(strokes, params, executor);
+        CORNU_ASSERT_MSG(executor.numTasks > (int)strokes.size(), "Only " << executor.numTasks << " tasks ran on the executor");
+        for(int i = 0; i < (int)strokes.size(); ++i)
+        {
+            std::vector<Cornu::BasicPrimitive> single = Cornu::fit(strokes[i], params);
+            CORNU_ASSERT_MSG(single.size() == result[i].size(), "Executor result differs for stroke " << i);
+        }
+
+        //a fitter can be kept off other threads altogether
+        Cornu::VectorC<Eigen::Vector2d> pts((int)strokes[0].size(), Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(strokes[0][i].x, strokes[0][i].y);
+        Cornu::Fitter fitter;
+        fitter.setParams(params);
+        fitter.setExecutor(&Cornu::Executor::serial());
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        CORNU_ASSERT(fitter.finalOutput() && (int)fitter.finalOutput()->primitives().size() == (int)result[0].size());
+    }
+
+    void oversketchBatchTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        //two independent chains: a stroke extended twice and a stroke extended once
+        Cornu::Parameters params;
+        std::vector<std::vector<Cornu::Point> > strokes(5);
+        for(int j = 0; j < 60; ++j)
+        {
+            double t = double(j) / 59.;
+            strokes[0].push_back(Cornu::Point(100. + 200. * t, 100. + 30. * sin(3. * t)));
+            strokes[1].push_back(Cornu::Point(100. + 200. * t, 300. + 20. * t * t));
+            strokes[2].push_back(Cornu::Point(290. + 150. * t, 100. + 30. * sin(3. + 2. * t)));
+            strokes[3].push_back(Cornu::Point(290. + 150. * t, 320. - 30. * t));
+            strokes[4].push_back(Cornu::Point(430. + 100. * t, 70. + 40. * t));
+        }
+        int oversketch[5] = { -1, -1, 0, 1, 2 };
+
+        std::vector<bool> closed;
+        std::vector<std::vector<Cornu::BasicPrimitive> > result =
+            Cornu::fitBatch(strokes, std::vector<int>(oversketch, oversketch + 5), params, &closed, 3);
+        CORNU_ASSERT(result.size() == strokes.size() && closed.size() == strokes.size());
+
+        //the same chains fit one after another
+        std::vector<Cornu::PrimitiveSequenceConstPtr> curves(strokes.size());
+        for(int i = 0; i < (int)strokes.size(); ++i)
+        {
+            Cornu::VectorC<Eigen::Vector2d> pts((int)strokes[i].size(), Cornu::NOT_CIRCULAR);
+            for(int j = 0; j < pts.size(); ++j)
+                pts[j] = Eigen::Vector2d(strokes[i][j].x, strokes[i][j].y);
+
+            Cornu::Fitter fitter;
+            fitter.setParams(params);
+            fitter.setDebugging(Debugging::silent());
+            fitter.setOriginalSketch(new Cornu::Polyline(pts));
+            if(oversketch[i] >= 0)
+                fitter.setOversketchBase(curves[oversketch[i]]);
+            fitter.run();
+            curves[i] = fitter.finalOutput();
+
+            CORNU_ASSERT_MSG(curves[i] && curves[i]->primitives().size() == (int)result[i].size(), "Oversketch batch result differs for stroke " << i);
+            //the primitives of the base that the extension doesn't reach are shared, not copied
+            Cornu::PrimitiveSequenceConstPtr kept = fitter.output<Cornu::OVERSKETCHING>()->toPrepend;
+            for(int j = 0; kept && j + 1 < kept->primitives().size(); ++j)
+                CORNU_ASSERT_MSG(curves[i]->primitives()[j] == curves[oversketch[i]]->primitives()[j], "Oversketch copied base primitive " << j);
+            for(int j = 0; j < (int)result[i].size(); ++j)
+                CORNU_ASSERT_MSG(fabs(curves[i]->primitives()[j]->length() - result[i][j].length) < 1e-8,
+                                 "Oversketch batch result differs for stroke " << i << " primitive " << j);
+        }
+        CORNU_ASSERT(curves[4]->length() > curves[2]->length() && curves[2]->length() > curves[0]->length());
+    }
+
+    void bufferAPITest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::Parameters params;
+        std::vector<Cornu::Point> pts;
+        std::vector<float> xy;
+        for(int i = 0; i < 100; ++i)
+        {
+            double t = double(i) / 99.;
+            pts.push_back(Cornu::Point(100. + 300. * t, 100. + 30. * sin(4. * t)));
+            xy.push_back((float)pts.back().x);
+            xy.push_back((float)pts.back().y);
+        }
+        std::vector<Cornu::BasicPrimitive> expected = Cornu::fit(pts, params);
+        CORNU_ASSERT(!expected.empty());
+
+        //double coordinates in separate arrays
+        std::vector<Cornu::BasicPrimitive> result(expected.size());
+        int num = Cornu::fit(&pts[0].x, &pts[0].y, 2, (int)pts.size(), params, &result[0], (int)result.size());
+        CORNU_ASSERT(num == (int)expected.size());
+        for(int i = 0; i < num; ++i)
+            CORNU_ASSERT_MSG(result[i].type == expected[i].type && result[i].length == expected[i].length, "Buffer result differs at primitive " << i);
+
+        //interleaved floats into a buffer that is too small
+        Cornu::BasicPrimitive unused;
+        CORNU_ASSERT(Cornu::fit(&xy[0], &xy[1], 2, (int)pts.size(), params, &unused, 0) == (int)expected.size());
+
+        std::vector<Cornu::BasicBezier> bezier = Cornu::toBezierSpline(expected, 1.);
+        std::vector<Cornu::BasicBezier> bezierBuffer(bezier.size());
+        CORNU_ASSERT(Cornu::toBezierSpline(&expected[0], (int)expected.size(), 1., &bezierBuffer[0], (int)bezierBuffer.size()) == (int)bezier.size());
+        CORNU_ASSERT(bezierBuffer.back().controlPoint[3].x == bezier.back().controlPoint[3].x);
+
+        //vertex buffers, first just counting
+        int numVertices = Cornu::tessellate(&expected[0], (int)expected.size(), 0.1, (Cornu::CurveVertex *)NULL, 0);
+        CORNU_ASSERT(numVertices > (int)expected.size());
+        std::vector<Cornu::QuantizedCurveVertex> vertices(numVertices);
+        double bounds[4], length;
+        CORNU_ASSERT(Cornu::tessellate(&expected[0], (int)expected.size(), 0.1, &vertices[0], numVertices, bounds, &length) == numVertices);
+        CORNU_ASSERT(vertices[0].arcLength == 0 && vertices.back().arcLength == 65535);
+        double endX = bounds[0] + (bounds[2] - bounds[0]) * vertices.back().pos[0] / 65535.;
+        Cornu::Point end;
+        expected.back().eval(expected.back().length, &end);
+        CORNU_ASSERT_LT_MSG(fabs(endX - end.x), 0.01, "Quantized vertex is off");
+    }
+
+    void imageTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        //an antialiased ring that crosses several tiles and a bar that runs off the left side
+        const int width = 600, height = 400;
+        const double cx = 256.3, cy = 200.7;
+        std::vector<unsigned char> pixels(width * height);
+        for(int y = 0; y < height; ++y)
+        {
+            for(int x = 0; x < width; ++x)
+            {
+                double d = sqrt(Cornu::SQR(x + 0.5 - cx) + Cornu::SQR(y + 0.5 - cy));
+                double paper = std::min(1., std::max(0., fabs(d - 105.) - 15. + 0.5));
+                if(y >= 340 && y < 360 && x < 300)
+                    paper = 0.;
+                pixels[y * width + x] = (unsigned char)(255. * paper + 0.5);
+            }
+        }
+
+        Cornu::ImageContours contours, smallTiles;
+        Cornu::traceContours(&pixels[0], width, height, width, 128., contours, Cornu::Executor::serial());
+        Cornu::traceContours(&pixels[0], width, height, width, 128., smallTiles, Cornu::ThreadPool::global(), 8, 37);
+        CORNU_ASSERT(contours.numContours() == 3 && smallTiles.numContours() == 3);
+        CORNU_ASSERT_MSG(contours.xy.size() == smallTiles.xy.size(), "Contours depend on how the image is tiled");
+        Cornu::ImageContours noTiles;
+        Cornu::traceContours(&pixels[0], width, height, width, 128., noTiles, Cornu::Executor::serial(), 8, 0); //taken as 1
+        CORNU_ASSERT(noTiles.xy.size() == contours.xy.size());
+        int numClosed = 0;
+        for(int i = 0; i < smallTiles.numContours(); ++i)
+            numClosed += smallTiles.closed[i];
+        CORNU_ASSERT_MSG(numClosed == 2, "The ring's outlines should be closed and the bar's open");
+        numClosed = 0;
+        for(int i = 0; i < contours.numContours(); ++i)
+        {
+            if(!contours.closed[i])
+                continue;
+            ++numClosed;
+            long long first = contours.offsets[i], last = contours.offsets[i + 1] - 1;
+            CORNU_ASSERT(contours.xy[2 * first] == contours.xy[2 * last] && contours.xy[2 * first + 1] == contours.xy[2 * last + 1]);
+            for(long long j = first; j <= last; ++j)
+            {
+                double d = sqrt(Cornu::SQR(contours.xy[2 * j] - cx) + Cornu::SQR(contours.xy[2 * j + 1] - cy));
+                CORNU_ASSERT_LT_MSG(std::min(fabs(d - 90.), fabs(d - 120.)), 0.25, "Traced contour is off the ring");
+            }
+        }
+        CORNU_ASSERT_MSG(numClosed == 2, "The ring's outlines should be closed and the bar's open");
+
+        //and fitting them gives two circles and an open curve
+        Cornu::VectorizedImage image;
+        Cornu::vectorizeImage(&pixels[0], width, height, width, Cornu::Parameters(), image);
+        CORNU_ASSERT(image.numCurves() == 3 && image.offsets.size() == 4);
+        for(int i = 0; i < image.numCurves(); ++i)
+        {
+            CORNU_ASSERT(image.offsets[i + 1] > image.offsets[i]);
+            CORNU_ASSERT(image.closed[i] == contours.closed[i]);
+            for(long long j = image.offsets[i]; image.closed[i] && j < image.offsets[i + 1]; ++j)
+            {
+                const Cornu::BasicPrimitive &primitive = image.primitives[j];
+                Cornu::Point pos;
+                primitive.eval(primitive.length * 0.5, &pos);
+                double d = sqrt(Cornu::SQR(pos.x - cx) + Cornu::SQR(pos.y - cy));
+                CORNU_ASSERT_LT_MSG(std::min(fabs(d - 90.), fabs(d - 120.)), 1., "Fit curve is off the ring");
+            }
+        }
+
+        //a curve known to be closed is fit as closed even if its ends are too far apart to tell
+        std::vector<double> arc;
+        for(int i = 0; i <= 100; ++i)
+        {
+            arc.push_back(50. * cos(i * 0.05));
+            arc.push_back(50. * sin(i * 0.05));
+        }
+        long long arcOffsets[] = { 0, 101 };
+        std::vector<Cornu::BasicPrimitive> primitives;
+        std::vector<long long> primitiveOffsets;
+        std::vector<bool> arcClosed, known(1, true);
+        Cornu::fitBatch(&arc[0], &arc[1], 2, arcOffsets, 1, Cornu::Parameters(), primitives, primitiveOffsets, &arcClosed);
+        CORNU_ASSERT(arcClosed.size() == 1 && !arcClosed[0]);
+        Cornu::fitBatch(&arc[0], &arc[1], 2, arcOffsets, 1, Cornu::Parameters(), primitives, primitiveOffsets, &arcClosed, 0, &known);
+        CORNU_ASSERT_MSG(arcClosed[0] && primitiveOffsets[1] > 0, "Curve given as closed was fit as open");
+        Cornu::Point start, end;
+        primitives[0].eval(0., &start);
+        primitives.back().eval(primitives.back().length, &end);
+        CORNU_ASSERT_LT_MSG(sqrt(Cornu::SQR(start.x - end.x) + Cornu::SQR(start.y - end.y)), 1e-3, "Closed curve has a gap");
+    }
+
+    void evalBatchTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::BasicPrimitive prims[3];
+        for(int i = 0; i < 3; ++i)
+        {
+            prims[i].type = Cornu::BasicPrimitive::PrimitiveType(i);
+            prims[i].start = Cornu::Point(10. * i, 5.);
+            prims[i].length = 50. + 20. * i;
+            prims[i].startAngle = 0.3 * i;
+            prims[i].startCurvature = i ? 0.01 : 0.;
+            prims[i].curvatureDerivative = i == 2 ? 0.001 : 0.;
+        }
+
+        const int samples = 17;
+        Cornu::Point pos[3 * samples], der[3 * samples], der2[3 * samples];
+        Cornu::tessellate(prims, 3, samples, pos, der, der2);
+
+        for(int i = 0; i < 3 * samples; ++i)
+        {
+            const Cornu::BasicPrimitive &prim = prims[i / samples];
+            Cornu::Point p, d, d2;
+            prim.eval(prim.length * (i % samples) / (samples - 1.), &p, &d, &d2);
+            double err = fabs(p.x - pos[i].x) + fabs(p.y - pos[i].y) + fabs(d.x - der[i].x) + fabs(d.y - der[i].y) +
+                         fabs(d2.x - der2[i].x) + fabs(d2.y - der2[i].y);
+            CORNU_ASSERT_LT_MSG(err, 1e-8, "Batch evaluation differs at sample " << i);
+        }
+
+        double s[2] = { 5., 40. };
+        Cornu::Point single[2];
+        prims[2].evalBatch(s, 2, single);
+        Cornu::Point p;
+        prims[2].eval(40., &p);
+        CORNU_ASSERT_LT_MSG(fabs(p.x - single[1].x) + fabs(p.y - single[1].y), 1e-8, "evalBatch differs from eval");
+    }
+
+    void incrementalTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::IncrementalFitter fitter;
+        for(int i = 0; i < 300; ++i)
+        {
+            double t = double(i) / 299.;
+            fitter.addPoint(Eigen::Vector2d(100. + 300. * t, 100. + 30. * sin(6. * t)));
+            if(i % 10 != 9)
+                continue;
+
+            Cornu::PrimitiveSequenceConstPtr curve = fitter.update();
+            CORNU_ASSERT_MSG(curve, "Incremental fit failed after " << (i + 1) << " points");
+            CORNU_ASSERT_MSG((int)fitter.originalSketchToFinalParameters().size() == fitter.points().size(), "Wrong number of parameters");
+            CORNU_ASSERT_LT_MSG((curve->endPos() - fitter.points().back()).norm(), 10., "Curve does not follow the sketch");
+        }
+
+        //points pushed from another thread all arrive, in order, however the updates interleave with them
+        Cornu::PointQueue queue(16);
+        std::atomic<bool> producerDone(false);
+        std::thread producer([&]()
+        {
+            for(int i = 0; i < 300; ++i)
+            {
+                double t = double(i) / 299.;
+                while(!queue.push(Eigen::Vector2d(100. + 300. * t, 100. + 30. * sin(6. * t))))
+                    std::this_thread::yield();
+            }
+            producerDone = true;
+        });
+        Cornu::IncrementalFitter queueFitter;
+        Cornu::PrimitiveSequenceConstPtr curve;
+        while(true)
+        {
+            bool last = producerDone; //read before draining, so no points can be left behind
+            curve = queueFitter.update(queue);
+            if(last)
+                break;
+        }
+        producer.join();
+        CORNU_ASSERT(queue.empty() && queueFitter.points().size() == fitter.points().size() && curve);
+        for(int i = 0; i < fitter.points().size(); ++i)
+            CORNU_ASSERT_MSG(queueFitter.points()[i] == fitter.points()[i], "Queued point " << i << " differs");
+        CORNU_ASSERT_LT_MSG((curve->endPos() - queueFitter.points().back()).norm(), 10., "Curve does not follow the sketch");
+    }
+
+    void invalidationTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(100, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = double(i) / 99.;
+            pts[i] = Eigen::Vector2d(100. + 300. * t, 100. + 30. * sin(4. * t));
+        }
+
+        Cornu::Fitter fitter;
+        Cornu::Parameters params;
+        fitter.setParams(params);
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+
+        //changing a finite cost should only invalidate the graph and later stages
+        Cornu::smart_ptr<const Cornu::AlgorithmOutput<Cornu::PRIMITIVE_FITTING> > primitives = fitter.output<Cornu::PRIMITIVE_FITTING>();
+        params.set(Cornu::Parameters::ERROR_COST, 2.);
+        fitter.setParams(params);
+        CORNU_ASSERT(fitter.output<Cornu::PRIMITIVE_FITTING>() == primitives && !fitter.output<Cornu::GRAPH_CONSTRUCTION>());
+        fitter.run();
+
+        Cornu::Fitter fresh;
+        fresh.setParams(params);
+        fresh.setOriginalSketch(new Cornu::Polyline(pts));
+        fresh.run();
+        CORNU_ASSERT(fresh.finalOutput());
+        CORNU_ASSERT(fitter.finalOutput());
+        CORNU_ASSERT_MSG(fresh.finalOutput()->primitives().size() == fitter.finalOutput()->primitives().size(), "Partial refit differs from a full fit");
+
+        //disabling lines changes what the primitive fitter does
+        params.set(Cornu::Parameters::LINE_COST, Cornu::Parameters::infinity);
+        fitter.setParams(params);
+        CORNU_ASSERT(!fitter.output<Cornu::PRIMITIVE_FITTING>() && fitter.output<Cornu::ERROR_COMPUTER>());
+    }
+
+    void cancelTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(100, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(100. + 3. * i, 100. + 30. * sin(0.04 * i));
+
+        std::atomic<bool> cancel(true);
+        Cornu::Fitter fitter;
+        fitter.setCancelFlag(&cancel);
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        CORNU_ASSERT(fitter.cancelled() && !fitter.output<Cornu::SCALE_DETECTION>() && !fitter.finalOutput());
+
+        cancel = false;
+        fitter.run();
+        CORNU_ASSERT(!fitter.cancelled() && fitter.finalOutput());
+
+        //a cancelled refit keeps the stages that are still valid and the next run finishes it
+        Cornu::smart_ptr<const Cornu::AlgorithmOutput<Cornu::PRIMITIVE_FITTING> > primitives = fitter.output<Cornu::PRIMITIVE_FITTING>();
+        Cornu::Parameters params;
+        params.set(Cornu::Parameters::ERROR_COST, 2.);
+        fitter.setParams(params);
+        cancel = true;
+        fitter.run();
+        CORNU_ASSERT(fitter.output<Cornu::PRIMITIVE_FITTING>() == primitives && !fitter.finalOutput());
+        cancel = false;
+        fitter.run();
+        CORNU_ASSERT(fitter.output<Cornu::PRIMITIVE_FITTING>() == primitives && fitter.finalOutput());
+
+        //a stage cancelled partway through is left invalid; the stroke is wiggly enough for the first path to have
+        //several edges to validate
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(100. + 3. * i, 100. + 30. * sin(0.1 * i));
+        CancellingExecutor cancelling(cancel);
+        Cornu::Fitter midStage;
+        params.set(Cornu::Parameters::MULTITHREADED, 1.); //so that the path finder validates edges on the executor
+        midStage.setParams(params);
+        midStage.setExecutor(&cancelling);
+        midStage.setCancelFlag(&cancel);
+        midStage.setOriginalSketch(new Cornu::Polyline(pts));
+        cancelling.fitter = &midStage;
+        midStage.run();
+        CORNU_ASSERT(cancel && midStage.output<Cornu::GRAPH_CONSTRUCTION>() && !midStage.output<Cornu::PATH_FINDING>() && !midStage.finalOutput());
+        cancel = false;
+        cancelling.fitter = NULL;
+        midStage.run();
+        CORNU_ASSERT(midStage.output<Cornu::PATH_FINDING>() && midStage.finalOutput());
+    }
+
+    void asyncTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        std::vector<Cornu::Point> points;
+        for(int i = 0; i < 100; ++i)
+            points.push_back(Cornu::Point(100. + 3. * i, 100. + 30. * sin(0.04 * i)));
+        Cornu::Parameters params;
+        params.set(Cornu::Parameters::MULTITHREADED, 1.);
+
+        bool closed = true, asyncClosed = false;
+        std::vector<Cornu::BasicPrimitive> single = Cornu::fit(points, params, &closed);
+        Cornu::AsyncFit fit = Cornu::fitAsync(points, params);
+        const std::vector<Cornu::BasicPrimitive> &result = fit.get(&asyncClosed);
+        CORNU_ASSERT(fit.ready() && !result.empty() && result.size() == single.size() && asyncClosed == closed);
+        for(int i = 0; i < (int)single.size(); ++i)
+            CORNU_ASSERT_MSG(single[i].type == result[i].type && single[i].length == result[i].length, "Async result differs at primitive " << i);
+
+        //a fit cancelled before it starts finishes right away with nothing
+        DeferringExecutor executor;
+        Cornu::AsyncFit cancelled = Cornu::fitAsync(points, params, executor), notCancelled = Cornu::fitAsync(points, params, executor);
+        CORNU_ASSERT(!cancelled.ready());
+        cancelled.cancel();
+        executor.runSubmitted();
+        CORNU_ASSERT(cancelled.ready() && cancelled.get().empty() && notCancelled.get().size() == single.size());
+    }
+
+    void schedulerTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+        using Cornu::FitScheduler;
+
+        std::vector<Cornu::Point> points;
+        for(int i = 0; i < 100; ++i)
+            points.push_back(Cornu::Point(100. + 3. * i, 100. + 30. * sin(0.04 * i)));
+        Cornu::Parameters params;
+        std::vector<Cornu::BasicPrimitive> single = Cornu::fit(points, params);
+
+        //with one thread, an interactive fit submitted behind many bulk ones overtakes them
+        const int numBulk = 20;
+        FitScheduler scheduler(1);
+        std::vector<Cornu::AsyncFit> bulk;
+        for(int i = 0; i < numBulk; ++i)
+            bulk.push_back(scheduler.fit(points, params, FitScheduler::BULK));
+        Cornu::AsyncFit interactive = scheduler.fit(points, params, FitScheduler::INTERACTIVE);
+        CORNU_ASSERT(interactive.get().size() == single.size() && !bulk.back().ready());
+
+        for(int i = 0; i < numBulk; ++i)
+            CORNU_ASSERT_MSG(bulk[i].get().size() == single.size(), "Bulk fit " << i << " differs");
+
+        FitScheduler::Stats interactiveStats = scheduler.stats(FitScheduler::INTERACTIVE), bulkStats = scheduler.stats(FitScheduler::BULK);
+        CORNU_ASSERT(interactiveStats.numFits == 1 && interactiveStats.numPreemptions == 0 && bulkStats.numFits == numBulk);
+        CORNU_ASSERT(bulkStats.maxQueueWait > interactiveStats.maxQueueWait && bulkStats.totalServiceTime > 0.);
+        CORNU_ASSERT(bulkStats.maxServiceTime <= bulkStats.totalServiceTime && bulkStats.maxQueueWait <= bulkStats.totalQueueWait);
+    }
+
+    void metricsTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+        using Cornu::FitMetrics;
+
+        Cornu::VectorC<Eigen::Vector2d> pts(100, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = double(i) / 99.;
+            pts[i] = Eigen::Vector2d(100. + 300. * t, 100. + 30. * sin(4. * t));
+        }
+
+        Cornu::Fitter fitter;
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+
+        const FitMetrics &metrics = fitter.metrics();
+        double stageTotal = 0.;
+        for(int i = 0; i < Cornu::NUM_ALGORITHM_STAGES; ++i)
+            stageTotal += metrics.stageTime((Cornu::AlgorithmStage)i);
+        CORNU_ASSERT(metrics.stageTime(Cornu::PRIMITIVE_FITTING) > 0. && stageTotal <= metrics.totalTime());
+
+        CORNU_ASSERT(metrics.counter(FitMetrics::CANDIDATE_PRIMITIVES) == (int)fitter.output<Cornu::PRIMITIVE_FITTING>()->primitives.size());
+        CORNU_ASSERT(metrics.counter(FitMetrics::GRAPH_EDGES) == fitter.output<Cornu::GRAPH_CONSTRUCTION>()->numEdges());
+        CORNU_ASSERT(metrics.counter(FitMetrics::GRAPH_VERTICES) > 0 && metrics.counter(FitMetrics::PATH_FINDER_ITERATIONS) > 0);
+        CORNU_ASSERT(metrics.counter(FitMetrics::EDGE_VALIDATIONS) == fitter.output<Cornu::PATH_FINDING>()->numValidations);
+        CORNU_ASSERT(metrics.counter(FitMetrics::EDGE_INVALIDATIONS) <= metrics.counter(FitMetrics::EDGE_VALIDATIONS));
+        CORNU_ASSERT_MSG(metrics.invalidationRate() < 0.5, metrics.invalidationRate()); //the predicted costs should mostly hold up
+        CORNU_ASSERT(metrics.counter(FitMetrics::SOLVER_ITERATIONS) >= fitter.output<Cornu::COMBINING>()->numIterations);
+
+        //only the stages that run count
+        Cornu::Parameters params;
+        params.set(Cornu::Parameters::ERROR_COST, 2.);
+        fitter.setParams(params);
+        fitter.run();
+        CORNU_ASSERT(fitter.metrics().stageTime(Cornu::PRIMITIVE_FITTING) == 0. && fitter.metrics().counter(FitMetrics::CANDIDATE_PRIMITIVES) == 0);
+        CORNU_ASSERT(fitter.metrics().counter(FitMetrics::GRAPH_EDGES) > 0);
+    }
+
+    void traceTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+        using Cornu::Trace;
+
+        Cornu::VectorC<Eigen::Vector2d> pts(100, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = double(i) / 99.;
+            pts[i] = Eigen::Vector2d(100. + 300. * t, 100. + 30. * sin(4. * t));
+        }
+
+        Trace::clear();
+        Cornu::Fitter fitter;
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        CORNU_ASSERT(Trace::numEvents() == 0); //disabled by default
+
+        Trace::setEnabled(true);
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        Trace::setEnabled(false);
+#ifndef CORNUCOPIA_NO_TRACE
+        CORNU_ASSERT(Trace::numEvents() > Cornu::NUM_ALGORITHM_STAGES);
+
+        std::ostringstream json;
+        Trace::writeChromeJson(json);
+        CORNU_ASSERT(json.str().find("\"name\":\"Fitter::run\",\"ph\":\"X\"") != std::string::npos);
+        CORNU_ASSERT(json.str().find("\"name\":\"Path Finding\"") != std::string::npos);
+#else
+        CORNU_ASSERT(Trace::numEvents() == 0); //the scopes are compiled out
+#endif
+
+        Trace::clear();
+        CORNU_ASSERT(Trace::numEvents() == 0);
+    }
+
+    void debuggingTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(100, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(100. + 3. * i, 100. + 30. * sin(0.04 * i));
+
+        CountingDebugging off(false), on(true);
+        Cornu::Fitter fitter;
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.setDebugging(&off);
+        fitter.run();
+        CORNU_ASSERT(off.numCalls == 0);
+
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.setDebugging(&on);
+        fitter.run();
+#ifdef CORNUCOPIA_NO_DEBUGGING
+        CORNU_ASSERT(on.numCalls == 0);
+#else
+        CORNU_ASSERT(on.numCalls > 0);
+#endif
+    }
+
+    void snapshotTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(150, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(100. + 3. * i, 100. + 40. * sin(0.05 * i));
+
+        Cornu::Fitter fitter;
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        CORNU_ASSERT(fitter.finalOutput());
+
+        for(int stage = Cornu::SCALE_DETECTION; stage < Cornu::NUM_ALGORITHM_STAGES; ++stage)
+        {
+            std::stringstream snapshot;
+            CORNU_ASSERT(fitter.writeSnapshot(snapshot, (Cornu::AlgorithmStage)stage));
+
+            Cornu::Fitter replay;
+            CORNU_ASSERT(replay.loadSnapshot(snapshot));
+            replay.run();
+            for(int i = 0; i < Cornu::NUM_ALGORITHM_STAGES; ++i)
+                CORNU_ASSERT_MSG((replay.metrics().stageTime((Cornu::AlgorithmStage)i) > 0.) == (i >= stage), "Stage " << i << " ran wrongly in a replay from stage " << stage);
+
+            CORNU_ASSERT(replay.finalOutput());
+            const Cornu::VectorC<Cornu::CurvePrimitiveConstPtr> &expected = fitter.finalOutput()->primitives();
+            const Cornu::VectorC<Cornu::CurvePrimitiveConstPtr> &result = replay.finalOutput()->primitives();
+            CORNU_ASSERT_MSG(result.size() == expected.size(), "Replay from stage " << stage << " differs");
+            for(int i = 0; i < result.size(); ++i)
+                CORNU_ASSERT_MSG(result[i]->getType() == expected[i]->getType() && fabs(result[i]->length() - expected[i]->length()) < 1e-6,
+                                 "Replay from stage " << stage << " differs at primitive " << i);
+        }
+
+        //truncated and garbled snapshots fail to load
+        std::stringstream snapshot;
+        fitter.writeSnapshot(snapshot, Cornu::PATH_FINDING);
+        std::string data = snapshot.str();
+        Cornu::Fitter replay;
+        std::istringstream truncated(data.substr(0, data.size() / 2));
+        CORNU_ASSERT(!replay.loadSnapshot(truncated) && !replay.originalSketch());
+        data[0] = 'X';
+        std::istringstream garbled(data);
+        CORNU_ASSERT(!replay.loadSnapshot(garbled));
+    }
+
+    void slowCaptureTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(150, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(100. + 3. * i, 100. + 40. * sin(0.05 * i));
+        Cornu::Parameters params(Cornu::Parameters::LINES_AND_ARCS);
+
+        //a fit under budget isn't captured, and a slow one is listed in the manifest
+        remove("snapshots.txt");
+        Cornu::Fitter fitter;
+        fitter.setParams(params);
+        fitter.setSlowFitCapture(".", 1000.);
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        CORNU_ASSERT(!std::ifstream("snapshots.txt"));
+
+        fitter.setSlowFitCapture(".", 0., 1e-9);
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        std::string name;
+        std::ifstream manifest("snapshots.txt");
+        CORNU_ASSERT(std::getline(manifest, name) && !name.empty());
+        manifest.close();
+
+        //the capture replays the whole fit and has the metrics of the slow run
+        std::ifstream capture((name + ".snp").c_str(), std::ios::binary);
+        Cornu::Fitter replay;
+        CORNU_ASSERT(replay.loadSnapshot(capture));
+        capture.close();
+        remove((name + ".snp").c_str());
+        remove("snapshots.txt");
+        CORNU_ASSERT(replay.params() == params && replay.slowFitCaptureDirectory().empty());
+        CORNU_ASSERT(replay.metrics().totalTime() == fitter.metrics().totalTime());
+        CORNU_ASSERT(replay.metrics().counter(Cornu::FitMetrics::EDGE_VALIDATIONS) == fitter.metrics().counter(Cornu::FitMetrics::EDGE_VALIDATIONS));
+        replay.run();
+        CORNU_ASSERT(replay.metrics().stageTime(Cornu::SCALE_DETECTION) > 0. && replay.finalOutput());
+        CORNU_ASSERT(replay.finalOutput()->primitives().size() == fitter.finalOutput()->primitives().size());
+        CORNU_ASSERT(replay.metrics().counter(Cornu::FitMetrics::EDGE_VALIDATIONS) == fitter.metrics().counter(Cornu::FitMetrics::EDGE_VALIDATIONS));
+    }
+
+    void allocatorTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+        using Cornu::FitMetrics;
+
+        Cornu::VectorC<Eigen::Vector2d> pts(150, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(100. + 3. * i, 100. + 40. * sin(0.05 * i));
+        Cornu::PolylineConstPtr sketch = new Cornu::Polyline(pts);
+
+        //the fit allocates from its allocator, in parallel stages too, and gives it all back when it's gone
+        BudgetAllocator allocator(1LL << 40);
+        Cornu::Fitter reference;
+        reference.setOriginalSketch(sketch);
+        reference.run();
+        {
+            Cornu::Fitter fitter;
+            Cornu::Parameters params;
+            params.set(Cornu::Parameters::MULTITHREADED, 1.);
+            fitter.setParams(params);
+            fitter.setAllocator(&allocator);
+            fitter.setOriginalSketch(sketch);
+            fitter.run();
+            CORNU_ASSERT(allocator.numAllocations > 0 && allocator.liveBytes > 0);
+            const FitMetrics &metrics = fitter.metrics();
+            CORNU_ASSERT(metrics.counter(FitMetrics::ALLOCATOR_BYTES) >= allocator.liveBytes);
+            CORNU_ASSERT(metrics.peakBytes() >= allocator.liveBytes && metrics.peakBytes() <= metrics.counter(FitMetrics::ALLOCATOR_BYTES));
+            CORNU_ASSERT(fitter.finalOutput()->primitives().size() == reference.finalOutput()->primitives().size());
+        }
+        CORNU_ASSERT_MSG(allocator.liveBytes == 0, "Leaked " << allocator.liveBytes << " bytes");
+
+        //a fit past its budget fails with the allocator's exception
+        BudgetAllocator small(1000);
+        Cornu::Fitter fitter;
+        fitter.setAllocator(&small);
+        fitter.setOriginalSketch(sketch);
+        bool threw = false;
+        try
+        {
+            fitter.run();
+        }
+        catch(const std::bad_alloc &)
+        {
+            threw = true;
+        }
+        CORNU_ASSERT(threw);
+    }
+
+    void performanceTest()
+    {
+        //a noisy spiral, like a long tablet stroke
+        std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > spiral(1000);
+        srand(47);
+        for(int i = 0; i < (int)spiral.size(); ++i)
+        {
+            double angle = 0.012 * i, radius = 20. + 30. * angle;
+            spiral[i] = Eigen::Vector2d(500. + radius * cos(angle) + drand(-0.7, 0.7), 500. + radius * sin(angle) + drand(-0.7, 0.7));
+        }
+        Cornu::PolylineConstPtr sketch = new Cornu::Polyline(Cornu::VectorC<Eigen::Vector2d>(spiral, Cornu::NOT_CIRCULAR));
+
+        assertTimeBudget("fitting a 1000-point noisy spiral with the default preset", 20., [&]() {
+            Cornu::Fitter fitter;
+            fitter.setParams(Cornu::Parameters(Cornu::Parameters::DEFAULT));
+            fitter.setOriginalSketch(sketch);
+            fitter.run();
+        });
+    }
+
+    void leanTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(100, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = double(i) / 99.;
+            pts[i] = Eigen::Vector2d(100. + 300. * t, 100. + 30. * sin(4. * t));
+        }
+
+        Cornu::Parameters params;
+        Cornu::Fitter full, lean;
+        full.setParams(params);
+        full.setOriginalSketch(new Cornu::Polyline(pts));
+        full.run();
+        lean.setParams(params);
+        lean.setLean(true);
+        lean.setOriginalSketch(new Cornu::Polyline(pts));
+        lean.run();
+
+        CORNU_ASSERT(full.finalOutput() && lean.finalOutput());
+        CORNU_ASSERT_MSG(full.finalOutput()->primitives().size() == lean.finalOutput()->primitives().size(), "Lean fit differs from a full fit");
+        CORNU_ASSERT(full.output<Cornu::PRIMITIVE_FITTING>() && !lean.output<Cornu::PRIMITIVE_FITTING>() && !lean.output<Cornu::RESAMPLING>());
+        CORNU_ASSERT(lean.output<Cornu::SCALE_DETECTION>());
+
+        //the preliminary resampling is released once the curve closer is done with it
+        CORNU_ASSERT(lean.peakMemoryUsage(Cornu::RESAMPLING) < full.peakMemoryUsage(Cornu::RESAMPLING));
+        CORNU_ASSERT(lean.peakMemoryUsage(Cornu::GRAPH_CONSTRUCTION) > 0);
+
+        //released stages are recomputed when a later one is invalidated
+        params.set(Cornu::Parameters::ERROR_COST, 2.);
+        full.setParams(params);
+        full.run();
+        lean.setParams(params);
+        lean.run();
+        CORNU_ASSERT(lean.finalOutput());
+        CORNU_ASSERT_MSG(full.finalOutput()->primitives().size() == lean.finalOutput()->primitives().size(), "Lean refit differs from a full refit");
+    }
+
+    void resetTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::Parameters params;
+        Cornu::Fitter reused;
+        reused.setParams(params);
+
+        const Cornu::AlgorithmOutput<Cornu::PRIMITIVE_FITTING> *prevPrimitives = NULL;
+        for(int stroke = 0; stroke < 3; ++stroke)
+        {
+            Cornu::VectorC<Eigen::Vector2d> pts(100, Cornu::NOT_CIRCULAR);
+            for(int i = 0; i < pts.size(); ++i)
+            {
+                double t = double(i) / 99.;
+                pts[i] = Eigen::Vector2d(100. + 300. * t, 100. + (20. + 5. * stroke) * sin(4. * t));
+            }
+
+            reused.reset();
+            reused.setOriginalSketch(new Cornu::Polyline(pts));
+            reused.run();
+
+            Cornu::Fitter fresh;
+            fresh.setParams(params);
+            fresh.setOriginalSketch(new Cornu::Polyline(pts));
+            fresh.run();
+
+            CORNU_ASSERT(fresh.finalOutput() && reused.finalOutput());
+            CORNU_ASSERT_MSG(fresh.finalOutput()->primitives().size() == reused.finalOutput()->primitives().size(), "Reused fitter differs from a fresh one");
+            CORNU_ASSERT_MSG(fresh.finalOutput()->length() == reused.finalOutput()->length(), "Reused fitter differs from a fresh one");
+
+            //the outputs of the previous run are reused
+            CORNU_ASSERT(stroke == 0 || reused.output<Cornu::PRIMITIVE_FITTING>().get() == prevPrimitives);
+            prevPrimitives = reused.output<Cornu::PRIMITIVE_FITTING>().get();
+        }
+    }
+
+    void cacheTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        std::vector<Cornu::Point> points;
+        for(int i = 0; i < 50; ++i)
+            points.push_back(Cornu::Point(100. + 4. * i, 100. + 0.05 * i * i));
+
+        Cornu::FitCache cache;
+        Cornu::Parameters params;
+
+        bool closed;
+        std::vector<Cornu::BasicPrimitive> first = Cornu::fit(points, params, &closed, &cache);
+        std::vector<Cornu::BasicPrimitive> second = Cornu::fit(points, params, &closed, &cache);
+        CORNU_ASSERT(cache.hits() == 1 && cache.misses() == 1 && cache.numEntries() == 1);
+        CORNU_ASSERT(first.size() == second.size() && !first.empty() && first[0].length == second[0].length);
+
+        params.set(Cornu::Parameters::ERROR_COST, 2.);
+        Cornu::fit(points, params, &closed, &cache);
+        CORNU_ASSERT(cache.misses() == 2 && cache.numEntries() == 2);
+
+        //with a tiny budget, only the most recent result is kept until it is returned
+        cache.setMaxMemory(1);
+        CORNU_ASSERT(cache.numEntries() == 0 && cache.memoryUsage() == 0);
+        CORNU_ASSERT(!Cornu::fit(points, params, &closed, &cache).empty());
+    }
+
+    void forkTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(200, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(100. + 2. * i, 300. + 80. * sin(i * 0.03) + 20. * sin(i * 0.11));
+
+        Cornu::Fitter fitter;
+        fitter.setDebugging(Cornu::Debugging::silent()); //the forks run on other threads
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        Cornu::PrimitiveSequenceConstPtr original = fitter.finalOutput();
+        CORNU_ASSERT(original);
+
+        //variants that only change the graph costs share everything before graph construction
+        Cornu::Parameters variants[2];
+        variants[0].set(Cornu::Parameters::ERROR_COST, 3.);
+        variants[1] = Cornu::Parameters::presets()[Cornu::Parameters::LINES_AND_ARCS];
+        std::vector<Cornu::Fitter> forks;
+        for(int i = 0; i < 2; ++i)
+            forks.push_back(fitter.fork(variants[i]));
+        CORNU_ASSERT_MSG(forks[0].output<Cornu::PRIMITIVE_FITTING>() && forks[0].output<Cornu::PRIMITIVE_FITTING>()->primitives.size() ==
+                         fitter.output<Cornu::PRIMITIVE_FITTING>()->primitives.size(), "Fork should start with unaffected stages");
+#ifndef CORNUCOPIA_ATOMIC_REFCOUNT
+        //the forks run on other threads, so they can't share pointers with this fitter
+        CORNU_ASSERT(forks[0].output<Cornu::PRIMITIVE_FITTING>() != fitter.output<Cornu::PRIMITIVE_FITTING>() &&
+                     forks[0].originalSketch() != fitter.originalSketch());
+#endif
+        CORNU_ASSERT_MSG(!forks[0].output<Cornu::GRAPH_CONSTRUCTION>(), "Fork should not share affected stages");
+
+        std::vector<std::thread> threads;
+        for(int i = 0; i < 2; ++i)
+            threads.push_back(std::thread([&forks, i]() { forks[i].run(); }));
+        for(int i = 0; i < 2; ++i)
+            threads[i].join();
+
+        //each fork gets what a fresh fitter with its parameters gets, and the original is untouched
+        for(int i = 0; i < 2; ++i)
+        {
+            Cornu::Fitter fresh;
+            fresh.setDebugging(Cornu::Debugging::silent());
+            fresh.setOriginalSketch(new Cornu::Polyline(pts));
+            fresh.setParams(variants[i]);
+            fresh.run();
+            CORNU_ASSERT(forks[i].finalOutput() && fresh.finalOutput());
+            CORNU_ASSERT_MSG(forks[i].finalOutput()->primitives().size() == fresh.finalOutput()->primitives().size() &&
+                             forks[i].finalOutput()->length() == fresh.finalOutput()->length(), "Fork differs from a fresh fit of variant " << i);
+            CORNU_ASSERT(forks[i].metrics().stageTime(Cornu::RESAMPLING) == 0.);
+        }
+        CORNU_ASSERT(fitter.finalOutput() == original);
+    }
+
+    void graphBudgetTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(400, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = double(i) / 399.;
+            pts[i] = Eigen::Vector2d(100. + 800. * t, 100. + 40. * sin(30. * t));
+        }
+
+        Cornu::Fitter fitter;
+        Cornu::Parameters params;
+        params.set(Cornu::Parameters::MAX_GRAPH_VERTICES, 1e9);
+        params.set(Cornu::Parameters::MAX_GRAPH_EDGES, 1e9);
+        fitter.setParams(params);
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        CORNU_ASSERT(fitter.finalOutput());
+        int fullEdges = fitter.output<Cornu::GRAPH_CONSTRUCTION>()->numEdges();
+
+        //a tight budget should shrink the graph but still produce a fit
+        params.set(Cornu::Parameters::MAX_GRAPH_VERTICES, 500);
+        params.set(Cornu::Parameters::MAX_GRAPH_EDGES, 2000);
+        fitter.setParams(params);
+        CORNU_ASSERT(fitter.output<Cornu::PRIMITIVE_FITTING>() && !fitter.output<Cornu::GRAPH_CONSTRUCTION>());
+        fitter.run();
+        CORNU_ASSERT(fitter.finalOutput());
+        CORNU_ASSERT_LT_MSG(fitter.output<Cornu::GRAPH_CONSTRUCTION>()->numEdges(), fullEdges, "Budget did not prune the graph");
+    }
+
+    void errorBackendTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+        using Cornu::FitMetrics;
+
+        Cornu::VectorC<Eigen::Vector2d> pts(200, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(100. + 2. * i, 100. + 60. * sin(0.03 * i) + 0.01 * i * i);
+        Cornu::PolylineConstPtr sketch = new Cornu::Polyline(pts);
+
+        Cornu::Fitter reference;
+        reference.setOriginalSketch(sketch);
+        reference.run();
+        CORNU_ASSERT(reference.finalOutput());
+
+        //by default, candidates are evaluated one by one and the backend isn't used
+        CountingErrorBackend backend;
+        Cornu::Fitter fitter;
+        fitter.setErrorBackend(&backend);
+        fitter.setOriginalSketch(sketch);
+        fitter.run();
+        CORNU_ASSERT(backend.numBatches == 0);
+
+        //in batches (from several threads), the candidates and the fit are the same
+        Cornu::Parameters params;
+        params.set(Cornu::Parameters::ERROR_BATCH_SIZE, 8.);
+        params.set(Cornu::Parameters::MULTITHREADED, 1.);
+        fitter.setParams(params);
+        fitter.run();
+        CORNU_ASSERT(backend.numBatches > 0 && backend.largestBatch >= 8);
+        CORNU_ASSERT(backend.numCandidates >= fitter.metrics().counter(FitMetrics::CANDIDATE_PRIMITIVES));
+        CORNU_ASSERT(fitter.metrics().counter(FitMetrics::CANDIDATE_PRIMITIVES) == reference.metrics().counter(FitMetrics::CANDIDATE_PRIMITIVES));
+        CORNU_ASSERT(fitter.finalOutput()->primitives().size() == reference.finalOutput()->primitives().size());
+        CORNU_ASSERT(fitter.finalOutput()->length() == reference.finalOutput()->length());
+    }
+
+    void warmErrorVectorTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(200, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(3. * i, 80. * sin(i * 0.04));
+
+        Cornu::Fitter fitter;
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        const Cornu::ErrorComputer &errorComputer = *fitter.output<Cornu::ERROR_COMPUTER>()->errorComputer;
+        const std::vector<Cornu::FitPrimitive> &primitives = fitter.output<Cornu::PRIMITIVE_FITTING>()->primitives;
+
+        //warm-started projections from a slightly different curve give the same error vector as projecting from scratch
+        int checked = 0;
+        for(int i = 0; i < (int)primitives.size() && checked < 20; ++i)
+        {
+            const Cornu::FitPrimitive &primitive = primitives[i];
+            if(primitive.isFixed() || primitive.curve->getType() != Cornu::CurvePrimitive::CLOTHOID || primitive.numPts < 8)
+                continue;
+            ++checked;
+
+            Cornu::CurvePrimitivePtr curve = primitive.curve->clone();
+            Eigen::VectorXd warm, error, warmError;
+            Eigen::MatrixXd errorDer, warmErrorDer;
+            errorComputer.computeErrorVectorIncremental(curve, primitive.startIdx, primitive.endIdx, warmError, &warmErrorDer, warm);
+            CORNU_ASSERT(warm.size() == primitive.numPts);
+
+            //zeroed first, or gcc warns that the fixed-capacity storage may be used uninitialized
+            Cornu::CurvePrimitive::ParamVec params = Cornu::CurvePrimitive::ParamVec::Zero(curve->params().size());
+            params = curve->params();
+            params[Cornu::CurvePrimitive::ANGLE] += 0.01;
+            params[Cornu::CurvePrimitive::X] += 0.5;
+            curve->setParams(params);
+            errorComputer.computeErrorVector(curve, primitive.startIdx, primitive.endIdx, error, &errorDer);
+            errorComputer.computeErrorVectorIncremental(curve, primitive.startIdx, primitive.endIdx, warmError, &warmErrorDer, warm);
+            CORNU_ASSERT_MSG((error - warmError).norm() < 1e-6 * (1. + error.norm()), (error - warmError).norm());
+            CORNU_ASSERT((errorDer - warmErrorDer).norm() < 1e-6 * (1. + errorDer.norm()));
+
+            //and the same summed error, from the same guesses
+            double sum = errorComputer.computeError(curve, primitive.startIdx, primitive.endIdx);
+            double warmSum = errorComputer.computeErrorIncremental(curve, primitive.startIdx, primitive.endIdx, warm);
+            CORNU_ASSERT_MSG(fabs(sum - warmSum) < 1e-6 * (1. + sum), sum - warmSum);
+
+            //a loop that comes back near its start: warm-started at its end, the samples still project onto its start
+            double radius = 3. * primitive.curve->length();
+            Cornu::CurvePrimitivePtr loop = new Cornu::Clothoid(primitive.curve->startPos(), primitive.curve->startAngle(),
+                                                                1.9 * Cornu::PI * radius, 1. / radius, 1.1 / radius);
+            warm = Eigen::VectorXd::Constant(primitive.numPts, loop->length());
+            sum = errorComputer.computeError(loop, primitive.startIdx, primitive.endIdx);
+            warmSum = errorComputer.computeErrorIncremental(loop, primitive.startIdx, primitive.endIdx, warm);
+            CORNU_ASSERT_MSG(fabs(sum - warmSum) < 1e-6 * (1. + sum), sum - warmSum);
+        }
+        CORNU_ASSERT(checked > 0);
+    }
+
+    void momentErrorTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        //a wiggle and a hairpin, so some lines are measured from the moments and some are not
+        Cornu::VectorC<Eigen::Vector2d> pts(200, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = i < 120 ? Eigen::Vector2d(3. * i, 20. * sin(i * 0.1)) : Eigen::Vector2d(3. * (240 - i), 60. + 5. * sin(i * 0.3));
+
+        Cornu::Fitter fitter;
+        Cornu::Parameters params;
+        params.setAlgorithm(Cornu::ERROR_COMPUTER, 1); //L2
+        fitter.setParams(params);
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        const Cornu::ErrorComputer &errorComputer = *fitter.output<Cornu::ERROR_COMPUTER>()->errorComputer;
+        const Cornu::VectorC<Eigen::Vector2d> &samples = fitter.output<Cornu::RESAMPLING>()->output->pts();
+
+        //line errors match the sums of the projected error vectors, and bounded errors are only cut off above the bound
+        for(int from = 0; from + 2 < samples.size(); from += 7)
+        {
+            for(int to = from + 2; to < samples.size(); to += 11)
+            {
+                Cornu::CurvePrimitivePtr line = new Cornu::Line(samples[from] + Eigen::Vector2d(-2., 1.), samples[to] + Eigen::Vector2d(2., 1.));
+                Eigen::VectorXd errorVector;
+                errorComputer.computeErrorVector(line, from, to, errorVector, NULL, false, true, false);
+                double error = errorComputer.computeError(line, from, to, false, true, false);
+                CORNU_ASSERT_MSG(fabs(error - errorVector.squaredNorm()) < 1e-8 * (1. + error), error - errorVector.squaredNorm());
+
+                double cost = errorComputer.computeErrorForCost(line, from, to, true, true, false);
+                double bounded = errorComputer.computeErrorForCostBounded(line, from, to, 0.5 * cost, true, true, false);
+                CORNU_ASSERT(bounded > 0.5 * cost && bounded <= cost * (1. + 1e-8));
+            }
+        }
+    }
+
+    void previousPathTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        for(int closed = 0; closed < 2; ++closed)
+        {
+            Cornu::VectorC<Eigen::Vector2d> pts(200, closed ? Cornu::CIRCULAR : Cornu::NOT_CIRCULAR);
+            for(int i = 0; i < pts.size(); ++i)
+            {
+                double t = double(i) / 200.;
+                pts[i] = closed ? Eigen::Vector2d(400. + 250. * cos(Cornu::TWOPI * t), 300. + 120. * sin(Cornu::TWOPI * t) + 20. * sin(5. * Cornu::TWOPI * t))
+                                : Eigen::Vector2d(100. + 600. * t, 100. + 30. * sin(12. * t));
+            }
+
+            Cornu::Fitter fitter;
+            Cornu::Parameters params;
+            fitter.setParams(params);
+            fitter.setOriginalSketch(new Cornu::Polyline(pts));
+            fitter.run();
+            CORNU_ASSERT(fitter.finalOutput() && fitter.previousPath().empty());
+            CORNU_ASSERT(fitter.output<Cornu::CURVE_CLOSING>()->closed == (closed != 0));
+            int pathLength = (int)fitter.output<Cornu::PATH_FINDING>()->path.size();
+
+            //a cost change keeps the path as a bound for the refit, which finds the same path as a fresh fit
+            params.set(Cornu::Parameters::G1_COST, 1.5 * params.get(Cornu::Parameters::G1_COST));
+            Cornu::Fitter fresh = fitter.fork(params);
+            fresh.setPreviousPath(std::vector<Cornu::Fitter::PathEdge>());
+            fitter.setParams(params);
+            CORNU_ASSERT((int)fitter.previousPath().size() == pathLength);
+            fitter.run();
+            fresh.run();
+            CORNU_ASSERT(fitter.output<Cornu::PATH_FINDING>()->path == fresh.output<Cornu::PATH_FINDING>()->path);
+
+            //changing the primitives drops it
+            params.set(Cornu::Parameters::ERROR_THRESHOLD, 0.5 * params.get(Cornu::Parameters::ERROR_THRESHOLD));
+            fitter.setParams(params);
+            CORNU_ASSERT(fitter.previousPath().empty());
+        }
+    }
+
+    void alternativesTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(200, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = double(i) / 199.;
+            pts[i] = Eigen::Vector2d(100. + 600. * t, 100. + 60. * sin(9. * t) + (t > 0.5 ? 200. * (t - 0.5) : 0.));
+        }
+
+        Cornu::Fitter single;
+        single.setOriginalSketch(new Cornu::Polyline(pts));
+        single.run();
+        CORNU_ASSERT(single.numAlternatives() == 1 && single.alternativeOutput(0) == single.finalOutput());
+
+        Cornu::Parameters params;
+        params.set(Cornu::Parameters::NUM_ALTERNATIVES, 4.);
+        Cornu::Fitter fitter = single.fork(params);
+        fitter.run();
+
+        //the first is the usual fit; the others cost at least as much and have other structures
+        Cornu::smart_ptr<const Cornu::AlgorithmOutput<Cornu::PATH_FINDING> > paths = fitter.output<Cornu::PATH_FINDING>();
+        CORNU_ASSERT(paths->path == single.output<Cornu::PATH_FINDING>()->path);
+        CORNU_ASSERT_MSG(fitter.numAlternatives() > 1 && fitter.numAlternatives() <= 4, "Alternatives: " << fitter.numAlternatives());
+        CORNU_ASSERT(paths->alternativeCosts.size() == paths->alternatives.size());
+        for(int i = 0; i < (int)paths->alternatives.size(); ++i)
+        {
+            CORNU_ASSERT(paths->alternatives[i] != paths->path);
+            CORNU_ASSERT(i == 0 || paths->alternativeCosts[i] >= paths->alternativeCosts[i - 1]);
+        }
+
+        //only the requested alternatives are combined, once each
+        for(int i = 1; i < fitter.numAlternatives(); ++i)
+        {
+            Cornu::PrimitiveSequenceConstPtr alternative = fitter.alternativeOutput(i);
+            CORNU_ASSERT_MSG(alternative && alternative != fitter.finalOutput(), "Alternative " << i << " missing");
+            CORNU_ASSERT(fitter.alternativeOutput(i) == alternative);
+        }
+        CORNU_ASSERT(!fitter.alternativeOutput(fitter.numAlternatives()));
+    }
+
+    void singlePrecisionTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        //a rounded zigzag with sharp turns
+        Cornu::VectorC<Eigen::Vector2d> pts(300, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = double(i) / 299.;
+            double phase = fmod(4. * t, 1.);
+            pts[i] = Eigen::Vector2d(100. + 600. * t, 100. + 150. * (phase < 0.5 ? phase : 1. - phase) + 3. * sin(40. * t));
+        }
+
+        //the corners don't change when the corner detector smooths in single precision
+        Cornu::Parameters params;
+        Cornu::Fitter fitter;
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        Cornu::VectorC<bool> corners = fitter.output<Cornu::CORNER_DETECTION>()->corners;
+
+        params.set(Cornu::Parameters::SINGLE_PRECISION_FRONT_END, 1.);
+        fitter.setParams(params);
+        CORNU_ASSERT(!fitter.output<Cornu::CORNER_DETECTION>() && fitter.output<Cornu::OVERSKETCHING>());
+        fitter.run();
+        int numCorners = 0;
+        for(int i = 0; i < corners.size(); ++i)
+        {
+            numCorners += corners[i];
+            CORNU_ASSERT_MSG(fitter.output<Cornu::CORNER_DETECTION>()->corners[i] == corners[i], "Corner differs at " << i);
+        }
+        CORNU_ASSERT_MSG(numCorners >= 3, "Corners: " << numCorners);
+        CORNU_ASSERT(fitter.finalOutput());
+    }
+
+    void combineCacheTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(200, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = double(i) / 199.;
+            pts[i] = Eigen::Vector2d(100. + 600. * t, 100. + 30. * sin(12. * t));
+        }
+
+        Cornu::Fitter fitter;
+        Cornu::Parameters params;
+        fitter.setParams(params);
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        CORNU_ASSERT(fitter.finalOutput());
+        Cornu::TwoCurveCombineCacheConstPtr cache = fitter.output<Cornu::PRIMITIVE_FITTING>()->combineCache;
+        int cached = cache->size();
+        CORNU_ASSERT(cached > 0);
+
+        //changing a cost keeps the primitives and so the combinations already computed
+        params.set(Cornu::Parameters::G1_COST, 2. * params.get(Cornu::Parameters::G1_COST));
+        fitter.setParams(params);
+        fitter.run();
+        CORNU_ASSERT(fitter.output<Cornu::PRIMITIVE_FITTING>()->combineCache == cache && cache->size() >= cached);
+
+        //and gives the same result as fitting from scratch
+        Cornu::Fitter fresh;
+        fresh.setParams(params);
+        fresh.setOriginalSketch(new Cornu::Polyline(pts));
+        fresh.run();
+        CORNU_ASSERT(fresh.finalOutput() && fresh.finalOutput()->length() == fitter.finalOutput()->length());
+    }
+
+    void splitAtCornersTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        //a zigzag with five corners and a closed square
+        Cornu::VectorC<Eigen::Vector2d> zigzag(0, Cornu::NOT_CIRCULAR), square(0, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i <= 300; ++i)
+        {
+            double t = double(i) / 50.;
+            double up = t - floor(t);
+            zigzag.push_back(Eigen::Vector2d(100. + 50. * t, 100. + 80. * ((int)t % 2 ? 1. - up : up) + 5. * sin(3. * t)));
+        }
+        for(int i = 0; i < 400; ++i)
+        {
+            double t = double(i % 100) / 100.;
+            Eigen::Vector2d corners[4] = { Eigen::Vector2d(100, 100), Eigen::Vector2d(400, 100), Eigen::Vector2d(400, 400), Eigen::Vector2d(100, 400) };
+            square.push_back((1. - t) * corners[i / 100] + t * corners[(i / 100 + 1) % 4]);
+        }
+        square.push_back(square[0]);
+
+        Cornu::PolylineConstPtr sketches[2] = { new Cornu::Polyline(zigzag), new Cornu::Polyline(square) };
+        for(int s = 0; s < 2; ++s)
+        {
+            Cornu::Parameters params;
+            Cornu::Fitter whole, split, splitThreaded;
+            whole.setParams(params);
+            whole.setOriginalSketch(sketches[s]);
+            whole.run();
+            params.set(Cornu::Parameters::SPLIT_AT_CORNERS, 1.);
+            split.setParams(params);
+            split.setOriginalSketch(sketches[s]);
+            split.run();
+            params.set(Cornu::Parameters::MULTITHREADED, 1.);
+            splitThreaded.setParams(params);
+            splitThreaded.setOriginalSketch(sketches[s]);
+            splitThreaded.run();
+
+            CORNU_ASSERT(whole.finalOutput() && split.finalOutput() && splitThreaded.finalOutput());
+            Cornu::PrimitiveSequenceConstPtr result = split.finalOutput();
+            CORNU_ASSERT_MSG(result->isClosed() == whole.finalOutput()->isClosed(), "Split fit of sketch " << s << " changed closedness");
+            CORNU_ASSERT_LT_MSG(fabs(result->length() - whole.finalOutput()->length()), 0.02 * result->length(), "Split fit of sketch " << s << " differs");
+            CORNU_ASSERT((int)split.originalSketchToFinalParameters().size() == sketches[s]->pts().size());
+
+            //the pieces are joined, and every sample is near the curve
+            const Cornu::VectorC<Cornu::CurvePrimitiveConstPtr> &primitives = result->primitives();
+            for(int i = 0; i < primitives.endIdx(1); ++i)
+                CORNU_ASSERT_LT_MSG((primitives[i]->endPos() - primitives[i + 1]->startPos()).norm(), 1e-3, "Gap after primitive " << i << " of sketch " << s);
+            for(int i = 0; i < sketches[s]->pts().size(); ++i)
+            {
+                Eigen::Vector2d pt = sketches[s]->pts()[i];
+                CORNU_ASSERT_LT_MSG((result->pos(result->project(pt)) - pt).norm(), 10., "Sample " << i << " of sketch " << s << " is far from the split fit");
+            }
+
+            //the pieces are fit the same way on any number of threads
+            CORNU_ASSERT(splitThreaded.finalOutput()->primitives().size() == primitives.size());
+            for(int i = 0; i < primitives.size(); ++i)
+                CORNU_ASSERT_MSG(splitThreaded.finalOutput()->primitives()[i]->length() == primitives[i]->length(), "Threaded split fit differs at primitive " << i);
+        }
+    }
+
+    void coarseToFineTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        //a long, gently curving stroke with a few small bumps that the coarse fit misses
+        Cornu::VectorC<Eigen::Vector2d> pts(8000, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = i * 0.5;
+            double bump = fmod(t, 900.) < 30. ? 10. * sin(fmod(t, 900.) * 0.21) : 0.;
+            pts[i] = Eigen::Vector2d(t, 300. * sin(t * 0.002) + bump);
+        }
+        Cornu::PolylineConstPtr sketch = new Cornu::Polyline(pts);
+
+        Cornu::CoarseToFineFitter fitter;
+        Cornu::PrimitiveSequenceConstPtr curve = fitter.fit(sketch);
+        CORNU_ASSERT(curve && curve == fitter.curve());
+        CORNU_ASSERT_MSG(fitter.numRefinedWindows() > 0, "No windows were refined");
+        CORNU_ASSERT((int)fitter.originalSketchToFinalParameters().size() == pts.size());
+
+        Cornu::Fitter whole;
+        whole.setOriginalSketch(sketch);
+        whole.run();
+        CORNU_ASSERT(whole.finalOutput());
+        double wholeDist = 0., refinedDist = 0.;
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            wholeDist = std::max(wholeDist, sqrt(whole.finalOutput()->distanceSqTo(pts[i])));
+            refinedDist = std::max(refinedDist, (curve->pos(fitter.originalSketchToFinalParameters()[i]) - pts[i]).norm());
+        }
+        CORNU_ASSERT_LT_MSG(refinedDist, std::max(wholeDist, 2. * whole.scaledParameter(Cornu::Parameters::ERROR_THRESHOLD)) + 1e-6,
+                            "Coarse-to-fine fit is farther from the sketch than a full fit");
+
+        //closed sketches are fit at full resolution
+        Cornu::VectorC<Eigen::Vector2d> circle(400, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < circle.size(); ++i)
+            circle[i] = Eigen::Vector2d(300. + 200. * cos(i * 0.016), 300. + 200. * sin(i * 0.016));
+        CORNU_ASSERT(fitter.fit(new Cornu::Polyline(circle)) && fitter.curve()->isClosed() && fitter.numRefinedWindows() == -1);
+    }
+
+    void streamingPrelimTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        //a noisy wavy stroke: every dropped point must be within the cutoff of the segment between the kept points around it
+        const double cutoff = 3.;
+        Cornu::VectorC<Eigen::Vector2d> pts(3000, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(i * 0.4 + 0.7 * sin(i * 2.3), 100. * sin(i * 0.004) + 30. * sin(i * 0.031) + 0.7 * cos(i * 1.7));
+
+        Cornu::StreamingSimplifier simplifier(cutoff);
+        std::vector<int> kept;
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            int idx = simplifier.addPoint(pts[i]);
+            if(idx >= 0)
+                kept.push_back(idx);
+        }
+        kept.push_back(pts.size() - 1);
+        CORNU_ASSERT(simplifier.numPoints() == pts.size() && kept[0] == 0);
+        CORNU_ASSERT_LT_MSG((int)kept.size(), (int)pts.size() / 4, "Simplifier kept too many points");
+
+        double worst = 0.;
+        for(int k = 0; k + 1 < (int)kept.size(); ++k)
+        {
+            CORNU_ASSERT(kept[k] < kept[k + 1]);
+            Cornu::Line segment(pts[kept[k]], pts[kept[k + 1]]);
+            for(int i = kept[k] + 1; i < kept[k + 1]; ++i)
+                worst = std::max(worst, (segment.pos(segment.project(pts[i])) - pts[i]).norm());
+        }
+        CORNU_ASSERT_LT_MSG(worst, cutoff + 1e-6, "Dropped point is too far from the simplified polyline");
+
+        //and the streaming preliminary resampling produces a fit
+        Cornu::Fitter fitter;
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        Cornu::Parameters params;
+        params.setAlgorithm(Cornu::PRELIM_RESAMPLING, 2);
+        fitter.setParams(params);
+        fitter.run();
+        CORNU_ASSERT(fitter.finalOutput());
+    }
+
+    void inputDecimationTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        //a stroke as a high-rate stylus reports it: points a tenth of a pixel apart with a little jitter
+        Cornu::VectorC<Eigen::Vector2d> pts(6000, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+        {
+            double t = i * 0.1;
+            pts[i] = Eigen::Vector2d(t + 0.03 * sin(i * 2.3), 80. * sin(t * 0.01) + 0.03 * cos(i * 1.7));
+        }
+        Cornu::PolylineConstPtr sketch = new Cornu::Polyline(pts);
+
+        Cornu::Parameters params;
+        Cornu::Fitter decimated, full;
+        decimated.setParams(params);
+        params.set(Cornu::Parameters::INPUT_DECIMATION, 0.);
+        full.setParams(params);
+        Cornu::Fitter *fitters[2] = { &decimated, &full };
+        double dist[2] = { 0., 0. };
+        for(int f = 0; f < 2; ++f)
+        {
+            fitters[f]->setOriginalSketch(sketch);
+            fitters[f]->run();
+            CORNU_ASSERT(fitters[f]->finalOutput());
+
+            //every original point still gets a parameter, in order
+            const std::vector<double> &toFinal = fitters[f]->originalSketchToFinalParameters();
+            CORNU_ASSERT((int)toFinal.size() == pts.size());
+            for(int i = 0; i < pts.size(); ++i)
+            {
+                CORNU_ASSERT(i == 0 || toFinal[i] >= toFinal[i - 1]);
+                dist[f] = std::max(dist[f], sqrt(fitters[f]->finalOutput()->distanceSqTo(pts[i])));
+            }
+        }
+        CORNU_ASSERT_LT_MSG(dist[0], std::max(dist[1], 2. * full.scaledParameter(Cornu::Parameters::ERROR_THRESHOLD)) + 1e-6,
+                            "Decimated fit is farther from the sketch than a full fit");
+    }
+
+    void curveClosingTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        //a circle whose ends linger near the start point, like a slow tablet stroke circling back
+        Cornu::VectorC<Eigen::Vector2d> pts(0, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < 400; ++i)
+            pts.push_back(Eigen::Vector2d(200. + 0.5 * sin(i * 1.3), 200. + 0.5 * cos(i * 0.7)));
+        for(int i = 0; i <= 300; ++i)
+            pts.push_back(Eigen::Vector2d(100. + 100. * cos(i * 2. * Cornu::PI / 300.), 200. + 100. * sin(i * 2. * Cornu::PI / 300.)));
+        for(int i = 0; i < 400; ++i)
+            pts.push_back(Eigen::Vector2d(200.3 + 0.5 * cos(i * 0.9), 200.2 + 0.5 * sin(i * 1.1)));
+
+        Cornu::PolylineConstPtr outputs[2];
+        for(int alg = 0; alg < 2; ++alg)
+        {
+            Cornu::Fitter fitter;
+            fitter.setOriginalSketch(new Cornu::Polyline(pts));
+            Cornu::Parameters params;
+            params.setAlgorithm(Cornu::CURVE_CLOSING, alg);
+            params.setAlgorithm(Cornu::PRELIM_RESAMPLING, 1); //keep the lingering points
+            fitter.setParams(params);
+            fitter.run();
+            CORNU_ASSERT_MSG(fitter.output<Cornu::CURVE_CLOSING>()->closed, "Lingering stroke should be closed");
+            outputs[alg] = fitter.output<Cornu::CURVE_CLOSING>()->output;
+        }
+        CORNU_ASSERT_MSG(outputs[0]->pts() == outputs[1]->pts(), "Both closers should pick the same points");
+    }
+
+    void datasetTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        const char *fileName = "EndToEndTest.cstk";
+        Cornu::StrokeCorpusWriter writer;
+        CORNU_ASSERT(writer.open(fileName));
+        for(int s = 0; s < 4; ++s)
+        {
+            Cornu::VectorC<Eigen::Vector2d> pts(150 + 50 * s, Cornu::NOT_CIRCULAR);
+            for(int i = 0; i < pts.size(); ++i)
+                pts[i] = Eigen::Vector2d(2. * i, 60. * sin(i * (0.02 + 0.01 * s)));
+            writer.add(pts);
+        }
+        writer.add(Cornu::VectorC<Eigen::Vector2d>(1, Cornu::NOT_CIRCULAR)); //too short to fit
+        CORNU_ASSERT(writer.close());
+
+        Cornu::StrokeCorpus corpus;
+        CORNU_ASSERT_MSG(corpus.open(fileName), corpus.error());
+        std::stringstream data;
+        int written = Cornu::generateDataset(corpus, Cornu::Parameters(), data);
+        corpus.close();
+        remove(fileName);
+        CORNU_ASSERT_MSG(written == 4, written);
+
+        std::string bytes = data.str();
+        const char *ptr = bytes.data(), *end = ptr + bytes.size();
+        CORNU_ASSERT(bytes.size() >= 24 && std::string(ptr, 8) == "CornuDat");
+        unsigned int header[4];
+        memcpy(header, ptr + 8, sizeof(header));
+        CORNU_ASSERT(header[1] == 0x01020304);
+        CORNU_ASSERT(header[2] == Cornu::Dataset::NUM_VERTEX_FEATURES && header[3] == Cornu::Dataset::NUM_EDGE_FEATURES);
+        ptr += 24;
+
+        std::vector<bool> seen(4, false);
+        int totalEdges = 0;
+        while(ptr < end)
+        {
+            int counts[3];
+            memcpy(counts, ptr, sizeof(counts));
+            ptr += sizeof(counts);
+            CORNU_ASSERT_MSG(counts[0] >= 0 && counts[0] < 4 && !seen[counts[0]], counts[0]);
+            seen[counts[0]] = true;
+            CORNU_ASSERT(counts[1] > 0 && counts[2] >= 0); //a stroke fit by single primitives only has dummy edges
+            totalEdges += counts[2];
+            ptr += counts[1] * sizeof(Cornu::Dataset::VertexRecord);
+
+            for(int i = 0; i < counts[2]; ++i, ptr += sizeof(Cornu::Dataset::EdgeRecord))
+            {
+                Cornu::Dataset::EdgeRecord edge;
+                memcpy(&edge, ptr, sizeof(edge));
+                CORNU_ASSERT(edge.start >= 0 && edge.start < counts[1] && edge.end >= 0 && edge.end < counts[1]);
+                CORNU_ASSERT(edge.continuity >= 0 && edge.continuity <= 2);
+                CORNU_ASSERT_MSG(edge.validatedCost >= edge.cost, edge.validatedCost << " < " << edge.cost);
+            }
+        }
+        CORNU_ASSERT(ptr == end && totalEdges > 0);
+    }
+
+    void deadlineTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(600, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(i, 200. * sin(i * 0.01) + 40. * sin(i * 0.05) + 2. * sin(i * 1.3));
+
+        Cornu::Fitter fitter;
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        CORNU_ASSERT(fitter.finalOutput() && !fitter.metrics().truncated());
+
+        //a budget that runs out right away still gives a curve through the whole sketch
+        Cornu::Fitter hurried;
+        hurried.setTimeBudget(1e-9);
+        hurried.setOriginalSketch(new Cornu::Polyline(pts));
+        hurried.run();
+        CORNU_ASSERT(hurried.finalOutput() && hurried.metrics().truncated());
+        CORNU_ASSERT_LT_MSG((hurried.finalOutput()->endPos() - pts.back()).norm(), 10., "Truncated fit doesn't reach the end of the sketch");
+    }
+
+    void simplifierTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(300, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(100. + 2. * i, 300. + 80. * sin(i * 0.03) + 3. * sin(i * 0.4));
+
+        Cornu::Fitter fitter;
+        fitter.setOriginalSketch(new Cornu::Polyline(pts));
+        fitter.run();
+        Cornu::PrimitiveSequenceConstPtr original = fitter.finalOutput();
+        CORNU_ASSERT(original);
+
+        Cornu::CurveSimplifier simplifier(original);
+        std::vector<Cornu::PrimitiveSequenceConstPtr> levels = simplifier.levels(1., 5);
+        CORNU_ASSERT(levels.size() == 5 && simplifier.numCached() == 5);
+
+        double tolerance = 1.;
+        for(int i = 0; i < (int)levels.size(); ++i, tolerance *= 2.)
+        {
+            CORNU_ASSERT(levels[i]);
+            int finer = i == 0 ? (int)original->primitives().size() : (int)levels[i - 1]->primitives().size();
+            CORNU_ASSERT(levels[i]->primitives().size() <= finer);
+            double dist = Cornu::CurveSimplifier::maxDistance(original, levels[i], 0.1);
+            CORNU_ASSERT_LT_MSG(dist, tolerance * 1.01, "Level is farther from the curve than its tolerance");
+        }
+        CORNU_ASSERT_MSG(levels.back()->primitives().size() < original->primitives().size(), "Nothing was simplified");
+
+        //cached versions are returned as they are
+        CORNU_ASSERT(simplifier.simplified(4.) == levels[2]);
+        double found;
+        CORNU_ASSERT(simplifier.coarsestWithin(5., &found) == levels[2] && found == 4.);
+        CORNU_ASSERT(simplifier.coarsestWithin(0.5, &found) == original && found == 0.);
+    }
+
+    void pipelineTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::Parameters params;
+        std::vector<Cornu::VectorC<Eigen::Vector2d> > strokes;
+        for(int i = 0; i < 12; ++i)
+        {
+            Cornu::VectorC<Eigen::Vector2d> pts(100 + 10 * i, Cornu::NOT_CIRCULAR);
+            for(int j = 0; j < pts.size(); ++j)
+                pts[j] = Eigen::Vector2d(100. + 3. * j, 100. + (30. + 5. * i) * sin(0.04 * j + 0.3 * i));
+            strokes.push_back(pts);
+        }
+
+        //results come out in order and match fitting the strokes one at a time
+        Cornu::StrokePipeline pipeline(params, 1);
+        std::thread producer([&]()
+        {
+            for(int i = 0; i < (int)strokes.size(); ++i)
+                pipeline.push(strokes[i]);
+            pipeline.finish();
+        });
+
+        int numResults = 0;
+        Cornu::PrimitiveSequenceConstPtr curve;
+        while(pipeline.pop(curve))
+        {
+            Cornu::Fitter fitter;
+            fitter.setParams(params);
+            fitter.setDebugging(Debugging::silent());
+            fitter.setOriginalSketch(new Cornu::Polyline(strokes[numResults]));
+            fitter.run();
+            Cornu::PrimitiveSequenceConstPtr single = fitter.finalOutput();
+            CORNU_ASSERT_MSG(!curve == !single, "Pipeline fit of stroke " << numResults << " failed where the single one didn't or vice versa");
+            CORNU_ASSERT_MSG(!curve || (curve->primitives().size() == single->primitives().size() && curve->length() == single->length()),
+                             "Pipeline result differs for stroke " << numResults);
+            ++numResults;
+        }
+        producer.join();
+        CORNU_ASSERT(numResults == (int)strokes.size());
+    }
+
+    void staticFitterTest()
+    {
+        using Cornu::Debugging; //for the assertion macros
+
+        Cornu::VectorC<Eigen::Vector2d> pts(300, Cornu::NOT_CIRCULAR);
+        for(int i = 0; i < pts.size(); ++i)
+            pts[i] = Eigen::Vector2d(2. * i, 100. * sin(i * 0.02) + 0.5 * sin(i * 1.7));
+        Cornu::PolylineConstPtr sketch = new Cornu::Polyline(pts);
+
+        //the streaming preliminary resampling, whatever the parameters say
+        Cornu::StaticFitter<0, 2> fixed;
+        Cornu::Parameters params;
+        params.setAlgorithm(Cornu::PRELIM_RESAMPLING, 1);
+        fixed.setParams(params);
+        fixed.setOriginalSketch(sketch);
+        fixed.run();
+        CORNU_ASSERT(fixed.params().getAlgorithm(Cornu::PRELIM_RESAMPLING) == 2);
+
+        Cornu::Fitter fitter;
+        params.setAlgorithm(Cornu::PRELIM_RESAMPLING, 2);
+        fitter.setParams(params);
+        fitter.setOriginalSketch(sketch);
+        fitter.run();
+        CORNU_ASSERT(fixed.finalOutput() && fitter.finalOutput());
+        CORNU_ASSERT(fixed.stageOutput<Cornu::COMBINING>().output->primitives().size() == fitter.finalOutput()->primitives().size());
+        CORNU_ASSERT_LT_MSG(fabs(fixed.finalOutput()->length() - fitter.finalOutput()->length()), 1e-8, "Static fitter differs from the same configuration");
+    }
+
     void fullAPITest()
     {
         //initialize the fitter
@@ -36,7 +36,7 @@ public:
     {
         const int num = 5000000;
 
-        VectorXd t(num), s1, c1, s2, c2;
+        VectorXd t(num), s1, c1, s2, c2, s3, c3;
 
         for(int i = 0; i < num; ++i) {
             t[i] = f(i, num);
@@ -50,12 +50,24 @@ public:
         fresnelApprox(t, &s2, &c2);
         Debugging::get()->elapsedTime("Fresnel approx");
 
-        ArrayXd diffV = (s1 - s2).array().square() + (c1 - c2).array().square();
-        ArrayXd errVec = (diffV / (s1.array().square() + c1.array().square())).sqrt();
-        double relErr = errVec.maxCoeff();
-        Debugging::get()->printf("Done, max relative error = %.10lf", relErr);
+        Debugging::get()->startTiming("Fresnel table");
+        fresnelTable(t, &s3, &c3);
+        Debugging::get()->elapsedTime("Fresnel table");
 
+        double relErr = maxRelErr(s1, c1, s2, c2);
+        Debugging::get()->printf("Done, max relative error = %.10lf", relErr);
         CORNU_ASSERT(relErr < 1e-6);
+
+        double tableRelErr = maxRelErr(s1, c1, s3, c3);
+        Debugging::get()->printf("Table max relative error = %.10lf", tableRelErr);
+        CORNU_ASSERT(tableRelErr < 1e-5);
+    }
+
+    double maxRelErr(const VectorXd &s1, const VectorXd &c1, const VectorXd &s2, const VectorXd &c2)
+    {
+        ArrayXd diffV = (s1 - s2).array().square() + (c1 - c2).array().square();
+        ArrayXd errVec = (diffV / (s1.array().square() + c1.array().square())).sqrt();
+        return errVec.maxCoeff();
     }
 
     double f(int i, int num)
@@ -21,6 +21,13 @@
 #include "Test.h"
 
 #include "Polyline.h"
+#include "StrokeCorpus.h"
+#include "JsonReader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
 
 using namespace std;
 using namespace Eigen;
@@ -48,6 +55,123 @@ public:
         pts2[2] = Vector2d(5, 4);
         
         testPolyline(Polyline(pts2));
+
+        testCorpus(pts1, pts2);
+        testJson(pts1);
+
+        VectorC<Vector2d> pts3(200, NOT_CIRCULAR);
+        for(int i = 0; i < pts3.size(); ++i)
+            pts3[i] = Vector2d(i + 0.3 * sin(i * 7.), 20. * sin(i * 0.1));
+        testCursor(Polyline(pts1));
+        testCursor(Polyline(pts2));
+        testCursor(Polyline(pts3));
+
+        //a polyline built up a point at a time matches one made from all the points
+        PolylinePtr grown = new Polyline(VectorC<Vector2d>(vector<Vector2d, aligned_allocator<Vector2d> >(pts1.begin(), pts1.begin() + 2), NOT_CIRCULAR));
+        grown->addPoint(pts1[2]);
+        Polyline whole(pts1);
+        CORNU_ASSERT(grown->pts().size() == 3);
+        CORNU_ASSERT_LT_MSG(fabs(grown->length() - whole.length()), 1e-10, "");
+        CORNU_ASSERT_LT_MSG(fabs(grown->idxToParam(2) - whole.idxToParam(2)), 1e-10, "");
+        testPolyline(*grown);
+    }
+
+    void testCorpus(const VectorC<Vector2d> &pts1, const VectorC<Vector2d> &pts2)
+    {
+        const char *fileName = "PolylineTest.cstk";
+        StrokeCorpusWriter writer;
+        CORNU_ASSERT(writer.open(fileName));
+        writer.add(pts1);
+        writer.add(pts2);
+        writer.add(pts1);
+        CORNU_ASSERT(writer.close());
+
+        StrokeCorpus corpus;
+        CORNU_ASSERT_MSG(corpus.open(fileName), corpus.error());
+        CORNU_ASSERT_MSG(corpus.size() == 3, corpus.size());
+        for(int i = 0; i < corpus.size(); ++i)
+        {
+            const VectorC<Vector2d> &pts = (i == 1) ? pts2 : pts1;
+            StrokeSpan span = corpus.stroke(i);
+            CORNU_ASSERT_MSG(span.size == pts.size(), span.size);
+            CORNU_ASSERT(span.closed == (pts.circular() == CIRCULAR));
+            CORNU_ASSERT(((size_t)span.pts & 15) == 0);
+
+            PolylineConstPtr poly = span.toPolyline();
+            CORNU_ASSERT(poly->isClosed() == span.closed);
+            for(int j = 0; j < pts.size(); ++j)
+                CORNU_ASSERT(poly->pts()[j] == pts[j]);
+        }
+        corpus.close();
+
+        //an index offset past the end of the file is rejected
+        FILE *file = fopen(fileName, "r+b");
+        CORNU_ASSERT(file);
+        fseek(file, 24, SEEK_SET);
+        long long badOffset = 1 << 30;
+        fwrite(&badOffset, 8, 1, file);
+        fclose(file);
+        CORNU_ASSERT(!corpus.open(fileName));
+        CORNU_ASSERT(!corpus.isOpen());
+
+        remove(fileName);
+    }
+
+    void testJson(const VectorC<Vector2d> &pts)
+    {
+        //numbers are read exactly, whether or not they take the fast path
+        const char *numbers[] = { "0", "-0.25", "123.456", "1e-7", "6.02214076e23", "0.1000000000000000055511151231257827",
+                                  "-2.2250738585072014e-308", "1.7976931348623157e308", "12345678901234567890" };
+        for(int i = 0; i < (int)(sizeof(numbers) / sizeof(numbers[0])); ++i)
+        {
+            double value;
+            CORNU_ASSERT(JsonReader::parseNumber(numbers[i], numbers[i] + strlen(numbers[i]), value));
+            CORNU_ASSERT_MSG(value == strtod(numbers[i], NULL), numbers[i]);
+        }
+        double value;
+        CORNU_ASSERT(JsonReader::parseNumber("-inf", "-inf" + 4, value) && value < -1e308);
+        CORNU_ASSERT(!JsonReader::parseNumber("true", "true" + 4, value));
+        CORNU_ASSERT(!JsonReader::parseNumber("1.5x", "1.5x" + 4, value));
+
+        ostringstream text;
+        text.precision(17);
+        text << "[ { \"pts\" : [ ";
+        for(int i = 0; i < pts.size(); ++i)
+            text << (i ? ", " : "") << pts[i][0] << ", " << pts[i][1];
+        text << " ], \"name\" : \"a \\\"b\\\"\", \"nested\" : [ [ 1, { \"x\" : [] } ], 2 ], \"closed\" : true } ]";
+        string json = text.str();
+
+        JsonReader reader(json.data(), json.data() + json.size());
+        CORNU_ASSERT(reader.next() == JsonReader::BEGIN_ARRAY && reader.next() == JsonReader::BEGIN_OBJECT);
+        CORNU_ASSERT(reader.next() == JsonReader::STRING && reader.text() == "pts" && reader.next() == JsonReader::BEGIN_ARRAY);
+        VectorC<Vector2d> readPts;
+        CORNU_ASSERT(reader.readPoints(readPts) && readPts.size() == pts.size());
+        for(int i = 0; i < pts.size(); ++i)
+            CORNU_ASSERT(readPts[i] == pts[i]);
+        CORNU_ASSERT(reader.next() == JsonReader::STRING && reader.next() == JsonReader::STRING);
+        CORNU_ASSERT_MSG(reader.text() == "a \"b\"", reader.text());
+        CORNU_ASSERT(reader.next() == JsonReader::STRING && reader.next() == JsonReader::BEGIN_ARRAY && reader.skipRest());
+        CORNU_ASSERT(reader.next() == JsonReader::STRING && reader.text() == "closed");
+        CORNU_ASSERT(reader.next() == JsonReader::WORD && reader.text() == "true");
+        CORNU_ASSERT(reader.next() == JsonReader::END_OBJECT && reader.next() == JsonReader::END_ARRAY && reader.next() == JsonReader::END);
+    }
+
+    //a cursor should agree with eval on sweeps, jumps forward and back, and laps around a closed polyline
+    void testCursor(const Polyline &p)
+    {
+        vector<double> params;
+        for(int i = 0; i <= 500; ++i)
+            params.push_back(p.length() * (p.isClosed() ? 3. : 1.) * i / 500.);
+        for(int i = 0; i < 100; ++i)
+            params.push_back(p.length() * fabs(sin(i * 1.7)));
+
+        Polyline::Cursor cursor(p);
+        for(int i = 0; i < (int)params.size(); ++i)
+        {
+            Vector2d pos, der;
+            cursor.eval(params[i], &pos, &der);
+            CORNU_ASSERT_LT_MSG((pos - p.pos(params[i])).norm() + (der - p.der(params[i])).norm(), 1e-10, "Cursor disagrees with eval at " << params[i]);
+        }
     }
 
     void testPolyline(const Polyline &p)
@@ -46,6 +46,8 @@ public:
             testArc();
         for(int i = 0; i < 1000; ++i)
             testClothoid();
+        for(int i = 0; i < 100; ++i)
+            testBlocks();
     }
 
     void testLine()
@@ -136,6 +138,38 @@ public:
         ClothoidPtr fitZero = fitter.getCurveWithZeroCurvature(fit->length() * 0.5);
         CORNU_ASSERT_LT_MSG(fabs(fitZero->curvature(fit->length() * 0.5)), 1e-10, "Curvature not zero where expected");
     }
+
+    //adding points in blocks fits the same primitives as adding them one at a time
+    void testBlocks()
+    {
+        ArcPtr orig = new Arc(Vector2d(drand(-1, 1), drand(-1, 1)), Vector2d(drand(-1, 1), drand(-1, 1)), Vector2d(drand(-1, 1), drand(-1, 1)));
+        if(orig->length() == 0.)
+            return;
+
+        vector<Vector2d, Eigen::aligned_allocator<Vector2d> > pts;
+        vector<double> weights;
+        for(int i = 0; i < 70; ++i)
+        {
+            pts.push_back(orig->pos(double(i) * orig->length() / 69.) + Vector2d(drand(-0.05, 0.05), drand(-0.05, 0.05)));
+            weights.push_back(drand(0.5, 2.));
+        }
+
+        FitterBasePtr single[3] = { new LineFitter(), new ArcFitter(), new ClothoidFitter() };
+        FitterBasePtr blocks[3] = { new LineFitter(), new ArcFitter(), new ClothoidFitter() };
+        for(int type = 0; type < 3; ++type)
+        {
+            const double *w = (type < 2) ? &weights[0] : NULL; //clothoids don't support weights
+            for(int i = 0; i < (int)pts.size(); ++i)
+                single[type]->addPointW(pts[i], w ? w[i] : 1.);
+            for(int start = 0, size = 1; start < (int)pts.size(); start += size, size *= 2)
+                blocks[type]->addPoints(&pts[start], w ? w + start : NULL, min(size, (int)pts.size() - start));
+
+            CurvePrimitivePtr singleFit = single[type]->getPrimitive(), blocksFit = blocks[type]->getPrimitive();
+            double diff = (singleFit->startPos() - blocksFit->startPos()).norm() + (singleFit->endPos() - blocksFit->endPos()).norm() +
+                          fabs(singleFit->length() - blocksFit->length());
+            CORNU_ASSERT_LT_MSG(diff, 1e-8, "Type " << type << " fits differently in blocks");
+        }
+    }
 };
 
 static PrimitiveFitterTest test;
@@ -21,7 +21,12 @@
 #include "Test.h"
 
 #include "PrimitiveSequence.h"
+#include "PrimitiveRope.h"
 #include "Line.h"
+#include "Arc.h"
+#include "Clothoid.h"
+#include "Bezier.h"
+#include "CompactCurve.h"
 
 using namespace std;
 using namespace Eigen;
@@ -57,6 +62,329 @@ public:
             prims2[i] = new Line(pts2[i], pts2[(i + 1) % 3]);
         
         testPrimitiveSequence(PrimitiveSequence(prims2));
+
+        testProjection();
+        testRope();
+        testAdaptiveBezier();
+        testTessellate();
+        testCompact();
+        testIntersections();
+    }
+
+    //projection through the bounding box tree should find the same point as checking every primitive
+    void testProjection()
+    {
+        VectorC<CurvePrimitiveConstPtr> prims(0, NOT_CIRCULAR);
+        Vector2d pos(0, 0);
+        double angle = 0;
+        for(int i = 0; i < 300; ++i)
+        {
+            CurvePrimitivePtr prim;
+            if(i % 3 == 0)
+                prim = new Line(pos, pos + 5. * Vector2d(cos(angle), sin(angle)));
+            else if(i % 3 == 1)
+                prim = new Arc(pos, angle, 6., 0.1 * sin(0.1 * i));
+            else
+                prim = new Clothoid(pos, angle, 8., 0.1 * sin(0.1 * i), -0.1 * cos(0.07 * i));
+            prims.push_back(prim);
+            pos = prim->endPos();
+            angle = prim->endAngle();
+        }
+        PrimitiveSequence seq(prims);
+
+        Matrix2Xd queries(2, 500);
+        for(int i = 0; i < queries.cols(); ++i)
+            queries.col(i) = seq.pos(seq.length() * i / queries.cols()) + 20. * Vector2d(sin(1.3 * i), cos(2.1 * i));
+        VectorXd many = seq.projectMany(queries);
+
+        for(int i = 0; i < queries.cols(); ++i)
+        {
+            Vector2d pt = queries.col(i);
+            double minDistSq = 1e50;
+            for(int j = 0; j < prims.size(); ++j)
+                minDistSq = min(minDistSq, (prims[j]->pos(prims[j]->project(pt)) - pt).squaredNorm());
+
+            CORNU_ASSERT_LT_MSG(fabs(seq.distanceSqTo(pt) - minDistSq), 1e-8, "Incorrect projection");
+            CORNU_ASSERT_LT_MSG(fabs((seq.pos(seq.project(pt)) - pt).squaredNorm() - minDistSq), 1e-8, "Incorrect projection");
+            CORNU_ASSERT_LT_MSG(fabs((seq.pos(many[i]) - pt).squaredNorm() - minDistSq), 1e-8, "Incorrect batch projection");
+        }
+    }
+
+    //the adaptive Bezier spline should stay within the tolerance of the curve, however tight the turns
+    void testAdaptiveBezier()
+    {
+        VectorC<CurvePrimitiveConstPtr> prims(0, NOT_CIRCULAR);
+        Vector2d pos(0, 0);
+        double angle = 0;
+        for(int i = 0; i < 30; ++i)
+        {
+            CurvePrimitivePtr prim;
+            if(i % 3 == 0)
+                prim = new Line(pos, pos + 5. * Vector2d(cos(angle), sin(angle)));
+            else if(i % 3 == 1)
+                prim = new Arc(pos, angle, 10., 2. * sin(0.7 * i));
+            else
+                prim = new Clothoid(pos, angle, 10., sin(0.7 * i), -0.5 * cos(0.3 * i));
+            prims.push_back(prim);
+            pos = prim->endPos();
+            angle = prim->endAngle();
+        }
+        PrimitiveSequence seq(prims);
+
+        const double tolerances[3] = { 1., 0.1, 0.001 };
+        int prevSize = 0;
+        for(int t = 0; t < 3; ++t)
+        {
+            BezierSplinePtr spline = seq.toAdaptiveBezierSpline(tolerances[t]);
+            const BezierSpline::PrimitiveVector &beziers = spline->primitives();
+            CORNU_ASSERT_MSG((int)beziers.size() > prevSize, "A tighter tolerance should need more Beziers");
+            prevSize = (int)beziers.size();
+
+            double maxDist = 0.;
+            for(int i = 0; i < (int)beziers.size(); ++i)
+            {
+                for(int k = 0; k <= 20; ++k)
+                {
+                    Vector2d pt;
+                    beziers[i].eval(k / 20., &pt);
+                    maxDist = max(maxDist, sqrt(seq.distanceSqTo(pt)));
+                }
+                if(i > 0)
+                    CORNU_ASSERT_LT_MSG((beziers[i].controlPoint(0) - beziers[i - 1].controlPoint(3)).norm(), 1e-8, "Beziers should connect");
+            }
+            CORNU_ASSERT_LT_MSG(maxDist, 1.2 * tolerances[t], "Bezier spline is too far from the curve");
+        }
+    }
+
+    //the tessellation should be within the tolerance of the curve, with the arc length and tangent of each vertex
+    void testTessellate()
+    {
+        VectorC<CurvePrimitiveConstPtr> prims(0, NOT_CIRCULAR);
+        Vector2d pos(0, 0);
+        double angle = 0;
+        for(int i = 0; i < 30; ++i)
+        {
+            CurvePrimitivePtr prim;
+            if(i % 3 == 0)
+                prim = new Line(pos, pos + 5. * Vector2d(cos(angle), sin(angle)));
+            else if(i % 3 == 1)
+                prim = new Arc(pos, angle, 10., 2. * sin(0.7 * i));
+            else
+                prim = new Clothoid(pos, angle, 10., sin(0.7 * i), -0.5 * cos(0.3 * i));
+            prims.push_back(prim);
+            pos = prim->endPos();
+            angle = prim->endAngle();
+        }
+        PrimitiveSequence seq(prims);
+
+        const double tolerance = 0.05;
+        int num = seq.tessellate(tolerance, (CurveVertex *)NULL, 0);
+        vector<CurveVertex> vertices(num);
+        CORNU_ASSERT(seq.tessellate(tolerance, &vertices[0], num) == num);
+        CORNU_ASSERT_LT_MSG(fabs(vertices.back().arcLength - seq.length()), 1e-3, "Tessellation should cover the curve");
+
+        double maxDist = 0.;
+        for(int i = 0; i < num; ++i)
+        {
+            Vector2d vertexPos(vertices[i].pos[0], vertices[i].pos[1]), tangent(vertices[i].tangent[0], vertices[i].tangent[1]);
+            CORNU_ASSERT_LT_MSG((vertexPos - seq.pos(vertices[i].arcLength)).norm(), 1e-3, "Vertex should be at its arc length");
+            CORNU_ASSERT_LT_MSG((tangent - seq.der(vertices[i].arcLength)).norm(), 1e-3, "Vertex tangent is wrong");
+            if(i == 0)
+                continue;
+            CORNU_ASSERT(vertices[i].arcLength > vertices[i - 1].arcLength);
+            Vector2d prevPos(vertices[i - 1].pos[0], vertices[i - 1].pos[1]);
+            for(int k = 1; k < 10; ++k)
+                maxDist = max(maxDist, (seq.pos(vertices[i - 1].arcLength + (vertices[i].arcLength - vertices[i - 1].arcLength) * k / 10.) -
+                                        (prevPos + (vertexPos - prevPos) * k / 10.)).norm());
+        }
+        CORNU_ASSERT_LT_MSG(maxDist, tolerance * 1.01, "Tessellation is too far from the curve");
+
+        //the quantized vertices should dequantize to nearly the same ones
+        vector<QuantizedCurveVertex> quantized(num);
+        CORNU_ASSERT(seq.tessellate(tolerance, &quantized[0], num) == num);
+        const AlignedBox2d &box = seq.boundingBox();
+        for(int i = 0; i < num; ++i)
+        {
+            for(int k = 0; k < 2; ++k)
+            {
+                double coord = box.min()[k] + (box.max()[k] - box.min()[k]) * quantized[i].pos[k] / 65535.;
+                CORNU_ASSERT_LT_MSG(fabs(coord - vertices[i].pos[k]), 1e-3, "Quantized position is off");
+            }
+        }
+    }
+
+    //the compact encoding should decode to a curve within the tolerance of the original, even across a gap
+    void testCompact()
+    {
+        VectorC<CurvePrimitiveConstPtr> prims(0, NOT_CIRCULAR);
+        Vector2d pos(100, 200);
+        double angle = 0;
+        for(int i = 0; i < 60; ++i)
+        {
+            CurvePrimitivePtr prim;
+            if(i % 3 == 0)
+                prim = new Line(pos, pos + 5. * Vector2d(cos(angle), sin(angle)));
+            else if(i % 3 == 1)
+                prim = new Arc(pos, angle, 10., 0.2 * sin(0.7 * i));
+            else
+                prim = new Clothoid(pos, angle, 10., 0.1 * sin(0.7 * i), -0.05 * cos(0.3 * i));
+            prims.push_back(prim);
+            pos = prim->endPos() + (i == 30 ? Vector2d(3., -2.) : Vector2d::Zero());
+            angle = prim->endAngle();
+        }
+        PrimitiveSequenceConstPtr seq = new PrimitiveSequence(prims);
+
+        const double tolerances[] = { 0.5, 0.01 };
+        for(int t = 0; t < 2; ++t)
+        {
+            vector<unsigned char> data = encodeCompactCurve(seq, tolerances[t]);
+            CORNU_ASSERT_LT_MSG((int)data.size(), (int)prims.size() * 10, "Encoding is not compact");
+            PrimitiveSequenceConstPtr decoded = decodeCompactCurve(data);
+            CORNU_ASSERT(decoded && decoded->primitives().size() == prims.size() && !decoded->isClosed());
+
+            double maxDist = 0.;
+            for(int i = 0; i <= 1000; ++i)
+            {
+                maxDist = max(maxDist, seq->distanceTo(decoded->pos(decoded->length() * i / 1000.)));
+                maxDist = max(maxDist, decoded->distanceTo(seq->pos(seq->length() * i / 1000.)));
+            }
+            CORNU_ASSERT_LT_MSG(maxDist, tolerances[t], "Decoded curve is too far from the original");
+
+            //truncated or damaged data should be rejected rather than misread
+            CORNU_ASSERT(!decodeCompactCurve(&data[0], data.size() - 1));
+            data[0] = 'X';
+            CORNU_ASSERT(!decodeCompactCurve(data));
+        }
+    }
+
+    //edits of a rope should match the same edits of a sequence and leave the original rope alone
+    //a wiggly curve of all three kinds of primitives, turned by rotation about center
+    static PrimitiveSequenceConstPtr wigglyCurve(const Vector2d &center, double rotation)
+    {
+        VectorC<CurvePrimitiveConstPtr> prims(0, NOT_CIRCULAR);
+        Vector2d pos = center + Rotation2D<double>(rotation) * Vector2d(-150., 0.);
+        double angle = rotation;
+        for(int i = 0; i < 30; ++i)
+        {
+            CurvePrimitivePtr prim;
+            if(i % 3 == 0)
+                prim = new Line(pos, pos + 5. * Vector2d(cos(angle), sin(angle)));
+            else if(i % 3 == 1)
+                prim = new Arc(pos, angle, 10., 0.15 * sin(0.7 * i));
+            else
+                prim = new Clothoid(pos, angle, 10., 0.1 * sin(0.7 * i), -0.15 * sin(0.7 * i));
+            prims.push_back(prim);
+            pos = prim->endPos();
+            angle = prim->endAngle();
+        }
+        return new PrimitiveSequence(prims);
+    }
+
+    //intersections and closest approach through the trees should match dense polylines
+    void testIntersections()
+    {
+        PrimitiveSequenceConstPtr curves[2] = { wigglyCurve(Vector2d(100., 100.), 0.), wigglyCurve(Vector2d(100., 150.), 0.5) };
+
+        const int numSamples = 3000;
+        Matrix2Xd pts[2];
+        for(int c = 0; c < 2; ++c)
+            curves[c]->evalBatch(VectorXd::LinSpaced(numSamples + 1, 0., curves[c]->length()), &pts[c]);
+
+        int numCrossings = 0;
+        for(int i = 0; i < numSamples; ++i)
+            for(int j = 0; j < numSamples; ++j)
+            {
+                Vector2d d1 = pts[0].col(i + 1) - pts[0].col(i), d2 = pts[1].col(j + 1) - pts[1].col(j);
+                Vector2d diff = pts[1].col(j) - pts[0].col(i);
+                double det = d1[0] * d2[1] - d1[1] * d2[0];
+                double t = (diff[0] * d2[1] - diff[1] * d2[0]) / det, u = (diff[0] * d1[1] - diff[1] * d1[0]) / det;
+                if(t >= 0. && t < 1. && u >= 0. && u < 1.)
+                    ++numCrossings;
+            }
+
+        vector<CurveIntersection> crossings = curves[0]->intersections(*curves[1]);
+        CORNU_ASSERT_MSG(numCrossings > 0, "Test curves don't cross");
+        CORNU_ASSERT_MSG((int)crossings.size() == numCrossings, "Wrong number of intersections");
+        for(int i = 0; i < (int)crossings.size(); ++i)
+            CORNU_ASSERT_LT_MSG((curves[0]->pos(crossings[i].s1) - curves[1]->pos(crossings[i].s2)).norm(), 1e-6, "Intersection is off the curves");
+
+        //move the second curve off the first so that they don't cross
+        PrimitiveSequenceConstPtr moved = wigglyCurve(Vector2d(110., 250.), 0.5);
+        moved->evalBatch(VectorXd::LinSpaced(numSamples + 1, 0., moved->length()), &pts[1]);
+        CORNU_ASSERT(curves[0]->intersections(*moved).empty());
+
+        double minDist = 1e10;
+        for(int i = 0; i <= numSamples; ++i)
+            minDist = min(minDist, curves[0]->distanceTo(pts[1].col(i)));
+
+        double s, otherS;
+        double dist = curves[0]->closestApproach(*moved, &s, &otherS);
+        CORNU_ASSERT_LT_MSG(dist, minDist + 1e-9, "Closest approach missed the closest points");
+        CORNU_ASSERT_LT_MSG(minDist - dist, 1e-2, "Closest approach is too close");
+        CORNU_ASSERT_LT_MSG(fabs((curves[0]->pos(s) - moved->pos(otherS)).norm() - dist), 1e-9, "Closest points don't match the distance");
+        CORNU_ASSERT(curves[0]->closestApproach(*moved, NULL, NULL, 0.5 * dist) == numeric_limits<double>::infinity());
+        CORNU_ASSERT(curves[0]->closestApproach(*curves[1]) < 1e-6);
+    }
+
+    void testRope()
+    {
+        VectorC<CurvePrimitiveConstPtr> prims(0, NOT_CIRCULAR);
+        Vector2d pos(0, 0);
+        double angle = 0;
+        for(int i = 0; i < 200; ++i)
+        {
+            CurvePrimitivePtr prim;
+            if(i % 2 == 0)
+                prim = new Arc(pos, angle, 6., 0.1 * sin(0.1 * i));
+            else
+                prim = new Clothoid(pos, angle, 8., 0.1 * sin(0.1 * i), -0.1 * cos(0.07 * i));
+            prims.push_back(prim);
+            pos = prim->endPos();
+            angle = prim->endAngle();
+        }
+        PrimitiveSequence seq(prims);
+        PrimitiveRope rope(prims);
+        CORNU_ASSERT(rope.size() == prims.size() && fabs(rope.length() - seq.length()) < 1e-8);
+
+        for(double s = 0.; s <= seq.length(); s += 2.7)
+        {
+            double seqParam, ropeParam;
+            CORNU_ASSERT_MSG(rope.paramToIdx(s, &ropeParam) == seq.paramToIdx(s, &seqParam) && fabs(ropeParam - seqParam) < 1e-8, "Incorrect rope index");
+            Vector2d pt = seq.pos(s) + 15. * Vector2d(sin(s), cos(1.7 * s));
+            CORNU_ASSERT_LT_MSG(fabs((rope.pos(rope.project(pt)) - pt).squaredNorm() - seq.distanceSqTo(pt)), 1e-8, "Incorrect rope projection");
+        }
+
+        //trims share the primitives they keep whole
+        for(double from = 0.; from < seq.length(); from += 37.3)
+        {
+            for(double to = from + 0.5; to < seq.length() + 20.; to += 91.1)
+            {
+                PrimitiveRope trim = rope.trimmed(from, to);
+                PrimitiveSequencePtr seqTrim = seq.trimmed(from, to);
+                CORNU_ASSERT_MSG(trim.size() == seqTrim->primitives().size() && fabs(trim.length() - seqTrim->length()) < 1e-8, "Incorrect rope trim");
+                for(double x = 0; x < trim.length(); x += 3.1)
+                    CORNU_ASSERT_LT_MSG((trim.pos(x) - seq.pos(from + x)).norm(), 1e-8, "Incorrect rope trim");
+                for(int i = 1; i + 1 < trim.size(); ++i)
+                    CORNU_ASSERT(trim.primitive(i) == seqTrim->primitives()[i]);
+            }
+        }
+
+        //a splice replaces the middle, and the old rope, kept as an undo step, still has the old curve
+        PrimitiveRope replacement(new Line(seq.pos(500.), seq.pos(700.)));
+        PrimitiveRope edited = rope.spliced(500., 700., replacement);
+        CORNU_ASSERT_LT_MSG(fabs(edited.length() - (seq.length() - 200. + replacement.length())), 1e-8, "Incorrect splice");
+        CORNU_ASSERT_LT_MSG((edited.pos(500. + 0.5 * replacement.length()) - 0.5 * (seq.pos(500.) + seq.pos(700.))).norm(), 1e-8, "Incorrect splice");
+        CORNU_ASSERT_LT_MSG((edited.pos(edited.length()) - seq.endPos()).norm(), 1e-8, "Incorrect splice");
+        CORNU_ASSERT(rope.size() == prims.size() && (rope.pos(600.) - seq.pos(600.)).norm() < 1e-8);
+
+        //building one primitive at a time keeps the tree balanced, so the result matches
+        PrimitiveRope grown;
+        for(int i = 0; i < prims.size(); ++i)
+            grown = grown.concatenated(PrimitiveRope(prims[i]));
+        for(int i = 0; i < prims.size(); ++i)
+            CORNU_ASSERT(grown.primitive(i) == prims[i]);
+        PrimitiveSequencePtr back = grown.sliced(50, 150).toSequence();
+        CORNU_ASSERT(back->primitives().size() == 100 && back->primitives()[0] == prims[50] && back->primitives()[99] == prims[149]);
     }
 
     void testPrimitiveSequence(const PrimitiveSequence &p)
@@ -20,8 +20,10 @@
 
 #include "Test.h"
 #include "Debugging.h"
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
-#include <ctime>
+#include <chrono>
 #include <cstdarg>
 #include <map>
 
@@ -46,6 +48,8 @@ public:
     }
 
     //overrides
+    bool isDebuggingOn() const { return true; }
+
     void printf(const char *fmt, ...)
     {
         const int sz = 200; //we don't need terribly long debug strings
@@ -65,7 +69,7 @@ public:
 
     void startTiming(const string &description)
     {
-        _startTimes[description] = clock();
+        _startTimes[description] = chrono::steady_clock::now();
     }
     void elapsedTime(const string &description = "")
     {
@@ -75,8 +79,8 @@ public:
 
             return;
         }
-        int diff = clock() - _startTimes[description];
-        printf("Timing: %20s   ---   %.3lf", description.c_str(), double(diff) / CLOCKS_PER_SEC);
+        double diff = chrono::duration<double>(chrono::steady_clock::now() - _startTimes[description]).count();
+        printf("Timing: %20s   ---   %.3lf", description.c_str(), diff);
     }
 
     //not overrides
@@ -86,7 +90,7 @@ public:
 private:
     DebuggingTestImpl() : _indent(0) {}
 
-    map<string, int> _startTimes; 
+    map<string, chrono::steady_clock::time_point> _startTimes; //wall time
     int _indent;
 };
 
@@ -96,6 +100,67 @@ std::vector<TestCase *> &TestCase::allTests()
     return _allTests;
 }
 
+//Sorting and floating point arithmetic, about what fitting does--the fastest of several runs
+static double _timeCalibrationLoop()
+{
+    typedef chrono::steady_clock Clock;
+
+    vector<double> values(1 << 16);
+    double best = 1e10, sum = 0.;
+    for(int run = 0; run < 5; ++run)
+    {
+        Clock::time_point start = Clock::now();
+        unsigned int seed = 12345;
+        for(int i = 0; i < (int)values.size(); ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            values[i] = double(seed) / 4294967296.;
+        }
+        sort(values.begin(), values.end());
+        for(int i = 0; i < (int)values.size(); ++i)
+            sum += sqrt(values[i]) * sin(values[i]);
+        best = min(best, chrono::duration<double>(Clock::now() - start).count());
+    }
+    values[0] = sum; //keeps the loop from being optimized away
+    return best;
+}
+
+double TestCase::calibrationTime()
+{
+    static const double time = _timeCalibrationLoop();
+    return time;
+}
+
+double TestCase::perfSlack()
+{
+    if(const char *slack = getenv("CORNUCOPIA_PERF_SLACK"))
+        return atof(slack);
+#ifdef __OPTIMIZE__
+    return 3.;
+#else
+    return 0.; //unoptimized timings say nothing about optimized ones
+#endif
+}
+
+void TestCase::assertTimeBudget(const string &description, double budget, const function<void()> &op, int runs)
+{
+    if(perfSlack() <= 0.)
+        return;
+
+    vector<double> times;
+    for(int i = 0; i < runs; ++i)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        op();
+        times.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    sort(times.begin(), times.end());
+    double units = times[times.size() / 2] / calibrationTime();
+
+    Debugging::get()->printf("Performance: %s takes %.1f calibration units (budget %.1f)", description.c_str(), units, budget);
+    CORNU_ASSERT_MSG(units <= budget * perfSlack(), description << " is over its time budget by more than a factor of " << perfSlack());
+}
+
 //To make sure tests run in a consistent order, we sort them by name
 struct TestComparator
 {
@@ -106,7 +171,10 @@ int main()
 {
     std::sort(TestCase::allTests().begin(), TestCase::allTests().end(), TestComparator());
 
-    DebuggingTestImpl::get()->printf("Starting tests\n");
+    DebuggingTestImpl::get()->printf("Starting tests");
+    if(TestCase::perfSlack() > 0.)
+        DebuggingTestImpl::get()->printf("Calibration loop: %.3lf ms, performance slack factor %.1f", 1000. * TestCase::calibrationTime(), TestCase::perfSlack());
+    DebuggingTestImpl::get()->printf("");
 
     bool anyFailed = false;
 
@@ -23,6 +23,7 @@
 
 #include <vector>
 #include <string>
+#include <functional>
 
 #include "TestUtils.h"
 
@@ -48,6 +49,15 @@ public:
     virtual std::string name() { return "Unnamed"; }
 
     static std::vector<TestCase *> &allTests(); //Meyer's singleton
+
+    //Performance assertion: runs op several times and fails if the median time exceeds the budget times the slack
+    //factor.  The budget is in units of the time a fixed calibration loop takes, so that it means the same on
+    //slower and faster machines.  The slack factor is 3 unless the CORNUCOPIA_PERF_SLACK environment variable sets
+    //it; 0 turns the checks off, as does compiling without optimization.
+    static void assertTimeBudget(const std::string &description, double budget, const std::function<void()> &op, int runs = 5);
+
+    static double calibrationTime(); //in seconds, measured once
+    static double perfSlack();
 };
 
 #endif //CORNUCOPIA_TEST_H_INCLUDED